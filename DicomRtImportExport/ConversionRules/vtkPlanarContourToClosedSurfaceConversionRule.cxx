@@ -20,6 +20,9 @@
 
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
 
+// SlicerRt includes
+#include "vtkSlicerRtTaskPool.h"
+
 // VTK includes
 #include <vtkVersion.h>
 #include <vtkObjectFactory.h>
@@ -46,9 +49,14 @@
 #include <vtkTransform.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkUnstructuredGrid.h>
+#include <vtkIdTypeArray.h>
+#include <vtkMutexLock.h>
+#include <vtkVariant.h>
 
 // STD includes
 #include <algorithm>
+#include <cmath>
+#include <vector>
 
 //----------------------------------------------------------------------------
 vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToClosedSurfaceConversionRule);
@@ -69,6 +77,8 @@ vtkPlanarContourToClosedSurfaceConversionRule::vtkPlanarContourToClosedSurfaceCo
 
   this->ConversionParameters[this->GetDefaultSliceThicknessParameterName()] = std::make_pair("0.0",
     "Default thickness for contours if slice spacing cannot be calculated.");
+  this->ConversionParameters[this->GetNumberOfThreadsParameterName()] = std::make_pair("0",
+    "Number of threads used for triangulating between the contour planes (0 = number of processors, 1 = no multi-threading).");
 }
 
 //----------------------------------------------------------------------------
@@ -112,6 +122,321 @@ vtkDataObject* vtkPlanarContourToClosedSurfaceConversionRule::ConstructRepresent
     }
 }
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Find the closest point to a query point among the points of a contour.
+  /// The points are sorted into a uniform grid of buckets in the XY plane (the contours are aligned with the
+  /// XY plane when triangulated), and the buckets are searched in rings around the query point until the
+  /// XY distance of the unvisited buckets exceeds the closest distance found. The result is the same as
+  /// that of a linear search: the lowest index is returned if multiple points are at the same distance.
+  class ContourPointLocator
+  {
+  public:
+    ContourPointLocator() : Points(NULL), NumberOfPoints(0), BucketSize(1.0)
+    {
+      this->Origin[0] = this->Origin[1] = 0.0;
+      this->Dimensions[0] = this->Dimensions[1] = 1;
+    }
+
+    /// Sort the points into buckets. The point coordinates (x,y,z triplets) must not change while the locator is used.
+    void Build(const double* points, int numberOfPoints)
+    {
+      this->Points = points;
+      this->NumberOfPoints = numberOfPoints;
+      if (numberOfPoints < MINIMUM_NUMBER_OF_POINTS_FOR_BUCKETS)
+        {
+        // Linear search is faster for short contours
+        return;
+        }
+
+      double bounds[4] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+      for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+        {
+        const double* point = points + 3*pointIndex;
+        bounds[0] = std::min(bounds[0], point[0]);
+        bounds[1] = std::max(bounds[1], point[0]);
+        bounds[2] = std::min(bounds[2], point[1]);
+        bounds[3] = std::max(bounds[3], point[1]);
+        }
+      double extent[2] = { bounds[1]-bounds[0], bounds[3]-bounds[2] };
+
+      // Square buckets containing a few points each on average. For contours that are thin in one direction
+      // the buckets are not made smaller than needed for the longer side.
+      int targetNumberOfBuckets = std::max(1, numberOfPoints / POINTS_PER_BUCKET);
+      double bucketSize = sqrt(extent[0] * extent[1] / targetNumberOfBuckets);
+      bucketSize = std::max(bucketSize, std::max(extent[0], extent[1]) / targetNumberOfBuckets);
+      if (bucketSize <= 0.0)
+        {
+        bucketSize = 1.0;
+        }
+      this->BucketSize = bucketSize;
+      this->Origin[0] = bounds[0];
+      this->Origin[1] = bounds[2];
+      this->Dimensions[0] = std::min(targetNumberOfBuckets, (int)(extent[0] / bucketSize) + 1);
+      this->Dimensions[1] = std::min(targetNumberOfBuckets, (int)(extent[1] / bucketSize) + 1);
+
+      // Sort point indices by bucket (counting sort keeps the point indices ascending within each bucket)
+      int numberOfBuckets = this->Dimensions[0] * this->Dimensions[1];
+      this->BucketOffsets.assign(numberOfBuckets + 1, 0);
+      this->PointBuckets.resize(numberOfPoints);
+      for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+        {
+        const double* point = points + 3*pointIndex;
+        int bucket = this->GetBucketIndex(point[0], 0) + this->GetBucketIndex(point[1], 1) * this->Dimensions[0];
+        this->PointBuckets[pointIndex] = bucket;
+        ++this->BucketOffsets[bucket+1];
+        }
+      for (int bucket = 0; bucket < numberOfBuckets; ++bucket)
+        {
+        this->BucketOffsets[bucket+1] += this->BucketOffsets[bucket];
+        }
+      this->BucketPointIndices.resize(numberOfPoints);
+      this->BucketFillPositions.assign(this->BucketOffsets.begin(), this->BucketOffsets.end()-1);
+      for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+        {
+        this->BucketPointIndices[this->BucketFillPositions[this->PointBuckets[pointIndex]]++] = pointIndex;
+        }
+    }
+
+    /// Get the index of the contour point closest to the given point
+    int FindClosestPoint(const double* queryPoint) const
+    {
+      if (this->NumberOfPoints < MINIMUM_NUMBER_OF_POINTS_FOR_BUCKETS)
+        {
+        int closestPointIndex = 0;
+        double minimumDistance = vtkMath::Distance2BetweenPoints(queryPoint, this->Points);
+        for (int pointIndex = 1; pointIndex < this->NumberOfPoints; ++pointIndex)
+          {
+          double distance = vtkMath::Distance2BetweenPoints(queryPoint, this->Points + 3*pointIndex);
+          if (distance < minimumDistance)
+            {
+            minimumDistance = distance;
+            closestPointIndex = pointIndex;
+            }
+          }
+        return closestPointIndex;
+        }
+
+      int centerBucket[2] = { this->GetBucketIndex(queryPoint[0], 0), this->GetBucketIndex(queryPoint[1], 1) };
+      // Tolerance for the rounding errors of assigning points to buckets
+      double boundTolerance = 1.0e-9 * this->BucketSize;
+
+      int closestPointIndex = -1;
+      double minimumDistance = VTK_DOUBLE_MAX;
+      for (int ring = 0; ; ++ring)
+        {
+        int ringMin[2] = { centerBucket[0] - ring, centerBucket[1] - ring };
+        int ringMax[2] = { centerBucket[0] + ring, centerBucket[1] + ring };
+        int firstRow = std::max(ringMin[1], 0);
+        int lastRow = std::min(ringMax[1], this->Dimensions[1]-1);
+        int firstColumn = std::max(ringMin[0], 0);
+        int lastColumn = std::min(ringMax[0], this->Dimensions[0]-1);
+        for (int row = firstRow; row <= lastRow; ++row)
+          {
+          bool fullRow = (row == ringMin[1] || row == ringMax[1]);
+          for (int column = firstColumn; column <= lastColumn; ++column)
+            {
+            if (!fullRow && column != ringMin[0] && column != ringMax[0])
+              {
+              // Inner buckets were visited in previous rings, jump to the other side of the ring
+              if (ringMax[0] > lastColumn)
+                {
+                break;
+                }
+              column = ringMax[0];
+              }
+            this->SearchBucket(column + row * this->Dimensions[0], queryPoint, closestPointIndex, minimumDistance);
+            }
+          }
+
+        // Compute lower bound for the distance of points in buckets that have not been visited yet
+        bool unvisitedBucketsExist = false;
+        double distanceLowerBound = VTK_DOUBLE_MAX;
+        for (int axis = 0; axis < 2; ++axis)
+          {
+          if (ringMin[axis] > 0)
+            {
+            unvisitedBucketsExist = true;
+            distanceLowerBound = std::min(distanceLowerBound, queryPoint[axis] - (this->Origin[axis] + ringMin[axis] * this->BucketSize));
+            }
+          if (ringMax[axis] < this->Dimensions[axis]-1)
+            {
+            unvisitedBucketsExist = true;
+            distanceLowerBound = std::min(distanceLowerBound, this->Origin[axis] + (ringMax[axis]+1) * this->BucketSize - queryPoint[axis]);
+            }
+          }
+        if (!unvisitedBucketsExist)
+          {
+          break;
+          }
+        distanceLowerBound -= boundTolerance;
+        if (closestPointIndex >= 0 && distanceLowerBound > 0.0 && distanceLowerBound * distanceLowerBound > minimumDistance)
+          {
+          break;
+          }
+        }
+
+      return closestPointIndex;
+    }
+
+  protected:
+    int GetBucketIndex(double coordinate, int axis) const
+    {
+      double bucketIndex = (coordinate - this->Origin[axis]) / this->BucketSize;
+      if (!(bucketIndex > 0.0))
+        {
+        return 0;
+        }
+      if (bucketIndex >= this->Dimensions[axis])
+        {
+        return this->Dimensions[axis]-1;
+        }
+      return (int)bucketIndex;
+    }
+
+    void SearchBucket(int bucket, const double* queryPoint, int& closestPointIndex, double& minimumDistance) const
+    {
+      for (int position = this->BucketOffsets[bucket]; position < this->BucketOffsets[bucket+1]; ++position)
+        {
+        int pointIndex = this->BucketPointIndices[position];
+        double distance = vtkMath::Distance2BetweenPoints(queryPoint, this->Points + 3*pointIndex);
+        if (distance < minimumDistance || (distance == minimumDistance && pointIndex < closestPointIndex))
+          {
+          minimumDistance = distance;
+          closestPointIndex = pointIndex;
+          }
+        }
+    }
+
+  protected:
+    static const int MINIMUM_NUMBER_OF_POINTS_FOR_BUCKETS = 32;
+    static const int POINTS_PER_BUCKET = 4;
+
+    const double* Points;
+    int NumberOfPoints;
+    double Origin[2];
+    double BucketSize;
+    int Dimensions[2];
+    std::vector<int> BucketOffsets;
+    std::vector<int> BucketPointIndices;
+    std::vector<int> BucketFillPositions;
+    std::vector<int> PointBuckets;
+  };
+}
+
+//----------------------------------------------------------------------------
+class vtkPlanarContourToClosedSurfaceConversionRule::TriangulationWorkspace
+{
+public:
+  /// Make sure that the buffers are large enough for the given contour sizes, so that no allocation happens
+  /// while triangulating. The buffers never shrink.
+  void Reserve(int maximumNumberOfPointsInLine, vtkIdType maximumTableSize)
+  {
+    this->Line1Points.reserve(3 * maximumNumberOfPointsInLine);
+    this->Line2Points.reserve(3 * maximumNumberOfPointsInLine);
+    this->ClosestPointFromLine1ToLine2Ids.reserve(maximumNumberOfPointsInLine);
+    this->ClosestPointFromLine2ToLine1Ids.reserve(maximumNumberOfPointsInLine);
+    this->FirstColumnScores.reserve(maximumNumberOfPointsInLine);
+    this->ScoreRows.reserve(2 * maximumNumberOfPointsInLine);
+    this->BacktrackTable.reserve(maximumTableSize);
+  }
+
+  /// Copy the coordinates of the points in the line to a contiguous buffer
+  static void GatherLinePoints(vtkPoints* points, vtkIdList* linePointIds, std::vector<double>& linePoints)
+  {
+    vtkIdType numberOfPoints = linePointIds->GetNumberOfIds();
+    linePoints.resize(3 * numberOfPoints);
+    for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+      {
+      points->GetPoint(linePointIds->GetId(pointIndex), &linePoints[3*pointIndex]);
+      }
+  }
+
+  /// Point coordinates of the two lines, in the order of the point ID lists
+  std::vector<double> Line1Points;
+  std::vector<double> Line2Points;
+
+  /// Closest point indices between the lines and the locators used for finding them
+  std::vector<vtkIdType> ClosestPointFromLine1ToLine2Ids;
+  std::vector<vtkIdType> ClosestPointFromLine2ToLine1Ids;
+  ContourPointLocator Line1PointLocator;
+  ContourPointLocator Line2PointLocator;
+
+  /// Score of the first column of the dynamic programming table
+  std::vector<double> FirstColumnScores;
+  /// Previous and current row of the score table (only these are needed when filling the table)
+  std::vector<double> ScoreRows;
+  /// Backtrack table stored contiguously, row by row. Rows represent line 1, columns represent line 2.
+  std::vector<signed char> BacktrackTable;
+};
+
+//----------------------------------------------------------------------------
+class vtkPlanarContourToClosedSurfaceConversionRule::PlanePairTask
+{
+public:
+  PlanePairTask()
+    : InputROIPoints(NULL)
+    , Lines(NULL)
+    , PointLocators(NULL)
+    , LinePointIdLists(NULL)
+    , FirstLineOnPlane1Index(0)
+    , NumberOfLinesInPlane1(0)
+    , FirstLineOnPlane2Index(0)
+    , NumberOfLinesInPlane2(0)
+  {
+  }
+
+  /// Input shared by all the tasks (only read by the tasks)
+  vtkPolyData* InputROIPoints;
+  std::vector<vtkSmartPointer<vtkLine> >* Lines;
+  std::vector<vtkSmartPointer<vtkPointLocator> >* PointLocators;
+  std::vector<vtkSmartPointer<vtkIdList> >* LinePointIdLists;
+
+  /// Lines of the two planes
+  vtkIdType FirstLineOnPlane1Index;
+  int NumberOfLinesInPlane1;
+  vtkIdType FirstLineOnPlane2Index;
+  int NumberOfLinesInPlane2;
+
+  /// Triangles created between the two planes
+  vtkSmartPointer<vtkCellArray> OutputPolygons;
+  /// Lines on plane 1 that were triangulated to plane 2 (above)
+  std::vector<vtkIdType> LinesTriangulatedToAbove;
+  /// Lines on plane 2 that were triangulated to plane 1 (below)
+  std::vector<vtkIdType> LinesTriangulatedToBelow;
+};
+
+//----------------------------------------------------------------------------
+class vtkPlanarContourToClosedSurfaceConversionRule::PlanePairTaskList
+{
+public:
+  PlanePairTaskList() : Rule(NULL), Tasks(NULL) { }
+  vtkPlanarContourToClosedSurfaceConversionRule* Rule;
+  std::vector<PlanePairTask>* Tasks;
+  /// Workspaces not used by any task at the moment. There is one workspace per thread, so that
+  /// the buffers are reused for all the plane pairs.
+  std::vector<TriangulationWorkspace*> FreeWorkspaces;
+  vtkSimpleMutexLock Lock;
+};
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::TriangulatePlanePairTaskFunction(void* userData, int taskIndex)
+{
+  PlanePairTaskList* taskList = static_cast<PlanePairTaskList*>(userData);
+
+  taskList->Lock.Lock();
+  TriangulationWorkspace* workspace = taskList->FreeWorkspaces.back();
+  taskList->FreeWorkspaces.pop_back();
+  taskList->Lock.Unlock();
+
+  taskList->Rule->TriangulatePlanePair(&(*taskList->Tasks)[taskIndex], workspace);
+
+  taskList->Lock.Lock();
+  taskList->FreeWorkspaces.push_back(workspace);
+  taskList->Lock.Unlock();
+}
+
 //----------------------------------------------------------------------------
 bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
 {
@@ -161,12 +486,14 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
 
   double spacing = this->GetSpacingBetweenLines(inputContoursCopy);
 
+  std::vector<vtkSmartPointer<vtkLine> > lines(numberOfLines);
   std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators(numberOfLines);
   std::vector<vtkSmartPointer<vtkIdList> > linePointIdLists(numberOfLines);
   for(int lineIndex = 0; lineIndex < numberOfLines; ++lineIndex)
     {
     vtkSmartPointer<vtkLine> currentLine = vtkSmartPointer<vtkLine>::New();
     currentLine->DeepCopy(inputContoursCopy->GetCell(lineIndex));
+    lines[lineIndex] = currentLine;
     linePointIdLists[lineIndex] = currentLine->GetPointIds();
     vtkSmartPointer<vtkPolyData> linePolyData = vtkSmartPointer<vtkPolyData>::New();
     linePolyData->SetPoints(currentLine->GetPoints());
@@ -184,118 +511,77 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
     lineTriganulatedToBelow[i] = false;
     }
 
-  // Get two consecutive planes.
-  vtkIdType firstLineOnPlane1Index = 0; // pointer to first line on plane 1.
-  int numberOfLinesInPlane1 = this->GetNumberOfLinesOnPlane(inputContoursCopy, 0, spacing);
-
-  // Loop through all of the contours in the polydata
-  while (firstLineOnPlane1Index + numberOfLinesInPlane1 < numberOfLines)
+  // Find the planes (consecutive lines with the same Z-coordinate)
+  std::vector<std::pair<vtkIdType, int> > planes; // first line index, number of lines
+  for (vtkIdType firstLineOnPlaneIndex = 0; firstLineOnPlaneIndex < numberOfLines; )
     {
-    vtkIdType firstLineOnPlane2Index = firstLineOnPlane1Index + numberOfLinesInPlane1; // pointer to first line on plane 2
-    int numberOfLinesInPlane2 = this->GetNumberOfLinesOnPlane(inputContoursCopy, firstLineOnPlane2Index, spacing); // number of lines on plane 2
+    int numberOfLinesInPlane = this->GetNumberOfLinesOnPlane(inputContoursCopy, firstLineOnPlaneIndex, spacing);
+    planes.push_back(std::make_pair(firstLineOnPlaneIndex, numberOfLinesInPlane));
+    firstLineOnPlaneIndex += numberOfLinesInPlane;
+    }
 
-    // initialize overlaps lists. - list of list
-    // Each internal list represents a line from the plane and will store the pointers to the overlap lines
+  // Create a task for each pair of consecutive planes. The triangulation between two planes is independent
+  // from the other plane pairs, so the tasks can be run in parallel.
+  std::vector<PlanePairTask> planePairTasks(planes.size() > 1 ? planes.size()-1 : 0);
+  for (size_t planePairIndex = 0; planePairIndex < planePairTasks.size(); ++planePairIndex)
+    {
+    PlanePairTask& task = planePairTasks[planePairIndex];
+    task.InputROIPoints = inputContoursCopy;
+    task.Lines = &lines;
+    task.PointLocators = &pointLocators;
+    task.LinePointIdLists = &linePointIdLists;
+    task.FirstLineOnPlane1Index = planes[planePairIndex].first;
+    task.NumberOfLinesInPlane1 = planes[planePairIndex].second;
+    task.FirstLineOnPlane2Index = planes[planePairIndex+1].first;
+    task.NumberOfLinesInPlane2 = planes[planePairIndex+1].second;
+    task.OutputPolygons = vtkSmartPointer<vtkCellArray>::New();
+    }
 
-    // List of Overlaps for lines from plane 1
-    std::vector< std::vector< vtkIdType > > plane1Overlaps;
-    for (int line1Index = 0; line1Index < numberOfLinesInPlane1; ++line1Index)
-      {
-      std::vector< vtkIdType > temp;
-      plane1Overlaps.push_back(temp);
-      }
+  // Triangulate between the planes. The number of points varies a lot between the planes, so the plane pairs
+  // are handed out to the threads one by one.
+  int numberOfThreads = vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(
+    vtkVariant(this->ConversionParameters[this->GetNumberOfThreadsParameterName()].first).ToInt(), (int)planePairTasks.size() );
+  std::vector<TriangulationWorkspace> workspaces(numberOfThreads);
+  PlanePairTaskList taskList;
+  taskList.Rule = this;
+  taskList.Tasks = &planePairTasks;
+  for (std::vector<TriangulationWorkspace>::iterator workspaceIt = workspaces.begin(); workspaceIt != workspaces.end(); ++workspaceIt)
+    {
+    taskList.FreeWorkspaces.push_back(&(*workspaceIt));
+    }
+  vtkSlicerRtTaskPool::ExecuteTasks((int)planePairTasks.size(),
+    vtkPlanarContourToClosedSurfaceConversionRule::TriangulatePlanePairTaskFunction, &taskList, numberOfThreads);
 
-    // overlaps for lines from plane 2
-    std::vector< std::vector< vtkIdType > > plane2Overlaps;
-    for (int line2Index=0; line2Index < numberOfLinesInPlane2; ++line2Index)
+  // Merge the results in plane order, so that the output is the same regardless of the number of threads
+  vtkIdType numberOfPolygons = 0;
+  vtkIdType polygonConnectivitySize = 0;
+  for (std::vector<PlanePairTask>::iterator taskIt = planePairTasks.begin(); taskIt != planePairTasks.end(); ++taskIt)
+    {
+    numberOfPolygons += taskIt->OutputPolygons->GetNumberOfCells();
+    polygonConnectivitySize += taskIt->OutputPolygons->GetData()->GetNumberOfValues();
+    for (std::vector<vtkIdType>::iterator lineIt = taskIt->LinesTriangulatedToAbove.begin(); lineIt != taskIt->LinesTriangulatedToAbove.end(); ++lineIt)
       {
-      std::vector< vtkIdType > temp;
-      plane2Overlaps.push_back(temp);
+      lineTriganulatedToAbove[*lineIt] = true;
       }
-
-    // Loop through the lines in the first plane
-    for (int line1Index=0; line1Index < numberOfLinesInPlane1; ++line1Index)
+    for (std::vector<vtkIdType>::iterator lineIt = taskIt->LinesTriangulatedToBelow.begin(); lineIt != taskIt->LinesTriangulatedToBelow.end(); ++lineIt)
       {
-      vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-      line1->DeepCopy(inputContoursCopy->GetCell(firstLineOnPlane1Index+line1Index));
-
-      // Loop through the lines in the second plane
-      for (int line2Index=0; line2Index < numberOfLinesInPlane2; ++line2Index)
-        {
-        vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-        line2->DeepCopy(inputContoursCopy->GetCell(firstLineOnPlane2Index+line2Index));
-
-        // If the two lines overlap, then add them to the lists
-        if (this->DoLinesOverlap(line1, line2))
-          {
-          // line from plane 1 overlaps with line from plane 2
-          plane1Overlaps[line1Index].push_back(firstLineOnPlane2Index+line2Index);
-          plane2Overlaps[line2Index].push_back(firstLineOnPlane1Index+line1Index);
-          }
-        }
+      lineTriganulatedToBelow[*lineIt] = true;
       }
-
-    // Loop through all of the lines in the first plane
-    for (int line1Index = firstLineOnPlane1Index; line1Index < firstLineOnPlane1Index+numberOfLinesInPlane1; ++line1Index)
+    }
+  vtkSmartPointer<vtkIdTypeArray> polygonConnectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+  polygonConnectivity->SetNumberOfValues(polygonConnectivitySize);
+  vtkIdType polygonConnectivityPosition = 0;
+  for (std::vector<PlanePairTask>::iterator taskIt = planePairTasks.begin(); taskIt != planePairTasks.end(); ++taskIt)
+    {
+    vtkIdTypeArray* taskConnectivity = taskIt->OutputPolygons->GetData();
+    if (taskConnectivity->GetNumberOfValues() > 0)
       {
-      vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-      line1->DeepCopy(inputContoursCopy->GetCell(line1Index));
-
-      std::vector<vtkSmartPointer<vtkPointLocator> > overlap1PointLocators(plane1Overlaps[line1Index-firstLineOnPlane1Index].size());
-      std::vector<vtkSmartPointer<vtkIdList> > overlap1PointIds(plane1Overlaps[line1Index-firstLineOnPlane1Index].size());
-
-      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
-      for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index-firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
-        {
-        vtkIdType j = plane1Overlaps[line1Index-firstLineOnPlane1Index][overlapIndex];
-        overlap1PointLocators[overlapIndex] = (pointLocators[j]);
-        overlap1PointIds[overlapIndex] = (linePointIdLists[j]);
-        }
-
-      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
-      for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index-firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
-        {
-        vtkIdType line2Index = plane1Overlaps[line1Index-firstLineOnPlane1Index][overlapIndex];
-
-        vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-        line2->DeepCopy(inputContoursCopy->GetCell(line2Index));
-
-        std::vector<vtkSmartPointer<vtkPointLocator> > overlap2PointLocators(plane2Overlaps[line2Index-firstLineOnPlane2Index].size());
-        std::vector<vtkSmartPointer<vtkIdList> > overlap2PointIds(plane2Overlaps[line2Index-firstLineOnPlane2Index].size());
-
-        for (size_t i=0; i<plane2Overlaps[line2Index-firstLineOnPlane2Index].size(); ++i)
-          {
-          int j = plane2Overlaps[line2Index-firstLineOnPlane2Index][i];
-          overlap2PointLocators[i] = (pointLocators[j]);
-          overlap2PointIds[i] = (linePointIdLists[j]);
-          }
-
-        // Get the portion of line 1 that is close to line 2,
-        vtkSmartPointer<vtkLine> dividedLine1 = vtkSmartPointer<vtkLine>::New();
-        this->Branch(inputContoursCopy, line1, line2Index, plane1Overlaps[line1Index-firstLineOnPlane1Index], overlap1PointLocators, overlap1PointIds, dividedLine1);
-        vtkSmartPointer<vtkIdList> dividedPointsInLine1 = dividedLine1->GetPointIds();
-        int numberOfdividedPointsInLine1 = dividedLine1->GetNumberOfPoints();
-
-        // Get the portion of line 2 that is close to line 1.
-        vtkSmartPointer<vtkLine> dividedLine2 = vtkSmartPointer<vtkLine>::New();
-        this->Branch(inputContoursCopy, line2, line1Index, plane2Overlaps[line2Index-firstLineOnPlane2Index], overlap2PointLocators, overlap2PointIds, dividedLine2);
-        vtkSmartPointer<vtkIdList> dividedPointsInLine2 = dividedLine2->GetPointIds();
-        int numberOfdividedPointsInLine2 = dividedLine2->GetNumberOfPoints();
-
-        if (numberOfdividedPointsInLine1 > 1 && numberOfdividedPointsInLine2 > 1)
-          {
-          lineTriganulatedToAbove[line1Index] = true;
-          lineTriganulatedToBelow[line2Index] = true;
-          this->TriangulateContours(inputContoursCopy, dividedPointsInLine1, dividedPointsInLine2, outputPolygons);
-          }
-
-        }
+      std::copy(taskConnectivity->GetPointer(0), taskConnectivity->GetPointer(0) + taskConnectivity->GetNumberOfValues(),
+        polygonConnectivity->GetPointer(polygonConnectivityPosition));
+      polygonConnectivityPosition += taskConnectivity->GetNumberOfValues();
       }
-
-    // Advance the points
-    firstLineOnPlane1Index = firstLineOnPlane2Index;
-    numberOfLinesInPlane1 = numberOfLinesInPlane2;
     }
+  outputPolygons->SetCells(numberOfPolygons, polygonConnectivity);
 
   // Triangulate all contours which are exposed.
   this->EndCapping( inputContoursCopy, outputPolygons, lineTriganulatedToAbove, lineTriganulatedToBelow);
@@ -319,7 +605,7 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
 }
 
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyData* inputROIPoints, vtkIdList* pointsInLine1, vtkIdList* pointsInLine2, vtkCellArray* outputPolygons)
+void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyData* inputROIPoints, vtkIdList* pointsInLine1, vtkIdList* pointsInLine2, vtkCellArray* outputPolygons, TriangulationWorkspace* workspace/*=NULL*/)
 {
   if (!inputROIPoints)
     {
@@ -344,29 +630,39 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
     return;
     }
 
+  TriangulationWorkspace temporaryWorkspace;
+  if (!workspace)
+    {
+    workspace = &temporaryWorkspace;
+    }
+
   int numberOfPointsInLine1 = pointsInLine1->GetNumberOfIds();
   int numberOfPointsInLine2 = pointsInLine2->GetNumberOfIds();
 
+  // Gather the point coordinates so that the points are accessed sequentially
+  TriangulationWorkspace::GatherLinePoints(inputROIPoints->GetPoints(), pointsInLine1, workspace->Line1Points);
+  TriangulationWorkspace::GatherLinePoints(inputROIPoints->GetPoints(), pointsInLine2, workspace->Line2Points);
+  const double* line1Points = &workspace->Line1Points[0];
+  const double* line2Points = &workspace->Line2Points[0];
+
   // Pre-calculate and store the closest points.
 
   // Closest point from line 1 to line 2
-  std::vector< int > closestPointFromLine1ToLine2Ids;
+  std::vector<vtkIdType>& closestPointFromLine1ToLine2Ids = workspace->ClosestPointFromLine1ToLine2Ids;
+  closestPointFromLine1ToLine2Ids.resize(numberOfPointsInLine1);
+  workspace->Line2PointLocator.Build(line2Points, numberOfPointsInLine2);
   for (int line1PointIndex = 0; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
     {
-    double line1Point[3] = {0,0,0};
-    inputROIPoints->GetPoint(pointsInLine1->GetId(line1PointIndex), line1Point);
-
-    closestPointFromLine1ToLine2Ids.push_back(this->GetClosestPoint(inputROIPoints, line1Point, pointsInLine2));
+    closestPointFromLine1ToLine2Ids[line1PointIndex] = workspace->Line2PointLocator.FindClosestPoint(line1Points + 3*line1PointIndex);
     }
 
   // Closest from line 2 to line 1
-  std::vector< int > closestPointFromLine2ToLine1Ids;
+  std::vector<vtkIdType>& closestPointFromLine2ToLine1Ids = workspace->ClosestPointFromLine2ToLine1Ids;
+  closestPointFromLine2ToLine1Ids.resize(numberOfPointsInLine2);
+  workspace->Line1PointLocator.Build(line1Points, numberOfPointsInLine1);
   for (int line2PointIndex = 0; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
     {
-    double line2Point[3] = {0,0,0};
-    inputROIPoints->GetPoint(pointsInLine2->GetId(line2PointIndex),line2Point);
-
-    closestPointFromLine2ToLine1Ids.push_back(this->GetClosestPoint(inputROIPoints, line2Point, pointsInLine1));
+    closestPointFromLine2ToLine1Ids[line2PointIndex] = workspace->Line1PointLocator.FindClosestPoint(line2Points + 3*line2PointIndex);
     }
 
   // Orient loops.
@@ -374,11 +670,8 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
   vtkIdType startLine1PointId = 0;
   vtkIdType startLine2PointId = closestPointFromLine1ToLine2Ids[0];
 
-  double firstPointLine1[3] = {0,0,0}; // first point on line 1;
-  inputROIPoints->GetPoint(pointsInLine1->GetId(startLine1PointId),firstPointLine1);
-
-  double firstPointLine2[3] = {0,0,0}; // first point on line 2;
-  inputROIPoints->GetPoint(pointsInLine2->GetId(startLine2PointId), firstPointLine2);
+  const double* firstPointLine1 = line1Points + 3*startLine1PointId; // first point on line 1;
+  const double* firstPointLine2 = line2Points + 3*startLine2PointId; // first point on line 2;
 
   // Determine if the loops are closed.
   // A loop is closed if the first point is repeated as the last point.
@@ -390,53 +683,48 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
   int line2EndPoint = this->GetEndLoop(startLine2PointId, numberOfPointsInLine2, line2Closed);
 
   // for backtracking
-  int left = -1;
-  int up = 1;
+  const signed char left = -1;
+  const signed char up = 1;
 
   // Initialize the Dynamic Programming table.
   // Rows represent line 1. Columns represent line 2.
+  // The backtrack table is stored contiguously, and only two rows of the score table are kept.
+  workspace->BacktrackTable.resize((size_t)numberOfPointsInLine1 * numberOfPointsInLine2);
+  signed char* backtrackTable = &workspace->BacktrackTable[0];
+  workspace->ScoreRows.resize(2 * numberOfPointsInLine2);
+  double* previousScoreRow = &workspace->ScoreRows[0];
+  double* currentScoreRow = &workspace->ScoreRows[numberOfPointsInLine2];
 
   // Initialize the score table.
-  std::vector< std::vector< double > > scoreTable( numberOfPointsInLine1, std::vector< double >( numberOfPointsInLine2 ) );
   double distanceBetweenPoints = vtkMath::Distance2BetweenPoints(firstPointLine1, firstPointLine2);
-  scoreTable[0][0] = distanceBetweenPoints;
-
-  std::vector< std::vector< int > > backtrackTable( numberOfPointsInLine1, std::vector< int >( numberOfPointsInLine2 ) );
-  backtrackTable[0][0] = 0;
+  previousScoreRow[0] = distanceBetweenPoints;
+  backtrackTable[0] = 0;
 
   // Initialize the first row in the table.
   vtkIdType currentPointIdLine2 = this->GetNextLocation(startLine2PointId, numberOfPointsInLine2, line2Closed);
   for (int line2PointIndex = 1; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
     {
-    double currentPointLine2[3] = {0,0,0}; // current point on line 2
-    inputROIPoints->GetPoint(pointsInLine2->GetId(currentPointIdLine2),currentPointLine2);
-
     // Use the distance between first point on line 1 and current point on line 2.
-    double distance = vtkMath::Distance2BetweenPoints(firstPointLine1, currentPointLine2);
+    double distance = vtkMath::Distance2BetweenPoints(firstPointLine1, line2Points + 3*currentPointIdLine2);
 
-    scoreTable[0][line2PointIndex] = scoreTable[0][line2PointIndex-1]+distance;
-    backtrackTable[0][line2PointIndex] = left;
+    previousScoreRow[line2PointIndex] = previousScoreRow[line2PointIndex-1]+distance;
+    backtrackTable[line2PointIndex] = left;
 
     currentPointIdLine2 = this->GetNextLocation(currentPointIdLine2, numberOfPointsInLine2, line2Closed);
     }
 
   // Initialize the first column in the table.
+  std::vector<double>& firstColumnScores = workspace->FirstColumnScores;
+  firstColumnScores.resize(numberOfPointsInLine1);
+  firstColumnScores[0] = previousScoreRow[0];
   vtkIdType currentPointIdLine1 = this->GetNextLocation(startLine1PointId, numberOfPointsInLine2, line1Closed);
   for( int line1PointIndex=1; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
     {
-    double currentPointLine1[3] = {0,0,0}; // current point on line 1
-    inputROIPoints->GetPoint(pointsInLine1->GetId(currentPointIdLine1), currentPointLine1);
-
     // Use the distance between first point on line 2 and current point on line 1.
-    double distance = vtkMath::Distance2BetweenPoints(currentPointLine1, firstPointLine2);
+    double distance = vtkMath::Distance2BetweenPoints(line1Points + 3*currentPointIdLine1, firstPointLine2);
 
-    scoreTable[line1PointIndex][0] = scoreTable[line1PointIndex-1][0]+distance;
-    backtrackTable[line1PointIndex][0] = up;
-    for(int line2PointIndex = 1; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
-      {
-      scoreTable[line1PointIndex][line2PointIndex] = 0;
-      backtrackTable[line1PointIndex][line2PointIndex] = up;
-      }
+    firstColumnScores[line1PointIndex] = firstColumnScores[line1PointIndex-1]+distance;
+    backtrackTable[(size_t)line1PointIndex * numberOfPointsInLine2] = up;
 
     currentPointIdLine1 = this->GetNextLocation(currentPointIdLine1, numberOfPointsInLine1, line1Closed);
     }
@@ -452,44 +740,41 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
   vtkIdType line2PointIndex=1;
   for (line1PointIndex = 1; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
     {
-    double pointOnLine1[3] = {0,0,0};
-    inputROIPoints->GetPoint(pointsInLine1->GetId(currentPointIdLine1), pointOnLine1);
+    const double* pointOnLine1 = line1Points + 3*currentPointIdLine1;
+    signed char* backtrackRow = backtrackTable + (size_t)line1PointIndex * numberOfPointsInLine2;
+    currentScoreRow[0] = firstColumnScores[line1PointIndex];
 
     for (line2PointIndex = 1; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
       {
-      double pointOnLine2[3] = {0,0,0};
-      inputROIPoints->GetPoint(pointsInLine2->GetId(currentPointIdLine2), pointOnLine2);
-
-      double distance = vtkMath::Distance2BetweenPoints(pointOnLine1, pointOnLine2);
+      double distance = vtkMath::Distance2BetweenPoints(pointOnLine1, line2Points + 3*currentPointIdLine2);
 
       // Use the pre-calculated closest point.
       if (currentPointIdLine1 == closestPointFromLine2ToLine1Ids[previousLine2])
         {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex][line2PointIndex-1]+distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = left;
+        currentScoreRow[line2PointIndex] = currentScoreRow[line2PointIndex-1]+distance;
+        backtrackRow[line2PointIndex] = left;
         }
       else if (currentPointIdLine2 == closestPointFromLine1ToLine2Ids[previousLine1])
         {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex-1][line2PointIndex]+distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = up;
-
+        currentScoreRow[line2PointIndex] = previousScoreRow[line2PointIndex]+distance;
+        backtrackRow[line2PointIndex] = up;
         }
-      else if (scoreTable[line1PointIndex][line2PointIndex-1] <= scoreTable[line1PointIndex-1][line2PointIndex])
+      else if (currentScoreRow[line2PointIndex-1] <= previousScoreRow[line2PointIndex])
         {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex][line2PointIndex-1]+distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = left;
-
+        currentScoreRow[line2PointIndex] = currentScoreRow[line2PointIndex-1]+distance;
+        backtrackRow[line2PointIndex] = left;
         }
       else
         {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex-1][line2PointIndex]+distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = up;
+        currentScoreRow[line2PointIndex] = previousScoreRow[line2PointIndex]+distance;
+        backtrackRow[line2PointIndex] = up;
         }
 
       // Advance the pointers
       previousLine2 = currentPointIdLine2;
       currentPointIdLine2 = this->GetNextLocation(currentPointIdLine2, numberOfPointsInLine2, line2Closed);
       }
+    std::swap(previousScoreRow, currentScoreRow);
     previousLine1 = currentPointIdLine1;
     currentPointIdLine1 = this->GetNextLocation(currentPointIdLine1, numberOfPointsInLine1, line1Closed);
     }
@@ -501,25 +786,15 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
   --line2PointIndex;
   while (line1PointIndex > 0  || line2PointIndex > 0)
     {
-    double line1Point[3] = {0,0,0}; // current point on line 1
-    inputROIPoints->GetPoint(pointsInLine1->GetId(currentPointIdLine1), line1Point);
-
-    double line2Point[3] = {0,0,0}; // current point on line 2
-    inputROIPoints->GetPoint(pointsInLine2->GetId(currentPointIdLine2), line2Point);
-
-    if (backtrackTable[line1PointIndex][line2PointIndex] == left)
+    vtkIdType currentTriangle[3] = {0,0,0};
+    if (backtrackTable[(size_t)line1PointIndex * numberOfPointsInLine2 + line2PointIndex] == left)
       {
       vtkIdType previousPointIndexLine2 = this->GetPreviousLocation(currentPointIdLine2, numberOfPointsInLine2, line2Closed);
 
-      vtkIdType currentTriangle[3] = {0,0,0};
       currentTriangle[0] = pointsInLine1->GetId(currentPointIdLine1);
       currentTriangle[1] = pointsInLine2->GetId(currentPointIdLine2);
       currentTriangle[2] = pointsInLine2->GetId(previousPointIndexLine2);
-
-      outputPolygons->InsertNextCell(3);
-      outputPolygons->InsertCellPoint(currentTriangle[0]);
-      outputPolygons->InsertCellPoint(currentTriangle[1]);
-      outputPolygons->InsertCellPoint(currentTriangle[2]);
+      outputPolygons->InsertNextCell(3, currentTriangle);
 
       line2PointIndex -= 1;
       currentPointIdLine2 = previousPointIndexLine2;
@@ -528,15 +803,10 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
       {
       vtkIdType previousPointIndexLine1 = this->GetPreviousLocation(currentPointIdLine1, numberOfPointsInLine1, line1Closed);
 
-      vtkIdType currentTriangle[3] = {0,0,0};
       currentTriangle[0] = pointsInLine1->GetId(currentPointIdLine1);
       currentTriangle[1] = pointsInLine2->GetId(currentPointIdLine2);
       currentTriangle[2] = pointsInLine1->GetId(previousPointIndexLine1);
-
-      outputPolygons->InsertNextCell(3);
-      outputPolygons->InsertCellPoint(currentTriangle[0]);
-      outputPolygons->InsertCellPoint(currentTriangle[1]);
-      outputPolygons->InsertCellPoint(currentTriangle[2]);
+      outputPolygons->InsertNextCell(3, currentTriangle);
 
       line1PointIndex -= 1;
       currentPointIdLine1 = previousPointIndexLine1;
@@ -544,6 +814,133 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateContours(vtkPolyD
     }
 }
 
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::TriangulatePlanePair(PlanePairTask* task, TriangulationWorkspace* workspace)
+{
+  vtkPolyData* inputContoursCopy = task->InputROIPoints;
+  std::vector<vtkSmartPointer<vtkLine> >& lines = *(task->Lines);
+  std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators = *(task->PointLocators);
+  std::vector<vtkSmartPointer<vtkIdList> >& linePointIdLists = *(task->LinePointIdLists);
+
+  vtkIdType firstLineOnPlane1Index = task->FirstLineOnPlane1Index;
+  int numberOfLinesInPlane1 = task->NumberOfLinesInPlane1;
+  vtkIdType firstLineOnPlane2Index = task->FirstLineOnPlane2Index;
+  int numberOfLinesInPlane2 = task->NumberOfLinesInPlane2;
+
+  // initialize overlaps lists. - list of list
+  // Each internal list represents a line from the plane and will store the pointers to the overlap lines
+
+  // List of Overlaps for lines from plane 1
+  std::vector< std::vector< vtkIdType > > plane1Overlaps(numberOfLinesInPlane1);
+
+  // overlaps for lines from plane 2
+  std::vector< std::vector< vtkIdType > > plane2Overlaps(numberOfLinesInPlane2);
+
+  // Loop through the lines in the first plane
+  for (int line1Index=0; line1Index < numberOfLinesInPlane1; ++line1Index)
+    {
+    // Lines are copied from the shared list, because computing the bounds of a cell modifies it
+    vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
+    line1->DeepCopy(lines[firstLineOnPlane1Index+line1Index]);
+
+    // Loop through the lines in the second plane
+    for (int line2Index=0; line2Index < numberOfLinesInPlane2; ++line2Index)
+      {
+      vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
+      line2->DeepCopy(lines[firstLineOnPlane2Index+line2Index]);
+
+      // If the two lines overlap, then add them to the lists
+      if (this->DoLinesOverlap(line1, line2))
+        {
+        // line from plane 1 overlaps with line from plane 2
+        plane1Overlaps[line1Index].push_back(firstLineOnPlane2Index+line2Index);
+        plane2Overlaps[line2Index].push_back(firstLineOnPlane1Index+line1Index);
+        }
+      }
+    }
+
+  // Pairs of overlapping line portions. They are triangulated after all of them are found,
+  // so that the buffers can be allocated once for the largest pair and the output for all the triangles.
+  std::vector<std::pair<vtkSmartPointer<vtkIdList>, vtkSmartPointer<vtkIdList> > > contourPairsToTriangulate;
+
+  // Loop through all of the lines in the first plane
+  for (int line1Index = firstLineOnPlane1Index; line1Index < firstLineOnPlane1Index+numberOfLinesInPlane1; ++line1Index)
+    {
+    vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
+    line1->DeepCopy(lines[line1Index]);
+
+    std::vector<vtkSmartPointer<vtkPointLocator> > overlap1PointLocators(plane1Overlaps[line1Index-firstLineOnPlane1Index].size());
+    std::vector<vtkSmartPointer<vtkIdList> > overlap1PointIds(plane1Overlaps[line1Index-firstLineOnPlane1Index].size());
+
+    // Loop through all of the lines in the second plane that overlap with the current line in the first plane
+    for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index-firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
+      {
+      vtkIdType j = plane1Overlaps[line1Index-firstLineOnPlane1Index][overlapIndex];
+      overlap1PointLocators[overlapIndex] = (pointLocators[j]);
+      overlap1PointIds[overlapIndex] = (linePointIdLists[j]);
+      }
+
+    // Loop through all of the lines in the second plane that overlap with the current line in the first plane
+    for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index-firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
+      {
+      vtkIdType line2Index = plane1Overlaps[line1Index-firstLineOnPlane1Index][overlapIndex];
+
+      vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
+      line2->DeepCopy(lines[line2Index]);
+
+      std::vector<vtkSmartPointer<vtkPointLocator> > overlap2PointLocators(plane2Overlaps[line2Index-firstLineOnPlane2Index].size());
+      std::vector<vtkSmartPointer<vtkIdList> > overlap2PointIds(plane2Overlaps[line2Index-firstLineOnPlane2Index].size());
+
+      for (size_t i=0; i<plane2Overlaps[line2Index-firstLineOnPlane2Index].size(); ++i)
+        {
+        int j = plane2Overlaps[line2Index-firstLineOnPlane2Index][i];
+        overlap2PointLocators[i] = (pointLocators[j]);
+        overlap2PointIds[i] = (linePointIdLists[j]);
+        }
+
+      // Get the portion of line 1 that is close to line 2,
+      vtkSmartPointer<vtkLine> dividedLine1 = vtkSmartPointer<vtkLine>::New();
+      this->Branch(inputContoursCopy, line1, line2Index, plane1Overlaps[line1Index-firstLineOnPlane1Index], overlap1PointLocators, overlap1PointIds, dividedLine1);
+      vtkSmartPointer<vtkIdList> dividedPointsInLine1 = dividedLine1->GetPointIds();
+      int numberOfdividedPointsInLine1 = dividedLine1->GetNumberOfPoints();
+
+      // Get the portion of line 2 that is close to line 1.
+      vtkSmartPointer<vtkLine> dividedLine2 = vtkSmartPointer<vtkLine>::New();
+      this->Branch(inputContoursCopy, line2, line1Index, plane2Overlaps[line2Index-firstLineOnPlane2Index], overlap2PointLocators, overlap2PointIds, dividedLine2);
+      vtkSmartPointer<vtkIdList> dividedPointsInLine2 = dividedLine2->GetPointIds();
+      int numberOfdividedPointsInLine2 = dividedLine2->GetNumberOfPoints();
+
+      if (numberOfdividedPointsInLine1 > 1 && numberOfdividedPointsInLine2 > 1)
+        {
+        task->LinesTriangulatedToAbove.push_back(line1Index);
+        task->LinesTriangulatedToBelow.push_back(line2Index);
+        contourPairsToTriangulate.push_back(std::make_pair(dividedPointsInLine1, dividedPointsInLine2));
+        }
+
+      }
+    }
+
+  // Triangulate the contour pairs. The triangulation of a pair with n and m points creates n+m-2 triangles.
+  int maximumNumberOfPointsInLine = 0;
+  vtkIdType maximumTableSize = 0;
+  vtkIdType numberOfTriangles = 0;
+  std::vector<std::pair<vtkSmartPointer<vtkIdList>, vtkSmartPointer<vtkIdList> > >::iterator pairIt;
+  for (pairIt = contourPairsToTriangulate.begin(); pairIt != contourPairsToTriangulate.end(); ++pairIt)
+    {
+    vtkIdType numberOfPointsInLine1 = pairIt->first->GetNumberOfIds();
+    vtkIdType numberOfPointsInLine2 = pairIt->second->GetNumberOfIds();
+    maximumNumberOfPointsInLine = std::max(maximumNumberOfPointsInLine, (int)std::max(numberOfPointsInLine1, numberOfPointsInLine2));
+    maximumTableSize = std::max(maximumTableSize, numberOfPointsInLine1 * numberOfPointsInLine2);
+    numberOfTriangles += numberOfPointsInLine1 + numberOfPointsInLine2 - 2;
+    }
+  task->OutputPolygons->Allocate(task->OutputPolygons->EstimateSize(numberOfTriangles, 3));
+  workspace->Reserve(maximumNumberOfPointsInLine, maximumTableSize);
+  for (pairIt = contourPairsToTriangulate.begin(); pairIt != contourPairsToTriangulate.end(); ++pairIt)
+    {
+    this->TriangulateContours(inputContoursCopy, pairIt->first, pairIt->second, task->OutputPolygons, workspace);
+    }
+}
+
 //----------------------------------------------------------------------------
 vtkIdType vtkPlanarContourToClosedSurfaceConversionRule::GetEndLoop(vtkIdType startLoopIndex, int numberOfPoints, bool loopClosed)
 {
@@ -978,7 +1375,7 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::DoLinesOverlap(vtkLine* line
 }
 // TODO: It may be possible to speed up this function by only calling the branch function once. -- need to look into this
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists, vtkLine* outputLine)
+void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists, vtkLine* outputLine)
 {
   if (!inputROIPoints)
     {
@@ -1043,7 +1440,7 @@ void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROI
 }
 
 //----------------------------------------------------------------------------
-int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, std::vector< vtkIdType > overlappingLineIds,  std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists)
+int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists)
 {
   if (!inputROIPoints)
     {
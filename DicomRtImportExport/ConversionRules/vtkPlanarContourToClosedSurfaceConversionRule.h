@@ -54,6 +54,7 @@ public:
   virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
 
   static const std::string GetDefaultSliceThicknessParameterName() { return "Default slice thickness"; };
+  static const std::string GetNumberOfThreadsParameterName() { return "Number of threads"; };
 
   /// Constructs representation object from representation name for the supported representation classes
   /// (typically source and target representation VTK classes, subclasses of vtkDataObject)
@@ -84,12 +85,32 @@ protected:
   vtkPlanarContourToClosedSurfaceConversionRule();
   virtual ~vtkPlanarContourToClosedSurfaceConversionRule();
 
+  /// Buffers reused for triangulating all the contour pairs in a conversion (dynamic programming table,
+  /// gathered point coordinates, and closest point index). Defined in the implementation file.
+  class TriangulationWorkspace;
+
   /// Construct a surface triangulation between two lines using a dynamic programming algorithm.
   /// \param inputROIPoints Polydata containing all of the points and contours
   /// \param pointsInLine1 List of points that are contained in the line to be triangulated
   /// \param pointsInLine2 List of points that are contained in the line to be triangulated
   /// \param Cell array that polygons are added to by the triangulation algorithm
-  void TriangulateContours(vtkPolyData* inputROIPoints, vtkIdList* pointsInLine1, vtkIdList* pointsInLine2, vtkCellArray* outputPolygons);
+  /// \param workspace Buffers used for the triangulation. If NULL, then temporary buffers are allocated
+  void TriangulateContours(vtkPolyData* inputROIPoints, vtkIdList* pointsInLine1, vtkIdList* pointsInLine2, vtkCellArray* outputPolygons, TriangulationWorkspace* workspace=NULL);
+
+  /// Lines on two consecutive planes and the result of triangulating between them. Defined in the implementation file.
+  class PlanePairTask;
+  /// Plane pair tasks and the triangulation workspaces shared by the tasks. Defined in the implementation file.
+  class PlanePairTaskList;
+
+  /// Triangulate between the overlapping lines of two consecutive planes.
+  /// Only reads the shared input of the task, so plane pairs can be triangulated in parallel.
+  /// \param task Plane pair to triangulate. The resulting triangles and triangulated lines are stored in the task
+  /// \param workspace Buffers used for the triangulation
+  void TriangulatePlanePair(PlanePairTask* task, TriangulationWorkspace* workspace);
+
+  /// Task function triangulating a plane pair of a PlanePairTaskList
+  /// \sa vtkSlicerRtTaskPool
+  static void TriangulatePlanePairTaskFunction(void* userData, int taskIndex);
 
   /// Find the index of the last point in a contour.
   /// \param startLoopIndex The index of the first point in the contour
@@ -149,7 +170,7 @@ protected:
   /// \param pointLocators List of point locators for lines in the overlap list
   /// \param lineIdLists List of vtkIdLists for all of the lines in the overlap list
   /// \param outputLine The output branched line
-  void Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists, vtkLine* outputLine);
+  void Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists, vtkLine* outputLine);
 
   /// Find the branch closest from the point on the trunk
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -157,7 +178,7 @@ protected:
   /// \param overlappingLineIds List of line IDs for lines that overlap with the current line
   /// \param pointLocators List of point locators for lines in the overlap list
   /// \param lineIdLists List of vtkIdLists for all of the lines in the overlap list
-  int GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists);
+  int GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists);
 
   /// Seal the exterior contours of the mesh.
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -0,0 +1,358 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkClosedSurfaceSlicer.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkClosedSurfaceSlicer);
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Identifier of an intersection point: the surface edge it lies on (ordered point IDs),
+  /// or the surface point it coincides with (second ID is -1)
+  typedef std::pair<vtkIdType, vtkIdType> IntersectionKey;
+
+  //----------------------------------------------------------------------------
+  struct IntersectionPoint
+  {
+    IntersectionKey Key;
+    double Position[3];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Intersection of a triangle and a slice plane. Oriented from the edge where the triangle boundary
+  /// goes above the plane to the edge where it goes below, so segments of neighboring triangles follow each other
+  struct SliceSegment
+  {
+    IntersectionPoint Start;
+    IntersectionPoint End;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute the intersection of a slice plane and an edge that crosses it. Points with slice coordinate
+  /// equal to the plane are above the plane, so only the second point of the edge may be on the plane.
+  void ComputeIntersection(vtkIdType pointIdA, const double* pointA, double sliceCoordinateA,
+    vtkIdType pointIdB, const double* pointB, double sliceCoordinateB, double sliceCoordinate, IntersectionPoint& intersection)
+  {
+    if (sliceCoordinateA == sliceCoordinate || sliceCoordinateB == sliceCoordinate)
+    {
+      bool onA = (sliceCoordinateA == sliceCoordinate);
+      intersection.Key = IntersectionKey((onA ? pointIdA : pointIdB), -1);
+      std::copy((onA ? pointA : pointB), (onA ? pointA : pointB) + 3, intersection.Position);
+      return;
+    }
+
+    // Interpolate in the order of the point IDs, so that the neighbor triangle gets exactly the same position
+    if (pointIdA > pointIdB)
+    {
+      std::swap(pointIdA, pointIdB);
+      std::swap(pointA, pointB);
+      std::swap(sliceCoordinateA, sliceCoordinateB);
+    }
+    double t = (sliceCoordinate - sliceCoordinateA) / (sliceCoordinateB - sliceCoordinateA);
+    for (int i=0; i<3; ++i)
+    {
+      intersection.Position[i] = pointA[i] + t * (pointB[i] - pointA[i]);
+    }
+    intersection.Key = IntersectionKey(pointIdA, pointIdB);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Chain the segments of a slice into contours
+  vtkSmartPointer<vtkPolyData> BuildContours(const std::vector<SliceSegment>& segments)
+  {
+    // Identify the shared intersection points
+    std::vector<IntersectionKey> keys;
+    keys.reserve(2 * segments.size());
+    for (std::vector<SliceSegment>::const_iterator segmentIt=segments.begin(); segmentIt!=segments.end(); ++segmentIt)
+    {
+      keys.push_back(segmentIt->Start.Key);
+      keys.push_back(segmentIt->End.Key);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    int numberOfPoints = (int)keys.size();
+    int numberOfSegments = (int)segments.size();
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToDouble();
+    points->SetNumberOfPoints(numberOfPoints);
+    std::vector<int> startIds(numberOfSegments, 0);
+    std::vector<int> endIds(numberOfSegments, 0);
+    std::vector<int> numberOfOutgoingSegments(numberOfPoints, 0);
+    std::vector<int> incidenceOffsets(numberOfPoints+1, 0);
+    for (int segmentIndex=0; segmentIndex<numberOfSegments; ++segmentIndex)
+    {
+      const SliceSegment& segment = segments[segmentIndex];
+      startIds[segmentIndex] = (int)(std::lower_bound(keys.begin(), keys.end(), segment.Start.Key) - keys.begin());
+      endIds[segmentIndex] = (int)(std::lower_bound(keys.begin(), keys.end(), segment.End.Key) - keys.begin());
+      points->SetPoint(startIds[segmentIndex], segment.Start.Position);
+      points->SetPoint(endIds[segmentIndex], segment.End.Position);
+      ++numberOfOutgoingSegments[startIds[segmentIndex]];
+      ++incidenceOffsets[startIds[segmentIndex]+1];
+      ++incidenceOffsets[endIds[segmentIndex]+1];
+    }
+
+    // Segments incident to each point
+    for (int pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+    {
+      incidenceOffsets[pointIndex+1] += incidenceOffsets[pointIndex];
+    }
+    std::vector<int> incidentSegments(2 * numberOfSegments, 0);
+    std::vector<int> incidenceFill(incidenceOffsets.begin(), incidenceOffsets.end()-1);
+    for (int segmentIndex=0; segmentIndex<numberOfSegments; ++segmentIndex)
+    {
+      incidentSegments[incidenceFill[startIds[segmentIndex]]++] = segmentIndex;
+      incidentSegments[incidenceFill[endIds[segmentIndex]]++] = segmentIndex;
+    }
+
+    // Trace contours. Open contours (only possible if the surface is not closed) are traced from their
+    // start points first, then the closed contours from any remaining segment.
+    vtkSmartPointer<vtkCellArray> contours = vtkSmartPointer<vtkCellArray>::New();
+    std::vector<bool> visited(numberOfSegments, false);
+    std::vector<vtkIdType> contour;
+    for (int pass=0; pass<2; ++pass)
+    {
+      for (int startSegmentIndex=0; startSegmentIndex<numberOfSegments; ++startSegmentIndex)
+      {
+        int startPointId = startIds[startSegmentIndex];
+        int numberOfIncidentSegments = incidenceOffsets[startPointId+1] - incidenceOffsets[startPointId];
+        if (visited[startSegmentIndex] || (pass == 0 && 2*numberOfOutgoingSegments[startPointId] <= numberOfIncidentSegments))
+        {
+          continue;
+        }
+
+        contour.clear();
+        contour.push_back(startPointId);
+        int currentPointId = startPointId;
+        while (true)
+        {
+          // Prefer continuing along the orientation of the segments
+          int nextSegmentIndex = -1;
+          for (int incidenceIndex=incidenceOffsets[currentPointId]; incidenceIndex<incidenceOffsets[currentPointId+1]; ++incidenceIndex)
+          {
+            int segmentIndex = incidentSegments[incidenceIndex];
+            if (visited[segmentIndex])
+            {
+              continue;
+            }
+            if (startIds[segmentIndex] == currentPointId)
+            {
+              nextSegmentIndex = segmentIndex;
+              break;
+            }
+            if (nextSegmentIndex < 0)
+            {
+              nextSegmentIndex = segmentIndex;
+            }
+          }
+          if (nextSegmentIndex < 0)
+          {
+            break;
+          }
+          visited[nextSegmentIndex] = true;
+          currentPointId = (startIds[nextSegmentIndex] == currentPointId ? endIds[nextSegmentIndex] : startIds[nextSegmentIndex]);
+          contour.push_back(currentPointId);
+        }
+        contours->InsertNextCell((vtkIdType)contour.size(), &contour[0]);
+      }
+    }
+
+    vtkSmartPointer<vtkPolyData> sliceContours = vtkSmartPointer<vtkPolyData>::New();
+    sliceContours->SetPoints(points);
+    sliceContours->SetPolys(contours);
+    return sliceContours;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkClosedSurfaceSlicer::vtkClosedSurfaceSlicer()
+  : NumberOfSlices(0)
+{
+  for (int i=0; i<3; ++i)
+  {
+    this->SliceOrigin[i] = 0.0;
+    this->SliceStep[i] = (i == 2 ? 1.0 : 0.0);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkClosedSurfaceSlicer::~vtkClosedSurfaceSlicer()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkClosedSurfaceSlicer::SetInputData(vtkPolyData* closedSurface)
+{
+  this->Input = closedSurface;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkClosedSurfaceSlicer::GetInput()
+{
+  return this->Input;
+}
+
+//----------------------------------------------------------------------------
+void vtkClosedSurfaceSlicer::SetSlicePlanes(const double origin[3], const double step[3], int numberOfSlices)
+{
+  for (int i=0; i<3; ++i)
+  {
+    this->SliceOrigin[i] = origin[i];
+    this->SliceStep[i] = step[i];
+  }
+  this->NumberOfSlices = std::max(0, numberOfSlices);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkPolyData* vtkClosedSurfaceSlicer::GetSliceContours(int sliceIndex)
+{
+  if (sliceIndex < 0 || sliceIndex >= (int)this->SliceContours.size())
+  {
+    return NULL;
+  }
+  return this->SliceContours[sliceIndex];
+}
+
+//----------------------------------------------------------------------------
+bool vtkClosedSurfaceSlicer::Update()
+{
+  this->SliceContours.clear();
+  this->SliceContours.resize(this->NumberOfSlices);
+
+  if (!this->Input)
+  {
+    vtkErrorMacro("Update: Input closed surface must be set");
+    return false;
+  }
+  double stepLength2 = vtkMath::Dot(this->SliceStep, this->SliceStep);
+  if (stepLength2 == 0.0)
+  {
+    vtkErrorMacro("Update: Slice step must not be zero");
+    return false;
+  }
+
+  vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+  triangleFilter->SetInputData(this->Input);
+  triangleFilter->PassVertsOff();
+  triangleFilter->PassLinesOff();
+  triangleFilter->Update();
+  vtkPolyData* surface = triangleFilter->GetOutput();
+  vtkPoints* surfacePoints = surface->GetPoints();
+  if (!surfacePoints || surface->GetNumberOfPolys() == 0 || this->NumberOfSlices == 0)
+  {
+    return true;
+  }
+
+  // Slice coordinate of each point: plane n is where the slice coordinate equals n
+  vtkIdType numberOfSurfacePoints = surfacePoints->GetNumberOfPoints();
+  std::vector<double> positions(3 * numberOfSurfacePoints, 0.0);
+  std::vector<double> sliceCoordinates(numberOfSurfacePoints, 0.0);
+  for (vtkIdType pointId=0; pointId<numberOfSurfacePoints; ++pointId)
+  {
+    double* position = &positions[3*pointId];
+    surfacePoints->GetPoint(pointId, position);
+    double relativePosition[3] = { position[0]-this->SliceOrigin[0], position[1]-this->SliceOrigin[1], position[2]-this->SliceOrigin[2] };
+    sliceCoordinates[pointId] = vtkMath::Dot(relativePosition, this->SliceStep) / stepLength2;
+  }
+
+  // Intersect each triangle with the planes within its slice range. A point is above plane n if its slice coordinate
+  // is at least n, so a triangle crosses plane n if its smallest slice coordinate is below n and its largest is at least n.
+  std::vector< std::vector<SliceSegment> > sliceSegments(this->NumberOfSlices);
+  vtkCellArray* triangles = surface->GetPolys();
+  vtkIdType numberOfTrianglePoints = 0;
+  vtkIdType* trianglePointIds = NULL;
+  for (triangles->InitTraversal(); triangles->GetNextCell(numberOfTrianglePoints, trianglePointIds); )
+  {
+    if (numberOfTrianglePoints != 3)
+    {
+      continue;
+    }
+    double triangleSliceCoordinates[3] = { sliceCoordinates[trianglePointIds[0]], sliceCoordinates[trianglePointIds[1]], sliceCoordinates[trianglePointIds[2]] };
+    double minimumSliceCoordinate = std::min(triangleSliceCoordinates[0], std::min(triangleSliceCoordinates[1], triangleSliceCoordinates[2]));
+    double maximumSliceCoordinate = std::max(triangleSliceCoordinates[0], std::max(triangleSliceCoordinates[1], triangleSliceCoordinates[2]));
+    double firstSlice = std::max(0.0, floor(minimumSliceCoordinate) + 1.0);
+    double lastSlice = std::min((double)(this->NumberOfSlices - 1), floor(maximumSliceCoordinate));
+    for (int slice=(int)firstSlice; slice<=(int)lastSlice && firstSlice<=lastSlice; ++slice)
+    {
+      SliceSegment segment;
+      bool startFound = false;
+      bool endFound = false;
+      for (int edge=0; edge<3; ++edge)
+      {
+        int a = edge;
+        int b = (edge + 1) % 3;
+        bool aboveA = (triangleSliceCoordinates[a] >= slice);
+        bool aboveB = (triangleSliceCoordinates[b] >= slice);
+        if (aboveA == aboveB)
+        {
+          continue;
+        }
+        // Compute from the point below the plane to the point above it
+        int below = (aboveA ? b : a);
+        int above = (aboveA ? a : b);
+        IntersectionPoint& intersection = (aboveB ? segment.Start : segment.End);
+        ComputeIntersection(trianglePointIds[below], &positions[3*trianglePointIds[below]], triangleSliceCoordinates[below],
+          trianglePointIds[above], &positions[3*trianglePointIds[above]], triangleSliceCoordinates[above], slice, intersection);
+        (aboveB ? startFound : endFound) = true;
+      }
+      if (startFound && endFound && segment.Start.Key != segment.End.Key)
+      {
+        sliceSegments[slice].push_back(segment);
+      }
+    }
+  }
+
+  // Chain segments into contours on each slice
+  for (int slice=0; slice<this->NumberOfSlices; ++slice)
+  {
+    if (!sliceSegments[slice].empty())
+    {
+      this->SliceContours[slice] = BuildContours(sliceSegments[slice]);
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkClosedSurfaceSlicer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "SliceOrigin: (" << this->SliceOrigin[0] << ", " << this->SliceOrigin[1] << ", " << this->SliceOrigin[2] << ")\n";
+  os << indent << "SliceStep: (" << this->SliceStep[0] << ", " << this->SliceStep[1] << ", " << this->SliceStep[2] << ")\n";
+  os << indent << "NumberOfSlices: " << this->NumberOfSlices << "\n";
+}
@@ -0,0 +1,95 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkClosedSurfaceSlicer_h
+#define __vtkClosedSurfaceSlicer_h
+
+#include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkPolyData;
+
+/// \ingroup SlicerRt_QtModules_DicomRtImportExport
+/// \brief Cut a closed surface with a stack of equally spaced parallel planes
+///
+/// Gives the same contours as cutting the surface with vtkCutter and joining the line segments using
+/// vtkStripper on each plane, but in a single pass over the surface: the slice coordinate of each point
+/// is computed once, and each triangle is intersected only with the planes within its slice range.
+/// Intersection points are identified by the edge (or point) of the surface they lie on, so the segments
+/// are chained into contours exactly, without point merging tolerance. Contours are not split into
+/// parts of limited length (as vtkStripper does by default).
+///
+/// This is not a VTK pipeline filter, because its result is a separate poly data for each slice
+/// (see \sa GetSliceContours) rather than a single output data object.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkClosedSurfaceSlicer : public vtkObject
+{
+public:
+  static vtkClosedSurfaceSlicer* New();
+  vtkTypeMacro(vtkClosedSurfaceSlicer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set closed surface to cut, in the coordinate system of the slice planes
+  void SetInputData(vtkPolyData* closedSurface);
+  /// Get closed surface to cut
+  vtkPolyData* GetInput();
+
+  /// Set slice planes. Plane n (0 <= n < numberOfSlices) contains the point origin + n*step, and its normal is step
+  void SetSlicePlanes(const double origin[3], const double step[3], int numberOfSlices);
+  /// Get number of slice planes
+  vtkGetMacro(NumberOfSlices, int);
+
+  /// Compute contours on all slice planes
+  /// \return Success flag
+  bool Update();
+
+  /// Get contours of a slice computed in the last update. Each polygon cell is one contour,
+  /// and closed contours end with their first point (same as the lines created by vtkStripper).
+  /// \return NULL if the slice index is invalid or the surface does not intersect the slice plane
+  vtkPolyData* GetSliceContours(int sliceIndex);
+
+protected:
+  vtkClosedSurfaceSlicer();
+  virtual ~vtkClosedSurfaceSlicer();
+
+protected:
+  vtkSmartPointer<vtkPolyData> Input;
+
+  /// Point on the first slice plane
+  double SliceOrigin[3];
+  /// Vector from a slice plane to the next one
+  double SliceStep[3];
+  /// Number of slice planes
+  int NumberOfSlices;
+
+  /// Contours of each slice in the last update, NULL for slices without contours
+  std::vector< vtkSmartPointer<vtkPolyData> > SliceContours;
+
+private:
+  vtkClosedSurfaceSlicer(const vtkClosedSurfaceSlicer&); // Not implemented
+  void operator=(const vtkClosedSurfaceSlicer&);         // Not implemented
+};
+
+#endif
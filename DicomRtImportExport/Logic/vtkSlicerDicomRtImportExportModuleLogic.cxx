@@ -27,6 +27,7 @@
 #include "vtkSlicerDicomRtImportExportModuleLogic.h"
 #include "vtkSlicerDicomRtReader.h"
 #include "vtkSlicerDicomRtWriter.h"
+#include "vtkClosedSurfaceSlicer.h"
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
 #include "vtkPlanarContourToRibbonModelConversionRule.h"
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
@@ -47,6 +48,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtTaskPool.h"
 #include "PlmCommon.h"
 #include "vtkMRMLIsodoseNode.h"
 #include "vtkMRMLPlanarImageNode.h"
@@ -71,6 +73,7 @@
 #include <dcmtk/dcmdata/dcdeftag.h>
 #include <dcmtk/dcmdata/dcdatset.h>
 #include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/dcmdata/dcsequen.h>
 #include <dcmtk/ofstd/ofcond.h>
 #include <dcmtk/ofstd/ofstring.h>
 #include <dcmtk/ofstd/ofstd.h> // for class OFStandard
@@ -100,18 +103,20 @@
 #include <vtkPolyData.h>
 #include <vtkImageData.h>
 #include <vtkLookupTable.h>
-#include <vtkImageCast.h>
+#include <vtkImageShiftScale.h>
+#include <vtkMatrix4x4.h>
 #include <vtkStringArray.h>
 #include <vtkObjectFactory.h>
 #include <vtkGeneralTransform.h>
 #include <vtkTransformPolyDataFilter.h>
-#include <vtkCutter.h>
-#include <vtkStripper.h>
-#include <vtkPlane.h>
+#include <vtksys/SystemTools.hxx>
 
 // ITK includes
 #include <itkImage.h>
 
+// STD includes
+#include <map>
+
 // GDCM includes
 #include <gdcmIPPSorter.h>
 
@@ -125,6 +130,14 @@ vtkCxxSetObjectMacro(vtkSlicerDicomRtImportExportModuleLogic, IsodoseLogic, vtkS
 vtkCxxSetObjectMacro(vtkSlicerDicomRtImportExportModuleLogic, PlanarImageLogic, vtkSlicerPlanarImageModuleLogic);
 vtkCxxSetObjectMacro(vtkSlicerDicomRtImportExportModuleLogic, BeamsLogic, vtkSlicerBeamsModuleLogic);
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Maximum number of examined files kept in the cache. If it grows larger, then the cache is cleared
+  /// before the next examination, so that browsing many DICOM databases does not accumulate memory.
+  const unsigned int MAX_NUMBER_OF_CACHED_EXAMINED_FILES = 50000;
+}
+
 //----------------------------------------------------------------------------
 class vtkSlicerDicomRtImportExportModuleLogic::vtkInternal
 {
@@ -132,6 +145,54 @@ public:
   vtkInternal(vtkSlicerDicomRtImportExportModuleLogic* external);
   ~vtkInternal() { };
 
+  /// Result of examining one DICOM file. Cached by file path, and invalidated if the modification time
+  /// or the size of the file changes
+  struct ExaminedFile
+  {
+    ExaminedFile() : ModifiedTime(0), FileSize(0), Loadable(false) { };
+    /// Modification time of the file when it was examined
+    long ModifiedTime;
+    /// Size of the file when it was examined
+    unsigned long FileSize;
+    /// Flag indicating whether the file contains a supported RT object
+    bool Loadable;
+    OFString SOPClassUID;
+    /// Name of the loadable (without the referenced plan name in case of RT dose)
+    OFString Name;
+    std::vector<OFString> ReferencedSOPInstanceUIDs;
+  };
+
+  /// Files to examine, shared between the worker threads
+  struct ExamineTaskList
+  {
+    std::vector<std::string> FileNames;
+    std::vector<ExaminedFile*> Results;
+    vtkInternal* Internal;
+  };
+
+  /// Examine one DICOM file. Only the header is read (parsing stops before the contours of structure sets
+  /// and before the pixel data), and the referenced UIDs are gathered directly from the dataset.
+  /// Can be called from any thread.
+  void ExamineFile(const std::string& fileName, ExaminedFile& examinedFile);
+
+  /// Task function examining one file of an ExamineTaskList
+  static void ExamineFileTaskFunction(void* userData, int taskIndex);
+
+  /// Closed surfaces to cut into planar contours on export, shared between the worker threads
+  struct SliceSurfaceTaskList
+  {
+    std::vector<vtkClosedSurfaceSlicer*> Slicers;
+    /// Success flag of each slicer (not bool, as elements of a bool vector cannot be set from multiple threads)
+    std::vector<char> Results;
+  };
+
+  /// Task function updating one slicer of a SliceSurfaceTaskList
+  static void SliceSurfaceTaskFunction(void* userData, int taskIndex);
+
+  /// Append the name of the referenced RT plan to the names of RT dose files. The DICOM database
+  /// is opened once for all the files. Must be called from the main thread.
+  void AppendRtPlanNamesToRtDoseNames(std::vector<ExaminedFile*>& examinedFiles, std::vector<OFString>& names);
+
   /// Examine RT Dose dataset and assemble name and referenced SOP instances
   void ExamineRtDoseDataset(DcmDataset* dataset, OFString &name, std::vector<OFString> &referencedSOPInstanceUIDs);
 
@@ -178,6 +239,9 @@ public:
 
 public:
   vtkSlicerDicomRtImportExportModuleLogic* External;
+
+  /// Examination results by file path
+  std::map<std::string, ExaminedFile> ExaminedFileCache;
 };
 
 //----------------------------------------------------------------------------
@@ -212,45 +276,16 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtDoseDataset(
     name += " [" + instanceNumber + "]";
   }
 
-  // Find RTPlan name for RTDose series
-  OFString referencedSOPInstanceUID("");
-  DRTDoseIOD rtDoseObject;
-  if (rtDoseObject.read(*dataset).good())
+  // Get referenced RTPlan (its name is appended to the dose name in AppendRtPlanNamesToRtDoseNames)
+  DcmItem* referencedRTPlanItem = NULL;
+  if (dataset->findAndGetSequenceItem(DCM_ReferencedRTPlanSequence, referencedRTPlanItem, 0).good() && referencedRTPlanItem)
   {
-    DRTReferencedRTPlanSequence &referencedRTPlanSequence = rtDoseObject.getReferencedRTPlanSequence();
-    if (referencedRTPlanSequence.gotoFirstItem().good())
+    OFString referencedSOPInstanceUID("");
+    if (referencedRTPlanItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good() && !referencedSOPInstanceUID.empty())
     {
-      DRTReferencedRTPlanSequence::Item &referencedRTPlanSequenceItem = referencedRTPlanSequence.getCurrentItem();
-      if (referencedRTPlanSequenceItem.isValid())
-      {
-        if (referencedRTPlanSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-        {
-          referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-        }
-      }
+      referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
     }
   }
-
-  // Create and open DICOM database to perform database operations for getting RTPlan name
-  QSettings settings;
-  QString databaseDirectory = settings.value("DatabaseDirectory").toString();
-  QString databaseFile = databaseDirectory + vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME.c_str();
-  ctkDICOMDatabase* dicomDatabase = new ctkDICOMDatabase();
-  dicomDatabase->openDatabase(databaseFile, vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
-
-  // Get RTPlan name to show it with the dose
-  QString rtPlanLabelTag("300a,0002");
-  QString rtPlanFileName = dicomDatabase->fileForInstance(referencedSOPInstanceUID.c_str());
-  if (!rtPlanFileName.isEmpty())
-  {
-    name += OFString(": ") + OFString(dicomDatabase->fileValue(rtPlanFileName,rtPlanLabelTag).toLatin1().constData());
-  }
-
-  // Close and delete DICOM database
-  dicomDatabase->closeDatabase();
-  delete dicomDatabase;
-  QSqlDatabase::removeDatabase(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
-  QSqlDatabase::removeDatabase(QString(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str()) + "TagCache");
 }
 
 //-----------------------------------------------------------------------------
@@ -306,98 +341,28 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtStructureSet
     name += ": " + structLabel;
   }
 
-  // Get referenced image instance UIDs
-  OFString referencedSOPInstanceUID("");
-  DRTStructureSetIOD rtStructureSetObject;
-  if (rtStructureSetObject.read(*dataset).good())
+  // Get referenced image instance UIDs from the referenced frame of reference sequence.
+  // The elements are accessed directly in the dataset instead of reading the whole structure set
+  // into an IOD object, which would load all contour data.
+  DcmItem* referencedFrameOfReferenceItem = NULL;
+  DcmItem* referencedStudyItem = NULL;
+  DcmItem* referencedSeriesItem = NULL;
+  DcmSequenceOfItems* contourImageSequence = NULL;
+  if ( dataset->findAndGetSequenceItem(DCM_ReferencedFrameOfReferenceSequence, referencedFrameOfReferenceItem, 0).good() && referencedFrameOfReferenceItem
+    && referencedFrameOfReferenceItem->findAndGetSequenceItem(DCM_RTReferencedStudySequence, referencedStudyItem, 0).good() && referencedStudyItem
+    && referencedStudyItem->findAndGetSequenceItem(DCM_RTReferencedSeriesSequence, referencedSeriesItem, 0).good() && referencedSeriesItem
+    && referencedSeriesItem->findAndGetSequence(DCM_ContourImageSequence, contourImageSequence).good() && contourImageSequence )
   {
-    DRTROIContourSequence &rtROIContourSequenceObject = rtStructureSetObject.getROIContourSequence();
-    if (rtROIContourSequenceObject.gotoFirstItem().good())
+    for (unsigned long itemIndex=0; itemIndex<contourImageSequence->card(); ++itemIndex)
     {
-      do // For all ROIs
+      DcmItem* contourImageItem = contourImageSequence->getItem(itemIndex);
+      OFString referencedSOPInstanceUID("");
+      if (contourImageItem && contourImageItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good())
       {
-        DRTROIContourSequence::Item &currentRoiObject = rtROIContourSequenceObject.getCurrentItem();
-        if (currentRoiObject.isValid())
-        {
-          DRTContourSequence &rtContourSequenceObject = currentRoiObject.getContourSequence();
-          if (rtContourSequenceObject.gotoFirstItem().good())
-          {
-            do // For all contours
-            {
-              DRTContourSequence::Item &contourItem = rtContourSequenceObject.getCurrentItem();
-              if (!contourItem.isValid())
-              {
-                DRTContourImageSequence &rtContourImageSequenceObject = contourItem.getContourImageSequence();
-                if (rtContourImageSequenceObject.gotoFirstItem().good())
-                {
-                  DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                  if (rtContourImageSequenceItem.isValid())
-                  {
-                    OFString referencedSOPInstanceUID("");
-                    if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                    {
-                      referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                    }
-                  }
-                }
-              }
-            } // For all contours
-            while (rtContourSequenceObject.gotoNextItem().good());
-          }
-        }
-      } // For all ROIs
-      while (rtROIContourSequenceObject.gotoNextItem().good());
-    } // End ROIContourSequence
-
-    // If the above tags do not store the referenced instance UIDs, then look at the other possible place
-    if (referencedSOPInstanceUIDs.empty())
-    {
-      DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject = rtStructureSetObject.getReferencedFrameOfReferenceSequence();
-      if (rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
-      {
-        DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
-        if (currentReferencedFrameOfReferenceSequenceItem.isValid())
-        {
-          DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
-          if (rtReferencedStudySequenceObject.gotoFirstItem().good())
-          {
-            DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
-            if (rtReferencedStudySequenceItem.isValid())
-            {
-              DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
-              if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
-              {
-                if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
-                {
-                  DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject.getCurrentItem();
-                  if (rtReferencedSeriesSequenceItem.isValid())
-                  {
-                    DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
-                    if (rtContourImageSequenceObject.gotoFirstItem().good())
-                    {
-                      do
-                      {
-                        DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                        if (rtContourImageSequenceItem.isValid())
-                        {
-                          OFString referencedSOPInstanceUID("");
-                          if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                          {
-                            referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                          }
-                        }
-                      } // For all contours
-                      while (rtContourImageSequenceObject.gotoNextItem().good());
-                    }
-                  }
-                }
-              }
-            }
-          }
-        }
+        referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
       }
-    } // End DRTReferencedFrameOfReferenceSequence
-  } // End finding referenced instance UIDs
+    }
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -418,19 +383,151 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtImageDataset
   }
 
   // Get referenced RTPlan
-  OFString referencedSOPInstanceUID("");
-  DRTImageIOD rtImageObject;
-  if (rtImageObject.read(*dataset).good())
+  DcmItem* referencedRTPlanItem = NULL;
+  if (dataset->findAndGetSequenceItem(DCM_ReferencedRTPlanSequence, referencedRTPlanItem, 0).good() && referencedRTPlanItem)
   {
-    DRTReferencedRTPlanSequenceInRTImageModule &rtReferencedRtPlanSequenceObject = rtImageObject.getReferencedRTPlanSequence();
-    if (rtReferencedRtPlanSequenceObject.gotoFirstItem().good())
+    OFString referencedSOPInstanceUID("");
+    if (referencedRTPlanItem->findAndGetOFString(DCM_ReferencedSOPInstanceUID, referencedSOPInstanceUID).good())
     {
-      DRTReferencedRTPlanSequenceInRTImageModule::Item &currentReferencedRtPlanSequenceObject = rtReferencedRtPlanSequenceObject.getCurrentItem();
-      if (currentReferencedRtPlanSequenceObject.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-      {
-        referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-      }
+      referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFile(const std::string& fileName, ExaminedFile& examinedFile)
+{
+  examinedFile.Loadable = false;
+  examinedFile.SOPClassUID.clear();
+  examinedFile.Name.clear();
+  examinedFile.ReferencedSOPInstanceUIDs.clear();
+
+  // Load file header in DCMTK. Parsing stops at the ROI contour sequence, so that the contours of structure
+  // sets are not parsed at all. Values longer than the default maximum read length are not loaded
+  DcmFileFormat fileformat;
+  OFCondition result = fileformat.loadFileUntilTag(fileName.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_ROIContourSequence);
+  if (!result.good())
+  {
+    return; // Failed to parse this file, skip it
+  }
+
+  // Check SOP Class UID for one of the supported RT objects
+  DcmDataset *dataset = fileformat.getDataset();
+  OFString sopClass;
+  if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
+  {
+    return; // Failed to parse this file, skip it
+  }
+  examinedFile.SOPClassUID = sopClass;
+
+  // The other RT objects contain examined elements after the ROI contour sequence tag (e.g. RT plan label
+  // or referenced RT plan sequence), so they are read again until the pixel data
+  if (sopClass == UID_RTDoseStorage || sopClass == UID_RTPlanStorage || sopClass == UID_RTImageStorage)
+  {
+    result = fileformat.loadFileUntilTag(fileName.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+    if (!result.good())
+    {
+      return; // Failed to parse this file, skip it
+    }
+    dataset = fileformat.getDataset();
+  }
+
+  // DICOM parsing is successful, now check if the object is loadable
+  OFString name("");
+  OFString seriesNumber("");
+  dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
+  if (!seriesNumber.empty())
+  {
+    name += seriesNumber + ": ";
+  }
+
+  // RTDose
+  if (sopClass == UID_RTDoseStorage)
+  {
+    this->ExamineRtDoseDataset(dataset, name, examinedFile.ReferencedSOPInstanceUIDs);
+  }
+  // RTPlan
+  else if (sopClass == UID_RTPlanStorage)
+  {
+    this->ExamineRtPlanDataset(dataset, name, examinedFile.ReferencedSOPInstanceUIDs);
+  }
+  // RTStructureSet
+  else if (sopClass == UID_RTStructureSetStorage)
+  {
+    this->ExamineRtStructureSetDataset(dataset, name, examinedFile.ReferencedSOPInstanceUIDs);
+  }
+  // RTImage
+  else if (sopClass == UID_RTImageStorage)
+  {
+    this->ExamineRtImageDataset(dataset, name, examinedFile.ReferencedSOPInstanceUIDs);
+  }
+  /* Not yet supported
+  else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
+  else if (sopClass == UID_RTIonPlanStorage)
+  else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
+  */
+  else
+  {
+    return; // Not an RT file
+  }
+
+  examinedFile.Name = name;
+  examinedFile.Loadable = true;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFileTaskFunction(void* userData, int taskIndex)
+{
+  ExamineTaskList* taskList = static_cast<ExamineTaskList*>(userData);
+  taskList->Internal->ExamineFile(taskList->FileNames[taskIndex], *(taskList->Results[taskIndex]));
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::SliceSurfaceTaskFunction(void* userData, int taskIndex)
+{
+  SliceSurfaceTaskList* taskList = static_cast<SliceSurfaceTaskList*>(userData);
+  taskList->Results[taskIndex] = taskList->Slicers[taskIndex]->Update();
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::AppendRtPlanNamesToRtDoseNames(std::vector<ExaminedFile*>& examinedFiles, std::vector<OFString>& names)
+{
+  ctkDICOMDatabase* dicomDatabase = NULL;
+  for (unsigned int fileIndex=0; fileIndex<examinedFiles.size(); ++fileIndex)
+  {
+    ExaminedFile* examinedFile = examinedFiles[fileIndex];
+    if ( !examinedFile->Loadable || examinedFile->SOPClassUID != UID_RTDoseStorage
+      || examinedFile->ReferencedSOPInstanceUIDs.empty() )
+    {
+      continue;
+    }
+
+    // Create and open DICOM database to perform database operations for getting RTPlan name
+    if (!dicomDatabase)
+    {
+      QSettings settings;
+      QString databaseDirectory = settings.value("DatabaseDirectory").toString();
+      QString databaseFile = databaseDirectory + vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME.c_str();
+      dicomDatabase = new ctkDICOMDatabase();
+      dicomDatabase->openDatabase(databaseFile, vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
     }
+
+    // Get RTPlan name to show it with the dose
+    QString rtPlanLabelTag("300a,0002");
+    QString rtPlanFileName = dicomDatabase->fileForInstance(examinedFile->ReferencedSOPInstanceUIDs[0].c_str());
+    if (!rtPlanFileName.isEmpty())
+    {
+      names[fileIndex] += OFString(": ") + OFString(dicomDatabase->fileValue(rtPlanFileName,rtPlanLabelTag).toLatin1().constData());
+    }
+  }
+
+  // Close and delete DICOM database
+  if (dicomDatabase)
+  {
+    dicomDatabase->closeDatabase();
+    delete dicomDatabase;
+    QSqlDatabase::removeDatabase(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str());
+    QSqlDatabase::removeDatabase(QString(vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME.c_str()) + "TagCache");
   }
 }
 
@@ -447,56 +544,60 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtDose(vtkSlicerD
   const char* fileName = loadable->GetFiles()->GetValue(0);
   const char* seriesName = loadable->GetName();
 
-  // Load Volume
-  vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  volumeStorageNode->SetFileName(fileName);
-  volumeStorageNode->ResetFileNameList();
-  volumeStorageNode->SetSingleFile(1);
-
-  // Read volume from disk
-  if (!volumeStorageNode->ReadData(volumeNode))
-  {
-    vtkErrorWithObjectMacro(this->External, "LoadRtDose: Failed to load dose volume file '" << fileName << "' (series name '" << seriesName << "')");
-    return false;
-  }
-
-  volumeNode->SetScene(this->External->GetMRMLScene());
-  std::string volumeNodeName = scene->GenerateUniqueName(seriesName);
-  volumeNode->SetName(volumeNodeName.c_str());
-
-  // Set new spacing
-  double* initialSpacing = volumeNode->GetSpacing();
-  double* correctSpacing = rtReader->GetPixelSpacing();
-  volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
-  volumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
-  scene->AddNode(volumeNode);
-
   // Apply dose grid scaling
   if (!rtReader->GetDoseGridScaling())
   {
-    vtkErrorWithObjectMacro(this->External, "LoadRtDose: Empty dose unit value found for dose volume " << volumeNode->GetName());
+    vtkErrorWithObjectMacro(this->External, "LoadRtDose: Empty dose unit value found for dose volume " << seriesName);
   }
   double doseGridScaling = vtkVariant(rtReader->GetDoseGridScaling()).ToDouble();
 
-  vtkSmartPointer<vtkImageData> floatVolumeData = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  vtkImageData* doseVolumeData = rtReader->GetDoseVolumeData();
+  if (doseVolumeData)
+  {
+    // The reader decoded the dose grid and converted it to dose, use it directly
+    vtkSmartPointer<vtkMatrix4x4> lpsToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    lpsToRasMatrix->SetElement(0,0,-1);
+    lpsToRasMatrix->SetElement(1,1,-1);
+    vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Multiply4x4(lpsToRasMatrix, rtReader->GetDoseVolumeIJKToLPSMatrix(), ijkToRasMatrix);
+    volumeNode->SetIJKToRASMatrix(ijkToRasMatrix);
+    volumeNode->SetAndObserveImageData(doseVolumeData);
+  }
+  else
+  {
+    // Load Volume using the storage node (e.g. compressed pixel data)
+    vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
+    volumeStorageNode->SetFileName(fileName);
+    volumeStorageNode->ResetFileNameList();
+    volumeStorageNode->SetSingleFile(1);
 
-  vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
-  imageCast->SetInputData(volumeNode->GetImageData());
-  imageCast->SetOutputScalarTypeToFloat();
-  imageCast->Update();
-  floatVolumeData->DeepCopy(imageCast->GetOutput());
+    // Read volume from disk
+    if (!volumeStorageNode->ReadData(volumeNode))
+    {
+      vtkErrorWithObjectMacro(this->External, "LoadRtDose: Failed to load dose volume file '" << fileName << "' (series name '" << seriesName << "')");
+      return false;
+    }
 
-  float value = 0.0;
-  float* floatPtr = (float*)floatVolumeData->GetScalarPointer();
-  for (long i=0; i<floatVolumeData->GetNumberOfPoints(); ++i)
-  {
-    value = (*floatPtr) * doseGridScaling;
-    (*floatPtr) = value;
-    ++floatPtr;
+    // Set new spacing
+    double* initialSpacing = volumeNode->GetSpacing();
+    double* correctSpacing = rtReader->GetPixelSpacing();
+    volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
+
+    // Cast to float and apply dose grid scaling in one pass
+    vtkSmartPointer<vtkImageShiftScale> imageShiftScale = vtkSmartPointer<vtkImageShiftScale>::New();
+    imageShiftScale->SetInputData(volumeNode->GetImageData());
+    imageShiftScale->SetScale(doseGridScaling);
+    imageShiftScale->SetOutputScalarTypeToFloat();
+    imageShiftScale->Update();
+    volumeNode->SetAndObserveImageData(imageShiftScale->GetOutput());
   }
 
-  volumeNode->SetAndObserveImageData(floatVolumeData);
+  volumeNode->SetScene(this->External->GetMRMLScene());
+  std::string volumeNodeName = scene->GenerateUniqueName(seriesName);
+  volumeNode->SetName(volumeNodeName.c_str());
+  volumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+  scene->AddNode(volumeNode);
 
   // Get default isodose color table and default dose color table
   vtkMRMLColorTableNode* defaultIsodoseColorTable = vtkSlicerIsodoseModuleLogic::CreateDefaultIsodoseColorTable(scene);
@@ -1567,6 +1668,7 @@ vtkSlicerDicomRtImportExportModuleLogic::vtkSlicerDicomRtImportExportModuleLogic
   this->BeamsLogic = NULL;
 
   this->BeamModelsInSeparateBranch = true;
+  this->NumberOfThreads = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -1587,6 +1689,7 @@ vtkSlicerDicomRtImportExportModuleLogic::~vtkSlicerDicomRtImportExportModuleLogi
 void vtkSlicerDicomRtImportExportModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -1600,6 +1703,9 @@ void vtkSlicerDicomRtImportExportModuleLogic::SetMRMLSceneInternal(vtkMRMLScene
 //---------------------------------------------------------------------------
 void vtkSlicerDicomRtImportExportModuleLogic::OnMRMLSceneEndClose()
 {
+  // Files examined for the closed scene are not likely to be examined again
+  this->ClearExaminedFileCache();
+
   if (!this->GetMRMLScene())
   {
     vtkErrorMacro("OnMRMLSceneEndClose: Invalid MRML scene");
@@ -1635,73 +1741,60 @@ void vtkSlicerDicomRtImportExportModuleLogic::ExamineForLoad(vtkStringArray* fil
   }
   loadables->RemoveAllItems();
 
+  if (this->Internal->ExaminedFileCache.size() > MAX_NUMBER_OF_CACHED_EXAMINED_FILES)
+  {
+    this->ClearExaminedFileCache();
+  }
+
+  // Get examination results from the cache, and collect the files that have not been examined
+  // or have been modified since then
+  vtkInternal::ExamineTaskList taskList;
+  taskList.Internal = this->Internal;
+  std::vector<vtkInternal::ExaminedFile*> examinedFiles;
   for (int fileIndex=0; fileIndex<fileList->GetNumberOfValues(); ++fileIndex)
   {
-    // Load file in DCMTK
-    DcmFileFormat fileformat;
-    vtkStdString fileName = fileList->GetValue(fileIndex);
-    OFCondition result = fileformat.loadFile(fileName.c_str(), EXS_Unknown);
-    if (!result.good())
+    std::string fileName = fileList->GetValue(fileIndex);
+    long modifiedTime = vtksys::SystemTools::ModifiedTime(fileName.c_str());
+    unsigned long fileSize = vtksys::SystemTools::FileLength(fileName.c_str());
+    bool examined = (this->Internal->ExaminedFileCache.find(fileName) != this->Internal->ExaminedFileCache.end());
+    vtkInternal::ExaminedFile& examinedFile = this->Internal->ExaminedFileCache[fileName];
+    if (!examined || examinedFile.ModifiedTime != modifiedTime || examinedFile.FileSize != fileSize)
     {
-      continue; // Failed to parse this file, skip it
+      examinedFile.ModifiedTime = modifiedTime;
+      examinedFile.FileSize = fileSize;
+      taskList.FileNames.push_back(fileName);
+      taskList.Results.push_back(&examinedFile);
     }
+    examinedFiles.push_back(&examinedFile);
+  }
 
-    // Check SOP Class UID for one of the supported RT objects
-    DcmDataset *dataset = fileformat.getDataset();
-    OFString sopClass;
-    if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
-    {
-      continue; // Failed to parse this file, skip it
-    }
+  // Examine the files in parallel. File sizes differ a lot, so the pool hands out the files one by one
+  vtkSlicerRtTaskPool::ExecuteTasks((int)taskList.FileNames.size(), vtkInternal::ExamineFileTaskFunction, &taskList, this->NumberOfThreads);
 
-    // DICOM parsing is successful, now check if the object is loadable
-    OFString name("");
-    OFString seriesNumber("");
-    std::vector<OFString> referencedSOPInstanceUIDs;
-    dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
-    if (!seriesNumber.empty())
-    {
-      name += seriesNumber + ": ";
-    }
+  // Plan names are looked up in the DICOM database every time, as the plan may have been imported since
+  std::vector<OFString> names;
+  for (unsigned int fileIndex=0; fileIndex<examinedFiles.size(); ++fileIndex)
+  {
+    names.push_back(examinedFiles[fileIndex]->Name);
+  }
+  this->Internal->AppendRtPlanNamesToRtDoseNames(examinedFiles, names);
 
-    // RTDose
-    if (sopClass == UID_RTDoseStorage)
-    {
-      this->Internal->ExamineRtDoseDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTPlan
-    else if (sopClass == UID_RTPlanStorage)
-    {
-      this->Internal->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTStructureSet
-    else if (sopClass == UID_RTStructureSetStorage)
-    {
-      this->Internal->ExamineRtStructureSetDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTImage
-    else if (sopClass == UID_RTImageStorage)
-    {
-      this->Internal->ExamineRtImageDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    /* Not yet supported
-    else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
-    else if (sopClass == UID_RTIonPlanStorage)
-    else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
-    */
-    else
+  // Create and set up loadables for the RT objects in the order of the files
+  for (unsigned int fileIndex=0; fileIndex<examinedFiles.size(); ++fileIndex)
+  {
+    vtkInternal::ExaminedFile* examinedFile = examinedFiles[fileIndex];
+    if (!examinedFile->Loadable)
     {
-      continue; // Not an RT file
+      continue;
     }
 
-    // The file is a loadable RT object, create and set up loadable
     vtkSmartPointer<vtkSlicerDICOMLoadable> loadable = vtkSmartPointer<vtkSlicerDICOMLoadable>::New();
-    loadable->SetName(name.c_str());
-    loadable->AddFile(fileName.c_str());
+    loadable->SetName(names[fileIndex].c_str());
+    loadable->AddFile(fileList->GetValue(fileIndex).c_str());
     loadable->SetConfidence(1.0);
     loadable->SetSelected(true);
     std::vector<OFString>::iterator uidIt;
-    for (uidIt = referencedSOPInstanceUIDs.begin(); uidIt != referencedSOPInstanceUIDs.end(); ++uidIt)
+    for (uidIt = examinedFile->ReferencedSOPInstanceUIDs.begin(); uidIt != examinedFile->ReferencedSOPInstanceUIDs.end(); ++uidIt)
     {
       loadable->AddReferencedInstanceUID(uidIt->c_str());
     }
@@ -1709,6 +1802,12 @@ void vtkSlicerDicomRtImportExportModuleLogic::ExamineForLoad(vtkStringArray* fil
   }
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::ClearExaminedFileCache()
+{
+  this->Internal->ExaminedFileCache.clear();
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable* loadable)
 {
@@ -2097,16 +2196,22 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
       vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
       transformPolyData->SetTransform(nodeToWorldTransform);
 
-      // Initialize cutting plane with normal of the Z axis of the anatomical image
+      // Cutting planes are the slices of the anatomical image
       vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
       imageOrientedImageData->GetImageToWorldMatrix(imageToWorldMatrix);
       double normal[3] = { imageToWorldMatrix->GetElement(0,2), imageToWorldMatrix->GetElement(1,2), imageToWorldMatrix->GetElement(2,2) };
-      vtkSmartPointer<vtkPlane> slicePlane = vtkSmartPointer<vtkPlane>::New();
-      slicePlane->SetNormal(normal);
-
-      // Export each segment in segmentation
+      int imageExtent[6] = {0,-1,0,-1,0,-1};
+      imageOrientedImageData->GetExtent(imageExtent);
+      double firstSliceOrigin[3] = { imageToWorldMatrix->GetElement(0,3) + imageExtent[4]*normal[0],
+                                     imageToWorldMatrix->GetElement(1,3) + imageExtent[4]*normal[1],
+                                     imageToWorldMatrix->GetElement(2,3) + imageExtent[4]*normal[2] };
+      int numberOfSlices = std::max(0, imageExtent[5]-imageExtent[4]);
+
+      // Transform the closed surface of each segment to world coordinates
       std::vector< std::string > segmentIDs;
       segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+      std::vector< vtkSmartPointer<vtkClosedSurfaceSlicer> > slicers;
+      vtkInternal::SliceSurfaceTaskList taskList;
       for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
       {
         std::string segmentID = *segmentIdIt;
@@ -2122,54 +2227,56 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
           return error;
         }
 
-        // Initialize cutter pipeline for segment
         transformPolyData->SetInputData(closedSurfacePolyData);
-        vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
-        cutter->SetInputConnection(transformPolyData->GetOutputPort());
-        cutter->SetGenerateCutScalars(0);
-        vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
-        stripper->SetInputConnection(cutter->GetOutputPort());
-
-        // Get segment bounding box
-        double bounds[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
         transformPolyData->Update();
-        transformPolyData->GetOutput()->GetBounds(bounds);
+        vtkSmartPointer<vtkPolyData> worldClosedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+        worldClosedSurfacePolyData->ShallowCopy(transformPolyData->GetOutput());
+
+        vtkSmartPointer<vtkClosedSurfaceSlicer> slicer = vtkSmartPointer<vtkClosedSurfaceSlicer>::New();
+        slicer->SetInputData(worldClosedSurfacePolyData);
+        slicer->SetSlicePlanes(firstSliceOrigin, normal, numberOfSlices);
+        slicers.push_back(slicer);
+        taskList.Slicers.push_back(slicer);
+      }
+      taskList.Results.resize(slicers.size(), 0);
+
+      // Create planar contours from the closed surfaces, segments in parallel. Segment sizes differ a lot,
+      // so each segment is a separate task of the pool
+      vtkSlicerRtTaskPool::ExecuteTasks((int)taskList.Slicers.size(), vtkInternal::SliceSurfaceTaskFunction, &taskList, this->NumberOfThreads);
+
+      // Export each segment in segmentation
+      for (unsigned int segmentIndex=0; segmentIndex<segmentIDs.size(); ++segmentIndex)
+      {
+        std::string segmentID = segmentIDs[segmentIndex];
+        vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(segmentID);
+        if (!taskList.Results[segmentIndex])
+        {
+          error = "Failed to create planar contours from closed surface of segment " + segmentID;
+          vtkErrorMacro("ExportDicomRTStudy: " + error);
+          return error;
+        }
 
         // Containers to be passed to the writer
         std::vector<int> sliceNumbers;
         std::vector<std::string> sliceUIDs;
         std::vector<vtkPolyData*> sliceContours;
 
-        // Create planar contours from closed surface based on each of the anatomical image slices
-        int imageExtent[6] = {0,-1,0,-1,0,-1};
-        imageOrientedImageData->GetExtent(imageExtent);
-        for (int slice=imageExtent[4]; slice<imageExtent[5]; ++slice)
+        for (int sliceIndex=0; sliceIndex<numberOfSlices; ++sliceIndex)
         {
-          // Calculate slice origin
-          double origin[3] = { imageToWorldMatrix->GetElement(0,3) + slice*normal[0],
-                               imageToWorldMatrix->GetElement(1,3) + slice*normal[1],
-                               imageToWorldMatrix->GetElement(2,3) + slice*normal[2] };
-          slicePlane->SetOrigin(origin);
-          if (origin[2] < bounds[4] || origin[2] > bounds[5])
+          vtkPolyData* sliceContour = slicers[segmentIndex]->GetSliceContours(sliceIndex);
+          if (!sliceContour)
           {
-            // No contours outside surface bounds
+            // Segment does not intersect slice
             continue;
           }
 
-          // Cut closed surface at slice
-          cutter->SetCutFunction(slicePlane);
-
           // Get instance UID of corresponding slice
-          int sliceNumber = slice-imageExtent[0];
+          int sliceNumber = imageExtent[4]+sliceIndex-imageExtent[0];
           sliceNumbers.push_back(sliceNumber);
           std::string sliceInstanceUID = (imageSliceUIDs.size() > static_cast<size_t>(sliceNumber) ? imageSliceUIDs[sliceNumber] : "");
           sliceUIDs.push_back(sliceInstanceUID);
 
-          // Save slice contour
-          stripper->Update();
-          vtkPolyData* sliceContour = vtkPolyData::New();
-          sliceContour->SetPoints(stripper->GetOutput()->GetPoints());
-          sliceContour->SetPolys(stripper->GetOutput()->GetLines());
+          // Slice contours are owned by the slicer
           sliceContours.push_back(sliceContour);
         } // For each anatomical image slice
 
@@ -2179,12 +2286,6 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
 
         // Add contours to writer
         rtWriter->AddStructure(segmentName.c_str(), segmentColor, sliceNumbers, sliceUIDs, sliceContours);
-
-        // Clean up slice contours
-        for (std::vector<vtkPolyData*>::iterator contourIt=sliceContours.begin(); contourIt!=sliceContours.end(); ++contourIt)
-        {
-          (*contourIt)->Delete();
-        }
       } // For each segment
     }
     else
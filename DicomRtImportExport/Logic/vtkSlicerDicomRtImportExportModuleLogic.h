@@ -55,11 +55,17 @@ public:
   vtkTypeMacro(vtkSlicerDicomRtImportExportModuleLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
-  /// Examine a list of file lists and determine what objects can be loaded from them
+  /// Examine a list of file lists and determine what objects can be loaded from them.
+  /// Only the headers of the files are read, in parallel using NumberOfThreads threads. The results are
+  /// cached per file path, modification time and size, so unchanged files are not parsed again. The cache
+  /// is cleared when the scene is closed or when it exceeds a fixed number of files.
   /// \param fileList List of files to examine and generate loadables from
   /// \param loadables Collection to store generated (output) loadables
   void ExamineForLoad(vtkStringArray* fileList, vtkCollection* loadables);
 
+  /// Clear the cached results of ExamineForLoad
+  void ClearExaminedFileCache();
+
   /// Load DICOM RT series from file name
   /// /return True if loading successful
   bool LoadDicomRT(vtkSlicerDICOMLoadable* loadable);
@@ -85,6 +91,9 @@ public:
   vtkGetMacro(BeamModelsInSeparateBranch, bool);
   vtkBooleanMacro(BeamModelsInSeparateBranch, bool);
 
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
 protected:
   virtual void SetMRMLSceneInternal(vtkMRMLScene* newScene) VTK_OVERRIDE;
   virtual void OnMRMLSceneEndClose() VTK_OVERRIDE;
@@ -116,6 +125,11 @@ private:
   /// Flag determining whether the generated beam models are arranged in a separate subject hierarchy
   /// branch, or each beam model is added under its corresponding isocenter fiducial
   bool BeamModelsInSeparateBranch;
+
+  /// Threads examining the files in ExamineForLoad and cutting closed surface segments into planar contours
+  /// in ExportDicomRTStudy. The default 0 lets the task pool use all processor cores, 1 disables threading.
+  /// \sa vtkSlicerRtTaskPool
+  int NumberOfThreads;
 };
 
 #endif
@@ -26,24 +26,35 @@
 
 // SlicerRt includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtTaskPool.h"
 
 // VTK includes
 #include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
 #include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
+#include <vtkVariant.h>
 
 // STD includes
+#include <algorithm>
+#include <cstdlib>
 #include <vector>
 #include <map>
+#include <set>
 
 // DCMTK includes
 #include <dcmtk/config/osconfig.h>    /* make sure OS specific configuration is included first */
 
 #include <dcmtk/ofstd/ofconapp.h>
 
+#include <dcmtk/dcmdata/dcswap.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+
 #include <dcmtk/dcmrt/drtdose.h>
 #include <dcmtk/dcmrt/drtimage.h>
 #include <dcmtk/dcmrt/drtplan.h>
@@ -65,6 +76,95 @@
 // CTK includes
 #include <ctkDICOMDatabase.h>
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Stored dose grid values converted to dose, one frame per task
+  struct DoseScalingTask
+  {
+    const void* StoredValues;
+    int BitsAllocated;
+    bool Signed;
+    float* DoseValues;
+    vtkIdType NumberOfValuesPerFrame;
+    double DoseGridScaling;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Convert stored values to dose. The conversion is identical to casting the values to float
+  /// and then multiplying with the dose grid scaling. The loop is vectorized by the compilers.
+  template<class T> void ScaleDoseValues(const T* storedValues, float* doseValues, vtkIdType numberOfValues, double doseGridScaling)
+  {
+    for (vtkIdType i=0; i<numberOfValues; ++i)
+    {
+      doseValues[i] = static_cast<float>(static_cast<float>(storedValues[i]) * doseGridScaling);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void ScaleDoseFrameTaskFunction(void* userData, int frameIndex)
+  {
+    DoseScalingTask* task = static_cast<DoseScalingTask*>(userData);
+    vtkIdType begin = task->NumberOfValuesPerFrame * frameIndex;
+    float* doseValues = task->DoseValues + begin;
+    if (task->BitsAllocated == 16)
+    {
+      if (task->Signed)
+      {
+        ScaleDoseValues(static_cast<const Sint16*>(task->StoredValues) + begin, doseValues, task->NumberOfValuesPerFrame, task->DoseGridScaling);
+      }
+      else
+      {
+        ScaleDoseValues(static_cast<const Uint16*>(task->StoredValues) + begin, doseValues, task->NumberOfValuesPerFrame, task->DoseGridScaling);
+      }
+    }
+    else
+    {
+      if (task->Signed)
+      {
+        ScaleDoseValues(static_cast<const Sint32*>(task->StoredValues) + begin, doseValues, task->NumberOfValuesPerFrame, task->DoseGridScaling);
+      }
+      else
+      {
+        ScaleDoseValues(static_cast<const Uint32*>(task->StoredValues) + begin, doseValues, task->NumberOfValuesPerFrame, task->DoseGridScaling);
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Convert native pixel data accessed as bytes to values in machine byte order.
+  /// \param wordByteOrder Byte order of the 16-bit words in the buffer
+  /// \param transferSyntaxByteOrder Byte order of the transfer syntax. The words of 32-bit values are in this order
+  ///   even if DCMTK converted the bytes of the words
+  void ConvertPixelDataToLocalByteOrder(Uint8* bytes, size_t length, size_t bytesPerValue,
+    E_ByteOrder wordByteOrder, E_ByteOrder transferSyntaxByteOrder)
+  {
+    if (bytesPerValue == 2 || wordByteOrder == transferSyntaxByteOrder)
+    {
+      // The bytes of the values are in the order of the buffer
+      if (wordByteOrder != gLocalByteOrder)
+      {
+        swapBytes(bytes, length, bytesPerValue);
+      }
+      return;
+    }
+
+    // 32-bit values with words converted by DCMTK: convert the words, then their order
+    if (wordByteOrder != gLocalByteOrder)
+    {
+      swapBytes(bytes, length, sizeof(Uint16));
+    }
+    if (transferSyntaxByteOrder != gLocalByteOrder)
+    {
+      Uint16* words = reinterpret_cast<Uint16*>(bytes);
+      for (size_t wordIndex = 0; wordIndex + 1 < length / sizeof(Uint16); wordIndex += 2)
+      {
+        std::swap(words[wordIndex], words[wordIndex + 1]);
+      }
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 const std::string vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_DATABASE_FILENAME = "/ctkDICOM.sql";
 const std::string vtkSlicerDicomRtReader::DICOMRTREADER_DICOM_CONNECTION_NAME = "SlicerRt";
@@ -149,6 +249,11 @@ public:
 public:
   /// Load RT Dose
   void LoadRTDose(DcmDataset* dataset);
+  /// Decode the dose grid pixel data of an RT Dose dataset directly into a float volume containing the dose values.
+  /// Sets DoseVolumeData and DoseVolumeIJKToLPSMatrix, leaves DoseVolumeData empty if the pixel data cannot be decoded
+  /// this way (e.g. compressed transfer syntax). In that case the dose is loaded by the volume storage node, so the
+  /// reasons are only logged at debug level.
+  void LoadRTDoseVolume(DcmDataset* dataset, double doseGridScaling);
 
   /// Load RT Plan 
   void LoadRTPlan(DcmDataset* dataset);
@@ -157,8 +262,26 @@ public:
   void LoadRTStructureSet(DcmDataset* dataset);
   /// Load contours from a structure sequence
   void LoadContoursFromRoiSequence(DRTStructureSetROISequence* roiSequence);
-  /// Load individual contour from RT Structure Set
-  vtkSlicerDicomRtReader::vtkInternal::RoiEntry* LoadContour(DRTROIContourSequence::Item &roiObject, DRTStructureSetIOD* rtStructureSetObject);
+  /// Contour data of one ROI loaded by a worker thread
+  struct ContourLoadTask
+  {
+    ContourLoadTask() : RoiObject(NULL), Roi(NULL), MultipleReferencedInstancesFound(false), InvalidContourImageItemFound(false) { }
+    DRTROIContourSequence::Item* RoiObject;
+    RoiEntry* Roi;
+    vtkSmartPointer<vtkPolyData> PolyData;
+    std::map<int, std::string> ContourToSliceInstanceUIDMap;
+    std::set<std::string> ReferencedSopInstanceUids;
+    bool MultipleReferencedInstancesFound;
+    bool InvalidContourImageItemFound;
+  };
+  /// Load the planar contours of a ROI into a poly data. Only accesses the ROI contour item of the task, so tasks of
+  /// different ROIs can be run in parallel. The number of points is counted first, and then the points
+  /// (converted from LPS to RAS) and the cells are written directly to pre-sized arrays.
+  static void LoadContourPolyData(ContourLoadTask* task);
+  /// Task function loading the contours of one ROI of a vector of ContourLoadTask
+  static void LoadContourPolyDataTaskFunction(void* userData, int taskIndex);
+  /// Store loaded contour of a ROI in its ROI entry, including display color and referenced SOP instance UIDs
+  void StoreContour(ContourLoadTask& task, DRTStructureSetIOD* rtStructureSetObject);
 
   /// Load RT Image
   void LoadRTImage(DcmDataset* dataset);
@@ -395,8 +518,16 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTDose(DcmDataset* dataset)
 {
   this->External->LoadRTDoseSuccessful = false;
 
+  // The dose IOD would keep its own copy of the pixel data, so the pixel data is taken out of the
+  // dataset while the IOD is read. It is decoded from the dataset in LoadRTDoseVolume.
+  DcmElement* pixelDataElement = dataset->remove(DCM_PixelData);
   DRTDoseIOD rtDoseObject;
-  if (rtDoseObject.read(*dataset).bad())
+  OFCondition readResult = rtDoseObject.read(*dataset);
+  if (pixelDataElement)
+  {
+    dataset->insert(pixelDataElement);
+  }
+  if (readResult.bad())
   {
     vtkErrorWithObjectMacro(this->External, "LoadRTDose: Failed to read RT Dose dataset!");
     return;
@@ -466,9 +597,145 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTDose(DcmDataset* dataset)
   // Get and store patient, study and series information
   this->External->GetAndStoreHierarchyInformation(&rtDoseObject);
 
+  // Decode dose grid
+  this->LoadRTDoseVolume(dataset, vtkVariant(doseGridScaling.c_str()).ToDouble());
+
   this->External->LoadRTDoseSuccessful = true;
 }
 
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::vtkInternal::LoadRTDoseVolume(DcmDataset* dataset, double doseGridScaling)
+{
+  this->External->DoseVolumeData = NULL;
+
+  // Only native (uncompressed) pixel data is decoded here
+  if (DcmXfer(dataset->getOriginalXfer()).isEncapsulated())
+  {
+    vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Encapsulated pixel data is not decoded by the reader");
+    return;
+  }
+
+  Uint16 rows = 0;
+  Uint16 columns = 0;
+  Uint16 bitsAllocated = 0;
+  Uint16 pixelRepresentation = 0;
+  Sint32 numberOfFrames = 1;
+  if ( dataset->findAndGetUint16(DCM_Rows, rows).bad() || dataset->findAndGetUint16(DCM_Columns, columns).bad()
+    || dataset->findAndGetUint16(DCM_BitsAllocated, bitsAllocated).bad() || rows == 0 || columns == 0 )
+  {
+    vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Failed to get dose grid dimensions");
+    return;
+  }
+  dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation);
+  if (dataset->findAndGetSint32(DCM_NumberOfFrames, numberOfFrames).bad() || numberOfFrames < 1)
+  {
+    numberOfFrames = 1;
+  }
+  if (bitsAllocated != 16 && bitsAllocated != 32)
+  {
+    vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Unsupported bits allocated value " << bitsAllocated);
+    return;
+  }
+
+  // Geometry: image position is the center of the first voxel, image orientation contains the row and column directions,
+  // the frames are stacked along their normal at the offsets specified in the grid frame offset vector
+  double imagePosition[3] = {0.0, 0.0, 0.0};
+  double rowDirection[3] = {1.0, 0.0, 0.0};
+  double columnDirection[3] = {0.0, 1.0, 0.0};
+  for (unsigned long i=0; i<3; ++i)
+  {
+    Float64 value = 0.0;
+    if (dataset->findAndGetFloat64(DCM_ImagePositionPatient, value, i).bad())
+    {
+      vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Failed to get image position");
+      return;
+    }
+    imagePosition[i] = value;
+    if ( dataset->findAndGetFloat64(DCM_ImageOrientationPatient, value, i).bad() )
+    {
+      vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Failed to get image orientation");
+      return;
+    }
+    rowDirection[i] = value;
+    dataset->findAndGetFloat64(DCM_ImageOrientationPatient, value, i+3);
+    columnDirection[i] = value;
+  }
+  double sliceDirection[3] = {0.0, 0.0, 1.0};
+  vtkMath::Cross(rowDirection, columnDirection, sliceDirection);
+  double sliceSpacing = 1.0;
+  if (numberOfFrames > 1)
+  {
+    Float64 firstOffset = 0.0;
+    Float64 secondOffset = 0.0;
+    if ( dataset->findAndGetFloat64(DCM_GridFrameOffsetVector, firstOffset, 0).bad()
+      || dataset->findAndGetFloat64(DCM_GridFrameOffsetVector, secondOffset, 1).bad() )
+    {
+      vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Failed to get grid frame offset vector");
+      return;
+    }
+    sliceSpacing = secondOffset - firstOffset;
+    if (sliceSpacing < 0)
+    {
+      // Frames are stacked opposite to the normal direction
+      sliceSpacing = -sliceSpacing;
+      vtkMath::MultiplyScalar(sliceDirection, -1.0);
+    }
+    if (sliceSpacing == 0)
+    {
+      vtkWarningWithObjectMacro(this->External, "LoadRTDoseVolume: Zero frame spacing in grid frame offset vector, using 1mm");
+      sliceSpacing = 1.0;
+    }
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> ijkToLpsMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int i=0; i<3; ++i)
+  {
+    ijkToLpsMatrix->SetElement(i, 0, rowDirection[i] * this->External->PixelSpacing[0]);
+    ijkToLpsMatrix->SetElement(i, 1, columnDirection[i] * this->External->PixelSpacing[1]);
+    ijkToLpsMatrix->SetElement(i, 2, sliceDirection[i] * sliceSpacing);
+    ijkToLpsMatrix->SetElement(i, 3, imagePosition[i]);
+  }
+
+  // Get stored values. Native pixel data (OB or OW) can only be accessed as 8 or 16-bit values, so it is accessed
+  // as bytes, converted to machine byte order with the width of the stored values, and then reinterpreted according
+  // to bits allocated. DCMTK gives OW data as little endian words, OB data in the byte order of the transfer syntax.
+  vtkIdType numberOfVoxels = (vtkIdType)columns * rows * numberOfFrames;
+  size_t bytesPerValue = bitsAllocated / 8;
+  DcmElement* pixelDataElement = NULL;
+  Uint8* pixelDataBytes = NULL;
+  if ( dataset->findAndGetElement(DCM_PixelData, pixelDataElement).bad() || !pixelDataElement
+    || pixelDataElement->getUint8Array(pixelDataBytes).bad() || !pixelDataBytes
+    || (vtkIdType)(pixelDataElement->getLength() / bytesPerValue) < numberOfVoxels )
+  {
+    vtkDebugWithObjectMacro(this->External, "LoadRTDoseVolume: Failed to get dose grid pixel data");
+    return;
+  }
+  E_ByteOrder transferSyntaxByteOrder = DcmXfer(dataset->getOriginalXfer()).getByteOrder();
+  E_ByteOrder wordByteOrder = (pixelDataElement->getVR() == EVR_OW ? EBO_LittleEndian : transferSyntaxByteOrder);
+  ConvertPixelDataToLocalByteOrder(pixelDataBytes, pixelDataElement->getLength(), bytesPerValue, wordByteOrder, transferSyntaxByteOrder);
+
+  // Convert to dose directly in the buffer of the output volume
+  vtkSmartPointer<vtkImageData> doseVolumeData = vtkSmartPointer<vtkImageData>::New();
+  doseVolumeData->SetExtent(0, columns-1, 0, rows-1, 0, numberOfFrames-1);
+  doseVolumeData->AllocateScalars(VTK_FLOAT, 1);
+
+  DoseScalingTask task;
+  task.StoredValues = pixelDataBytes;
+  task.BitsAllocated = bitsAllocated;
+  task.Signed = (pixelRepresentation == 1);
+  task.DoseValues = static_cast<float*>(doseVolumeData->GetScalarPointer());
+  task.NumberOfValuesPerFrame = (vtkIdType)columns * rows;
+  task.DoseGridScaling = doseGridScaling;
+  // Frames are converted in parallel using all processor cores
+  vtkSlicerRtTaskPool::ExecuteTasks(numberOfFrames, ScaleDoseFrameTaskFunction, &task, 0);
+
+  // The stored values are not needed any more
+  delete dataset->remove(DCM_PixelData);
+
+  this->External->DoseVolumeData = doseVolumeData;
+  this->External->DoseVolumeIJKToLPSMatrix->DeepCopy(ijkToLpsMatrix);
+}
+
 //----------------------------------------------------------------------------
 void vtkSlicerDicomRtReader::vtkInternal::LoadRTPlan(DcmDataset* dataset)
 {
@@ -701,19 +968,46 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTStructureSet(DcmDataset* dataset
     return;
   }
 
-  // Read ROIs, iterate over ROI contour sequence
+  // Collect ROIs, iterate over ROI contour sequence
+  std::vector<ContourLoadTask> contourLoadTasks;
   do 
   {
     DRTROIContourSequence::Item &currentRoiObject = rtROIContourSequenceObject.getCurrentItem();
-    RoiEntry* currentRoiEntry = this->LoadContour(currentRoiObject, rtStructureSetObject);
-    if (currentRoiEntry)
+    if (!currentRoiObject.isValid())
     {
-      // Set referenced series UID
-      currentRoiEntry->ReferencedSeriesUID = (std::string)referencedSeriesInstanceUID.c_str();
+      continue;
     }
+
+    // Get ROI entry created for the referenced ROI
+    Sint32 referencedRoiNumber = -1;
+    currentRoiObject.getReferencedROINumber(referencedRoiNumber);
+    RoiEntry* roiEntry = this->FindRoiByNumber(referencedRoiNumber);
+    if (roiEntry == NULL)
+    {
+      vtkErrorWithObjectMacro(this->External, "LoadRTStructureSet: ROI with number " << referencedRoiNumber << " is not found!");
+      continue;
+    }
+
+    ContourLoadTask task;
+    task.RoiObject = &currentRoiObject;
+    task.Roi = roiEntry;
+    contourLoadTasks.push_back(task);
   }
   while (rtROIContourSequenceObject.gotoNextItem().good());
 
+  // Load contour data of the ROIs in parallel into independent poly data objects. ROIs contain very different
+  // number of points, so the pool hands them out one by one
+  vtkSlicerRtTaskPool::ExecuteTasks((int)contourLoadTasks.size(), vtkInternal::LoadContourPolyDataTaskFunction, &contourLoadTasks, 0);
+
+  // Store loaded ROIs in sequence order
+  for (std::vector<ContourLoadTask>::iterator taskIt = contourLoadTasks.begin(); taskIt != contourLoadTasks.end(); ++taskIt)
+  {
+    this->StoreContour(*taskIt, rtStructureSetObject);
+
+    // Set referenced series UID
+    taskIt->Roi->ReferencedSeriesUID = (std::string)referencedSeriesInstanceUID.c_str();
+  }
+
   // SOP instance UID
   OFString sopInstanceUid("");
   if (rtStructureSetObject->getSOPInstanceUID(sopInstanceUid).bad())
@@ -770,43 +1064,52 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadContoursFromRoiSequence(DRTStructu
 }
 
 //----------------------------------------------------------------------------
-vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkInternal::LoadContour(
-  DRTROIContourSequence::Item &roiObject, DRTStructureSetIOD* rtStructureSetObject)
+void vtkSlicerDicomRtReader::vtkInternal::LoadContourPolyDataTaskFunction(void* userData, int taskIndex)
 {
-  if (!roiObject.isValid())
-  {
-    return NULL;
-  }
-
-  // Used for connection from one planar contour ROI to the corresponding anatomical volume slice instance
-  std::map<int, std::string> contourToSliceInstanceUIDMap;
-  std::set<std::string> referencedSopInstanceUids;
-
-  // Get ROI entry created for the referenced ROI
-  Sint32 referencedRoiNumber = -1;
-  roiObject.getReferencedROINumber(referencedRoiNumber);
-  RoiEntry* roiEntry = this->FindRoiByNumber(referencedRoiNumber);
-  if (roiEntry == NULL)
-  {
-    vtkErrorWithObjectMacro(this->External, "LoadContour: ROI with number " << referencedRoiNumber << " is not found!");      
-    return NULL;
-  } 
+  std::vector<ContourLoadTask>* tasks = static_cast<std::vector<ContourLoadTask>*>(userData);
+  LoadContourPolyData(&(*tasks)[taskIndex]);
+}
 
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::vtkInternal::LoadContourPolyData(ContourLoadTask* task)
+{
   // Get contour sequence
-  DRTContourSequence &rtContourSequenceObject = roiObject.getContourSequence();
+  DRTContourSequence &rtContourSequenceObject = task->RoiObject->getContourSequence();
   if (!rtContourSequenceObject.gotoFirstItem().good())
   {
-    vtkErrorWithObjectMacro(this->External, "LoadContour: Contour sequence for ROI named '"
-      << roiEntry->Name << "' with number " << referencedRoiNumber << " is empty!");
-    return roiEntry;
+    return;
+  }
+
+  // Count the contours and points to allocate the arrays only once
+  vtkIdType numberOfContours = 0;
+  vtkIdType totalNumberOfPoints = 0;
+  do
+  {
+    DRTContourSequence::Item &contourItem = rtContourSequenceObject.getCurrentItem();
+    if (!contourItem.isValid())
+    {
+      continue;
+    }
+    OFString numberOfPointsString("");
+    contourItem.getNumberOfContourPoints(numberOfPointsString);
+    ++numberOfContours;
+    totalNumberOfPoints += std::max(0, atoi(numberOfPointsString.c_str()));
   }
+  while (rtContourSequenceObject.gotoNextItem().good());
 
-  // Create containers for contour poly data
+  // Create containers for contour poly data. Each cell contains its points and the first point again to close the contour
   vtkSmartPointer<vtkPoints> currentRoiContourPoints = vtkSmartPointer<vtkPoints>::New();
-  vtkSmartPointer<vtkCellArray> currentRoiContourCells = vtkSmartPointer<vtkCellArray>::New();
-  vtkIdType pointId = 0;
+  currentRoiContourPoints->SetNumberOfPoints(totalNumberOfPoints);
+  float* pointCoordinates = static_cast<float*>(currentRoiContourPoints->GetData()->GetVoidPointer(0));
+  vtkSmartPointer<vtkIdTypeArray> cellConnectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+  cellConnectivity->SetNumberOfValues(totalNumberOfPoints + 2 * numberOfContours);
+  vtkIdType* connectivity = cellConnectivity->GetPointer(0);
 
   // Read contour data, iterate over contour sequence
+  vtkIdType pointId = 0;
+  vtkIdType connectivityIndex = 0;
+  int contourIndex = 0;
+  rtContourSequenceObject.gotoFirstItem();
   do
   {
     // Get contour
@@ -816,29 +1119,35 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
       continue;
     }
 
-    // Get number of contour points
-    OFString numberOfPointsString("");
-    contourItem.getNumberOfContourPoints(numberOfPointsString);
-    std::stringstream ss;
-    ss << numberOfPointsString;
-    int numberOfPoints;
-    ss >> numberOfPoints;
-
     // Get contour point data
     OFVector<vtkTypeFloat64> contourData_LPS;
     contourItem.getContourData(contourData_LPS);
 
-    unsigned int contourIndex = currentRoiContourCells->InsertNextCell(numberOfPoints+1);
-    for (int k=0; k<numberOfPoints; k++)
+    // Get number of contour points (cannot be more than the number of available coordinates or the counted points)
+    OFString numberOfPointsString("");
+    contourItem.getNumberOfContourPoints(numberOfPointsString);
+    vtkIdType numberOfPoints = std::max(0, atoi(numberOfPointsString.c_str()));
+    numberOfPoints = std::min(numberOfPoints, (vtkIdType)(contourData_LPS.size() / 3));
+    numberOfPoints = std::min(numberOfPoints, totalNumberOfPoints - pointId);
+
+    // Convert from DICOM LPS -> Slicer RAS
+    const vtkTypeFloat64* lpsCoordinates = (contourData_LPS.empty() ? NULL : &contourData_LPS[0]);
+    float* rasCoordinates = pointCoordinates + 3 * pointId;
+    for (vtkIdType k=0; k<numberOfPoints; ++k)
     {
-      // Convert from DICOM LPS -> Slicer RAS
-      currentRoiContourPoints->InsertPoint(pointId, -contourData_LPS[3*k], -contourData_LPS[3*k+1], contourData_LPS[3*k+2]);
-      currentRoiContourCells->InsertCellPoint(pointId);
-      pointId++;
+      rasCoordinates[3*k]   = static_cast<float>(-lpsCoordinates[3*k]);
+      rasCoordinates[3*k+1] = static_cast<float>(-lpsCoordinates[3*k+1]);
+      rasCoordinates[3*k+2] = static_cast<float>(lpsCoordinates[3*k+2]);
     }
 
-    // Close the contour
-    currentRoiContourCells->InsertCellPoint(pointId-numberOfPoints);
+    // Add cell, and close the contour
+    connectivity[connectivityIndex++] = numberOfPoints + 1;
+    for (vtkIdType k=0; k<numberOfPoints; ++k)
+    {
+      connectivity[connectivityIndex++] = pointId + k;
+    }
+    connectivity[connectivityIndex++] = pointId;
+    pointId += numberOfPoints;
 
     // Add map to the referenced slice instance UID
     // This is not a mandatory field so no error logged if not found. The reason why
@@ -851,23 +1160,73 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
       {
         OFString referencedSOPInstanceUID("");
         rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID);
-        contourToSliceInstanceUIDMap[contourIndex] = referencedSOPInstanceUID.c_str();
-        referencedSopInstanceUids.insert(referencedSOPInstanceUID.c_str());
+        task->ContourToSliceInstanceUIDMap[contourIndex] = referencedSOPInstanceUID.c_str();
+        task->ReferencedSopInstanceUids.insert(referencedSOPInstanceUID.c_str());
 
         // Check if multiple SOP instance UIDs are referenced
         if (rtContourImageSequenceObject.getNumberOfItems() > 1)
         {
-          vtkWarningWithObjectMacro(this->External, "LoadContour: Contour in ROI " << roiEntry->Number << ": " << roiEntry->Name << " contains multiple referenced instances. This is not yet supported!");
+          task->MultipleReferencedInstancesFound = true;
         }
       }
       else
       {
-        vtkErrorWithObjectMacro(this->External, "LoadContour: Contour image sequence object item is invalid");
+        task->InvalidContourImageItemFound = true;
       }
     }
+    ++contourIndex;
   }
   while (rtContourSequenceObject.gotoNextItem().good());
 
+  // Shrink arrays if fewer points were found than specified
+  if (pointId < totalNumberOfPoints)
+  {
+    currentRoiContourPoints->SetNumberOfPoints(pointId);
+    currentRoiContourPoints->Squeeze();
+    cellConnectivity->SetNumberOfValues(connectivityIndex);
+    cellConnectivity->Squeeze();
+  }
+  vtkSmartPointer<vtkCellArray> currentRoiContourCells = vtkSmartPointer<vtkCellArray>::New();
+  currentRoiContourCells->SetCells(numberOfContours, cellConnectivity);
+
+  // Save just loaded contour data
+  task->PolyData = vtkSmartPointer<vtkPolyData>::New();
+  task->PolyData->SetPoints(currentRoiContourPoints);
+  if (currentRoiContourPoints->GetNumberOfPoints() == 1)
+  {
+    // Point ROI
+    task->PolyData->SetVerts(currentRoiContourCells);
+  }
+  else if (currentRoiContourPoints->GetNumberOfPoints() > 1)
+  {
+    // Contour ROI
+    task->PolyData->SetLines(currentRoiContourCells);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::vtkInternal::StoreContour(ContourLoadTask& task, DRTStructureSetIOD* rtStructureSetObject)
+{
+  RoiEntry* roiEntry = task.Roi;
+  if (!task.PolyData)
+  {
+    vtkErrorWithObjectMacro(this->External, "StoreContour: Contour sequence for ROI named '"
+      << roiEntry->Name << "' with number " << roiEntry->Number << " is empty!");
+    return;
+  }
+  if (task.MultipleReferencedInstancesFound)
+  {
+    vtkWarningWithObjectMacro(this->External, "StoreContour: Contour in ROI " << roiEntry->Number << ": " << roiEntry->Name << " contains multiple referenced instances. This is not yet supported!");
+  }
+  if (task.InvalidContourImageItemFound)
+  {
+    vtkErrorWithObjectMacro(this->External, "StoreContour: Contour image sequence object item is invalid");
+  }
+
+  // Used for connection from one planar contour ROI to the corresponding anatomical volume slice instance
+  std::map<int, std::string>& contourToSliceInstanceUIDMap = task.ContourToSliceInstanceUIDMap;
+  std::set<std::string>& referencedSopInstanceUids = task.ReferencedSopInstanceUids;
+
   // Read slice reference UIDs from referenced frame of reference sequence if it was not included in the ROIContourSequence above
   if (contourToSliceInstanceUIDMap.empty())
   {
@@ -887,7 +1246,7 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
         }
         else
         {
-          vtkErrorWithObjectMacro(this->External, "LoadContour: Contour image sequence object item in referenced frame of reference sequence is invalid");
+          vtkErrorWithObjectMacro(this->External, "StoreContour: Contour image sequence object item in referenced frame of reference sequence is invalid");
         }
         currentSliceNumber--;
       }
@@ -895,30 +1254,18 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
     }
     else
     {
-      vtkErrorWithObjectMacro(this->External, "LoadContour: No items in contour image sequence object item in referenced frame of reference sequence!");
+      vtkErrorWithObjectMacro(this->External, "StoreContour: No items in contour image sequence object item in referenced frame of reference sequence!");
     }
   }
 
   // Save just loaded contour data into ROI entry
-  vtkSmartPointer<vtkPolyData> currentRoiPolyData = vtkSmartPointer<vtkPolyData>::New();
-  currentRoiPolyData->SetPoints(currentRoiContourPoints);
-  if (currentRoiContourPoints->GetNumberOfPoints() == 1)
-  {
-    // Point ROI
-    currentRoiPolyData->SetVerts(currentRoiContourCells);
-  }
-  else if (currentRoiContourPoints->GetNumberOfPoints() > 1)
-  {
-    // Contour ROI
-    currentRoiPolyData->SetLines(currentRoiContourCells);
-  }
-  roiEntry->SetPolyData(currentRoiPolyData);
+  roiEntry->SetPolyData(task.PolyData);
 
   // Get structure color
   Sint32 roiDisplayColor = -1;
   for (int j=0; j<3; j++)
   {
-    roiObject.getROIDisplayColor(roiDisplayColor,j);
+    task.RoiObject->getROIDisplayColor(roiDisplayColor,j);
     roiEntry->DisplayColor[j] = roiDisplayColor/255.0;
   }
 
@@ -936,8 +1283,6 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
   // Strip last space
   serializedUidList = serializedUidList.substr(0, serializedUidList.size()-1);
   this->External->SetRTStructureSetReferencedSOPInstanceUIDs(serializedUidList.c_str());
-
-  return roiEntry;
 }
 
 //----------------------------------------------------------------------------
@@ -1191,6 +1536,7 @@ vtkSlicerDicomRtReader::vtkSlicerDicomRtReader()
   this->RTStructureSetReferencedSOPInstanceUIDs = NULL;
 
   this->SetPixelSpacing(0.0,0.0);
+  this->DoseVolumeIJKToLPSMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   this->DoseUnits = NULL;
   this->DoseGridScaling = NULL;
   this->RTDoseReferencedRTPlanSOPInstanceUID = NULL;
@@ -1232,6 +1578,18 @@ vtkSlicerDicomRtReader::vtkSlicerDicomRtReader()
   this->LoadRTImageSuccessful = false;
 }
 
+//----------------------------------------------------------------------------
+vtkImageData* vtkSlicerDicomRtReader::GetDoseVolumeData()
+{
+  return this->DoseVolumeData.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+vtkMatrix4x4* vtkSlicerDicomRtReader::GetDoseVolumeIJKToLPSMatrix()
+{
+  return this->DoseVolumeIJKToLPSMatrix.GetPointer();
+}
+
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtReader::~vtkSlicerDicomRtReader()
 {
@@ -34,7 +34,10 @@
 
 // VTK includes
 #include <vtkObject.h>
+#include <vtkSmartPointer.h>
 
+class vtkImageData;
+class vtkMatrix4x4;
 class vtkPolyData;
 
 // Due to some reason the Python wrapping of this class fails, therefore
@@ -105,6 +108,15 @@ public:
   /// \param jawPositions Array in which the jaw positions are copied
   void GetBeamLeafJawPositions(unsigned int beamNumber, double jawPositions[2][2]);
 
+  /// Get dose volume decoded from an RT Dose file. Contains the dose values (stored values multiplied
+  /// by dose grid scaling) as float. Origin and spacing of the image are default, the geometry is
+  /// described by \sa GetDoseVolumeIJKToLPSMatrix.
+  /// \return NULL if the pixel data could not be decoded by the reader (e.g. compressed transfer syntax)
+  vtkImageData* GetDoseVolumeData();
+
+  /// Get IJK to LPS matrix of the decoded dose volume, \sa GetDoseVolumeData
+  vtkMatrix4x4* GetDoseVolumeIJKToLPSMatrix();
+
   /// Set input file name
   vtkSetStringMacro(FileName);
 
@@ -301,6 +313,12 @@ protected:
   /// Dose units (e.g., Gy) - for RTDOSE
   char* DoseUnits;
 
+  /// Decoded dose volume - for RTDOSE
+  vtkSmartPointer<vtkImageData> DoseVolumeData;
+
+  /// IJK to LPS matrix of the decoded dose volume - for RTDOSE
+  vtkSmartPointer<vtkMatrix4x4> DoseVolumeIJKToLPSMatrix;
+
   /// Dose grid scaling (e.g., 4.4812099e-5) - for RTDOSE
   /// Scaling factor that when multiplied by the dose grid data found in the voxel values,
   /// yields grid doses in the dose units as specified by Dose Units.
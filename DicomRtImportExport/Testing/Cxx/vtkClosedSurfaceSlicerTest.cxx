@@ -0,0 +1,170 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkClosedSurfaceSlicer.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCutter.h>
+#include <vtkMath.h>
+#include <vtkPlane.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkStripper.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  /// Maximum distance between the contour points of the slicer and the cutter (mm)
+  const double POINT_TOLERANCE = 1.0e-4;
+
+  //-----------------------------------------------------------------------------
+  /// Get distance of a point from the closest point of a point set
+  double GetDistanceFromPoints(const double point[3], vtkPoints* points)
+  {
+    double minimumDistance2 = VTK_DOUBLE_MAX;
+    for (vtkIdType pointId=0; pointId<points->GetNumberOfPoints(); ++pointId)
+    {
+      minimumDistance2 = std::min(minimumDistance2, vtkMath::Distance2BetweenPoints(point, points->GetPoint(pointId)));
+    }
+    return sqrt(minimumDistance2);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compare the contours of the slicer to the result of vtkCutter and vtkStripper on each slice
+  bool CompareToCutter(vtkPolyData* surface, const double origin[3], const double step[3], int numberOfSlices)
+  {
+    vtkSmartPointer<vtkClosedSurfaceSlicer> slicer = vtkSmartPointer<vtkClosedSurfaceSlicer>::New();
+    slicer->SetInputData(surface);
+    slicer->SetSlicePlanes(origin, step, numberOfSlices);
+    if (!slicer->Update())
+    {
+      std::cerr << "Failed to slice closed surface!" << std::endl;
+      return false;
+    }
+
+    vtkSmartPointer<vtkPlane> slicePlane = vtkSmartPointer<vtkPlane>::New();
+    slicePlane->SetNormal(const_cast<double*>(step));
+    vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
+    cutter->SetInputData(surface);
+    cutter->SetCutFunction(slicePlane);
+    cutter->SetGenerateCutScalars(0);
+    vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
+    stripper->SetInputConnection(cutter->GetOutputPort());
+
+    bool valid = true;
+    for (int slice=0; slice<numberOfSlices; ++slice)
+    {
+      double sliceOrigin[3] = { origin[0] + slice*step[0], origin[1] + slice*step[1], origin[2] + slice*step[2] };
+      slicePlane->SetOrigin(sliceOrigin);
+      stripper->Update();
+      vtkPolyData* cutterContours = stripper->GetOutput();
+      vtkPolyData* slicerContours = slicer->GetSliceContours(slice);
+
+      vtkIdType numberOfCutterContours = cutterContours->GetNumberOfLines();
+      vtkIdType numberOfSlicerContours = (slicerContours ? slicerContours->GetNumberOfPolys() : 0);
+      if (numberOfCutterContours != numberOfSlicerContours)
+      {
+        std::cerr << "Slice " << slice << ": " << numberOfSlicerContours << " contours instead of " << numberOfCutterContours << std::endl;
+        valid = false;
+        continue;
+      }
+      if (numberOfSlicerContours == 0)
+      {
+        continue;
+      }
+
+      // Both contours must pass through the same points
+      vtkPoints* cutterPoints = cutterContours->GetPoints();
+      vtkPoints* slicerPoints = slicerContours->GetPoints();
+      double maximumDistance = 0.0;
+      for (vtkIdType pointId=0; pointId<slicerPoints->GetNumberOfPoints(); ++pointId)
+      {
+        maximumDistance = std::max(maximumDistance, GetDistanceFromPoints(slicerPoints->GetPoint(pointId), cutterPoints));
+      }
+      for (vtkIdType pointId=0; pointId<cutterPoints->GetNumberOfPoints(); ++pointId)
+      {
+        maximumDistance = std::max(maximumDistance, GetDistanceFromPoints(cutterPoints->GetPoint(pointId), slicerPoints));
+      }
+      if (maximumDistance > POINT_TOLERANCE)
+      {
+        std::cerr << "Slice " << slice << ": contour points differ by " << maximumDistance << " mm" << std::endl;
+        valid = false;
+      }
+
+      // Contours must be closed
+      vtkCellArray* contours = slicerContours->GetPolys();
+      vtkIdType numberOfContourPoints = 0;
+      vtkIdType* contourPointIds = NULL;
+      for (contours->InitTraversal(); contours->GetNextCell(numberOfContourPoints, contourPointIds); )
+      {
+        if (numberOfContourPoints < 4 || contourPointIds[0] != contourPointIds[numberOfContourPoints-1])
+        {
+          std::cerr << "Slice " << slice << ": open contour with " << numberOfContourPoints << " points" << std::endl;
+          valid = false;
+        }
+      }
+    }
+
+    return valid;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkClosedSurfaceSlicerTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkSphereSource> sphereSource = vtkSmartPointer<vtkSphereSource>::New();
+  sphereSource->SetCenter(1.3, -2.1, 0.35);
+  sphereSource->SetRadius(40.0);
+  sphereSource->SetThetaResolution(60);
+  sphereSource->SetPhiResolution(45);
+  sphereSource->Update();
+  vtkPolyData* sphere = sphereSource->GetOutput();
+
+  bool valid = true;
+
+  // Axial slices, including slices outside the surface
+  double axialOrigin[3] = {0.0, 0.0, -45.0};
+  double axialStep[3] = {0.0, 0.0, 1.25};
+  valid &= CompareToCutter(sphere, axialOrigin, axialStep, 80);
+
+  // Oblique slices with non-unit spacing
+  double obliqueOrigin[3] = {-30.0, 10.0, -20.0};
+  double obliqueStep[3] = {0.6, -0.3, 1.5};
+  valid &= CompareToCutter(sphere, obliqueOrigin, obliqueStep, 40);
+
+  // Invalid slice index
+  vtkSmartPointer<vtkClosedSurfaceSlicer> slicer = vtkSmartPointer<vtkClosedSurfaceSlicer>::New();
+  slicer->SetInputData(sphere);
+  slicer->SetSlicePlanes(axialOrigin, axialStep, 10);
+  slicer->Update();
+  if (slicer->GetSliceContours(10) != NULL || slicer->GetSliceContours(-1) != NULL)
+  {
+    std::cerr << "Contours returned for invalid slice index!" << std::endl;
+    valid = false;
+  }
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
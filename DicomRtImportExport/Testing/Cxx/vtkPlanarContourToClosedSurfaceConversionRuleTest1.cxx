@@ -0,0 +1,471 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// SegmentationCore includes
+#include "vtkSegmentation.h"
+#include "vtkSegment.h"
+#include "vtkSegmentationConverter.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCompositeDataSet.h>
+#include <vtkIdTypeArray.h>
+#include <vtkInformation.h>
+#include <vtkMultiBlockDataSet.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+#include <vtkVariant.h>
+#include <vtkXMLMultiBlockDataReader.h>
+#include <vtkXMLMultiBlockDataWriter.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+  /// Number of threads whose output is compared to the single-threaded conversion. More than the
+  /// number of cores is fine, then the plane pairs are still processed in a different order.
+  const int NUMBER_OF_THREADS_FOR_COMPARISON = 4;
+
+  //-----------------------------------------------------------------------------
+  /// Triangle point IDs, for comparing the triangles of two surfaces regardless of their order
+  struct Triangle
+  {
+    vtkIdType PointIds[3];
+    bool operator<(const Triangle& other) const
+    {
+      return std::lexicographical_compare(this->PointIds, this->PointIds+3, other.PointIds, other.PointIds+3);
+    }
+    bool operator!=(const Triangle& other) const
+    {
+      return !std::equal(this->PointIds, this->PointIds+3, other.PointIds);
+    }
+  };
+
+  //-----------------------------------------------------------------------------
+  bool GetSortedTriangles(vtkPolyData* surface, std::vector<Triangle>& triangles)
+  {
+    triangles.clear();
+    vtkCellArray* polys = surface->GetPolys();
+    polys->InitTraversal();
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    while (polys->GetNextCell(numberOfCellPoints, cellPointIds))
+    {
+      if (numberOfCellPoints != 3)
+      {
+        return false;
+      }
+      Triangle triangle;
+      std::copy(cellPointIds, cellPointIds+3, triangle.PointIds);
+      triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Read the baseline closed surfaces. The blocks of the file are the surfaces, named by segment ID.
+  bool ReadBaselineSurfaces(const std::string& baselineFile, std::map<std::string, vtkSmartPointer<vtkPolyData> >& baselineSurfaces)
+  {
+    vtkSmartPointer<vtkXMLMultiBlockDataReader> reader = vtkSmartPointer<vtkXMLMultiBlockDataReader>::New();
+    reader->SetFileName(baselineFile.c_str());
+    reader->Update();
+    vtkMultiBlockDataSet* multiBlock = vtkMultiBlockDataSet::SafeDownCast(reader->GetOutput());
+    if (!multiBlock)
+    {
+      return false;
+    }
+    for (unsigned int blockIndex = 0; blockIndex < multiBlock->GetNumberOfBlocks(); ++blockIndex)
+    {
+      vtkPolyData* surface = vtkPolyData::SafeDownCast(multiBlock->GetBlock(blockIndex));
+      vtkInformation* metaData = (multiBlock->HasMetaData(blockIndex) ? multiBlock->GetMetaData(blockIndex) : NULL);
+      if (!surface || !metaData || !metaData->Get(vtkCompositeDataSet::NAME()))
+      {
+        return false;
+      }
+      baselineSurfaces[metaData->Get(vtkCompositeDataSet::NAME())] = surface;
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Write the closed surfaces in the baseline format, for creating the baseline
+  bool WriteSurfaces(const std::string& filePath, vtkMultiBlockDataSet* surfaces)
+  {
+    vtkSmartPointer<vtkXMLMultiBlockDataWriter> writer = vtkSmartPointer<vtkXMLMultiBlockDataWriter>::New();
+    writer->SetFileName(filePath.c_str());
+    writer->SetInputData(surfaces);
+    return (writer->Write() != 0);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compare closed surface to the baseline. The point coordinates and the triangles (including point order,
+  /// i.e. orientation) must be identical, only the order of the triangles may differ.
+  bool CompareToBaselineSurface(vtkPolyData* surface, vtkPolyData* baselineSurface, const std::string& segmentId)
+  {
+    if (surface->GetNumberOfPoints() != baselineSurface->GetNumberOfPoints()
+      || surface->GetNumberOfPolys() != baselineSurface->GetNumberOfPolys())
+    {
+      std::cerr << "Closed surface of segment '" << segmentId << "' differs from the baseline: "
+        << surface->GetNumberOfPoints() << " points and " << surface->GetNumberOfPolys() << " triangles instead of "
+        << baselineSurface->GetNumberOfPoints() << " points and " << baselineSurface->GetNumberOfPolys() << " triangles" << std::endl;
+      return false;
+    }
+
+    for (vtkIdType pointId = 0; pointId < surface->GetNumberOfPoints(); ++pointId)
+    {
+      double point[3] = { 0.0, 0.0, 0.0 };
+      double baselinePoint[3] = { 0.0, 0.0, 0.0 };
+      surface->GetPoint(pointId, point);
+      baselineSurface->GetPoint(pointId, baselinePoint);
+      if (point[0] != baselinePoint[0] || point[1] != baselinePoint[1] || point[2] != baselinePoint[2])
+      {
+        std::cerr << "Closed surface of segment '" << segmentId << "' differs from the baseline at point " << pointId << std::endl;
+        return false;
+      }
+    }
+
+    std::vector<Triangle> triangles;
+    std::vector<Triangle> baselineTriangles;
+    if (!GetSortedTriangles(surface, triangles) || !GetSortedTriangles(baselineSurface, baselineTriangles))
+    {
+      std::cerr << "Closed surface of segment '" << segmentId << "' contains non-triangle cells!" << std::endl;
+      return false;
+    }
+    for (size_t triangleIndex = 0; triangleIndex < triangles.size(); ++triangleIndex)
+    {
+      if (triangles[triangleIndex] != baselineTriangles[triangleIndex])
+      {
+        std::cerr << "Closed surface of segment '" << segmentId << "' contains triangles that differ from the baseline!" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Convert segment with the given number of threads
+  bool ConvertWithNumberOfThreads(vtkPlanarContourToClosedSurfaceConversionRule* conversionRule, vtkPolyData* planarContoursPolyData,
+    int numberOfThreads, vtkPolyData* closedSurfacePolyData)
+  {
+    std::stringstream numberOfThreadsStream;
+    numberOfThreadsStream << numberOfThreads;
+    conversionRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetNumberOfThreadsParameterName(), numberOfThreadsStream.str());
+    bool success = conversionRule->Convert(planarContoursPolyData, closedSurfacePolyData);
+    conversionRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetNumberOfThreadsParameterName(), "0");
+    return success;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check that the surfaces have identical points and identical triangles in the same order
+  bool AreSurfacesIdentical(vtkPolyData* surface1, vtkPolyData* surface2)
+  {
+    if (surface1->GetNumberOfPoints() != surface2->GetNumberOfPoints()
+      || surface1->GetNumberOfPolys() != surface2->GetNumberOfPolys())
+    {
+      return false;
+    }
+    for (vtkIdType pointId = 0; pointId < surface1->GetNumberOfPoints(); ++pointId)
+    {
+      double point1[3] = { 0.0, 0.0, 0.0 };
+      double point2[3] = { 0.0, 0.0, 0.0 };
+      surface1->GetPoint(pointId, point1);
+      surface2->GetPoint(pointId, point2);
+      if (point1[0] != point2[0] || point1[1] != point2[1] || point1[2] != point2[2])
+      {
+        return false;
+      }
+    }
+    vtkIdTypeArray* connectivity1 = surface1->GetPolys()->GetData();
+    vtkIdTypeArray* connectivity2 = surface2->GetPolys()->GetData();
+    if (connectivity1->GetNumberOfValues() != connectivity2->GetNumberOfValues())
+    {
+      return false;
+    }
+    for (vtkIdType valueIndex = 0; valueIndex < connectivity1->GetNumberOfValues(); ++valueIndex)
+    {
+      if (connectivity1->GetValue(valueIndex) != connectivity2->GetValue(valueIndex))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Convert the planar contours of all segments in a segmentation to closed surface and report
+// the conversion time of each segment. Used for benchmarking the conversion rule. The surfaces
+// are compared to the baseline surfaces created by the original implementation of the conversion.
+int vtkPlanarContourToClosedSurfaceConversionRuleTest1( int argc, char * argv[] )
+{
+  int argIndex = 1;
+
+  const char *dataDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-DataDirectoryPath") == 0)
+    {
+      dataDirectoryPath = argv[argIndex+1];
+      std::cout << "Data directory path: " << dataDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      dataDirectoryPath = "";
+    }
+  }
+  else
+  {
+    std::cerr << "No arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *inputSegmentationFileName = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-InputSegmentationFile") == 0)
+    {
+      inputSegmentationFileName = argv[argIndex+1];
+      std::cout << "Input segmentation file name: " << inputSegmentationFileName << std::endl;
+      argIndex += 2;
+    }
+    else
+    {
+      inputSegmentationFileName = "";
+    }
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int numberOfRepetitions = 1;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-NumberOfRepetitions") == 0)
+    {
+      numberOfRepetitions = vtkVariant(argv[argIndex+1]).ToInt();
+      std::cout << "Number of repetitions: " << numberOfRepetitions << std::endl;
+      argIndex += 2;
+    }
+  }
+  if (numberOfRepetitions < 1)
+  {
+    numberOfRepetitions = 1;
+  }
+
+  const char *baselineClosedSurfaceFileName = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-BaselineClosedSurfaceFile") == 0)
+  {
+    baselineClosedSurfaceFileName = argv[argIndex+1];
+    std::cout << "Baseline closed surface file name: " << baselineClosedSurfaceFileName << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const char *temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-TemporaryDirectory") == 0)
+  {
+    temporaryDirectoryPath = argv[argIndex+1];
+    std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Create scene
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+
+  // Create Segmentations logic
+  vtkSmartPointer<vtkSlicerSegmentationsModuleLogic> segmentationsLogic = vtkSmartPointer<vtkSlicerSegmentationsModuleLogic>::New();
+  segmentationsLogic->SetMRMLScene(mrmlScene);
+
+  // Load segmentation containing planar contours
+  std::string segmentationFile = std::string(dataDirectoryPath) + std::string(inputSegmentationFileName);
+  if (!vtksys::SystemTools::FileExists(segmentationFile.c_str()))
+  {
+    std::cerr << "Loading segmentation from file '" << segmentationFile << "' failed - the file does not exist!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkMRMLSegmentationNode* segmentationNode = segmentationsLogic->LoadSegmentationFromFile(segmentationFile.c_str());
+  if (!segmentationNode || !segmentationNode->GetSegmentation())
+  {
+    std::cerr << "Loading segmentation from existing file '" << segmentationFile << "' failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+
+  // Load baseline closed surfaces. If there is no baseline, then the surfaces are written to the temporary
+  // directory, and can be added as baseline after comparing them to the output of the original implementation.
+  std::string baselineClosedSurfaceFile = std::string(dataDirectoryPath) + std::string(baselineClosedSurfaceFileName);
+  bool baselineExists = vtksys::SystemTools::FileExists(baselineClosedSurfaceFile.c_str());
+  std::map<std::string, vtkSmartPointer<vtkPolyData> > baselineSurfaces;
+  if (baselineExists && !ReadBaselineSurfaces(baselineClosedSurfaceFile, baselineSurfaces))
+  {
+    std::cerr << "Loading baseline closed surfaces from file '" << baselineClosedSurfaceFile << "' failed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkMultiBlockDataSet> closedSurfaces = vtkSmartPointer<vtkMultiBlockDataSet>::New();
+
+  // Convert each segment with the conversion rule
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> conversionRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double totalConversionTimeSec = 0.0;
+  int numberOfConvertedSegments = 0;
+
+  std::vector<std::string> segmentIDs;
+  segmentation->GetSegmentIDs(segmentIDs);
+  for (std::vector<std::string>::iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+  {
+    vtkSegment* segment = segmentation->GetSegment(*segmentIdIt);
+    vtkPolyData* planarContoursPolyData = vtkPolyData::SafeDownCast(
+      segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName()) );
+    if (!planarContoursPolyData)
+    {
+      std::cerr << "Segment '" << (*segmentIdIt) << "' does not contain planar contour representation!" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (planarContoursPolyData->GetNumberOfLines() == 0)
+    {
+      // Point and empty structures are not converted
+      continue;
+    }
+
+    vtkPolyData* baselineClosedSurfacePolyData = NULL;
+    if (baselineExists)
+    {
+      std::map<std::string, vtkSmartPointer<vtkPolyData> >::iterator baselineIt = baselineSurfaces.find(*segmentIdIt);
+      if (baselineIt == baselineSurfaces.end())
+      {
+        std::cerr << "Baseline closed surface of segment '" << (*segmentIdIt) << "' is missing!" << std::endl;
+        return EXIT_FAILURE;
+      }
+      baselineClosedSurfacePolyData = baselineIt->second;
+    }
+
+    double segmentConversionTimeSec = 0.0;
+    vtkIdType numberOfTriangles = -1;
+    for (int repetition = 0; repetition < numberOfRepetitions; ++repetition)
+    {
+      vtkSmartPointer<vtkPolyData> closedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+      double checkpointStart = timer->GetUniversalTime();
+      if (!conversionRule->Convert(planarContoursPolyData, closedSurfacePolyData))
+      {
+        std::cerr << "Failed to convert segment '" << (*segmentIdIt) << "' to closed surface!" << std::endl;
+        return EXIT_FAILURE;
+      }
+      segmentConversionTimeSec += timer->GetUniversalTime() - checkpointStart;
+
+      // Conversion must produce the same surface in every repetition
+      if (numberOfTriangles >= 0 && numberOfTriangles != closedSurfacePolyData->GetNumberOfPolys())
+      {
+        std::cerr << "Number of triangles in the closed surface of segment '" << (*segmentIdIt) << "' differs between repetitions: "
+          << numberOfTriangles << " != " << closedSurfacePolyData->GetNumberOfPolys() << std::endl;
+        return EXIT_FAILURE;
+      }
+      numberOfTriangles = closedSurfacePolyData->GetNumberOfPolys();
+
+      if (baselineClosedSurfacePolyData && !CompareToBaselineSurface(closedSurfacePolyData, baselineClosedSurfacePolyData, (*segmentIdIt)))
+      {
+        return EXIT_FAILURE;
+      }
+      if (repetition == 0)
+      {
+        unsigned int blockIndex = closedSurfaces->GetNumberOfBlocks();
+        closedSurfaces->SetBlock(blockIndex, closedSurfacePolyData);
+        closedSurfaces->GetMetaData(blockIndex)->Set(vtkCompositeDataSet::NAME(), segmentIdIt->c_str());
+      }
+    }
+    if (numberOfTriangles == 0)
+    {
+      std::cerr << "Closed surface of segment '" << (*segmentIdIt) << "' is empty!" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Plane pairs are triangulated in parallel, the result must not depend on the number of threads
+    vtkSmartPointer<vtkPolyData> singleThreadedClosedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPolyData> multiThreadedClosedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+    if ( !ConvertWithNumberOfThreads(conversionRule, planarContoursPolyData, 1, singleThreadedClosedSurfacePolyData)
+      || !ConvertWithNumberOfThreads(conversionRule, planarContoursPolyData, NUMBER_OF_THREADS_FOR_COMPARISON, multiThreadedClosedSurfacePolyData) )
+    {
+      std::cerr << "Failed to convert segment '" << (*segmentIdIt) << "' to closed surface with fixed number of threads!" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (!AreSurfacesIdentical(singleThreadedClosedSurfacePolyData, multiThreadedClosedSurfacePolyData))
+    {
+      std::cerr << "Closed surface of segment '" << (*segmentIdIt) << "' differs between 1 and "
+        << NUMBER_OF_THREADS_FOR_COMPARISON << " threads!" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "  Segment '" << (*segmentIdIt) << "': " << planarContoursPolyData->GetNumberOfLines() << " contours, "
+      << planarContoursPolyData->GetNumberOfPoints() << " points, " << numberOfTriangles << " triangles, "
+      << segmentConversionTimeSec * 1000.0 / numberOfRepetitions << " ms" << std::endl;
+    totalConversionTimeSec += segmentConversionTimeSec / numberOfRepetitions;
+    ++numberOfConvertedSegments;
+  }
+
+  if (numberOfConvertedSegments == 0)
+  {
+    std::cerr << "No segments were converted!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Planar contour to closed surface conversion of " << numberOfConvertedSegments << " segments: "
+    << totalConversionTimeSec * 1000.0 << " ms" << std::endl;
+
+  if (!baselineExists)
+  {
+    vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+    std::string closedSurfaceFile = std::string(temporaryDirectoryPath) + "/" + vtksys::SystemTools::GetFilenameName(baselineClosedSurfaceFile);
+    WriteSurfaces(closedSurfaceFile, closedSurfaces);
+    std::cerr << "Baseline closed surface file '" << baselineClosedSurfaceFile << "' does not exist! Closed surfaces are written to '"
+      << closedSurfaceFile << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,367 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtReader.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>    /* make sure OS specific configuration is included first */
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/ofstd/ofstd.h>
+
+namespace
+{
+  /// ROIs of the structure set in the order of the structure set ROI sequence. The marker is a point ROI.
+  const int NUMBER_OF_ROIS = 3;
+  const int ROI_NUMBERS[NUMBER_OF_ROIS] = { 1, 2, 3 };
+  const char* ROI_NAMES[NUMBER_OF_ROIS] = { "Body", "Marker", "Tumor" };
+  const int ROI_COLORS[NUMBER_OF_ROIS][3] = { { 255, 128, 0 }, { 0, 255, 0 }, { 10, 20, 250 } };
+  const int NUMBER_OF_CONTOURS[NUMBER_OF_ROIS] = { 3, 1, 5 };
+  /// Order of the ROIs in the ROI contour sequence, different from the structure set ROI sequence
+  const int ROI_CONTOUR_ORDER[NUMBER_OF_ROIS] = { 2, 0, 1 };
+  const int NUMBER_OF_SLICES = 5;
+
+  //-----------------------------------------------------------------------------
+  int GetNumberOfContourPoints(int roiIndex, int contourIndex)
+  {
+    return (roiIndex == 1 ? 1 : 4 + 3 * contourIndex + roiIndex);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Contour coordinates (LPS) as DS values, with decimals that are not exactly representable
+  std::vector<std::string> GetContourData(int roiIndex, int contourIndex)
+  {
+    std::vector<std::string> values;
+    int numberOfPoints = GetNumberOfContourPoints(roiIndex, contourIndex);
+    for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+    {
+      double angle = 2.0 * vtkMath::Pi() * pointIndex / numberOfPoints;
+      double radius = 20.0 + 7.3 * roiIndex + 1.1 * contourIndex;
+      double coordinates[3] = { radius * cos(angle) - 3.7, radius * sin(angle) + 12.1, -31.5 + 2.5 * contourIndex };
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        std::ostringstream stream;
+        stream.imbue(std::locale::classic());
+        stream << std::fixed << std::setprecision(4) << coordinates[axis];
+        values.push_back(stream.str());
+      }
+    }
+    return values;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Write a synthetic RT structure set file
+  bool WriteStructureSetFile(const std::string& filePath)
+  {
+    DcmFileFormat fileFormat;
+    DcmDataset* dataset = fileFormat.getDataset();
+    char uid[100];
+    std::string frameOfReferenceUid = dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT);
+    std::string referencedSeriesUid = dcmGenerateUniqueIdentifier(uid, SITE_SERIES_UID_ROOT);
+    std::vector<std::string> sliceUids;
+    for (int sliceIndex = 0; sliceIndex < NUMBER_OF_SLICES; ++sliceIndex)
+    {
+      sliceUids.push_back(dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT));
+    }
+
+    dataset->putAndInsertString(DCM_SOPClassUID, UID_RTStructureSetStorage);
+    dataset->putAndInsertString(DCM_SOPInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT));
+    dataset->putAndInsertString(DCM_StudyInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_STUDY_UID_ROOT));
+    dataset->putAndInsertString(DCM_SeriesInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_SERIES_UID_ROOT));
+    dataset->putAndInsertString(DCM_Modality, "RTSTRUCT");
+    dataset->putAndInsertString(DCM_PatientName, "Synthetic^Structures");
+    dataset->putAndInsertString(DCM_PatientID, "SyntheticStructures");
+    dataset->putAndInsertString(DCM_StructureSetLabel, "Synthetic");
+
+    // Referenced frame of reference, study, series and slices
+    DcmItem* frameOfReferenceItem = NULL;
+    DcmItem* studyItem = NULL;
+    DcmItem* seriesItem = NULL;
+    dataset->findOrCreateSequenceItem(DCM_ReferencedFrameOfReferenceSequence, frameOfReferenceItem, -2);
+    frameOfReferenceItem->putAndInsertString(DCM_FrameOfReferenceUID, frameOfReferenceUid.c_str());
+    frameOfReferenceItem->findOrCreateSequenceItem(DCM_RTReferencedStudySequence, studyItem, -2);
+    studyItem->putAndInsertString(DCM_ReferencedSOPClassUID, "1.2.840.10008.3.1.2.3.2" /* Study Component Management SOP Class */);
+    studyItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_STUDY_UID_ROOT));
+    studyItem->findOrCreateSequenceItem(DCM_RTReferencedSeriesSequence, seriesItem, -2);
+    seriesItem->putAndInsertString(DCM_SeriesInstanceUID, referencedSeriesUid.c_str());
+    for (int sliceIndex = 0; sliceIndex < NUMBER_OF_SLICES; ++sliceIndex)
+    {
+      DcmItem* imageItem = NULL;
+      seriesItem->findOrCreateSequenceItem(DCM_ContourImageSequence, imageItem, -2);
+      imageItem->putAndInsertString(DCM_ReferencedSOPClassUID, UID_CTImageStorage);
+      imageItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, sliceUids[sliceIndex].c_str());
+    }
+
+    // Structure set ROIs
+    for (int roiIndex = 0; roiIndex < NUMBER_OF_ROIS; ++roiIndex)
+    {
+      DcmItem* roiItem = NULL;
+      dataset->findOrCreateSequenceItem(DCM_StructureSetROISequence, roiItem, -2);
+      std::ostringstream roiNumber;
+      roiNumber << ROI_NUMBERS[roiIndex];
+      roiItem->putAndInsertString(DCM_ROINumber, roiNumber.str().c_str());
+      roiItem->putAndInsertString(DCM_ReferencedFrameOfReferenceUID, frameOfReferenceUid.c_str());
+      roiItem->putAndInsertString(DCM_ROIName, ROI_NAMES[roiIndex]);
+      roiItem->putAndInsertString(DCM_ROIGenerationAlgorithm, "MANUAL");
+    }
+
+    // ROI contours
+    for (int orderIndex = 0; orderIndex < NUMBER_OF_ROIS; ++orderIndex)
+    {
+      int roiIndex = ROI_CONTOUR_ORDER[orderIndex];
+      DcmItem* roiContourItem = NULL;
+      dataset->findOrCreateSequenceItem(DCM_ROIContourSequence, roiContourItem, -2);
+      std::ostringstream roiNumber;
+      roiNumber << ROI_NUMBERS[roiIndex];
+      roiContourItem->putAndInsertString(DCM_ReferencedROINumber, roiNumber.str().c_str());
+      std::ostringstream color;
+      color << ROI_COLORS[roiIndex][0] << "\\" << ROI_COLORS[roiIndex][1] << "\\" << ROI_COLORS[roiIndex][2];
+      roiContourItem->putAndInsertString(DCM_ROIDisplayColor, color.str().c_str());
+      for (int contourIndex = 0; contourIndex < NUMBER_OF_CONTOURS[roiIndex]; ++contourIndex)
+      {
+        DcmItem* contourItem = NULL;
+        roiContourItem->findOrCreateSequenceItem(DCM_ContourSequence, contourItem, -2);
+        std::vector<std::string> contourData = GetContourData(roiIndex, contourIndex);
+        std::string contourDataString;
+        for (size_t valueIndex = 0; valueIndex < contourData.size(); ++valueIndex)
+        {
+          contourDataString += (valueIndex > 0 ? "\\" : "") + contourData[valueIndex];
+        }
+        std::ostringstream numberOfPoints;
+        numberOfPoints << GetNumberOfContourPoints(roiIndex, contourIndex);
+        contourItem->putAndInsertString(DCM_ContourGeometricType, (roiIndex == 1 ? "POINT" : "CLOSED_PLANAR"));
+        contourItem->putAndInsertString(DCM_NumberOfContourPoints, numberOfPoints.str().c_str());
+        contourItem->putAndInsertString(DCM_ContourData, contourDataString.c_str());
+        DcmItem* imageItem = NULL;
+        contourItem->findOrCreateSequenceItem(DCM_ContourImageSequence, imageItem, -2);
+        imageItem->putAndInsertString(DCM_ReferencedSOPClassUID, UID_CTImageStorage);
+        imageItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, sliceUids[contourIndex % NUMBER_OF_SLICES].c_str());
+      }
+    }
+
+    return fileFormat.saveFile(filePath.c_str(), EXS_LittleEndianExplicit).good();
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create the poly data of a ROI the same way as the serial contour loading did before loading in bulk:
+  /// points inserted one by one (converted from LPS to RAS), and one closed cell per contour
+  vtkSmartPointer<vtkPolyData> CreateSerialRoiPolyData(int roiIndex)
+  {
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> cells = vtkSmartPointer<vtkCellArray>::New();
+    vtkIdType pointId = 0;
+    for (int contourIndex = 0; contourIndex < NUMBER_OF_CONTOURS[roiIndex]; ++contourIndex)
+    {
+      std::vector<std::string> contourData = GetContourData(roiIndex, contourIndex);
+      int numberOfPoints = GetNumberOfContourPoints(roiIndex, contourIndex);
+      cells->InsertNextCell(numberOfPoints + 1);
+      for (int k = 0; k < numberOfPoints; ++k)
+      {
+        points->InsertPoint(pointId, -OFStandard::atof(contourData[3*k].c_str()), -OFStandard::atof(contourData[3*k+1].c_str()),
+          OFStandard::atof(contourData[3*k+2].c_str()) );
+        cells->InsertCellPoint(pointId);
+        ++pointId;
+      }
+      cells->InsertCellPoint(pointId - numberOfPoints);
+    }
+
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(points);
+    if (points->GetNumberOfPoints() == 1)
+    {
+      polyData->SetVerts(cells);
+    }
+    else
+    {
+      polyData->SetLines(cells);
+    }
+    return polyData;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compare the cells of two cell arrays
+  bool CompareCells(vtkCellArray* cells, vtkCellArray* expectedCells, const char* roiName)
+  {
+    if (cells->GetNumberOfCells() != expectedCells->GetNumberOfCells())
+    {
+      std::cerr << "ROI " << roiName << " has " << cells->GetNumberOfCells() << " contours instead of " << expectedCells->GetNumberOfCells() << std::endl;
+      return false;
+    }
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    vtkIdType expectedNumberOfCellPoints = 0;
+    vtkIdType* expectedCellPointIds = NULL;
+    cells->InitTraversal();
+    expectedCells->InitTraversal();
+    for (vtkIdType cellId = 0; cells->GetNextCell(numberOfCellPoints, cellPointIds)
+      && expectedCells->GetNextCell(expectedNumberOfCellPoints, expectedCellPointIds); ++cellId)
+    {
+      if (numberOfCellPoints != expectedNumberOfCellPoints)
+      {
+        std::cerr << "Contour " << cellId << " of ROI " << roiName << " has " << numberOfCellPoints << " points instead of " << expectedNumberOfCellPoints << std::endl;
+        return false;
+      }
+      for (vtkIdType k = 0; k < numberOfCellPoints; ++k)
+      {
+        if (cellPointIds[k] != expectedCellPointIds[k])
+        {
+          std::cerr << "Contour " << cellId << " of ROI " << roiName << " has point " << cellPointIds[k] << " instead of " << expectedCellPointIds[k]
+            << " at index " << k << std::endl;
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compare the loaded ROI to the serially created one point by point
+  bool CompareRoi(vtkSlicerDicomRtReader* reader, int roiIndex)
+  {
+    const char* roiName = ROI_NAMES[roiIndex];
+    if (!reader->GetRoiName(roiIndex) || std::string(reader->GetRoiName(roiIndex)) != roiName)
+    {
+      std::cerr << "ROI " << roiIndex << " is named " << (reader->GetRoiName(roiIndex) ? reader->GetRoiName(roiIndex) : "NULL")
+        << " instead of " << roiName << std::endl;
+      return false;
+    }
+    double* color = reader->GetRoiDisplayColor(roiIndex);
+    for (int i = 0; i < 3; ++i)
+    {
+      if (color[i] != ROI_COLORS[roiIndex][i] / 255.0)
+      {
+        std::cerr << "ROI " << roiName << " has invalid display color" << std::endl;
+        return false;
+      }
+    }
+
+    vtkPolyData* polyData = reader->GetRoiPolyData(roiIndex);
+    vtkSmartPointer<vtkPolyData> expectedPolyData = CreateSerialRoiPolyData(roiIndex);
+    if (!polyData || !polyData->GetPoints() || polyData->GetNumberOfPoints() != expectedPolyData->GetNumberOfPoints())
+    {
+      std::cerr << "ROI " << roiName << " has " << (polyData ? polyData->GetNumberOfPoints() : 0) << " points instead of "
+        << expectedPolyData->GetNumberOfPoints() << std::endl;
+      return false;
+    }
+    if (polyData->GetPoints()->GetDataType() != expectedPolyData->GetPoints()->GetDataType())
+    {
+      std::cerr << "ROI " << roiName << " has points of invalid data type" << std::endl;
+      return false;
+    }
+    for (vtkIdType pointId = 0; pointId < polyData->GetNumberOfPoints(); ++pointId)
+    {
+      double point[3] = { 0.0, 0.0, 0.0 };
+      double expectedPoint[3] = { 0.0, 0.0, 0.0 };
+      polyData->GetPoint(pointId, point);
+      expectedPolyData->GetPoint(pointId, expectedPoint);
+      if (point[0] != expectedPoint[0] || point[1] != expectedPoint[1] || point[2] != expectedPoint[2])
+      {
+        std::cerr << "Point " << pointId << " of ROI " << roiName << " is (" << point[0] << ", " << point[1] << ", " << point[2]
+          << ") instead of (" << expectedPoint[0] << ", " << expectedPoint[1] << ", " << expectedPoint[2] << ")" << std::endl;
+        return false;
+      }
+    }
+
+    if ( polyData->GetNumberOfLines() != expectedPolyData->GetNumberOfLines()
+      || polyData->GetNumberOfVerts() != expectedPolyData->GetNumberOfVerts() )
+    {
+      std::cerr << "ROI " << roiName << " has " << polyData->GetNumberOfLines() << " lines and " << polyData->GetNumberOfVerts()
+        << " vertices instead of " << expectedPolyData->GetNumberOfLines() << " and " << expectedPolyData->GetNumberOfVerts() << std::endl;
+      return false;
+    }
+    return CompareCells(polyData->GetLines(), expectedPolyData->GetLines(), roiName)
+      && CompareCells(polyData->GetVerts(), expectedPolyData->GetVerts(), roiName);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Load a synthetic RT structure set, and compare the contours loaded in bulk and in parallel per ROI
+// to the result of the serial contour loading point by point
+int vtkSlicerDicomRtReaderContourTest1(int argc, char* argv[])
+{
+  int argIndex = 1;
+
+  // TemporaryDirectory
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-TemporaryDirectory") == 0)
+  {
+    temporaryDirectoryPath = argv[argIndex+1];
+    std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+  std::string filePath = std::string(temporaryDirectoryPath) + "/SyntheticStructures.dcm";
+  if (!WriteStructureSetFile(filePath))
+  {
+    std::cerr << "Failed to write structure set file " << filePath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtkSmartPointer<vtkSlicerDicomRtReader> reader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+  reader->SetFileName(filePath.c_str());
+  reader->Update();
+  vtksys::SystemTools::RemoveFile(filePath.c_str());
+  if (!reader->GetLoadRTStructureSetSuccessful())
+  {
+    std::cerr << "Failed to load structure set" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (reader->GetNumberOfRois() != NUMBER_OF_ROIS)
+  {
+    std::cerr << "Structure set contains " << reader->GetNumberOfRois() << " ROIs instead of " << NUMBER_OF_ROIS << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (int roiIndex = 0; roiIndex < NUMBER_OF_ROIS; ++roiIndex)
+  {
+    if (!CompareRoi(reader, roiIndex))
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtReader.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+#include <vtkVariant.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <string>
+#include <vector>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>    /* make sure OS specific configuration is included first */
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+
+namespace
+{
+  const Uint16 NUMBER_OF_ROWS = 3;
+  const Uint16 NUMBER_OF_COLUMNS = 4;
+  const int NUMBER_OF_FRAMES = 2;
+  const char* DOSE_GRID_SCALING = "2.5E-5";
+
+  //-----------------------------------------------------------------------------
+  /// Stored value of a voxel. All bytes of the values differ, so that any byte order error changes them.
+  /// 16-bit values are signed, 32-bit values are unsigned.
+  double GetStoredValue(int voxelIndex, int bitsAllocated)
+  {
+    if (bitsAllocated == 16)
+    {
+      return static_cast<double>(static_cast<Sint16>(0x0102 + voxelIndex * 0x0a13 - 0x3000));
+    }
+    return static_cast<double>(static_cast<Uint32>(0x01020304u + voxelIndex * 0x00110213u));
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Write a synthetic RT dose file with the given bits allocated and transfer syntax
+  bool WriteDoseFile(const std::string& filePath, int bitsAllocated, E_TransferSyntax transferSyntax)
+  {
+    DcmFileFormat fileFormat;
+    DcmDataset* dataset = fileFormat.getDataset();
+    char uid[100];
+    dataset->putAndInsertString(DCM_SOPClassUID, UID_RTDoseStorage);
+    dataset->putAndInsertString(DCM_SOPInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT));
+    dataset->putAndInsertString(DCM_StudyInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_STUDY_UID_ROOT));
+    dataset->putAndInsertString(DCM_SeriesInstanceUID, dcmGenerateUniqueIdentifier(uid, SITE_SERIES_UID_ROOT));
+    dataset->putAndInsertString(DCM_FrameOfReferenceUID, dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT));
+    dataset->putAndInsertString(DCM_Modality, "RTDOSE");
+    dataset->putAndInsertString(DCM_PatientName, "Synthetic^Dose");
+    dataset->putAndInsertString(DCM_PatientID, "SyntheticDose");
+    dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+    dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+    dataset->putAndInsertUint16(DCM_Rows, NUMBER_OF_ROWS);
+    dataset->putAndInsertUint16(DCM_Columns, NUMBER_OF_COLUMNS);
+    dataset->putAndInsertUint16(DCM_BitsAllocated, bitsAllocated);
+    dataset->putAndInsertUint16(DCM_BitsStored, bitsAllocated);
+    dataset->putAndInsertUint16(DCM_HighBit, bitsAllocated - 1);
+    dataset->putAndInsertUint16(DCM_PixelRepresentation, (bitsAllocated == 16 ? 1 : 0));
+    dataset->putAndInsertString(DCM_NumberOfFrames, "2");
+    dataset->putAndInsertString(DCM_ImagePositionPatient, "-10\\20\\30");
+    dataset->putAndInsertString(DCM_ImageOrientationPatient, "1\\0\\0\\0\\1\\0");
+    dataset->putAndInsertString(DCM_PixelSpacing, "2\\1.5");
+    dataset->putAndInsertString(DCM_GridFrameOffsetVector, "0\\3");
+    dataset->putAndInsertString(DCM_DoseUnits, "GY");
+    dataset->putAndInsertString(DCM_DoseType, "PHYSICAL");
+    dataset->putAndInsertString(DCM_DoseSummationType, "PLAN");
+    dataset->putAndInsertString(DCM_DoseGridScaling, DOSE_GRID_SCALING);
+
+    // Pixel data is set as 16-bit words, that DCMTK writes in the byte order of the transfer syntax.
+    // The words of 32-bit values are ordered according to the transfer syntax too.
+    bool bigEndian = (DcmXfer(transferSyntax).getByteOrder() == EBO_BigEndian);
+    int numberOfVoxels = NUMBER_OF_ROWS * NUMBER_OF_COLUMNS * NUMBER_OF_FRAMES;
+    std::vector<Uint16> words;
+    for (int voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+    {
+      if (bitsAllocated == 16)
+      {
+        words.push_back(static_cast<Uint16>(static_cast<Sint16>(GetStoredValue(voxelIndex, 16))));
+        continue;
+      }
+      Uint32 value = static_cast<Uint32>(GetStoredValue(voxelIndex, 32));
+      Uint16 highWord = static_cast<Uint16>(value >> 16);
+      Uint16 lowWord = static_cast<Uint16>(value & 0xffff);
+      words.push_back(bigEndian ? highWord : lowWord);
+      words.push_back(bigEndian ? lowWord : highWord);
+    }
+    dataset->putAndInsertUint16Array(DCM_PixelData, &words[0], words.size());
+
+    return fileFormat.saveFile(filePath.c_str(), transferSyntax).good();
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Write a dose file, load it with the reader, and compare the dose values to the stored values multiplied
+  /// by the dose grid scaling, the same way as the reader converts them
+  bool WriteLoadAndCheck(const std::string& filePath, int bitsAllocated, E_TransferSyntax transferSyntax, const char* transferSyntaxName)
+  {
+    std::cout << "Load " << bitsAllocated << "-bit dose in " << transferSyntaxName << " transfer syntax" << std::endl;
+    if (!WriteDoseFile(filePath, bitsAllocated, transferSyntax))
+    {
+      std::cerr << "Failed to write dose file " << filePath << std::endl;
+      return false;
+    }
+
+    vtkSmartPointer<vtkSlicerDicomRtReader> reader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+    reader->SetFileName(filePath.c_str());
+    reader->Update();
+    vtkImageData* doseVolumeData = reader->GetDoseVolumeData();
+    if (!reader->GetLoadRTDoseSuccessful() || !doseVolumeData)
+    {
+      std::cerr << "Failed to load dose volume" << std::endl;
+      return false;
+    }
+    int* dimensions = doseVolumeData->GetDimensions();
+    if ( dimensions[0] != NUMBER_OF_COLUMNS || dimensions[1] != NUMBER_OF_ROWS || dimensions[2] != NUMBER_OF_FRAMES
+      || doseVolumeData->GetScalarType() != VTK_FLOAT )
+    {
+      std::cerr << "Dose volume has invalid dimensions or scalar type" << std::endl;
+      return false;
+    }
+
+    double doseGridScaling = vtkVariant(DOSE_GRID_SCALING).ToDouble();
+    float* doseValues = static_cast<float*>(doseVolumeData->GetScalarPointer());
+    for (int voxelIndex = 0; voxelIndex < NUMBER_OF_ROWS * NUMBER_OF_COLUMNS * NUMBER_OF_FRAMES; ++voxelIndex)
+    {
+      float expectedDose = static_cast<float>(static_cast<float>(GetStoredValue(voxelIndex, bitsAllocated)) * doseGridScaling);
+      if (doseValues[voxelIndex] != expectedDose)
+      {
+        std::cerr << "Dose mismatch at voxel " << voxelIndex << ": " << doseValues[voxelIndex] << " instead of " << expectedDose << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Load synthetic RT dose files with 16 and 32-bit values in little and big endian transfer syntaxes
+int vtkSlicerDicomRtReaderDoseTest1(int argc, char* argv[])
+{
+  int argIndex = 1;
+
+  // TemporaryDirectory
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-TemporaryDirectory") == 0)
+  {
+    temporaryDirectoryPath = argv[argIndex+1];
+    std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+  std::string filePath = std::string(temporaryDirectoryPath) + "/SyntheticDose.dcm";
+
+  bool valid = true;
+  valid &= WriteLoadAndCheck(filePath, 16, EXS_LittleEndianImplicit, "implicit little endian");
+  valid &= WriteLoadAndCheck(filePath, 32, EXS_LittleEndianImplicit, "implicit little endian");
+  valid &= WriteLoadAndCheck(filePath, 16, EXS_LittleEndianExplicit, "explicit little endian");
+  valid &= WriteLoadAndCheck(filePath, 32, EXS_LittleEndianExplicit, "explicit little endian");
+  valid &= WriteLoadAndCheck(filePath, 16, EXS_BigEndianExplicit, "explicit big endian");
+  valid &= WriteLoadAndCheck(filePath, 32, EXS_BigEndianExplicit, "explicit big endian");
+
+  vtksys::SystemTools::RemoveFile(filePath.c_str());
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,617 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkGammaDoseComparisonFilter.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtTaskPool.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkDoubleArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkGammaDoseComparisonFilter);
+
+namespace
+{
+  /// Inverse squared dose tolerance used when the local dose tolerance is zero
+  const double ZERO_TOLERANCE_INVERSE_SQUARE = 1.0e30;
+
+  //----------------------------------------------------------------------------
+  /// Voxel offset in the search neighborhood of a reference voxel
+  struct GammaSearchOffset
+  {
+    int Offset[3];
+    /// Squared distance divided by the squared DTA tolerance
+    double Distance2;
+    /// Lower bound of the normalized squared distance of all points searched at this offset
+    double LowerBound2;
+  };
+
+  //----------------------------------------------------------------------------
+  bool IsSearchOffsetCloser(const GammaSearchOffset& a, const GammaSearchOffset& b)
+  {
+    return a.Distance2 < b.Distance2;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Copy the first scalar component of an image to a float buffer covering the given extent.
+  /// Voxels of the extent that are outside the image get the default value.
+  template<class T>
+  void vtkGammaDoseComparisonFilterExtractBuffer(vtkImageData* image, T* /*dummy*/, const int extent[6], float defaultValue, std::vector<float>& buffer)
+  {
+    int dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+    buffer.assign((size_t)dimensions[0] * dimensions[1] * dimensions[2], defaultValue);
+
+    int imageExtent[6] = {0, -1, 0, -1, 0, -1};
+    image->GetExtent(imageExtent);
+    int overlap[6] = {0, -1, 0, -1, 0, -1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      overlap[2*axis] = std::max(extent[2*axis], imageExtent[2*axis]);
+      overlap[2*axis+1] = std::min(extent[2*axis+1], imageExtent[2*axis+1]);
+      if (overlap[2*axis] > overlap[2*axis+1])
+      {
+        return;
+      }
+    }
+
+    int numberOfComponents = image->GetNumberOfScalarComponents();
+    for (int k=overlap[4]; k<=overlap[5]; ++k)
+    {
+      for (int j=overlap[2]; j<=overlap[3]; ++j)
+      {
+        T* inPtr = static_cast<T*>(image->GetScalarPointer(overlap[0], j, k));
+        float* outPtr = &buffer[ ((size_t)(k-extent[4]) * dimensions[1] + (j-extent[2])) * dimensions[0] + (overlap[0]-extent[0]) ];
+        for (int i=overlap[0]; i<=overlap[1]; ++i)
+        {
+          *(outPtr++) = static_cast<float>(*inPtr);
+          inPtr += numberOfComponents;
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool ExtractBuffer(vtkImageData* image, const int extent[6], float defaultValue, std::vector<float>& buffer)
+  {
+    switch (image->GetScalarType())
+    {
+      vtkTemplateMacro(vtkGammaDoseComparisonFilterExtractBuffer(image, static_cast<VTK_TT*>(NULL), extent, defaultValue, buffer));
+    default:
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Running statistics of the computed gamma values
+  struct GammaStatistics
+  {
+    GammaStatistics(int numberOfHistogramBins)
+      : NumberOfAnalyzedVoxels(0)
+      , NumberOfPassedVoxels(0)
+      , SumGamma(0.0)
+      , MaxGamma(0.0)
+      , Histogram(numberOfHistogramBins, 0)
+    {
+    }
+
+    void Add(const GammaStatistics& other)
+    {
+      this->NumberOfAnalyzedVoxels += other.NumberOfAnalyzedVoxels;
+      this->NumberOfPassedVoxels += other.NumberOfPassedVoxels;
+      this->SumGamma += other.SumGamma;
+      this->MaxGamma = std::max(this->MaxGamma, other.MaxGamma);
+      for (size_t binIndex=0; binIndex<this->Histogram.size(); ++binIndex)
+      {
+        this->Histogram[binIndex] += other.Histogram[binIndex];
+      }
+    }
+
+    vtkIdType NumberOfAnalyzedVoxels;
+    vtkIdType NumberOfPassedVoxels;
+    double SumGamma;
+    double MaxGamma;
+    std::vector<vtkIdType> Histogram;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Reference slices to compute gamma for, shared between the worker threads
+  struct GammaTaskList
+  {
+    const float* ReferenceDose;
+    const float* CompareDose;
+    /// NULL if there is no mask
+    const float* Mask;
+    /// NULL if only the statistics are computed
+    float* Gamma;
+    int Dimensions[3];
+    /// Spacing divided by the DTA tolerance
+    double NormalizedSpacing[3];
+    const std::vector<GammaSearchOffset>* SearchOffsets;
+    double MaximumGamma;
+    double ThresholdDose;
+    /// Absolute dose tolerance (global gamma) or fraction of the local dose (local gamma)
+    double DoseTolerance;
+    bool LocalGamma;
+    bool ReferenceOnlyThreshold;
+    bool InterpolateSearch;
+    /// Stop the search as soon as a gamma not greater than 1 is found
+    bool PassFailOnly;
+    double HistogramSpacing;
+    /// Statistics not used by any task. There are as many as threads, so a task always finds one
+    std::vector<GammaStatistics*> FreeStatistics;
+    vtkSimpleMutexLock Lock;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute gamma for one reference slice and add it to the statistics
+  void GammaTask(GammaTaskList* taskList, int k, GammaStatistics& statistics)
+  {
+    const int nx = taskList->Dimensions[0];
+    const int ny = taskList->Dimensions[1];
+    const int nz = taskList->Dimensions[2];
+    const vtkIdType sliceSize = (vtkIdType)nx * ny;
+    const std::vector<GammaSearchOffset>& searchOffsets = *(taskList->SearchOffsets);
+    const int numberOfSearchOffsets = (int)searchOffsets.size();
+    const double maximumGamma2 = taskList->MaximumGamma * taskList->MaximumGamma;
+    const float* compareDose = taskList->CompareDose;
+    // Squared gamma at which the search of a voxel can stop
+    const double sufficientGamma2 = (taskList->PassFailOnly ? 1.0 : -1.0);
+    const int numberOfHistogramBins = (int)statistics.Histogram.size();
+
+    for (int j=0; j<ny; ++j)
+    {
+      for (int i=0; i<nx; ++i)
+      {
+        vtkIdType voxelIndex = k*sliceSize + (vtkIdType)j*nx + i;
+        if (taskList->Gamma)
+        {
+          taskList->Gamma[voxelIndex] = 0.0f;
+        }
+
+        // Exclude masked and thresholded voxels
+        if (taskList->Mask && taskList->Mask[voxelIndex] == 0.0f)
+        {
+          continue;
+        }
+        double referenceDose = taskList->ReferenceDose[voxelIndex];
+        if ( referenceDose < taskList->ThresholdDose
+          && (taskList->ReferenceOnlyThreshold || compareDose[voxelIndex] < taskList->ThresholdDose) )
+        {
+          continue;
+        }
+
+        double doseTolerance = (taskList->LocalGamma ? taskList->DoseTolerance * referenceDose : taskList->DoseTolerance);
+        double inverseDoseTolerance2 = (doseTolerance > 0.0 ? 1.0 / (doseTolerance*doseTolerance) : ZERO_TOLERANCE_INVERSE_SQUARE);
+
+        // Visit the compare voxels in the order of increasing distance until the
+        // distance alone is at least the best squared gamma found so far
+        double bestGamma2 = maximumGamma2;
+        for (int offsetIndex=0; offsetIndex<numberOfSearchOffsets; ++offsetIndex)
+        {
+          const GammaSearchOffset& searchOffset = searchOffsets[offsetIndex];
+          if ( searchOffset.LowerBound2 >= bestGamma2
+            || (bestGamma2 <= sufficientGamma2 && bestGamma2 < maximumGamma2) )
+          {
+            break;
+          }
+          int ci = i + searchOffset.Offset[0];
+          int cj = j + searchOffset.Offset[1];
+          int ck = k + searchOffset.Offset[2];
+          if (ci < 0 || ci >= nx || cj < 0 || cj >= ny || ck < 0 || ck >= nz)
+          {
+            continue;
+          }
+          vtkIdType compareIndex = ck*sliceSize + (vtkIdType)cj*nx + ci;
+          double compareDoseDifference = compareDose[compareIndex] - referenceDose;
+          double gamma2 = searchOffset.Distance2 + compareDoseDifference * compareDoseDifference * inverseDoseTolerance2;
+          if (gamma2 < bestGamma2)
+          {
+            bestGamma2 = gamma2;
+          }
+          if (!taskList->InterpolateSearch)
+          {
+            continue;
+          }
+
+          // Minimize gamma on the segments between the compare voxel and its neighbors towards the reference voxel.
+          // Along a segment both the squared distance and the squared dose difference are quadratic in the segment parameter.
+          const vtkIdType strides[3] = { 1, nx, sliceSize };
+          for (int axis=0; axis<3; ++axis)
+          {
+            int offset = searchOffset.Offset[axis];
+            if (offset == 0)
+            {
+              continue;
+            }
+            vtkIdType neighborIndex = compareIndex - (offset > 0 ? strides[axis] : -strides[axis]);
+            double segmentDoseChange = compareDose[neighborIndex] - compareDose[compareIndex];
+            double normalizedSpacing2 = taskList->NormalizedSpacing[axis] * taskList->NormalizedSpacing[axis];
+            double a = normalizedSpacing2 + segmentDoseChange * segmentDoseChange * inverseDoseTolerance2;
+            double b = -2.0 * normalizedSpacing2 * (offset > 0 ? offset : -offset)
+              + 2.0 * compareDoseDifference * segmentDoseChange * inverseDoseTolerance2;
+            double t = std::min(1.0, std::max(0.0, -b / (2.0 * a)));
+            double segmentGamma2 = (a * t + b) * t + gamma2;
+            if (segmentGamma2 < bestGamma2)
+            {
+              bestGamma2 = segmentGamma2;
+            }
+          }
+        }
+
+        double gamma = sqrt(bestGamma2);
+        if (taskList->Gamma)
+        {
+          taskList->Gamma[voxelIndex] = static_cast<float>(gamma);
+        }
+        ++statistics.NumberOfAnalyzedVoxels;
+        if (gamma <= 1.0)
+        {
+          ++statistics.NumberOfPassedVoxels;
+        }
+        statistics.SumGamma += gamma;
+        statistics.MaxGamma = std::max(statistics.MaxGamma, gamma);
+        int binIndex = std::min(numberOfHistogramBins-1, (int)(gamma / taskList->HistogramSpacing));
+        ++statistics.Histogram[binIndex];
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute gamma for one reference slice, accumulating to statistics borrowed from the free list
+  void GammaTaskFunction(void* userData, int taskIndex)
+  {
+    GammaTaskList* taskList = static_cast<GammaTaskList*>(userData);
+
+    taskList->Lock.Lock();
+    GammaStatistics* statistics = taskList->FreeStatistics.back();
+    taskList->FreeStatistics.pop_back();
+    taskList->Lock.Unlock();
+
+    GammaTask(taskList, taskIndex, *statistics);
+
+    taskList->Lock.Lock();
+    taskList->FreeStatistics.push_back(statistics);
+    taskList->Lock.Unlock();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Invoke progress event of the filter with the fraction of the processed slices
+  void GammaProgressFunction(void* userData, int numberOfCompletedTasks, int numberOfTasks)
+  {
+    vtkGammaDoseComparisonFilter* self = static_cast<vtkGammaDoseComparisonFilter*>(userData);
+    double progress = (numberOfTasks > 0 ? (double)numberOfCompletedTasks / numberOfTasks : 1.0);
+    self->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparisonFilter::vtkGammaDoseComparisonFilter()
+  : DtaDistanceToleranceMm(3.0)
+  , DoseDifferenceTolerance(0.03)
+  , ReferenceDoseGy(50.0)
+  , UseMaximumDose(true)
+  , AnalysisThreshold(0.1)
+  , MaximumGamma(2.0)
+  , LocalGamma(false)
+  , ReferenceOnlyThreshold(false)
+  , InterpolateSearch(false)
+  , NumberOfThreads(0)
+  , ComputeGammaImage(true)
+  , PassFailOnly(false)
+  , HistogramSpacing(0.1)
+  , AppliedReferenceDoseGy(0.0)
+  , NumberOfAnalyzedVoxels(0)
+  , NumberOfPassedVoxels(0)
+  , MeanGamma(0.0)
+  , MaxGamma(0.0)
+{
+  this->OutputHistogram = vtkSmartPointer<vtkTable>::New();
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparisonFilter::~vtkGammaDoseComparisonFilter()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::SetReferenceDoseData(vtkOrientedImageData* referenceDose)
+{
+  this->ReferenceDoseData = referenceDose;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkGammaDoseComparisonFilter::GetReferenceDoseData()
+{
+  return this->ReferenceDoseData;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::SetCompareDoseData(vtkOrientedImageData* compareDose)
+{
+  this->CompareDoseData = compareDose;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkGammaDoseComparisonFilter::GetCompareDoseData()
+{
+  return this->CompareDoseData;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::SetMaskData(vtkOrientedImageData* mask)
+{
+  this->MaskData = mask;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkGammaDoseComparisonFilter::GetMaskData()
+{
+  return this->MaskData;
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkGammaDoseComparisonFilter::GetOutput()
+{
+  return this->Output;
+}
+
+//----------------------------------------------------------------------------
+vtkTable* vtkGammaDoseComparisonFilter::GetOutputHistogram()
+{
+  return this->OutputHistogram;
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetPassFraction()
+{
+  if (this->NumberOfAnalyzedVoxels == 0)
+  {
+    return 0.0;
+  }
+  return (double)this->NumberOfPassedVoxels / this->NumberOfAnalyzedVoxels;
+}
+
+//----------------------------------------------------------------------------
+bool vtkGammaDoseComparisonFilter::Update()
+{
+  this->Output = NULL;
+  this->AppliedReferenceDoseGy = 0.0;
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfPassedVoxels = 0;
+  this->MeanGamma = 0.0;
+  this->MaxGamma = 0.0;
+  this->OutputHistogram->Initialize();
+
+  if (!this->ReferenceDoseData || !this->CompareDoseData)
+  {
+    vtkErrorMacro("Update: Reference and compare doses must be set");
+    return false;
+  }
+  if ( this->DtaDistanceToleranceMm <= 0.0 || this->DoseDifferenceTolerance <= 0.0 || this->MaximumGamma <= 0.0
+    || this->HistogramSpacing <= 0.0 )
+  {
+    vtkErrorMacro("Update: DTA tolerance, dose difference tolerance, maximum gamma and histogram spacing must be positive");
+    return false;
+  }
+  if ( !vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceDoseData, this->CompareDoseData)
+    || (this->MaskData && !vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceDoseData, this->MaskData)) )
+  {
+    vtkErrorMacro("Update: Compare dose and mask must have the same geometry as the reference dose");
+    return false;
+  }
+
+  // Get doses and mask on the reference extent
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  this->ReferenceDoseData->GetExtent(extent);
+  int dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+  if (dimensions[0] <= 0 || dimensions[1] <= 0 || dimensions[2] <= 0)
+  {
+    vtkErrorMacro("Update: Empty reference dose");
+    return false;
+  }
+  std::vector<float> referenceDose;
+  std::vector<float> compareDose;
+  std::vector<float> mask;
+  if ( !ExtractBuffer(this->ReferenceDoseData, extent, 0.0f, referenceDose)
+    || !ExtractBuffer(this->CompareDoseData, extent, 0.0f, compareDose)
+    || (this->MaskData && !ExtractBuffer(this->MaskData, extent, 0.0f, mask)) )
+  {
+    vtkErrorMacro("Update: Unknown scalar type of input image");
+    return false;
+  }
+
+  // Determine reference dose and dose tolerances
+  this->AppliedReferenceDoseGy = this->ReferenceDoseGy;
+  if (this->UseMaximumDose)
+  {
+    this->AppliedReferenceDoseGy = *std::max_element(referenceDose.begin(), referenceDose.end());
+  }
+
+  // Collect search offsets within the maximum gamma distance, ordered by distance
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceDoseData->GetSpacing(spacing);
+  double maximumSpacing = std::max(fabs(spacing[0]), std::max(fabs(spacing[1]), fabs(spacing[2])));
+  double searchRadius = this->MaximumGamma * this->DtaDistanceToleranceMm;
+  if (this->InterpolateSearch)
+  {
+    // Segments of voxels beyond the radius may reach into it
+    searchRadius += maximumSpacing;
+  }
+  int searchExtent[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    searchExtent[axis] = std::min(dimensions[axis]-1, (int)floor(searchRadius / fabs(spacing[axis])));
+  }
+  double dta2 = this->DtaDistanceToleranceMm * this->DtaDistanceToleranceMm;
+  std::vector<GammaSearchOffset> searchOffsets;
+  for (int dk=-searchExtent[2]; dk<=searchExtent[2]; ++dk)
+  {
+    for (int dj=-searchExtent[1]; dj<=searchExtent[1]; ++dj)
+    {
+      for (int di=-searchExtent[0]; di<=searchExtent[0]; ++di)
+      {
+        double distance2 = di*spacing[0]*di*spacing[0] + dj*spacing[1]*dj*spacing[1] + dk*spacing[2]*dk*spacing[2];
+        if (distance2 > searchRadius * searchRadius)
+        {
+          continue;
+        }
+        GammaSearchOffset searchOffset;
+        searchOffset.Offset[0] = di;
+        searchOffset.Offset[1] = dj;
+        searchOffset.Offset[2] = dk;
+        searchOffset.Distance2 = distance2 / dta2;
+        searchOffset.LowerBound2 = searchOffset.Distance2;
+        if (this->InterpolateSearch)
+        {
+          double lowerBoundDistance = std::max(0.0, sqrt(distance2) - maximumSpacing);
+          searchOffset.LowerBound2 = lowerBoundDistance * lowerBoundDistance / dta2;
+        }
+        searchOffsets.push_back(searchOffset);
+      }
+    }
+  }
+  std::sort(searchOffsets.begin(), searchOffsets.end(), IsSearchOffsetCloser);
+
+  // Create output image only if requested, the statistics are accumulated while computing
+  vtkSmartPointer<vtkOrientedImageData> gammaImage;
+  if (this->ComputeGammaImage)
+  {
+    gammaImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    gammaImage->SetExtent(extent);
+    gammaImage->SetSpacing(spacing);
+    gammaImage->SetOrigin(this->ReferenceDoseData->GetOrigin());
+    double directions[3][3] = {{1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,0.0,1.0}};
+    this->ReferenceDoseData->GetDirections(directions);
+    gammaImage->SetDirections(directions);
+    gammaImage->AllocateScalars(VTK_FLOAT, 1);
+  }
+  int numberOfHistogramBins = std::max(1, (int)ceil(this->MaximumGamma / this->HistogramSpacing));
+  GammaStatistics statistics(numberOfHistogramBins);
+
+  // Compute gamma slice by slice
+  GammaTaskList taskList;
+  taskList.ReferenceDose = &referenceDose[0];
+  taskList.CompareDose = &compareDose[0];
+  taskList.Mask = (this->MaskData ? &mask[0] : NULL);
+  taskList.Gamma = (gammaImage.GetPointer() ? static_cast<float*>(gammaImage->GetScalarPointer()) : NULL);
+  for (int axis=0; axis<3; ++axis)
+  {
+    taskList.Dimensions[axis] = dimensions[axis];
+    taskList.NormalizedSpacing[axis] = spacing[axis] / this->DtaDistanceToleranceMm;
+  }
+  taskList.SearchOffsets = &searchOffsets;
+  taskList.MaximumGamma = this->MaximumGamma;
+  taskList.ThresholdDose = this->AnalysisThreshold * this->AppliedReferenceDoseGy;
+  taskList.DoseTolerance = (this->LocalGamma ? this->DoseDifferenceTolerance : this->DoseDifferenceTolerance * this->AppliedReferenceDoseGy);
+  taskList.LocalGamma = this->LocalGamma;
+  taskList.ReferenceOnlyThreshold = this->ReferenceOnlyThreshold;
+  taskList.InterpolateSearch = this->InterpolateSearch;
+  taskList.PassFailOnly = this->PassFailOnly;
+  taskList.HistogramSpacing = this->HistogramSpacing;
+
+  int numberOfThreads = vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(this->NumberOfThreads, dimensions[2]);
+  std::vector<GammaStatistics> threadStatistics(numberOfThreads, GammaStatistics(numberOfHistogramBins));
+  for (std::vector<GammaStatistics>::iterator statisticsIt=threadStatistics.begin(); statisticsIt!=threadStatistics.end(); ++statisticsIt)
+  {
+    taskList.FreeStatistics.push_back(&(*statisticsIt));
+  }
+
+  // Progress is reported on the calling thread while the workers compute the slices
+  vtkSmartPointer<vtkSlicerRtTaskPool> taskPool = vtkSmartPointer<vtkSlicerRtTaskPool>::New();
+  taskPool->SetTaskFunction(GammaTaskFunction, &taskList);
+  if (this->HasObserver(vtkCommand::ProgressEvent))
+  {
+    taskPool->SetProgressFunction(GammaProgressFunction, this);
+  }
+  taskPool->SetNumberOfThreads(numberOfThreads);
+  taskPool->Execute(dimensions[2]);
+  for (std::vector<GammaStatistics>::iterator statisticsIt=threadStatistics.begin(); statisticsIt!=threadStatistics.end(); ++statisticsIt)
+  {
+    statistics.Add(*statisticsIt);
+  }
+
+  this->NumberOfAnalyzedVoxels = statistics.NumberOfAnalyzedVoxels;
+  this->NumberOfPassedVoxels = statistics.NumberOfPassedVoxels;
+  if (statistics.NumberOfAnalyzedVoxels > 0)
+  {
+    this->MeanGamma = statistics.SumGamma / statistics.NumberOfAnalyzedVoxels;
+  }
+  this->MaxGamma = statistics.MaxGamma;
+  this->Output = gammaImage;
+
+  // Assemble histogram table
+  vtkSmartPointer<vtkDoubleArray> bins = vtkSmartPointer<vtkDoubleArray>::New();
+  bins->SetName("Bins");
+  vtkSmartPointer<vtkIdTypeArray> frequencies = vtkSmartPointer<vtkIdTypeArray>::New();
+  frequencies->SetName("Frequencies");
+  for (int binIndex=0; binIndex<numberOfHistogramBins; ++binIndex)
+  {
+    bins->InsertNextTuple1(binIndex * this->HistogramSpacing);
+    frequencies->InsertNextTuple1(statistics.Histogram[binIndex]);
+  }
+  this->OutputHistogram->AddColumn(bins);
+  this->OutputHistogram->AddColumn(frequencies);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "DtaDistanceToleranceMm: " << this->DtaDistanceToleranceMm << "\n";
+  os << indent << "DoseDifferenceTolerance: " << this->DoseDifferenceTolerance << "\n";
+  os << indent << "ReferenceDoseGy: " << this->ReferenceDoseGy << "\n";
+  os << indent << "UseMaximumDose: " << (this->UseMaximumDose ? "true" : "false") << "\n";
+  os << indent << "AnalysisThreshold: " << this->AnalysisThreshold << "\n";
+  os << indent << "MaximumGamma: " << this->MaximumGamma << "\n";
+  os << indent << "LocalGamma: " << (this->LocalGamma ? "true" : "false") << "\n";
+  os << indent << "ReferenceOnlyThreshold: " << (this->ReferenceOnlyThreshold ? "true" : "false") << "\n";
+  os << indent << "InterpolateSearch: " << (this->InterpolateSearch ? "true" : "false") << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "ComputeGammaImage: " << (this->ComputeGammaImage ? "true" : "false") << "\n";
+  os << indent << "PassFailOnly: " << (this->PassFailOnly ? "true" : "false") << "\n";
+  os << indent << "HistogramSpacing: " << this->HistogramSpacing << "\n";
+  os << indent << "AppliedReferenceDoseGy: " << this->AppliedReferenceDoseGy << "\n";
+  os << indent << "NumberOfAnalyzedVoxels: " << this->NumberOfAnalyzedVoxels << "\n";
+  os << indent << "NumberOfPassedVoxels: " << this->NumberOfPassedVoxels << "\n";
+  os << indent << "MeanGamma: " << this->MeanGamma << "\n";
+  os << indent << "MaxGamma: " << this->MaxGamma << "\n";
+}
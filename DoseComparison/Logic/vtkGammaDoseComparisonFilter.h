@@ -0,0 +1,243 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkGammaDoseComparisonFilter_h
+#define __vtkGammaDoseComparisonFilter_h
+
+#include "vtkSlicerDoseComparisonModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+class vtkOrientedImageData;
+class vtkTable;
+
+/// \ingroup SlicerRt_QtModules_DoseComparison
+/// \brief Compute the gamma index of a compare dose with respect to a reference dose
+///
+/// Same gamma definition and parameters as the plastimatch Gamma_dose_comparison class, so that the
+/// two engines can be used interchangeably. For each reference voxel above the analysis threshold the
+/// compare dose voxels are visited in the order of increasing distance (shells of equal distance around
+/// the reference voxel). The search stops as soon as the distance term alone of the next shell is at least
+/// the best gamma found so far, because no farther voxel can improve it. Optionally the compare dose
+/// is linearly interpolated between each visited voxel and its neighbors towards the reference voxel,
+/// which gives sub-voxel search accuracy. Slices of the reference dose are processed in parallel.
+///
+/// The compare dose and the mask must have the same geometry (origin, spacing, directions) as the reference
+/// dose, but they may have a different extent. Compare dose outside its extent is zero, voxels outside the
+/// mask extent are excluded.
+///
+/// The output gamma image has the geometry and extent of the reference dose. Voxels excluded from the
+/// analysis (by the mask or the threshold) have zero gamma. The pass statistics, the mean and maximum gamma
+/// and a gamma histogram are accumulated during the computation, so the gamma image can be omitted when only
+/// these are needed (see ComputeGammaImage).
+///
+/// Progress of the update (fraction of the processed reference slices, as double) is reported by
+/// vtkCommand::ProgressEvent, invoked on the thread calling \sa Update.
+///
+/// This is not a VTK pipeline filter, because the inputs and the output are vtkOrientedImageData, whose
+/// directions are not passed along by the VTK image pipeline.
+class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkGammaDoseComparisonFilter : public vtkObject
+{
+public:
+  static vtkGammaDoseComparisonFilter* New();
+  vtkTypeMacro(vtkGammaDoseComparisonFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set reference dose. Must have one scalar component
+  void SetReferenceDoseData(vtkOrientedImageData* referenceDose);
+  /// Get reference dose
+  vtkOrientedImageData* GetReferenceDoseData();
+
+  /// Set compare dose. Must have one scalar component and the same geometry as the reference dose
+  void SetCompareDoseData(vtkOrientedImageData* compareDose);
+  /// Get compare dose
+  vtkOrientedImageData* GetCompareDoseData();
+
+  /// Set mask. Only voxels with non-zero mask value are analyzed. Optional
+  void SetMaskData(vtkOrientedImageData* mask);
+  /// Get mask
+  vtkOrientedImageData* GetMaskData();
+
+  /// Get output gamma image (float). NULL if ComputeGammaImage is off
+  vtkOrientedImageData* GetOutput();
+
+  /// Get histogram of the gamma values of the analyzed voxels. Column "Bins" contains
+  /// the lower bin edges, column "Frequencies" the number of voxels in each bin.
+  /// Gamma values not lower than the last edge are counted in the last bin.
+  vtkTable* GetOutputHistogram();
+
+  /// Set distance to agreement (DTA) tolerance, in mm
+  vtkSetMacro(DtaDistanceToleranceMm, double);
+  /// Get distance to agreement (DTA) tolerance, in mm
+  vtkGetMacro(DtaDistanceToleranceMm, double);
+
+  /// Set dose difference tolerance as a fraction of the reference dose (e.g. 0.03 for 3%)
+  vtkSetMacro(DoseDifferenceTolerance, double);
+  /// Get dose difference tolerance as a fraction of the reference dose
+  vtkGetMacro(DoseDifferenceTolerance, double);
+
+  /// Set reference dose (prescription dose) in Gy. Used only if UseMaximumDose is off
+  vtkSetMacro(ReferenceDoseGy, double);
+  /// Get reference dose (prescription dose) in Gy
+  vtkGetMacro(ReferenceDoseGy, double);
+
+  /// Set flag determining whether the maximum of the reference dose is used as reference dose
+  vtkSetMacro(UseMaximumDose, bool);
+  /// Get flag determining whether the maximum of the reference dose is used as reference dose
+  vtkGetMacro(UseMaximumDose, bool);
+  /// Set flag determining whether the maximum of the reference dose is used as reference dose
+  vtkBooleanMacro(UseMaximumDose, bool);
+
+  /// Set analysis threshold as a fraction of the reference dose (e.g. 0.1 for 10%)
+  vtkSetMacro(AnalysisThreshold, double);
+  /// Get analysis threshold as a fraction of the reference dose
+  vtkGetMacro(AnalysisThreshold, double);
+
+  /// Set maximum gamma. The search region and the output values are limited by it
+  vtkSetMacro(MaximumGamma, double);
+  /// Get maximum gamma
+  vtkGetMacro(MaximumGamma, double);
+
+  /// Set flag determining whether the dose difference tolerance is relative to the local reference dose
+  vtkSetMacro(LocalGamma, bool);
+  /// Get flag determining whether the dose difference tolerance is relative to the local reference dose
+  vtkGetMacro(LocalGamma, bool);
+  /// Set flag determining whether the dose difference tolerance is relative to the local reference dose
+  vtkBooleanMacro(LocalGamma, bool);
+
+  /// Set flag determining whether only the reference dose is thresholded. If off, then voxels are
+  /// excluded only if both reference and compare doses are below the threshold
+  vtkSetMacro(ReferenceOnlyThreshold, bool);
+  /// Get flag determining whether only the reference dose is thresholded
+  vtkGetMacro(ReferenceOnlyThreshold, bool);
+  /// Set flag determining whether only the reference dose is thresholded
+  vtkBooleanMacro(ReferenceOnlyThreshold, bool);
+
+  /// Set flag determining whether the compare dose is interpolated between voxels during the search
+  vtkSetMacro(InterpolateSearch, bool);
+  /// Get flag determining whether the compare dose is interpolated between voxels during the search
+  vtkGetMacro(InterpolateSearch, bool);
+  /// Set flag determining whether the compare dose is interpolated between voxels during the search
+  vtkBooleanMacro(InterpolateSearch, bool);
+
+  /// Set number of threads computing the reference slices. 0 (default) means one thread per processor core,
+  /// 1 means the slices are computed on the calling thread (unless progress is observed) \sa vtkSlicerRtTaskPool
+  vtkSetMacro(NumberOfThreads, int);
+  /// Get number of threads
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Set flag determining whether the output gamma image is created. If off, then only the statistics are computed
+  vtkSetMacro(ComputeGammaImage, bool);
+  /// Get flag determining whether the output gamma image is created
+  vtkGetMacro(ComputeGammaImage, bool);
+  /// Set flag determining whether the output gamma image is created
+  vtkBooleanMacro(ComputeGammaImage, bool);
+
+  /// Set flag determining whether the search of a voxel stops as soon as it is proven to pass (gamma <= 1).
+  /// The pass fraction is exact, but the gamma value of passing voxels is only an upper bound,
+  /// which affects the gamma image, the mean gamma and the histogram.
+  vtkSetMacro(PassFailOnly, bool);
+  /// Get flag determining whether the search of a voxel stops as soon as it is proven to pass
+  vtkGetMacro(PassFailOnly, bool);
+  /// Set flag determining whether the search of a voxel stops as soon as it is proven to pass
+  vtkBooleanMacro(PassFailOnly, bool);
+
+  /// Set width of the gamma histogram bins. The histogram covers the range from 0 to MaximumGamma
+  vtkSetMacro(HistogramSpacing, double);
+  /// Get width of the gamma histogram bins
+  vtkGetMacro(HistogramSpacing, double);
+
+  /// Compute gamma image and pass statistics
+  /// \return Success flag
+  bool Update();
+
+  /// Get reference dose used in the last update (Gy). It is the maximum reference dose if UseMaximumDose is on
+  vtkGetMacro(AppliedReferenceDoseGy, double);
+
+  /// Get number of voxels included in the analysis in the last update
+  vtkGetMacro(NumberOfAnalyzedVoxels, vtkIdType);
+  /// Get number of analyzed voxels with gamma not greater than 1 in the last update
+  vtkGetMacro(NumberOfPassedVoxels, vtkIdType);
+  /// Get fraction of analyzed voxels that passed (between 0 and 1)
+  double GetPassFraction();
+  /// Get mean gamma of the analyzed voxels in the last update
+  vtkGetMacro(MeanGamma, double);
+  /// Get largest gamma of the analyzed voxels in the last update. It is at most MaximumGamma
+  vtkGetMacro(MaxGamma, double);
+
+protected:
+  vtkGammaDoseComparisonFilter();
+  virtual ~vtkGammaDoseComparisonFilter();
+
+protected:
+  vtkSmartPointer<vtkOrientedImageData> ReferenceDoseData;
+  vtkSmartPointer<vtkOrientedImageData> CompareDoseData;
+  vtkSmartPointer<vtkOrientedImageData> MaskData;
+  vtkSmartPointer<vtkOrientedImageData> Output;
+  vtkSmartPointer<vtkTable> OutputHistogram;
+
+  /// Distance to agreement (DTA) tolerance, in mm. Default is 3
+  double DtaDistanceToleranceMm;
+  /// Dose difference tolerance as a fraction of the reference dose. Default is 0.03
+  double DoseDifferenceTolerance;
+  /// Reference dose (prescription dose) in Gy. Default is 50
+  double ReferenceDoseGy;
+  /// Use maximum of the reference dose as reference dose. Default is true
+  bool UseMaximumDose;
+  /// Analysis threshold as a fraction of the reference dose. Default is 0.1
+  double AnalysisThreshold;
+  /// Maximum gamma. Default is 2
+  double MaximumGamma;
+  /// Local dose difference. Default is false (global)
+  bool LocalGamma;
+  /// Threshold only the reference dose. Default is false
+  bool ReferenceOnlyThreshold;
+  /// Interpolate compare dose during the search. Default is false
+  bool InterpolateSearch;
+
+  /// Number of threads searching the reference slices, see \sa SetNumberOfThreads
+  int NumberOfThreads;
+
+  /// Create output gamma image. Default is true
+  bool ComputeGammaImage;
+  /// Stop the search of a voxel once it is proven to pass. Default is false
+  bool PassFailOnly;
+  /// Width of the gamma histogram bins. Default is 0.1
+  double HistogramSpacing;
+
+  /// Reference dose used in the last update
+  double AppliedReferenceDoseGy;
+  /// Number of analyzed voxels in the last update
+  vtkIdType NumberOfAnalyzedVoxels;
+  /// Number of passed voxels in the last update
+  vtkIdType NumberOfPassedVoxels;
+  /// Mean gamma in the last update
+  double MeanGamma;
+  /// Largest gamma in the last update
+  double MaxGamma;
+
+private:
+  vtkGammaDoseComparisonFilter(const vtkGammaDoseComparisonFilter&); // Not implemented
+  void operator=(const vtkGammaDoseComparisonFilter&);               // Not implemented
+};
+
+#endif
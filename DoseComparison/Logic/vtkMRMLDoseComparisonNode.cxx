@@ -25,6 +25,7 @@
 #include <vtkMRMLScene.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSegmentationNode.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -38,6 +39,7 @@ static const char* REFERENCE_DOSE_VOLUME_REFERENCE_ROLE = "referenceDoseVolumeRe
 static const char* COMPARE_DOSE_VOLUME_REFERENCE_ROLE = "compareDoseVolumeRef";
 static const char* MASK_SEGMENTATION_REFERENCE_ROLE = "maskSegmentationRef";
 static const char* GAMMA_VOLUME_REFERENCE_ROLE = "outputGammaVolumeRef";
+static const char* GAMMA_HISTOGRAM_TABLE_REFERENCE_ROLE = "outputGammaHistogramTableRef";
 
 //------------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLDoseComparisonNode);
@@ -58,6 +60,12 @@ vtkMRMLDoseComparisonNode::vtkMRMLDoseComparisonNode()
   this->ResultsValid = false;
   this->ReportString = NULL;
   this->LocalDoseDifference = false;
+  this->UseNativeGammaEngine = false;
+  this->UseSubVoxelSearch = false;
+  this->SummaryOnly = false;
+  this->PassFailOnly = false;
+  this->MeanGamma = -1.0;
+  this->MaxGamma = -1.0;
 
   this->HideFromEditors = false;
 }
@@ -84,7 +92,13 @@ void vtkMRMLDoseComparisonNode::WriteXML(ostream& of, int nIndent)
   of << " UseLinearInterpolation=\"" << (this->UseLinearInterpolation ? "true" : "false") << "\"";
   of << " LocalDoseDifference=\"" << (this->LocalDoseDifference ? "true" : "false") << "\"";
   of << " DoseThresholdOnReferenceOnly=\"" << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\"";
+  of << " UseNativeGammaEngine=\"" << (this->UseNativeGammaEngine ? "true" : "false") << "\"";
+  of << " UseSubVoxelSearch=\"" << (this->UseSubVoxelSearch ? "true" : "false") << "\"";
+  of << " SummaryOnly=\"" << (this->SummaryOnly ? "true" : "false") << "\"";
+  of << " PassFailOnly=\"" << (this->PassFailOnly ? "true" : "false") << "\"";
   of << " PassFractionPercent=\"" << this->PassFractionPercent << "\"";
+  of << " MeanGamma=\"" << this->MeanGamma << "\"";
+  of << " MaxGamma=\"" << this->MaxGamma << "\"";
   of << " ResultsValid=\"" << (this->ResultsValid ? "true" : "false") << "\"";
   of << " ReportString=\"" << (this->ReportString ? this->ReportString : "") << "\"";
 }
@@ -143,10 +157,34 @@ void vtkMRMLDoseComparisonNode::ReadXMLAttributes(const char** atts)
       {
       this->DoseThresholdOnReferenceOnly = (strcmp(attValue,"true") ? false : true);
       }
+    else if (!strcmp(attName, "UseNativeGammaEngine")) 
+      {
+      this->UseNativeGammaEngine = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "UseSubVoxelSearch")) 
+      {
+      this->UseSubVoxelSearch = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "SummaryOnly")) 
+      {
+      this->SummaryOnly = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "PassFailOnly")) 
+      {
+      this->PassFailOnly = (strcmp(attValue,"true") ? false : true);
+      }
     else if (!strcmp(attName, "PassFractionPercent")) 
       {
       this->PassFractionPercent = vtkVariant(attValue).ToDouble();
       }
+    else if (!strcmp(attName, "MeanGamma")) 
+      {
+      this->MeanGamma = vtkVariant(attValue).ToDouble();
+      }
+    else if (!strcmp(attName, "MaxGamma")) 
+      {
+      this->MaxGamma = vtkVariant(attValue).ToDouble();
+      }
     else if (!strcmp(attName, "ResultsValid")) 
       {
       this->ResultsValid = (strcmp(attValue,"true") ? false : true);
@@ -173,10 +211,16 @@ void vtkMRMLDoseComparisonNode::Copy(vtkMRMLNode *anode)
   this->AnalysisThresholdPercent = node->AnalysisThresholdPercent;
   this->MaximumGamma = node->MaximumGamma;
   this->PassFractionPercent = node->PassFractionPercent;
+  this->MeanGamma = node->MeanGamma;
+  this->MaxGamma = node->MaxGamma;
   this->UseMaximumDose = node->UseMaximumDose;
   this->UseLinearInterpolation = node->UseLinearInterpolation;
   this->LocalDoseDifference = node->LocalDoseDifference;
   this->DoseThresholdOnReferenceOnly = node->DoseThresholdOnReferenceOnly;
+  this->UseNativeGammaEngine = node->UseNativeGammaEngine;
+  this->UseSubVoxelSearch = node->UseSubVoxelSearch;
+  this->SummaryOnly = node->SummaryOnly;
+  this->PassFailOnly = node->PassFailOnly;
   this->ResultsValid = node->ResultsValid;
   this->ReportString = node->ReportString;
 
@@ -199,7 +243,13 @@ void vtkMRMLDoseComparisonNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "UseLinearInterpolation:   " << (this->UseLinearInterpolation ? "true" : "false") << "\n";
   os << indent << "LocalDoseDifference:   " << (this->LocalDoseDifference ? "true" : "false") << "\n";
   os << indent << "DoseThresholdOnReferenceOnly:   " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "UseNativeGammaEngine:   " << (this->UseNativeGammaEngine ? "true" : "false") << "\n";
+  os << indent << "UseSubVoxelSearch:   " << (this->UseSubVoxelSearch ? "true" : "false") << "\n";
+  os << indent << "SummaryOnly:   " << (this->SummaryOnly ? "true" : "false") << "\n";
+  os << indent << "PassFailOnly:   " << (this->PassFailOnly ? "true" : "false") << "\n";
   os << indent << "PassFractionPercent:   " << this->PassFractionPercent << "\n";
+  os << indent << "MeanGamma:   " << this->MeanGamma << "\n";
+  os << indent << "MaxGamma:   " << this->MaxGamma << "\n";
   os << indent << "ResultsValid:   " << (this->ResultsValid ? "true" : "false") << "\n";
   os << indent << "ReportString:   " << (this->ReportString ? this->ReportString : "") << "\n";
 }
@@ -275,3 +325,21 @@ void vtkMRMLDoseComparisonNode::SetAndObserveGammaVolumeNode(vtkMRMLScalarVolume
 
   this->SetNodeReferenceID(GAMMA_VOLUME_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 }
+
+//----------------------------------------------------------------------------
+vtkMRMLTableNode* vtkMRMLDoseComparisonNode::GetGammaHistogramTableNode()
+{
+  return vtkMRMLTableNode::SafeDownCast( this->GetNodeReference(GAMMA_HISTOGRAM_TABLE_REFERENCE_ROLE) );
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetAndObserveGammaHistogramTableNode(vtkMRMLTableNode* node)
+{
+  if (node && this->Scene != node->GetScene())
+    {
+    vtkErrorMacro("Cannot set reference: the referenced and referencing node are not in the same scene");
+    return;
+    }
+
+  this->SetNodeReferenceID(GAMMA_HISTOGRAM_TABLE_REFERENCE_ROLE, (node ? node->GetID() : NULL));
+}
@@ -33,6 +33,7 @@
 
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLSegmentationNode;
+class vtkMRMLTableNode;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkMRMLDoseComparisonNode : public vtkMRMLNode
@@ -78,6 +79,11 @@ public:
   /// Set and observe output gamma volume node
   void SetAndObserveGammaVolumeNode(vtkMRMLScalarVolumeNode* node);
 
+  /// Get output gamma histogram table node
+  vtkMRMLTableNode* GetGammaHistogramTableNode();
+  /// Set and observe output gamma histogram table node
+  void SetAndObserveGammaHistogramTableNode(vtkMRMLTableNode* node);
+
   /// Get mask segment ID
   vtkGetStringMacro(MaskSegmentID);
   /// Set mask segment ID
@@ -136,6 +142,34 @@ public:
   /// Set local dose difference flag
   vtkBooleanMacro(LocalDoseDifference, bool);
 
+  /// Get native gamma engine flag
+  vtkGetMacro(UseNativeGammaEngine, bool);
+  /// Set native gamma engine flag
+  vtkSetMacro(UseNativeGammaEngine, bool);
+  /// Set native gamma engine flag
+  vtkBooleanMacro(UseNativeGammaEngine, bool);
+
+  /// Get sub-voxel search flag
+  vtkGetMacro(UseSubVoxelSearch, bool);
+  /// Set sub-voxel search flag
+  vtkSetMacro(UseSubVoxelSearch, bool);
+  /// Set sub-voxel search flag
+  vtkBooleanMacro(UseSubVoxelSearch, bool);
+
+  /// Get summary only flag
+  vtkGetMacro(SummaryOnly, bool);
+  /// Set summary only flag
+  vtkSetMacro(SummaryOnly, bool);
+  /// Set summary only flag
+  vtkBooleanMacro(SummaryOnly, bool);
+
+  /// Get pass/fail only flag
+  vtkGetMacro(PassFailOnly, bool);
+  /// Set pass/fail only flag
+  vtkSetMacro(PassFailOnly, bool);
+  /// Set pass/fail only flag
+  vtkBooleanMacro(PassFailOnly, bool);
+
   /// Get valid flag
   vtkGetMacro(ResultsValid, bool);
   /// Set valid flag
@@ -148,6 +182,16 @@ public:
   /// Set pass fraction
   vtkSetMacro(PassFractionPercent, double);
 
+  /// Get mean gamma
+  vtkGetMacro(MeanGamma, double);
+  /// Set mean gamma
+  vtkSetMacro(MeanGamma, double);
+
+  /// Get largest gamma
+  vtkGetMacro(MaxGamma, double);
+  /// Set largest gamma
+  vtkSetMacro(MaxGamma, double);
+
   /// Get report string
   vtkGetStringMacro(ReportString);
   /// Set report string
@@ -197,10 +241,33 @@ protected:
   /// Flag determining whether dose thresholding should be performed using only the reference image
   /// Default value is false, meaning that both images will be used
   bool DoseThresholdOnReferenceOnly;
+
+  /// Flag determining whether the multi-threaded gamma engine of SlicerRT (vtkGammaDoseComparisonFilter) is used
+  /// instead of the plastimatch one. Default value is false
+  bool UseNativeGammaEngine;
+
+  /// Flag determining whether the compare dose is interpolated between voxels during the gamma search.
+  /// Only used by the native gamma engine. Default value is false
+  bool UseSubVoxelSearch;
+
+  /// Flag determining whether only the pass rate, the gamma statistics and the histogram are computed,
+  /// without creating the gamma volume. Always uses the native gamma engine. Default value is false
+  bool SummaryOnly;
+
+  /// Flag determining whether the gamma search of a voxel stops as soon as it is proven to pass.
+  /// Only used by the native gamma engine. The pass rate is exact, but the gamma values of passing voxels
+  /// (and thus the mean gamma and the histogram) are upper bounds. Default value is false
+  bool PassFailOnly;
   
   /// Percentage of voxels that passed (output)
   double PassFractionPercent;
 
+  /// Mean gamma of the analyzed voxels (output). Only computed by the native gamma engine
+  double MeanGamma;
+
+  /// Largest gamma of the analyzed voxels (output). Only computed by the native gamma engine
+  double MaxGamma;
+
   /// Flag indicating if the results are valid
   bool ResultsValid;
 
@@ -21,6 +21,7 @@
 // DoseComparison includes
 #include "vtkSlicerDoseComparisonModuleLogic.h"
 #include "vtkMRMLDoseComparisonNode.h"
+#include "vtkGammaDoseComparisonFilter.h"
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
@@ -33,6 +34,7 @@
 #include "vtkMRMLSegmentationNode.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 #include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
 
 // MRML includes
@@ -44,6 +46,7 @@
 #include <vtkMRMLScene.h>
 #include <vtkMRMLSubjectHierarchyConstants.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
+#include <vtkMRMLTableNode.h>
 
 // MRMLLogic includes
 #include <vtkMRMLColorLogic.h>
@@ -51,13 +54,21 @@
 #include <vtkSlicerSubjectHierarchyModuleLogic.h>
 
 // VTK includes
+#include <vtkCallbackCommand.h>
 #include <vtkNew.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkDoubleArray.h>
+#include <vtkTable.h>
 #include <vtkTimerLog.h>
 #include <vtkLookupTable.h>
 #include <vtkImageConstantPad.h>
 #include <vtkObjectFactory.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <sstream>
+
 // SlicerBase includes
 #include "vtkSlicerApplicationLogic.h"
 
@@ -78,6 +89,17 @@ void GammaProgressCallback(float progress)
   }
 }
 
+//---------------------------------------------------------------------------
+void GammaFilterProgressCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eventId), void* clientData, void* callData)
+{
+  vtkSlicerDoseComparisonModuleLogic* logic = reinterpret_cast<vtkSlicerDoseComparisonModuleLogic*>(clientData);
+  double* progress = reinterpret_cast<double*>(callData);
+  if (logic && progress)
+  {
+    logic->GammaProgressUpdated((float)(*progress));
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseComparisonModuleLogic);
 
@@ -195,13 +217,22 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   double checkpointStart = timer->GetUniversalTime();
 
   parameterNode->ResultsValidOff();
+  parameterNode->SetMeanGamma(-1.0);
+  parameterNode->SetMaxGamma(-1.0);
 
-  double checkpointConvertStart = timer->GetUniversalTime();
-  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
-  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
-  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
+  // Gamma volume is not created in summary mode
+  bool summaryOnly = parameterNode->GetSummaryOnly();
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+  if (gammaVolumeNode == NULL && !summaryOnly)
+  {
+    std::string errorMessage("Invalid gamma volume node in parameter set node");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
 
-  Plm_image::Pointer maskVolume;
+  double checkpointConvertStart = timer->GetUniversalTime();
+  vtkSmartPointer<vtkSegmentation> segmentationCopy;
+  vtkOrientedImageData* maskSegmentLabelmap = NULL;
   vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
   const char* maskSegmentID = parameterNode->GetMaskSegmentID();
   if (maskSegmentationNode && maskSegmentID)
@@ -217,7 +248,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     }
 
     // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
-    vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
+    segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
     segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
     segmentationCopy->CopyConversionParameters(maskSegmentation);
     segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
@@ -228,7 +259,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
       return errorMessage;
     }
     // Get segment binary labelmap
-    vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
+    maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
       vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
 
     // Apply parent transformation nodes if necessary
@@ -239,57 +270,183 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
       vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
+  }
 
-    // Convert mask to Plm image
-    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
-    if (!maskVolume)
+  double checkpointGammaStart = 0.0;
+  double checkpointVtkConvertStart = 0.0;
+  if (parameterNode->GetUseNativeGammaEngine() || summaryOnly)
+  {
+    // Get doses in world coordinate system, compare dose and mask on the reference dose grid
+    vtkSmartPointer<vtkOrientedImageData> referenceDose = vtkSmartPointer<vtkOrientedImageData>::New();
+    vtkSmartPointer<vtkOrientedImageData> compareDose = vtkSmartPointer<vtkOrientedImageData>::New();
+    if ( !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetReferenceDoseVolumeNode(), referenceDose, true)
+      || !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetCompareDoseVolumeNode(), compareDose, true) )
     {
-      std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
+      std::string errorMessage("Failed to get dose volumes");
+      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+      return errorMessage;
+    }
+    if ( !vtkOrientedImageDataResample::DoGeometriesMatch(referenceDose, compareDose)
+      && !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(compareDose, referenceDose, compareDose, parameterNode->GetUseLinearInterpolation()) )
+    {
+      std::string errorMessage("Failed to resample compare dose to reference dose grid");
+      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+      return errorMessage;
+    }
+    if ( maskSegmentLabelmap && !vtkOrientedImageDataResample::DoGeometriesMatch(referenceDose, maskSegmentLabelmap)
+      && !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(maskSegmentLabelmap, referenceDose, maskSegmentLabelmap) )
+    {
+      std::string errorMessage("Failed to resample mask segment labelmap to reference dose grid");
       vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
-  }
 
-  // Compute gamma dose volume
-  double checkpointGammaStart = timer->GetUniversalTime();
-  Gamma_dose_comparison gamma;
-  gamma.set_reference_image(referenceDose->itk_float());
-  gamma.set_compare_image(compareDose->itk_float());
-  if (maskSegmentationNode && maskSegmentID)
-  {
-    gamma.set_mask_image(maskVolume->itk_uchar());
+    // Compute gamma dose volume
+    checkpointGammaStart = timer->GetUniversalTime();
+    vtkSmartPointer<vtkGammaDoseComparisonFilter> gammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+    gammaFilter->SetReferenceDoseData(referenceDose);
+    gammaFilter->SetCompareDoseData(compareDose);
+    gammaFilter->SetMaskData(maskSegmentLabelmap);
+    gammaFilter->SetDtaDistanceToleranceMm(parameterNode->GetDtaDistanceToleranceMm());
+    gammaFilter->SetDoseDifferenceTolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+    gammaFilter->SetUseMaximumDose(parameterNode->GetUseMaximumDose());
+    gammaFilter->SetReferenceDoseGy(parameterNode->GetReferenceDoseGy());
+    gammaFilter->SetAnalysisThreshold(parameterNode->GetAnalysisThresholdPercent() / 100.0);
+    gammaFilter->SetMaximumGamma(parameterNode->GetMaximumGamma());
+    gammaFilter->SetLocalGamma(parameterNode->GetLocalDoseDifference());
+    gammaFilter->SetReferenceOnlyThreshold(parameterNode->GetDoseThresholdOnReferenceOnly());
+    gammaFilter->SetInterpolateSearch(parameterNode->GetUseSubVoxelSearch());
+    gammaFilter->SetPassFailOnly(parameterNode->GetPassFailOnly());
+    gammaFilter->SetComputeGammaImage(!summaryOnly);
+    vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+    progressCallback->SetCallback(GammaFilterProgressCallback);
+    progressCallback->SetClientData(this);
+    gammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+    if (!gammaFilter->Update())
+    {
+      std::string errorMessage("Gamma computation failed");
+      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+      return errorMessage;
+    }
+
+    parameterNode->SetPassFractionPercent( gammaFilter->GetPassFraction() * 100.0 );
+    parameterNode->SetMeanGamma(gammaFilter->GetMeanGamma());
+    parameterNode->SetMaxGamma(gammaFilter->GetMaxGamma());
+    std::stringstream reportStream;
+    reportStream << "Reference dose: " << gammaFilter->GetAppliedReferenceDoseGy() << " Gy" << std::endl
+      << "Number of analyzed voxels: " << gammaFilter->GetNumberOfAnalyzedVoxels() << std::endl
+      << "Number of passed voxels: " << gammaFilter->GetNumberOfPassedVoxels() << std::endl
+      << "Pass rate: " << gammaFilter->GetPassFraction() * 100.0 << " %" << std::endl
+      << "Mean gamma: " << gammaFilter->GetMeanGamma() << std::endl
+      << "Maximum gamma: " << gammaFilter->GetMaxGamma() << std::endl;
+    parameterNode->SetReportString(reportStream.str().c_str());
+
+    // Set histogram to table node
+    vtkMRMLTableNode* histogramTableNode = parameterNode->GetGammaHistogramTableNode();
+    if (histogramTableNode)
+    {
+      vtkTable* histogram = gammaFilter->GetOutputHistogram();
+      vtkDataArray* bins = vtkDataArray::SafeDownCast(histogram->GetColumnByName("Bins"));
+      vtkDataArray* frequencies = vtkDataArray::SafeDownCast(histogram->GetColumnByName("Frequencies"));
+      vtkIdType numberOfAnalyzedVoxels = gammaFilter->GetNumberOfAnalyzedVoxels();
+
+      histogramTableNode->SetUseColumnNameAsColumnHeader(true);
+      histogramTableNode->RemoveAllColumns();
+      vtkDoubleArray* gammaColumn = vtkDoubleArray::SafeDownCast(histogramTableNode->AddColumn(vtkSmartPointer<vtkDoubleArray>::New()));
+      gammaColumn->SetName("Gamma");
+      vtkDoubleArray* voxelCountColumn = vtkDoubleArray::SafeDownCast(histogramTableNode->AddColumn(vtkSmartPointer<vtkDoubleArray>::New()));
+      voxelCountColumn->SetName("Number of voxels");
+      vtkDoubleArray* voxelPercentColumn = vtkDoubleArray::SafeDownCast(histogramTableNode->AddColumn(vtkSmartPointer<vtkDoubleArray>::New()));
+      voxelPercentColumn->SetName("Percent of analyzed voxels");
+      for (vtkIdType binIndex=0; binIndex<bins->GetNumberOfTuples(); ++binIndex)
+      {
+        double voxelCount = frequencies->GetTuple1(binIndex);
+        gammaColumn->InsertNextValue(bins->GetTuple1(binIndex));
+        voxelCountColumn->InsertNextValue(voxelCount);
+        voxelPercentColumn->InsertNextValue(numberOfAnalyzedVoxels > 0 ? voxelCount * 100.0 / numberOfAnalyzedVoxels : 0.0);
+      }
+
+      // Trigger UI update
+      histogramTableNode->Modified();
+    }
+
+    if (summaryOnly)
+    {
+      parameterNode->ResultsValidOn();
+      if (this->LogSpeedMeasurements)
+      {
+        double checkpointEnd = timer->GetUniversalTime();
+        std::cout << "Total gamma summary computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
+                  << "\tConverting inputs: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
+                  << "\tGamma computation: " << checkpointEnd-checkpointGammaStart << " s" << std::endl;
+      }
+      return "";
+    }
+
+    // Set output to gamma volume node. The geometry of the oriented image data is stored in the IJK to RAS matrix
+    checkpointVtkConvertStart = timer->GetUniversalTime();
+    vtkOrientedImageData* gammaImage = gammaFilter->GetOutput();
+    vtkSmartPointer<vtkMatrix4x4> gammaIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    gammaImage->GetImageToWorldMatrix(gammaIjkToRasMatrix);
+    vtkSmartPointer<vtkImageData> gammaImageData = vtkSmartPointer<vtkImageData>::New();
+    gammaImageData->ShallowCopy(gammaImage);
+    gammaImageData->SetOrigin(0.0, 0.0, 0.0);
+    gammaImageData->SetSpacing(1.0, 1.0, 1.0);
+    gammaVolumeNode->SetIJKToRASMatrix(gammaIjkToRasMatrix);
+    gammaVolumeNode->SetAndObserveImageData(gammaImageData);
   }
-  gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
-  gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
-  gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
-  gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
-  if (!parameterNode->GetUseMaximumDose())
+  else
   {
-    gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
-  }
-  gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
-  gamma.set_gamma_max(parameterNode->GetMaximumGamma());
-  gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
-  gamma.set_progress_callback(&GammaProgressCallback);
+    vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
+    Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode, true, true);
+    Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode(), true, true);
 
-  gamma.run();
+    // Convert mask to Plm image (the labelmap belongs to the segmentation copy, so it can be shared)
+    Plm_image::Pointer maskVolume;
+    if (maskSegmentLabelmap)
+    {
+      maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap, true);
+      if (!maskVolume)
+      {
+        std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
+        vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+        return errorMessage;
+      }
+    }
 
-  itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
-  parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
-  parameterNode->SetReportString(gamma.get_report_string().c_str());
+    // Compute gamma dose volume
+    checkpointGammaStart = timer->GetUniversalTime();
+    Gamma_dose_comparison gamma;
+    gamma.set_reference_image(referenceDose->itk_float());
+    gamma.set_compare_image(compareDose->itk_float());
+    if (maskVolume)
+    {
+      gamma.set_mask_image(maskVolume->itk_uchar());
+    }
+    gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
+    gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+    gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
+    gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
+    if (!parameterNode->GetUseMaximumDose())
+    {
+      gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
+    }
+    gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
+    gamma.set_gamma_max(parameterNode->GetMaximumGamma());
+    gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
+    gamma.set_progress_callback(&GammaProgressCallback);
 
-  // Convert output to VTK
-  double checkpointVtkConvertStart = timer->GetUniversalTime();
+    gamma.run();
 
-  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
-  if (gammaVolumeNode == NULL)
-  {
-    std::string errorMessage("Invalid gamma volume node in parameter set node");
-    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-    return errorMessage;
+    itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
+    parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
+    parameterNode->SetReportString(gamma.get_report_string().c_str());
+
+    // Convert output to VTK
+    checkpointVtkConvertStart = timer->GetUniversalTime();
+    vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT, true, true);
   }
 
-  vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
   gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
 
   // Set default colormap to red
@@ -363,9 +520,9 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     double checkpointEnd = timer->GetUniversalTime();
     std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
               << "\tApplying transforms: " << checkpointConvertStart-checkpointStart << " s" << std::endl
-              << "\tConverting from VTK to ITK: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
-              << "\tGamma computation: " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
-              << "\tConverting back from ITK to VTK: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
+              << "\tConverting inputs: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
+              << "\tGamma computation (" << (parameterNode->GetUseNativeGammaEngine() ? "native" : "plastimatch") << "): " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
+              << "\tConverting output: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
   }
 
   return "";
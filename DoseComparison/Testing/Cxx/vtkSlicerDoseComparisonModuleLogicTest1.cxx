@@ -30,12 +30,15 @@
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -43,6 +46,9 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <cmath>
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
 {
@@ -153,6 +159,34 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
 
   // Compute DoseAccumulation
   doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  double plastimatchPassFractionPercent = paramNode->GetPassFractionPercent();
+
+  // Compute gamma with the native engine into another volume
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> outputNativeGammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  outputNativeGammaVolumeNode->SetName("OutputDoseNative");
+  mrmlScene->AddNode(outputNativeGammaVolumeNode);
+  vtkSmartPointer<vtkMRMLDoseComparisonNode> nativeParamNode = vtkSmartPointer<vtkMRMLDoseComparisonNode>::New();
+  mrmlScene->AddNode(nativeParamNode);
+  nativeParamNode->SetAndObserveReferenceDoseVolumeNode(day1DoseScalarVolumeNode);
+  nativeParamNode->SetAndObserveCompareDoseVolumeNode(day2DoseScalarVolumeNode);
+  nativeParamNode->SetAndObserveGammaVolumeNode(outputNativeGammaVolumeNode);
+  nativeParamNode->SetDoseThresholdOnReferenceOnly(true);
+  nativeParamNode->UseNativeGammaEngineOn();
+  doseComparisonLogic->ComputeGammaDoseDifference(nativeParamNode);
+
+  // Compute gamma summary only (pass/fail) without creating a gamma volume
+  vtkSmartPointer<vtkMRMLTableNode> gammaHistogramTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  gammaHistogramTableNode->SetName("GammaHistogram");
+  mrmlScene->AddNode(gammaHistogramTableNode);
+  vtkSmartPointer<vtkMRMLDoseComparisonNode> summaryParamNode = vtkSmartPointer<vtkMRMLDoseComparisonNode>::New();
+  mrmlScene->AddNode(summaryParamNode);
+  summaryParamNode->SetAndObserveReferenceDoseVolumeNode(day1DoseScalarVolumeNode);
+  summaryParamNode->SetAndObserveCompareDoseVolumeNode(day2DoseScalarVolumeNode);
+  summaryParamNode->SetAndObserveGammaHistogramTableNode(gammaHistogramTableNode);
+  summaryParamNode->SetDoseThresholdOnReferenceOnly(true);
+  summaryParamNode->SummaryOnlyOn();
+  summaryParamNode->PassFailOnlyOn();
+  doseComparisonLogic->ComputeGammaDoseDifference(summaryParamNode);
 
   // Get saved volume
   vtkSmartPointer<vtkCollection> gammaVolumeNodes = vtkSmartPointer<vtkCollection>::Take(
@@ -182,5 +216,102 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // The native engine is compared to the baseline on every analyzed voxel. The two engines do not round identically,
+  // so the gamma values may differ slightly, but every voxel has to pass or fail in both.
+  const double gammaDifferenceTolerance = 1.0e-3;
+  if ( !summaryParamNode->GetResultsValid()
+    || summaryParamNode->GetPassFractionPercent() != nativeParamNode->GetPassFractionPercent() )
+  {
+    errorStream << "ERROR: Summary gamma pass fraction (" << summaryParamNode->GetPassFractionPercent()
+      << "%) differs from the full computation (" << nativeParamNode->GetPassFractionPercent() << "%)!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (gammaHistogramTableNode->GetNumberOfRows() == 0)
+  {
+    errorStream << "ERROR: Gamma histogram table is empty!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int nativeDimensions[3] = {0, 0, 0};
+  int baselineDimensions[3] = {0, 0, 0};
+  int referenceDoseDimensions[3] = {0, 0, 0};
+  outputNativeGammaVolumeNode->GetImageData()->GetDimensions(nativeDimensions);
+  baselineGammaVolumeNode->GetImageData()->GetDimensions(baselineDimensions);
+  day1DoseScalarVolumeNode->GetImageData()->GetDimensions(referenceDoseDimensions);
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (nativeDimensions[axis] != baselineDimensions[axis] || nativeDimensions[axis] != referenceDoseDimensions[axis])
+    {
+      errorStream << "ERROR: Native gamma volume dimensions differ from the baseline or the reference dose!" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Analyzed voxels are the ones with reference dose above the threshold (the dose threshold is on reference only)
+  vtkDataArray* referenceDoseArray = day1DoseScalarVolumeNode->GetImageData()->GetPointData()->GetScalars();
+  double referenceDoseRange[2] = {0.0, 0.0};
+  referenceDoseArray->GetRange(referenceDoseRange);
+  double appliedReferenceDoseGy = (nativeParamNode->GetUseMaximumDose() ? referenceDoseRange[1] : nativeParamNode->GetReferenceDoseGy());
+  double thresholdDose = nativeParamNode->GetAnalysisThresholdPercent() / 100.0 * appliedReferenceDoseGy;
+
+  vtkDataArray* nativeGammaArray = outputNativeGammaVolumeNode->GetImageData()->GetPointData()->GetScalars();
+  vtkDataArray* baselineGammaArray = baselineGammaVolumeNode->GetImageData()->GetPointData()->GetScalars();
+  int numberOfAnalyzedVoxels = 0;
+  int numberOfPassDifferences = 0;
+  double maximumGammaDifference = 0.0;
+  vtkIdType maximumGammaDifferenceVoxelIndex = -1;
+  for (vtkIdType voxelIndex=0; voxelIndex<nativeGammaArray->GetNumberOfTuples(); ++voxelIndex)
+  {
+    double nativeGamma = nativeGammaArray->GetTuple1(voxelIndex);
+    if (referenceDoseArray->GetTuple1(voxelIndex) < thresholdDose)
+    {
+      if (nativeGamma != 0.0)
+      {
+        errorStream << "ERROR: Native gamma is not zero at voxel " << voxelIndex << " excluded from the analysis!" << std::endl;
+        return EXIT_FAILURE;
+      }
+      continue;
+    }
+    ++numberOfAnalyzedVoxels;
+    double baselineGamma = baselineGammaArray->GetTuple1(voxelIndex);
+    if ((nativeGamma <= 1.0) != (baselineGamma <= 1.0))
+    {
+      ++numberOfPassDifferences;
+    }
+    if (fabs(nativeGamma - baselineGamma) > maximumGammaDifference)
+    {
+      maximumGammaDifference = fabs(nativeGamma - baselineGamma);
+      maximumGammaDifferenceVoxelIndex = voxelIndex;
+    }
+  }
+  if (numberOfAnalyzedVoxels == 0)
+  {
+    errorStream << "ERROR: No voxels are analyzed!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  outputStream << "Maximum gamma difference of native and baseline engines on " << numberOfAnalyzedVoxels << " analyzed voxels: "
+    << maximumGammaDifference << std::endl;
+  if (maximumGammaDifference > gammaDifferenceTolerance)
+  {
+    errorStream << "ERROR: Difference of native and baseline gamma (" << maximumGammaDifference << ") at voxel "
+      << maximumGammaDifferenceVoxelIndex << " exceeds tolerance!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (numberOfPassDifferences > 0)
+  {
+    errorStream << "ERROR: " << numberOfPassDifferences << " voxels pass in one engine and fail in the other!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Pass fractions have to match exactly, that is the same number of voxels pass. The tolerance only
+  // allows for the rounding of the percentages, which is far below one voxel.
+  double passFractionTolerancePercent = 100.0 / numberOfAnalyzedVoxels * 1.0e-3;
+  if ( !nativeParamNode->GetResultsValid()
+    || fabs(nativeParamNode->GetPassFractionPercent() - plastimatchPassFractionPercent) > passFractionTolerancePercent )
+  {
+    errorStream << "ERROR: Native gamma pass fraction (" << nativeParamNode->GetPassFractionPercent()
+      << "%) differs from the plastimatch one (" << plastimatchPassFractionPercent << "%)!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
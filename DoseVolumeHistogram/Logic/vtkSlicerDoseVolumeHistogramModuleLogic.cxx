@@ -25,6 +25,8 @@
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 #include "vtkFractionalImageAccumulate.h"
+#include "vtkMultiStructureImageAccumulate.h"
+#include "vtkSlicerRtTaskPool.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -48,6 +50,7 @@
 #include <vtkMRMLLayoutNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
 #include <vtkEventBroker.h>
 
 // VTK includes
@@ -68,11 +71,13 @@
 #include <vtkDelimitedTextWriter.h>
 #include <vtkWeakPointer.h>
 #include <vtkFieldData.h>
+#include <vtkGeneralTransform.h>
 
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
 // STD includes
+#include <algorithm>
 #include <set>
 
 //----------------------------------------------------------------------------
@@ -99,6 +104,68 @@ const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseVolumeHistogramModuleLogic);
 
+//---------------------------------------------------------------------------
+struct vtkSlicerDoseVolumeHistogramModuleLogic::SegmentDvhTask
+{
+  SegmentDvhTask()
+    : Logic(NULL)
+    , AutomaticOversampling(false)
+    , UseFractionalLabelmap(false)
+    , ResamplingRequired(false)
+    , IsDoseVolume(false)
+    , ComputeStatistics(true)
+    , DoseVolumeMaxDose(0.0)
+    , VolumeCc(0.0)
+    , MeanDose(0.0)
+    , MinDose(0.0)
+    , MaxDose(0.0)
+    , ComputationTime(0.0)
+  {
+  }
+
+  // Inputs (set up on the main thread)
+  vtkSlicerDoseVolumeHistogramModuleLogic* Logic;
+  std::string SegmentID;
+  /// Labelmap of the segment in the temporary segmentation copy. Modified in place during the computation
+  vtkSmartPointer<vtkOrientedImageData> SegmentLabelmap;
+  vtkSmartPointer<vtkOrientedImageData> DoseVolume;
+  /// Dose volume resampled with the fixed oversampling factor, NULL if automatic oversampling is used
+  vtkSmartPointer<vtkOrientedImageData> FixedOversampledDoseVolume;
+  /// Transform from segmentation to world, NULL if the segmentation is not transformed
+  vtkSmartPointer<vtkGeneralTransform> SegmentationToWorldTransform;
+  bool AutomaticOversampling;
+  bool UseFractionalLabelmap;
+  bool ResamplingRequired;
+  bool IsDoseVolume;
+  /// If false, then only the segment labelmap is prepared, and the statistics are computed for all segments in one pass
+  bool ComputeStatistics;
+  /// Maximum dose in the whole dose volume, determining the number of DVH bins
+  double DoseVolumeMaxDose;
+
+  // Results
+  std::string ErrorMessage;
+  double VolumeCc;
+  double MeanDose;
+  double MinDose;
+  double MaxDose;
+  /// DVH plot values as (dose, volume percent) pairs
+  std::vector<double> DvhValues;
+  double ComputationTime;
+};
+
+//---------------------------------------------------------------------------
+struct vtkSlicerDoseVolumeHistogramModuleLogic::SegmentDvhTaskList
+{
+  SegmentDvhTaskList()
+    : Logic(NULL)
+    , Tasks(NULL)
+  {
+  }
+
+  vtkSlicerDoseVolumeHistogramModuleLogic* Logic;
+  std::vector<SegmentDvhTask>* Tasks;
+};
+
 //---------------------------------------------------------------------------
 class vtkDoseVolumeHistogramEventCallbackCommand : public vtkCallbackCommand
 {
@@ -121,6 +188,7 @@ vtkSlicerDoseVolumeHistogramModuleLogic::vtkSlicerDoseVolumeHistogramModuleLogic
   this->DefaultDoseVolumeOversamplingFactor = 2.0;
 
   this->LogSpeedMeasurements = false;
+  this->NumberOfThreads = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -322,100 +390,84 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     }
   }
 
-  // Compute DVH for each selected segment
-  int counter = 1; // Start at one so that progress can reach 100%
-  int numberOfSelectedSegments = segmentationCopy->GetNumberOfSegments();
-  for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt, ++counter)
+  // If all segment labelmaps are padded to the geometry of the same oversampled dose volume and have the same
+  // DVH bins, then the histograms of all the segments can be computed in one pass over the dose volume
+  bool useSinglePassHistogram = !useFractionalLabelmap && !parameterNode->GetAutomaticOversampling()
+    && vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode) && this->StartValue > 0.0 && this->StepSize > 0.0;
+
+  // Assemble DVH task for each selected segment.
+  // Each task gets its own shallow copies of the input images so that no data object is shared between the
+  // pipelines running on different threads. MRML is only accessed here and when storing the results.
+  bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
+  std::vector<SegmentDvhTask> tasks(segmentIDs.size());
+  for (unsigned int taskIndex=0; taskIndex<segmentIDs.size(); ++taskIndex)
   {
-    std::string segmentID = *segmentIdIt;
-    vtkSegment* segment = segmentationCopy->GetSegment(*segmentIdIt);
-  
+    SegmentDvhTask& task = tasks[taskIndex];
+    task.Logic = this;
+    task.SegmentID = segmentIDs[taskIndex];
+
     // Get segment labelmap
-    vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
-      representationName ) );
+    vtkSegment* segment = segmentationCopy->GetSegment(task.SegmentID);
+    vtkOrientedImageData* segmentLabelmap = (segment ? vtkOrientedImageData::SafeDownCast(segment->GetRepresentation(representationName)) : NULL);
     if (!segmentLabelmap)
     {
       std::string errorMessage("Failed to get labelmap for segments");
       vtkErrorMacro("ComputeDvh: " << errorMessage);
       return errorMessage;
     }
+    task.SegmentLabelmap = segmentLabelmap;
 
-    double minimumValue = 0.0;
-    vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
-      segmentLabelmap->GetFieldData()->GetAbstractArray(vtkSegmentationConverter::GetScalarRangeFieldName()));
-    if (scalarRange && scalarRange->GetNumberOfValues() == 2)
+    task.DoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+    task.DoseVolume->ShallowCopy(doseImageData);
+    if (fixedOversampledDoseVolume.GetPointer())
     {
-      minimumValue = scalarRange->GetValue(0);
+      task.FixedOversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+      task.FixedOversampledDoseVolume->ShallowCopy(fixedOversampledDoseVolume);
     }
 
-    // Apply parent transformation nodes if necessary
+    // Get transform to apply on the segment labelmap if the segmentation is transformed.
+    // Each task gets its own transform object, as transforms are updated lazily, which is not thread-safe
     if (segmentationNode->GetParentTransformNode())
     {
-      double backgroundValue[4] = {minimumValue, minimumValue, minimumValue, 0.0};
-      if (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, segmentLabelmap, useFractionalLabelmap, backgroundValue))
-      {
-        std::string errorMessage("Failed to apply parent transformation to segment");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
-      }
-      resamplingRequired = true;
+      task.SegmentationToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+      segmentationNode->GetParentTransformNode()->GetTransformToWorld(task.SegmentationToWorldTransform);
     }
-    // Resample labelmap if necessary (if it was master, and could not be re-converted using the oversampled geometry, or if there was a parent transform)
-    if (resamplingRequired)
-    {
 
-      // Resample segmentation labelmap volume
-      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        segmentLabelmap, fixedOversampledDoseVolume, segmentLabelmap, useFractionalLabelmap, false, NULL, minimumValue ) )
-      {
-        std::string errorMessage("Failed to resample segment binary labelmap");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
-      }
-    }
+    task.AutomaticOversampling = parameterNode->GetAutomaticOversampling();
+    task.UseFractionalLabelmap = useFractionalLabelmap;
+    task.ResamplingRequired = resamplingRequired;
+    task.IsDoseVolume = isDoseVolume;
+    task.DoseVolumeMaxDose = maxDose;
+    task.ComputeStatistics = !useSinglePassHistogram;
+  }
 
-    // Get oversampled dose volume
-    vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume;
-    // Use the same resampled dose volume if oversampling is fixed
-    if (!parameterNode->GetAutomaticOversampling())
-    {
-      oversampledDoseVolume = fixedOversampledDoseVolume;
-    }
-    // Resample dose volume to match automatically oversampled segment labelmap geometry
-    else
-    {
-      oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
-      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        doseImageData, segmentLabelmap, oversampledDoseVolume, true ) )
-      {
-        std::string errorMessage("Failed to resample dose volume");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
-      }
-    }
+  // Compute DVH for each selected segment.
+  // The computation of the segments is independent, so it can be done in parallel
+  SegmentDvhTaskList taskList;
+  taskList.Logic = this;
+  taskList.Tasks = &tasks;
+  vtkSmartPointer<vtkSlicerRtTaskPool> taskPool = vtkSmartPointer<vtkSlicerRtTaskPool>::New();
+  taskPool->SetNumberOfThreads(this->NumberOfThreads);
+  taskPool->SetTaskFunction(vtkSlicerDoseVolumeHistogramModuleLogic::ComputeSegmentDvhTaskFunction, &taskList);
+  taskPool->SetProgressFunction(vtkSlicerDoseVolumeHistogramModuleLogic::ReportSegmentDvhProgress, &taskList);
+  taskPool->Execute((int)tasks.size());
 
-    // Make sure the segment labelmap is the same dimension as the dose volume
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(segmentLabelmap);
-    padder->SetConstant(minimumValue);
-    int extent[6] = {0,-1,0,-1,0,-1};
-    oversampledDoseVolume->GetExtent(extent);
-    padder->SetOutputWholeExtent(extent);
-    padder->Update();
-    segmentLabelmap->vtkImageData::DeepCopy(padder->GetOutput());
-
-    // Calculate DVH for current segment
-    std::string errorMessage = this->ComputeDvh(parameterNode, segmentLabelmap, oversampledDoseVolume, segmentID, maxDose);
+  if (useSinglePassHistogram)
+  {
+    this->ComputeDvhInSinglePass(tasks, fixedOversampledDoseVolume);
+  }
+
+  // Store results in MRML in the order of the selected segments, so that the
+  // metrics table rows and the created nodes are the same as in serial computation
+  for (std::vector<SegmentDvhTask>::iterator taskIt = tasks.begin(); taskIt != tasks.end(); ++taskIt)
+  {
+    std::string errorMessage = this->StoreSegmentDvh(parameterNode, &(*taskIt));
     if (!errorMessage.empty())
     {
       vtkErrorMacro("ComputeDvh: " << errorMessage);
       return errorMessage;
     }
-
-    // Update progress bar
-    double progress = (double)counter / (double)numberOfSelectedSegments;
-    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
-  } // For each segment
+  }
 
   // Fire only one modified event when the computation is done
   this->SetDisableModifiedEvent(0);
@@ -431,39 +483,102 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
 }
 
 //---------------------------------------------------------------------------
-std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume, std::string segmentID, double maxDoseGy)
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeSegmentDvhTaskFunction(void* userData, int taskIndex)
 {
-  if (!this->GetMRMLScene() || !parameterNode)
+  SegmentDvhTaskList* taskList = static_cast<SegmentDvhTaskList*>(userData);
+  taskList->Logic->ComputeSegmentDvh(&(*taskList->Tasks)[taskIndex]);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ReportSegmentDvhProgress(void* userData, int numberOfCompletedTasks, int numberOfTasks)
+{
+  SegmentDvhTaskList* taskList = static_cast<SegmentDvhTaskList*>(userData);
+  double progress = (numberOfTasks > 0 ? (double)numberOfCompletedTasks / (double)numberOfTasks : 1.0);
+  taskList->Logic->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeSegmentDvh(SegmentDvhTask* task)
+{
+  if (!task || !task->SegmentLabelmap.GetPointer() || !task->DoseVolume.GetPointer())
   {
-    std::string errorMessage("Invalid MRML scene or parameter set node");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    if (task)
+    {
+      task->ErrorMessage = "Invalid segment labelmap or dose volume";
+    }
+    return;
   }
-  if (!segmentLabelmap)
+
+  double checkpointStart = vtkTimerLog::GetUniversalTime();
+
+  vtkOrientedImageData* segmentLabelmap = task->SegmentLabelmap;
+  bool useFractionalLabelmap = task->UseFractionalLabelmap;
+
+  double minimumValue = 0.0;
+  double maximumValue = 1.0;
+  vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
+    segmentLabelmap->GetFieldData()->GetAbstractArray(vtkSegmentationConverter::GetScalarRangeFieldName()));
+  if (scalarRange && scalarRange->GetNumberOfValues() == 2)
   {
-    std::string errorMessage("Invalid segment labelmap");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    minimumValue = scalarRange->GetValue(0);
+    maximumValue = scalarRange->GetValue(1);
   }
-  if (!oversampledDoseVolume)
+
+  // Apply parent transformation if necessary
+  bool resamplingRequired = task->ResamplingRequired;
+  if (task->SegmentationToWorldTransform.GetPointer())
   {
-    std::string errorMessage("Invalid oversampled dose volume");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    double backgroundValue[4] = {minimumValue, minimumValue, minimumValue, 0.0};
+    vtkOrientedImageDataResample::TransformOrientedImage(segmentLabelmap, task->SegmentationToWorldTransform, false, false, useFractionalLabelmap, backgroundValue);
+    resamplingRequired = true;
   }
-  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
-  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
-  if ( !segmentationNode || !doseVolumeNode )
+  // Resample labelmap if necessary (if it was master, and could not be re-converted using the oversampled geometry, or if there was a parent transform)
+  if (resamplingRequired)
   {
-    std::string errorMessage("Both segmentation node and dose volume node need to be set");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    // Resample segmentation labelmap volume
+    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      segmentLabelmap, task->FixedOversampledDoseVolume, segmentLabelmap, useFractionalLabelmap, false, NULL, minimumValue ) )
+    {
+      task->ErrorMessage = "Failed to resample segment binary labelmap";
+      return;
+    }
+  }
+
+  // Get oversampled dose volume
+  vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume;
+  // Use the same resampled dose volume if oversampling is fixed
+  if (!task->AutomaticOversampling)
+  {
+    oversampledDoseVolume = task->FixedOversampledDoseVolume;
+  }
+  // Resample dose volume to match automatically oversampled segment labelmap geometry
+  else
+  {
+    oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      task->DoseVolume, segmentLabelmap, oversampledDoseVolume, true ) )
+    {
+      task->ErrorMessage = "Failed to resample dose volume";
+      return;
+    }
   }
-  std::string segmentName = parameterNode->GetSegmentationNode()->GetSegmentation()->GetSegment(segmentID)->GetName();
 
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  double checkpointStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
+  // Make sure the segment labelmap is the same dimension as the dose volume
+  vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+  padder->SetInputData(segmentLabelmap);
+  padder->SetConstant(minimumValue);
+  int extent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseVolume->GetExtent(extent);
+  padder->SetOutputWholeExtent(extent);
+  padder->Update();
+  segmentLabelmap->vtkImageData::DeepCopy(padder->GetOutput());
+
+  // Statistics are computed together for all segments in ComputeDvhInSinglePass
+  if (!task->ComputeStatistics)
+  {
+    task->ComputationTime = vtkTimerLog::GetUniversalTime() - checkpointStart;
+    return;
+  }
 
   // Create stencil for structure
   vtkNew<vtkImageToImageStencil> stencil;
@@ -473,19 +588,6 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   // So, we have to choose >=epsilon (epsilon is a very small positive number).
   // How small the number is has a significance when the segmentLabelmap is a floating-point image,
   // which is a rare scenario, but may still happen.
-  double minimumValue = 0.0;
-  double maximumValue = 1.0;
-  segmentLabelmap->GetFieldData();
-  vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
-    segmentLabelmap->GetFieldData()->GetAbstractArray( vtkSegmentationConverter::GetScalarRangeFieldName() )
-    );
-  if (scalarRange && scalarRange->GetNumberOfValues() == 2)
-  {
-    minimumValue = scalarRange->GetValue(0);
-    maximumValue = scalarRange->GetValue(1);
-  }
-
-  bool useFractionalLabelmap = parameterNode->GetUseFractionalLabelmap();
   if (useFractionalLabelmap)
   {
     stencil->ThresholdByUpper(minimumValue + 1e-10);
@@ -503,9 +605,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   structureStencil->GetExtent(stencilExtent);
   if (stencilExtent[1]-stencilExtent[0] <= 0 || stencilExtent[3]-stencilExtent[2] <= 0 || stencilExtent[5]-stencilExtent[4] <= 0)
   {
-    std::string errorMessage("Invalid stenciled dose volume");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    task->ErrorMessage = "Invalid stenciled dose volume";
+    return;
   }
 
   // Compute statistics
@@ -529,98 +630,29 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   // Report error if there are no voxels in the stenciled dose volume (no non-zero voxels in the resampled labelmap)
   if (structureStat->GetVoxelCount() < 1)
   {
-    std::string errorMessage("Dose volume and the structure do not overlap"); // User-friendly error to help troubleshooting
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
-  }
-
-  // Get metrics table for the parameter node; Create one if missing
-  vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
-  vtkTable* metricsTable = metricsTableNode->GetTable();
-  // Setup table if empty
-  if (metricsTable->GetNumberOfColumns() == 0)
-  {
-    this->InitializeMetricsTable(parameterNode);
-  }
-
-  // Get DVH array node for the inputs (dose volume, segmentation, segment).
-  // If found, then it gets overwritten by the new computation, otherwise
-  std::string structureDvhNodeRef = parameterNode->AssembleDvhNodeReference(segmentID);
-  vtkMRMLDoubleArrayNode* arrayNode = vtkMRMLDoubleArrayNode::SafeDownCast(metricsTableNode->GetNodeReference(structureDvhNodeRef.c_str()));
-  int tableRow = -1;
-  if (!arrayNode)
-  {
-    arrayNode = vtkMRMLDoubleArrayNode::New();
-    std::string dvhArrayNodeName = segmentID + DVH_ARRAY_NODE_NAME_POSTFIX;
-    dvhArrayNodeName = this->GetMRMLScene()->GenerateUniqueName(dvhArrayNodeName);
-    arrayNode->SetName(dvhArrayNodeName.c_str());
-    arrayNode->SetAttribute(DVH_DVH_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
-    this->GetMRMLScene()->AddNode(arrayNode);
-    tableRow = metricsTable->GetNumberOfRows();
-    std::stringstream ss;
-    ss << tableRow;
-    arrayNode->SetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str(), ss.str().c_str());
-    arrayNode->Delete(); // Release ownership to scene only
-    metricsTable->InsertNextBlankRow();
-
-    // Set node references
-    metricsTableNode->SetNodeReferenceID(structureDvhNodeRef.c_str(), arrayNode->GetID());
-    arrayNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::DOSE_VOLUME_REFERENCE_ROLE, doseVolumeNode->GetID());
-    arrayNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::SEGMENTATION_REFERENCE_ROLE, segmentationNode->GetID());
-    arrayNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::DVH_METRICS_TABLE_REFERENCE_ROLE, metricsTableNode->GetID());
-  }
-  else if (arrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str()))
-  {
-    tableRow = vtkVariant(arrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str())).ToInt();
-  }
-  else
-  {
-    std::string errorMessage("Failed to find metrics table row for structure " + segmentName);
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    task->ErrorMessage = "Dose volume and the structure do not overlap"; // User-friendly error to help troubleshooting
+    return;
   }
 
-  // Set array node attributes:
-  // Structure name and segment color for visualization in the chart view
-  arrayNode->SetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str(), segmentID.c_str());
-  // Oversampling factor
-  std::ostringstream oversamplingAttrValueStream;
-  oversamplingAttrValueStream << (parameterNode->GetAutomaticOversampling() ? (-1.0) : this->DefaultDoseVolumeOversamplingFactor);
-  arrayNode->SetAttribute(DVH_DOSE_VOLUME_OVERSAMPLING_FACTOR_ATTRIBUTE_NAME.c_str(), oversamplingAttrValueStream.str().c_str());
-
   // Get spacing and voxel volume
   double* segmentLabelmapSpacing = segmentLabelmap->GetSpacing();
   double cubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
   double ccPerCubicMM = 0.001;
 
-  // Set default column values
-
-  // Structure name
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure, vtkVariant(segmentName));
-  // Volume name
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnDoseVolume, vtkVariant(doseVolumeNode->GetName()));
-  // Volume (cc) - save as attribute too (the DVH contains percentages that often need to be converted to volume)
-  double volumeCc = 0;
+  // Volume (cc)
+  double totalVoxels = 0;
   if (useFractionalLabelmap)
   {
-    volumeCc = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
+    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
   }
   else
   {
-    volumeCc = structureStat->GetVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
+    totalVoxels = structureStat->GetVoxelCount();
   }
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(volumeCc));
-  std::ostringstream attributeNameStream;
-  std::ostringstream attributeValueStream;
-  attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
-  attributeValueStream << volumeCc;
-  arrayNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
-  // Mean dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(structureStat->GetMean()[0]));
-  // Min dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(structureStat->GetMin()[0]));
-  // Max dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(structureStat->GetMax()[0]));
+  task->VolumeCc = totalVoxels * cubicMMPerVoxel * ccPerCubicMM;
+  task->MeanDose = structureStat->GetMean()[0];
+  task->MinDose = structureStat->GetMin()[0];
+  task->MaxDose = structureStat->GetMax()[0];
 
   // Create DVH plot values
   int numSamples = 0;
@@ -628,18 +660,17 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   double stepSize;
   double rangeMin = structureStat->GetMin()[0];
   double rangeMax = structureStat->GetMax()[0];
-  if (vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode))
+  if (task->IsDoseVolume)
   {
     if (rangeMin<0)
     {
-      std::string errorMessage("The dose volume contains negative dose values");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
+      task->ErrorMessage = "The dose volume contains negative dose values";
+      return;
     }
 
     startValue = this->StartValue;
     stepSize = this->StepSize;
-    numSamples = (int)ceil( (maxDoseGy-startValue)/stepSize ) + 1;
+    numSamples = (int)ceil( (task->DoseVolumeMaxDose-startValue)/stepSize ) + 1;
   }
   else
   {
@@ -669,52 +700,250 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   structureStat->SetComponentSpacing(stepSize,1,1);
   structureStat->Update();
 
-  vtkDoubleArray* doubleArray = arrayNode->GetArray();
-  doubleArray->SetNumberOfTuples(numSamples + (insertPointAtOrigin?1:0));
-
-  int outputArrayIndex=0;
+  task->DvhValues.clear();
+  task->DvhValues.reserve(2 * (numSamples+1));
 
   if (insertPointAtOrigin)
   {
     // Add first fixed point at (0.0, 100%)
-    doubleArray->SetComponent(outputArrayIndex, 0, 0.0);
-    doubleArray->SetComponent(outputArrayIndex, 1, 100.0);
-    doubleArray->SetComponent(outputArrayIndex, 2, 0);
-    ++outputArrayIndex;
+    task->DvhValues.push_back(0.0);
+    task->DvhValues.push_back(100.0);
   }
 
   vtkImageData* statArray = structureStat->GetOutput();
-  double totalVoxels = 0;
-  if (useFractionalLabelmap)
-  {
-    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
-  }
-  else
-  {
-    totalVoxels = structureStat->GetVoxelCount();
-  }
-
   for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
   {
     double voxelsInBin = statArray->GetScalarComponentAsDouble(sampleIndex,0,0,0);
-    doubleArray->SetComponent( outputArrayIndex, 0, startValue + sampleIndex * stepSize );
+    task->DvhValues.push_back(startValue + sampleIndex * stepSize);
     if (useFractionalLabelmap)
     {
-      doubleArray->SetComponent( outputArrayIndex, 1, std::max(0.0, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0) );
+      task->DvhValues.push_back(std::max(0.0, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0));
     }
     else
     {
-      doubleArray->SetComponent( outputArrayIndex, 1, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0 );
+      task->DvhValues.push_back((1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0);
     }
-    doubleArray->SetComponent( outputArrayIndex, 2, 0 );
-    ++outputArrayIndex;
     voxelBelowDose += voxelsInBin;
   }
 
   // Set the start of the first bin to 0 if the volume contains dose and the start value was negative
-  if (vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode) && !insertPointAtOrigin)
+  if (task->IsDoseVolume && !insertPointAtOrigin)
+  {
+    task->DvhValues[0] = 0.0;
+  }
+
+  task->ComputationTime = vtkTimerLog::GetUniversalTime() - checkpointStart;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvhInSinglePass(std::vector<SegmentDvhTask>& tasks, vtkOrientedImageData* oversampledDoseVolume)
+{
+  double checkpointStart = vtkTimerLog::GetUniversalTime();
+
+  int extent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseVolume->GetExtent(extent);
+  bool validExtent = (extent[1]-extent[0] > 0 && extent[3]-extent[2] > 0 && extent[5]-extent[4] > 0);
+
+  // Add labelmap of all the segments that were successfully prepared
+  int numSamples = (int)ceil( (tasks.empty() ? 0.0 : (tasks[0].DoseVolumeMaxDose-this->StartValue)/this->StepSize) ) + 1;
+  vtkSmartPointer<vtkMultiStructureImageAccumulate> structureStat = vtkSmartPointer<vtkMultiStructureImageAccumulate>::New();
+  structureStat->SetInputData(oversampledDoseVolume);
+  structureStat->SetHistogramOrigin(this->StartValue);
+  structureStat->SetHistogramSpacing(this->StepSize);
+  structureStat->SetNumberOfHistogramBins(std::max(1, numSamples));
+  std::vector<int> structureIndices(tasks.size(), -1);
+  for (unsigned int taskIndex=0; taskIndex<tasks.size(); ++taskIndex)
+  {
+    if (!tasks[taskIndex].ErrorMessage.empty())
+    {
+      continue;
+    }
+    if (!validExtent)
+    {
+      tasks[taskIndex].ErrorMessage = "Invalid stenciled dose volume";
+      continue;
+    }
+    structureIndices[taskIndex] = structureStat->AddStructureLabelmap(tasks[taskIndex].SegmentLabelmap);
+  }
+  if (structureStat->GetNumberOfStructures() == 0)
+  {
+    return;
+  }
+  if (!structureStat->Update())
+  {
+    for (unsigned int taskIndex=0; taskIndex<tasks.size(); ++taskIndex)
+    {
+      if (structureIndices[taskIndex] >= 0)
+      {
+        tasks[taskIndex].ErrorMessage = "Failed to compute dose statistics for the segments";
+      }
+    }
+    return;
+  }
+
+  // Get spacing and voxel volume (all segment labelmaps have the geometry of the oversampled dose)
+  double* spacing = oversampledDoseVolume->GetSpacing();
+  double cubicMMPerVoxel = spacing[0] * spacing[1] * spacing[2];
+  double ccPerCubicMM = 0.001;
+
+  vtkNew<vtkDoubleArray> cumulativeHistogram;
+  for (unsigned int taskIndex=0; taskIndex<tasks.size(); ++taskIndex)
+  {
+    int structureIndex = structureIndices[taskIndex];
+    if (structureIndex < 0)
+    {
+      continue;
+    }
+    SegmentDvhTask& task = tasks[taskIndex];
+
+    // Report error if there are no voxels in the segment
+    if (structureStat->GetVoxelCount(structureIndex) < 1)
+    {
+      task.ErrorMessage = "Dose volume and the structure do not overlap"; // User-friendly error to help troubleshooting
+      continue;
+    }
+
+    task.VolumeCc = structureStat->GetVoxelCount(structureIndex) * cubicMMPerVoxel * ccPerCubicMM;
+    task.MeanDose = structureStat->GetMean(structureIndex);
+    task.MinDose = structureStat->GetMin(structureIndex);
+    task.MaxDose = structureStat->GetMax(structureIndex);
+    if (task.MinDose < 0)
+    {
+      task.ErrorMessage = "The dose volume contains negative dose values";
+      continue;
+    }
+
+    // Create DVH plot values. Start value is positive, so the fixed point at (0.0, 100%) is always added
+    structureStat->GetCumulativeHistogram(structureIndex, cumulativeHistogram.GetPointer());
+    task.DvhValues.clear();
+    task.DvhValues.reserve(2 * (numSamples+1));
+    task.DvhValues.push_back(0.0);
+    task.DvhValues.push_back(100.0);
+    for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
+    {
+      task.DvhValues.push_back(this->StartValue + sampleIndex * this->StepSize);
+      task.DvhValues.push_back(cumulativeHistogram->GetValue(sampleIndex));
+    }
+  }
+
+  // Distribute time of the common computation among the segments for logging
+  double computationTimePerSegment = (vtkTimerLog::GetUniversalTime() - checkpointStart) / structureStat->GetNumberOfStructures();
+  for (unsigned int taskIndex=0; taskIndex<tasks.size(); ++taskIndex)
   {
-    doubleArray->SetComponent(0,0,0);
+    if (structureIndices[taskIndex] >= 0)
+    {
+      tasks[taskIndex].ComputationTime += computationTimePerSegment;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::StoreSegmentDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, SegmentDvhTask* task)
+{
+  if (!this->GetMRMLScene() || !parameterNode || !task)
+  {
+    std::string errorMessage("Invalid MRML scene, parameter set node, or segment DVH task");
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
+    return errorMessage;
+  }
+  if (!task->ErrorMessage.empty())
+  {
+    return task->ErrorMessage;
+  }
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if ( !segmentationNode || !doseVolumeNode )
+  {
+    std::string errorMessage("Both segmentation node and dose volume node need to be set");
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
+    return errorMessage;
+  }
+  std::string segmentID = task->SegmentID;
+  std::string segmentName = segmentationNode->GetSegmentation()->GetSegment(segmentID)->GetName();
+
+  // Get metrics table for the parameter node; Create one if missing
+  vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+  // Setup table if empty
+  if (metricsTable->GetNumberOfColumns() == 0)
+  {
+    this->InitializeMetricsTable(parameterNode);
+  }
+
+  // Get DVH array node for the inputs (dose volume, segmentation, segment).
+  // If found, then it gets overwritten by the new computation, otherwise
+  std::string structureDvhNodeRef = parameterNode->AssembleDvhNodeReference(segmentID);
+  vtkMRMLDoubleArrayNode* arrayNode = vtkMRMLDoubleArrayNode::SafeDownCast(metricsTableNode->GetNodeReference(structureDvhNodeRef.c_str()));
+  int tableRow = -1;
+  if (!arrayNode)
+  {
+    arrayNode = vtkMRMLDoubleArrayNode::New();
+    std::string dvhArrayNodeName = segmentID + DVH_ARRAY_NODE_NAME_POSTFIX;
+    dvhArrayNodeName = this->GetMRMLScene()->GenerateUniqueName(dvhArrayNodeName);
+    arrayNode->SetName(dvhArrayNodeName.c_str());
+    arrayNode->SetAttribute(DVH_DVH_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+    this->GetMRMLScene()->AddNode(arrayNode);
+    tableRow = metricsTable->GetNumberOfRows();
+    std::stringstream ss;
+    ss << tableRow;
+    arrayNode->SetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str(), ss.str().c_str());
+    arrayNode->Delete(); // Release ownership to scene only
+    metricsTable->InsertNextBlankRow();
+
+    // Set node references
+    metricsTableNode->SetNodeReferenceID(structureDvhNodeRef.c_str(), arrayNode->GetID());
+    arrayNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::DOSE_VOLUME_REFERENCE_ROLE, doseVolumeNode->GetID());
+    arrayNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::SEGMENTATION_REFERENCE_ROLE, segmentationNode->GetID());
+    arrayNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::DVH_METRICS_TABLE_REFERENCE_ROLE, metricsTableNode->GetID());
+  }
+  else if (arrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str()))
+  {
+    tableRow = vtkVariant(arrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str())).ToInt();
+  }
+  else
+  {
+    std::string errorMessage("Failed to find metrics table row for structure " + segmentName);
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Set array node attributes:
+  // Structure name and segment color for visualization in the chart view
+  arrayNode->SetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str(), segmentID.c_str());
+  // Oversampling factor
+  std::ostringstream oversamplingAttrValueStream;
+  oversamplingAttrValueStream << (parameterNode->GetAutomaticOversampling() ? (-1.0) : this->DefaultDoseVolumeOversamplingFactor);
+  arrayNode->SetAttribute(DVH_DOSE_VOLUME_OVERSAMPLING_FACTOR_ATTRIBUTE_NAME.c_str(), oversamplingAttrValueStream.str().c_str());
+
+  // Set default column values
+
+  // Structure name
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure, vtkVariant(segmentName));
+  // Volume name
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnDoseVolume, vtkVariant(doseVolumeNode->GetName()));
+  // Volume (cc) - save as attribute too (the DVH contains percentages that often need to be converted to volume)
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(task->VolumeCc));
+  std::ostringstream attributeNameStream;
+  std::ostringstream attributeValueStream;
+  attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
+  attributeValueStream << task->VolumeCc;
+  arrayNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
+  // Mean dose
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(task->MeanDose));
+  // Min dose
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(task->MinDose));
+  // Max dose
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(task->MaxDose));
+
+  // Copy DVH plot values into the array
+  vtkDoubleArray* doubleArray = arrayNode->GetArray();
+  int numberOfTuples = (int)(task->DvhValues.size() / 2);
+  doubleArray->SetNumberOfTuples(numberOfTuples);
+  for (int tupleIndex=0; tupleIndex<numberOfTuples; ++tupleIndex)
+  {
+    doubleArray->SetComponent(tupleIndex, 0, task->DvhValues[2*tupleIndex]);
+    doubleArray->SetComponent(tupleIndex, 1, task->DvhValues[2*tupleIndex+1]);
+    doubleArray->SetComponent(tupleIndex, 2, 0);
   }
 
   // Setup DVH subject hierarchy item
@@ -722,7 +951,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   if (!shNode)
   {
     std::string errorMessage("Failed to access subject hierarchy node");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
     return errorMessage;
   }
   vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
@@ -742,11 +971,9 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   doseVolumeNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), arrayNode->GetID());
 
   // Log measured time
-  double checkpointEnd = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
   if (this->LogSpeedMeasurements)
   {
-    vtkDebugMacro("ComputeDvh: DVH computation time for structure '" << segmentID << "': " << checkpointEnd-checkpointStart << " s");
+    vtkDebugMacro("StoreSegmentDvh: DVH computation time for structure '" << segmentID << "': " << task->ComputationTime << " s");
   }
 
   return "";
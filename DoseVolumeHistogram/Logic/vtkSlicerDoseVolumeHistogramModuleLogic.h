@@ -128,16 +128,37 @@ public:
   vtkSetMacro(LogSpeedMeasurements, bool);
   vtkBooleanMacro(LogSpeedMeasurements, bool);
 
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
 protected:
-  /// Compute DVH for the given structure segment with the stenciled dose volume
-  /// (the labelmap representation of a segment but with dose values instead of the labels)
+  /// Inputs and results of the DVH computation for one segment (defined in the implementation file)
+  struct SegmentDvhTask;
+  /// Segment DVH tasks processed by the task pool (defined in the implementation file)
+  struct SegmentDvhTaskList;
+
+  /// Compute DVH for the segment described in the task (resample and pad labelmap, stencil the dose volume, compute histogram and metrics).
+  /// Does not access the MRML scene so that it can be called from worker threads, the results are stored in the task.
+  /// \param task Segment DVH task containing the segment labelmap and the dose volume. Error message is set in the task on failure
+  void ComputeSegmentDvh(SegmentDvhTask* task);
+
+  /// Compute statistics and DVH values for all segments in one pass over the oversampled dose volume.
+  /// The segment labelmaps must have been prepared by \sa ComputeSegmentDvh (resampled and padded to the dose geometry).
+  /// \param tasks Segment DVH tasks. Results or error message are set in the tasks
+  /// \param oversampledDoseVolume Dose volume resampled with the fixed oversampling factor
+  void ComputeDvhInSinglePass(std::vector<SegmentDvhTask>& tasks, vtkOrientedImageData* oversampledDoseVolume);
+
+  /// Store the results of a segment DVH computation in MRML (DVH array node, metrics table row, references).
+  /// Must be called on the main thread.
   /// \param parameterNode Dose volume histogram parameter set node
-  /// \param segmentLabelmap Binary representation of the labelmap representation of the segment the DVH is calculated on
-  /// \param oversampledDoseVolume Dose volume resampled to match the geometry of the segment labelmap (to allow stenciling)
-  /// \param segmentID ID of segment the DVH is calculated on
-  /// \param maxDoseGy Maximum dose determining the number of DVH bins (passed as argument so that it is only calculated once in \sa ComputeDvh() )
+  /// \param task Segment DVH task that has been processed by \sa ComputeSegmentDvh
   /// \return Error message, empty string if no error
-  std::string ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume, std::string segmentID, double maxDoseGy);
+  std::string StoreSegmentDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, SegmentDvhTask* task);
+
+  /// Task pool function computing the DVH of one segment of a \sa SegmentDvhTaskList
+  static void ComputeSegmentDvhTaskFunction(void* userData, int taskIndex);
+  /// Task pool function reporting the progress of the segment DVH computation
+  static void ReportSegmentDvhProgress(void* userData, int numberOfCompletedTasks, int numberOfTasks);
 
   /// Return the chart view node object from the layout
   vtkMRMLChartViewNode* GetChartViewNode();
@@ -191,6 +212,10 @@ protected:
 
   /// Flag telling whether the speed measurements are logged on standard output
   bool LogSpeedMeasurements;
+
+  /// Number of threads computing the segment DVHs (see \sa vtkSlicerRtTaskPool). Default is 0 (all processor cores).
+  /// The results are identical regardless of the number of threads.
+  int NumberOfThreads;
 };
 
 #endif
@@ -0,0 +1,156 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRtCommon includes
+#include "vtkFractionalImageAccumulate.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkImageStencilData.h>
+#include <vtkImageToImageStencil.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  /// Maximum relative difference of the sums (mean, standard deviation, fractional voxel count) between the
+  /// vectorized and the scalar kernel. The vector lanes only change the order of the additions, which causes
+  /// differences in the order of the double precision rounding error.
+  const double RELATIVE_TOLERANCE = 1.0e-12;
+
+  //-----------------------------------------------------------------------------
+  bool IsRelativeDifferenceWithinTolerance(double value, double expectedValue)
+  {
+    double scale = std::max(fabs(expectedValue), 1.0);
+    return fabs(value - expectedValue) <= RELATIVE_TOLERANCE * scale;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Accumulate the dose with the given labelmap, with or without the vectorized kernels
+  vtkSmartPointer<vtkFractionalImageAccumulate> Accumulate(vtkImageData* doseImage, vtkImageData* fractionalLabelmap,
+    vtkImageStencilData* stencil, bool ignoreZero, bool useVectorizedKernels)
+  {
+    vtkSmartPointer<vtkFractionalImageAccumulate> accumulate = vtkSmartPointer<vtkFractionalImageAccumulate>::New();
+    accumulate->SetInputData(doseImage);
+    accumulate->SetStencilData(stencil);
+    accumulate->UseFractionalLabelmapOn();
+    accumulate->SetFractionalLabelmap(fractionalLabelmap);
+    accumulate->SetMinimumFractionalValue(-108.0);
+    accumulate->SetMaximumFractionalValue(108.0);
+    accumulate->SetIgnoreZero(ignoreZero ? 1 : 0);
+    accumulate->SetComponentExtent(0, 99, 0, 0, 0, 0);
+    accumulate->SetComponentOrigin(0.5, 0, 0);
+    accumulate->SetComponentSpacing(0.25, 1, 1);
+    accumulate->SetUseVectorizedKernels(useVectorizedKernels);
+    accumulate->Update();
+    return accumulate;
+  }
+
+  //-----------------------------------------------------------------------------
+  bool CompareKernels(vtkImageData* doseImage, vtkImageData* fractionalLabelmap, vtkImageStencilData* stencil, bool ignoreZero)
+  {
+    vtkSmartPointer<vtkFractionalImageAccumulate> scalar = Accumulate(doseImage, fractionalLabelmap, stencil, ignoreZero, false);
+    vtkSmartPointer<vtkFractionalImageAccumulate> vectorized = Accumulate(doseImage, fractionalLabelmap, stencil, ignoreZero, true);
+
+    bool valid = true;
+    if (vectorized->GetVoxelCount() != scalar->GetVoxelCount()
+      || vectorized->GetMin()[0] != scalar->GetMin()[0]
+      || vectorized->GetMax()[0] != scalar->GetMax()[0])
+    {
+      std::cerr << "Voxel count, min or max differ: (" << vectorized->GetVoxelCount() << ", " << vectorized->GetMin()[0] << ", "
+        << vectorized->GetMax()[0] << ") instead of (" << scalar->GetVoxelCount() << ", " << scalar->GetMin()[0] << ", "
+        << scalar->GetMax()[0] << ")" << std::endl;
+      valid = false;
+    }
+    if (!IsRelativeDifferenceWithinTolerance(vectorized->GetMean()[0], scalar->GetMean()[0])
+      || !IsRelativeDifferenceWithinTolerance(vectorized->GetStandardDeviation()[0], scalar->GetStandardDeviation()[0])
+      || !IsRelativeDifferenceWithinTolerance(vectorized->GetFractionalVoxelCount(), scalar->GetFractionalVoxelCount()))
+    {
+      std::cerr.precision(17);
+      std::cerr << "Statistics differ: (" << vectorized->GetMean()[0] << ", " << vectorized->GetStandardDeviation()[0] << ", "
+        << vectorized->GetFractionalVoxelCount() << ") instead of (" << scalar->GetMean()[0] << ", "
+        << scalar->GetStandardDeviation()[0] << ", " << scalar->GetFractionalVoxelCount() << ")" << std::endl;
+      valid = false;
+    }
+
+    // Bins are filled in voxel order by both kernels, so the histograms are identical
+    vtkDataArray* scalarHistogram = scalar->GetOutput()->GetPointData()->GetScalars();
+    vtkDataArray* vectorizedHistogram = vectorized->GetOutput()->GetPointData()->GetScalars();
+    for (vtkIdType bin=0; bin<scalarHistogram->GetNumberOfTuples(); ++bin)
+    {
+      if (vectorizedHistogram->GetTuple1(bin) != scalarHistogram->GetTuple1(bin))
+      {
+        std::cerr << "Bin " << bin << " contains " << vectorizedHistogram->GetTuple1(bin) << " instead of "
+          << scalarHistogram->GetTuple1(bin) << std::endl;
+        valid = false;
+      }
+    }
+    return valid;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkFractionalImageAccumulateTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  std::cout << "Vectorized kernel instruction set: " << vtkFractionalImageAccumulate::GetVectorizedKernelInstructionSet() << std::endl;
+
+  // Odd row length, so that the vectorized kernels also process remaining voxels at the end of the spans
+  int extent[6] = {0, 36, 0, 24, 0, 12};
+
+  vtkSmartPointer<vtkImageData> doseImage = vtkSmartPointer<vtkImageData>::New();
+  doseImage->SetExtent(extent);
+  doseImage->AllocateScalars(VTK_FLOAT, 1);
+  vtkSmartPointer<vtkImageData> fractionalLabelmap = vtkSmartPointer<vtkImageData>::New();
+  fractionalLabelmap->SetExtent(extent);
+  fractionalLabelmap->AllocateScalars(VTK_CHAR, 1);
+
+  // Random dose (with zero values and values outside the histogram range) and random fractions
+  vtkSmartPointer<vtkMinimalStandardRandomSequence> random = vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+  random->SetSeed(42);
+  float* dosePtr = static_cast<float*>(doseImage->GetScalarPointer());
+  char* fractionPtr = static_cast<char*>(fractionalLabelmap->GetScalarPointer());
+  vtkIdType numberOfVoxels = doseImage->GetNumberOfPoints();
+  for (vtkIdType i=0; i<numberOfVoxels; ++i)
+  {
+    random->Next();
+    dosePtr[i] = (i % 13 == 0 ? 0.0f : static_cast<float>(random->GetRangeValue(-2.0, 30.0)));
+    random->Next();
+    fractionPtr[i] = static_cast<char>(random->GetRangeValue(-108.0, 108.0));
+  }
+
+  // Stencil of the voxels with positive fraction, so that the image is processed in many short spans
+  vtkSmartPointer<vtkImageToImageStencil> stencil = vtkSmartPointer<vtkImageToImageStencil>::New();
+  stencil->SetInputData(fractionalLabelmap);
+  stencil->ThresholdByUpper(0.5);
+  stencil->Update();
+
+  bool valid = true;
+  valid &= CompareKernels(doseImage, fractionalLabelmap, NULL, false);
+  valid &= CompareKernels(doseImage, fractionalLabelmap, NULL, true);
+  valid &= CompareKernels(doseImage, fractionalLabelmap, stencil->GetOutput(), false);
+  valid &= CompareKernels(doseImage, fractionalLabelmap, stencil->GetOutput(), true);
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
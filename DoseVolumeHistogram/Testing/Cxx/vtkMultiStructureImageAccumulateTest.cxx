@@ -0,0 +1,233 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRtCommon includes
+#include "vtkMultiStructureImageAccumulate.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageAccumulate.h>
+#include <vtkImageData.h>
+#include <vtkImageStencilData.h>
+#include <vtkImageToImageStencil.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const int NUMBER_OF_STRUCTURES = 3;
+  const int NUMBER_OF_BINS = 40;
+  const double HISTOGRAM_ORIGIN = 2.0;
+  const double HISTOGRAM_SPACING = 1.0;
+  const double STATISTICS_TOLERANCE = 1.0e-9;
+
+  //-----------------------------------------------------------------------------
+  /// Create image with the given extent and scalar type
+  vtkSmartPointer<vtkImageData> CreateImage(int extent[6], int scalarType)
+  {
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    image->SetExtent(extent);
+    image->SetSpacing(1.5, 2.0, 2.5);
+    image->SetOrigin(-10.0, 5.0, 3.0);
+    image->AllocateScalars(scalarType, 1);
+    return image;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Membership of a voxel in the test structures (overlapping ellipsoids and a slab)
+  bool IsInStructure(int structureIndex, int i, int j, int k)
+  {
+    switch (structureIndex)
+    {
+    case 0:
+      return (i-8)*(i-8) + (j-7)*(j-7)*2 + (k-5)*(k-5)*3 < 40;
+    case 1:
+      return (i-14)*(i-14)*2 + (j-9)*(j-9) + (k-4)*(k-4) < 30;
+    default:
+      return (j >= 12 && k >= 2 && k <= 7);
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compute histogram and statistics of one structure with a stenciled vtkImageAccumulate and compare them to the multi-structure results
+  bool CompareToImageAccumulate(vtkImageData* doseImage, vtkImageData* structureLabelmap, vtkMultiStructureImageAccumulate* accumulate, int structureIndex, const char* mode)
+  {
+    vtkSmartPointer<vtkImageToImageStencil> stencil = vtkSmartPointer<vtkImageToImageStencil>::New();
+    stencil->SetInputData(structureLabelmap);
+    stencil->ThresholdByUpper(0.5);
+    stencil->Update();
+
+    vtkSmartPointer<vtkImageAccumulate> imageAccumulate = vtkSmartPointer<vtkImageAccumulate>::New();
+    imageAccumulate->SetInputData(doseImage);
+    imageAccumulate->SetStencilData(stencil->GetOutput());
+    imageAccumulate->SetComponentExtent(0, NUMBER_OF_BINS-1, 0, 0, 0, 0);
+    imageAccumulate->SetComponentOrigin(HISTOGRAM_ORIGIN, 0, 0);
+    imageAccumulate->SetComponentSpacing(HISTOGRAM_SPACING, 1, 1);
+    imageAccumulate->Update();
+
+    bool valid = true;
+    if (imageAccumulate->GetVoxelCount() != accumulate->GetVoxelCount(structureIndex))
+    {
+      std::cerr << mode << " structure " << structureIndex << ": voxel count " << accumulate->GetVoxelCount(structureIndex)
+        << " instead of " << imageAccumulate->GetVoxelCount() << std::endl;
+      valid = false;
+    }
+    if (fabs(imageAccumulate->GetMin()[0] - accumulate->GetMin(structureIndex)) > STATISTICS_TOLERANCE
+      || fabs(imageAccumulate->GetMax()[0] - accumulate->GetMax(structureIndex)) > STATISTICS_TOLERANCE
+      || fabs(imageAccumulate->GetMean()[0] - accumulate->GetMean(structureIndex)) > STATISTICS_TOLERANCE)
+    {
+      std::cerr << mode << " structure " << structureIndex << ": statistics (" << accumulate->GetMin(structureIndex) << ", "
+        << accumulate->GetMax(structureIndex) << ", " << accumulate->GetMean(structureIndex) << ") instead of ("
+        << imageAccumulate->GetMin()[0] << ", " << imageAccumulate->GetMax()[0] << ", " << imageAccumulate->GetMean()[0] << ")" << std::endl;
+      valid = false;
+    }
+
+    vtkDataArray* expectedHistogram = imageAccumulate->GetOutput()->GetPointData()->GetScalars();
+    vtkDoubleArray* histogram = accumulate->GetHistogram(structureIndex);
+    if (!histogram || histogram->GetNumberOfTuples() != NUMBER_OF_BINS)
+    {
+      std::cerr << mode << " structure " << structureIndex << ": invalid histogram" << std::endl;
+      return false;
+    }
+    for (int bin=0; bin<NUMBER_OF_BINS; ++bin)
+    {
+      if (histogram->GetValue(bin) != expectedHistogram->GetTuple1(bin))
+      {
+        std::cerr << mode << " structure " << structureIndex << ": bin " << bin << " contains " << histogram->GetValue(bin)
+          << " voxels instead of " << expectedHistogram->GetTuple1(bin) << std::endl;
+        valid = false;
+      }
+    }
+    return valid;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkMultiStructureImageAccumulateTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  int extent[6] = {0, 22, 0, 16, 0, 10};
+
+  // Dose values are a quarter of a bin away from the bin boundaries, so that the bin of each voxel is unambiguous.
+  // Some values are below the histogram origin and some are above the last bin.
+  vtkSmartPointer<vtkImageData> doseImage = CreateImage(extent, VTK_FLOAT);
+  for (int k=extent[4]; k<=extent[5]; ++k)
+  {
+    for (int j=extent[2]; j<=extent[3]; ++j)
+    {
+      for (int i=extent[0]; i<=extent[1]; ++i)
+      {
+        float dose = (float)((i*7 + j*5 + k*3) % 47) + 0.25f;
+        doseImage->SetScalarComponentFromFloat(i, j, k, 0, dose);
+      }
+    }
+  }
+
+  // Binary labelmaps of overlapping structures
+  std::vector< vtkSmartPointer<vtkImageData> > structureLabelmaps;
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    vtkSmartPointer<vtkImageData> labelmap = CreateImage(extent, VTK_UNSIGNED_CHAR);
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          labelmap->SetScalarComponentFromFloat(i, j, k, 0, IsInStructure(structureIndex, i, j, k) ? 1.0 : 0.0);
+        }
+      }
+    }
+    structureLabelmaps.push_back(labelmap);
+  }
+
+  bool valid = true;
+
+  vtkSmartPointer<vtkMultiStructureImageAccumulate> accumulate = vtkSmartPointer<vtkMultiStructureImageAccumulate>::New();
+  accumulate->SetInputData(doseImage);
+  accumulate->SetHistogramOrigin(HISTOGRAM_ORIGIN);
+  accumulate->SetHistogramSpacing(HISTOGRAM_SPACING);
+  accumulate->SetNumberOfHistogramBins(NUMBER_OF_BINS);
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    accumulate->AddStructureLabelmap(structureLabelmaps[structureIndex]);
+  }
+  if (!accumulate->Update())
+  {
+    std::cerr << "Failed to accumulate binary labelmaps!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    valid &= CompareToImageAccumulate(doseImage, structureLabelmaps[structureIndex], accumulate, structureIndex, "Binary");
+  }
+
+  // Multi-label labelmap: later structures take precedence where the structures overlap,
+  // and the binary labelmaps are replaced by the exclusive ones for the comparison
+  vtkSmartPointer<vtkImageData> multiLabelLabelmap = CreateImage(extent, VTK_SHORT);
+  multiLabelLabelmap->GetPointData()->GetScalars()->FillComponent(0, 0.0);
+  for (int k=extent[4]; k<=extent[5]; ++k)
+  {
+    for (int j=extent[2]; j<=extent[3]; ++j)
+    {
+      for (int i=extent[0]; i<=extent[1]; ++i)
+      {
+        for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+        {
+          if (IsInStructure(structureIndex, i, j, k))
+          {
+            multiLabelLabelmap->SetScalarComponentFromFloat(i, j, k, 0, structureIndex+1);
+          }
+        }
+      }
+    }
+  }
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    vtkImageData* labelmap = structureLabelmaps[structureIndex];
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          int label = (int)multiLabelLabelmap->GetScalarComponentAsDouble(i, j, k, 0);
+          labelmap->SetScalarComponentFromFloat(i, j, k, 0, (label == structureIndex+1) ? 1.0 : 0.0);
+        }
+      }
+    }
+  }
+
+  accumulate->SetMultiLabelLabelmap(multiLabelLabelmap, NUMBER_OF_STRUCTURES);
+  if (!accumulate->Update())
+  {
+    std::cerr << "Failed to accumulate multi-label labelmap!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int structureIndex=0; structureIndex<NUMBER_OF_STRUCTURES; ++structureIndex)
+  {
+    valid &= CompareToImageAccumulate(doseImage, structureLabelmaps[structureIndex], accumulate, structureIndex, "Multi-label");
+  }
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -305,6 +305,17 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
     std::cerr << "Invalid arguments!" << std::endl;
     return EXIT_FAILURE;
   }
+  // NumberOfThreads (optional)
+  int numberOfThreads = 1;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-NumberOfThreads") == 0)
+    {
+      numberOfThreads = vtkVariant(argv[argIndex+1]).ToInt();
+      std::cout << "Number of threads: " << numberOfThreads << std::endl;
+      argIndex += 2;
+    }
+  }
 
   // Constraint the criteria to be greater than zero
   if (volumeDifferenceCriterion == 0.0)
@@ -413,6 +424,7 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
     dvhLogic->SetStartValue(dvhStartValue);
     dvhLogic->SetStepSize(dvhStepSize);
   }
+  dvhLogic->SetNumberOfThreads(numberOfThreads);
 
   // Setup time measurement
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
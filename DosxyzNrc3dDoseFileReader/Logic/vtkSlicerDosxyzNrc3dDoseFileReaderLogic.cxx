@@ -21,6 +21,9 @@
 // DosxyzNrc3dDoseFileReader includes
 #include "vtkSlicerDosxyzNrc3dDoseFileReaderLogic.h"
 
+// SlicerRT includes
+#include "vtkSlicerRtTaskPool.h"
+
 // VTK includes
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
@@ -40,10 +43,156 @@
 // STD includes
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <locale>
 #include <string>
 #include <algorithm>
 #include <cctype>
 #include <functional>
+#include <cstdlib>
+#include <cstring>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  inline bool IsWhitespace(char c)
+  {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+  }
+
+  //----------------------------------------------------------------------------
+  inline const char* SkipWhitespace(const char* pos, const char* end)
+  {
+    while (pos < end && IsWhitespace(*pos))
+    {
+      ++pos;
+    }
+    return pos;
+  }
+
+  //----------------------------------------------------------------------------
+  inline const char* SkipToken(const char* pos, const char* end)
+  {
+    while (pos < end && !IsWhitespace(*pos))
+    {
+      ++pos;
+    }
+    return pos;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Parser of the floating point numbers of the file. The decimal separator is always '.', so the numbers
+  /// are parsed using the classic locale, independently of the locale of the application.
+  /// Fortran double precision exponents ("D" instead of "E") are also accepted.
+  class NumberParser
+  {
+  public:
+    NumberParser()
+    {
+      this->NumberStream.imbue(std::locale::classic());
+    }
+
+    /// Parse the token starting at the given position of the file contents
+    /// \return Pointer after the parsed token, NULL if the token is not a number
+    const char* Parse(const char* pos, const char* end, double& value)
+    {
+      const char* tokenEnd = SkipToken(pos, end);
+      this->Token.assign(pos, tokenEnd);
+      std::replace(this->Token.begin(), this->Token.end(), 'D', 'E');
+      std::replace(this->Token.begin(), this->Token.end(), 'd', 'e');
+      this->NumberStream.clear();
+      this->NumberStream.str(this->Token);
+      this->NumberStream >> value;
+      if (this->Token.empty() || this->NumberStream.fail() || this->NumberStream.peek() != std::char_traits<char>::eof())
+      {
+        return NULL;
+      }
+      return tokenEnd;
+    }
+
+  protected:
+    /// Stream and token reused for each number to avoid allocations
+    std::istringstream NumberStream;
+    std::string Token;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Text of the dose and uncertainty blocks, split into chunks at whitespace that are parsed by separate threads
+  struct ValueBlocksParser
+  {
+    /// Start of each chunk (chunk i ends at start of chunk i+1)
+    std::vector<const char*> ChunkStarts;
+    /// Number of values in each chunk, then the index of the first value of each chunk
+    std::vector<vtkIdType> ChunkValueIndices;
+    /// Number of voxels (values in one block)
+    vtkIdType NumberOfVoxels;
+    float IntensityScalingFactor;
+    float* DoseValues;
+    float* UncertaintyValues;
+    /// Flag for each chunk telling if it contained a token that is not a number
+    std::vector<int> ChunkParseErrors;
+    /// If true then the threads count the values in their chunk, otherwise they parse them
+    bool CountOnly;
+  };
+
+  //----------------------------------------------------------------------------
+  vtkIdType CountValuesInChunk(const char* pos, const char* end)
+  {
+    vtkIdType numberOfValues = 0;
+    pos = SkipWhitespace(pos, end);
+    while (pos < end)
+    {
+      ++numberOfValues;
+      pos = SkipWhitespace(SkipToken(pos, end), end);
+    }
+    return numberOfValues;
+  }
+
+  //----------------------------------------------------------------------------
+  void ParseChunk(ValueBlocksParser* parser, int chunkIndex)
+  {
+    const char* pos = parser->ChunkStarts[chunkIndex];
+    const char* end = parser->ChunkStarts[chunkIndex+1];
+    if (parser->CountOnly)
+    {
+      parser->ChunkValueIndices[chunkIndex] = CountValuesInChunk(pos, end);
+      return;
+    }
+
+    vtkIdType valueIndex = parser->ChunkValueIndices[chunkIndex];
+    vtkIdType numberOfValuesToStore = (parser->UncertaintyValues ? 2 * parser->NumberOfVoxels : parser->NumberOfVoxels);
+    NumberParser numberParser;
+    pos = SkipWhitespace(pos, end);
+    while (pos < end && valueIndex < numberOfValuesToStore)
+    {
+      double value = 0.0;
+      const char* tokenEnd = numberParser.Parse(pos, end, value);
+      if (!tokenEnd)
+      {
+        parser->ChunkParseErrors[chunkIndex] = 1;
+        value = 0.0;
+        tokenEnd = SkipToken(pos, end);
+      }
+      if (valueIndex < parser->NumberOfVoxels)
+      {
+        parser->DoseValues[valueIndex] = static_cast<float>(value) * parser->IntensityScalingFactor;
+      }
+      else
+      {
+        parser->UncertaintyValues[valueIndex - parser->NumberOfVoxels] = static_cast<float>(value);
+      }
+      ++valueIndex;
+      pos = SkipWhitespace(tokenEnd, end);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void ParseChunkTaskFunction(void* userData, int chunkIndex)
+  {
+    ParseChunk(static_cast<ValueBlocksParser*>(userData), chunkIndex);
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDosxyzNrc3dDoseFileReaderLogic);
@@ -51,6 +200,7 @@ vtkStandardNewMacro(vtkSlicerDosxyzNrc3dDoseFileReaderLogic);
 //----------------------------------------------------------------------------
 vtkSlicerDosxyzNrc3dDoseFileReaderLogic::vtkSlicerDosxyzNrc3dDoseFileReaderLogic()
 {
+  this->NumberOfThreads = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -68,17 +218,74 @@ bool vtkSlicerDosxyzNrc3dDoseFileReaderLogic::AreEqualWithTolerance(double a, do
 void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::LoadDosxyzNrc3dDoseFile(char* filename, float intensityScalingFactor/*=1.0*/)
+const char* vtkSlicerDosxyzNrc3dDoseFileReaderLogic::ReadVoxelBoundaries(const char* pos, const char* end, int numberOfVoxels,
+  std::vector<double>& voxelBoundaries, double& spacing, const char* directionName)
 {
-  ifstream readFileStream(filename); 
+  voxelBoundaries.resize(numberOfVoxels + 1);
+  spacing = 0;
+  double initialVoxelSpacing = 0;
+  NumberParser numberParser;
+  for (int counter = 0; counter < numberOfVoxels + 1; ++counter)
+  {
+    pos = SkipWhitespace(pos, end);
+    if (pos >= end)
+    {
+      vtkErrorMacro("ReadVoxelBoundaries: The end of file was reached earlier than specified.");
+      return NULL;
+    }
+    double boundary = 0;
+    pos = numberParser.Parse(pos, end, boundary);
+    if (!pos)
+    {
+      vtkErrorMacro("ReadVoxelBoundaries: Invalid voxel boundary value in " << directionName << " direction.");
+      return NULL;
+    }
+    voxelBoundaries[counter] = boundary * 10.0; // convert from cm to mm
+    if (counter == 1)
+    {
+      initialVoxelSpacing = fabs(voxelBoundaries[counter] - voxelBoundaries[counter - 1]);
+      spacing = initialVoxelSpacing;
+    }
+    else if (counter > 1)
+    {
+      double currentVoxelSpacing = fabs(voxelBoundaries[counter] - voxelBoundaries[counter - 1]);
+      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
+      {
+        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in " << directionName << " direction.");
+      }
+    }
+  }
+  return pos;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::LoadDosxyzNrc3dDoseFile(char* filename, float intensityScalingFactor/*=1.0*/, bool loadRelativeUncertainty/*=false*/)
+{
+  // Read the whole file in one block, it is parsed from memory
+  ifstream readFileStream(filename, std::ios::in | std::ios::binary);
   if (!readFileStream)
   {
     vtkErrorMacro("LoadDosxyzNrc3dDoseFile: The specified file could not be opened.");
     return;
   }
+  readFileStream.seekg(0, std::ios::end);
+  std::streamoff fileSize = readFileStream.tellg();
+  readFileStream.seekg(0, std::ios::beg);
+  if (fileSize <= 0)
+  {
+    vtkErrorMacro("LoadDosxyzNrc3dDoseFile: The specified file is empty.");
+    return;
+  }
+  std::vector<char> fileContents(static_cast<size_t>(fileSize) + 1, '\0');
+  readFileStream.read(&fileContents[0], fileSize);
+  fileSize = readFileStream.gcount();
+  readFileStream.close();
+  const char* pos = &fileContents[0];
+  const char* end = pos + fileSize;
 
   if (intensityScalingFactor == 0)
   {
@@ -89,7 +296,13 @@ void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::LoadDosxyzNrc3dDoseFile(char* file
   int size[3] = { 0, 0, 0 };
 
   // read in block 1 (number of voxels in x, y, z directions)
-  readFileStream >> size[0] >> size[1] >> size[2];
+  for (int i = 0; i < 3; ++i)
+  {
+    pos = SkipWhitespace(pos, end);
+    char* numberEnd = NULL;
+    size[i] = static_cast<int>(strtol(pos, &numberEnd, 10));
+    pos = numberEnd;
+  }
 
   if (size[0] <= 0 || size[1] <= 0 || size[2] <= 0)
   {
@@ -97,105 +310,80 @@ void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::LoadDosxyzNrc3dDoseFile(char* file
     return;
   }
 
-  std::vector<double> voxelBoundariesX(size[0] + 1); 
-  std::vector<double> voxelBoundariesY(size[1] + 1);
-  std::vector<double> voxelBoundariesZ(size[2] + 1);
+  // read in blocks 2-4 (voxel boundaries, cm, in x, y, z directions)
+  std::vector<double> voxelBoundariesX;
+  std::vector<double> voxelBoundariesY;
+  std::vector<double> voxelBoundariesZ;
   double spacingX = 0;
   double spacingY = 0;
   double spacingZ = 0;
+  if ( !(pos = this->ReadVoxelBoundaries(pos, end, size[0], voxelBoundariesX, spacingX, "X"))
+    || !(pos = this->ReadVoxelBoundaries(pos, end, size[1], voxelBoundariesY, spacingY, "Y"))
+    || !(pos = this->ReadVoxelBoundaries(pos, end, size[2], voxelBoundariesZ, spacingZ, "Z")) )
+  {
+    return;
+  }
 
-  int counter = 0;
-  double initialVoxelSpacing = 0;
-  double currentVoxelSpacing = 0;
-
-  // read in block 2 (voxel boundaries, cm, in x direction)
-  while (!readFileStream.eof() && counter < size[0] + 1)
+  // read in block 5 (dose array values) and block 6 (relative uncertainty values)
+  vtkSmartPointer<vtkImageData> floatDosxyzNrc3dDoseVolumeData = vtkSmartPointer<vtkImageData>::New();
+  floatDosxyzNrc3dDoseVolumeData->SetExtent(0, size[0] - 1, 0, size[1] - 1, 0, size[2] - 1);
+  floatDosxyzNrc3dDoseVolumeData->AllocateScalars(VTK_FLOAT, 1);
+  vtkSmartPointer<vtkImageData> floatUncertaintyVolumeData;
+  if (loadRelativeUncertainty)
   {
-    readFileStream >> voxelBoundariesX[counter];
-    voxelBoundariesX[counter] = voxelBoundariesX[counter] * 10.0; // convert from cm to mm
-    if (counter == 1)
-    {
-      initialVoxelSpacing = fabs(voxelBoundariesX[counter] - voxelBoundariesX[counter - 1]);
-      spacingX = initialVoxelSpacing;
-    }
-    else if (counter > 1)
-    {
-      currentVoxelSpacing = abs(voxelBoundariesX[counter] - voxelBoundariesX[counter - 1]);
-      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
-      {
-        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in X direction.");
-      }
-    }
-    counter += 1;
+    floatUncertaintyVolumeData = vtkSmartPointer<vtkImageData>::New();
+    floatUncertaintyVolumeData->SetExtent(0, size[0] - 1, 0, size[1] - 1, 0, size[2] - 1);
+    floatUncertaintyVolumeData->AllocateScalars(VTK_FLOAT, 1);
   }
 
-  // read in block 3 (voxel boundaries, cm, in y direction)
-  counter = 0;
-  while (!readFileStream.eof() && counter < size[1] + 1)
+  // Split the text into chunks at whitespace, one for each thread
+  int numberOfChunks = vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(this->NumberOfThreads, VTK_MAX_THREADS);
+  ValueBlocksParser parser;
+  parser.NumberOfVoxels = (vtkIdType)size[0] * size[1] * size[2];
+  parser.IntensityScalingFactor = intensityScalingFactor;
+  parser.DoseValues = static_cast<float*>(floatDosxyzNrc3dDoseVolumeData->GetScalarPointer());
+  parser.UncertaintyValues = (loadRelativeUncertainty ? static_cast<float*>(floatUncertaintyVolumeData->GetScalarPointer()) : NULL);
+  parser.ChunkStarts.push_back(pos);
+  for (int chunkIndex = 1; chunkIndex < numberOfChunks; ++chunkIndex)
   {
-    readFileStream >> voxelBoundariesY[counter];
-    voxelBoundariesY[counter] = voxelBoundariesY[counter] * 10.0; // convert from cm to mm
-    if (counter == 1)
-    {
-      initialVoxelSpacing = fabs(voxelBoundariesY[counter] - voxelBoundariesY[counter - 1]);
-      spacingY = initialVoxelSpacing;
-    }
-    else if (counter > 1)
-    {
-      currentVoxelSpacing = abs(voxelBoundariesY[counter] - voxelBoundariesY[counter - 1]);
-      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
-      {
-        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in Y direction.");
-      }
-    }
-    counter += 1;
+    const char* chunkStart = std::max(parser.ChunkStarts.back(), pos + (end - pos) * chunkIndex / numberOfChunks);
+    parser.ChunkStarts.push_back(SkipToken(chunkStart, end));
+  }
+  parser.ChunkStarts.push_back(end);
+  parser.ChunkValueIndices.resize(numberOfChunks, 0);
+  parser.ChunkParseErrors.resize(numberOfChunks, 0);
+
+  // Count the values in each chunk to know where they go in the volumes, then parse the values
+  parser.CountOnly = true;
+  vtkSlicerRtTaskPool::ExecuteTasks(numberOfChunks, ParseChunkTaskFunction, &parser, numberOfChunks);
+  vtkIdType numberOfValues = 0;
+  for (int chunkIndex = 0; chunkIndex < numberOfChunks; ++chunkIndex)
+  {
+    vtkIdType numberOfValuesInChunk = parser.ChunkValueIndices[chunkIndex];
+    parser.ChunkValueIndices[chunkIndex] = numberOfValues;
+    numberOfValues += numberOfValuesInChunk;
   }
 
-  // read in block 4 (voxel boundaries, cm, in z direction)
-  counter = 0;
-  while (!readFileStream.eof() && counter < size[2] + 1)
+  if (numberOfValues < parser.NumberOfVoxels)
   {
-    readFileStream >> voxelBoundariesZ[counter];
-    voxelBoundariesZ[counter] = voxelBoundariesZ[counter] * 10.0; // convert from cm to mm
-    if (counter == 1)
-    {
-      initialVoxelSpacing = fabs(voxelBoundariesZ[counter] - voxelBoundariesZ[counter - 1]);
-      spacingZ = initialVoxelSpacing;
-    }
-    else if (counter > 1)
+    vtkErrorMacro("LoadDosxyzNrc3dDoseFile: The end of file was reached earlier than specified.");
+    memset(parser.DoseValues, 0, parser.NumberOfVoxels * sizeof(float));
+  }
+  bool uncertaintyBlockFound = (loadRelativeUncertainty && numberOfValues >= 2 * parser.NumberOfVoxels);
+  if (loadRelativeUncertainty && !uncertaintyBlockFound)
+  {
+    if (numberOfValues > parser.NumberOfVoxels)
     {
-      currentVoxelSpacing = abs(voxelBoundariesZ[counter] - voxelBoundariesZ[counter - 1]);
-      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
-      {
-        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in Z direction.");
-      }
+      vtkWarningMacro("LoadDosxyzNrc3dDoseFile: The relative uncertainty block is incomplete, it is not loaded.");
     }
-    counter += 1;
+    parser.UncertaintyValues = NULL;
   }
 
-  // read in block 5 (dose array values)
-  vtkSmartPointer<vtkImageData> floatDosxyzNrc3dDoseVolumeData = vtkSmartPointer<vtkImageData>::New();
-  floatDosxyzNrc3dDoseVolumeData->SetExtent(0, size[0] - 1, 0, size[1] - 1, 0, size[2] - 1);
-  floatDosxyzNrc3dDoseVolumeData->AllocateScalars(VTK_FLOAT, 1); 
-
-  float* floatPtr = (float*)floatDosxyzNrc3dDoseVolumeData->GetScalarPointer();
-  float currentValue = 0.0;
-  for (long z = 0; z < size[2]; z++)
+  parser.CountOnly = false;
+  vtkSlicerRtTaskPool::ExecuteTasks(numberOfChunks, ParseChunkTaskFunction, &parser, numberOfChunks);
+  if (std::find(parser.ChunkParseErrors.begin(), parser.ChunkParseErrors.end(), 1) != parser.ChunkParseErrors.end())
   {
-    for (long y = 0; y < size[1]; y++)
-    {
-      for (long x = 0; x < size[0]; x++)
-      {
-        if (readFileStream.eof())
-        {
-          vtkErrorMacro("LoadDosxyzNrc3dDoseFile: The end of file was reached earlier than specified.");
-        }
-        readFileStream >> currentValue;
-        currentValue = currentValue * intensityScalingFactor;
-        (*floatPtr) = currentValue;
-        ++floatPtr;
-      }
-    }
+    vtkErrorMacro("LoadDosxyzNrc3dDoseFile: Invalid values found in the dose or uncertainty block, they are set to zero.");
   }
 
   // create volume node for dose values
@@ -225,7 +413,22 @@ void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::LoadDosxyzNrc3dDoseFile(char* file
   dosxyzNrc3dDoseVolumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
   dosxyzNrc3dDoseVolumeNode->SetAndObserveDisplayNodeID(dosxyzNrc3dDoseVolumeDisplayNode->GetID());
 
-  //todo: read in block 6 (relative errors) of .3ddose file in another volume node
-
-  readFileStream.close();
+  // create volume node for relative uncertainty values (block 6) with the same geometry as the dose
+  if (uncertaintyBlockFound)
+  {
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> uncertaintyVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    uncertaintyVolumeNode->SetScene(this->GetMRMLScene());
+    std::string uncertaintyVolumeNodeName = vtksys::SystemTools::GetFilenameWithoutExtension(filename) + "_RelativeUncertainty";
+    uncertaintyVolumeNode->SetName(uncertaintyVolumeNodeName.c_str());
+    uncertaintyVolumeNode->SetSpacing(spacingX, spacingY, spacingZ);
+    uncertaintyVolumeNode->SetOrigin(voxelBoundariesX[0], voxelBoundariesY[0], voxelBoundariesZ[0]);
+    this->GetMRMLScene()->AddNode(uncertaintyVolumeNode);
+
+    uncertaintyVolumeNode->SetAndObserveImageData(floatUncertaintyVolumeData);
+
+    vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> uncertaintyVolumeDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
+    this->GetMRMLScene()->AddNode(uncertaintyVolumeDisplayNode);
+    uncertaintyVolumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
+    uncertaintyVolumeNode->SetAndObserveDisplayNodeID(uncertaintyVolumeDisplayNode->GetID());
+  }
 }
@@ -46,17 +46,36 @@ public:
   vtkTypeMacro(vtkSlicerDosxyzNrc3dDoseFileReaderLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
-  /// Load DosxyzNrc3dDose volume from file
+  /// Load DosxyzNrc3dDose volume from file.
   /// \param filename Path and filename of the DosxyzNrc3dDose file
-  void LoadDosxyzNrc3dDoseFile(char* filename, float intensityScalingFactor=1.0);
+  /// \param intensityScalingFactor Factor the dose values are multiplied with
+  /// \param loadRelativeUncertainty If true and the file contains relative uncertainties (block 6), then they are
+  ///   loaded into a second volume named after the file with the suffix "_RelativeUncertainty"
+  void LoadDosxyzNrc3dDoseFile(char* filename, float intensityScalingFactor=1.0, bool loadRelativeUncertainty=false);
 
   /// Determine if two numbers are equal within a small tolerance (0.001)
   static bool AreEqualWithTolerance(double a, double b);
 
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+protected:
+  /// Parse one voxel boundaries block (cm) from file contents, convert to mm, and determine spacing
+  /// \param pos Position in the file contents where the block starts
+  /// \param end End of the file contents
+  /// \return Position after the block, NULL on error
+  const char* ReadVoxelBoundaries(const char* pos, const char* end, int numberOfVoxels,
+    std::vector<double>& voxelBoundaries, double& spacing, const char* directionName);
+
 protected:
   vtkSlicerDosxyzNrc3dDoseFileReaderLogic();
   virtual ~vtkSlicerDosxyzNrc3dDoseFileReaderLogic();
 
+protected:
+  /// Number of chunks the dose and uncertainty values are split into and parsed in parallel (see \sa vtkSlicerRtTaskPool).
+  /// Default is 0 (one chunk per processor core), 1 means serial parsing
+  int NumberOfThreads;
+
 private:
   vtkSlicerDosxyzNrc3dDoseFileReaderLogic(const vtkSlicerDosxyzNrc3dDoseFileReaderLogic&);  // Not implemented
   void operator=(const vtkSlicerDosxyzNrc3dDoseFileReaderLogic&);  // Not implemented
@@ -0,0 +1,284 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Anna Ilina, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario.
+
+==============================================================================*/
+
+// DosxyzNrc3dDoseFileReader includes
+#include "vtkSlicerDosxyzNrc3dDoseFileReaderLogic.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const int NUMBER_OF_VOXELS[3] = { 5, 4, 3 };
+  const double VOXEL_SIZE_CM[3] = { 0.25, 0.5, 0.4 };
+  const double FIRST_BOUNDARY_CM[3] = { -1.0, 2.5, -0.6 };
+  const float SCALING_FACTOR = 2.5f;
+  const char* FILE_NAME_WITHOUT_EXTENSION = "SyntheticDose";
+
+  //-----------------------------------------------------------------------------
+  /// Format a value as written by DOSXYZnrc. Every third value uses the Fortran double precision exponent.
+  std::string FormatValue(double value, int index)
+  {
+    std::ostringstream stream;
+    stream.imbue(std::locale::classic());
+    stream << std::scientific << std::uppercase << std::setprecision(6) << value;
+    std::string text = stream.str();
+    if (index % 3 == 0)
+    {
+      std::replace(text.begin(), text.end(), 'E', 'D');
+    }
+    return text;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Value of the formatted text converted to float, the same way as the reader is expected to convert it
+  float GetExpectedValue(std::string text)
+  {
+    std::replace(text.begin(), text.end(), 'D', 'E');
+    std::istringstream stream(text);
+    stream.imbue(std::locale::classic());
+    double value = 0.0;
+    stream >> value;
+    return static_cast<float>(value);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Set a locale with comma as decimal separator for the C library, if any is available
+  /// \return Name of the locale, NULL if none is available
+  const char* SetCommaDecimalLocale()
+  {
+    const char* localeNames[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "German_Germany.1252", NULL };
+    for (int localeIndex = 0; localeNames[localeIndex]; ++localeIndex)
+    {
+      if (setlocale(LC_NUMERIC, localeNames[localeIndex]) && localeconv()->decimal_point[0] == ',')
+      {
+        return localeNames[localeIndex];
+      }
+    }
+    setlocale(LC_NUMERIC, "C");
+    return NULL;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Write a synthetic 3ddose file with dose and relative uncertainty blocks, and store the expected voxel values
+  bool WriteSynthetic3dDoseFile(const std::string& filePath, std::vector<float>& expectedDoseValues, std::vector<float>& expectedUncertaintyValues)
+  {
+    std::ofstream file(filePath.c_str());
+    if (!file)
+    {
+      return false;
+    }
+
+    // Block 1: number of voxels
+    file << "  " << NUMBER_OF_VOXELS[0] << "  " << NUMBER_OF_VOXELS[1] << "  " << NUMBER_OF_VOXELS[2] << "\n";
+
+    // Blocks 2-4: voxel boundaries (cm)
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      for (int boundaryIndex = 0; boundaryIndex <= NUMBER_OF_VOXELS[axis]; ++boundaryIndex)
+      {
+        file << " " << FormatValue(FIRST_BOUNDARY_CM[axis] + boundaryIndex * VOXEL_SIZE_CM[axis], boundaryIndex + 1);
+      }
+      file << "\n";
+    }
+
+    // Block 5 (dose) and block 6 (relative uncertainty), several values per line as in the DOSXYZnrc output
+    int numberOfVoxels = NUMBER_OF_VOXELS[0] * NUMBER_OF_VOXELS[1] * NUMBER_OF_VOXELS[2];
+    expectedDoseValues.clear();
+    expectedUncertaintyValues.clear();
+    for (int voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+    {
+      std::string text = FormatValue((voxelIndex % 7) * 1.234567e-3 + voxelIndex * 3.3e-5, voxelIndex);
+      expectedDoseValues.push_back(GetExpectedValue(text) * SCALING_FACTOR);
+      file << " " << text << ((voxelIndex % 5 == 4) ? "\n" : "");
+    }
+    file << "\n";
+    for (int voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+    {
+      std::string text = FormatValue((voxelIndex % 4 == 0) ? 1.0 : 0.01 + voxelIndex * 1.7e-3, voxelIndex + 1);
+      expectedUncertaintyValues.push_back(GetExpectedValue(text));
+      file << " " << text << ((voxelIndex % 5 == 4) ? "\n" : "");
+    }
+    file << "\n";
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compare the geometry and the voxel values of a loaded volume to the expected ones
+  bool CheckVolume(vtkMRMLScalarVolumeNode* volumeNode, const std::vector<float>& expectedValues, const char* description)
+  {
+    if (!volumeNode || !volumeNode->GetImageData())
+    {
+      std::cerr << description << " volume is not loaded!" << std::endl;
+      return false;
+    }
+
+    bool valid = true;
+    double* spacing = volumeNode->GetSpacing();
+    double* origin = volumeNode->GetOrigin();
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      // Boundaries are converted from cm to mm
+      if (fabs(spacing[axis] - VOXEL_SIZE_CM[axis] * 10.0) > 1.0e-6 || fabs(origin[axis] - FIRST_BOUNDARY_CM[axis] * 10.0) > 1.0e-6)
+      {
+        std::cerr << description << " volume geometry mismatch on axis " << axis << ": spacing " << spacing[axis] << ", origin " << origin[axis] << std::endl;
+        valid = false;
+      }
+    }
+
+    vtkImageData* imageData = volumeNode->GetImageData();
+    int* dimensions = imageData->GetDimensions();
+    if (dimensions[0] != NUMBER_OF_VOXELS[0] || dimensions[1] != NUMBER_OF_VOXELS[1] || dimensions[2] != NUMBER_OF_VOXELS[2]
+      || imageData->GetScalarType() != VTK_FLOAT)
+    {
+      std::cerr << description << " volume has invalid dimensions or scalar type!" << std::endl;
+      return false;
+    }
+
+    float* values = static_cast<float*>(imageData->GetScalarPointer());
+    for (size_t voxelIndex = 0; voxelIndex < expectedValues.size(); ++voxelIndex)
+    {
+      if (values[voxelIndex] != expectedValues[voxelIndex])
+      {
+        std::cerr << description << " value mismatch at voxel " << voxelIndex << ": " << values[voxelIndex]
+          << " instead of " << expectedValues[voxelIndex] << std::endl;
+        valid = false;
+      }
+    }
+    return valid;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Load the file into a new scene and check the created volumes
+  bool LoadAndCheck(const std::string& filePath, int numberOfThreads, bool loadRelativeUncertainty,
+    const std::vector<float>& expectedDoseValues, const std::vector<float>& expectedUncertaintyValues)
+  {
+    std::cout << "Load with " << numberOfThreads << " thread(s), relative uncertainty " << (loadRelativeUncertainty ? "on" : "off") << std::endl;
+
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkSlicerDosxyzNrc3dDoseFileReaderLogic> logic;
+    logic->SetMRMLScene(scene.GetPointer());
+    logic->SetNumberOfThreads(numberOfThreads);
+    std::vector<char> filePathBuffer(filePath.begin(), filePath.end());
+    filePathBuffer.push_back('\0');
+    logic->LoadDosxyzNrc3dDoseFile(&filePathBuffer[0], SCALING_FACTOR, loadRelativeUncertainty);
+
+    bool valid = true;
+    vtkSmartPointer<vtkCollection> doseVolumeNodes = vtkSmartPointer<vtkCollection>::Take(
+      scene->GetNodesByClassByName("vtkMRMLScalarVolumeNode", FILE_NAME_WITHOUT_EXTENSION) );
+    if (doseVolumeNodes->GetNumberOfItems() != 1)
+    {
+      std::cerr << "Invalid number of dose volumes: " << doseVolumeNodes->GetNumberOfItems() << std::endl;
+      return false;
+    }
+    valid &= CheckVolume(vtkMRMLScalarVolumeNode::SafeDownCast(doseVolumeNodes->GetItemAsObject(0)), expectedDoseValues, "Dose");
+
+    std::string uncertaintyVolumeName = std::string(FILE_NAME_WITHOUT_EXTENSION) + "_RelativeUncertainty";
+    vtkSmartPointer<vtkCollection> uncertaintyVolumeNodes = vtkSmartPointer<vtkCollection>::Take(
+      scene->GetNodesByClassByName("vtkMRMLScalarVolumeNode", uncertaintyVolumeName.c_str()) );
+    if (uncertaintyVolumeNodes->GetNumberOfItems() != (loadRelativeUncertainty ? 1 : 0))
+    {
+      std::cerr << "Invalid number of relative uncertainty volumes: " << uncertaintyVolumeNodes->GetNumberOfItems() << std::endl;
+      return false;
+    }
+    if (loadRelativeUncertainty)
+    {
+      valid &= CheckVolume(vtkMRMLScalarVolumeNode::SafeDownCast(uncertaintyVolumeNodes->GetItemAsObject(0)), expectedUncertaintyValues, "Relative uncertainty");
+    }
+    return valid;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDosxyzNrc3dDoseFileReaderLogicTest1( int argc, char * argv[] )
+{
+  int argIndex = 1;
+
+  // TemporaryDirectory
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1 && STRCASECMP(argv[argIndex], "-TemporaryDirectory") == 0)
+  {
+    temporaryDirectoryPath = argv[argIndex+1];
+    std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+    argIndex += 2;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+  std::string filePath = std::string(temporaryDirectoryPath) + "/" + FILE_NAME_WITHOUT_EXTENSION + ".3ddose";
+  std::vector<float> expectedDoseValues;
+  std::vector<float> expectedUncertaintyValues;
+  if (!WriteSynthetic3dDoseFile(filePath, expectedDoseValues, expectedUncertaintyValues))
+  {
+    std::cerr << "Failed to write synthetic 3ddose file " << filePath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Parallel parsing splits the values into chunks that have to give the same result as serial parsing
+  bool valid = true;
+  valid &= LoadAndCheck(filePath, 1, false, expectedDoseValues, expectedUncertaintyValues);
+  valid &= LoadAndCheck(filePath, 1, true, expectedDoseValues, expectedUncertaintyValues);
+  valid &= LoadAndCheck(filePath, 3, false, expectedDoseValues, expectedUncertaintyValues);
+  valid &= LoadAndCheck(filePath, 3, true, expectedDoseValues, expectedUncertaintyValues);
+
+  // The file always uses '.' as decimal separator, regardless of the locale of the application
+  const char* commaDecimalLocaleName = SetCommaDecimalLocale();
+  if (commaDecimalLocaleName)
+  {
+    std::cout << "Load with locale " << commaDecimalLocaleName << std::endl;
+    valid &= LoadAndCheck(filePath, 1, true, expectedDoseValues, expectedUncertaintyValues);
+    valid &= LoadAndCheck(filePath, 3, true, expectedDoseValues, expectedUncertaintyValues);
+    setlocale(LC_NUMERIC, "C");
+  }
+  else
+  {
+    std::cout << "No locale with comma as decimal separator is available, loading with such locale is not tested" << std::endl;
+  }
+
+  vtksys::SystemTools::RemoveFile(filePath.c_str());
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -104,7 +104,8 @@ bool qSlicerDosxyzNrc3dDoseFileReaderPlugin::load(const IOProperties& properties
   Q_ASSERT(d->Logic);
 
   float intensityScalingFactor = properties["scalingFactor"].toFloat();
-  d->Logic->LoadDosxyzNrc3dDoseFile(fileName.toLatin1().data(), intensityScalingFactor);
+  bool loadRelativeUncertainty = properties["loadRelativeUncertainty"].toBool();
+  d->Logic->LoadDosxyzNrc3dDoseFile(fileName.toLatin1().data(), intensityScalingFactor, loadRelativeUncertainty);
 
   this->setLoadedNodes(QStringList());
 
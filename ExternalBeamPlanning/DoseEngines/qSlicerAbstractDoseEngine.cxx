@@ -55,6 +55,8 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 #include <QSlider>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QList>
+#include <QMap>
 
 //----------------------------------------------------------------------------
 double qSlicerAbstractDoseEngine::DEFAULT_DOSE_VOLUME_WINDOW_LEVEL_MAXIMUM = 16.0;
@@ -76,6 +78,10 @@ public:
   /// Engine-specific parameters defined in \sa defineBeamParameters.
   /// Key is the parameter name (without engine name prefix), value is the default
   QMap<QString,QVariant> BeamParameters;
+
+  /// Intermediate results added during the calculation, for each beam under calculation (between
+  /// \sa beginDoseCalculation and \sa endDoseCalculation). They replace the previous ones on success
+  QMap< vtkMRMLRTBeamNode*, QList< vtkSmartPointer<vtkMRMLNode> > > PendingIntermediateResults;
 };
 
 //-----------------------------------------------------------------------------
@@ -124,6 +130,24 @@ void qSlicerAbstractDoseEngine::setName(QString name)
 //----------------------------------------------------------------------------
 QString qSlicerAbstractDoseEngine::calculateDose(vtkMRMLRTBeamNode* beamNode)
 {
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> resultDoseVolumeNode;
+  QString errorMessage = this->beginDoseCalculation(beamNode, resultDoseVolumeNode);
+  if (!errorMessage.isEmpty())
+  {
+    return errorMessage;
+  }
+
+  // Calculate dose
+  errorMessage = this->calculateDoseUsingEngine(beamNode, resultDoseVolumeNode);
+
+  return this->endDoseCalculation(beamNode, resultDoseVolumeNode, errorMessage);
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::beginDoseCalculation(vtkMRMLRTBeamNode* beamNode, vtkSmartPointer<vtkMRMLScalarVolumeNode>& resultDoseVolumeNode)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
   if (!beamNode)
   {
     QString errorMessage("Invalid beam node");
@@ -171,25 +195,109 @@ QString qSlicerAbstractDoseEngine::calculateDose(vtkMRMLRTBeamNode* beamNode)
     qCritical() << Q_FUNC_INFO << ": Failed to access reference volume subject hierarchy item";
   }
 
-  // Remove past intermediate results for beam before calculating dose again
-  this->removeIntermediateResults(beamNode);
+  // Take the inputs from MRML, so that thread-safe engines do not access it while calculating
+  QString errorMessage = this->prepareDoseCalculationForBeam(beamNode);
+  if (!errorMessage.isEmpty())
+  {
+    return errorMessage;
+  }
 
-  // Create output dose volume for beam
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> resultDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  beamNode->GetScene()->AddNode(resultDoseVolumeNode);
+  // Create output dose volume for beam. Thread-safe engines get it outside the scene, and it is added
+  // to the scene only if the calculation succeeds. Past results are replaced only then too
+  resultDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  if (!this->isThreadSafe())
+  {
+    beamNode->GetScene()->AddNode(resultDoseVolumeNode);
+  }
   // Give default name for result node (engine can give it a more meaningful name)
   std::string resultDoseNodeName = std::string(beamNode->GetName()) + "_Dose";
   resultDoseVolumeNode->SetName(resultDoseNodeName.c_str());
 
-  // Calculate dose
-  QString errorMessage = this->calculateDoseUsingEngine(beamNode, resultDoseVolumeNode);
-  if (errorMessage.isEmpty())
+  d->PendingIntermediateResults[beamNode] = QList< vtkSmartPointer<vtkMRMLNode> >();
+
+  return QString();
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::endDoseCalculation(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode, QString calculationErrorMessage)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  if (!beamNode || !beamNode->GetScene() || !resultDoseVolumeNode)
   {
-    // Add result dose volume to beam
-    this->addResultDose(resultDoseVolumeNode, beamNode);
+    d->PendingIntermediateResults.remove(beamNode);
+    QString errorMessage("Invalid beam node or result dose volume");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
   }
+  vtkMRMLScene* scene = beamNode->GetScene();
 
-  return errorMessage;
+  // Let the engine set its results to MRML (this may add intermediate results too)
+  QString errorMessage = this->finishDoseCalculationForBeam(beamNode, resultDoseVolumeNode, calculationErrorMessage.isEmpty());
+  if (!calculationErrorMessage.isEmpty())
+  {
+    errorMessage = calculationErrorMessage;
+  }
+  QList< vtkSmartPointer<vtkMRMLNode> > pendingIntermediateResults = d->PendingIntermediateResults.take(beamNode);
+
+  // Discard the new results on error, so that the previous ones are kept
+  if (!errorMessage.isEmpty())
+  {
+    foreach (vtkSmartPointer<vtkMRMLNode> intermediateResult, pendingIntermediateResults)
+    {
+      if (intermediateResult->GetScene())
+      {
+        scene->RemoveNode(intermediateResult);
+      }
+    }
+    if (resultDoseVolumeNode->GetScene())
+    {
+      scene->RemoveNode(resultDoseVolumeNode);
+    }
+    return errorMessage;
+  }
+
+  // Replace past intermediate results for beam
+  this->removeIntermediateResults(beamNode);
+  foreach (vtkSmartPointer<vtkMRMLNode> intermediateResult, pendingIntermediateResults)
+  {
+    if (!intermediateResult->GetScene())
+    {
+      scene->AddNode(intermediateResult);
+    }
+    this->addIntermediateResult(intermediateResult, beamNode);
+  }
+
+  // Add result dose volume to beam (replacing the past one)
+  if (!resultDoseVolumeNode->GetScene())
+  {
+    scene->AddNode(resultDoseVolumeNode);
+  }
+  this->addResultDose(resultDoseVolumeNode, beamNode);
+
+  return QString();
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerAbstractDoseEngine::isThreadSafe()
+{
+  return false;
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::prepareDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode)
+{
+  Q_UNUSED(beamNode);
+  return QString();
+}
+
+//----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::finishDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode, bool success)
+{
+  Q_UNUSED(beamNode);
+  Q_UNUSED(resultDoseVolumeNode);
+  Q_UNUSED(success);
+  return QString();
 }
 
 //---------------------------------------------------------------------------
@@ -205,6 +313,19 @@ void qSlicerAbstractDoseEngine::addIntermediateResult(vtkMRMLNode* result, vtkMR
     qCritical() << Q_FUNC_INFO << ": Invalid beam node";
     return;
   }
+
+  // Results of a running calculation are added to the beam when the calculation ends successfully
+  Q_D(qSlicerAbstractDoseEngine);
+  if (d->PendingIntermediateResults.contains(beamNode))
+  {
+    d->PendingIntermediateResults[beamNode].append(result);
+    return;
+  }
+  if (!result->GetScene())
+  {
+    beamNode->GetScene()->AddNode(result);
+  }
+
   vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(beamNode->GetScene());
   if (!shNode)
   {
@@ -23,6 +23,9 @@
 
 #include "qSlicerExternalBeamPlanningDoseEnginesExport.h"
 
+// VTK includes
+#include <vtkSmartPointer.h>
+
 // Qt includes
 #include <QObject>
 #include <QStringList>
@@ -69,6 +72,30 @@ public:
   /// \return Error message. Empty string on success
   QString calculateDose(vtkMRMLRTBeamNode* beamNode);
 
+  /// Create the result dose volume for a single beam and take the inputs of its calculation from MRML
+  /// (\sa prepareDoseCalculationForBeam). First step of \sa calculateDose, must be called on the main thread.
+  /// The results of the previous calculation are kept until the calculation ends successfully.
+  /// If the engine is thread-safe, then the result dose volume is added to the scene only in \sa endDoseCalculation
+  /// \param beamNode Beam node for which the dose is calculated
+  /// \param resultDoseVolumeNode Output volume node for the result dose, to be passed to \sa calculateDoseUsingEngine
+  /// \return Error message. Empty string on success
+  QString beginDoseCalculation(vtkMRMLRTBeamNode* beamNode, vtkSmartPointer<vtkMRMLScalarVolumeNode>& resultDoseVolumeNode);
+
+  /// Replace the results of the previous calculation of a single beam with the new result dose volume and
+  /// intermediate results. Last step of \sa calculateDose, must be called on the main thread for each begun beam.
+  /// \param beamNode Beam node for which the dose is calculated
+  /// \param resultDoseVolumeNode Result dose volume created by \sa beginDoseCalculation
+  /// \param calculationErrorMessage Error message returned by \sa calculateDoseUsingEngine. On error (or if the
+  ///   calculation was cancelled) the new results are discarded and the previous ones are kept
+  /// \return Error message. Empty string on success
+  QString endDoseCalculation(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode, QString calculationErrorMessage);
+
+  /// Return true if the dose for multiple beams can be calculated at the same time in worker threads.
+  /// Thread-safe engines must not access MRML nodes in \sa calculateDoseUsingEngine (the beam node only
+  /// identifies the beam): the inputs are taken in \sa prepareDoseCalculationForBeam, and the results
+  /// are set to MRML nodes in \sa finishDoseCalculationForBeam, both called on the main thread. False by default.
+  virtual bool isThreadSafe();
+
   /// Get result per-beam dose volume for given beam
   vtkMRMLScalarVolumeNode* getResultDoseForBeam(vtkMRMLRTBeamNode* beamNode);
 
@@ -88,6 +115,19 @@ protected:
     vtkMRMLRTBeamNode* beamNode,
     vtkMRMLScalarVolumeNode* resultDoseVolumeNode ) = 0;
 
+  /// Take the inputs of the dose calculation of a single beam from MRML. Called on the main thread by
+  /// \sa beginDoseCalculation, needs to be implemented in thread-safe engines. Does nothing by default.
+  /// \return Error message. Empty string on success
+  virtual QString prepareDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode);
+
+  /// Set the results of the dose calculation of a single beam to the result dose volume and add the intermediate
+  /// results (\sa addIntermediateResult), then release the inputs taken by \sa prepareDoseCalculationForBeam.
+  /// Called on the main thread by \sa endDoseCalculation, needs to be implemented in thread-safe engines.
+  /// Does nothing by default.
+  /// \param success False if the calculation failed or was cancelled. Then only the inputs need to be released
+  /// \return Error message. Empty string on success
+  virtual QString finishDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode, bool success);
+
   /// Define engine-specific beam parameters.
   /// This is the method that needs to be implemented in each engine.
   virtual void defineBeamParameters() = 0;
@@ -95,7 +135,9 @@ protected:
 // Dose calculation related functions (functions to call from the subclass).
 // Public so that they can be called from python.
 public:
-  /// Add intermediate results to beam. Doing so allows easily cleaning up the intermediate results
+  /// Add intermediate results to beam. Doing so allows easily cleaning up the intermediate results.
+  /// During the calculation of the beam, the results are added to the beam (and to the scene if they are
+  /// not in it yet) only when the calculation ends successfully (\sa endDoseCalculation).
   /// \param result MRML node containing the intermediate result to add
   /// \param beamNode Beam to add the intermediate result to
   Q_INVOKABLE void addIntermediateResult(vtkMRMLNode* result, vtkMRMLRTBeamNode* beamNode);
@@ -242,6 +284,7 @@ private:
   Q_DISABLE_COPY(qSlicerAbstractDoseEngine);
   friend class qSlicerDoseEnginePluginHandler;
   friend class qSlicerDoseEngineLogic;
+  friend class qSlicerDoseEngineLogicPrivate;
   friend class qSlicerExternalBeamPlanningModuleWidget;
 };
 
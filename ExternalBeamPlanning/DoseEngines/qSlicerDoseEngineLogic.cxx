@@ -32,6 +32,7 @@
 #include "vtkMRMLDoseAccumulationNode.h"
 #include "vtkSlicerDoseAccumulationModuleLogic.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
+#include "vtkSlicerRtTaskPool.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
@@ -53,6 +54,9 @@
 // Qt includes
 #include <QDebug>
 
+// STD includes
+#include <vector>
+
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_SubjectHierarchy
 class qSlicerDoseEngineLogicPrivate
@@ -64,6 +68,37 @@ public:
   qSlicerDoseEngineLogicPrivate(qSlicerDoseEngineLogic& object);
   ~qSlicerDoseEngineLogicPrivate();
   void loadApplicationSettings();
+
+  /// Beams to calculate, processed by vtkSlicerRtTaskPool. The worker threads only access the
+  /// elements of their beam (thread-safe engines use the beam node only to identify the beam)
+  struct BeamTaskList
+  {
+    BeamTaskList() : Logic(NULL), Engine(NULL), TaskPool(NULL) { };
+    qSlicerDoseEngineLogicPrivate* Logic;
+    qSlicerAbstractDoseEngine* Engine;
+    vtkSlicerRtTaskPool* TaskPool;
+    std::vector<vtkMRMLRTBeamNode*> Beams;
+    std::vector< vtkSmartPointer<vtkMRMLScalarVolumeNode> > ResultDoseVolumeNodes;
+    std::vector<QString> ErrorMessages;
+  };
+
+  /// Calculate the dose of a beam of a BeamTaskList
+  static void CalculateBeamDoseTaskFunction(void* userData, int taskIndex);
+  /// Report progress and cancel the calculation if requested, called on the main thread
+  static void CalculateBeamDoseProgressFunction(void* userData, int numberOfCompletedTasks, int numberOfTasks);
+
+  /// Calculate dose for the beams, in parallel if the engine is thread-safe. The calculation of the beams
+  /// is begun on the main thread, and ended after all workers are joined. If the calculation is cancelled
+  /// or fails for any beam, then the previous results of all the beams are kept
+  /// \return Error message. Empty string on success or cancel
+  QString calculateBeamDoses(qSlicerAbstractDoseEngine* engine, std::vector<vtkMRMLRTBeamNode*>& beams);
+
+public:
+  /// Number of threads calculating the beams with thread-safe dose engines.
+  /// 0 (default) uses all processor cores. \sa vtkSlicerRtTaskPool
+  int NumberOfThreads;
+  /// Flag set when cancelling the running dose calculation
+  bool CancelRequested;
 };
 
 //-----------------------------------------------------------------------------
@@ -72,6 +107,8 @@ public:
 //-----------------------------------------------------------------------------
 qSlicerDoseEngineLogicPrivate::qSlicerDoseEngineLogicPrivate(qSlicerDoseEngineLogic& object)
   : q_ptr(&object)
+  , NumberOfThreads(0)
+  , CancelRequested(false)
 {
 }
 
@@ -87,12 +124,102 @@ void qSlicerDoseEngineLogicPrivate::loadApplicationSettings()
   //      See qSlicerSubjectHierarchyPluginLogicPrivate::loadApplicationSettings
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogicPrivate::CalculateBeamDoseTaskFunction(void* userData, int taskIndex)
+{
+  BeamTaskList* taskList = static_cast<BeamTaskList*>(userData);
+
+  QString errorMessage = taskList->Engine->calculateDoseUsingEngine(
+    taskList->Beams[taskIndex], taskList->ResultDoseVolumeNodes[taskIndex] );
+  taskList->ErrorMessages[taskIndex] = errorMessage;
+
+  // No results are kept on error, so the remaining beams are not started
+  if (!errorMessage.isEmpty())
+  {
+    taskList->TaskPool->Cancel();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogicPrivate::CalculateBeamDoseProgressFunction(void* userData, int numberOfCompletedTasks, int numberOfTasks)
+{
+  BeamTaskList* taskList = static_cast<BeamTaskList*>(userData);
+  qSlicerDoseEngineLogicPrivate* self = taskList->Logic;
+
+  // Events may be processed on progress update, which is how the calculation is cancelled
+  emit self->q_ptr->progressUpdated((double)numberOfCompletedTasks / (numberOfTasks+1));
+  if (self->CancelRequested)
+  {
+    taskList->TaskPool->Cancel();
+  }
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerDoseEngineLogicPrivate::calculateBeamDoses(qSlicerAbstractDoseEngine* engine, std::vector<vtkMRMLRTBeamNode*>& beams)
+{
+  int numberOfBeams = (int)beams.size();
+  vtkSmartPointer<vtkSlicerRtTaskPool> taskPool = vtkSmartPointer<vtkSlicerRtTaskPool>::New();
+  BeamTaskList taskList;
+  taskList.Logic = this;
+  taskList.Engine = engine;
+  taskList.TaskPool = taskPool;
+  taskList.Beams = beams;
+  taskList.ResultDoseVolumeNodes.resize(numberOfBeams);
+  taskList.ErrorMessages.resize(numberOfBeams);
+
+  // Begin calculation of each beam on the main thread. The inputs are taken from MRML here
+  QString errorMessage;
+  int numberOfBegunBeams = 0;
+  for ( ; numberOfBegunBeams<numberOfBeams; ++numberOfBegunBeams)
+  {
+    errorMessage = engine->beginDoseCalculation(beams[numberOfBegunBeams], taskList.ResultDoseVolumeNodes[numberOfBegunBeams]);
+    if (!errorMessage.isEmpty())
+    {
+      break;
+    }
+  }
+
+  // Calculate the beams. Engines that are not thread-safe calculate them on the main thread
+  bool allBeamsCalculated = false;
+  if (errorMessage.isEmpty() && !this->CancelRequested)
+  {
+    taskPool->SetTaskFunction(qSlicerDoseEngineLogicPrivate::CalculateBeamDoseTaskFunction, &taskList);
+    taskPool->SetProgressFunction(qSlicerDoseEngineLogicPrivate::CalculateBeamDoseProgressFunction, &taskList);
+    taskPool->SetNumberOfThreads(engine->isThreadSafe() ? this->NumberOfThreads : 1);
+    allBeamsCalculated = taskPool->Execute(numberOfBeams);
+  }
+  for (int beamIndex=0; beamIndex<numberOfBegunBeams && errorMessage.isEmpty(); ++beamIndex)
+  {
+    errorMessage = taskList.ErrorMessages[beamIndex];
+  }
+
+  // End the calculation of the beams on the main thread, now that all workers are joined. The new
+  // results are discarded unless all beams were calculated, so the previous results are kept
+  QString discardMessage = errorMessage;
+  if (discardMessage.isEmpty() && (!allBeamsCalculated || this->CancelRequested))
+  {
+    discardMessage = QString("Dose calculation cancelled");
+  }
+  for (int beamIndex=0; beamIndex<numberOfBegunBeams; ++beamIndex)
+  {
+    QString beamErrorMessage = engine->endDoseCalculation(
+      beams[beamIndex], taskList.ResultDoseVolumeNodes[beamIndex], discardMessage );
+    if (discardMessage.isEmpty() && !beamErrorMessage.isEmpty() && errorMessage.isEmpty())
+    {
+      errorMessage = beamErrorMessage;
+    }
+  }
+
+  return errorMessage;
+}
+
 //-----------------------------------------------------------------------------
 // qSlicerDoseEngineLogic methods
 
 //----------------------------------------------------------------------------
 qSlicerDoseEngineLogic::qSlicerDoseEngineLogic(QObject* parent)
   : QObject(parent)
+  , d_ptr( new qSlicerDoseEngineLogicPrivate(*this) )
 {
 }
 
@@ -190,6 +317,8 @@ void qSlicerDoseEngineLogic::onDoseEngineChangedInPlan(vtkObject* nodeObject)
 //---------------------------------------------------------------------------
 QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
 {
+  Q_D(qSlicerDoseEngineLogic);
+
   QString errorMessage("");
   if (!planNode || !planNode->GetScene())
   {
@@ -212,26 +341,10 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
   std::vector<vtkMRMLRTBeamNode*> beams;
   planNode->GetBeams(beams);
   int numberOfBeams = beams.size();
-  int currentBeamIndex = 0;
   double progress = 0.0;
-
-  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt, ++currentBeamIndex)
+  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
   {
-    vtkMRMLRTBeamNode* beamNode = (*beamIt);
-    if (beamNode)
-    {
-      progress = (double)currentBeamIndex / (numberOfBeams+1);
-      emit progressUpdated(progress);
-
-      // Calculate dose for current beam
-      errorMessage = selectedEngine->calculateDose(beamNode);
-      if (!errorMessage.isEmpty())
-      {
-        qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-        return errorMessage;
-      }
-    }
-    else
+    if (!(*beamIt))
     {
       errorMessage = QString("Invalid beam!");
       qCritical() << Q_FUNC_INFO << ": " << errorMessage;
@@ -239,6 +352,22 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
     }
   }
 
+  d->CancelRequested = false;
+  emit progressUpdated(progress);
+  errorMessage = d->calculateBeamDoses(selectedEngine, beams);
+  if (!errorMessage.isEmpty())
+  {
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  if (d->CancelRequested)
+  {
+    errorMessage = QString("Dose calculation cancelled");
+    qWarning() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
   progress = (double)numberOfBeams / (numberOfBeams+1);
   emit progressUpdated(progress);
 
@@ -256,6 +385,13 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
   return QString();
 }
 
+//---------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::cancelDoseCalculation()
+{
+  Q_D(qSlicerDoseEngineLogic);
+  d->CancelRequested = true;
+}
+
 //---------------------------------------------------------------------------
 QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNode)
 {
@@ -473,3 +609,17 @@ vtkMRMLRTBeamNode* qSlicerDoseEngineLogic::createBeamInPlan(vtkMRMLRTPlanNode* p
 
   return beamNode;
 }
+
+//---------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::setNumberOfThreads(int numberOfThreads)
+{
+  Q_D(qSlicerDoseEngineLogic);
+  d->NumberOfThreads = numberOfThreads;
+}
+
+//---------------------------------------------------------------------------
+int qSlicerDoseEngineLogic::numberOfThreads()
+{
+  Q_D(qSlicerDoseEngineLogic);
+  return d->NumberOfThreads;
+}
@@ -58,9 +58,17 @@ public:
   /// Set the current MRML scene to the widget
   Q_INVOKABLE virtual void setMRMLScene(vtkMRMLScene* scene);
 
-  /// Calculate dose for a plan
+  /// Calculate dose for a plan. If the dose engine of the plan is thread-safe, then the beams are
+  /// calculated in parallel, otherwise one after the other. MRML is only accessed on the main thread
+  /// (before and after the beams are calculated), and the results are the same in both cases.
+  /// If the calculation fails or is cancelled, then the results of the previous calculation are kept.
+  /// The calculation can be cancelled from a slot connected to \sa progressUpdated
   Q_INVOKABLE QString calculateDose(vtkMRMLRTPlanNode* planNode);
 
+  /// Cancel the running dose calculation. The beams that are being calculated are finished, the
+  /// rest are skipped, and the results of the previous calculation are kept
+  Q_INVOKABLE void cancelDoseCalculation();
+
   /// Accumulate per-beam dose volumes for each beam under given plan. The accumulated
   /// total dose is 
   Q_INVOKABLE QString createAccumulatedDose(vtkMRMLRTPlanNode* planNode);
@@ -72,6 +80,13 @@ public:
   /// Create a beam for a plan (with beam parameters defined by the dose engine of the plan)
   Q_INVOKABLE vtkMRMLRTBeamNode* createBeamInPlan(vtkMRMLRTPlanNode* planNode);
 
+  /// Set number of worker threads for the beams of a plan, if its dose engine is thread-safe.
+  /// 0 (default) means one thread per processor core, 1 calculates the beams on the main thread.
+  /// \sa vtkSlicerRtTaskPool
+  Q_INVOKABLE void setNumberOfThreads(int numberOfThreads);
+  /// Get number of threads
+  Q_INVOKABLE int numberOfThreads();
+
 signals:
   /// Signals for dose calculation progress update
   /// \param progress Value between 0 and 1
@@ -90,7 +105,7 @@ protected slots:
   void onDoseEngineChangedInPlan(vtkObject* nodeObject);
 
 protected:
-  QScopedPointer<qSlicerDoseEngineLogic> d_ptr; 
+  QScopedPointer<qSlicerDoseEngineLogicPrivate> d_ptr; 
 
 private:
   Q_DECLARE_PRIVATE(qSlicerDoseEngineLogic);
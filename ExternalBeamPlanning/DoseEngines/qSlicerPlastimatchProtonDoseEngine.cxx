@@ -55,6 +55,109 @@
 #include <QDebug>
 #include <QStringList>
 
+// STD includes
+#include <sstream>
+
+//----------------------------------------------------------------------------
+/// Inputs of the calculation of a beam, taken from MRML on the main thread, and its results, set to MRML
+/// on the main thread. The calculation itself (that may run in a worker thread) only accesses these.
+class qSlicerPlastimatchProtonDoseEngine::BeamCalculation
+{
+public:
+  BeamCalculation()
+    : RxDose(0.0)
+    , SAD(0.0)
+    , X1Jaw(0.0)
+    , X2Jaw(0.0)
+    , Y1Jaw(0.0)
+    , Y2Jaw(0.0)
+    , Algorithm(0)
+    , KanematsuGottschalk(false)
+    , RangeCompensatorSmearingRadius(0.0)
+    , RangeCompensatorHighland(false)
+    , SourceSize(0.0)
+    , StepLength(0.0)
+    , ApertureOffset(0.0)
+    , PencilBeamResolution(0.0)
+    , BeamLineTypeActive(0)
+    , ManualEnergyLimits(false)
+    , MinimumEnergy(0.0)
+    , MaximumEnergy(0.0)
+    , ProximalMargin(0.0)
+    , DistalMargin(0.0)
+    , EnergyResolution(0.0)
+    , EnergySpread(0.0)
+  {
+    for (int i=0; i<3; ++i)
+    {
+      this->Isocenter[i] = 0.0;
+      this->SourcePosition[i] = 0.0;
+      this->ReferenceOrigin[i] = 0.0;
+      this->ReferenceSpacing[i] = 1.0;
+      this->ApertureVolumeOrigin[i] = 0.0;
+      this->ApertureVolumeSpacing[i] = 1.0;
+      this->RangeCompensatorVolumeOrigin[i] = 0.0;
+      this->RangeCompensatorVolumeSpacing[i] = 1.0;
+      for (int j=0; j<3; ++j)
+      {
+        this->ReferenceDirections[i][j] = (i == j ? 1.0 : 0.0);
+      }
+    }
+  }
+
+public:
+  // Inputs
+
+  /// Reference volume (own copy for the beam) and target labelmap
+  itk::Image<short, 3>::Pointer ReferenceVolumeItk;
+  itk::Image<unsigned char, 3>::Pointer TargetVolumeItk;
+  /// Geometry of the reference volume, which is also the geometry of the dose
+  double ReferenceOrigin[3];
+  double ReferenceSpacing[3];
+  double ReferenceDirections[3][3];
+
+  /// Isocenter in LPS
+  double Isocenter[3];
+  double SourcePosition[3];
+  double RxDose;
+  double SAD;
+  double X1Jaw;
+  double X2Jaw;
+  double Y1Jaw;
+  double Y2Jaw;
+
+  /// Engine-specific beam parameters
+  int Algorithm;
+  bool KanematsuGottschalk;
+  double RangeCompensatorSmearingRadius;
+  bool RangeCompensatorHighland;
+  double SourceSize;
+  double StepLength;
+  double ApertureOffset;
+  double PencilBeamResolution;
+  int BeamLineTypeActive;
+  bool ManualEnergyLimits;
+  double MinimumEnergy;
+  double MaximumEnergy;
+  double ProximalMargin;
+  double DistalMargin;
+  double EnergyResolution;
+  double EnergySpread;
+
+  // Results
+
+  vtkSmartPointer<vtkImageData> DoseImageData;
+  vtkSmartPointer<vtkImageData> ApertureImageData;
+  double ApertureVolumeOrigin[3];
+  double ApertureVolumeSpacing[3];
+  vtkSmartPointer<vtkImageData> RangeCompensatorImageData;
+  double RangeCompensatorVolumeOrigin[3];
+  double RangeCompensatorVolumeSpacing[3];
+
+  /// Parameters set to plastimatch, printed when the calculation is finished
+  std::ostringstream Log;
+};
+
 //----------------------------------------------------------------------------
 qSlicerPlastimatchProtonDoseEngine::qSlicerPlastimatchProtonDoseEngine(QObject* parent)
   : qSlicerAbstractDoseEngine(parent)
@@ -65,6 +168,14 @@ qSlicerPlastimatchProtonDoseEngine::qSlicerPlastimatchProtonDoseEngine(QObject*
 //----------------------------------------------------------------------------
 qSlicerPlastimatchProtonDoseEngine::~qSlicerPlastimatchProtonDoseEngine()
 {
+  qDeleteAll(this->m_BeamCalculations);
+  this->m_BeamCalculations.clear();
+}
+
+//----------------------------------------------------------------------------
+bool qSlicerPlastimatchProtonDoseEngine::isThreadSafe()
+{
+  return true;
 }
 
 //---------------------------------------------------------------------------
@@ -140,7 +251,7 @@ void qSlicerPlastimatchProtonDoseEngine::defineBeamParameters()
 }
 
 //---------------------------------------------------------------------------
-QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode)
+QString qSlicerPlastimatchProtonDoseEngine::prepareDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode)
 {
   vtkMRMLRTPlanNode* parentPlanNode = beamNode->GetParentPlanNode();
   if (!parentPlanNode)
@@ -156,14 +267,8 @@ QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBe
     qCritical() << Q_FUNC_INFO << ": " << errorMessage;
     return errorMessage;
   }
-  if (!resultDoseVolumeNode)
-  {
-    QString errorMessage("Invalid result dose volume");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
 
-  vtkMRMLScene* scene = beamNode->GetScene();
+  QScopedPointer<BeamCalculation> calculation(new BeamCalculation());
 
   // Get target as ITK image
   vtkSmartPointer<vtkOrientedImageData> targetLabelmap = parentPlanNode->GetTargetOrientedImageData();
@@ -181,7 +286,7 @@ QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBe
     return errorMessage;
   }
   targetPlmVolume->print();
-  itk::Image<unsigned char, 3>::Pointer targetVolumeItk = targetPlmVolume->itk_uchar();
+  calculation->TargetVolumeItk = targetPlmVolume->itk_uchar();
 
   // Reference code for setting the geometry of the segmentation rasterization
   // in case the default one (from DICOM) is not desired
@@ -194,32 +299,79 @@ QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBe
 #endif
 
   // Get isocenter
-  double isocenter[3] = {0.0, 0.0, 0.0};
-  if (!beamNode->GetPlanIsocenterPosition(isocenter))
+  if (!beamNode->GetPlanIsocenterPosition(calculation->Isocenter))
   {
     QString errorMessage("Failed to get isocenter position");
     qCritical() << Q_FUNC_INFO << ": " << errorMessage;
     return errorMessage;
   }
   // Convert isocenter position to LPS for Plastimatch
-  isocenter[0] = -isocenter[0];
-  isocenter[1] = -isocenter[1];
+  calculation->Isocenter[0] = -calculation->Isocenter[0];
+  calculation->Isocenter[1] = -calculation->Isocenter[1];
 
   // Calculate sourcePosition position
-  double sourcePosition[3] = {0.0, 0.0, 0.0};
-  if (!beamNode->GetSourcePosition(sourcePosition))
+  if (!beamNode->GetSourcePosition(calculation->SourcePosition))
   {
     QString errorMessage("Failed to calculate source position");
     qCritical() << Q_FUNC_INFO << ": " << errorMessage;
     return errorMessage;
   }
 
-  // Convert reference volume to Plastimatch image
-  //TODO: Cache it so that it does not need to be reconverted every time
-  Plm_image::Pointer referenceVolumePlm = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
+  // Convert reference volume to Plastimatch image (cached, so that it is not reconverted for every beam).
+  // The cache gives a copy, so each beam has its own image
+  Plm_image::Pointer referenceVolumePlm = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode, true, true);
   referenceVolumePlm->print();
-  // Create ITK output dose volume based on the reference volume
-  itk::Image<short, 3>::Pointer referenceVolumeItk = referenceVolumePlm->itk_short();
+  calculation->ReferenceVolumeItk = referenceVolumePlm->itk_short();
+  referenceVolumeNode->GetOrigin(calculation->ReferenceOrigin);
+  referenceVolumeNode->GetSpacing(calculation->ReferenceSpacing);
+  referenceVolumeNode->GetIJKToRASDirections(calculation->ReferenceDirections);
+
+  calculation->RxDose = parentPlanNode->GetRxDose();
+  calculation->SAD = beamNode->GetSAD();
+  calculation->X1Jaw = beamNode->GetX1Jaw();
+  calculation->X2Jaw = beamNode->GetX2Jaw();
+  calculation->Y1Jaw = beamNode->GetY1Jaw();
+  calculation->Y2Jaw = beamNode->GetY2Jaw();
+
+  calculation->Algorithm = this->integerParameter(beamNode, "Algorithm");
+  calculation->KanematsuGottschalk = this->booleanParameter(beamNode, "KanematsuGottschalk");
+  calculation->RangeCompensatorSmearingRadius = this->doubleParameter(beamNode, "RangeCompensatorSmearingRadius");
+  calculation->RangeCompensatorHighland = this->booleanParameter(beamNode, "RangeCompensatorHighland");
+  calculation->SourceSize = this->doubleParameter(beamNode, "SourceSize");
+  calculation->StepLength = this->doubleParameter(beamNode, "StepLength");
+  calculation->ApertureOffset = this->doubleParameter(beamNode, "ApertureOffset");
+  calculation->PencilBeamResolution = this->doubleParameter(beamNode, "PencilBeamResolution");
+  calculation->BeamLineTypeActive = this->integerParameter(beamNode, "BeamLineTypeActive");
+  calculation->ManualEnergyLimits = this->booleanParameter(beamNode, "ManualEnergyLimits");
+  calculation->MinimumEnergy = this->doubleParameter(beamNode, "MinimumEnergy");
+  calculation->MaximumEnergy = this->doubleParameter(beamNode, "MaximumEnergy");
+  calculation->ProximalMargin = this->doubleParameter(beamNode, "ProximalMargin");
+  calculation->DistalMargin = this->doubleParameter(beamNode, "DistalMargin");
+  calculation->EnergyResolution = this->doubleParameter(beamNode, "EnergyResolution");
+  calculation->EnergySpread = this->doubleParameter(beamNode, "EnergySpread");
+
+  delete this->m_BeamCalculations.take(beamNode);
+  this->m_BeamCalculations[beamNode] = calculation.take();
+  return QString();
+}
+
+//---------------------------------------------------------------------------
+QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode)
+{
+  Q_UNUSED(resultDoseVolumeNode);
+
+  // Only the inputs taken from MRML by prepareDoseCalculationForBeam are used, as this may run in a worker thread
+  BeamCalculation* calculation = this->m_BeamCalculations.value(beamNode, NULL);
+  if (!calculation)
+  {
+    QString errorMessage("Dose calculation has not been prepared for the beam");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  // The parameters are logged to the buffer of the beam, which is printed on the main thread
+  // by finishDoseCalculationForBeam, so that the logs of parallel beams are not interleaved
+  std::ostringstream& parameterLog = calculation->Log;
 
   // Plastimatch RT plan and beam
   Rt_plan rt_plan;
@@ -234,37 +386,36 @@ QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBe
     // Assign inputs to dose calculation logic
 
     // Update plan
-    std::cout << "\n ***PLAN PARAMETERS***" << std::endl;
-    std::cout << "Setting reference volume" << std::endl;
-    rt_plan.set_patient (referenceVolumeItk);
-    std::cout << "Setting target volume" << std::endl;
-    rt_plan.set_target (targetVolumeItk);
-    std::cout << "Setting reference dose point -> ";
-    rt_plan.set_ref_dose_point(isocenter); //TODO: MD Fix, for the moment, the reference dose point is the isocenter
-    std::cout << "Reference dose position: " << rt_plan.get_ref_dose_point()[0] << " " << rt_plan.get_ref_dose_point()[1] << " " << rt_plan.get_ref_dose_point()[2] << std::endl;
+    parameterLog << "\n ***PLAN PARAMETERS***" << std::endl;
+    parameterLog << "Setting reference volume" << std::endl;
+    rt_plan.set_patient (calculation->ReferenceVolumeItk);
+    parameterLog << "Setting target volume" << std::endl;
+    rt_plan.set_target (calculation->TargetVolumeItk);
+    parameterLog << "Setting reference dose point -> ";
+    rt_plan.set_ref_dose_point(calculation->Isocenter); //TODO: MD Fix, for the moment, the reference dose point is the isocenter
+    parameterLog << "Reference dose position: " << rt_plan.get_ref_dose_point()[0] << " " << rt_plan.get_ref_dose_point()[1] << " " << rt_plan.get_ref_dose_point()[2] << std::endl;
     rt_plan.set_have_ref_dose_point(true);
     rt_plan.set_have_dose_norm(true);
-    std::cout << "Setting dose prescription -> ";
-    rt_plan.set_normalization_dose(parentPlanNode->GetRxDose());
-    std::cout << "Dose prescription = " << rt_plan.get_normalization_dose() << std::endl;
+    parameterLog << "Setting dose prescription -> ";
+    rt_plan.set_normalization_dose(calculation->RxDose);
+    parameterLog << "Dose prescription = " << rt_plan.get_normalization_dose() << std::endl;
 
     // Not needed for dose calculation: 
     // Parameter Set, Plan Contour, Dose Volume, Dose Grid
 
     // Set beam parameters
-    std::cout << std::endl << " ***BEAM PARAMETERS***" << std::endl;
+    parameterLog << std::endl << " ***BEAM PARAMETERS***" << std::endl;
 
-    std::cout << "Setting source position -> ";
-    rt_beam->set_source_position(sourcePosition);
-    std::cout << "Source position: " << rt_beam->get_source_position()[0] << " " << rt_beam->get_source_position()[1] << " " << rt_beam->get_source_position()[2] << std::endl;
+    parameterLog << "Setting source position -> ";
+    rt_beam->set_source_position(calculation->SourcePosition);
+    parameterLog << "Source position: " << rt_beam->get_source_position()[0] << " " << rt_beam->get_source_position()[1] << " " << rt_beam->get_source_position()[2] << std::endl;
 
-    std::cout << "Setting isocenter position -> ";
-    rt_beam->set_isocenter_position(isocenter);
-    std::cout << "Isocenter position: " << rt_beam->get_isocenter_position()[0] << " " << rt_beam->get_isocenter_position()[1] << " " << rt_beam->get_isocenter_position()[2] << std::endl;
+    parameterLog << "Setting isocenter position -> ";
+    rt_beam->set_isocenter_position(calculation->Isocenter);
+    parameterLog << "Isocenter position: " << rt_beam->get_isocenter_position()[0] << " " << rt_beam->get_isocenter_position()[1] << " " << rt_beam->get_isocenter_position()[2] << std::endl;
 
-    std::cout << "Setting dose calculation algorithm -> ";
-    int algorithm = this->integerParameter(beamNode, "Algorithm");
-    switch(algorithm)
+    parameterLog << "Setting dose calculation algorithm -> ";
+    switch(calculation->Algorithm)
     {
     case 1: // Pencil beam
       rt_beam->set_flavor("d");
@@ -273,150 +424,134 @@ QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBe
       rt_beam->set_flavor("b");
       break;
     }
-    std::cout << "Algorithm Flavor = " << rt_beam->get_flavor() << std::endl;
+    parameterLog << "Algorithm Flavor = " << rt_beam->get_flavor() << std::endl;
 
-    bool kgScattering = this->booleanParameter(beamNode, "KanematsuGottschalk");
-    if (kgScattering)
+    if (calculation->KanematsuGottschalk)
     {
       rt_beam->set_homo_approx('n');
-      std::cout << "Homo approximation set to false" << std::endl;
+      parameterLog << "Homo approximation set to false" << std::endl;
     }
     else
     {
       rt_beam->set_homo_approx('y');
-      std::cout << "Homo approximation set to true" << std::endl;
+      parameterLog << "Homo approximation set to true" << std::endl;
     }
 
-    std::cout << "Setting beam weight -> ";
+    parameterLog << "Setting beam weight -> ";
     rt_beam->set_beam_weight(1.0); // Beam weight is applied centrally by the dose engine logic (qSlicerDoseEngineLogic::createAccumulatedDose)
-    std::cout << "Beam weight = " << rt_beam->get_beam_weight() << std::endl;
+    parameterLog << "Beam weight = " << rt_beam->get_beam_weight() << std::endl;
 
-    std::cout << "Setting smearing -> ";
-    double rangeCompensatorSmearingRadius = this->doubleParameter(beamNode, "RangeCompensatorSmearingRadius");
-    rt_beam->set_smearing(rangeCompensatorSmearingRadius);
-    std::cout << "Smearing = " << rt_beam->get_smearing() << std::endl;
+    parameterLog << "Setting smearing -> ";
+    rt_beam->set_smearing(calculation->RangeCompensatorSmearingRadius);
+    parameterLog << "Smearing = " << rt_beam->get_smearing() << std::endl;
 
-    std::cout << "Setting Highland model for range compensator" << std::endl;
-    bool rangeCompensatorHighland = this->booleanParameter(beamNode, "RangeCompensatorHighland");
-    if (rangeCompensatorHighland)
+    parameterLog << "Setting Highland model for range compensator" << std::endl;
+    if (calculation->RangeCompensatorHighland)
     {
       rt_beam->set_rc_MC_model('n');
-      std::cout << "Highland model for range compensator set to true" << std::endl;
+      parameterLog << "Highland model for range compensator set to true" << std::endl;
     }
     else
     {
       rt_beam->set_rc_MC_model('y');
-      std::cout << "Highland model for range compensator set to false" << std::endl;
+      parameterLog << "Highland model for range compensator set to false" << std::endl;
     }
 
-    std::cout << "Setting source size -> ";
-    double sourceSize = this->doubleParameter(beamNode, "SourceSize");
-    rt_beam->set_source_size(sourceSize);
-    std::cout << "Source size = " << rt_beam->get_source_size() << std::endl;
+    parameterLog << "Setting source size -> ";
+    rt_beam->set_source_size(calculation->SourceSize);
+    parameterLog << "Source size = " << rt_beam->get_source_size() << std::endl;
 
-    std::cout << "Setting step length -> ";
-    double stepLength = this->doubleParameter(beamNode, "StepLength");
-    rt_beam->set_step_length(stepLength);
-    std::cout << "Step length = " << rt_beam->get_step_length() << std::endl;
+    parameterLog << "Setting step length -> ";
+    rt_beam->set_step_length(calculation->StepLength);
+    parameterLog << "Step length = " << rt_beam->get_step_length() << std::endl;
 
     //TODO: Add in the future: CouchAngle
 
     // Aperture parameters
-    std::cout << "\nAPERTURE PARAMETERS:" << std::endl;
+    parameterLog << "\nAPERTURE PARAMETERS:" << std::endl;
 
-    double apertureOffset = this->doubleParameter(beamNode, "ApertureOffset");
-    if (beamNode->GetSAD() < 0 || beamNode->GetSAD() < apertureOffset)
+    double apertureOffset = calculation->ApertureOffset;
+    double sad = calculation->SAD;
+    if (sad < 0 || sad < apertureOffset)
     {
-      QString errorMessage = QString("SAD (=%1) must be positive and greater than aperture offset (%2)").arg(beamNode->GetSAD()).arg(apertureOffset);
+      QString errorMessage = QString("SAD (=%1) must be positive and greater than aperture offset (%2)").arg(sad).arg(apertureOffset);
       qCritical() << Q_FUNC_INFO << ": " << errorMessage;
       return errorMessage;
     }
     double apertureOrigin[2] = {
-      beamNode->GetX1Jaw() * apertureOffset / beamNode->GetSAD(),
-      beamNode->GetY1Jaw() * apertureOffset / beamNode->GetSAD() };
+      calculation->X1Jaw * apertureOffset / sad,
+      calculation->Y1Jaw * apertureOffset / sad };
 
-    double pencilBeamResolution = this->doubleParameter(beamNode, "PencilBeamResolution");
+    double pencilBeamResolution = calculation->PencilBeamResolution;
     // Convert from spacing at isocenter to spacing at aperture
     double apertureSpacing[2] = {
-      pencilBeamResolution * apertureOffset / beamNode->GetSAD(),
-      pencilBeamResolution * apertureOffset / beamNode->GetSAD() };
+      pencilBeamResolution * apertureOffset / sad,
+      pencilBeamResolution * apertureOffset / sad };
 
     plm_long apertureDimensions[2] = {
-      (plm_long)((beamNode->GetX2Jaw() - beamNode->GetX1Jaw()) / pencilBeamResolution + 1 ),
-      (plm_long)((beamNode->GetY2Jaw() - beamNode->GetY1Jaw()) / pencilBeamResolution + 1 ) };
+      (plm_long)((calculation->X2Jaw - calculation->X1Jaw) / pencilBeamResolution + 1 ),
+      (plm_long)((calculation->Y2Jaw - calculation->Y1Jaw) / pencilBeamResolution + 1 ) };
 
-    std::cout << "Setting aperture distance -> ";
+    parameterLog << "Setting aperture distance -> ";
     rt_beam->get_aperture()->set_distance(apertureOffset);
-    std::cout << "Aperture distance = " << rt_beam->get_aperture()->get_distance() << std::endl;
+    parameterLog << "Aperture distance = " << rt_beam->get_aperture()->get_distance() << std::endl;
 
-    std::cout << "Setting aperture origin -> ";
+    parameterLog << "Setting aperture origin -> ";
     rt_beam->get_aperture()->set_origin(apertureOrigin);
-    std::cout << "Aperture origin = " << apertureOrigin[0] << " " << apertureOrigin[1] << std::endl;
+    parameterLog << "Aperture origin = " << apertureOrigin[0] << " " << apertureOrigin[1] << std::endl;
 
-    std::cout << "Setting aperture spacing -> ";
+    parameterLog << "Setting aperture spacing -> ";
     rt_beam->get_aperture()->set_spacing(apertureSpacing);
-    std::cout << "Aperture Spacing = " << rt_beam->get_aperture()->get_spacing(0) << " " << rt_beam->get_aperture()->get_spacing(1) << std::endl;
+    parameterLog << "Aperture Spacing = " << rt_beam->get_aperture()->get_spacing(0) << " " << rt_beam->get_aperture()->get_spacing(1) << std::endl;
 
-    std::cout << "Setting aperture dim -> ";
+    parameterLog << "Setting aperture dim -> ";
     rt_beam->get_aperture()->set_dim(apertureDimensions);
-    std::cout << "Aperture dim = " << rt_beam->get_aperture()->get_dim(0) << " " << rt_beam->get_aperture()->get_dim(1) << std::endl;
+    parameterLog << "Aperture dim = " << rt_beam->get_aperture()->get_dim(0) << " " << rt_beam->get_aperture()->get_dim(1) << std::endl;
 
     //TODO: Add in the future: CollimatorAngle
 
     // Update mebs parameters
-    std::cout << "\nENERGY PARAMETERS:" << std::endl;
+    parameterLog << "\nENERGY PARAMETERS:" << std::endl;
 
-    std::cout << "Setting beam line type -> ";
-    int beamLineTypeActive = this->integerParameter(beamNode, "BeamLineTypeActive");
-    if (beamLineTypeActive == 0)
+    parameterLog << "Setting beam line type -> ";
+    if (calculation->BeamLineTypeActive == 0)
     {
       rt_beam->set_beam_line_type("active");      
-      std::cout << "beam line type set to active" << std::endl;
+      parameterLog << "beam line type set to active" << std::endl;
     }
     else
     {
       rt_beam->set_beam_line_type("passive");      
-      std::cout << "beam line type set to passive" << std::endl;
+      parameterLog << "beam line type set to passive" << std::endl;
     }
 
-    std::cout << "Setting have prescription -> ";
-    bool manualEnergyLimits = this->booleanParameter(beamNode, "ManualEnergyLimits");
-    rt_beam->get_mebs()->set_have_prescription(manualEnergyLimits);
-    std::cout << "Manual energy prescription set to " << rt_beam->get_mebs()->get_have_prescription() << std::endl;
+    parameterLog << "Setting have prescription -> ";
+    rt_beam->get_mebs()->set_have_prescription(calculation->ManualEnergyLimits);
+    parameterLog << "Manual energy prescription set to " << rt_beam->get_mebs()->get_have_prescription() << std::endl;
 
     if (rt_beam->get_mebs()->get_have_prescription() == true)
     {
-      double minimumEnergy = this->doubleParameter(beamNode, "MinimumEnergy");
-      rt_beam->get_mebs()->set_energy_min(minimumEnergy);
-      double maximumEnergy = this->doubleParameter(beamNode, "MaximumEnergy");
-      rt_beam->get_mebs()->set_energy_max(maximumEnergy);
-      std::cout << "Energy min: " << rt_beam->get_mebs()->get_energy_min() << ", Energy max: " << rt_beam->get_mebs()->get_energy_max() << std::endl;
+      rt_beam->get_mebs()->set_energy_min(calculation->MinimumEnergy);
+      rt_beam->get_mebs()->set_energy_max(calculation->MaximumEnergy);
+      parameterLog << "Energy min: " << rt_beam->get_mebs()->get_energy_min() << ", Energy max: " << rt_beam->get_mebs()->get_energy_max() << std::endl;
     }
 
-    std::cout << "Setting proximal margin -> ";
-    double proximalMargin = this->doubleParameter(beamNode, "ProximalMargin");
-    rt_beam->get_mebs()->set_proximal_margin(proximalMargin);
-    std::cout << "Proximal margin = " << rt_beam->get_mebs()->get_proximal_margin() << std::endl;
-
-    std::cout << "Setting distal margin -> ";
-    double distalMargin = this->doubleParameter(beamNode, "DistalMargin");
-    rt_beam->get_mebs()->set_distal_margin(distalMargin);
-    std::cout << "Distal margin = " << rt_beam->get_mebs()->get_distal_margin() << std::endl;
-
-    std::cout << "Setting energy resolution -> ";
-    double energyResolution = this->doubleParameter(beamNode, "EnergyResolution");
-    rt_beam->get_mebs()->set_energy_resolution(energyResolution);
-    std::cout << "Energy resolution = " << rt_beam->get_mebs()->get_energy_resolution() << std::endl;
-
-    std::cout << "Setting energy spread -> ";
-    double energySpread = this->doubleParameter(beamNode, "EnergySpread");
-    rt_beam->get_mebs()->set_spread(energySpread);
-    std::cout << "Energy spread = " << rt_beam->get_mebs()->get_spread() << std::endl;
-
-    // A little warm fuzzy for the developers
-    rt_plan.print_verif ();
-    std::cout << "Working..." << std::endl;
-    fflush(stdout);
+    parameterLog << "Setting proximal margin -> ";
+    rt_beam->get_mebs()->set_proximal_margin(calculation->ProximalMargin);
+    parameterLog << "Proximal margin = " << rt_beam->get_mebs()->get_proximal_margin() << std::endl;
+
+    parameterLog << "Setting distal margin -> ";
+    rt_beam->get_mebs()->set_distal_margin(calculation->DistalMargin);
+    parameterLog << "Distal margin = " << rt_beam->get_mebs()->get_distal_margin() << std::endl;
+
+    parameterLog << "Setting energy resolution -> ";
+    rt_beam->get_mebs()->set_energy_resolution(calculation->EnergyResolution);
+    parameterLog << "Energy resolution = " << rt_beam->get_mebs()->get_energy_resolution() << std::endl;
+
+    parameterLog << "Setting energy spread -> ";
+    rt_beam->get_mebs()->set_spread(calculation->EnergySpread);
+    parameterLog << "Energy spread = " << rt_beam->get_mebs()->get_spread() << std::endl;
+
   }
   catch (std::exception& ex)
   {
@@ -437,54 +572,83 @@ QString qSlicerPlastimatchProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBe
     return errorMessage;
   }
 
-  // Get per-beam dose image and set it to result node
+  // Get per-beam dose image. The plastimatch results are not used after this point, so the image
+  // data can use their buffers directly. They are set to MRML nodes in finishDoseCalculationForBeam
   itk::Image<float, 3>::Pointer doseVolumeItk = rt_beam->get_dose()->itk_float();
+  calculation->DoseImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(doseVolumeItk, calculation->DoseImageData, VTK_FLOAT, true);
 
-  // Create dose image data to set to the volume node
-  vtkSmartPointer<vtkImageData> protonDoseImageData = vtkSmartPointer<vtkImageData>::New();
-  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(doseVolumeItk, protonDoseImageData, VTK_FLOAT);
+  // Get aperture image
+  Plm_image::Pointer& ap = rt_beam->get_aperture_image();
+  itk::Image<unsigned char, 3>::Pointer apertureVolumeItk = ap->itk_uchar();
+  calculation->ApertureImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<unsigned char>(apertureVolumeItk, calculation->ApertureImageData, VTK_UNSIGNED_CHAR, true);
+
+  // Get range compensator image
+  Plm_image::Pointer& rc = rt_beam->get_range_compensator_image();
+  itk::Image<float, 3>::Pointer rcVolumeItk = rc->itk_float();
+  calculation->RangeCompensatorImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(rcVolumeItk, calculation->RangeCompensatorImageData, VTK_FLOAT, true);
+
+  for (int i=0; i<3; ++i)
+  {
+    calculation->ApertureVolumeSpacing[i] = apertureVolumeItk->GetSpacing()[i];
+    calculation->ApertureVolumeOrigin[i] = apertureVolumeItk->GetOrigin()[i];
+    calculation->RangeCompensatorVolumeSpacing[i] = rcVolumeItk->GetSpacing()[i];
+    calculation->RangeCompensatorVolumeOrigin[i] = rcVolumeItk->GetOrigin()[i];
+  }
+
+  return QString();
+}
+
+//---------------------------------------------------------------------------
+QString qSlicerPlastimatchProtonDoseEngine::finishDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode, bool success)
+{
+  QScopedPointer<BeamCalculation> calculation(this->m_BeamCalculations.take(beamNode));
+  if (!calculation.isNull() && !calculation->Log.str().empty())
+  {
+    std::cout << "Proton dose calculation parameters of beam " << beamNode->GetName() << ":" << calculation->Log.str() << std::endl;
+  }
+  if (!success)
+  {
+    return QString();
+  }
+  if (calculation.isNull() || !calculation->DoseImageData)
+  {
+    QString errorMessage = QString("Dose has not been calculated for beam %1").arg(beamNode->GetName());
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
 
   // Set image data to result dose volume node
-  resultDoseVolumeNode->SetAndObserveImageData(protonDoseImageData);
-  resultDoseVolumeNode->CopyOrientation(referenceVolumeNode);
+  resultDoseVolumeNode->SetAndObserveImageData(calculation->DoseImageData);
+  resultDoseVolumeNode->SetOrigin(calculation->ReferenceOrigin);
+  resultDoseVolumeNode->SetSpacing(calculation->ReferenceSpacing);
+  resultDoseVolumeNode->SetIJKToRASDirections(calculation->ReferenceDirections);
 
   std::string protonDoseNodeName = std::string(beamNode->GetName()) + "_ProtonDose";
   resultDoseVolumeNode->SetName(protonDoseNodeName.c_str());
 
-  // Get aperture image, create volume node, and add as intermediate result
-  Plm_image::Pointer& ap = rt_beam->get_aperture_image();
-  itk::Image<unsigned char, 3>::Pointer apertureVolumeItk = ap->itk_uchar();
-
-  vtkSmartPointer<vtkImageData> apertureImageData = vtkSmartPointer<vtkImageData>::New();
-  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<unsigned char>(apertureVolumeItk, apertureImageData, VTK_UNSIGNED_CHAR);
-
+  // Create aperture volume node, and add as intermediate result
   vtkSmartPointer<vtkMRMLScalarVolumeNode> apertureVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  apertureVolumeNode->SetAndObserveImageData(apertureImageData);
-  apertureVolumeNode->SetSpacing(apertureVolumeItk->GetSpacing()[0], apertureVolumeItk->GetSpacing()[1], apertureVolumeItk->GetSpacing()[2]);
-  apertureVolumeNode->SetOrigin(apertureVolumeItk->GetOrigin()[0], apertureVolumeItk->GetOrigin()[1], apertureVolumeItk->GetOrigin()[2]);
+  apertureVolumeNode->SetAndObserveImageData(calculation->ApertureImageData);
+  apertureVolumeNode->SetSpacing(calculation->ApertureVolumeSpacing);
+  apertureVolumeNode->SetOrigin(calculation->ApertureVolumeOrigin);
 
   std::string apertureNodeName = std::string(beamNode->GetName()) + "_Aperture";
   apertureVolumeNode->SetName(apertureNodeName.c_str());
-  scene->AddNode(apertureVolumeNode);
-  
-  this->addIntermediateResult(apertureVolumeNode, beamNode);
-
-  // Get range compensator image, create volume node, and add as intermediate result
-  Plm_image::Pointer& rc = rt_beam->get_range_compensator_image();
-  itk::Image<float, 3>::Pointer rcVolumeItk = rc->itk_float();
 
-  vtkSmartPointer<vtkImageData> rangeCompensatorImageData = vtkSmartPointer<vtkImageData>::New();
-  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(rcVolumeItk, rangeCompensatorImageData, VTK_FLOAT);
+  this->addIntermediateResult(apertureVolumeNode, beamNode);
 
+  // Create range compensator volume node, and add as intermediate result
   vtkSmartPointer<vtkMRMLScalarVolumeNode> rangeCompensatorVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  rangeCompensatorVolumeNode->SetAndObserveImageData(rangeCompensatorImageData);
-  rangeCompensatorVolumeNode->SetSpacing(rcVolumeItk->GetSpacing()[0], rcVolumeItk->GetSpacing()[1], rcVolumeItk->GetSpacing()[2]);
-  rangeCompensatorVolumeNode->SetOrigin(rcVolumeItk->GetOrigin()[0], rcVolumeItk->GetOrigin()[1], rcVolumeItk->GetOrigin()[2]);
+  rangeCompensatorVolumeNode->SetAndObserveImageData(calculation->RangeCompensatorImageData);
+  rangeCompensatorVolumeNode->SetSpacing(calculation->RangeCompensatorVolumeSpacing);
+  rangeCompensatorVolumeNode->SetOrigin(calculation->RangeCompensatorVolumeOrigin);
 
   std::string rangeCompensatorNodeName = std::string(beamNode->GetName()) + "_RangeCompensator";
   rangeCompensatorVolumeNode->SetName(rangeCompensatorNodeName.c_str());
-  scene->AddNode(rangeCompensatorVolumeNode);
-  
+
   this->addIntermediateResult(rangeCompensatorVolumeNode, beamNode);
 
   return QString();
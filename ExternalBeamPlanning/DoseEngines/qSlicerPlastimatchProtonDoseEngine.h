@@ -27,6 +27,9 @@
 // ExternalBeamPlanning includes
 #include "qSlicerAbstractDoseEngine.h"
 
+// Qt includes
+#include <QMap>
+
 /// \ingroup SlicerRt_ExternalBeamPlanning
 /// \brief Plastimatch proton dose calculation algorithm
 class Q_SLICER_EXTERNALBEAMPLANNING_DOSE_ENGINES_EXPORT qSlicerPlastimatchProtonDoseEngine : public qSlicerAbstractDoseEngine
@@ -40,6 +43,10 @@ public:
   /// Destructor
   virtual ~qSlicerPlastimatchProtonDoseEngine();
 
+  /// Beams are calculated using separate Plastimatch plans from inputs taken from MRML beforehand,
+  /// so multiple beams can be calculated at the same time
+  virtual bool isThreadSafe();
+
 protected:
   /// Calculate dose for a single beam. Called by \sa CalculateDose that performs actions generic
   /// to any dose engine before and after calculation.
@@ -48,9 +55,22 @@ protected:
   /// \param resultDoseVolumeNode Output volume node for the result dose. It is created by \sa CalculateDose
   virtual QString calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode);
 
+  /// Convert the reference volume, the target and the beam parameters to the inputs of the beam calculation
+  virtual QString prepareDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode);
+
+  /// Set the calculated dose to the result volume and create the aperture and range compensator volumes
+  virtual QString finishDoseCalculationForBeam(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode, bool success);
+
   /// Define engine-specific beam parameters
   void defineBeamParameters();
 
+protected:
+  /// Inputs and results of the calculation of a beam
+  class BeamCalculation;
+  /// Calculation of each beam between \sa prepareDoseCalculationForBeam and \sa finishDoseCalculationForBeam.
+  /// Only read while the beams are being calculated
+  QMap<vtkMRMLRTBeamNode*, BeamCalculation*> m_BeamCalculations;
+
 private:
   Q_DISABLE_COPY(qSlicerPlastimatchProtonDoseEngine);
 };
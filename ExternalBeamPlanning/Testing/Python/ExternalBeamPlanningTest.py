@@ -37,6 +37,7 @@ class ExternalBeamPlanningTest(unittest.TestCase):
     self.TestSection_01_RetrieveInputData()
     self.TestSection_02_LoadInputData()
     self.TestSection_1_RunPlastimatchProtonDoseEngine()
+    self.TestSection_2_CalculateBeamsInParallel()
 
     logging.info('Test finished')
 
@@ -188,3 +189,90 @@ class ExternalBeamPlanningTest(unittest.TestCase):
     self.assertAlmostEqual(doseMean, 0.01670, 4)
     self.assertAlmostEqual(doseStdDev, 0.12670, 4)
     self.assertEqual(doseVoxelCount, 1000)
+
+  #------------------------------------------------------------------------------
+  def TestSection_2_CalculateBeamsInParallel(self):
+    logging.info('Test section 2: Calculate beams in parallel')
+
+    import numpy
+    from vtk.util import numpy_support
+
+    engineLogic = slicer.qSlicerDoseEngineLogic()
+    engineLogic.setMRMLScene(slicer.mrmlScene)
+
+    ctVolumeNode = slicer.util.getNode('TinyPatient_CT')
+    segmentationNode = slicer.util.getNode('TinyPatient_Structures')
+    self.assertIsNotNone(ctVolumeNode)
+    self.assertIsNotNone(segmentationNode)
+
+    totalDoseVolumeNode = slicer.vtkMRMLScalarVolumeNode()
+    totalDoseVolumeNode.SetName('TotalDoseTwoBeams')
+    slicer.mrmlScene.AddNode(totalDoseVolumeNode)
+
+    planNode = slicer.vtkMRMLRTPlanNode()
+    planNode.SetName('TestProtonPlanTwoBeams')
+    slicer.mrmlScene.AddNode(planNode)
+
+    planNode.SetAndObserveReferenceVolumeNode(ctVolumeNode)
+    planNode.SetAndObserveSegmentationNode(segmentationNode)
+    planNode.SetAndObserveOutputTotalDoseVolumeNode(totalDoseVolumeNode)
+    planNode.SetTargetSegmentID("Tumor_Contour")
+    planNode.SetIsocenterToTargetCenter()
+    planNode.SetDoseEngineName(self.plastimatchProtonDoseEngineName)
+
+    # Add two beams from different directions, with the same parameters as in section 1
+    engineHandler = slicer.qSlicerDoseEnginePluginHandler()
+    plastimatchProtonEngine = engineHandler.instance().doseEngineByName(self.plastimatchProtonDoseEngineName)
+    beamNodes = []
+    for gantryAngle in [0.0, 90.0]:
+      beamNode = engineLogic.createBeamInPlan(planNode)
+      beamNode.SetGantryAngle(gantryAngle)
+      beamNode.SetX1Jaw(-50.0)
+      beamNode.SetX2Jaw(50.0)
+      beamNode.SetY1Jaw(-50.0)
+      beamNode.SetY2Jaw(75.0)
+      plastimatchProtonEngine.setParameter(beamNode, 'EnergyResolution', 4.0)
+      plastimatchProtonEngine.setParameter(beamNode, 'RangeCompensatorSmearingRadius', 0.0)
+      plastimatchProtonEngine.setParameter(beamNode, 'ProximalMargin', 0.0)
+      plastimatchProtonEngine.setParameter(beamNode, 'DistalMargin', 0.0)
+      beamNodes.append(beamNode)
+
+    def getBeamDoseVolumeNode(beamNode):
+      numberOfDoseReferences = beamNode.GetNumberOfNodeReferences('ResultDoseRef')
+      self.assertGreater(numberOfDoseReferences, 0)
+      return beamNode.GetNthNodeReference('ResultDoseRef', numberOfDoseReferences-1)
+
+    def getVoxels(volumeNode):
+      imageData = volumeNode.GetImageData()
+      self.assertIsNotNone(imageData)
+      return (imageData.GetDimensions(), numpy.copy(numpy_support.vtk_to_numpy(imageData.GetPointData().GetScalars())))
+
+    # Calculate on the main thread, then with two threads. The results must be the same voxel by voxel
+    voxelsPerNumberOfThreads = []
+    for numberOfThreads in [1, 2]:
+      engineLogic.setNumberOfThreads(numberOfThreads)
+      errorMessage = engineLogic.calculateDose(planNode)
+      self.assertEqual(errorMessage, "")
+      voxelsPerNumberOfThreads.append([getVoxels(getBeamDoseVolumeNode(beamNode)) for beamNode in beamNodes] + [getVoxels(totalDoseVolumeNode)])
+
+    for (serialVoxels, parallelVoxels) in zip(voxelsPerNumberOfThreads[0], voxelsPerNumberOfThreads[1]):
+      self.assertEqual(serialVoxels[0], parallelVoxels[0])
+      self.assertTrue(numpy.array_equal(serialVoxels[1], parallelVoxels[1]))
+    self.assertFalse(numpy.array_equal(voxelsPerNumberOfThreads[0][0][1], voxelsPerNumberOfThreads[0][1][1]))
+
+    # Cancelled calculation keeps the previous results. Progress 0 is reported before any beam is calculated,
+    # so cancel at the first progress after it, when the new result of at least one beam already exists
+    doseVolumeNodeIDs = [getBeamDoseVolumeNode(beamNode).GetID() for beamNode in beamNodes]
+    cancelProgressValues = []
+    def cancelAfterFirstBeam(progress):
+      if progress > 0.0 and not cancelProgressValues:
+        cancelProgressValues.append(progress)
+        engineLogic.cancelDoseCalculation()
+    engineLogic.connect('progressUpdated(double)', cancelAfterFirstBeam)
+    errorMessage = engineLogic.calculateDose(planNode)
+    engineLogic.disconnect('progressUpdated(double)', cancelAfterFirstBeam)
+    self.assertEqual(len(cancelProgressValues), 1)
+    self.assertEqual(errorMessage, "Dose calculation cancelled")
+    self.assertEqual([getBeamDoseVolumeNode(beamNode).GetID() for beamNode in beamNodes], doseVolumeNodeIDs)
+    for (beamNode, voxels) in zip(beamNodes, voxelsPerNumberOfThreads[1]):
+      self.assertTrue(numpy.array_equal(getVoxels(getBeamDoseVolumeNode(beamNode))[1], voxels[1]))
@@ -66,6 +66,55 @@
 #include <QTime>
 #include <QItemSelection>
 #include <QMessageBox>
+#include <QEvent>
+
+//-----------------------------------------------------------------------------
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+/// Application event filter discarding user input during dose calculation, except for the given widget
+/// (the cancel button). Events are processed on progress update, and editing the scene meanwhile would
+/// invalidate the inputs and results of the calculation.
+class qSlicerExternalBeamPlanningInputBlocker : public QObject
+{
+public:
+  qSlicerExternalBeamPlanningInputBlocker(QWidget* allowedWidget)
+    : QObject(NULL)
+    , AllowedWidget(allowedWidget)
+  {
+  }
+
+protected:
+  virtual bool eventFilter(QObject* watched, QEvent* event)
+  {
+    switch (event->type())
+    {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+    case QEvent::Shortcut:
+    case QEvent::ShortcutOverride:
+    case QEvent::ContextMenu:
+    case QEvent::Drop:
+    case QEvent::Close:
+      {
+      QWidget* watchedWidget = qobject_cast<QWidget*>(watched);
+      if (watchedWidget && this->AllowedWidget && (watchedWidget == this->AllowedWidget || this->AllowedWidget->isAncestorOf(watchedWidget)))
+      {
+        return false;
+      }
+      return true;
+      }
+    default:
+      return false;
+    }
+  }
+
+protected:
+  QWidget* AllowedWidget;
+};
 
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
@@ -84,6 +133,8 @@ public:
   bool ModuleWindowInitialized;
   /// Dose engine logic for dose calculation related functions
   qSlicerDoseEngineLogic* DoseEngineLogic;
+  /// Flag indicating that dose calculation is running. The calculate button cancels it meanwhile
+  bool DoseCalculationInProgress;
 };
 
 //-----------------------------------------------------------------------------
@@ -94,6 +145,7 @@ qSlicerExternalBeamPlanningModuleWidgetPrivate::qSlicerExternalBeamPlanningModul
   : q_ptr(&object)
   , ModuleWindowInitialized(false)
   , DoseEngineLogic(NULL)
+  , DoseCalculationInProgress(false)
 {
   this->DoseEngineLogic = new qSlicerDoseEngineLogic(&object);
 }
@@ -962,6 +1014,14 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
 {
   Q_D(qSlicerExternalBeamPlanningModuleWidget);
 
+  // Events are processed on progress updates, so the button can be clicked during the calculation
+  if (d->DoseCalculationInProgress)
+  {
+    d->label_CalculateDoseStatus->setText("Cancelling dose calculation...");
+    d->DoseEngineLogic->cancelDoseCalculation();
+    return;
+  }
+
   d->label_CalculateDoseStatus->setText("Starting dose calculation...");
 
   if (!this->mrmlScene())
@@ -996,7 +1056,16 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
     return;
   }
   // Calculate dose
+  d->DoseCalculationInProgress = true;
+  QString previousButtonText = d->pushButton_CalculateDose->text();
+  d->pushButton_CalculateDose->setText("Cancel");
+  // Only the cancel button accepts user input until the calculation is finished
+  qSlicerExternalBeamPlanningInputBlocker inputBlocker(d->pushButton_CalculateDose);
+  qApp->installEventFilter(&inputBlocker);
   QString errorMessage = d->DoseEngineLogic->calculateDose(planNode);
+  qApp->removeEventFilter(&inputBlocker);
+  d->pushButton_CalculateDose->setText(previousButtonText);
+  d->DoseCalculationInProgress = false;
 
   if (errorMessage.isEmpty())
   {
@@ -1022,6 +1091,7 @@ void qSlicerExternalBeamPlanningModuleWidget::onProgressUpdated(double progress)
   int progressPercent = (int)(progress * 100.0);
   QString progressMessage = QString("Dose calculation in progress: %1 %").arg(progressPercent);
   d->label_CalculateDoseStatus->setText(progressMessage);
+  // Let the cancel button be clicked. Other user input is discarded meanwhile, see calculateDoseClicked
   QApplication::processEvents();
 }
 
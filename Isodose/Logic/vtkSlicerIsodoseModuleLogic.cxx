@@ -30,6 +30,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtTaskPool.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -48,8 +49,10 @@
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkCellArray.h>
 #include <vtkImageData.h>
-#include <vtkImageMarchingCubes.h>
+#include <vtkMarchingCubesTriangleCases.h>
+#include <vtkPoints.h>
 #include <vtkImageChangeInformation.h>
 #include <vtkImageReslice.h>
 #include <vtkSmartPointer.h>
@@ -63,8 +66,13 @@
 #include <vtkWindowedSincPolyDataFilter.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkObjectFactory.h>
+#include <vtkWeakPointer.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <map>
+#include <set>
+
 //----------------------------------------------------------------------------
 const char* vtkSlicerIsodoseModuleLogic::DEFAULT_ISODOSE_COLOR_TABLE_FILE_NAME = "Isodose_ColorTable.ctbl";
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX = "IsodoseLevel_";
@@ -73,6 +81,312 @@ const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTF
 
 static const char* ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE = "isodoseRootModelHierarchyRef";
 static const char* ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE = "isodoseRootModelHierarchyDisplayRef";
+static const char* ISODOSE_LEVEL_ATTRIBUTE_NAME = "IsodoseLevel";
+
+//----------------------------------------------------------------------------
+class vtkSlicerIsodoseModuleLogic::vtkInternal
+{
+public:
+  /// Copy of a cached surface in an isodose model node
+  struct ModelSurfaceCopy
+  {
+    ModelSurfaceCopy() : IsoLevel(0.0), PolyDataMTime(0) { };
+    float IsoLevel;
+    vtkWeakPointer<vtkPolyData> PolyData;
+    vtkMTimeType PolyDataMTime;
+  };
+
+  /// Isodose surfaces of a dose volume by level. Levels without surface have a NULL entry.
+  /// The surfaces are valid as long as the dose image and its geometry (including the parent transform)
+  /// are unchanged. The isodose model nodes get copies of the surfaces, so that the cache is not affected
+  /// by changes to the models.
+  struct IsodoseSurfaceCache
+  {
+    IsodoseSurfaceCache() : DoseImageDataMTime(0) { };
+    vtkWeakPointer<vtkImageData> DoseImageData;
+    vtkMTimeType DoseImageDataMTime;
+    /// IJK to RAS matrix and parent transform to world matrix elements
+    std::vector<double> DoseGeometry;
+    std::map<float, vtkSmartPointer<vtkPolyData> > Surfaces;
+    /// Surface copies in the isodose model nodes by model node ID. A copy is only replaced if its level
+    /// has been extracted again or the model poly data has been changed since it was copied.
+    std::map<std::string, ModelSurfaceCopy> ModelSurfaceCopies;
+  };
+
+  /// Cached isodose surfaces by dose volume node ID
+  std::map<std::string, IsodoseSurfaceCache> IsodoseSurfaceCaches;
+};
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Surface of one distinct isodose level
+  struct IsodoseSurfaceTask
+  {
+    IsodoseSurfaceTask() : IsoLevel(0.0) { }
+    double IsoLevel;
+    /// Contour of the level from the common marching cubes pass. NULL if the level is not crossed.
+    vtkSmartPointer<vtkPolyData> ContourPolyData;
+    vtkSmartPointer<vtkPolyData> SurfacePolyData;
+  };
+
+  //----------------------------------------------------------------------------
+  struct IsodoseSurfaceTaskList
+  {
+    IsodoseSurfaceTaskList() : Tasks(NULL), IJKToRASMatrix(NULL) { }
+    std::vector<IsodoseSurfaceTask>* Tasks;
+    vtkMatrix4x4* IJKToRASMatrix;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Cube corners and edges in the numbering of vtkMarchingCubesTriangleCases (same as vtkImageMarchingCubes)
+  const int CUBE_CORNER_OFFSETS[8][3] = { {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1} };
+  const int CUBE_EDGE_START_CORNERS[12] = { 0, 1, 3, 0, 4, 5, 7, 4, 0, 1, 3, 2 };
+  const int CUBE_EDGE_AXES[12] = { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 };
+
+  //----------------------------------------------------------------------------
+  /// Point IDs of the voxel edges crossed by the isodose levels, for the edges of one layer of cubes.
+  /// The points are keyed by edge and level, so that the levels crossing the same edge get their own
+  /// points. The edges are stored the same way as in vtkImageMarchingCubes: five edges per voxel,
+  /// the edges shared by neighboring cubes are mapped to the same entry.
+  class IsodoseEdgePointLocator
+  {
+  public:
+    IsodoseEdgePointLocator(int numberOfLevels, int dimensionX, int dimensionY)
+      : NumberOfLevels(numberOfLevels)
+      , DimensionX(dimensionX)
+      , PointIds((size_t)numberOfLevels * 5 * dimensionX * dimensionY, -1)
+    {
+    }
+
+    /// Get the point ID of an edge of the cube at (x, y) in the current layer for a level. -1 if not yet created.
+    vtkIdType& GetPointId(int level, int x, int y, int edge)
+    {
+      switch (edge)
+      {
+        case 1: ++x; edge = 3; break;
+        case 2: ++y; edge = 0; break;
+        case 5: ++x; edge = 7; break;
+        case 6: ++y; edge = 4; break;
+        case 9: ++x; edge = 8; break;
+        case 10: ++y; edge = 8; break;
+        case 11: ++x; ++y; edge = 8; break;
+      }
+      int slot = (edge == 7 ? 1 : (edge == 8 ? 2 : edge));
+      return this->PointIds[(((size_t)y * this->DimensionX + x) * 5 + slot) * this->NumberOfLevels + level];
+    }
+
+    /// Move to the next layer of cubes: the edges on the top of the cubes become the edges at the bottom
+    void IncrementZ()
+    {
+      size_t voxelStride = (size_t)5 * this->NumberOfLevels;
+      for (size_t voxelStart = 0; voxelStart < this->PointIds.size(); voxelStart += voxelStride)
+      {
+        vtkIdType* voxelPointIds = &this->PointIds[voxelStart];
+        for (int level = 0; level < this->NumberOfLevels; ++level)
+        {
+          voxelPointIds[0 * this->NumberOfLevels + level] = voxelPointIds[4 * this->NumberOfLevels + level];
+          voxelPointIds[3 * this->NumberOfLevels + level] = voxelPointIds[1 * this->NumberOfLevels + level];
+          voxelPointIds[1 * this->NumberOfLevels + level] = -1;
+          voxelPointIds[2 * this->NumberOfLevels + level] = -1;
+          voxelPointIds[4 * this->NumberOfLevels + level] = -1;
+        }
+      }
+    }
+
+  private:
+    int NumberOfLevels;
+    int DimensionX;
+    std::vector<vtkIdType> PointIds;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Contour all isodose levels in a single marching cubes pass over the dose image. The points and triangles
+  /// of each level go to the poly data of the level, in the same order and at the same positions as if the
+  /// level had been contoured alone by vtkImageMarchingCubes.
+  template <class T>
+  void ContourIsodoseLevels(vtkImageData* doseImageData, T* doseScalars, std::vector<IsodoseSurfaceTask>& tasks)
+  {
+    int extent[6] = {0, -1, 0, -1, 0, -1};
+    doseImageData->GetExtent(extent);
+    double origin[3] = {0.0, 0.0, 0.0};
+    doseImageData->GetOrigin(origin);
+    double spacing[3] = {0.0, 0.0, 0.0};
+    doseImageData->GetSpacing(spacing);
+    vtkIdType increments[3] = {0, 0, 0};
+    doseImageData->GetIncrements(increments);
+    int dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+
+    int numberOfLevels = (int)tasks.size();
+    std::vector<vtkSmartPointer<vtkPoints> > levelPoints(numberOfLevels);
+    std::vector<vtkSmartPointer<vtkCellArray> > levelTriangles(numberOfLevels);
+    for (int level = 0; level < numberOfLevels; ++level)
+    {
+      levelPoints[level] = vtkSmartPointer<vtkPoints>::New();
+      levelTriangles[level] = vtkSmartPointer<vtkCellArray>::New();
+    }
+
+    vtkIdType cornerIncrements[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (int corner = 0; corner < 8; ++corner)
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        cornerIncrements[corner] += CUBE_CORNER_OFFSETS[corner][axis] * increments[axis];
+      }
+    }
+
+    vtkMarchingCubesTriangleCases* triangleCases = vtkMarchingCubesTriangleCases::GetCases();
+    IsodoseEdgePointLocator locator(numberOfLevels, dimensions[0], dimensions[1]);
+    double cornerValues[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    for (int z = 0; z < dimensions[2]-1; ++z)
+    {
+      for (int y = 0; y < dimensions[1]-1; ++y)
+      {
+        for (int x = 0; x < dimensions[0]-1; ++x)
+        {
+          // Read the dose at the cube corners once for all levels
+          T* cubePtr = doseScalars + x * increments[0] + y * increments[1] + z * increments[2];
+          for (int corner = 0; corner < 8; ++corner)
+          {
+            cornerValues[corner] = (double)cubePtr[cornerIncrements[corner]];
+          }
+
+          for (int level = 0; level < numberOfLevels; ++level)
+          {
+            double isoLevel = tasks[level].IsoLevel;
+            int cubeIndex = 0;
+            for (int corner = 0; corner < 8; ++corner)
+            {
+              if (cornerValues[corner] > isoLevel)
+              {
+                cubeIndex |= (1 << corner);
+              }
+            }
+            if (cubeIndex == 0 || cubeIndex == 255)
+            {
+              continue;
+            }
+
+            EDGE_LIST* edge = triangleCases[cubeIndex].edges;
+            while (*edge > -1)
+            {
+              vtkIdType triangle[3] = {0, 0, 0};
+              for (int i = 0; i < 3; ++i, ++edge)
+              {
+                vtkIdType& pointId = locator.GetPointId(level, x, y, *edge);
+                if (pointId < 0)
+                {
+                  // Interpolate the point on the edge the same way as vtkImageMarchingCubes
+                  int startCorner = CUBE_EDGE_START_CORNERS[*edge];
+                  int edgeAxis = CUBE_EDGE_AXES[*edge];
+                  T* startPtr = cubePtr + cornerIncrements[startCorner];
+                  T* endPtr = startPtr + increments[edgeAxis];
+                  double edgePosition = (isoLevel - *startPtr) / (*endPtr - *startPtr);
+                  int index[3] = { extent[0] + x, extent[2] + y, extent[4] + z };
+                  double point[3] = {0.0, 0.0, 0.0};
+                  for (int axis = 0; axis < 3; ++axis)
+                  {
+                    double position = (double)(index[axis] + CUBE_CORNER_OFFSETS[startCorner][axis]);
+                    point[axis] = origin[axis] + spacing[axis] * (axis == edgeAxis ? position + edgePosition : position);
+                  }
+                  pointId = levelPoints[level]->InsertNextPoint(point);
+                }
+                triangle[i] = pointId;
+              }
+              levelTriangles[level]->InsertNextCell(3, triangle);
+            }
+          }
+        }
+      }
+      locator.IncrementZ();
+    }
+
+    for (int level = 0; level < numberOfLevels; ++level)
+    {
+      if (levelPoints[level]->GetNumberOfPoints() < 1)
+      {
+        continue;
+      }
+      tasks[level].ContourPolyData = vtkSmartPointer<vtkPolyData>::New();
+      tasks[level].ContourPolyData->SetPoints(levelPoints[level]);
+      tasks[level].ContourPolyData->SetPolys(levelTriangles[level]);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Decimate, smooth and transform the contour of one isodose level to RAS
+  void CreateIsodoseSurface(IsodoseSurfaceTask& task, vtkMatrix4x4* ijkToRasMatrix)
+  {
+    // Release the contour, the tasks are not executed again
+    vtkSmartPointer<vtkPolyData> isoPolyData = task.ContourPolyData;
+    task.ContourPolyData = NULL;
+    if (!isoPolyData)
+    {
+      return;
+    }
+
+    vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+    triangleFilter->SetInputData(isoPolyData);
+    triangleFilter->Update();
+
+    vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+    decimate->SetInputData(triangleFilter->GetOutput());
+    decimate->SetTargetReduction(0.6);
+    decimate->SetFeatureAngle(60);
+    decimate->SplittingOff();
+    decimate->PreserveTopologyOn();
+    decimate->SetMaximumError(1);
+    decimate->Update();
+
+    vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+    smootherSinc->SetPassBand(0.1);
+    smootherSinc->SetInputData(decimate->GetOutput() );
+    smootherSinc->SetNumberOfIterations(2);
+    smootherSinc->FeatureEdgeSmoothingOff();
+    smootherSinc->BoundarySmoothingOff();
+    smootherSinc->Update();
+
+    vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputData(smootherSinc->GetOutput());
+    normals->ComputePointNormalsOn();
+    normals->SetFeatureAngle(60);
+    normals->Update();
+
+    vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
+    inputIJKToRASTransform->Identity();
+    inputIJKToRASTransform->SetMatrix(ijkToRasMatrix);
+
+    vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+    transformPolyData->SetInputData(normals->GetOutput());
+    transformPolyData->SetTransform(inputIJKToRASTransform);
+    transformPolyData->Update();
+
+    task.SurfacePolyData = transformPolyData->GetOutput();
+  }
+
+  //----------------------------------------------------------------------------
+  void CreateIsodoseSurfaceTaskFunction(void* userData, int taskIndex)
+  {
+    IsodoseSurfaceTaskList* taskList = static_cast<IsodoseSurfaceTaskList*>(userData);
+    CreateIsodoseSurface((*taskList->Tasks)[taskIndex], taskList->IJKToRASMatrix);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Remove an isodose model hierarchy node with its model and model display node
+  void RemoveIsodoseModel(vtkMRMLScene* scene, vtkMRMLHierarchyNode* isodoseModelHierarchyNode)
+  {
+    vtkMRMLModelNode* isodoseModelNode = vtkMRMLModelNode::SafeDownCast(isodoseModelHierarchyNode->GetAssociatedNode());
+    if (isodoseModelNode)
+    {
+      if (isodoseModelNode->GetDisplayNode())
+      {
+        scene->RemoveNode(isodoseModelNode->GetDisplayNode());
+      }
+      scene->RemoveNode(isodoseModelNode);
+    }
+    scene->RemoveNode(isodoseModelHierarchyNode);
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
@@ -80,17 +394,25 @@ vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::vtkSlicerIsodoseModuleLogic()
 {
+  this->NumberOfThreads = 0;
+  this->Internal = new vtkInternal();
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::~vtkSlicerIsodoseModuleLogic()
 {
+  if (this->Internal)
+  {
+    delete this->Internal;
+    this->Internal = NULL;
+  }
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerIsodoseModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -153,6 +475,8 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneEndClose()
     return;
   }
 
+  this->Internal->IsodoseSurfaceCaches.clear();
+
   this->Modified();
 }
 
@@ -186,6 +510,12 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
     return;
   }
 
+  // Release the cached isodose surfaces of a removed dose volume
+  if (node->IsA("vtkMRMLScalarVolumeNode") && node->GetID())
+  {
+    this->Internal->IsodoseSurfaceCaches.erase(node->GetID());
+  }
+
   // if the scene is still updating, jump out
   if (this->GetMRMLScene()->IsBatchProcessing())
   {
@@ -424,6 +754,14 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     return;
   }
 
+  // Get color table
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!colorTableNode)
+  {
+    vtkErrorMacro("CreateIsodoseSurfaces: Invalid isodose color table!");
+    return;
+  }
+
   this->GetMRMLScene()->StartState(vtkMRMLScene::BatchProcessState); 
 
   // Get subject hierarchy item for the dose volume
@@ -433,7 +771,8 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     vtkErrorMacro("CreateIsodoseSurfaces: Failed to get subject hierarchy item for dose volume '" << doseVolumeNode->GetName() << "'");
   }
 
-  // Model hierarchy node for the loaded structure set
+  // Model hierarchy node for the isodose surfaces. It is kept if already exists, so that the models
+  // of the levels that are still in the color table can be updated in place
   vtkMRMLModelHierarchyNode* rootModelHierarchyNode = vtkMRMLModelHierarchyNode::SafeDownCast( doseVolumeNode->GetNodeReference(ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE) );
   if (!rootModelHierarchyNode)
   {
@@ -441,36 +780,14 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     this->GetMRMLScene()->AddNode(rootModelHierarchyNode);
     rootModelHierarchyNode->Delete();
   }
-  else 
-  {
-    std::vector< vtkMRMLHierarchyNode *> children = rootModelHierarchyNode->GetChildrenNodes(); 
-    for (unsigned int i=0; i<children.size(); i++)
-    {
-      vtkMRMLHierarchyNode *child = children[i];
-      vtkMRMLModelNode* mnode = vtkMRMLModelNode::SafeDownCast(child->GetAssociatedNode());
-      this->GetMRMLScene()->RemoveNode(mnode);
-      this->GetMRMLScene()->RemoveNode(child);
-    }
-    this->GetMRMLScene()->RemoveNode(rootModelHierarchyNode);
-    rootModelHierarchyNode = vtkMRMLModelHierarchyNode::New();
-    this->GetMRMLScene()->AddNode(rootModelHierarchyNode);
-    rootModelHierarchyNode->Delete();    
-  }
   std::string modelHierarchyNodeName = std::string(doseVolumeNode->GetName()) + vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX;
   rootModelHierarchyNode->SetName(modelHierarchyNodeName.c_str());
   doseVolumeNode->SetNodeReferenceID(ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE, rootModelHierarchyNode->GetID());
  
   // Create display node for the model hierarchy node
   vtkMRMLModelDisplayNode* rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::SafeDownCast( doseVolumeNode->GetNodeReference(ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE) );
-  if (rootModelHierarchyDisplayNode)
-  {
-    rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::New();
-    this->GetMRMLScene()->AddNode(rootModelHierarchyDisplayNode);
-    rootModelHierarchyDisplayNode->Delete();
-  }
-  else
+  if (!rootModelHierarchyDisplayNode)
   {
-    this->GetMRMLScene()->RemoveNode(rootModelHierarchyDisplayNode);
     rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::New();
     this->GetMRMLScene()->AddNode(rootModelHierarchyDisplayNode);
     rootModelHierarchyDisplayNode->Delete();
@@ -480,142 +797,275 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   rootModelHierarchyNode->SetAndObserveDisplayNodeID( rootModelHierarchyDisplayNode->GetID() );
   doseVolumeNode->SetNodeReferenceID(ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE, rootModelHierarchyDisplayNode->GetID() );
 
-  // Remove previous isodoses
-  shNode->RemoveItemChildren(doseShItemID, true, false);
-
-  // Get color table
-  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  // Collect the existing isodose models by level. Models that cannot be matched to a level are removed.
+  std::multimap<float, vtkMRMLModelHierarchyNode*> existingIsodoseModelHierarchyNodes;
+  std::vector<vtkMRMLHierarchyNode*> children = rootModelHierarchyNode->GetChildrenNodes();
+  for (unsigned int i=0; i<children.size(); i++)
+  {
+    vtkMRMLModelHierarchyNode* childModelHierarchyNode = vtkMRMLModelHierarchyNode::SafeDownCast(children[i]);
+    vtkMRMLModelNode* childModelNode = vtkMRMLModelNode::SafeDownCast(children[i]->GetAssociatedNode());
+    const char* isoLevelAttribute = (childModelNode ? childModelNode->GetAttribute(ISODOSE_LEVEL_ATTRIBUTE_NAME) : NULL);
+    if (!childModelHierarchyNode || !isoLevelAttribute)
+    {
+      RemoveIsodoseModel(this->GetMRMLScene(), children[i]);
+      continue;
+    }
+    existingIsodoseModelHierarchyNodes.insert(
+      std::make_pair((float)vtkVariant(isoLevelAttribute).ToDouble(), childModelHierarchyNode) );
+  }
 
-  // Progress
-  int stepCount = 1 /* reslice step */ + colorTableNode->GetNumberOfColors();
-  int currentStep = 0;
+  // Remove previous isodoses from under the dose in subject hierarchy, except for the models that are updated in place
+  if (doseShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    std::set<vtkMRMLNode*> existingIsodoseModelNodes;
+    for (std::multimap<float, vtkMRMLModelHierarchyNode*>::iterator existingModelIt = existingIsodoseModelHierarchyNodes.begin();
+      existingModelIt != existingIsodoseModelHierarchyNodes.end(); ++existingModelIt)
+    {
+      existingIsodoseModelNodes.insert(existingModelIt->second->GetAssociatedNode());
+    }
+    std::vector<vtkIdType> doseChildItemIDs;
+    shNode->GetItemChildren(doseShItemID, doseChildItemIDs, false);
+    for (std::vector<vtkIdType>::iterator childItemIt = doseChildItemIDs.begin(); childItemIt != doseChildItemIDs.end(); ++childItemIt)
+    {
+      if (existingIsodoseModelNodes.find(shNode->GetItemDataNode(*childItemIt)) == existingIsodoseModelNodes.end())
+      {
+        shNode->RemoveItem(*childItemIt, true, false);
+      }
+    }
+  }
 
-  // Reslice dose volume
+  // Get dose volume geometry
   vtkSmartPointer<vtkMatrix4x4> inputIJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   doseVolumeNode->GetIJKToRASMatrix(inputIJK2RASMatrix);
   vtkSmartPointer<vtkMatrix4x4> inputRAS2IJKMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   doseVolumeNode->GetRASToIJKMatrix(inputRAS2IJKMatrix); 
 
-  vtkSmartPointer<vtkTransform> outputIJK2IJKResliceTransform = vtkSmartPointer<vtkTransform>::New(); 
-  outputIJK2IJKResliceTransform->Identity();
-  outputIJK2IJKResliceTransform->PostMultiply();
-  outputIJK2IJKResliceTransform->SetMatrix(inputIJK2RASMatrix);
-
   vtkSmartPointer<vtkMRMLTransformNode> inputVolumeNodeTransformNode = doseVolumeNode->GetParentTransformNode();
   vtkSmartPointer<vtkMatrix4x4> inputRAS2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
   if (inputVolumeNodeTransformNode!=NULL)
   {
     inputVolumeNodeTransformNode->GetMatrixTransformToWorld(inputRAS2RASMatrix);  
-    outputIJK2IJKResliceTransform->Concatenate(inputRAS2RASMatrix);
   }
-  
-  outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
-  outputIJK2IJKResliceTransform->Inverse();
-
-  int dimensions[3] = {0, 0, 0};
-  doseVolumeNode->GetImageData()->GetDimensions(dimensions);
-  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
-  reslice->SetInputData(doseVolumeNode->GetImageData());
-  reslice->SetOutputOrigin(0, 0, 0);
-  reslice->SetOutputSpacing(1, 1, 1);
-  reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
-  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
-  reslice->Update();
-  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+
+  // Get the surfaces cached for the dose volume. They are discarded if the dose or its geometry has changed.
+  vtkImageData* doseImageData = doseVolumeNode->GetImageData();
+  std::vector<double> doseGeometry(32, 0.0);
+  for (int row=0; row<4; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      doseGeometry[4*row + column] = inputIJK2RASMatrix->GetElement(row, column);
+      doseGeometry[16 + 4*row + column] = inputRAS2RASMatrix->GetElement(row, column);
+    }
+  }
+  vtkInternal::IsodoseSurfaceCache& surfaceCache = this->Internal->IsodoseSurfaceCaches[doseVolumeNode->GetID()];
+  if ( surfaceCache.DoseImageData.GetPointer() != doseImageData
+    || surfaceCache.DoseImageDataMTime != doseImageData->GetMTime()
+    || surfaceCache.DoseGeometry != doseGeometry )
+  {
+    surfaceCache.Surfaces.clear();
+    surfaceCache.ModelSurfaceCopies.clear();
+    surfaceCache.DoseImageData = doseImageData;
+    surfaceCache.DoseImageDataMTime = doseImageData->GetMTime();
+    surfaceCache.DoseGeometry = doseGeometry;
+  }
+
+  // Collect the distinct isodose levels that are not in the cache. Levels with the same dose value share the surface.
+  std::vector<IsodoseSurfaceTask> surfaceTasks;
+  std::set<float> isoLevels;
+  for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
+  {
+    double isoLevel = vtkVariant(colorTableNode->GetColorName(i)).ToDouble();
+    if (!isoLevels.insert((float)isoLevel).second || surfaceCache.Surfaces.find((float)isoLevel) != surfaceCache.Surfaces.end())
+    {
+      continue;
+    }
+    IsodoseSurfaceTask task;
+    task.IsoLevel = isoLevel;
+    surfaceTasks.push_back(task);
+  }
+
+  // Forget the surfaces of the levels that have been removed from the color table
+  for (std::map<float, vtkSmartPointer<vtkPolyData> >::iterator surfaceIt = surfaceCache.Surfaces.begin(); surfaceIt != surfaceCache.Surfaces.end(); )
+  {
+    if (isoLevels.find(surfaceIt->first) == isoLevels.end())
+    {
+      surfaceCache.Surfaces.erase(surfaceIt++);
+    }
+    else
+    {
+      ++surfaceIt;
+    }
+  }
+
+  // Progress
+  int stepCount = 1 /* reslice step */ + 1 /* surface extraction step */ + colorTableNode->GetNumberOfColors();
+  int currentStep = 0;
+  double progress = 0.0;
+
+  if (!surfaceTasks.empty())
+  {
+    // Reslice dose volume
+    vtkSmartPointer<vtkTransform> outputIJK2IJKResliceTransform = vtkSmartPointer<vtkTransform>::New(); 
+    outputIJK2IJKResliceTransform->Identity();
+    outputIJK2IJKResliceTransform->PostMultiply();
+    outputIJK2IJKResliceTransform->SetMatrix(inputIJK2RASMatrix);
+    if (inputVolumeNodeTransformNode!=NULL)
+    {
+      outputIJK2IJKResliceTransform->Concatenate(inputRAS2RASMatrix);
+    }
+    outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
+    outputIJK2IJKResliceTransform->Inverse();
+
+    int dimensions[3] = {0, 0, 0};
+    doseImageData->GetDimensions(dimensions);
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData(doseImageData);
+    reslice->SetOutputOrigin(0, 0, 0);
+    reslice->SetOutputSpacing(1, 1, 1);
+    reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
+    reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
+    reslice->Update();
+    vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+
+    // Report progress
+    ++currentStep;
+    progress = (double)(currentStep) / (double)stepCount;
+    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+
+    // Contour all levels in one pass over the dose, then decimate, smooth and transform the surfaces of the levels in parallel
+    switch (reslicedDoseVolumeImage->GetScalarType())
+    {
+      vtkTemplateMacro(ContourIsodoseLevels(reslicedDoseVolumeImage, static_cast<VTK_TT*>(reslicedDoseVolumeImage->GetScalarPointer()), surfaceTasks));
+      default:
+        vtkErrorMacro("CreateIsodoseSurfaces: Unsupported dose scalar type " << reslicedDoseVolumeImage->GetScalarTypeAsString());
+        break;
+    }
+    IsodoseSurfaceTaskList taskList;
+    taskList.Tasks = &surfaceTasks;
+    taskList.IJKToRASMatrix = inputIJK2RASMatrix;
+    vtkSlicerRtTaskPool::ExecuteTasks((int)surfaceTasks.size(), CreateIsodoseSurfaceTaskFunction, &taskList, this->NumberOfThreads);
+
+    // Empty levels are cached too (with no surface), so that they are not extracted again
+    for (std::vector<IsodoseSurfaceTask>::iterator taskIt = surfaceTasks.begin(); taskIt != surfaceTasks.end(); ++taskIt)
+    {
+      surfaceCache.Surfaces[(float)taskIt->IsoLevel] = taskIt->SurfacePolyData;
+    }
+  }
+  else
+  {
+    // Nothing to extract
+    ++currentStep;
+  }
 
   // Report progress
   ++currentStep;
-  double progress = (double)(currentStep) / (double)stepCount;
+  progress = (double)(currentStep) / (double)stepCount;
   this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
 
-  // Create isodose surfaces
+  // Get dose unit name
+  std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
+    doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+
+  // Levels extracted in this call. The models of these levels get a new copy of the surface.
+  std::set<float> extractedIsoLevels;
+  for (std::vector<IsodoseSurfaceTask>::iterator taskIt = surfaceTasks.begin(); taskIt != surfaceTasks.end(); ++taskIt)
+  {
+    extractedIsoLevels.insert((float)taskIt->IsoLevel);
+  }
+
+  // Create or update isodose models
+  std::map<std::string, vtkInternal::ModelSurfaceCopy> modelSurfaceCopies;
+  int isodoseModelIndex = 0;
   for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
   {
     double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
     const char* strIsoLevel = colorTableNode->GetColorName(i);
-    double isoLevel = vtkVariant(strIsoLevel).ToDouble();
+    float isoLevel = (float)vtkVariant(strIsoLevel).ToDouble();
     colorTableNode->GetColor(i, val);
 
-    vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
-    marchingCubes->SetInputData(reslicedDoseVolumeImage);
-    marchingCubes->SetNumberOfContours(1); 
-    marchingCubes->SetValue(0, isoLevel);
-    marchingCubes->ComputeScalarsOff();
-    marchingCubes->ComputeGradientsOff();
-    marchingCubes->ComputeNormalsOff();
-    marchingCubes->Update();
-
-    vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
-    if (isoPolyData->GetNumberOfPoints() >= 1)
+    // Take the existing model of the level if any
+    vtkMRMLModelHierarchyNode* isodoseModelHierarchyNode = NULL;
+    std::multimap<float, vtkMRMLModelHierarchyNode*>::iterator existingModelIt = existingIsodoseModelHierarchyNodes.find(isoLevel);
+    if (existingModelIt != existingIsodoseModelHierarchyNodes.end())
     {
-      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
-      triangleFilter->SetInputData(marchingCubes->GetOutput());
-      triangleFilter->Update();
-
-      vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
-      decimate->SetInputData(triangleFilter->GetOutput());
-      decimate->SetTargetReduction(0.6);
-      decimate->SetFeatureAngle(60);
-      decimate->SplittingOff();
-      decimate->PreserveTopologyOn();
-      decimate->SetMaximumError(1);
-      decimate->Update();
-
-      vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
-      smootherSinc->SetPassBand(0.1);
-      smootherSinc->SetInputData(decimate->GetOutput() );
-      smootherSinc->SetNumberOfIterations(2);
-      smootherSinc->FeatureEdgeSmoothingOff();
-      smootherSinc->BoundarySmoothingOff();
-      smootherSinc->Update();
-
-      vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-      normals->SetInputData(smootherSinc->GetOutput());
-      normals->ComputePointNormalsOn();
-      normals->SetFeatureAngle(60);
-      normals->Update();
-
-      vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
-      inputIJKToRASTransform->Identity();
-      inputIJKToRASTransform->SetMatrix(inputIJK2RASMatrix);
-
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetInputData(normals->GetOutput());
-      transformPolyData->SetTransform(inputIJKToRASTransform);
-      transformPolyData->Update();
-  
-      vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
-      displayNode = vtkMRMLModelDisplayNode::SafeDownCast(this->GetMRMLScene()->AddNode(displayNode));
-      displayNode->SliceIntersectionVisibilityOn();  
-      displayNode->VisibilityOn(); 
+      isodoseModelHierarchyNode = existingModelIt->second;
+      existingIsodoseModelHierarchyNodes.erase(existingModelIt);
+    }
+
+    vtkPolyData* isodoseSurfacePolyData = surfaceCache.Surfaces[isoLevel];
+    if (!isodoseSurfacePolyData)
+    {
+      // No surface at this level
+      if (isodoseModelHierarchyNode)
+      {
+        RemoveIsodoseModel(this->GetMRMLScene(), isodoseModelHierarchyNode);
+      }
+    }
+    else
+    {
+      vtkMRMLModelNode* isodoseModelNode = NULL;
+      vtkMRMLModelDisplayNode* displayNode = NULL;
+      if (isodoseModelHierarchyNode)
+      {
+        isodoseModelNode = vtkMRMLModelNode::SafeDownCast(isodoseModelHierarchyNode->GetAssociatedNode());
+        displayNode = isodoseModelNode->GetModelDisplayNode();
+      }
+      if (!displayNode)
+      {
+        vtkSmartPointer<vtkMRMLModelDisplayNode> newDisplayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
+        displayNode = vtkMRMLModelDisplayNode::SafeDownCast(this->GetMRMLScene()->AddNode(newDisplayNode));
+        displayNode->SliceIntersectionVisibilityOn();  
+        displayNode->VisibilityOn(); 
+
+        // Disable backface culling to make the back side of the model visible as well
+        displayNode->SetBackfaceCulling(0);
+      }
       displayNode->SetColor(val[0], val[1], val[2]);
       displayNode->SetOpacity(val[3]);
-    
-      // Disable backface culling to make the back side of the model visible as well
-      displayNode->SetBackfaceCulling(0);
 
-      // Get dose unit name
-      std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
-        doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
-
-      vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
-      isodoseModelNode = vtkMRMLModelNode::SafeDownCast(this->GetMRMLScene()->AddNode(isodoseModelNode));
       std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
+      if (!isodoseModelNode)
+      {
+        vtkSmartPointer<vtkMRMLModelNode> newIsodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
+        isodoseModelNode = vtkMRMLModelNode::SafeDownCast(this->GetMRMLScene()->AddNode(newIsodoseModelNode));
+        isodoseModelNode->SetSelectable(1);
+        isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+        shNode->RequestOwnerPluginSearch(isodoseModelNode); // The attribute above distinguishes isodoses from regular models
+
+        // Put the new node in the model hierarchy
+        vtkSmartPointer<vtkMRMLModelHierarchyNode> newIsodoseModelHierarchyNode = vtkSmartPointer<vtkMRMLModelHierarchyNode>::New();
+        this->GetMRMLScene()->AddNode(newIsodoseModelHierarchyNode);
+        isodoseModelHierarchyNode = newIsodoseModelHierarchyNode;
+        isodoseModelHierarchyNode->SetModelNodeID(isodoseModelNode->GetID());
+        isodoseModelHierarchyNode->SetParentNodeID(rootModelHierarchyNode->GetID());
+        isodoseModelHierarchyNode->HideFromEditorsOn();
+      }
       isodoseModelNode->SetName(isodoseModelNodeName.c_str());
-      isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
-      isodoseModelNode->SetAndObservePolyData(transformPolyData->GetOutput());
-      isodoseModelNode->SetSelectable(1);
-      isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
-      shNode->RequestOwnerPluginSearch(isodoseModelNode); // The attribute above distinguishes isodoses from regular models
-
-      // Put the new node in the model hierarchy
-      vtkSmartPointer<vtkMRMLModelHierarchyNode> isodoseModelHierarchyNode = vtkSmartPointer<vtkMRMLModelHierarchyNode>::New();
-      this->GetMRMLScene()->AddNode(isodoseModelHierarchyNode);
-      std::string modelHierarchyNodeName = std::string(isodoseModelNodeName) + vtkSlicerRtCommon::DICOMRTIMPORT_MODEL_HIERARCHY_NODE_NAME_POSTFIX;
-      isodoseModelHierarchyNode->SetName(modelHierarchyNodeName.c_str());
-      isodoseModelHierarchyNode->SetModelNodeID(isodoseModelNode->GetID());
-      isodoseModelHierarchyNode->SetParentNodeID(rootModelHierarchyNode->GetID());
-      isodoseModelHierarchyNode->HideFromEditorsOn();
+      isodoseModelNode->SetAttribute(ISODOSE_LEVEL_ATTRIBUTE_NAME, strIsoLevel);
+      if (isodoseModelNode->GetDisplayNode() != displayNode)
+      {
+        isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
+      }
+
+      // Copy the cached surface to the model, unless the model already has an unchanged copy of it
+      vtkInternal::ModelSurfaceCopy surfaceCopy = surfaceCache.ModelSurfaceCopies[isodoseModelNode->GetID()];
+      vtkPolyData* modelPolyData = isodoseModelNode->GetPolyData();
+      if ( !modelPolyData || extractedIsoLevels.find(isoLevel) != extractedIsoLevels.end() || surfaceCopy.IsoLevel != isoLevel
+        || surfaceCopy.PolyData.GetPointer() != modelPolyData || surfaceCopy.PolyDataMTime != modelPolyData->GetMTime() )
+      {
+        vtkSmartPointer<vtkPolyData> isodoseSurfacePolyDataCopy = vtkSmartPointer<vtkPolyData>::New();
+        isodoseSurfacePolyDataCopy->DeepCopy(isodoseSurfacePolyData);
+        isodoseModelNode->SetAndObservePolyData(isodoseSurfacePolyDataCopy);
+        surfaceCopy.IsoLevel = isoLevel;
+        surfaceCopy.PolyData = isodoseModelNode->GetPolyData();
+        surfaceCopy.PolyDataMTime = isodoseModelNode->GetPolyData()->GetMTime();
+      }
+      modelSurfaceCopies[isodoseModelNode->GetID()] = surfaceCopy;
+
+      std::string isodoseModelHierarchyNodeName = std::string(isodoseModelNodeName) + vtkSlicerRtCommon::DICOMRTIMPORT_MODEL_HIERARCHY_NODE_NAME_POSTFIX;
+      isodoseModelHierarchyNode->SetName(isodoseModelHierarchyNodeName.c_str());
+      isodoseModelHierarchyNode->SetIndexInParent(isodoseModelIndex++);
     }
 
     // Report progress
@@ -624,5 +1074,13 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
   }
 
+  // Remove the models of the levels that are not in the color table any more
+  for (std::multimap<float, vtkMRMLModelHierarchyNode*>::iterator existingModelIt = existingIsodoseModelHierarchyNodes.begin();
+    existingModelIt != existingIsodoseModelHierarchyNodes.end(); ++existingModelIt)
+  {
+    RemoveIsodoseModel(this->GetMRMLScene(), existingModelIt->second);
+  }
+  surfaceCache.ModelSurfaceCopies.swap(modelSurfaceCopies);
+
   this->GetMRMLScene()->EndState(vtkMRMLScene::BatchProcessState); 
 }
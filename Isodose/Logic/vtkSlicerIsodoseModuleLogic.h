@@ -56,12 +56,18 @@ public:
   /// Set number of isodose levels
   void SetNumberOfIsodoseLevels(vtkMRMLIsodoseNode* parameterNode, int newNumberOfColors);
 
-  /// Accumulates dose volumes with the given IDs and corresponding weights
+  /// Create isodose surface models for the levels in the isodose color table.
+  /// The surfaces are cached per dose volume, and only the levels that are not in the cache are extracted.
+  /// Existing isodose models are updated in place (name, color, surface), models of removed levels are deleted.
   void CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode);
 
   /// Get dose volume node
   vtkMRMLModelHierarchyNode* GetRootModelHierarchyNode(vtkMRMLIsodoseNode* parameterNode);
 
+public:
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
 public:
   /// Creates default isodose color table. Gets and returns if already exists
   static vtkMRMLColorTableNode* CreateDefaultIsodoseColorTable(vtkMRMLScene* scene);
@@ -92,6 +98,17 @@ protected:
   vtkSlicerIsodoseModuleLogic();
   virtual ~vtkSlicerIsodoseModuleLogic();
 
+protected:
+  /// Number of isodose surfaces decimated and smoothed at the same time by CreateIsodoseSurfaces.
+  /// The levels are contoured together in one pass over the dose.
+  /// Default is 0, which uses all the processor cores. Set to 1 to process the levels one after the other.
+  /// \sa vtkSlicerRtTaskPool
+  int NumberOfThreads;
+
+private:
+  class vtkInternal;
+  vtkInternal* Internal;
+
 private:
   vtkSlicerIsodoseModuleLogic(const vtkSlicerIsodoseModuleLogic&); // Not implemented
   void operator=(const vtkSlicerIsodoseModuleLogic&);               // Not implemented
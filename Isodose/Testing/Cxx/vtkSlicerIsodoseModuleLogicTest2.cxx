@@ -0,0 +1,334 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Isodose includes
+#include "vtkSlicerIsodoseModuleLogic.h"
+#include "vtkMRMLIsodoseNode.h"
+
+// MRML includes
+#include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLModelHierarchyNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLSubjectHierarchyNode.h>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkDecimatePro.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkImageMarchingCubes.h>
+#include <vtkMath.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkSmartPointer.h>
+#include <vtkTriangleFilter.h>
+#include <vtkVariant.h>
+#include <vtkWindowedSincPolyDataFilter.h>
+
+// STD includes
+#include <cmath>
+#include <map>
+
+namespace
+{
+  /// Voxels per axis of the synthetic dose volume
+  const int DOSE_VOLUME_SIZE = 21;
+  /// Number of isodose levels used from the default isodose color table (5, 10, 15, 20, 25 Gy)
+  const int NUMBER_OF_ISODOSE_LEVELS = 5;
+  /// Index and new name of the level changed after creating the isodose surfaces
+  const int CHANGED_LEVEL_INDEX = 2;
+  const char* CHANGED_LEVEL_NAME = "17";
+  /// Index of the level whose model surface is cleared after creating the isodose surfaces
+  const int CLEARED_LEVEL_INDEX = 0;
+  /// Tolerance of the surface point coordinate comparison (mm)
+  const double POINT_TOLERANCE_MM = 1.0e-6;
+
+  //-----------------------------------------------------------------------------
+  /// Create dose image with sharp dose steps: 30 Gy in a sphere, surrounded by a 12 Gy shell, 0 Gy outside.
+  /// Isodose levels 15, 20, 25 Gy (and 5, 10 Gy) cross the same voxel edges.
+  vtkSmartPointer<vtkImageData> CreateSteppedDoseImage()
+  {
+    vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+    doseImageData->SetDimensions(DOSE_VOLUME_SIZE, DOSE_VOLUME_SIZE, DOSE_VOLUME_SIZE);
+    doseImageData->AllocateScalars(VTK_FLOAT, 1);
+    float* dosePtr = static_cast<float*>(doseImageData->GetScalarPointer());
+    double center[3] = { 10.0, 10.0, 9.5 };
+    for (int k=0; k<DOSE_VOLUME_SIZE; ++k)
+    {
+      for (int j=0; j<DOSE_VOLUME_SIZE; ++j)
+      {
+        for (int i=0; i<DOSE_VOLUME_SIZE; ++i)
+        {
+          double position[3] = { (double)i, (double)j, (double)k };
+          double distance = sqrt(vtkMath::Distance2BetweenPoints(position, center));
+          *(dosePtr++) = (distance < 5.0 ? 30.0f : (distance < 7.5 ? 12.0f : 0.0f));
+        }
+      }
+    }
+    return doseImageData;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create dose image with integer dose values falling off smoothly from 30 Gy at an off-grid center.
+  /// The levels cross different voxel edges, and the dose is stored as short, not float.
+  vtkSmartPointer<vtkImageData> CreateSmoothDoseImage()
+  {
+    vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+    doseImageData->SetDimensions(DOSE_VOLUME_SIZE, DOSE_VOLUME_SIZE, DOSE_VOLUME_SIZE);
+    doseImageData->AllocateScalars(VTK_SHORT, 1);
+    short* dosePtr = static_cast<short*>(doseImageData->GetScalarPointer());
+    double center[3] = { 9.3, 10.6, 10.2 };
+    for (int k=0; k<DOSE_VOLUME_SIZE; ++k)
+    {
+      for (int j=0; j<DOSE_VOLUME_SIZE; ++j)
+      {
+        for (int i=0; i<DOSE_VOLUME_SIZE; ++i)
+        {
+          double position[3] = { (double)i, (double)j, (double)k };
+          double distance2 = vtkMath::Distance2BetweenPoints(position, center);
+          *(dosePtr++) = (short)floor(30.0 * exp(-distance2 / 32.0) + 0.5);
+        }
+      }
+    }
+    return doseImageData;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create isodose surface of a single level with a single-value marching cubes filter and the
+  /// post-processing of the isodose logic. The dose volume has identity IJK to RAS geometry.
+  vtkSmartPointer<vtkPolyData> CreateReferenceIsodoseSurface(vtkImageData* doseImageData, double isoLevel)
+  {
+    vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
+    marchingCubes->SetInputData(doseImageData);
+    marchingCubes->SetNumberOfContours(1);
+    marchingCubes->SetValue(0, isoLevel);
+    marchingCubes->ComputeScalarsOff();
+    marchingCubes->ComputeGradientsOff();
+    marchingCubes->ComputeNormalsOff();
+    marchingCubes->Update();
+    if (marchingCubes->GetOutput()->GetNumberOfPoints() < 1)
+    {
+      return NULL;
+    }
+
+    vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+    triangleFilter->SetInputData(marchingCubes->GetOutput());
+    triangleFilter->Update();
+
+    vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+    decimate->SetInputData(triangleFilter->GetOutput());
+    decimate->SetTargetReduction(0.6);
+    decimate->SetFeatureAngle(60);
+    decimate->SplittingOff();
+    decimate->PreserveTopologyOn();
+    decimate->SetMaximumError(1);
+    decimate->Update();
+
+    vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+    smootherSinc->SetPassBand(0.1);
+    smootherSinc->SetInputData(decimate->GetOutput() );
+    smootherSinc->SetNumberOfIterations(2);
+    smootherSinc->FeatureEdgeSmoothingOff();
+    smootherSinc->BoundarySmoothingOff();
+    smootherSinc->Update();
+
+    vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputData(smootherSinc->GetOutput());
+    normals->ComputePointNormalsOn();
+    normals->SetFeatureAngle(60);
+    normals->Update();
+
+    return normals->GetOutput();
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get the isodose model surfaces by level
+  std::map<double, vtkPolyData*> GetIsodoseSurfaces(vtkSlicerIsodoseModuleLogic* isodoseLogic, vtkMRMLIsodoseNode* parameterNode)
+  {
+    std::map<double, vtkPolyData*> isodoseSurfaces;
+    vtkMRMLModelHierarchyNode* rootModelHierarchyNode = isodoseLogic->GetRootModelHierarchyNode(parameterNode);
+    if (!rootModelHierarchyNode)
+    {
+      return isodoseSurfaces;
+    }
+    std::vector<vtkMRMLHierarchyNode*> children = rootModelHierarchyNode->GetChildrenNodes();
+    for (unsigned int i=0; i<children.size(); ++i)
+    {
+      vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast(children[i]->GetAssociatedNode());
+      if (modelNode && modelNode->GetAttribute("IsodoseLevel"))
+      {
+        isodoseSurfaces[vtkVariant(modelNode->GetAttribute("IsodoseLevel")).ToDouble()] = modelNode->GetPolyData();
+      }
+    }
+    return isodoseSurfaces;
+  }
+
+  //-----------------------------------------------------------------------------
+  bool CompareSurfaces(vtkPolyData* surface, vtkPolyData* referenceSurface, double isoLevel)
+  {
+    if (!surface || !referenceSurface)
+    {
+      std::cerr << "Isodose surface of level " << isoLevel << " is missing!" << std::endl;
+      return false;
+    }
+    if ( surface->GetNumberOfPoints() != referenceSurface->GetNumberOfPoints()
+      || surface->GetNumberOfPolys() != referenceSurface->GetNumberOfPolys() )
+    {
+      std::cerr << "Isodose surface of level " << isoLevel << " has " << surface->GetNumberOfPoints() << " points and "
+        << surface->GetNumberOfPolys() << " triangles instead of " << referenceSurface->GetNumberOfPoints() << " points and "
+        << referenceSurface->GetNumberOfPolys() << " triangles!" << std::endl;
+      return false;
+    }
+    for (vtkIdType pointId=0; pointId<surface->GetNumberOfPoints(); ++pointId)
+    {
+      double point[3] = { 0.0, 0.0, 0.0 };
+      double referencePoint[3] = { 0.0, 0.0, 0.0 };
+      surface->GetPoint(pointId, point);
+      referenceSurface->GetPoint(pointId, referencePoint);
+      if (sqrt(vtkMath::Distance2BetweenPoints(point, referencePoint)) > POINT_TOLERANCE_MM)
+      {
+        std::cerr << "Isodose surface of level " << isoLevel << " differs from the reference at point " << pointId << "!" << std::endl;
+        return false;
+      }
+    }
+    vtkIdTypeArray* triangles = surface->GetPolys()->GetData();
+    vtkIdTypeArray* referenceTriangles = referenceSurface->GetPolys()->GetData();
+    for (vtkIdType valueIndex=0; valueIndex<triangles->GetNumberOfValues(); ++valueIndex)
+    {
+      if (triangles->GetValue(valueIndex) != referenceTriangles->GetValue(valueIndex))
+      {
+        std::cerr << "Isodose surface of level " << isoLevel << " has triangles that differ from the reference!" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create the isodose surfaces with the given number of threads and compare each level to the reference
+  bool CreateAndCheckIsodoseSurfaces(vtkImageData* doseImageData, int numberOfThreads)
+  {
+    std::cout << "Create isodose surfaces with " << numberOfThreads << " thread(s)" << std::endl;
+
+    vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+    vtkSmartPointer<vtkSlicerIsodoseModuleLogic> isodoseLogic = vtkSmartPointer<vtkSlicerIsodoseModuleLogic>::New();
+    isodoseLogic->SetMRMLScene(mrmlScene);
+    isodoseLogic->SetNumberOfThreads(numberOfThreads);
+
+    // Dose volume with identity geometry in the subject hierarchy
+    vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(mrmlScene);
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> doseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    doseVolumeNode->SetName("Dose");
+    doseVolumeNode->SetAndObserveImageData(doseImageData);
+    mrmlScene->AddNode(doseVolumeNode);
+    shNode->CreateItem(shNode->GetSceneItemID(), doseVolumeNode);
+
+    vtkMRMLColorTableNode* isodoseColorTableNode = vtkSlicerIsodoseModuleLogic::CreateDefaultIsodoseColorTable(mrmlScene);
+    if (!isodoseColorTableNode)
+    {
+      std::cerr << "Failed to create default isodose color table!" << std::endl;
+      return false;
+    }
+    isodoseColorTableNode->SetNumberOfColors(NUMBER_OF_ISODOSE_LEVELS);
+
+    vtkSmartPointer<vtkMRMLIsodoseNode> parameterNode = vtkSmartPointer<vtkMRMLIsodoseNode>::New();
+    mrmlScene->AddNode(parameterNode);
+    parameterNode->SetAndObserveDoseVolumeNode(doseVolumeNode);
+    parameterNode->SetAndObserveColorTableNode(isodoseColorTableNode);
+
+    isodoseLogic->CreateIsodoseSurfaces(parameterNode);
+
+    std::map<double, vtkPolyData*> isodoseSurfaces = GetIsodoseSurfaces(isodoseLogic, parameterNode);
+    if ((int)isodoseSurfaces.size() != NUMBER_OF_ISODOSE_LEVELS)
+    {
+      std::cerr << "Invalid number of isodose surfaces: " << isodoseSurfaces.size() << std::endl;
+      return false;
+    }
+
+    bool valid = true;
+    for (int levelIndex=0; levelIndex<NUMBER_OF_ISODOSE_LEVELS; ++levelIndex)
+    {
+      double isoLevel = vtkVariant(isodoseColorTableNode->GetColorName(levelIndex)).ToDouble();
+      vtkSmartPointer<vtkPolyData> referenceSurface = CreateReferenceIsodoseSurface(doseImageData, isoLevel);
+      valid &= CompareSurfaces(isodoseSurfaces[isoLevel], referenceSurface, isoLevel);
+    }
+    if (!valid)
+    {
+      return false;
+    }
+
+    // Change one level and clear the surface of another model. The surfaces are regenerated from the
+    // cache, which must not be affected by changes to the models.
+    std::map<double, vtkMTimeType> surfaceMTimes;
+    for (std::map<double, vtkPolyData*>::iterator surfaceIt = isodoseSurfaces.begin(); surfaceIt != isodoseSurfaces.end(); ++surfaceIt)
+    {
+      surfaceMTimes[surfaceIt->first] = surfaceIt->second->GetMTime();
+    }
+    isodoseColorTableNode->SetColorName(CHANGED_LEVEL_INDEX, CHANGED_LEVEL_NAME);
+    double clearedIsoLevel = vtkVariant(isodoseColorTableNode->GetColorName(CLEARED_LEVEL_INDEX)).ToDouble();
+    isodoseSurfaces[clearedIsoLevel]->Initialize();
+    isodoseSurfaces[clearedIsoLevel]->Modified();
+
+    isodoseLogic->CreateIsodoseSurfaces(parameterNode);
+
+    std::map<double, vtkPolyData*> updatedIsodoseSurfaces = GetIsodoseSurfaces(isodoseLogic, parameterNode);
+    if ((int)updatedIsodoseSurfaces.size() != NUMBER_OF_ISODOSE_LEVELS)
+    {
+      std::cerr << "Invalid number of isodose surfaces after changing a level: " << updatedIsodoseSurfaces.size() << std::endl;
+      return false;
+    }
+    for (int levelIndex=0; levelIndex<NUMBER_OF_ISODOSE_LEVELS; ++levelIndex)
+    {
+      double isoLevel = vtkVariant(isodoseColorTableNode->GetColorName(levelIndex)).ToDouble();
+      vtkSmartPointer<vtkPolyData> referenceSurface = CreateReferenceIsodoseSurface(doseImageData, isoLevel);
+      valid &= CompareSurfaces(updatedIsodoseSurfaces[isoLevel], referenceSurface, isoLevel);
+
+      // Models of the other levels must be left alone
+      if ( levelIndex != CHANGED_LEVEL_INDEX && levelIndex != CLEARED_LEVEL_INDEX
+        && (updatedIsodoseSurfaces[isoLevel] != isodoseSurfaces[isoLevel] || updatedIsodoseSurfaces[isoLevel]->GetMTime() != surfaceMTimes[isoLevel]) )
+      {
+        std::cerr << "Isodose surface of unchanged level " << isoLevel << " has been modified!" << std::endl;
+        valid = false;
+      }
+    }
+    return valid;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Check that the isodose levels contoured in a single pass are extracted exactly as if each level was
+// contoured alone by vtkImageMarchingCubes. The dose volumes have sharp dose steps where multiple levels
+// are interpolated on the same voxel edges, and a smooth fall-off where the levels cross different edges.
+// Then check that changing one level only updates the model of that level.
+int vtkSlicerIsodoseModuleLogicTest2( int vtkNotUsed(argc), char * vtkNotUsed(argv)[] )
+{
+  vtkSmartPointer<vtkImageData> steppedDoseImageData = CreateSteppedDoseImage();
+  vtkSmartPointer<vtkImageData> smoothDoseImageData = CreateSmoothDoseImage();
+
+  bool valid = true;
+  valid &= CreateAndCheckIsodoseSurfaces(steppedDoseImageData, 1);
+  valid &= CreateAndCheckIsodoseSurfaces(steppedDoseImageData, 4);
+  valid &= CreateAndCheckIsodoseSurfaces(smoothDoseImageData, 1);
+  valid &= CreateAndCheckIsodoseSurfaces(smoothDoseImageData, 4);
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
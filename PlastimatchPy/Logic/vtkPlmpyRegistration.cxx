@@ -155,10 +155,10 @@ void vtkPlmpyRegistration::StartRegistration()
 {
   this->RegistrationData->set_fixed_image (
     PlmCommon::ConvertVolumeNodeToPlmImage(
-      this->GetMRMLScene()->GetNodeByID(this->FixedImageID)));
+      this->GetMRMLScene()->GetNodeByID(this->FixedImageID), true, true));
   this->RegistrationData->set_moving_image (
     PlmCommon::ConvertVolumeNodeToPlmImage(
-      this->GetMRMLScene()->GetNodeByID(this->MovingImageID)));
+      this->GetMRMLScene()->GetNodeByID(this->MovingImageID), true, true));
 
   /* A little debugging information */
   printf ("Fixed image\n");
@@ -474,7 +474,7 @@ void vtkPlmpyRegistration::SetWarpedImageInVolumeNode(Plm_image::Pointer& warped
   itk::Image<float, 3>::Pointer outputImageItk = warpedPlastimatchImage->itk_float();    
 
   vtkSmartPointer<vtkImageData> outputImageVtk = vtkSmartPointer<vtkImageData>::New();
-  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(outputImageItk, outputImageVtk, VTK_FLOAT);
+  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(outputImageItk, outputImageVtk, VTK_FLOAT, true);
   
   // Read fixed image to get the geometrical information
   vtkMRMLScalarVolumeNode* fixedVolumeNode 
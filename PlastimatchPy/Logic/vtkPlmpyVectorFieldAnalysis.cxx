@@ -235,7 +235,7 @@ void vtkPlmpyVectorFieldAnalysis::SetImageIntoVolumeNode(Plm_image::Pointer& pla
   itk::Image<float, 3>::Pointer outputImageItk = plastimatchImage->itk_float();    
 
   vtkSmartPointer<vtkImageData> outputImageVtk = vtkSmartPointer<vtkImageData>::New();
-  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(outputImageItk, outputImageVtk, VTK_FLOAT);
+  vtkSlicerRtCommon::ConvertItkImageToVtkImageData<float>(outputImageItk, outputImageVtk, VTK_FLOAT, true);
   
   // Read fixed image to get the geometrical information
   vtkMRMLScalarVolumeNode* fixedVolumeNode 
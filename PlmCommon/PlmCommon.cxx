@@ -24,10 +24,20 @@
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLModelNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
 #include <vtkSmartPointer.h>
+#include <vtkCallbackCommand.h>
 #include <vtkImageData.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkWeakPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <list>
+#include <vector>
 
 // Segmentations includes
 #include "vtkOrientedImageData.h"
@@ -35,6 +45,287 @@
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 
+//----------------------------------------------------------------------------
+// Conversion cache
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Thread that loaded the library. Observers of the MRML nodes are only added and removed on this thread,
+  /// conversions on other threads do not use the cache
+  const vtkMultiThreaderIDType MainThreadID = vtkMultiThreader::GetCurrentThreadID();
+
+  bool IsMainThread()
+  {
+    return vtkMultiThreader::ThreadsEqual(vtkMultiThreader::GetCurrentThreadID(), MainThreadID) != 0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Plm image converted from a volume node. The entry is valid as long as the node (including its
+  /// geometry: origin, spacing and directions), its image data and its parent transforms are unchanged.
+  struct PlmImageCacheEntry
+  {
+    PlmImageCacheEntry() : ApplyWorldTransform(true), NodeMTime(0), ImageMTime(0), TransformMTime(0), SizeInBytes(0), SceneObserverTag(0) { }
+    std::string NodeID;
+    vtkWeakPointer<vtkMRMLScalarVolumeNode> Node;
+    vtkWeakPointer<vtkMRMLScene> Scene;
+    bool ApplyWorldTransform;
+    vtkMTimeType NodeMTime;
+    vtkMTimeType ImageMTime;
+    vtkMTimeType TransformMTime;
+    unsigned long long SizeInBytes;
+    std::vector<unsigned long> NodeObserverTags;
+    unsigned long SceneObserverTag;
+    Plm_image::Pointer Image;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Most recently used Plm images converted from volume nodes, within a memory budget.
+  /// Entries are removed when the image data or the transform of the node is modified,
+  /// and when the node is removed from the scene or deleted. Entries of nodes modified
+  /// otherwise (e.g. new origin or spacing) are removed when they are next looked up. The cached images are never
+  /// given out, callers get a deep copy that they are free to modify (e.g. convert to other pixel type).
+  class PlmImageCache
+  {
+  public:
+    static PlmImageCache* GetInstance()
+    {
+      static PlmImageCache instance;
+      return &instance;
+    }
+
+    /// Get copy of the cached image of a volume node. Returns empty pointer if there is no valid cached image
+    Plm_image::Pointer Find(vtkMRMLScalarVolumeNode* node, bool applyWorldTransform)
+    {
+      Plm_image::Pointer image;
+      if (!node || !node->GetID())
+      {
+        return image;
+      }
+      this->Lock.Lock();
+      for (std::list<PlmImageCacheEntry>::iterator entryIt=this->Entries.begin(); entryIt!=this->Entries.end(); ++entryIt)
+      {
+        if (entryIt->NodeID != node->GetID() || entryIt->ApplyWorldTransform != applyWorldTransform)
+        {
+          continue;
+        }
+        if ( entryIt->Node.GetPointer() == node
+          && entryIt->NodeMTime == node->GetMTime()
+          && entryIt->ImageMTime == GetImageMTime(node)
+          && entryIt->TransformMTime == GetTransformMTime(node) )
+        {
+          // Move to the front so that least recently used entries are at the end
+          image = entryIt->Image;
+          this->Entries.splice(this->Entries.begin(), this->Entries, entryIt);
+        }
+        else
+        {
+          this->RemoveEntry(entryIt);
+        }
+        break;
+      }
+      this->Lock.Unlock();
+
+      // The cached image is only read, so it can be copied without holding the lock
+      return (image ? image->clone() : image);
+    }
+
+    /// Whether there is an entry for the volume node, regardless of its validity
+    bool Contains(vtkMRMLScalarVolumeNode* node, bool applyWorldTransform)
+    {
+      bool found = false;
+      this->Lock.Lock();
+      for (std::list<PlmImageCacheEntry>::iterator entryIt=this->Entries.begin(); entryIt!=this->Entries.end(); ++entryIt)
+      {
+        if (entryIt->Node.GetPointer() == node && entryIt->ApplyWorldTransform == applyWorldTransform)
+        {
+          found = true;
+          break;
+        }
+      }
+      this->Lock.Unlock();
+      return found;
+    }
+
+    /// Add copy of the converted image of a volume node. An earlier entry of the same conversion is replaced.
+    /// Least recently used entries are removed if the budget is exceeded
+    void Add(vtkMRMLScalarVolumeNode* node, bool applyWorldTransform, Plm_image::Pointer image)
+    {
+      if (!node || !node->GetID() || !node->GetImageData() || !image)
+      {
+        return;
+      }
+      vtkImageData* imageData = node->GetImageData();
+      unsigned long long sizeInBytes = (unsigned long long)imageData->GetNumberOfPoints()
+        * imageData->GetScalarSize() * imageData->GetNumberOfScalarComponents();
+
+      this->Lock.Lock();
+      if (sizeInBytes > this->MemoryBudgetBytes)
+      {
+        this->Lock.Unlock();
+        return;
+      }
+      for (std::list<PlmImageCacheEntry>::iterator entryIt=this->Entries.begin(); entryIt!=this->Entries.end(); ++entryIt)
+      {
+        if (entryIt->NodeID == node->GetID() && entryIt->ApplyWorldTransform == applyWorldTransform)
+        {
+          this->RemoveEntry(entryIt);
+          break;
+        }
+      }
+      while (!this->Entries.empty() && this->GetTotalSizeInBytes() + sizeInBytes > this->MemoryBudgetBytes)
+      {
+        this->RemoveEntry(--this->Entries.end());
+      }
+
+      PlmImageCacheEntry entry;
+      entry.NodeID = node->GetID();
+      entry.Node = node;
+      entry.Scene = node->GetScene();
+      entry.ApplyWorldTransform = applyWorldTransform;
+      entry.NodeMTime = node->GetMTime();
+      entry.ImageMTime = GetImageMTime(node);
+      entry.TransformMTime = GetTransformMTime(node);
+      entry.SizeInBytes = sizeInBytes;
+      entry.Image = image->clone();
+      entry.NodeObserverTags.push_back(node->AddObserver(vtkMRMLVolumeNode::ImageDataModifiedEvent, this->Callback));
+      entry.NodeObserverTags.push_back(node->AddObserver(vtkMRMLTransformableNode::TransformModifiedEvent, this->Callback));
+      entry.NodeObserverTags.push_back(node->AddObserver(vtkCommand::DeleteEvent, this->Callback));
+      if (node->GetScene())
+      {
+        entry.SceneObserverTag = node->GetScene()->AddObserver(vtkMRMLScene::NodeRemovedEvent, this->Callback);
+      }
+      this->Entries.push_front(entry);
+      this->Lock.Unlock();
+    }
+
+    /// Remove all entries of a node
+    void RemoveNode(vtkObject* node)
+    {
+      this->Lock.Lock();
+      std::list<PlmImageCacheEntry>::iterator entryIt = this->Entries.begin();
+      while (entryIt != this->Entries.end())
+      {
+        std::list<PlmImageCacheEntry>::iterator currentEntryIt = entryIt++;
+        if (currentEntryIt->Node.GetPointer() == node || currentEntryIt->Node.GetPointer() == NULL)
+        {
+          this->RemoveEntry(currentEntryIt);
+        }
+      }
+      this->Lock.Unlock();
+    }
+
+    /// Remove all entries
+    void Clear()
+    {
+      this->Lock.Lock();
+      while (!this->Entries.empty())
+      {
+        this->RemoveEntry(this->Entries.begin());
+      }
+      this->Lock.Unlock();
+    }
+
+    void SetMemoryBudgetMB(unsigned int budgetMB)
+    {
+      this->Lock.Lock();
+      this->MemoryBudgetBytes = (unsigned long long)budgetMB * 1024 * 1024;
+      while (!this->Entries.empty() && this->GetTotalSizeInBytes() > this->MemoryBudgetBytes)
+      {
+        this->RemoveEntry(--this->Entries.end());
+      }
+      this->Lock.Unlock();
+    }
+
+    unsigned int GetMemoryBudgetMB()
+    {
+      this->Lock.Lock();
+      unsigned int budgetMB = (unsigned int)(this->MemoryBudgetBytes / (1024 * 1024));
+      this->Lock.Unlock();
+      return budgetMB;
+    }
+
+  protected:
+    PlmImageCache()
+      : MemoryBudgetBytes(512ULL * 1024 * 1024)
+    {
+      this->Callback = vtkSmartPointer<vtkCallbackCommand>::New();
+      this->Callback->SetClientData(this);
+      this->Callback->SetCallback(PlmImageCache::OnNodeEvent);
+    }
+
+    ~PlmImageCache()
+    {
+      this->Clear();
+    }
+
+    /// Remove entry and the observers it added. Must be called with the lock held, on the main thread
+    void RemoveEntry(std::list<PlmImageCacheEntry>::iterator entryIt)
+    {
+      if (entryIt->Node.GetPointer())
+      {
+        for (std::vector<unsigned long>::iterator tagIt=entryIt->NodeObserverTags.begin(); tagIt!=entryIt->NodeObserverTags.end(); ++tagIt)
+        {
+          entryIt->Node->RemoveObserver(*tagIt);
+        }
+      }
+      if (entryIt->Scene.GetPointer() && entryIt->SceneObserverTag)
+      {
+        entryIt->Scene->RemoveObserver(entryIt->SceneObserverTag);
+      }
+      this->Entries.erase(entryIt);
+    }
+
+    unsigned long long GetTotalSizeInBytes()
+    {
+      unsigned long long totalSizeInBytes = 0;
+      for (std::list<PlmImageCacheEntry>::iterator entryIt=this->Entries.begin(); entryIt!=this->Entries.end(); ++entryIt)
+      {
+        totalSizeInBytes += entryIt->SizeInBytes;
+      }
+      return totalSizeInBytes;
+    }
+
+    static vtkMTimeType GetImageMTime(vtkMRMLScalarVolumeNode* node)
+    {
+      return node->GetImageData() ? node->GetImageData()->GetMTime() : 0;
+    }
+
+    /// Latest modification time of the transforms between the node and world
+    static vtkMTimeType GetTransformMTime(vtkMRMLScalarVolumeNode* node)
+    {
+      vtkMTimeType transformMTime = 0;
+      for (vtkMRMLTransformNode* transformNode=node->GetParentTransformNode(); transformNode; transformNode=transformNode->GetParentTransformNode())
+      {
+        transformMTime = std::max(transformMTime, transformNode->GetMTime());
+        if (transformNode->GetTransformToParent())
+        {
+          transformMTime = std::max(transformMTime, transformNode->GetTransformToParent()->GetMTime());
+        }
+      }
+      return transformMTime;
+    }
+
+    static void OnNodeEvent(vtkObject* caller, unsigned long eventId, void* clientData, void* callData)
+    {
+      PlmImageCache* self = reinterpret_cast<PlmImageCache*>(clientData);
+      if (eventId == vtkMRMLScene::NodeRemovedEvent)
+      {
+        self->RemoveNode(reinterpret_cast<vtkMRMLNode*>(callData));
+      }
+      else
+      {
+        self->RemoveNode(caller);
+      }
+    }
+
+  protected:
+    std::list<PlmImageCacheEntry> Entries;
+    unsigned long long MemoryBudgetBytes;
+    vtkSmartPointer<vtkCallbackCommand> Callback;
+    vtkSimpleMutexLock Lock;
+  };
+}
+
 //----------------------------------------------------------------------------
 // Utility functions
 //----------------------------------------------------------------------------
@@ -53,10 +344,10 @@ convert_to_itk (vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform)
 //----------------------------------------------------------------------------
 template<class T> 
 static typename itk::Image<T,3>::Pointer
-convert_to_itk (vtkOrientedImageData* inImageData)
+convert_to_itk (vtkOrientedImageData* inImageData, bool shareBuffer)
 {
   typename itk::Image<T,3>::Pointer image = itk::Image<T,3>::New ();
-  if (!vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(inImageData, image, true))
+  if (!vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(inImageData, image, true, shareBuffer))
   {
     vtkGenericWarningMacro("PlmCommon::convert_to_itk(vtkOrientedImageData): Failed to convert oriented image data to PlmImage!");
   }
@@ -66,8 +357,19 @@ convert_to_itk (vtkOrientedImageData* inImageData)
 //----------------------------------------------------------------------------
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/)
+PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/, bool useCache/* = false*/)
 {
+  // Cache entries observe the MRML nodes, so they can only be created and removed on the main thread
+  useCache = useCache && IsMainThread();
+  if (useCache)
+  {
+    Plm_image::Pointer cachedImage = PlmImageCache::GetInstance()->Find(inVolumeNode, applyWorldTransform);
+    if (cachedImage)
+    {
+      return cachedImage;
+    }
+  }
+
   Plm_image::Pointer image = Plm_image::New ();
 
   if (!inVolumeNode || !inVolumeNode->GetImageData())
@@ -129,7 +431,12 @@ PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bo
 
   default:
     vtkWarningWithObjectMacro (inVolumeNode, "Unsupported scalar type!");
-    break;
+    return image;
+  }
+
+  if (useCache)
+  {
+    PlmImageCache::GetInstance()->Add(inVolumeNode, applyWorldTransform, image);
   }
 
   return image;
@@ -137,15 +444,15 @@ PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bo
 
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform/* = true*/)
+PlmCommon::ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform/* = true*/, bool useCache/* = false*/)
 {
   return PlmCommon::ConvertVolumeNodeToPlmImage(
-    vtkMRMLScalarVolumeNode::SafeDownCast(inNode), applyWorldTransform);
+    vtkMRMLScalarVolumeNode::SafeDownCast(inNode), applyWorldTransform, useCache);
 }
 
 //----------------------------------------------------------------------------
 Plm_image::Pointer 
-PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData)
+PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData, bool shareBuffer/* = false*/)
 {
   Plm_image::Pointer image = Plm_image::New ();
 
@@ -160,49 +467,49 @@ PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageDa
   switch (vtk_type) {
   case VTK_CHAR:
   case VTK_SIGNED_CHAR:
-    image->set_itk (convert_to_itk<char> (inImageData));
+    image->set_itk (convert_to_itk<char> (inImageData, shareBuffer));
     break;
   
   case VTK_UNSIGNED_CHAR:
-    image->set_itk (convert_to_itk<unsigned char> (inImageData));
+    image->set_itk (convert_to_itk<unsigned char> (inImageData, shareBuffer));
     break;
   
   case VTK_SHORT:
-    image->set_itk (convert_to_itk<short> (inImageData));
+    image->set_itk (convert_to_itk<short> (inImageData, shareBuffer));
     break;
   
   case VTK_UNSIGNED_SHORT:
-    image->set_itk (convert_to_itk<unsigned short> (inImageData));
+    image->set_itk (convert_to_itk<unsigned short> (inImageData, shareBuffer));
     break;
   
 #if (CMAKE_SIZEOF_UINT == 4)
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<int> (inImageData));
+    image->set_itk (convert_to_itk<int> (inImageData, shareBuffer));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned int> (inImageData));
+    image->set_itk (convert_to_itk<unsigned int> (inImageData, shareBuffer));
     break;
 #else
   case VTK_INT:
   case VTK_LONG: 
-    image->set_itk (convert_to_itk<long> (inImageData));
+    image->set_itk (convert_to_itk<long> (inImageData, shareBuffer));
     break;
   
   case VTK_UNSIGNED_INT:
   case VTK_UNSIGNED_LONG:
-    image->set_itk (convert_to_itk<unsigned long> (inImageData));
+    image->set_itk (convert_to_itk<unsigned long> (inImageData, shareBuffer));
     break;
 #endif
   
   case VTK_FLOAT:
-    image->set_itk (convert_to_itk<float> (inImageData));
+    image->set_itk (convert_to_itk<float> (inImageData, shareBuffer));
     break;
   
   case VTK_DOUBLE:
-    image->set_itk (convert_to_itk<double> (inImageData));
+    image->set_itk (convert_to_itk<double> (inImageData, shareBuffer));
     break;
 
   default:
@@ -212,3 +519,27 @@ PlmCommon::ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageDa
 
   return image;
 }
+
+//----------------------------------------------------------------------------
+void PlmCommon::SetConversionCacheMemoryBudgetMB(unsigned int budgetMB)
+{
+  PlmImageCache::GetInstance()->SetMemoryBudgetMB(budgetMB);
+}
+
+//----------------------------------------------------------------------------
+unsigned int PlmCommon::GetConversionCacheMemoryBudgetMB()
+{
+  return PlmImageCache::GetInstance()->GetMemoryBudgetMB();
+}
+
+//----------------------------------------------------------------------------
+bool PlmCommon::IsVolumeNodeConversionCached(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform/* = true*/)
+{
+  return PlmImageCache::GetInstance()->Contains(inVolumeNode, applyWorldTransform);
+}
+
+//----------------------------------------------------------------------------
+void PlmCommon::ClearConversionCache()
+{
+  PlmImageCache::GetInstance()->Clear();
+}
@@ -48,15 +48,33 @@ public:
   /// Convert MRML volume node to Plm image using typed scalar volume node
   /// \param inVolumeNode Scalar volume node to convert
   /// \param applyWorldTransform Flag determining if parent transform is applied to volume node when converting to Plm image. True by default
-  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true);
+  /// \param useCache Flag determining if the image is taken from (or added to) the conversion cache. The returned image
+  ///   is a copy of the cached one, so it can be modified. Only used on the main thread. False by default
+  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true, bool useCache = false);
 
   /// Convert MRML volume node to Plm image using generic MRML node type
   /// \param inNode Node to convert (must be scalar volume node type)
   /// \param applyWorldTransform Flag determining if parent transform is applied to volume node when converting to Plm image. True by default
-  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform = true);
+  /// \param useCache Flag determining if the image is taken from (or added to) the conversion cache. False by default
+  static Plm_image::Pointer ConvertVolumeNodeToPlmImage(vtkMRMLNode* inNode, bool applyWorldTransform = true, bool useCache = false);
 
   /// Convert VTK oriented image data to Plm image
-  static Plm_image::Pointer ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData);
+  /// \param inImageData Oriented image data to convert
+  /// \param shareBuffer Flag determining if the Plm image uses the voxel buffer of the input image instead of a copy.
+  ///   Only set it if the input image is not modified while the Plm image is in use. False by default
+  static Plm_image::Pointer ConvertVtkOrientedImageDataToPlmImage(vtkOrientedImageData* inImageData, bool shareBuffer = false);
+
+  /// Set memory budget of the volume node conversion cache in megabytes. Least recently used images are
+  /// removed from the cache when the budget is exceeded. Zero disables caching. 512 MB by default
+  static void SetConversionCacheMemoryBudgetMB(unsigned int budgetMB);
+  /// Get memory budget of the volume node conversion cache in megabytes
+  static unsigned int GetConversionCacheMemoryBudgetMB();
+
+  /// Determine if the volume node conversion cache contains an image converted from the volume node
+  static bool IsVolumeNodeConversionCached(vtkMRMLScalarVolumeNode* inVolumeNode, bool applyWorldTransform = true);
+
+  /// Remove all images from the volume node conversion cache
+  static void ClearConversionCache();
 };
 
 #endif
@@ -0,0 +1,194 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// PlmCommon includes
+#include "PlmCommon.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  //-----------------------------------------------------------------------------
+  /// Add volume node with a short image of the given dimensions. The voxel values are their indices.
+  vtkMRMLScalarVolumeNode* AddVolumeNode(vtkMRMLScene* scene, const char* name, int dimensions[3])
+  {
+    vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+    imageData->SetDimensions(dimensions);
+    imageData->AllocateScalars(VTK_SHORT, 1);
+    short* imagePtr = static_cast<short*>(imageData->GetScalarPointer());
+    for (vtkIdType i = 0; i < imageData->GetNumberOfPoints(); ++i)
+    {
+      imagePtr[i] = (short)(i % 1000);
+    }
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    volumeNode->SetName(name);
+    volumeNode->SetSpacing(1.0, 2.0, 3.0);
+    volumeNode->SetAndObserveImageData(imageData);
+    scene->AddNode(volumeNode);
+    return volumeNode;
+  }
+
+  //-----------------------------------------------------------------------------
+  bool CheckCached(vtkMRMLScalarVolumeNode* volumeNode, bool expectedCached, const char* description)
+  {
+    if (PlmCommon::IsVolumeNodeConversionCached(volumeNode) != expectedCached)
+    {
+      std::cerr << "Conversion of volume " << volumeNode->GetName() << " is " << (expectedCached ? "not " : "")
+        << "cached " << description << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Test that converted volumes are cached, that the entries are removed when the volume, its geometry or its
+// transform is modified, that least recently used entries are evicted to keep the memory budget, and that modifying a
+// returned image does not change the cached one
+int PlmCommonConversionCacheTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkMRMLScene> mrmlScene;
+  PlmCommon::ClearConversionCache();
+  PlmCommon::SetConversionCacheMemoryBudgetMB(1);
+
+  // Each volume takes 640000 bytes, so only one of them fits in the budget
+  int dimensions[3] = { 80, 80, 50 };
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNodeA = AddVolumeNode(mrmlScene.GetPointer(), "A", dimensions);
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNodeB = AddVolumeNode(mrmlScene.GetPointer(), "B", dimensions);
+  vtkNew<vtkMRMLLinearTransformNode> transformNode;
+  mrmlScene->AddNode(transformNode.GetPointer());
+  volumeNodeA->SetAndObserveTransformNodeID(transformNode->GetID());
+
+  // Conversion without cache does not add entry
+  PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, false);
+  if (!CheckCached(volumeNodeA, false, "after conversion without cache"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Cache hit returns a copy: modifying it does not change the next converted image
+  Plm_image::Pointer imageA1 = PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  if (!CheckCached(volumeNodeA, true, "after conversion"))
+  {
+    return EXIT_FAILURE;
+  }
+  itk::Image<short,3>::IndexType firstVoxelIndex;
+  firstVoxelIndex.Fill(0);
+  itk::Image<short,3>::Pointer itkImageA1 = imageA1->itk_short();
+  short originalFirstVoxelValue = itkImageA1->GetPixel(firstVoxelIndex);
+  itkImageA1->SetPixel(firstVoxelIndex, (short)(originalFirstVoxelValue + 100));
+  Plm_image::Pointer imageA2 = PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  itk::Image<short,3>::Pointer itkImageA2 = imageA2->itk_short();
+  if (imageA2.get() == imageA1.get() || itkImageA2.GetPointer() == itkImageA1.GetPointer()
+    || itkImageA2->GetPixel(firstVoxelIndex) != originalFirstVoxelValue)
+  {
+    std::cerr << "Cached image is shared with the caller" << std::endl;
+    return EXIT_FAILURE;
+  }
+  itk::Image<short,3>::SizeType size = itkImageA2->GetLargestPossibleRegion().GetSize();
+  if ((int)size[0] != dimensions[0] || (int)size[1] != dimensions[1] || (int)size[2] != dimensions[2])
+  {
+    std::cerr << "Cached image has wrong size" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Modified image data invalidates the entry
+  volumeNodeA->GetImageData()->Modified();
+  if (!CheckCached(volumeNodeA, false, "after modifying its image data"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Modified transform invalidates the entry
+  PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  if (!CheckCached(volumeNodeA, true, "after conversion"))
+  {
+    return EXIT_FAILURE;
+  }
+  vtkNew<vtkMatrix4x4> translation;
+  translation->SetElement(0, 3, 10.0);
+  transformNode->SetMatrixTransformToParent(translation.GetPointer());
+  if (!CheckCached(volumeNodeA, false, "after modifying its transform"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Modified geometry invalidates the entry, and the new spacing and origin are converted
+  Plm_image::Pointer imageA3 = PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  double originalOriginZ = imageA3->itk_short()->GetOrigin()[2];
+  volumeNodeA->SetSpacing(2.0, 2.0, 2.0);
+  volumeNodeA->SetOrigin(volumeNodeA->GetOrigin()[0], volumeNodeA->GetOrigin()[1], volumeNodeA->GetOrigin()[2] + 5.0);
+  Plm_image::Pointer imageA4 = PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  itk::Image<short,3>::SpacingType spacing = imageA4->itk_short()->GetSpacing();
+  if ( spacing[0] != 2.0 || spacing[1] != 2.0 || spacing[2] != 2.0
+    || fabs(imageA4->itk_short()->GetOrigin()[2] - (originalOriginZ + 5.0)) > 1e-6 )
+  {
+    std::cerr << "Cached image has stale geometry after modifying the volume spacing and origin" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Least recently used entry is evicted when the budget is exceeded
+  PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeB, true, true);
+  if (!CheckCached(volumeNodeA, false, "after exceeding the memory budget") || !CheckCached(volumeNodeB, true, "after conversion"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Both fit when the budget is increased
+  PlmCommon::SetConversionCacheMemoryBudgetMB(2);
+  PlmCommon::ConvertVolumeNodeToPlmImage(volumeNodeA, true, true);
+  if (!CheckCached(volumeNodeA, true, "after increasing the memory budget") || !CheckCached(volumeNodeB, true, "after increasing the memory budget"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Decreasing the budget evicts the least recently used entry
+  PlmCommon::SetConversionCacheMemoryBudgetMB(1);
+  if (!CheckCached(volumeNodeA, true, "after decreasing the memory budget") || !CheckCached(volumeNodeB, false, "after decreasing the memory budget"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Removing the node from the scene removes its entry
+  mrmlScene->RemoveNode(volumeNodeA);
+  if (PlmCommon::IsVolumeNodeConversionCached(volumeNodeA))
+  {
+    std::cerr << "Conversion of removed volume is cached" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  PlmCommon::ClearConversionCache();
+  PlmCommon::SetConversionCacheMemoryBudgetMB(512);
+  return EXIT_SUCCESS;
+}
@@ -26,6 +26,7 @@
 // SlicerRT includes
 #include "vtkMRMLRTBeamNode.h"
 #include "vtkCollisionDetectionFilter.h"
+#include "vtkSlicerRtTaskPool.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
@@ -35,12 +36,16 @@
 #include <vtkMRMLViewNode.h>
 #include <vtkMRMLModelHierarchyNode.h>
 #include <vtkMRMLModelDisplayNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLSegmentationNode.h>
 
 // Slicer includes
 #include <vtkSlicerModelsLogic.h>
 #include <vtkSlicerSegmentationsModuleLogic.h>
 
 // vtkSegmentationCore includes
+#include <vtkSegment.h>
+#include <vtkSegmentation.h>
 #include <vtkSegmentationConverter.h>
 
 // VTK includes
@@ -53,6 +58,14 @@
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkGeneralTransform.h>
 #include <vtkTransformFilter.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+
+// STD includes
+#include <algorithm>
+#include <sstream>
+#include <vector>
 
 //----------------------------------------------------------------------------
 // Treatment machine component names
@@ -72,6 +85,260 @@ const char* vtkSlicerRoomsEyeViewModuleLogic::ORIENTATION_MARKER_MODEL_NODE_NAME
 //TODO: Add this dynamically to the IEC transform map
 static const char* ADDITIONALCOLLIMATORMOUNTEDDEVICES_TO_COLLIMATOR_TRANSFORM_NODE_NAME = "AdditionalCollimatorDevicesToCollimatorTransform";
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Collision map poses, shared between the worker threads. One task is one gantry angle.
+  /// The collision detection filters only have their OBB trees read, and the matrices are read-only.
+  struct CollisionMapTaskList
+  {
+    CollisionMapTaskList() : CollisionMap(NULL), CheckPatient(false) { }
+    int Dimensions[3];
+    double FirstAngles[3];
+    double AngleSteps[3];
+
+    /// Frame of the gantry rotation (FixedReference to RAS)
+    vtkMatrix4x4* FixedReferenceToRasMatrix;
+    /// Frame of the patient support rotation (FixedReference to RAS)
+    vtkMatrix4x4* PatientSupportRotationParentToRasMatrix;
+    /// Patient support and table top relative to the rotated patient support frame
+    vtkMatrix4x4* PatientSupportToPatientSupportRotationMatrix;
+    vtkMatrix4x4* TableTopToPatientSupportRotationMatrix;
+
+    vtkCollisionDetectionFilter* GantryTableTopCollisionDetection;
+    vtkCollisionDetectionFilter* GantryPatientSupportCollisionDetection;
+    vtkCollisionDetectionFilter* CollimatorTableTopCollisionDetection;
+    vtkCollisionDetectionFilter* GantryPatientCollisionDetection;
+    vtkCollisionDetectionFilter* CollimatorPatientCollisionDetection;
+
+    unsigned char* CollisionMap;
+    bool CheckPatient;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Number of angles in a first angle, last angle, step triplet (the last angle is included)
+  int GetNumberOfAngles(double angleRange[3])
+  {
+    if (angleRange[2] <= 0.0 || angleRange[1] < angleRange[0])
+    {
+      return 0;
+    }
+    return (int)floor((angleRange[1] - angleRange[0]) / angleRange[2] + 1e-6) + 1;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Add the collision bit of a pair of pieces to the collisions at a pose. If the pair cannot be checked
+  /// (its OBB trees have not been built), then the pose is marked as failed instead of collision-free.
+  void CheckCollisionPair( vtkCollisionDetectionFilter* filter, vtkMatrix4x4* matrix0, vtkMatrix4x4* matrix1,
+    unsigned char collisionBit, unsigned char& collisions )
+  {
+    int numberOfContacts = filter->ComputeNumberOfContacts(matrix0, matrix1, 1);
+    if (numberOfContacts < 0)
+    {
+      collisions |= vtkSlicerRoomsEyeViewModuleLogic::CollisionCheckFailed;
+    }
+    else if (numberOfContacts > 0)
+    {
+      collisions |= collisionBit;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void ComputeCollisionMapForGantryAngle(CollisionMapTaskList* taskList, int gantryIndex)
+  {
+    vtkSmartPointer<vtkTransform> rotation = vtkSmartPointer<vtkTransform>::New();
+    vtkSmartPointer<vtkMatrix4x4> gantryToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> collimatorToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> patientSupportRotationToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> patientSupportToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> tableTopToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> patientToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New(); // Identity
+
+    // Same transform as in UpdateGantryToFixedReferenceTransform
+    double gantryAngle = taskList->FirstAngles[0] + gantryIndex * taskList->AngleSteps[0];
+    rotation->RotateY(gantryAngle * (-1.0));
+    vtkMatrix4x4::Multiply4x4(taskList->FixedReferenceToRasMatrix, rotation->GetMatrix(), gantryToRasMatrix);
+
+    // The patient does not move with the patient support (see CheckForCollisions), so this only depends on the gantry
+    unsigned char gantryPatientCollision = 0;
+    if (taskList->CheckPatient)
+    {
+      CheckCollisionPair( taskList->GantryPatientCollisionDetection, gantryToRasMatrix, patientToRasMatrix,
+        vtkSlicerRoomsEyeViewModuleLogic::GantryPatientCollision, gantryPatientCollision );
+    }
+
+    for (int patientSupportIndex = 0; patientSupportIndex < taskList->Dimensions[1]; ++patientSupportIndex)
+    {
+      // Same transform as in UpdatePatientSupportRotationToFixedReferenceTransform
+      double patientSupportAngle = taskList->FirstAngles[1] + patientSupportIndex * taskList->AngleSteps[1];
+      rotation->Identity();
+      rotation->RotateZ(patientSupportAngle);
+      vtkMatrix4x4::Multiply4x4(taskList->PatientSupportRotationParentToRasMatrix, rotation->GetMatrix(), patientSupportRotationToRasMatrix);
+      vtkMatrix4x4::Multiply4x4(patientSupportRotationToRasMatrix, taskList->PatientSupportToPatientSupportRotationMatrix, patientSupportToRasMatrix);
+      vtkMatrix4x4::Multiply4x4(patientSupportRotationToRasMatrix, taskList->TableTopToPatientSupportRotationMatrix, tableTopToRasMatrix);
+
+      unsigned char gantryCollisions = gantryPatientCollision;
+      CheckCollisionPair( taskList->GantryTableTopCollisionDetection, gantryToRasMatrix, tableTopToRasMatrix,
+        vtkSlicerRoomsEyeViewModuleLogic::GantryTableTopCollision, gantryCollisions );
+      CheckCollisionPair( taskList->GantryPatientSupportCollisionDetection, gantryToRasMatrix, patientSupportToRasMatrix,
+        vtkSlicerRoomsEyeViewModuleLogic::GantryPatientSupportCollision, gantryCollisions );
+
+      for (int collimatorIndex = 0; collimatorIndex < taskList->Dimensions[2]; ++collimatorIndex)
+      {
+        // Same transform as in UpdateCollimatorToGantryTransform
+        double collimatorAngle = taskList->FirstAngles[2] + collimatorIndex * taskList->AngleSteps[2];
+        rotation->Identity();
+        rotation->RotateZ(collimatorAngle);
+        vtkMatrix4x4::Multiply4x4(gantryToRasMatrix, rotation->GetMatrix(), collimatorToRasMatrix);
+
+        unsigned char collisions = gantryCollisions;
+        CheckCollisionPair( taskList->CollimatorTableTopCollisionDetection, collimatorToRasMatrix, tableTopToRasMatrix,
+          vtkSlicerRoomsEyeViewModuleLogic::CollimatorTableTopCollision, collisions );
+        if (taskList->CheckPatient)
+        {
+          CheckCollisionPair( taskList->CollimatorPatientCollisionDetection, collimatorToRasMatrix, patientToRasMatrix,
+            vtkSlicerRoomsEyeViewModuleLogic::CollimatorPatientCollision, collisions );
+        }
+
+        taskList->CollisionMap[ gantryIndex + taskList->Dimensions[0] * (patientSupportIndex + taskList->Dimensions[1] * collimatorIndex) ] = collisions;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Task function for vtkSlicerRtTaskPool, each task is a gantry angle
+  void ComputeCollisionMapTaskFunction(void* userData, int gantryIndex)
+  {
+    ComputeCollisionMapForGantryAngle(static_cast<CollisionMapTaskList*>(userData), gantryIndex);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Pair of pieces checked along a gantry arc. Input 0 of the filter moves with the gantry, input 1 is static.
+  struct GantryArcCollisionPair
+  {
+    GantryArcCollisionPair(vtkCollisionDetectionFilter* filter, vtkMatrix4x4* movingToGantryMatrix, vtkMatrix4x4* staticToRasMatrix, const char* description)
+      : Filter(filter), MovingToGantryMatrix(movingToGantryMatrix), StaticToRasMatrix(staticToRasMatrix), Description(description) { }
+    vtkCollisionDetectionFilter* Filter;
+    vtkMatrix4x4* MovingToGantryMatrix;
+    vtkMatrix4x4* StaticToRasMatrix;
+    const char* Description;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Find the first angle along a gantry arc where the pieces are closer than the clearance.
+  /// The OBB trees of the filter need to be up to date.
+  /// \return 1 if a collision was found, in which case its gantry angle is set to collisionGantryAngle,
+  ///   0 if the pieces do not collide along the arc, -1 if the pieces could not be checked
+  int FindFirstCollisionAlongGantryArc( GantryArcCollisionPair& pair, vtkMatrix4x4* fixedReferenceToRasMatrix,
+    double startGantryAngle, double stopGantryAngle, double clearance, double& collisionGantryAngle )
+  {
+    vtkPolyData* movingPolyData = pair.Filter->GetInput(0);
+    if (!movingPolyData)
+    {
+      return -1;
+    }
+
+    // Largest distance of the moving piece from the gantry rotation axis (Y axis of the gantry frame).
+    // The distance is convex, so its maximum over the bounding box is at one of the corners.
+    double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    movingPolyData->GetBounds(bounds);
+    double maximumRadius = 0.0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+      double movingPoint[4] = { bounds[corner&1], bounds[2+((corner>>1)&1)], bounds[4+((corner>>2)&1)], 1.0 };
+      double gantryPoint[4] = { 0.0, 0.0, 0.0, 1.0 };
+      pair.MovingToGantryMatrix->MultiplyPoint(movingPoint, gantryPoint);
+      maximumRadius = std::max(maximumRadius, sqrt(gantryPoint[0]*gantryPoint[0] + gantryPoint[2]*gantryPoint[2]));
+    }
+
+    vtkSmartPointer<vtkTransform> gantryRotation = vtkSmartPointer<vtkTransform>::New();
+    vtkSmartPointer<vtkMatrix4x4> gantryToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkSmartPointer<vtkMatrix4x4> movingToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+
+    // Depth-first traversal of the interval halves, earlier half first, so that the first collision along the arc is found
+    std::vector<std::pair<double, double> > intervals;
+    intervals.push_back(std::make_pair(startGantryAngle, stopGantryAngle));
+    while (!intervals.empty())
+    {
+      double firstAngle = intervals.back().first;
+      double lastAngle = intervals.back().second;
+      intervals.pop_back();
+
+      // A point at radius r travels at most r * angle from the middle of the interval
+      double middleAngle = (firstAngle + lastAngle) / 2.0;
+      double maximumMotion = maximumRadius * fabs(lastAngle - firstAngle) / 2.0 * vtkMath::Pi() / 180.0;
+
+      // Same transform as in UpdateGantryToFixedReferenceTransform
+      gantryRotation->Identity();
+      gantryRotation->RotateY(middleAngle * (-1.0));
+      vtkMatrix4x4::Multiply4x4(fixedReferenceToRasMatrix, gantryRotation->GetMatrix(), gantryToRasMatrix);
+      vtkMatrix4x4::Multiply4x4(gantryToRasMatrix, pair.MovingToGantryMatrix, movingToRasMatrix);
+
+      // If the pieces are farther apart at the middle than the motion plus the clearance, then they stay
+      // farther apart than the clearance anywhere in the interval
+      int withinDistance = pair.Filter->IsWithinDistance(movingToRasMatrix, pair.StaticToRasMatrix, maximumMotion + clearance);
+      if (withinDistance < 0)
+      {
+        // The OBB trees have not been built, so the interval cannot be cleared
+        return -1;
+      }
+      if (withinDistance == 0)
+      {
+        continue;
+      }
+      if (maximumMotion <= clearance)
+      {
+        collisionGantryAngle = middleAngle;
+        return 1;
+      }
+
+      intervals.push_back(std::make_pair(middleAngle, lastAngle));
+      intervals.push_back(std::make_pair(firstAngle, middleAngle));
+    }
+
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Latest modification time of a segment (including its representations), its segmentation,
+  /// the segmentation node and its parent transform node
+  vtkMTimeType GetSegmentMTime(vtkMRMLSegmentationNode* segmentationNode, vtkSegment* segment)
+  {
+    vtkMTimeType mTime = std::max(segmentationNode->GetMTime(), segment->GetMTime());
+    if (segmentationNode->GetSegmentation())
+    {
+      mTime = std::max(mTime, segmentationNode->GetSegmentation()->GetMTime());
+    }
+    if (segmentationNode->GetParentTransformNode())
+    {
+      mTime = std::max(mTime, segmentationNode->GetParentTransformNode()->GetMTime());
+    }
+    std::vector<std::string> representationNames;
+    segment->GetContainedRepresentationNames(representationNames);
+    for (std::vector<std::string>::iterator nameIt = representationNames.begin(); nameIt != representationNames.end(); ++nameIt)
+    {
+      vtkDataObject* representation = segment->GetRepresentation(*nameIt);
+      if (representation)
+      {
+        mTime = std::max(mTime, representation->GetMTime());
+      }
+    }
+    return mTime;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get the matrix from the parent frame of a transform node to RAS (identity if there is no parent)
+  void GetParentToWorldMatrix(vtkMRMLTransformNode* transformNode, vtkMatrix4x4* parentToWorldMatrix)
+  {
+    parentToWorldMatrix->Identity();
+    vtkMRMLTransformNode* parentTransformNode = transformNode->GetParentTransformNode();
+    if (parentTransformNode)
+    {
+      parentTransformNode->GetMatrixTransformToWorld(parentToWorldMatrix);
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerRoomsEyeViewModuleLogic);
 
@@ -84,6 +351,9 @@ vtkSlicerRoomsEyeViewModuleLogic::vtkSlicerRoomsEyeViewModuleLogic()
   , CollimatorTableTopCollisionDetection(NULL)
   , AdditionalModelsTableTopCollisionDetection(NULL)
   , AdditionalModelsPatientSupportCollisionDetection(NULL)
+  , PatientBodyPolyData(NULL)
+  , PatientBodyMTime(0)
+  , NumberOfThreads(0)
 {
   this->IECLogic = vtkSlicerIECTransformLogic::New();
 
@@ -94,6 +364,17 @@ vtkSlicerRoomsEyeViewModuleLogic::vtkSlicerRoomsEyeViewModuleLogic()
   this->CollimatorTableTopCollisionDetection = vtkCollisionDetectionFilter::New();
   this->AdditionalModelsTableTopCollisionDetection = vtkCollisionDetectionFilter::New();
   this->AdditionalModelsPatientSupportCollisionDetection = vtkCollisionDetectionFilter::New();
+
+  this->PatientBodyPolyData = vtkPolyData::New();
+
+  // Only the number of contacts is used, so the filters do not need to copy the treatment machine meshes to their outputs
+  this->GantryPatientCollisionDetection->CountContactsOnlyOn();
+  this->GantryTableTopCollisionDetection->CountContactsOnlyOn();
+  this->GantryPatientSupportCollisionDetection->CountContactsOnlyOn();
+  this->CollimatorPatientCollisionDetection->CountContactsOnlyOn();
+  this->CollimatorTableTopCollisionDetection->CountContactsOnlyOn();
+  this->AdditionalModelsTableTopCollisionDetection->CountContactsOnlyOn();
+  this->AdditionalModelsPatientSupportCollisionDetection->CountContactsOnlyOn();
 }
 
 //----------------------------------------------------------------------------
@@ -140,6 +421,12 @@ vtkSlicerRoomsEyeViewModuleLogic::~vtkSlicerRoomsEyeViewModuleLogic()
     this->AdditionalModelsPatientSupportCollisionDetection->Delete();
     this->AdditionalModelsPatientSupportCollisionDetection = NULL;
   }
+
+  if (this->PatientBodyPolyData)
+  {
+    this->PatientBodyPolyData->Delete();
+    this->PatientBodyPolyData = NULL;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -807,6 +1094,53 @@ bool vtkSlicerRoomsEyeViewModuleLogic::GetPatientBodyPolyData(vtkMRMLRoomsEyeVie
     patientBodyPolyData );
 }
 
+//----------------------------------------------------------------------------
+bool vtkSlicerRoomsEyeViewModuleLogic::UpdatePatientBodyCollisionInputs(vtkMRMLRoomsEyeViewNode* parameterNode)
+{
+  vtkMRMLSegmentationNode* segmentationNode = (parameterNode ? parameterNode->GetPatientBodySegmentationNode() : NULL);
+  const char* segmentID = (parameterNode ? parameterNode->GetPatientBodySegmentID() : NULL);
+  vtkSegment* segment = NULL;
+  if (segmentationNode && segmentationNode->GetID() && segmentationNode->GetSegmentation() && segmentID)
+  {
+    segment = segmentationNode->GetSegmentation()->GetSegment(segmentID);
+  }
+  if (!segment)
+  {
+    this->PatientBodySegmentationNodeID.clear();
+    this->PatientBodySegmentID.clear();
+    return false;
+  }
+
+  // Reuse the surface extracted last time if nothing has changed since. The modification time
+  // is taken after the extraction, as converting to closed surface modifies the segment.
+  if ( this->PatientBodySegmentationNodeID == segmentationNode->GetID() && this->PatientBodySegmentID == segmentID
+    && this->PatientBodyMTime == GetSegmentMTime(segmentationNode, segment) )
+  {
+    return true;
+  }
+
+  if (!this->GetPatientBodyPolyData(parameterNode, this->PatientBodyPolyData))
+  {
+    this->PatientBodySegmentationNodeID.clear();
+    this->PatientBodySegmentID.clear();
+    return false;
+  }
+  this->PatientBodySegmentationNodeID = segmentationNode->GetID();
+  this->PatientBodySegmentID = segmentID;
+  this->PatientBodyMTime = GetSegmentMTime(segmentationNode, segment);
+
+  // The surface is updated in place, so the inputs only need to be set the first time
+  if (this->GantryPatientCollisionDetection->GetInput(1) != this->PatientBodyPolyData)
+  {
+    this->GantryPatientCollisionDetection->SetInput(1, this->PatientBodyPolyData);
+  }
+  if (this->CollimatorPatientCollisionDetection->GetInput(1) != this->PatientBodyPolyData)
+  {
+    this->CollimatorPatientCollisionDetection->SetInput(1, this->PatientBodyPolyData);
+  }
+  return true;
+}
+
 //----------------------------------------------------------------------------
 void vtkSlicerRoomsEyeViewModuleLogic::UpdateCollimatorToGantryTransform(vtkMRMLRoomsEyeViewNode* parameterNode)
 {
@@ -1267,10 +1601,8 @@ std::string vtkSlicerRoomsEyeViewModuleLogic::CheckForCollisions(vtkMRMLRoomsEye
   //}
 
   // Get patient body poly data
-  vtkSmartPointer<vtkPolyData> patientBodyPolyData = vtkSmartPointer<vtkPolyData>::New();
-  if (this->GetPatientBodyPolyData(parameterNode, patientBodyPolyData))
+  if (this->UpdatePatientBodyCollisionInputs(parameterNode))
   {
-    this->GantryPatientCollisionDetection->SetInput(1, patientBodyPolyData);
     this->GantryPatientCollisionDetection->SetTransform(0, vtkLinearTransform::SafeDownCast(gantryToRasTransform));
     this->GantryPatientCollisionDetection->Update();
     if (this->GantryPatientCollisionDetection->GetNumberOfContacts() > 0)
@@ -1278,7 +1610,6 @@ std::string vtkSlicerRoomsEyeViewModuleLogic::CheckForCollisions(vtkMRMLRoomsEye
       statusString = statusString + "Collision between gantry and patient\n";
     }
 
-    this->CollimatorPatientCollisionDetection->SetInput(1, patientBodyPolyData);
     this->CollimatorPatientCollisionDetection->SetTransform(0, vtkLinearTransform::SafeDownCast(collimatorToRasTransform));
     this->CollimatorPatientCollisionDetection->Update();
     if (this->CollimatorPatientCollisionDetection->GetNumberOfContacts() > 0)
@@ -1289,3 +1620,210 @@ std::string vtkSlicerRoomsEyeViewModuleLogic::CheckForCollisions(vtkMRMLRoomsEye
 
   return statusString;
 }
+
+//-----------------------------------------------------------------------------
+std::string vtkSlicerRoomsEyeViewModuleLogic::CheckForCollisionsAlongGantryArc( vtkMRMLRoomsEyeViewNode* parameterNode,
+  double startGantryAngle, double stopGantryAngle, double clearance/*=1.0*/ )
+{
+  if (!parameterNode)
+  {
+    vtkErrorMacro("CheckForCollisionsAlongGantryArc: Invalid parameter set node");
+    return "Invalid parameters";
+  }
+  if (clearance <= 0.0)
+  {
+    vtkErrorMacro("CheckForCollisionsAlongGantryArc: Clearance needs to be positive");
+    return "Invalid parameters";
+  }
+
+  std::string statusString = "";
+
+  // Get transforms used in the collision detection filters
+  vtkMRMLLinearTransformNode* gantryToFixedReferenceTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Gantry, vtkSlicerIECTransformLogic::FixedReference);
+  vtkMRMLLinearTransformNode* patientSupportToPatientSupportRotationTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::PatientSupport, vtkSlicerIECTransformLogic::PatientSupportRotation);
+  vtkMRMLLinearTransformNode* collimatorToGantryTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::Gantry);
+  vtkMRMLLinearTransformNode* tableTopToTableTopEccentricRotationTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::TableTop, vtkSlicerIECTransformLogic::TableTopEccentricRotation);
+  if ( !gantryToFixedReferenceTransformNode || !patientSupportToPatientSupportRotationTransformNode
+    || !collimatorToGantryTransformNode || !tableTopToTableTopEccentricRotationTransformNode )
+  {
+    statusString = "Failed to access IEC transforms";
+    vtkErrorMacro("CheckForCollisionsAlongGantryArc: " + statusString);
+    return statusString;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> fixedReferenceToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  GetParentToWorldMatrix(gantryToFixedReferenceTransformNode, fixedReferenceToRasMatrix);
+  vtkSmartPointer<vtkMatrix4x4> gantryToGantryMatrix = vtkSmartPointer<vtkMatrix4x4>::New(); // Identity
+  vtkSmartPointer<vtkMatrix4x4> collimatorToGantryMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  collimatorToGantryTransformNode->GetMatrixTransformToParent(collimatorToGantryMatrix);
+  vtkSmartPointer<vtkMatrix4x4> patientSupportToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  patientSupportToPatientSupportRotationTransformNode->GetMatrixTransformToWorld(patientSupportToRasMatrix);
+  vtkSmartPointer<vtkMatrix4x4> tableTopToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  tableTopToTableTopEccentricRotationTransformNode->GetMatrixTransformToWorld(tableTopToRasMatrix);
+  vtkSmartPointer<vtkMatrix4x4> patientToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New(); // Identity
+
+  std::vector<GantryArcCollisionPair> pairs;
+  pairs.push_back(GantryArcCollisionPair(this->GantryTableTopCollisionDetection, gantryToGantryMatrix, tableTopToRasMatrix, "gantry and table top"));
+  pairs.push_back(GantryArcCollisionPair(this->GantryPatientSupportCollisionDetection, gantryToGantryMatrix, patientSupportToRasMatrix, "gantry and patient support"));
+  pairs.push_back(GantryArcCollisionPair(this->CollimatorTableTopCollisionDetection, collimatorToGantryMatrix, tableTopToRasMatrix, "collimator and table top"));
+
+  if (this->UpdatePatientBodyCollisionInputs(parameterNode))
+  {
+    pairs.push_back(GantryArcCollisionPair(this->GantryPatientCollisionDetection, gantryToGantryMatrix, patientToRasMatrix, "gantry and patient"));
+    pairs.push_back(GantryArcCollisionPair(this->CollimatorPatientCollisionDetection, collimatorToGantryMatrix, patientToRasMatrix, "collimator and patient"));
+  }
+
+  for (std::vector<GantryArcCollisionPair>::iterator pairIt = pairs.begin(); pairIt != pairs.end(); ++pairIt)
+  {
+    pairIt->Filter->UpdateTrees();
+    double collisionGantryAngle = 0.0;
+    int collisionFound = FindFirstCollisionAlongGantryArc(*pairIt, fixedReferenceToRasMatrix, startGantryAngle, stopGantryAngle, clearance, collisionGantryAngle);
+    if (collisionFound < 0)
+    {
+      // Do not report the arc as collision-free if a pair could not be checked
+      statusString = std::string("Failed to check collisions between ") + pairIt->Description;
+      vtkErrorMacro("CheckForCollisionsAlongGantryArc: " + statusString);
+      return statusString;
+    }
+    if (collisionFound > 0)
+    {
+      std::ostringstream collisionStream;
+      collisionStream << "Collision between " << pairIt->Description << " at gantry angle " << collisionGantryAngle << "\n";
+      statusString = statusString + collisionStream.str();
+    }
+  }
+
+  return statusString;
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerRoomsEyeViewModuleLogic::ComputeCollisionMap( vtkMRMLRoomsEyeViewNode* parameterNode, vtkMRMLScalarVolumeNode* collisionMapVolumeNode,
+  double gantryAngleRange[3], double patientSupportAngleRange[3], double collimatorAngleRange[3]/*=NULL*/ )
+{
+  if (!parameterNode)
+  {
+    vtkErrorMacro("ComputeCollisionMap: Invalid parameter set node");
+    return -1;
+  }
+  if (!collisionMapVolumeNode)
+  {
+    vtkErrorMacro("ComputeCollisionMap: Invalid output volume node");
+    return -1;
+  }
+  if (!gantryAngleRange || !patientSupportAngleRange)
+  {
+    vtkErrorMacro("ComputeCollisionMap: Invalid angle ranges");
+    return -1;
+  }
+
+  CollisionMapTaskList taskList;
+  double currentCollimatorAngleRange[3] = { parameterNode->GetCollimatorRotationAngle(), parameterNode->GetCollimatorRotationAngle(), 1.0 };
+  double* angleRanges[3] = { gantryAngleRange, patientSupportAngleRange, (collimatorAngleRange ? collimatorAngleRange : currentCollimatorAngleRange) };
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    taskList.Dimensions[axis] = GetNumberOfAngles(angleRanges[axis]);
+    if (taskList.Dimensions[axis] == 0)
+    {
+      vtkErrorMacro("ComputeCollisionMap: Invalid angle range (" << angleRanges[axis][0] << ", " << angleRanges[axis][1]
+        << ", step " << angleRanges[axis][2] << "). The step needs to be positive and the last angle not less than the first");
+      return -1;
+    }
+    taskList.FirstAngles[axis] = angleRanges[axis][0];
+    taskList.AngleSteps[axis] = angleRanges[axis][2];
+  }
+
+  // Get the frames of the rotations and the current patient support and table top positions relative to them
+  vtkMRMLLinearTransformNode* gantryToFixedReferenceTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Gantry, vtkSlicerIECTransformLogic::FixedReference);
+  vtkMRMLLinearTransformNode* patientSupportRotationToFixedReferenceTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::PatientSupportRotation, vtkSlicerIECTransformLogic::FixedReference);
+  vtkMRMLLinearTransformNode* patientSupportToPatientSupportRotationTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::PatientSupport, vtkSlicerIECTransformLogic::PatientSupportRotation);
+  vtkMRMLLinearTransformNode* tableTopToTableTopEccentricRotationTransformNode =
+    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::TableTop, vtkSlicerIECTransformLogic::TableTopEccentricRotation);
+  if ( !gantryToFixedReferenceTransformNode || !patientSupportRotationToFixedReferenceTransformNode
+    || !patientSupportToPatientSupportRotationTransformNode || !tableTopToTableTopEccentricRotationTransformNode )
+  {
+    vtkErrorMacro("ComputeCollisionMap: Failed to access IEC transforms");
+    return -1;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> fixedReferenceToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  GetParentToWorldMatrix(gantryToFixedReferenceTransformNode, fixedReferenceToRasMatrix);
+  vtkSmartPointer<vtkMatrix4x4> patientSupportRotationParentToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  GetParentToWorldMatrix(patientSupportRotationToFixedReferenceTransformNode, patientSupportRotationParentToRasMatrix);
+
+  vtkSmartPointer<vtkMatrix4x4> rasToPatientSupportRotationMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  patientSupportRotationToFixedReferenceTransformNode->GetMatrixTransformToWorld(rasToPatientSupportRotationMatrix);
+  rasToPatientSupportRotationMatrix->Invert();
+  vtkSmartPointer<vtkMatrix4x4> patientSupportToPatientSupportRotationMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  patientSupportToPatientSupportRotationTransformNode->GetMatrixTransformToWorld(patientSupportToPatientSupportRotationMatrix);
+  vtkMatrix4x4::Multiply4x4(rasToPatientSupportRotationMatrix, patientSupportToPatientSupportRotationMatrix, patientSupportToPatientSupportRotationMatrix);
+  vtkSmartPointer<vtkMatrix4x4> tableTopToPatientSupportRotationMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  tableTopToTableTopEccentricRotationTransformNode->GetMatrixTransformToWorld(tableTopToPatientSupportRotationMatrix);
+  vtkMatrix4x4::Multiply4x4(rasToPatientSupportRotationMatrix, tableTopToPatientSupportRotationMatrix, tableTopToPatientSupportRotationMatrix);
+
+  taskList.FixedReferenceToRasMatrix = fixedReferenceToRasMatrix;
+  taskList.PatientSupportRotationParentToRasMatrix = patientSupportRotationParentToRasMatrix;
+  taskList.PatientSupportToPatientSupportRotationMatrix = patientSupportToPatientSupportRotationMatrix;
+  taskList.TableTopToPatientSupportRotationMatrix = tableTopToPatientSupportRotationMatrix;
+
+  // Build the OBB trees once, the threads only read them
+  taskList.GantryTableTopCollisionDetection = this->GantryTableTopCollisionDetection;
+  taskList.GantryPatientSupportCollisionDetection = this->GantryPatientSupportCollisionDetection;
+  taskList.CollimatorTableTopCollisionDetection = this->CollimatorTableTopCollisionDetection;
+  taskList.GantryPatientCollisionDetection = this->GantryPatientCollisionDetection;
+  taskList.CollimatorPatientCollisionDetection = this->CollimatorPatientCollisionDetection;
+  this->GantryTableTopCollisionDetection->UpdateTrees();
+  this->GantryPatientSupportCollisionDetection->UpdateTrees();
+  this->CollimatorTableTopCollisionDetection->UpdateTrees();
+
+  if (this->UpdatePatientBodyCollisionInputs(parameterNode))
+  {
+    this->GantryPatientCollisionDetection->UpdateTrees();
+    this->CollimatorPatientCollisionDetection->UpdateTrees();
+    taskList.CheckPatient = true;
+  }
+
+  // Allocate collision map
+  vtkSmartPointer<vtkImageData> collisionMapImageData = vtkSmartPointer<vtkImageData>::New();
+  collisionMapImageData->SetExtent(0, taskList.Dimensions[0]-1, 0, taskList.Dimensions[1]-1, 0, taskList.Dimensions[2]-1);
+  collisionMapImageData->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  taskList.CollisionMap = static_cast<unsigned char*>(collisionMapImageData->GetScalarPointer());
+
+  // Compute collisions for each gantry angle in parallel
+  vtkSlicerRtTaskPool::ExecuteTasks(taskList.Dimensions[0], ComputeCollisionMapTaskFunction, &taskList, this->NumberOfThreads);
+
+  int numberOfCollidingPoses = 0;
+  int numberOfFailedPoses = 0;
+  vtkIdType numberOfPoses = collisionMapImageData->GetNumberOfPoints();
+  for (vtkIdType poseIndex = 0; poseIndex < numberOfPoses; ++poseIndex)
+  {
+    if (taskList.CollisionMap[poseIndex] & CollisionCheckFailed)
+    {
+      ++numberOfFailedPoses;
+    }
+    else if (taskList.CollisionMap[poseIndex])
+    {
+      ++numberOfCollidingPoses;
+    }
+  }
+
+  // Angles are stored in the geometry of the volume
+  collisionMapVolumeNode->SetOrigin(taskList.FirstAngles);
+  collisionMapVolumeNode->SetSpacing(taskList.AngleSteps);
+  collisionMapVolumeNode->SetAndObserveImageData(collisionMapImageData);
+
+  // Poses that could not be checked are not known to be collision-free, so the map cannot be used
+  if (numberOfFailedPoses > 0)
+  {
+    vtkErrorMacro("ComputeCollisionMap: Failed to check collisions at " << numberOfFailedPoses << " poses. Make sure all pieces have a mesh");
+    return -1;
+  }
+
+  return numberOfCollidingPoses;
+}
@@ -31,10 +31,14 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 // Slicer includes
 #include <vtkSlicerModuleLogic.h>
 
+// STD includes
+#include <string>
+
 class vtkCollisionDetectionFilter;
 class vtkSlicerIECTransformLogic;
 class vtkMRMLRoomsEyeViewNode;
 class vtkMRMLModelNode;
+class vtkMRMLScalarVolumeNode;
 class vtkPolyData;
 
 /// \ingroup SlicerRt_QtModules_RoomsEyeView
@@ -53,6 +57,18 @@ public:
   static const char* ELECTRONAPPLICATOR_MODEL_NAME;
   static const char* ORIENTATION_MARKER_MODEL_NODE_NAME;
 
+  /// Bits of the collision map voxel values, one for each pair of objects checked for collision.
+  /// CollisionCheckFailed is set at the poses where a pair could not be checked.
+  enum CollisionMapBits
+  {
+    GantryTableTopCollision = 1,
+    GantryPatientSupportCollision = 2,
+    CollimatorTableTopCollision = 4,
+    GantryPatientCollision = 8,
+    CollimatorPatientCollision = 16,
+    CollisionCheckFailed = 128
+  };
+
 public:
   static vtkSlicerRoomsEyeViewModuleLogic *New();
   vtkTypeMacro(vtkSlicerRoomsEyeViewModuleLogic, vtkSlicerModuleLogic);
@@ -98,6 +114,39 @@ public:
   /// \return string indicating whether collision occurred
   std::string CheckForCollisions(vtkMRMLRoomsEyeViewNode* parameterNode);
 
+  /// Check for collisions on a grid of gantry, patient support and collimator angles.
+  /// The same pieces are checked as in \sa CheckForCollisions, the poses are evaluated in parallel
+  /// without changing the transforms in the scene. Table top and patient support translations are taken
+  /// from the current state of the IEC transforms.
+  /// Each voxel of the output volume is a bit mask of the collisions at a pose (see \sa CollisionMapBits),
+  /// so zero means the pose is collision-free. The I, J and K axes of the volume are the gantry, patient
+  /// support and collimator angles, the origin and spacing of the volume are the first angles and the steps.
+  /// \param gantryAngleRange First angle, last angle and step of the gantry rotation (in degrees)
+  /// \param patientSupportAngleRange First angle, last angle and step of the patient support rotation (in degrees)
+  /// \param collimatorAngleRange First angle, last angle and step of the collimator rotation (in degrees).
+  ///   If NULL, then the collimator angle in the parameter node is used and the map is two-dimensional
+  /// \return Number of poses with collision, -1 on error. If a pair of pieces cannot be checked (for example
+  ///   a piece has no mesh), then the map is still output with CollisionCheckFailed set at those poses, and -1 is returned
+  int ComputeCollisionMap( vtkMRMLRoomsEyeViewNode* parameterNode, vtkMRMLScalarVolumeNode* collisionMapVolumeNode,
+    double gantryAngleRange[3], double patientSupportAngleRange[3], double collimatorAngleRange[3]=NULL );
+
+  /// Check for collisions along a gantry arc, with all the other axes in their current state.
+  /// Instead of sampling the arc, the motion of the gantry and the collimator is bounded over
+  /// angle intervals: an interval is collision-free if the pieces are farther apart at its middle
+  /// than the clearance plus the farthest any point of the moving piece travels within the interval.
+  /// Intervals that cannot be cleared are halved until this travel gets below the clearance, so thin
+  /// pieces cannot pass through each other between two checked angles.
+  /// \param startGantryAngle Gantry angle at the start of the arc (in degrees)
+  /// \param stopGantryAngle Gantry angle at the end of the arc (in degrees). The gantry rotates through
+  ///   the angles between the start and the stop angle, so arcs through 0 degrees need a stop angle
+  ///   outside the [0, 360] range (for example 181 to 539 for a full clockwise arc from 181)
+  /// \param clearance Pieces closer than this distance (in mm) anywhere on the arc are reported as colliding
+  /// \return String containing the collisions with the first gantry angle at which they were found,
+  ///   empty if the whole arc is collision-free. If a pair of pieces cannot be checked, then the check is
+  ///   aborted and the error is returned
+  std::string CheckForCollisionsAlongGantryArc( vtkMRMLRoomsEyeViewNode* parameterNode,
+    double startGantryAngle, double stopGantryAngle, double clearance=1.0 );
+
 // Additional device related methods
 public:
   /// Load basic additional devices (deployed with SlicerRT)
@@ -123,10 +172,19 @@ public:
   vtkGetObjectMacro(AdditionalModelsTableTopCollisionDetection, vtkCollisionDetectionFilter);
   vtkGetObjectMacro(AdditionalModelsPatientSupportCollisionDetection, vtkCollisionDetectionFilter);
 
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
 protected:
   /// Get patient body closed surface poly data from segmentation node and segment selection in the parameter node
   bool GetPatientBodyPolyData(vtkMRMLRoomsEyeViewNode* parameterNode, vtkPolyData* patientBodyPolyData);
 
+  /// Set the patient body closed surface as input 1 of the gantry and collimator patient collision detection filters.
+  /// The surface is only extracted again if the segmentation, the segment or the parent transform of the segmentation
+  /// changed since the last call, so that the OBB trees of the patient are not rebuilt when only the machine moves.
+  /// \return True if there is a patient body to check
+  bool UpdatePatientBodyCollisionInputs(vtkMRMLRoomsEyeViewNode* parameterNode);
+
 protected:
   vtkSlicerIECTransformLogic* IECLogic;
 
@@ -140,6 +198,18 @@ protected:
   vtkCollisionDetectionFilter* AdditionalModelsTableTopCollisionDetection;
   vtkCollisionDetectionFilter* AdditionalModelsPatientSupportCollisionDetection;
 
+  /// Patient body closed surface in the patient collision detection filters (see \sa UpdatePatientBodyCollisionInputs)
+  vtkPolyData* PatientBodyPolyData;
+  /// Segmentation node ID and segment ID the patient body surface was extracted from, empty if there is no surface
+  std::string PatientBodySegmentationNodeID;
+  std::string PatientBodySegmentID;
+  /// Latest modification time of the segmentation and the segment when the patient body surface was extracted
+  vtkMTimeType PatientBodyMTime;
+
+  /// Number of gantry angles of the collision map evaluated at the same time (see \sa vtkSlicerRtTaskPool).
+  /// 0 (default) uses all processor cores, 1 computes the map serially.
+  int NumberOfThreads;
+
 protected:
   vtkSlicerRoomsEyeViewModuleLogic();
   virtual ~vtkSlicerRoomsEyeViewModuleLogic();
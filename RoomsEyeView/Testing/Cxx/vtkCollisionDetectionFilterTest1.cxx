@@ -0,0 +1,259 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkCollisionDetectionFilter.h"
+
+// VTK includes
+#include <vtkIdTypeArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+
+// STD includes
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  /// Translations of the second sphere along the X axis. The spheres (radius 10 and 8) intersect
+  /// at the first, second and fourth position, and are apart at the third one.
+  const double SPHERE_TRANSLATIONS[4] = { 15.0, 5.0, 30.0, 12.0 };
+  const int NUMBER_OF_POSITIONS = 4;
+
+  typedef std::vector< std::pair<vtkIdType, vtkIdType> > ContactCellPairs;
+
+  //-----------------------------------------------------------------------------
+  vtkSmartPointer<vtkPolyData> CreateSphere(double radius, int resolution)
+  {
+    vtkNew<vtkSphereSource> sphereSource;
+    sphereSource->SetRadius(radius);
+    sphereSource->SetThetaResolution(resolution);
+    sphereSource->SetPhiResolution(resolution);
+    sphereSource->Update();
+    vtkSmartPointer<vtkPolyData> sphere = vtkSmartPointer<vtkPolyData>::New();
+    sphere->DeepCopy(sphereSource->GetOutput());
+    return sphere;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Contacting cell pairs of the last update of the filter, sorted so that they can be compared
+  /// regardless of the order the OBB tree nodes were visited in
+  ContactCellPairs GetSortedContactCellPairs(vtkCollisionDetectionFilter* filter)
+  {
+    ContactCellPairs pairs;
+    vtkIdTypeArray* contactCells0 = filter->GetContactCells(0);
+    vtkIdTypeArray* contactCells1 = filter->GetContactCells(1);
+    for (vtkIdType contactIndex = 0; contactIndex < contactCells0->GetNumberOfTuples(); ++contactIndex)
+    {
+      pairs.push_back(std::make_pair(contactCells0->GetValue(contactIndex), contactCells1->GetValue(contactIndex)));
+    }
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Count the contacting cell pairs by testing every triangle of the first mesh against every
+  /// transformed triangle of the second mesh (the first mesh is not transformed)
+  int ComputeNumberOfContactsBruteForce(vtkCollisionDetectionFilter* filter, vtkPolyData* mesh0, vtkPolyData* mesh1, vtkMatrix4x4* matrix1)
+  {
+    int numberOfContacts = 0;
+    vtkIdType numberOfCellPoints = 0;
+    vtkIdType* cellPointIds = NULL;
+    double x1[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double x2[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (vtkIdType cellId0 = 0; cellId0 < mesh0->GetNumberOfCells(); ++cellId0)
+    {
+      double points0[9];
+      double bounds0[6];
+      mesh0->GetCellPoints(cellId0, numberOfCellPoints, cellPointIds);
+      mesh0->GetCellBounds(cellId0, bounds0);
+      for (int pointIndex = 0; pointIndex < 3; ++pointIndex)
+      {
+        mesh0->GetPoints()->GetPoint(cellPointIds[pointIndex], points0 + 3*pointIndex);
+      }
+
+      for (vtkIdType cellId1 = 0; cellId1 < mesh1->GetNumberOfCells(); ++cellId1)
+      {
+        double points1[9];
+        double bounds1[6] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+        mesh1->GetCellPoints(cellId1, numberOfCellPoints, cellPointIds);
+        for (int pointIndex = 0; pointIndex < 3; ++pointIndex)
+        {
+          double in[4] = { 0.0, 0.0, 0.0, 1.0 };
+          double out[4] = { 0.0, 0.0, 0.0, 1.0 };
+          mesh1->GetPoints()->GetPoint(cellPointIds[pointIndex], in);
+          matrix1->MultiplyPoint(in, out);
+          for (int axis = 0; axis < 3; ++axis)
+          {
+            points1[3*pointIndex + axis] = out[axis] / out[3];
+            bounds1[2*axis] = std::min(bounds1[2*axis], points1[3*pointIndex + axis]);
+            bounds1[2*axis+1] = std::max(bounds1[2*axis+1], points1[3*pointIndex + axis]);
+          }
+        }
+
+        if (filter->IntersectPolygonWithPolygon(3, points0, bounds0, 3, points1, bounds1,
+          filter->GetCellTolerance(), x1, x2, vtkCollisionDetectionFilter::VTK_ALL_CONTACTS))
+        {
+          ++numberOfContacts;
+        }
+      }
+    }
+    return numberOfContacts;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Contacts found by a filter that builds its OBB trees from scratch
+  ContactCellPairs GetContactCellPairsWithNewTrees(vtkPolyData* mesh0, vtkPolyData* mesh1, vtkMatrix4x4* matrix0, vtkMatrix4x4* matrix1)
+  {
+    vtkNew<vtkCollisionDetectionFilter> filter;
+    filter->SetInput(0, mesh0);
+    filter->SetInput(1, mesh1);
+    filter->SetMatrix(0, matrix0);
+    filter->SetMatrix(1, matrix1);
+    filter->Update();
+    return GetSortedContactCellPairs(filter.GetPointer());
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkCollisionDetectionFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkPolyData> sphere0 = CreateSphere(10.0, 24);
+  vtkSmartPointer<vtkPolyData> sphere1 = CreateSphere(8.0, 16);
+  vtkNew<vtkMatrix4x4> matrix0;
+  vtkNew<vtkMatrix4x4> matrix1;
+
+  //------------------------------------------------------------------------
+  // Reused OBB trees: moving the second sphere only changes the matrix, so the trees are built once
+  // and the contacts have to be the same as with trees built for the given position
+  vtkNew<vtkCollisionDetectionFilter> filter;
+  filter->SetInput(0, sphere0);
+  filter->SetInput(1, sphere1);
+  filter->SetMatrix(0, matrix0.GetPointer());
+  filter->SetMatrix(1, matrix1.GetPointer());
+
+  std::vector<int> numberOfContactsAtPositions(NUMBER_OF_POSITIONS, 0);
+  for (int positionIndex = 0; positionIndex < NUMBER_OF_POSITIONS; ++positionIndex)
+  {
+    matrix1->SetElement(0, 3, SPHERE_TRANSLATIONS[positionIndex]);
+    filter->Update();
+
+    ContactCellPairs contacts = GetSortedContactCellPairs(filter.GetPointer());
+    ContactCellPairs expectedContacts = GetContactCellPairsWithNewTrees(sphere0, sphere1, matrix0.GetPointer(), matrix1.GetPointer());
+    if (contacts != expectedContacts)
+    {
+      std::cerr << "Contacts with reused OBB trees differ from the ones with new trees at translation "
+        << SPHERE_TRANSLATIONS[positionIndex] << ": " << contacts.size() << " instead of " << expectedContacts.size() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    int expectedNumberOfContacts = ComputeNumberOfContactsBruteForce(filter.GetPointer(), sphere0, sphere1, matrix1.GetPointer());
+    if (filter->GetNumberOfContacts() != expectedNumberOfContacts)
+    {
+      std::cerr << "Invalid number of contacts at translation " << SPHERE_TRANSLATIONS[positionIndex] << ": "
+        << filter->GetNumberOfContacts() << " instead of " << expectedNumberOfContacts << std::endl;
+      return EXIT_FAILURE;
+    }
+    if ((positionIndex == 2) != (expectedNumberOfContacts == 0))
+    {
+      std::cerr << "Unexpected collision state at translation " << SPHERE_TRANSLATIONS[positionIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+    numberOfContactsAtPositions[positionIndex] = expectedNumberOfContacts;
+  }
+  if (filter->GetNumberOfTreeBuilds() != 2)
+  {
+    std::cerr << "OBB trees were rebuilt on transform changes: " << filter->GetNumberOfTreeBuilds() << " builds instead of 2" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Modifying a mesh rebuilds its tree only
+  sphere1->Modified();
+  filter->Update();
+  if (filter->GetNumberOfTreeBuilds() != 3)
+  {
+    std::cerr << "OBB tree was not rebuilt after the mesh was modified: " << filter->GetNumberOfTreeBuilds() << " builds instead of 3" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //------------------------------------------------------------------------
+  // Contact counting: the contacts are the same as in the full mode, and the search stops at the first
+  // contact in first contact mode, both when updating the filter and when calling ComputeNumberOfContacts
+  vtkNew<vtkCollisionDetectionFilter> countFilter;
+  countFilter->CountContactsOnlyOn();
+  countFilter->SetInput(0, sphere0);
+  countFilter->SetInput(1, sphere1);
+  countFilter->SetMatrix(0, matrix0.GetPointer());
+  countFilter->SetMatrix(1, matrix1.GetPointer());
+  countFilter->UpdateTrees();
+  for (int positionIndex = 0; positionIndex < NUMBER_OF_POSITIONS; ++positionIndex)
+  {
+    matrix1->SetElement(0, 3, SPHERE_TRANSLATIONS[positionIndex]);
+    int expectedNumberOfContacts = numberOfContactsAtPositions[positionIndex];
+    int expectedNumberOfFirstContacts = (expectedNumberOfContacts > 0 ? 1 : 0);
+
+    countFilter->SetCollisionModeToAllContacts();
+    countFilter->Update();
+    if (countFilter->GetNumberOfContacts() != expectedNumberOfContacts
+      || GetSortedContactCellPairs(countFilter.GetPointer()) != GetContactCellPairsWithNewTrees(sphere0, sphere1, matrix0.GetPointer(), matrix1.GetPointer()))
+    {
+      std::cerr << "Contacts counted without generating outputs are invalid at translation " << SPHERE_TRANSLATIONS[positionIndex] << ": "
+        << countFilter->GetNumberOfContacts() << " instead of " << expectedNumberOfContacts << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (countFilter->GetOutput(0)->GetNumberOfCells() != 0 || countFilter->GetContactsOutput()->GetNumberOfPoints() != 0)
+    {
+      std::cerr << "Outputs were generated although only the contacts were to be counted" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    countFilter->SetCollisionModeToFirstContact();
+    countFilter->Update();
+    if (countFilter->GetNumberOfContacts() != expectedNumberOfFirstContacts)
+    {
+      std::cerr << "Counting in first contact mode did not stop at the first contact at translation " << SPHERE_TRANSLATIONS[positionIndex] << ": "
+        << countFilter->GetNumberOfContacts() << " contacts instead of " << expectedNumberOfFirstContacts << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    int numberOfContacts = countFilter->ComputeNumberOfContacts(matrix0.GetPointer(), matrix1.GetPointer(), 0);
+    int numberOfFirstContacts = countFilter->ComputeNumberOfContacts(matrix0.GetPointer(), matrix1.GetPointer(), 1);
+    if (numberOfContacts != expectedNumberOfContacts || numberOfFirstContacts != expectedNumberOfFirstContacts)
+    {
+      std::cerr << "ComputeNumberOfContacts returned " << numberOfContacts << " (first contact only: " << numberOfFirstContacts
+        << ") instead of " << expectedNumberOfContacts << " (" << expectedNumberOfFirstContacts << ") at translation "
+        << SPHERE_TRANSLATIONS[positionIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (countFilter->GetNumberOfTreeBuilds() != 2)
+  {
+    std::cerr << "OBB trees of the counting filter were rebuilt: " << countFilter->GetNumberOfTreeBuilds() << " builds instead of 2" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Collision detection test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,333 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Room's eye view includes
+#include "vtkMRMLRoomsEyeViewNode.h"
+#include "vtkSlicerRoomsEyeViewModuleLogic.h"
+
+// SlicerRt includes
+#include "vtkCollisionDetectionFilter.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCubeSource.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+  //-----------------------------------------------------------------------------
+  /// Triangulated axis-aligned cube
+  vtkSmartPointer<vtkPolyData> CreateCube(double centerX, double centerY, double centerZ, double size)
+  {
+    vtkNew<vtkCubeSource> cubeSource;
+    cubeSource->SetCenter(centerX, centerY, centerZ);
+    cubeSource->SetXLength(size);
+    cubeSource->SetYLength(size);
+    cubeSource->SetZLength(size);
+    vtkNew<vtkTriangleFilter> triangleFilter;
+    triangleFilter->SetInputConnection(cubeSource->GetOutputPort());
+    triangleFilter->Update();
+    vtkSmartPointer<vtkPolyData> cube = vtkSmartPointer<vtkPolyData>::New();
+    cube->DeepCopy(triangleFilter->GetOutput());
+    return cube;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compute the collision map with the given number of threads and check that only the expected pose collides
+  bool ComputeAndCheckCollisionMap(vtkSlicerRoomsEyeViewModuleLogic* logic, vtkMRMLRoomsEyeViewNode* parameterNode,
+    vtkMRMLScalarVolumeNode* collisionMapVolumeNode, int numberOfThreads,
+    double gantryAngleRange[3], double patientSupportAngleRange[3], double collimatorAngleRange[3],
+    const int expectedDimensions[3], const int expectedCollisionIndex[3], unsigned char expectedCollisions)
+  {
+    logic->SetNumberOfThreads(numberOfThreads);
+    int numberOfCollidingPoses = logic->ComputeCollisionMap(parameterNode, collisionMapVolumeNode,
+      gantryAngleRange, patientSupportAngleRange, collimatorAngleRange);
+    if (numberOfCollidingPoses != 1)
+    {
+      std::cerr << "Invalid number of colliding poses with " << numberOfThreads << " thread(s): " << numberOfCollidingPoses << " instead of 1" << std::endl;
+      return false;
+    }
+
+    vtkImageData* collisionMap = collisionMapVolumeNode->GetImageData();
+    int* dimensions = collisionMap->GetDimensions();
+    if (dimensions[0] != expectedDimensions[0] || dimensions[1] != expectedDimensions[1] || dimensions[2] != expectedDimensions[2])
+    {
+      std::cerr << "Invalid collision map dimensions: " << dimensions[0] << ", " << dimensions[1] << ", " << dimensions[2] << std::endl;
+      return false;
+    }
+    double* origin = collisionMapVolumeNode->GetOrigin();
+    double* spacing = collisionMapVolumeNode->GetSpacing();
+    double* angleRanges[3] = { gantryAngleRange, patientSupportAngleRange, collimatorAngleRange };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (origin[axis] != angleRanges[axis][0] || spacing[axis] != angleRanges[axis][2])
+      {
+        std::cerr << "Collision map geometry does not match the angle ranges on axis " << axis << std::endl;
+        return false;
+      }
+    }
+
+    bool valid = true;
+    for (int collimatorIndex = 0; collimatorIndex < dimensions[2]; ++collimatorIndex)
+    {
+      for (int patientSupportIndex = 0; patientSupportIndex < dimensions[1]; ++patientSupportIndex)
+      {
+        for (int gantryIndex = 0; gantryIndex < dimensions[0]; ++gantryIndex)
+        {
+          unsigned char collisions = *static_cast<unsigned char*>(collisionMap->GetScalarPointer(gantryIndex, patientSupportIndex, collimatorIndex));
+          bool isCollisionPose = (gantryIndex == expectedCollisionIndex[0] && patientSupportIndex == expectedCollisionIndex[1]
+            && collimatorIndex == expectedCollisionIndex[2]);
+          if (collisions != (isCollisionPose ? expectedCollisions : 0))
+          {
+            std::cerr << "Invalid collisions " << (int)collisions << " with " << numberOfThreads << " thread(s) at gantry angle "
+              << origin[0] + gantryIndex * spacing[0] << ", patient support angle " << origin[1] + patientSupportIndex * spacing[1]
+              << ", collimator angle " << origin[2] + collimatorIndex * spacing[2] << std::endl;
+            valid = false;
+          }
+        }
+      }
+    }
+    return valid;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get the gantry angle from the collision report of a pair of pieces
+  /// \return True if the report contains the pair (and nothing else)
+  bool GetReportedCollisionGantryAngle(const std::string& statusString, const std::string& pairDescription, double& gantryAngle)
+  {
+    std::string prefix = "Collision between " + pairDescription + " at gantry angle ";
+    if (statusString.compare(0, prefix.size(), prefix) != 0 || statusString.find('\n') != statusString.size() - 1)
+    {
+      return false;
+    }
+    gantryAngle = strtod(statusString.c_str() + prefix.size(), NULL);
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check the collision found along a gantry arc against the first and last contact angles found by sampling
+  /// the arc densely. The arc check may report the collision earlier (as the pieces get within the clearance
+  /// before they touch), but never later than the first contact.
+  bool CheckGantryArc(vtkSlicerRoomsEyeViewModuleLogic* logic, vtkMRMLRoomsEyeViewNode* parameterNode,
+    double startGantryAngle, double stopGantryAngle, double expectedContactGantryAngle)
+  {
+    const double maximumEarlyDetectionAngle = 2.0;
+    std::string statusString = logic->CheckForCollisionsAlongGantryArc(parameterNode, startGantryAngle, stopGantryAngle, 1.0);
+    double collisionGantryAngle = 0.0;
+    if (!GetReportedCollisionGantryAngle(statusString, "gantry and table top", collisionGantryAngle))
+    {
+      std::cerr << "Invalid collision report for gantry arc from " << startGantryAngle << " to " << stopGantryAngle << ": '" << statusString << "'" << std::endl;
+      return false;
+    }
+
+    // Distance from the contact angle along the direction of the rotation
+    double angleBeforeContact = (stopGantryAngle > startGantryAngle ? expectedContactGantryAngle - collisionGantryAngle : collisionGantryAngle - expectedContactGantryAngle);
+    if (angleBeforeContact < -0.01 || angleBeforeContact > maximumEarlyDetectionAngle)
+    {
+      std::cerr << "Collision along gantry arc from " << startGantryAngle << " to " << stopGantryAngle << " reported at " << collisionGantryAngle
+        << " degrees, but the first contact is at " << expectedContactGantryAngle << " degrees" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerRoomsEyeViewCollisionTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkMRMLScene> mrmlScene;
+  vtkNew<vtkSlicerRoomsEyeViewModuleLogic> revLogic;
+  revLogic->SetMRMLScene(mrmlScene.GetPointer());
+  revLogic->BuildRoomsEyeViewTransformHierarchy();
+
+  vtkNew<vtkMRMLRoomsEyeViewNode> paramNode;
+  mrmlScene->AddNode(paramNode.GetPointer());
+
+  // Synthetic pieces. All IEC transforms are identity, so the fixed reference frame is RAS.
+  // The gantry piece is on the gantry rotation axis and the patient support is below the table top,
+  // so neither collides at any angle. The collimator piece is off the collimator axis, and the only pose
+  // in the map where it gets into the table top (at (-100, 40, 0)) is gantry 90, patient support 0 and
+  // collimator 90 degrees. (The mirrored pose at gantry 270 and patient support 180 is outside the map.)
+  vtkSmartPointer<vtkPolyData> gantryPolyData = CreateCube(0.0, 500.0, 0.0, 20.0);
+  vtkSmartPointer<vtkPolyData> collimatorPolyData = CreateCube(40.0, 0.0, 92.0, 10.0);
+  vtkSmartPointer<vtkPolyData> patientSupportPolyData = CreateCube(0.0, 0.0, -300.0, 100.0);
+  vtkSmartPointer<vtkPolyData> tableTopPolyData = CreateCube(-100.0, 40.0, 0.0, 20.0);
+  revLogic->GetGantryTableTopCollisionDetection()->SetInput(0, gantryPolyData);
+  revLogic->GetGantryTableTopCollisionDetection()->SetInput(1, tableTopPolyData);
+  revLogic->GetGantryPatientSupportCollisionDetection()->SetInput(0, gantryPolyData);
+  revLogic->GetGantryPatientSupportCollisionDetection()->SetInput(1, patientSupportPolyData);
+  revLogic->GetCollimatorTableTopCollisionDetection()->SetInput(0, collimatorPolyData);
+  revLogic->GetCollimatorTableTopCollisionDetection()->SetInput(1, tableTopPolyData);
+
+  vtkNew<vtkMRMLScalarVolumeNode> collisionMapVolumeNode;
+  mrmlScene->AddNode(collisionMapVolumeNode.GetPointer());
+
+  double gantryAngleRange[3] = { 0.0, 180.0, 90.0 };
+  double patientSupportAngleRange[3] = { 0.0, 180.0, 90.0 };
+  double collimatorAngleRange[3] = { 0.0, 270.0, 90.0 };
+  const int expectedDimensions[3] = { 3, 3, 4 };
+  const int expectedCollisionIndex[3] = { 1, 0, 1 };
+
+  // The map has to be the same regardless of how the gantry angles are distributed between the threads
+  if ( !ComputeAndCheckCollisionMap(revLogic.GetPointer(), paramNode.GetPointer(), collisionMapVolumeNode.GetPointer(), 1,
+      gantryAngleRange, patientSupportAngleRange, collimatorAngleRange, expectedDimensions, expectedCollisionIndex,
+      vtkSlicerRoomsEyeViewModuleLogic::CollimatorTableTopCollision)
+    || !ComputeAndCheckCollisionMap(revLogic.GetPointer(), paramNode.GetPointer(), collisionMapVolumeNode.GetPointer(), 4,
+      gantryAngleRange, patientSupportAngleRange, collimatorAngleRange, expectedDimensions, expectedCollisionIndex,
+      vtkSlicerRoomsEyeViewModuleLogic::CollimatorTableTopCollision) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  //------------------------------------------------------------------------
+  // Missing mesh: the table top of the collimator pair is not set, so its OBB trees cannot be built.
+  // The poses cannot be reported as collision-free, so every pose is marked as failed and the map computation fails.
+  vtkNew<vtkSlicerRoomsEyeViewModuleLogic> missingMeshLogic;
+  missingMeshLogic->SetMRMLScene(mrmlScene.GetPointer());
+  missingMeshLogic->GetGantryTableTopCollisionDetection()->SetInput(0, gantryPolyData);
+  missingMeshLogic->GetGantryTableTopCollisionDetection()->SetInput(1, tableTopPolyData);
+  missingMeshLogic->GetGantryPatientSupportCollisionDetection()->SetInput(0, gantryPolyData);
+  missingMeshLogic->GetGantryPatientSupportCollisionDetection()->SetInput(1, patientSupportPolyData);
+  missingMeshLogic->GetCollimatorTableTopCollisionDetection()->SetInput(0, collimatorPolyData);
+
+  vtkNew<vtkMRMLScalarVolumeNode> failedCollisionMapVolumeNode;
+  mrmlScene->AddNode(failedCollisionMapVolumeNode.GetPointer());
+  TESTING_OUTPUT_ASSERT_WARNINGS_ERRORS_BEGIN();
+  int numberOfCollidingPoses = missingMeshLogic->ComputeCollisionMap(paramNode.GetPointer(), failedCollisionMapVolumeNode.GetPointer(),
+    gantryAngleRange, patientSupportAngleRange, collimatorAngleRange);
+  TESTING_OUTPUT_ASSERT_WARNINGS_ERRORS_END();
+  if (numberOfCollidingPoses != -1)
+  {
+    std::cerr << "Collision map computed with a missing mesh: " << numberOfCollidingPoses << " colliding poses instead of failure" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkImageData* failedCollisionMap = failedCollisionMapVolumeNode->GetImageData();
+  if (!failedCollisionMap || failedCollisionMap->GetNumberOfPoints() != expectedDimensions[0] * expectedDimensions[1] * expectedDimensions[2])
+  {
+    std::cerr << "Collision map is not output when a mesh is missing" << std::endl;
+    return EXIT_FAILURE;
+  }
+  unsigned char* failedCollisions = static_cast<unsigned char*>(failedCollisionMap->GetScalarPointer());
+  for (vtkIdType poseIndex = 0; poseIndex < failedCollisionMap->GetNumberOfPoints(); ++poseIndex)
+  {
+    if (!(failedCollisions[poseIndex] & vtkSlicerRoomsEyeViewModuleLogic::CollisionCheckFailed))
+    {
+      std::cerr << "Pose " << poseIndex << " is not marked as failed when a mesh is missing" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  //------------------------------------------------------------------------
+  // Gantry arc: the gantry piece is at 100 mm from the rotation axis, and sweeps through the table top piece
+  // (at (-100, 0, 0) in its new position) around gantry angle 90. The collimator piece is on the rotation axis.
+  vtkNew<vtkSlicerRoomsEyeViewModuleLogic> arcLogic;
+  arcLogic->SetMRMLScene(mrmlScene.GetPointer());
+  vtkSmartPointer<vtkPolyData> arcGantryPolyData = CreateCube(0.0, 0.0, 100.0, 20.0);
+  vtkSmartPointer<vtkPolyData> arcCollimatorPolyData = CreateCube(0.0, -500.0, 0.0, 20.0);
+  vtkSmartPointer<vtkPolyData> arcTableTopPolyData = CreateCube(-100.0, 0.0, 0.0, 20.0);
+  arcLogic->GetGantryTableTopCollisionDetection()->SetInput(0, arcGantryPolyData);
+  arcLogic->GetGantryTableTopCollisionDetection()->SetInput(1, arcTableTopPolyData);
+  arcLogic->GetGantryPatientSupportCollisionDetection()->SetInput(0, arcGantryPolyData);
+  arcLogic->GetGantryPatientSupportCollisionDetection()->SetInput(1, patientSupportPolyData);
+  arcLogic->GetCollimatorTableTopCollisionDetection()->SetInput(0, arcCollimatorPolyData);
+  arcLogic->GetCollimatorTableTopCollisionDetection()->SetInput(1, arcTableTopPolyData);
+
+  // Find the first and last contact angles by sampling the arc with the same gantry transform as the logic
+  vtkCollisionDetectionFilter* gantryTableTopFilter = arcLogic->GetGantryTableTopCollisionDetection();
+  gantryTableTopFilter->UpdateTrees();
+  vtkNew<vtkTransform> gantryToRasTransform;
+  vtkNew<vtkMatrix4x4> tableTopToRasMatrix;
+  double firstContactGantryAngle = -1.0;
+  double lastContactGantryAngle = -1.0;
+  for (int sampleIndex = 0; sampleIndex <= 18000; ++sampleIndex)
+  {
+    double gantryAngle = sampleIndex * 0.01;
+    gantryToRasTransform->Identity();
+    gantryToRasTransform->RotateY(gantryAngle * (-1.0));
+    if (gantryTableTopFilter->ComputeNumberOfContacts(gantryToRasTransform->GetMatrix(), tableTopToRasMatrix.GetPointer(), 1) > 0)
+    {
+      if (firstContactGantryAngle < 0.0)
+      {
+        firstContactGantryAngle = gantryAngle;
+      }
+      lastContactGantryAngle = gantryAngle;
+    }
+  }
+  if (firstContactGantryAngle <= 0.0 || lastContactGantryAngle >= 180.0)
+  {
+    std::cerr << "Invalid synthetic gantry arc setup, contacts between gantry angles " << firstContactGantryAngle
+      << " and " << lastContactGantryAngle << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The collision is found from both directions, at the angle where the gantry first reaches the table top
+  if ( !CheckGantryArc(arcLogic.GetPointer(), paramNode.GetPointer(), 0.0, 180.0, firstContactGantryAngle)
+    || !CheckGantryArc(arcLogic.GetPointer(), paramNode.GetPointer(), 180.0, 0.0, lastContactGantryAngle) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The rest of the circle is collision-free
+  std::string statusString = arcLogic->CheckForCollisionsAlongGantryArc(paramNode.GetPointer(), 180.0, 360.0, 1.0);
+  if (!statusString.empty())
+  {
+    std::cerr << "Collision reported along collision-free gantry arc: '" << statusString << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Near miss: a table top piece just outside the circle swept by the outer edges of the gantry piece.
+  // The pieces never touch, but the piece is reported if the gap is within the clearance.
+  const double clearance = 1.0;
+  const double sweptRadius = sqrt(110.0*110.0 + 10.0*10.0);
+  const double gaps[2] = { 0.5 * clearance, 3.0 * clearance };
+  for (int gapIndex = 0; gapIndex < 2; ++gapIndex)
+  {
+    vtkSmartPointer<vtkPolyData> nearMissTableTopPolyData = CreateCube(-(sweptRadius + gaps[gapIndex] + 10.0), 0.0, 0.0, 20.0);
+    arcLogic->GetGantryTableTopCollisionDetection()->SetInput(1, nearMissTableTopPolyData);
+    arcLogic->GetCollimatorTableTopCollisionDetection()->SetInput(1, nearMissTableTopPolyData);
+    statusString = arcLogic->CheckForCollisionsAlongGantryArc(paramNode.GetPointer(), 0.0, 180.0, clearance);
+    double collisionGantryAngle = 0.0;
+    bool collisionReported = GetReportedCollisionGantryAngle(statusString, "gantry and table top", collisionGantryAngle);
+    if (collisionReported != (gaps[gapIndex] < clearance) || (!collisionReported && !statusString.empty()))
+    {
+      std::cerr << "Invalid collision report for a gap of " << gaps[gapIndex] << " mm with clearance " << clearance
+        << " mm: '" << statusString << "'" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Collision map and gantry arc test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -80,6 +80,11 @@ public:
   /// Set Hausdorff table node
   void SetAndObserveHausdorffTableNode(vtkMRMLTableNode* node);
 
+  /// Get overlap table node, containing the overlap metrics of all pairs of reference and compare segments
+  vtkMRMLTableNode* GetOverlapTableNode();
+  /// Set overlap table node
+  void SetAndObserveOverlapTableNode(vtkMRMLTableNode* node);
+
   /// Get reference segment ID
   vtkGetStringMacro(ReferenceSegmentID);
   /// Set reference segment ID
@@ -1,22 +1,606 @@
 #include "vtkPolyDataDistanceHistogramFilter.h"
 
+// SlicerRT includes
+#include "vtkSlicerRtTaskPool.h"
+
 // vtk includes
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkCutter.h>
 #include <vtkDataObject.h>
 #include <vtkImageAccumulate.h>
 #include <vtkImageData.h>
-#include <vtkImplicitPolyDataDistance.h>
 #include <vtkInformation.h>
 #include <vtkInformationVector.h>
 #include <vtkIntArray.h>
 #include <vtkMath.h>
 #include <vtkObjectFactory.h>
+#include <vtkPlane.h>
+#include <vtkPointData.h>
+#include <vtkPolyDataNormals.h>
 #include <vtkPolyDataPointSampler.h>
 #include <vtkSmartPointer.h>
-#include <vtkSortDataArray.h>
 #include <vtkStreamingDemandDrivenPipeline.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
 
 vtkStandardNewMacro(vtkPolyDataDistanceHistogramFilter);
 
+namespace
+{
+  /// Tolerance of barycentric weights for deciding if the closest point is on an edge or vertex (same as in vtkImplicitPolyDataDistance)
+  const double CLOSEST_POINT_WEIGHT_TOLERANCE = 1.0e-12;
+  /// Maximum number of triangles in a leaf node of the bounding volume hierarchy
+  const int MAXIMUM_TRIANGLES_PER_LEAF = 8;
+  /// Number of points evaluated in one parallel task
+  const vtkIdType POINTS_PER_TASK = 1024;
+
+  //----------------------------------------------------------------------------
+  /// Closest point locator on a triangle mesh using a bounding volume hierarchy (axis aligned boxes).
+  /// Built once per mesh, then queries are read-only and can be run from multiple threads.
+  /// The sign of the distance is determined the same way as in vtkImplicitPolyDataDistance
+  /// (negative inside), using the face, edge or vertex normal depending on where the closest point is.
+  class SurfaceDistanceLocator
+  {
+  public:
+    SurfaceDistanceLocator()
+    {
+    }
+
+    /// Build the hierarchy from the polygons of a poly data
+    void Build(vtkPolyData* polyData)
+    {
+      this->Nodes.clear();
+      this->TriangleVertices.clear();
+      this->TrianglePointIds.clear();
+      this->TriangleNormals.clear();
+      this->EdgeNeighbors.clear();
+      this->PointNormals.clear();
+      if (!polyData || polyData->GetNumberOfPolys() == 0)
+      {
+        return;
+      }
+
+      // Triangulate and compute normals as vtkImplicitPolyDataDistance does.
+      // Splitting is turned off so that neighboring triangles share their points.
+      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+      triangleFilter->PassVertsOff();
+      triangleFilter->PassLinesOff();
+      triangleFilter->SetInputData(polyData);
+      vtkSmartPointer<vtkPolyDataNormals> normalsFilter = vtkSmartPointer<vtkPolyDataNormals>::New();
+      normalsFilter->SetInputConnection(triangleFilter->GetOutputPort());
+      normalsFilter->ComputePointNormalsOn();
+      normalsFilter->ComputeCellNormalsOn();
+      normalsFilter->SplittingOff();
+      normalsFilter->Update();
+      vtkPolyData* triangles = normalsFilter->GetOutput();
+      vtkPoints* points = triangles->GetPoints();
+      vtkDataArray* cellNormals = triangles->GetCellData()->GetNormals();
+      vtkDataArray* pointNormals = triangles->GetPointData()->GetNormals();
+      if (!points || !cellNormals || !pointNormals)
+      {
+        return;
+      }
+
+      vtkIdType numberOfPoints = points->GetNumberOfPoints();
+      this->PointNormals.resize(3*numberOfPoints);
+      for (vtkIdType pointId=0; pointId<numberOfPoints; ++pointId)
+      {
+        pointNormals->GetTuple(pointId, &this->PointNormals[3*pointId]);
+      }
+
+      vtkCellArray* polys = triangles->GetPolys();
+      vtkIdType numberOfTriangles = polys->GetNumberOfCells();
+      this->TriangleVertices.reserve(9*numberOfTriangles);
+      this->TrianglePointIds.reserve(3*numberOfTriangles);
+      this->TriangleNormals.reserve(3*numberOfTriangles);
+      vtkIdType numberOfCellPoints = 0;
+      vtkIdType* cellPointIds = NULL;
+      vtkIdType cellId = 0;
+      for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); ++cellId)
+      {
+        if (numberOfCellPoints != 3)
+        {
+          continue;
+        }
+        double normal[3] = {0.0, 0.0, 0.0};
+        cellNormals->GetTuple(cellId, normal);
+        for (int i=0; i<3; ++i)
+        {
+          double point[3] = {0.0, 0.0, 0.0};
+          points->GetPoint(cellPointIds[i], point);
+          this->TriangleVertices.push_back(point[0]);
+          this->TriangleVertices.push_back(point[1]);
+          this->TriangleVertices.push_back(point[2]);
+          this->TrianglePointIds.push_back(cellPointIds[i]);
+          this->TriangleNormals.push_back(normal[i]);
+        }
+      }
+      numberOfTriangles = (vtkIdType)this->TrianglePointIds.size() / 3;
+      if (numberOfTriangles == 0)
+      {
+        return;
+      }
+
+      // Find the neighbor across each edge (only if the edge is shared by exactly two triangles)
+      std::vector<TriangleEdge> edges;
+      edges.reserve(3*numberOfTriangles);
+      for (vtkIdType triangleId=0; triangleId<numberOfTriangles; ++triangleId)
+      {
+        for (int i=0; i<3; ++i)
+        {
+          // Edge opposite to vertex i
+          TriangleEdge edge;
+          edge.PointIds[0] = std::min(this->TrianglePointIds[3*triangleId+(i+1)%3], this->TrianglePointIds[3*triangleId+(i+2)%3]);
+          edge.PointIds[1] = std::max(this->TrianglePointIds[3*triangleId+(i+1)%3], this->TrianglePointIds[3*triangleId+(i+2)%3]);
+          edge.TriangleEdgeIndex = 3*triangleId+i;
+          edges.push_back(edge);
+        }
+      }
+      std::sort(edges.begin(), edges.end());
+      this->EdgeNeighbors.assign(3*numberOfTriangles, -1);
+      for (size_t edgeIndex=0; edgeIndex<edges.size(); )
+      {
+        size_t sameEdgeEnd = edgeIndex+1;
+        while (sameEdgeEnd<edges.size() && edges[sameEdgeEnd].PointIds[0] == edges[edgeIndex].PointIds[0]
+          && edges[sameEdgeEnd].PointIds[1] == edges[edgeIndex].PointIds[1])
+        {
+          ++sameEdgeEnd;
+        }
+        if (sameEdgeEnd-edgeIndex == 2)
+        {
+          this->EdgeNeighbors[edges[edgeIndex].TriangleEdgeIndex] = edges[edgeIndex+1].TriangleEdgeIndex / 3;
+          this->EdgeNeighbors[edges[edgeIndex+1].TriangleEdgeIndex] = edges[edgeIndex].TriangleEdgeIndex / 3;
+        }
+        edgeIndex = sameEdgeEnd;
+      }
+
+      // Build hierarchy by splitting the triangles at the median of the centroids along the longest axis
+      std::vector<vtkIdType> triangleOrder(numberOfTriangles);
+      std::vector<double> centroids(3*numberOfTriangles);
+      for (vtkIdType triangleId=0; triangleId<numberOfTriangles; ++triangleId)
+      {
+        triangleOrder[triangleId] = triangleId;
+        const double* vertices = &this->TriangleVertices[9*triangleId];
+        for (int axis=0; axis<3; ++axis)
+        {
+          centroids[3*triangleId+axis] = (vertices[axis] + vertices[3+axis] + vertices[6+axis]) / 3.0;
+        }
+      }
+      this->Nodes.reserve(2*numberOfTriangles/MAXIMUM_TRIANGLES_PER_LEAF+1);
+      this->BuildNode(triangleOrder, centroids, 0, numberOfTriangles);
+
+      // Store triangles in hierarchy order so that the leaves reference contiguous ranges
+      std::vector<double> orderedVertices(this->TriangleVertices.size());
+      std::vector<vtkIdType> orderedPointIds(this->TrianglePointIds.size());
+      std::vector<double> orderedNormals(this->TriangleNormals.size());
+      std::vector<vtkIdType> newTriangleIds(numberOfTriangles);
+      for (vtkIdType index=0; index<numberOfTriangles; ++index)
+      {
+        vtkIdType triangleId = triangleOrder[index];
+        newTriangleIds[triangleId] = index;
+        std::copy(&this->TriangleVertices[9*triangleId], &this->TriangleVertices[9*triangleId]+9, &orderedVertices[9*index]);
+        std::copy(&this->TrianglePointIds[3*triangleId], &this->TrianglePointIds[3*triangleId]+3, &orderedPointIds[3*index]);
+        std::copy(&this->TriangleNormals[3*triangleId], &this->TriangleNormals[3*triangleId]+3, &orderedNormals[3*index]);
+      }
+      std::vector<vtkIdType> orderedEdgeNeighbors(this->EdgeNeighbors.size());
+      for (vtkIdType index=0; index<numberOfTriangles; ++index)
+      {
+        vtkIdType triangleId = triangleOrder[index];
+        for (int i=0; i<3; ++i)
+        {
+          vtkIdType neighborId = this->EdgeNeighbors[3*triangleId+i];
+          orderedEdgeNeighbors[3*index+i] = (neighborId >= 0 ? newTriangleIds[neighborId] : -1);
+        }
+      }
+      this->TriangleVertices.swap(orderedVertices);
+      this->TrianglePointIds.swap(orderedPointIds);
+      this->TriangleNormals.swap(orderedNormals);
+      this->EdgeNeighbors.swap(orderedEdgeNeighbors);
+    }
+
+    /// Return true if the locator contains triangles
+    bool IsEmpty() const
+    {
+      return this->Nodes.empty();
+    }
+
+    /// Get distance of a point from the surface. Negative inside if signed distance is requested.
+    double EvaluateDistance(const double x[3], bool signedDistance) const
+    {
+      double closestPoint[3] = {0.0, 0.0, 0.0};
+      double weights[3] = {0.0, 0.0, 0.0};
+      vtkIdType triangleId = -1;
+      double distance = sqrt(this->FindClosestPoint(x, closestPoint, triangleId, weights));
+      if (!signedDistance || triangleId < 0)
+      {
+        return distance;
+      }
+
+      // Determine normal at the closest point: face, edge (average of the two faces) or vertex normal
+      int numberOfZeroWeights = 0;
+      int zeroWeightIndex = -1;
+      int nonZeroWeightIndex = -1;
+      for (int i=0; i<3; ++i)
+      {
+        if (fabs(weights[i]) < CLOSEST_POINT_WEIGHT_TOLERANCE)
+        {
+          ++numberOfZeroWeights;
+          if (zeroWeightIndex < 0)
+          {
+            zeroWeightIndex = i;
+          }
+        }
+        else if (nonZeroWeightIndex < 0)
+        {
+          nonZeroWeightIndex = i;
+        }
+      }
+      double normal[3] = { this->TriangleNormals[3*triangleId], this->TriangleNormals[3*triangleId+1], this->TriangleNormals[3*triangleId+2] };
+      if (numberOfZeroWeights == 1)
+      {
+        vtkIdType neighborId = this->EdgeNeighbors[3*triangleId+zeroWeightIndex];
+        if (neighborId >= 0)
+        {
+          for (int axis=0; axis<3; ++axis)
+          {
+            normal[axis] += this->TriangleNormals[3*neighborId+axis];
+          }
+        }
+      }
+      else if (numberOfZeroWeights == 2)
+      {
+        vtkIdType pointId = this->TrianglePointIds[3*triangleId+nonZeroWeightIndex];
+        for (int axis=0; axis<3; ++axis)
+        {
+          normal[axis] = this->PointNormals[3*pointId+axis];
+        }
+      }
+      // Points behind the surface (opposite to the normal) are inside. Points on the surface or on its tangent plane
+      // get positive distance (never -0), the same way as in vtkImplicitPolyDataDistance.
+      double toSurface[3] = { closestPoint[0]-x[0], closestPoint[1]-x[1], closestPoint[2]-x[2] };
+      return (vtkMath::Dot(toSurface, normal) <= 0.0 ? distance : -distance);
+    }
+
+  protected:
+    struct TriangleEdge
+    {
+      vtkIdType PointIds[2];
+      vtkIdType TriangleEdgeIndex;
+      bool operator<(const TriangleEdge& other) const
+      {
+        if (this->PointIds[0] != other.PointIds[0])
+        {
+          return this->PointIds[0] < other.PointIds[0];
+        }
+        if (this->PointIds[1] != other.PointIds[1])
+        {
+          return this->PointIds[1] < other.PointIds[1];
+        }
+        return this->TriangleEdgeIndex < other.TriangleEdgeIndex;
+      }
+    };
+
+    struct CentroidLess
+    {
+      CentroidLess(const std::vector<double>& centroids, int axis) : Centroids(centroids), Axis(axis) { }
+      bool operator()(vtkIdType a, vtkIdType b) const
+      {
+        return this->Centroids[3*a+this->Axis] < this->Centroids[3*b+this->Axis];
+      }
+      const std::vector<double>& Centroids;
+      int Axis;
+    };
+
+    struct Node
+    {
+      double Bounds[6];
+      /// First triangle (leaf) or -1 (inner node)
+      vtkIdType FirstTriangle;
+      vtkIdType NumberOfTriangles;
+      /// Child node indices (inner node)
+      int Children[2];
+    };
+
+    /// Build node of the triangles in the given range of the order and return its index
+    int BuildNode(std::vector<vtkIdType>& triangleOrder, const std::vector<double>& centroids, vtkIdType begin, vtkIdType end)
+    {
+      int nodeIndex = (int)this->Nodes.size();
+      this->Nodes.push_back(Node());
+      double bounds[6] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+      double centroidBounds[6] = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+      for (vtkIdType index=begin; index<end; ++index)
+      {
+        vtkIdType triangleId = triangleOrder[index];
+        for (int axis=0; axis<3; ++axis)
+        {
+          for (int vertex=0; vertex<3; ++vertex)
+          {
+            double value = this->TriangleVertices[9*triangleId+3*vertex+axis];
+            bounds[2*axis] = std::min(bounds[2*axis], value);
+            bounds[2*axis+1] = std::max(bounds[2*axis+1], value);
+          }
+          centroidBounds[2*axis] = std::min(centroidBounds[2*axis], centroids[3*triangleId+axis]);
+          centroidBounds[2*axis+1] = std::max(centroidBounds[2*axis+1], centroids[3*triangleId+axis]);
+        }
+      }
+      std::copy(bounds, bounds+6, this->Nodes[nodeIndex].Bounds);
+
+      if (end-begin <= MAXIMUM_TRIANGLES_PER_LEAF)
+      {
+        this->Nodes[nodeIndex].FirstTriangle = begin;
+        this->Nodes[nodeIndex].NumberOfTriangles = end-begin;
+        this->Nodes[nodeIndex].Children[0] = this->Nodes[nodeIndex].Children[1] = -1;
+        return nodeIndex;
+      }
+
+      int splitAxis = 0;
+      for (int axis=1; axis<3; ++axis)
+      {
+        if (centroidBounds[2*axis+1]-centroidBounds[2*axis] > centroidBounds[2*splitAxis+1]-centroidBounds[2*splitAxis])
+        {
+          splitAxis = axis;
+        }
+      }
+      vtkIdType middle = begin + (end-begin)/2;
+      std::nth_element(triangleOrder.begin()+begin, triangleOrder.begin()+middle, triangleOrder.begin()+end, CentroidLess(centroids, splitAxis));
+
+      int leftChild = this->BuildNode(triangleOrder, centroids, begin, middle);
+      int rightChild = this->BuildNode(triangleOrder, centroids, middle, end);
+      this->Nodes[nodeIndex].FirstTriangle = -1;
+      this->Nodes[nodeIndex].NumberOfTriangles = end-begin;
+      this->Nodes[nodeIndex].Children[0] = leftChild;
+      this->Nodes[nodeIndex].Children[1] = rightChild;
+      return nodeIndex;
+    }
+
+    /// Squared distance of a point from a box (zero inside)
+    static double BoxDistance2(const double bounds[6], const double x[3])
+    {
+      double distance2 = 0.0;
+      for (int axis=0; axis<3; ++axis)
+      {
+        double d = 0.0;
+        if (x[axis] < bounds[2*axis])
+        {
+          d = bounds[2*axis] - x[axis];
+        }
+        else if (x[axis] > bounds[2*axis+1])
+        {
+          d = x[axis] - bounds[2*axis+1];
+        }
+        distance2 += d*d;
+      }
+      return distance2;
+    }
+
+    /// Closest point of a triangle to a point (Ericson, Real-Time Collision Detection, 5.1.5).
+    /// Returns the squared distance and the barycentric weights of the closest point.
+    static double ClosestPointOnTriangle(const double x[3], const double* a, const double* b, const double* c, double closestPoint[3], double weights[3])
+    {
+      double ab[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+      double ac[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+      double ap[3] = { x[0]-a[0], x[1]-a[1], x[2]-a[2] };
+      double d1 = vtkMath::Dot(ab, ap);
+      double d2 = vtkMath::Dot(ac, ap);
+      if (d1 <= 0.0 && d2 <= 0.0)
+      {
+        weights[0] = 1.0; weights[1] = 0.0; weights[2] = 0.0;
+      }
+      else
+      {
+        double bp[3] = { x[0]-b[0], x[1]-b[1], x[2]-b[2] };
+        double d3 = vtkMath::Dot(ab, bp);
+        double d4 = vtkMath::Dot(ac, bp);
+        double cp[3] = { x[0]-c[0], x[1]-c[1], x[2]-c[2] };
+        double d5 = vtkMath::Dot(ab, cp);
+        double d6 = vtkMath::Dot(ac, cp);
+        double vc = d1*d4 - d3*d2;
+        double vb = d5*d2 - d1*d6;
+        double va = d3*d6 - d5*d4;
+        if (d3 >= 0.0 && d4 <= d3)
+        {
+          weights[0] = 0.0; weights[1] = 1.0; weights[2] = 0.0;
+        }
+        else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+        {
+          double v = d1 / (d1 - d3);
+          weights[0] = 1.0-v; weights[1] = v; weights[2] = 0.0;
+        }
+        else if (d6 >= 0.0 && d5 <= d6)
+        {
+          weights[0] = 0.0; weights[1] = 0.0; weights[2] = 1.0;
+        }
+        else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+        {
+          double w = d2 / (d2 - d6);
+          weights[0] = 1.0-w; weights[1] = 0.0; weights[2] = w;
+        }
+        else if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+        {
+          double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+          weights[0] = 0.0; weights[1] = 1.0-w; weights[2] = w;
+        }
+        else
+        {
+          double denominator = 1.0 / (va + vb + vc);
+          double v = vb * denominator;
+          double w = vc * denominator;
+          weights[0] = 1.0-v-w; weights[1] = v; weights[2] = w;
+        }
+      }
+      double distance2 = 0.0;
+      for (int axis=0; axis<3; ++axis)
+      {
+        closestPoint[axis] = weights[0]*a[axis] + weights[1]*b[axis] + weights[2]*c[axis];
+        distance2 += (closestPoint[axis]-x[axis]) * (closestPoint[axis]-x[axis]);
+      }
+      return distance2;
+    }
+
+    /// Find closest point on the surface. Returns squared distance (VTK_DOUBLE_MAX if empty)
+    double FindClosestPoint(const double x[3], double closestPoint[3], vtkIdType& closestTriangleId, double closestWeights[3]) const
+    {
+      double bestDistance2 = VTK_DOUBLE_MAX;
+      closestTriangleId = -1;
+      if (this->Nodes.empty())
+      {
+        return bestDistance2;
+      }
+
+      // Depth-first traversal visiting the closer child first
+      int stack[128];
+      int stackSize = 0;
+      stack[stackSize++] = 0;
+      while (stackSize > 0)
+      {
+        const Node& node = this->Nodes[stack[--stackSize]];
+        if (BoxDistance2(node.Bounds, x) >= bestDistance2)
+        {
+          continue;
+        }
+        if (node.FirstTriangle >= 0)
+        {
+          for (vtkIdType triangleId=node.FirstTriangle; triangleId<node.FirstTriangle+node.NumberOfTriangles; ++triangleId)
+          {
+            const double* vertices = &this->TriangleVertices[9*triangleId];
+            double point[3] = {0.0, 0.0, 0.0};
+            double weights[3] = {0.0, 0.0, 0.0};
+            double distance2 = ClosestPointOnTriangle(x, vertices, vertices+3, vertices+6, point, weights);
+            if (distance2 < bestDistance2)
+            {
+              bestDistance2 = distance2;
+              closestTriangleId = triangleId;
+              std::copy(point, point+3, closestPoint);
+              std::copy(weights, weights+3, closestWeights);
+            }
+          }
+          continue;
+        }
+        double childDistance2[2] = { BoxDistance2(this->Nodes[node.Children[0]].Bounds, x), BoxDistance2(this->Nodes[node.Children[1]].Bounds, x) };
+        int nearChild = (childDistance2[0] <= childDistance2[1] ? 0 : 1);
+        // Push farther child first so that the nearer one is visited first
+        if (childDistance2[1-nearChild] < bestDistance2)
+        {
+          stack[stackSize++] = node.Children[1-nearChild];
+        }
+        if (childDistance2[nearChild] < bestDistance2)
+        {
+          stack[stackSize++] = node.Children[nearChild];
+        }
+      }
+      return bestDistance2;
+    }
+
+  protected:
+    std::vector<Node> Nodes;
+    /// Vertex coordinates, 9 values per triangle
+    std::vector<double> TriangleVertices;
+    /// Point IDs, 3 per triangle
+    std::vector<vtkIdType> TrianglePointIds;
+    /// Triangle normals, 3 values per triangle
+    std::vector<double> TriangleNormals;
+    /// Neighbor triangle across the edge opposite to each vertex (-1 if none or not manifold)
+    std::vector<vtkIdType> EdgeNeighbors;
+    /// Point normals, 3 values per point
+    std::vector<double> PointNormals;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Points to compute distances for, shared between the worker threads
+  struct DistanceTaskList
+  {
+    const SurfaceDistanceLocator* Locator;
+    vtkPoints* Points;
+    bool SignedDistance;
+    double* Distances;
+  };
+
+  //----------------------------------------------------------------------------
+  void DistanceTaskFunction(void* userData, int taskIndex)
+  {
+    DistanceTaskList* taskList = static_cast<DistanceTaskList*>(userData);
+    vtkIdType numberOfPoints = taskList->Points->GetNumberOfPoints();
+    vtkIdType endPointIndex = std::min(numberOfPoints, (taskIndex+1) * POINTS_PER_TASK);
+    for (vtkIdType pointIndex=taskIndex*POINTS_PER_TASK; pointIndex<endPointIndex; ++pointIndex)
+    {
+      double point[3] = {0.0, 0.0, 0.0};
+      taskList->Points->GetPoint(pointIndex, point);
+      taskList->Distances[pointIndex] = taskList->Locator->EvaluateDistance(point, taskList->SignedDistance);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute distances of all points from the surface of the locator, in parallel
+  void ComputePointDistances(const SurfaceDistanceLocator& locator, vtkPoints* points, bool signedDistance, int numberOfThreads, double* distances)
+  {
+    DistanceTaskList taskList;
+    taskList.Locator = &locator;
+    taskList.Points = points;
+    taskList.SignedDistance = signedDistance;
+    taskList.Distances = distances;
+    int numberOfTasks = (int)((points->GetNumberOfPoints() + POINTS_PER_TASK - 1) / POINTS_PER_TASK);
+    vtkSlicerRtTaskPool::ExecuteTasks(numberOfTasks, DistanceTaskFunction, &taskList, numberOfThreads);
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkPolyDataDistanceHistogramFilter::vtkInternal
+{
+public:
+  /// Surface locator with the points and polygons it was built from
+  class CachedLocator
+  {
+  public:
+    CachedLocator()
+      : Points(NULL)
+      , Polys(NULL)
+      , PointsMTime(0)
+      , PolysMTime(0)
+    {
+    }
+
+    /// Rebuild the locator if the points or the polygons of the poly data are not the ones it was built from.
+    /// The MTime of the poly data itself is not used, because it changes with every shallow copy of the inputs.
+    void Update(vtkPolyData* polyData)
+    {
+      vtkPoints* points = polyData->GetPoints();
+      vtkCellArray* polys = polyData->GetPolys();
+      vtkMTimeType pointsMTime = (points ? points->GetMTime() : 0);
+      vtkMTimeType polysMTime = (polys ? polys->GetMTime() : 0);
+      if ( points == this->Points && polys == this->Polys
+        && pointsMTime == this->PointsMTime && polysMTime == this->PolysMTime )
+      {
+        return;
+      }
+      this->Locator.Build(polyData);
+      this->Points = points;
+      this->Polys = polys;
+      this->PointsMTime = pointsMTime;
+      this->PolysMTime = polysMTime;
+    }
+
+  public:
+    SurfaceDistanceLocator Locator;
+
+  protected:
+    /// Points and polygons the locator was built from. Only used for comparison, never dereferenced
+    vtkPoints* Points;
+    vtkCellArray* Polys;
+    vtkMTimeType PointsMTime;
+    vtkMTimeType PolysMTime;
+  };
+
+public:
+  /// Locator on the reference surface
+  CachedLocator ReferenceLocator;
+  /// Locator on the compare surface
+  CachedLocator CompareLocator;
+};
+
 //----------------------------------------------------------------------------
 const int vtkPolyDataDistanceHistogramFilter::INPUT_PORT_REFERENCE_POLYDATA = 0;
 const int vtkPolyDataDistanceHistogramFilter::INPUT_PORT_COMPARE_POLYDATA = 1;
@@ -26,6 +610,10 @@ const int vtkPolyDataDistanceHistogramFilter::OUTPUT_PORT_HISTOGRAM = 0;
 //----------------------------------------------------------------------------
 vtkPolyDataDistanceHistogramFilter::vtkPolyDataDistanceHistogramFilter()
   : OutputDistances(NULL)
+  , OutputReverseDistances(NULL)
+  , MeanSurfaceDistance(0.0)
+  , SurfaceDice(0.0)
+  , AddedPathLength(0.0)
   , SamplePolyDataVertices(1)
   , SamplePolyDataEdges(0)
   , SamplePolyDataFaces(0)
@@ -33,11 +621,16 @@ vtkPolyDataDistanceHistogramFilter::vtkPolyDataDistanceHistogramFilter()
   , HistogramMinimum(-10.0)
   , HistogramMaximum(10.0)
   , HistogramSpacing(0.2)
+  , SurfaceDistanceTolerance(1.0)
+  , AddedPathLengthSliceSpacing(1.0)
+  , NumberOfThreads(0)
 {
+  this->Internal = new vtkInternal();
   this->InputComparePolyData = vtkPolyData::New();
   this->InputReferencePolyData = vtkPolyData::New();
   this->OutputHistogram = vtkTable::New();
   this->OutputDistances = vtkDoubleArray::New();
+  this->OutputReverseDistances = vtkDoubleArray::New();
 
   //this->SetNumberOfInputPorts(2);
   //this->SetNumberOfOutputPorts(1); // See below why not 2
@@ -66,20 +659,29 @@ vtkPolyDataDistanceHistogramFilter::~vtkPolyDataDistanceHistogramFilter()
     this->OutputDistances->Delete();
     this->OutputDistances = NULL;
   }
+  if (this->OutputReverseDistances)
+  {
+    this->OutputReverseDistances->Delete();
+    this->OutputReverseDistances = NULL;
+  }
+  delete this->Internal;
+  this->Internal = NULL;
 }
 
 //----------------------------------------------------------------------------
 void vtkPolyDataDistanceHistogramFilter::SetInputReferencePolyData(vtkPolyData* polyData)
 {
   //this->SetInputDataObject(INPUT_PORT_REFERENCE_POLYDATA, polyData);
-  this->InputReferencePolyData->DeepCopy(polyData);
+  // Shallow copy is enough, as the input is not modified. The copy shares the points and polygons of the input,
+  // so the locator is only rebuilt if those change
+  this->InputReferencePolyData->ShallowCopy(polyData);
 }
 
 //----------------------------------------------------------------------------
 void vtkPolyDataDistanceHistogramFilter::SetInputComparePolyData(vtkPolyData* polyData)
 {
   //this->SetInputDataObject(INPUT_PORT_COMPARE_POLYDATA, polyData);
-  this->InputComparePolyData->DeepCopy(polyData);
+  this->InputComparePolyData->ShallowCopy(polyData);
 }
 
 //----------------------------------------------------------------------------
@@ -102,6 +704,12 @@ vtkDoubleArray* vtkPolyDataDistanceHistogramFilter::GetOutputDistances()
   return this->OutputDistances;
 }
 
+//----------------------------------------------------------------------------
+vtkDoubleArray* vtkPolyDataDistanceHistogramFilter::GetOutputReverseDistances()
+{
+  return this->OutputReverseDistances;
+}
+
 //----------------------------------------------------------------------------
 vtkTable* vtkPolyDataDistanceHistogramFilter::GetOutputHistogram()
 {
@@ -130,13 +738,18 @@ double vtkPolyDataDistanceHistogramFilter::GetAverageHausdorffDistance()
     return 0.0;
   }
 
+  vtkIdType numberOfValues = this->OutputDistances->GetNumberOfValues();
+  if (numberOfValues == 0)
+  {
+    return 0.0;
+  }
   double sum = 0.0;
-  for (int i=0; i<this->OutputDistances->GetNumberOfValues(); ++i)
+  for (vtkIdType i=0; i<numberOfValues; ++i)
   {
     sum += this->OutputDistances->GetValue(i);
   }
 
-  return sum / (double)this->OutputDistances->GetNumberOfValues();
+  return sum / (double)numberOfValues;
 }
   
 //----------------------------------------------------------------------------
@@ -154,33 +767,57 @@ double vtkPolyDataDistanceHistogramFilter::GetPercent95HausdorffDistance()
 //----------------------------------------------------------------------------
 double vtkPolyDataDistanceHistogramFilter::GetNthPercentileHausdorffDistance(double n)
 {
+  std::vector<double> percentiles(1, n);
+  std::vector<double> distances;
+  this->GetNthPercentileHausdorffDistances(percentiles, distances);
+  return distances[0];
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataDistanceHistogramFilter::GetNthPercentileHausdorffDistances(const std::vector<double>& percentiles, std::vector<double>& distances)
+{
+  distances.assign(percentiles.size(), 0.0);
   if (!this->OutputDistances)
   {
-    vtkErrorMacro("GetPercentNthHausdorffDistance: Output distances has not been created! Need to call Update after setting the inputs.");
-    return 0.0;
+    vtkErrorMacro("GetNthPercentileHausdorffDistances: Output distances has not been created! Need to call Update after setting the inputs.");
+    return;
   }
-
-  if (n < 0)
+  vtkIdType numberOfValues = this->OutputDistances->GetNumberOfValues();
+  if (numberOfValues == 0)
   {
-    vtkErrorMacro("GetPercentNthHausdorffDistance: N " << n << " must be equal to or greater than 0. Returning 0.0.");
-    return 0.0;
+    return;
   }
 
-  if (n > 100)
+  // Order requested ranks so that each selection only needs to consider the values above the previous rank
+  std::vector<std::pair<vtkIdType, size_t> > ranks;
+  for (size_t percentileIndex=0; percentileIndex<percentiles.size(); ++percentileIndex)
   {
-    vtkErrorMacro("GetPercentNthHausdorffDistance: N " << n << " must be equal to or less than 100. Returning 0.0.");
-    return 0.0;
+    double n = percentiles[percentileIndex];
+    if (n < 0 || n > 100)
+    {
+      vtkErrorMacro("GetNthPercentileHausdorffDistances: N " << n << " must be between 0 and 100. Returning 0.0.");
+      continue;
+    }
+    ranks.push_back(std::make_pair((vtkIdType)vtkMath::Round( (n / 100) * (numberOfValues - 1) ), percentileIndex));
   }
+  std::sort(ranks.begin(), ranks.end());
 
-  vtkSmartPointer<vtkDoubleArray> sortedDistances = vtkSmartPointer<vtkDoubleArray>::New();
-  sortedDistances->DeepCopy(this->OutputDistances);
-
-  vtkSmartPointer<vtkSortDataArray> sortDataArray = vtkSmartPointer<vtkSortDataArray>::New();
-  sortDataArray->Sort(sortedDistances);
-
-  int nthPercentileIndex = vtkMath::Round( (n/ 100) * (sortedDistances->GetNumberOfValues() - 1) );
-  double percentileNthDistance = sortedDistances->GetValue( nthPercentileIndex );
-  return percentileNthDistance;
+  std::vector<double> sortedDistances(numberOfValues);
+  for (vtkIdType i=0; i<numberOfValues; ++i)
+  {
+    sortedDistances[i] = this->OutputDistances->GetValue(i);
+  }
+  std::vector<double>::iterator selectionBegin = sortedDistances.begin();
+  for (std::vector<std::pair<vtkIdType, size_t> >::iterator rankIt=ranks.begin(); rankIt!=ranks.end(); ++rankIt)
+  {
+    std::vector<double>::iterator nthIt = sortedDistances.begin() + rankIt->first;
+    if (nthIt >= selectionBegin)
+    {
+      std::nth_element(selectionBegin, nthIt, sortedDistances.end());
+      selectionBegin = nthIt;
+    }
+    distances[rankIt->second] = *nthIt;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -213,34 +850,95 @@ double vtkPolyDataDistanceHistogramFilter::GetNthPercentileHausdorffDistance(dou
 //}
 
 //----------------------------------------------------------------------------
-void vtkPolyDataDistanceHistogramFilter::ComputeDistances(vtkPolyData* referencePolyData, vtkPolyData* comparePolyData, vtkDoubleArray* distanceArray)
+void vtkPolyDataDistanceHistogramFilter::ComputeDistances(vtkPolyData* samplePolyData, bool toReference, vtkDoubleArray* distanceArray)
 {
-  //TODO: Revise the role of reference and compare
-
   // generate the points at which to sample the distance
   vtkSmartPointer<vtkPolyDataPointSampler> pointSampler = vtkSmartPointer<vtkPolyDataPointSampler>::New();
   pointSampler->SetGenerateVertexPoints(this->SamplePolyDataVertices);
   pointSampler->SetGenerateEdgePoints(this->SamplePolyDataEdges);
   pointSampler->SetGenerateInteriorPoints(this->SamplePolyDataFaces);
   pointSampler->SetDistance(this->SamplingDistance);
-  pointSampler->SetInputData(comparePolyData);
-  pointSampler->Update();  
+  pointSampler->SetInputData(samplePolyData);
+  pointSampler->Update();
   vtkPoints* samplingPoints = pointSampler->GetOutput()->GetPoints();
-  
-  // generate the distance field
-  vtkSmartPointer<vtkImplicitPolyDataDistance> distanceField = vtkSmartPointer<vtkImplicitPolyDataDistance>::New();
-  distanceField->SetInput(referencePolyData);
-  
-  int numPoints = samplingPoints->GetNumberOfPoints();
-  for (int i = 0; i < numPoints; i++)
+  if (!samplingPoints)
   {
-    double samplePoint[3];
-    samplingPoints->GetPoint(i,samplePoint);
-    double newDistance = distanceField->EvaluateFunction(samplePoint);
-    distanceArray->InsertNextTuple1(newDistance);
+    return;
   }
+
+  // evaluate the signed distances from the other surface in parallel
+  distanceArray->SetNumberOfValues(samplingPoints->GetNumberOfPoints());
+  const SurfaceDistanceLocator& locator = (toReference ? this->Internal->ReferenceLocator.Locator : this->Internal->CompareLocator.Locator);
+  ComputePointDistances(locator, samplingPoints, true, this->NumberOfThreads, distanceArray->GetPointer(0));
 }
 
+//----------------------------------------------------------------------------
+double vtkPolyDataDistanceHistogramFilter::ComputeAddedPathLength()
+{
+  if (this->AddedPathLengthSliceSpacing <= 0.0)
+  {
+    return 0.0;
+  }
+
+  // Cut the reference surface with axial planes
+  double bounds[6] = {0.0, -1.0, 0.0, -1.0, 0.0, -1.0};
+  this->InputReferencePolyData->GetBounds(bounds);
+  int numberOfSlices = (int)floor((bounds[5] - bounds[4]) / this->AddedPathLengthSliceSpacing) + 1;
+  vtkSmartPointer<vtkPlane> plane = vtkSmartPointer<vtkPlane>::New();
+  plane->SetOrigin(0.0, 0.0, 0.0);
+  plane->SetNormal(0.0, 0.0, 1.0);
+  vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
+  cutter->SetCutFunction(plane);
+  cutter->SetInputData(this->InputReferencePolyData);
+  for (int sliceIndex=0; sliceIndex<numberOfSlices; ++sliceIndex)
+  {
+    // Slices are in the middle of the slabs to avoid cutting exactly through the extreme points
+    cutter->SetValue(sliceIndex, bounds[4] + (sliceIndex + 0.5) * this->AddedPathLengthSliceSpacing);
+  }
+  cutter->Update();
+  vtkPolyData* contours = cutter->GetOutput();
+  vtkPoints* contourPoints = contours->GetPoints();
+  if (!contourPoints)
+  {
+    return 0.0;
+  }
+
+  // Collect contour segments
+  vtkSmartPointer<vtkPoints> segmentMidpoints = vtkSmartPointer<vtkPoints>::New();
+  std::vector<double> segmentLengths;
+  vtkCellArray* lines = contours->GetLines();
+  vtkIdType numberOfLinePoints = 0;
+  vtkIdType* linePointIds = NULL;
+  for (lines->InitTraversal(); lines->GetNextCell(numberOfLinePoints, linePointIds); )
+  {
+    for (vtkIdType i=0; i+1<numberOfLinePoints; ++i)
+    {
+      double startPoint[3] = {0.0, 0.0, 0.0};
+      double endPoint[3] = {0.0, 0.0, 0.0};
+      contourPoints->GetPoint(linePointIds[i], startPoint);
+      contourPoints->GetPoint(linePointIds[i+1], endPoint);
+      segmentMidpoints->InsertNextPoint( (startPoint[0]+endPoint[0])/2.0, (startPoint[1]+endPoint[1])/2.0, (startPoint[2]+endPoint[2])/2.0 );
+      segmentLengths.push_back(sqrt(vtkMath::Distance2BetweenPoints(startPoint, endPoint)));
+    }
+  }
+  if (segmentLengths.empty())
+  {
+    return 0.0;
+  }
+
+  // Segments farther than the tolerance from the compare surface would need to be drawn
+  std::vector<double> midpointDistances(segmentLengths.size());
+  ComputePointDistances(this->Internal->CompareLocator.Locator, segmentMidpoints, false, this->NumberOfThreads, &midpointDistances[0]);
+  double addedPathLength = 0.0;
+  for (size_t segmentIndex=0; segmentIndex<segmentLengths.size(); ++segmentIndex)
+  {
+    if (midpointDistances[segmentIndex] > this->SurfaceDistanceTolerance)
+    {
+      addedPathLength += segmentLengths[segmentIndex];
+    }
+  }
+  return addedPathLength;
+}
 
 //----------------------------------------------------------------------------
 // DO NOT run anything in this function within the pipeline. This function
@@ -253,9 +951,49 @@ void vtkPolyDataDistanceHistogramFilter::Update()
   vtkPolyData* inputPolyDataReference = this->GetInputReferencePolyData();
   vtkPolyData* inputPolyDataCompare = this->GetInputComparePolyData();
 
+  this->MeanSurfaceDistance = 0.0;
+  this->SurfaceDice = 0.0;
+  this->AddedPathLength = 0.0;
+
+  // build the surface locators once per input mesh
+  this->Internal->ReferenceLocator.Update(inputPolyDataReference);
+  this->Internal->CompareLocator.Update(inputPolyDataCompare);
+  if (this->Internal->ReferenceLocator.Locator.IsEmpty() || this->Internal->CompareLocator.Locator.IsEmpty())
+  {
+    vtkErrorMacro("Update: Reference and compare poly data must contain polygons");
+    return;
+  }
+
   vtkSmartPointer<vtkDoubleArray> distances = vtkSmartPointer<vtkDoubleArray>::New(); // hold the distances in this array until we copy to the output
   distances->SetName("Distances");
-  this->ComputeDistances(inputPolyDataReference, inputPolyDataCompare, distances);
+  this->ComputeDistances(inputPolyDataCompare, true, distances);
+  vtkSmartPointer<vtkDoubleArray> reverseDistances = vtkSmartPointer<vtkDoubleArray>::New();
+  reverseDistances->SetName("ReverseDistances");
+  this->ComputeDistances(inputPolyDataReference, false, reverseDistances);
+
+  // symmetric surface metrics from the distances of both directions
+  vtkIdType numberOfSamples = distances->GetNumberOfValues() + reverseDistances->GetNumberOfValues();
+  double sumAbsoluteDistances = 0.0;
+  vtkIdType numberOfSamplesWithinTolerance = 0;
+  vtkDoubleArray* distanceArrays[2] = { distances, reverseDistances };
+  for (int arrayIndex=0; arrayIndex<2; ++arrayIndex)
+  {
+    for (vtkIdType i=0; i<distanceArrays[arrayIndex]->GetNumberOfValues(); ++i)
+    {
+      double absoluteDistance = fabs(distanceArrays[arrayIndex]->GetValue(i));
+      sumAbsoluteDistances += absoluteDistance;
+      if (absoluteDistance <= this->SurfaceDistanceTolerance)
+      {
+        ++numberOfSamplesWithinTolerance;
+      }
+    }
+  }
+  if (numberOfSamples > 0)
+  {
+    this->MeanSurfaceDistance = sumAbsoluteDistances / numberOfSamples;
+    this->SurfaceDice = (double)numberOfSamplesWithinTolerance / numberOfSamples;
+  }
+  this->AddedPathLength = this->ComputeAddedPathLength();
   
   // copy the distances into a dummy image
   vtkSmartPointer<vtkImageData> dummyImage = vtkSmartPointer<vtkImageData>::New();
@@ -312,6 +1050,7 @@ void vtkPolyDataDistanceHistogramFilter::Update()
   //vtkDoubleArray* outputDistances = vtkDoubleArray::SafeDownCast(outputInfoHistogram->Get(vtkDataObject::DATA_OBJECT()));
   //outputDistances->DeepCopy(distances);
   this->OutputDistances->DeepCopy(distances);
+  this->OutputReverseDistances->DeepCopy(reverseDistances);
 
   // output the histogram
   this->OutputHistogram->DeepCopy(histogram);
@@ -7,14 +7,17 @@
 
 #include "vtkSlicerSegmentComparisonModuleLogicExport.h"
 
+// STD includes
+#include <vector>
+
 
 /// \class vtkPolyDataDistanceHistogramFilter
 /// \brief Compute a histogram of distances from one poly data to another.
 ///
 /// vtkPolyDataDistanceHistogramFilter is an algorithm that outputs a histogram
 /// of the distances from one input vtkPolyData to another. This filter
-/// is based on the following classes from vtk: vtkPolyDataPointSampler,
-/// vtkImplicitPolyDataDistance. The histogram is output  as a vtkTable 
+/// samples the input using vtkPolyDataPointSampler and measures signed distances
+/// the same way as vtkImplicitPolyDataDistance. The histogram is output  as a vtkTable 
 /// object. The user can also access the raw distances directly as a 
 /// vtkDoubleArray using GetOutputDistances().
 ///
@@ -22,6 +25,11 @@
 /// it uses the pipeline internally. Creating such a "mini-pipeline" may
 /// result in unexpected requests being sent up the pipeline and other
 /// associated unexpected behaviour.
+///
+/// Distances are evaluated using a bounding volume hierarchy of the triangles of each surface, which is
+/// built only once per input mesh, and the sample points are processed in parallel. Besides the distances
+/// from the compare mesh to the reference mesh, the distances in the reverse direction are also computed,
+/// which allows calculating symmetric surface metrics (mean surface distance, surface Dice, added path length).
 class VTK_SLICER_SEGMENTCOMPARISON_MODULE_LOGIC_EXPORT vtkPolyDataDistanceHistogramFilter : public vtkObject
 {
 public:
@@ -57,6 +65,10 @@ public:
   /// Get the minimum of the distances from each point of the compare mesh to the reference mesh
   /// Contains as many distance values as there are samples (points, etc.) in the compare mesh
   vtkDoubleArray* GetOutputDistances();
+
+  /// Get the minimum of the distances from each point of the reference mesh to the compare mesh
+  /// Contains as many distance values as there are samples (points, etc.) in the reference mesh
+  vtkDoubleArray* GetOutputReverseDistances();
   
   /// Get maximum of the absolute of the minimum distances \sa GetOutputDistances from the compare mesh to the reference mesh.
   /// This is what is traditionally called Hausdorff distance.
@@ -73,6 +85,24 @@ public:
   // Get the Nth percentile of the absolute of the minimum distances \sa GetOutputDistances from the compare mesh to the reference mesh.
   /// (this corresponds to the 'percent Hausdorff distance' in plastimatch: http://plastimatch.org/doxygen/classHausdorff__distance.html )
   double GetNthPercentileHausdorffDistance(double n);
+
+  /// Get multiple percentiles of the minimum distances, the same way as \sa GetNthPercentileHausdorffDistance.
+  /// The distances are copied and partially ordered only once for all the requested percentiles.
+  /// \param percentiles Requested percentiles (between 0 and 100)
+  /// \param distances Output distances, in the same order as the percentiles
+  void GetNthPercentileHausdorffDistances(const std::vector<double>& percentiles, std::vector<double>& distances);
+
+  /// Get mean of the absolute distances in both directions (compare to reference and reference to compare)
+  vtkGetMacro(MeanSurfaceDistance, double);
+
+  /// Get surface Dice coefficient: fraction of the sample points of both meshes that are
+  /// closer to the other mesh than the surface distance tolerance \sa SurfaceDistanceTolerance
+  vtkGetMacro(SurfaceDice, double);
+
+  /// Get added path length: total length of the axial contours of the reference mesh that are farther from
+  /// the compare mesh than the surface distance tolerance, i.e. that need to be drawn if the compare mesh
+  /// is used as an initial segmentation. \sa AddedPathLengthSliceSpacing
+  vtkGetMacro(AddedPathLength, double);
   
   /// Set whether the filter should sample on the vertices of the input vtkPolyData objects.
   vtkSetMacro(SamplePolyDataVertices, int);
@@ -114,6 +144,22 @@ public:
   vtkSetMacro(HistogramSpacing, double);
   /// Get the histogram spacing (width of the bins).
   vtkGetMacro(HistogramSpacing, double);
+
+  /// Set the tolerance used for the surface Dice and the added path length
+  vtkSetMacro(SurfaceDistanceTolerance, double);
+  /// Get the tolerance used for the surface Dice and the added path length
+  vtkGetMacro(SurfaceDistanceTolerance, double);
+
+  /// Set the distance of the axial slices used for computing the added path length. Non-positive value disables the computation
+  vtkSetMacro(AddedPathLengthSliceSpacing, double);
+  /// Get the distance of the axial slices used for computing the added path length
+  vtkGetMacro(AddedPathLengthSliceSpacing, double);
+
+  /// Set number of threads evaluating the sample point distances. 0 (default) uses all processor cores
+  /// \sa vtkSlicerRtTaskPool
+  vtkSetMacro(NumberOfThreads, int);
+  /// Get number of threads
+  vtkGetMacro(NumberOfThreads, int);
   
   /// Compute distances an histogram
   void Update();
@@ -130,11 +176,14 @@ protected:
   //int FillOutputPortInformation(int port, vtkInformation* info);
 
 private:
-  /// This method measures the raw distances from points on comparePolyData to referencePolyData, and stores them in distanceArray.
-  /// \param referencePolyData The reference vtkPolyData on which to compute the distances. Distances are measured from points on the comparePolyData to the referencePolyData.
-  /// \param comparePolyData The compare vtkPolyData on which to compute the distances. Distances are measured from points on the comparePolyData to the referencePolyData.
+  /// This method measures the raw distances from sample points on samplePolyData to the other input, and stores them in distanceArray.
+  /// \param samplePolyData The vtkPolyData on which the sample points are generated.
+  /// \param toReference If true, then distances are measured to the reference vtkPolyData, otherwise to the compare vtkPolyData.
   /// \param distanceArray The array in which to store the raw distances.
-  void ComputeDistances(vtkPolyData* referencePolyData, vtkPolyData* comparePolyData, vtkDoubleArray* distanceArray);
+  void ComputeDistances(vtkPolyData* samplePolyData, bool toReference, vtkDoubleArray* distanceArray);
+
+  /// Compute added path length from the axial contours of the reference vtkPolyData \sa GetAddedPathLength
+  double ComputeAddedPathLength();
   
 protected:
   /// Compare polydata, one of the inputs to generate the distances (from the compare vtkPolyData to the reference vtkPolyData)
@@ -146,6 +195,15 @@ protected:
   vtkTable* OutputHistogram;
   /// Output distances for each reference vertex in an array
   vtkDoubleArray* OutputDistances;
+  /// Output distances for each sample point of the reference mesh in an array
+  vtkDoubleArray* OutputReverseDistances;
+
+  /// Mean surface distance computed in the last update
+  double MeanSurfaceDistance;
+  /// Surface Dice coefficient computed in the last update
+  double SurfaceDice;
+  /// Added path length computed in the last update
+  double AddedPathLength;
 
   /// Flag determining  whether the filter should sample on the vertices of the input vtkPolyData objects.
   /// All vertices from the vtkPolyData will be used, regardless of the sampling distance.
@@ -172,6 +230,19 @@ protected:
   /// Histogram spacing (width of the bins).
   /// Default is 0.1.
   double HistogramSpacing;
+
+  /// Tolerance used for the surface Dice and the added path length.
+  /// Default is 1.
+  double SurfaceDistanceTolerance;
+  /// Distance of the axial slices used for computing the added path length.
+  /// Default is 1.
+  double AddedPathLengthSliceSpacing;
+
+  /// Number of threads evaluating the distances, see \sa SetNumberOfThreads
+  int NumberOfThreads;
+
+  class vtkInternal;
+  vtkInternal* Internal;
   
 private:
   vtkPolyDataDistanceHistogramFilter(const vtkPolyDataDistanceHistogramFilter&);  // Not implemented.
@@ -0,0 +1,541 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSegmentOverlapFilter.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtTaskPool.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSegmentOverlapFilter);
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Binary labelmap packed into bits on the shared extent. Bit n of word w is the voxel with linear index 64*w+n
+  struct PackedMask
+  {
+    PackedMask()
+      : FirstWord(0)
+      , LastWord(-1)
+      , NumberOfVoxels(0)
+    {
+      this->SumIndex[0] = this->SumIndex[1] = this->SumIndex[2] = 0.0;
+    }
+
+    std::vector<vtkTypeUInt64> Words;
+    /// Range of the words containing voxels of the segment. Empty range (first > last) if the segment is empty
+    vtkIdType FirstWord;
+    vtkIdType LastWord;
+    vtkIdType NumberOfVoxels;
+    /// Sum of the IJK indices of the voxels of the segment, for computing the center of mass
+    double SumIndex[3];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Number of set bits in a word
+  inline int CountBits(vtkTypeUInt64 word)
+  {
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((word * 0x0101010101010101ULL) >> 56);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Pack the non-zero voxels of the first scalar component of an image into a bit mask covering the given extent
+  template<class T>
+  void vtkSegmentOverlapFilterPackMask(vtkImageData* image, T* /*dummy*/, const int extent[6], PackedMask& mask)
+  {
+    const vtkIdType dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+    const vtkIdType numberOfWords = (dimensions[0] * dimensions[1] * dimensions[2] + 63) / 64;
+    mask.Words.assign(numberOfWords, 0);
+
+    int imageExtent[6] = {0, -1, 0, -1, 0, -1};
+    image->GetExtent(imageExtent);
+    int overlap[6] = {0, -1, 0, -1, 0, -1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      overlap[2*axis] = std::max(extent[2*axis], imageExtent[2*axis]);
+      overlap[2*axis+1] = std::min(extent[2*axis+1], imageExtent[2*axis+1]);
+      if (overlap[2*axis] > overlap[2*axis+1])
+      {
+        return;
+      }
+    }
+
+    int numberOfComponents = image->GetNumberOfScalarComponents();
+    for (int k=overlap[4]; k<=overlap[5]; ++k)
+    {
+      for (int j=overlap[2]; j<=overlap[3]; ++j)
+      {
+        T* inPtr = static_cast<T*>(image->GetScalarPointer(overlap[0], j, k));
+        vtkIdType voxelIndex = ((k-extent[4]) * dimensions[1] + (j-extent[2])) * dimensions[0] + (overlap[0]-extent[0]);
+        vtkIdType rowNumberOfVoxels = 0;
+        double rowSumI = 0.0;
+        for (int i=overlap[0]; i<=overlap[1]; ++i)
+        {
+          if (*inPtr != 0)
+          {
+            mask.Words[voxelIndex >> 6] |= ((vtkTypeUInt64)1) << (voxelIndex & 63);
+            ++rowNumberOfVoxels;
+            rowSumI += i;
+          }
+          inPtr += numberOfComponents;
+          ++voxelIndex;
+        }
+        mask.NumberOfVoxels += rowNumberOfVoxels;
+        mask.SumIndex[0] += rowSumI;
+        mask.SumIndex[1] += (double)rowNumberOfVoxels * j;
+        mask.SumIndex[2] += (double)rowNumberOfVoxels * k;
+      }
+    }
+
+    mask.FirstWord = numberOfWords;
+    mask.LastWord = -1;
+    for (vtkIdType wordIndex=0; wordIndex<numberOfWords; ++wordIndex)
+    {
+      if (mask.Words[wordIndex])
+      {
+        mask.FirstWord = std::min(mask.FirstWord, wordIndex);
+        mask.LastWord = wordIndex;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Masks and pairs to process, shared between the worker threads
+  struct OverlapTaskList
+  {
+    /// Reference labelmaps, then compare labelmaps
+    std::vector<vtkOrientedImageData*> Labelmaps;
+    int NumberOfReferenceMasks;
+    int Extent[6];
+    std::vector<PackedMask> Masks;
+    /// Number of intersection voxels of each (reference, compare) pair
+    vtkIdType* NumberOfIntersectionVoxels;
+    /// Set to false if a labelmap cannot be packed, guarded by the lock
+    bool Success;
+    vtkSimpleMutexLock Lock;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Pack one labelmap
+  void PackMaskTaskFunction(void* userData, int labelmapIndex)
+  {
+    OverlapTaskList* taskList = static_cast<OverlapTaskList*>(userData);
+    vtkImageData* image = taskList->Labelmaps[labelmapIndex];
+    switch (image->GetScalarType())
+    {
+      vtkTemplateMacro(vtkSegmentOverlapFilterPackMask(image, static_cast<VTK_TT*>(NULL), taskList->Extent, taskList->Masks[labelmapIndex]));
+    default:
+      taskList->Lock.Lock();
+      taskList->Success = false;
+      taskList->Lock.Unlock();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Count the intersection voxels of one (reference, compare) pair
+  void IntersectionTaskFunction(void* userData, int pairIndex)
+  {
+    OverlapTaskList* taskList = static_cast<OverlapTaskList*>(userData);
+    int numberOfCompareMasks = (int)taskList->Masks.size() - taskList->NumberOfReferenceMasks;
+    const PackedMask& referenceMask = taskList->Masks[pairIndex / numberOfCompareMasks];
+    const PackedMask& compareMask = taskList->Masks[taskList->NumberOfReferenceMasks + pairIndex % numberOfCompareMasks];
+    vtkIdType firstWord = std::max(referenceMask.FirstWord, compareMask.FirstWord);
+    vtkIdType lastWord = std::min(referenceMask.LastWord, compareMask.LastWord);
+    vtkIdType numberOfIntersectionVoxels = 0;
+    for (vtkIdType wordIndex=firstWord; wordIndex<=lastWord; ++wordIndex)
+    {
+      numberOfIntersectionVoxels += CountBits(referenceMask.Words[wordIndex] & compareMask.Words[wordIndex]);
+    }
+    taskList->NumberOfIntersectionVoxels[pairIndex] = numberOfIntersectionVoxels;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string GetCenterAsString(const double* center)
+  {
+    if (!center)
+    {
+      return "";
+    }
+    std::stringstream centerSs;
+    centerSs << "(" << center[0] << ", " << center[1] << ", " << center[2] << ")";
+    return centerSs.str();
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentOverlapFilter::vtkSegmentOverlapFilter()
+  : NumberOfThreads(0)
+  , VoxelVolumeCc(0.0)
+{
+  this->Output = vtkSmartPointer<vtkTable>::New();
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentOverlapFilter::~vtkSegmentOverlapFilter()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentOverlapFilter::AddReferenceLabelmap(vtkOrientedImageData* labelmap, const char* name)
+{
+  this->ReferenceLabelmaps.push_back(labelmap);
+  this->ReferenceNames.push_back(name ? name : "");
+  this->NumberOfIntersectionVoxels.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkSegmentOverlapFilter::GetNumberOfReferenceLabelmaps()
+{
+  return (int)this->ReferenceLabelmaps.size();
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentOverlapFilter::AddCompareLabelmap(vtkOrientedImageData* labelmap, const char* name)
+{
+  this->CompareLabelmaps.push_back(labelmap);
+  this->CompareNames.push_back(name ? name : "");
+  this->NumberOfIntersectionVoxels.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkSegmentOverlapFilter::GetNumberOfCompareLabelmaps()
+{
+  return (int)this->CompareLabelmaps.size();
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentOverlapFilter::RemoveAllLabelmaps()
+{
+  this->ReferenceLabelmaps.clear();
+  this->ReferenceNames.clear();
+  this->CompareLabelmaps.clear();
+  this->CompareNames.clear();
+  this->NumberOfIntersectionVoxels.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkTable* vtkSegmentOverlapFilter::GetOutput()
+{
+  return this->Output;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentOverlapFilter::Update()
+{
+  this->Output->Initialize();
+  this->VoxelVolumeCc = 0.0;
+  this->NumberOfVoxels.clear();
+  this->Centers.clear();
+  this->NumberOfIntersectionVoxels.clear();
+
+  int numberOfReferenceLabelmaps = (int)this->ReferenceLabelmaps.size();
+  int numberOfCompareLabelmaps = (int)this->CompareLabelmaps.size();
+  if (numberOfReferenceLabelmaps == 0 || numberOfCompareLabelmaps == 0)
+  {
+    vtkErrorMacro("Update: At least one reference and one compare labelmap must be added");
+    return false;
+  }
+
+  OverlapTaskList taskList;
+  taskList.Labelmaps.insert(taskList.Labelmaps.end(), this->ReferenceLabelmaps.begin(), this->ReferenceLabelmaps.end());
+  taskList.Labelmaps.insert(taskList.Labelmaps.end(), this->CompareLabelmaps.begin(), this->CompareLabelmaps.end());
+  taskList.NumberOfReferenceMasks = numberOfReferenceLabelmaps;
+  taskList.Success = true;
+
+  // Shared extent containing all labelmaps
+  vtkOrientedImageData* geometryImage = taskList.Labelmaps[0];
+  int* extent = taskList.Extent;
+  extent[0] = extent[2] = extent[4] = VTK_INT_MAX;
+  extent[1] = extent[3] = extent[5] = VTK_INT_MIN;
+  for (std::vector<vtkOrientedImageData*>::iterator labelmapIt=taskList.Labelmaps.begin(); labelmapIt!=taskList.Labelmaps.end(); ++labelmapIt)
+  {
+    if (!(*labelmapIt))
+    {
+      vtkErrorMacro("Update: Invalid labelmap");
+      return false;
+    }
+    if (!vtkOrientedImageDataResample::DoGeometriesMatch(geometryImage, *labelmapIt))
+    {
+      vtkErrorMacro("Update: All labelmaps must have the same geometry");
+      return false;
+    }
+    int labelmapExtent[6] = {0, -1, 0, -1, 0, -1};
+    (*labelmapIt)->GetExtent(labelmapExtent);
+    if (labelmapExtent[0] > labelmapExtent[1] || labelmapExtent[2] > labelmapExtent[3] || labelmapExtent[4] > labelmapExtent[5])
+    {
+      continue;
+    }
+    for (int axis=0; axis<3; ++axis)
+    {
+      extent[2*axis] = std::min(extent[2*axis], labelmapExtent[2*axis]);
+      extent[2*axis+1] = std::max(extent[2*axis+1], labelmapExtent[2*axis+1]);
+    }
+  }
+  if (extent[0] > extent[1])
+  {
+    // All labelmaps are empty
+    extent[0] = extent[2] = extent[4] = 0;
+    extent[1] = extent[3] = extent[5] = -1;
+  }
+
+  // Read each labelmap once into a packed mask
+  taskList.Masks.resize(taskList.Labelmaps.size());
+  if (extent[0] <= extent[1])
+  {
+    vtkSlicerRtTaskPool::ExecuteTasks((int)taskList.Labelmaps.size(), PackMaskTaskFunction, &taskList, this->NumberOfThreads);
+  }
+  if (!taskList.Success)
+  {
+    vtkErrorMacro("Update: Unknown scalar type of input labelmap");
+    return false;
+  }
+
+  // Count intersections of all pairs
+  this->NumberOfIntersectionVoxels.resize(numberOfReferenceLabelmaps * numberOfCompareLabelmaps, 0);
+  taskList.NumberOfIntersectionVoxels = &this->NumberOfIntersectionVoxels[0];
+  vtkSlicerRtTaskPool::ExecuteTasks(numberOfReferenceLabelmaps * numberOfCompareLabelmaps, IntersectionTaskFunction, &taskList, this->NumberOfThreads);
+
+  // Volumes and centers of mass
+  double spacing[3] = {1.0, 1.0, 1.0};
+  geometryImage->GetSpacing(spacing);
+  this->VoxelVolumeCc = fabs(spacing[0] * spacing[1] * spacing[2]) / 1000.0;
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  geometryImage->GetImageToWorldMatrix(imageToWorldMatrix);
+  this->Centers.resize(3 * taskList.Masks.size(), 0.0);
+  for (size_t maskIndex=0; maskIndex<taskList.Masks.size(); ++maskIndex)
+  {
+    const PackedMask& mask = taskList.Masks[maskIndex];
+    this->NumberOfVoxels.push_back(mask.NumberOfVoxels);
+    if (mask.NumberOfVoxels == 0)
+    {
+      continue;
+    }
+    double centerIjk[4] = { mask.SumIndex[0] / mask.NumberOfVoxels, mask.SumIndex[1] / mask.NumberOfVoxels, mask.SumIndex[2] / mask.NumberOfVoxels, 1.0 };
+    double centerRas[4] = {0.0, 0.0, 0.0, 1.0};
+    imageToWorldMatrix->MultiplyPoint(centerIjk, centerRas);
+    std::copy(centerRas, centerRas+3, this->Centers.begin() + 3*maskIndex);
+  }
+
+  // Output table
+  vtkSmartPointer<vtkStringArray> referenceNameColumn = vtkSmartPointer<vtkStringArray>::New();
+  referenceNameColumn->SetName("Reference segment");
+  vtkSmartPointer<vtkStringArray> compareNameColumn = vtkSmartPointer<vtkStringArray>::New();
+  compareNameColumn->SetName("Compare segment");
+  const char* metricNames[7] = { "Dice coefficient", "Jaccard index", "Volume similarity",
+    "Reference volume (cc)", "Compare volume (cc)", "False positive volume (cc)", "False negative volume (cc)" };
+  vtkSmartPointer<vtkDoubleArray> metricColumns[7];
+  for (int metricIndex=0; metricIndex<7; ++metricIndex)
+  {
+    metricColumns[metricIndex] = vtkSmartPointer<vtkDoubleArray>::New();
+    metricColumns[metricIndex]->SetName(metricNames[metricIndex]);
+  }
+  vtkSmartPointer<vtkStringArray> referenceCenterColumn = vtkSmartPointer<vtkStringArray>::New();
+  referenceCenterColumn->SetName("Reference center");
+  vtkSmartPointer<vtkStringArray> compareCenterColumn = vtkSmartPointer<vtkStringArray>::New();
+  compareCenterColumn->SetName("Compare center");
+
+  for (int referenceIndex=0; referenceIndex<numberOfReferenceLabelmaps; ++referenceIndex)
+  {
+    double referenceCenter[3] = {0.0, 0.0, 0.0};
+    bool referenceCenterValid = this->GetReferenceCenter(referenceIndex, referenceCenter);
+    for (int compareIndex=0; compareIndex<numberOfCompareLabelmaps; ++compareIndex)
+    {
+      double compareCenter[3] = {0.0, 0.0, 0.0};
+      bool compareCenterValid = this->GetCompareCenter(compareIndex, compareCenter);
+      referenceNameColumn->InsertNextValue(this->ReferenceNames[referenceIndex]);
+      compareNameColumn->InsertNextValue(this->CompareNames[compareIndex]);
+      metricColumns[0]->InsertNextValue(this->GetDiceCoefficient(referenceIndex, compareIndex));
+      metricColumns[1]->InsertNextValue(this->GetJaccardIndex(referenceIndex, compareIndex));
+      metricColumns[2]->InsertNextValue(this->GetVolumeSimilarity(referenceIndex, compareIndex));
+      metricColumns[3]->InsertNextValue(this->GetReferenceVolumeCc(referenceIndex));
+      metricColumns[4]->InsertNextValue(this->GetCompareVolumeCc(compareIndex));
+      metricColumns[5]->InsertNextValue(this->GetFalsePositiveVolumeCc(referenceIndex, compareIndex));
+      metricColumns[6]->InsertNextValue(this->GetFalseNegativeVolumeCc(referenceIndex, compareIndex));
+      referenceCenterColumn->InsertNextValue(GetCenterAsString(referenceCenterValid ? referenceCenter : NULL));
+      compareCenterColumn->InsertNextValue(GetCenterAsString(compareCenterValid ? compareCenter : NULL));
+    }
+  }
+
+  this->Output->AddColumn(referenceNameColumn);
+  this->Output->AddColumn(compareNameColumn);
+  for (int metricIndex=0; metricIndex<7; ++metricIndex)
+  {
+    this->Output->AddColumn(metricColumns[metricIndex]);
+  }
+  this->Output->AddColumn(referenceCenterColumn);
+  this->Output->AddColumn(compareCenterColumn);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSegmentOverlapFilter::GetNumberOfIntersectionVoxels(int referenceIndex, int compareIndex)
+{
+  int numberOfReferenceLabelmaps = (int)this->ReferenceLabelmaps.size();
+  int numberOfCompareLabelmaps = (int)this->CompareLabelmaps.size();
+  if ( referenceIndex < 0 || referenceIndex >= numberOfReferenceLabelmaps || compareIndex < 0 || compareIndex >= numberOfCompareLabelmaps
+    || this->NumberOfIntersectionVoxels.size() != (size_t)(numberOfReferenceLabelmaps * numberOfCompareLabelmaps) )
+  {
+    vtkErrorMacro("GetNumberOfIntersectionVoxels: Invalid labelmap index or results are not computed");
+    return -1;
+  }
+  return this->NumberOfIntersectionVoxels[referenceIndex * numberOfCompareLabelmaps + compareIndex];
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetDiceCoefficient(int referenceIndex, int compareIndex)
+{
+  vtkIdType numberOfIntersectionVoxels = this->GetNumberOfIntersectionVoxels(referenceIndex, compareIndex);
+  if (numberOfIntersectionVoxels < 0)
+  {
+    return 0.0;
+  }
+  vtkIdType sumNumberOfVoxels = this->NumberOfVoxels[referenceIndex] + this->NumberOfVoxels[this->ReferenceLabelmaps.size() + compareIndex];
+  return (sumNumberOfVoxels > 0 ? 2.0 * numberOfIntersectionVoxels / sumNumberOfVoxels : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetJaccardIndex(int referenceIndex, int compareIndex)
+{
+  vtkIdType numberOfIntersectionVoxels = this->GetNumberOfIntersectionVoxels(referenceIndex, compareIndex);
+  if (numberOfIntersectionVoxels < 0)
+  {
+    return 0.0;
+  }
+  vtkIdType numberOfUnionVoxels = this->NumberOfVoxels[referenceIndex] + this->NumberOfVoxels[this->ReferenceLabelmaps.size() + compareIndex]
+    - numberOfIntersectionVoxels;
+  return (numberOfUnionVoxels > 0 ? (double)numberOfIntersectionVoxels / numberOfUnionVoxels : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetVolumeSimilarity(int referenceIndex, int compareIndex)
+{
+  if (this->GetNumberOfIntersectionVoxels(referenceIndex, compareIndex) < 0)
+  {
+    return 0.0;
+  }
+  vtkIdType referenceNumberOfVoxels = this->NumberOfVoxels[referenceIndex];
+  vtkIdType compareNumberOfVoxels = this->NumberOfVoxels[this->ReferenceLabelmaps.size() + compareIndex];
+  vtkIdType sumNumberOfVoxels = referenceNumberOfVoxels + compareNumberOfVoxels;
+  if (sumNumberOfVoxels == 0)
+  {
+    return 0.0;
+  }
+  vtkIdType differenceNumberOfVoxels = referenceNumberOfVoxels - compareNumberOfVoxels;
+  return 1.0 - (double)(differenceNumberOfVoxels < 0 ? -differenceNumberOfVoxels : differenceNumberOfVoxels) / sumNumberOfVoxels;
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetFalsePositiveVolumeCc(int referenceIndex, int compareIndex)
+{
+  vtkIdType numberOfIntersectionVoxels = this->GetNumberOfIntersectionVoxels(referenceIndex, compareIndex);
+  if (numberOfIntersectionVoxels < 0)
+  {
+    return 0.0;
+  }
+  return (this->NumberOfVoxels[this->ReferenceLabelmaps.size() + compareIndex] - numberOfIntersectionVoxels) * this->VoxelVolumeCc;
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetFalseNegativeVolumeCc(int referenceIndex, int compareIndex)
+{
+  vtkIdType numberOfIntersectionVoxels = this->GetNumberOfIntersectionVoxels(referenceIndex, compareIndex);
+  if (numberOfIntersectionVoxels < 0)
+  {
+    return 0.0;
+  }
+  return (this->NumberOfVoxels[referenceIndex] - numberOfIntersectionVoxels) * this->VoxelVolumeCc;
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetReferenceVolumeCc(int referenceIndex)
+{
+  if (this->GetNumberOfIntersectionVoxels(referenceIndex, 0) < 0)
+  {
+    return 0.0;
+  }
+  return this->NumberOfVoxels[referenceIndex] * this->VoxelVolumeCc;
+}
+
+//----------------------------------------------------------------------------
+double vtkSegmentOverlapFilter::GetCompareVolumeCc(int compareIndex)
+{
+  if (this->GetNumberOfIntersectionVoxels(0, compareIndex) < 0)
+  {
+    return 0.0;
+  }
+  return this->NumberOfVoxels[this->ReferenceLabelmaps.size() + compareIndex] * this->VoxelVolumeCc;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentOverlapFilter::GetReferenceCenter(int referenceIndex, double center[3])
+{
+  if (this->GetNumberOfIntersectionVoxels(referenceIndex, 0) < 0 || this->NumberOfVoxels[referenceIndex] == 0)
+  {
+    return false;
+  }
+  std::copy(this->Centers.begin() + 3*referenceIndex, this->Centers.begin() + 3*referenceIndex + 3, center);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSegmentOverlapFilter::GetCompareCenter(int compareIndex, double center[3])
+{
+  size_t maskIndex = this->ReferenceLabelmaps.size() + compareIndex;
+  if (this->GetNumberOfIntersectionVoxels(0, compareIndex) < 0 || this->NumberOfVoxels[maskIndex] == 0)
+  {
+    return false;
+  }
+  std::copy(this->Centers.begin() + 3*maskIndex, this->Centers.begin() + 3*maskIndex + 3, center);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSegmentOverlapFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfReferenceLabelmaps: " << this->ReferenceLabelmaps.size() << "\n";
+  os << indent << "NumberOfCompareLabelmaps: " << this->CompareLabelmaps.size() << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+}
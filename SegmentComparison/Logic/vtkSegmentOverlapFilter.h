@@ -0,0 +1,145 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSegmentOverlapFilter_h
+#define __vtkSegmentOverlapFilter_h
+
+#include "vtkSlicerSegmentComparisonModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+class vtkOrientedImageData;
+class vtkTable;
+
+/// \ingroup SlicerRt_QtModules_SegmentComparison
+/// \brief Compute overlap metrics for every pair of a set of reference and a set of compare binary labelmaps
+///
+/// Each labelmap is read only once: it is packed into a bit mask covering the union of the extents of
+/// all labelmaps, while its volume and center of mass are accumulated. The intersection volume of each
+/// (reference, compare) pair is then counted on the packed masks, limited to the range where both are
+/// non-empty. Pairs are processed in parallel.
+///
+/// All labelmaps must have the same geometry (origin, spacing, directions), but they may have different
+/// extents. Voxels with non-zero value are considered to be inside the segment.
+///
+/// The output table contains one row for each pair, in the order of the reference labelmaps, then the
+/// compare labelmaps. If both segments of a pair are empty, then its Dice coefficient, Jaccard index
+/// and volume similarity are zero.
+///
+/// This is not a VTK pipeline filter: any number of named labelmaps can be added on both sides, which
+/// does not map to a fixed set of input ports.
+class VTK_SLICER_SEGMENTCOMPARISON_MODULE_LOGIC_EXPORT vtkSegmentOverlapFilter : public vtkObject
+{
+public:
+  static vtkSegmentOverlapFilter* New();
+  vtkTypeMacro(vtkSegmentOverlapFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Add reference labelmap
+  /// \param labelmap Binary labelmap
+  /// \param name Name of the segment used in the output table
+  void AddReferenceLabelmap(vtkOrientedImageData* labelmap, const char* name);
+  /// Get number of reference labelmaps
+  int GetNumberOfReferenceLabelmaps();
+
+  /// Add compare labelmap
+  /// \param labelmap Binary labelmap. Must have the same geometry as the reference labelmaps
+  /// \param name Name of the segment used in the output table
+  void AddCompareLabelmap(vtkOrientedImageData* labelmap, const char* name);
+  /// Get number of compare labelmaps
+  int GetNumberOfCompareLabelmaps();
+
+  /// Remove all reference and compare labelmaps
+  void RemoveAllLabelmaps();
+
+  /// Set number of threads packing the labelmaps and counting the pairwise intersections.
+  /// 0 (default) means one thread per processor core, 1 means serial processing \sa vtkSlicerRtTaskPool
+  vtkSetMacro(NumberOfThreads, int);
+  /// Get number of threads
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Compute overlap metrics for all pairs of reference and compare labelmaps
+  /// \return Success flag
+  bool Update();
+
+  /// Get output table with one row for each (reference, compare) pair
+  vtkTable* GetOutput();
+
+  /// Get Dice coefficient of a pair computed in the last update
+  double GetDiceCoefficient(int referenceIndex, int compareIndex);
+  /// Get Jaccard index (intersection over union) of a pair computed in the last update
+  double GetJaccardIndex(int referenceIndex, int compareIndex);
+  /// Get volume similarity (1 - |Vref - Vcmp| / (Vref + Vcmp)) of a pair computed in the last update
+  double GetVolumeSimilarity(int referenceIndex, int compareIndex);
+  /// Get volume of the compare segment outside the reference segment (cc) computed in the last update
+  double GetFalsePositiveVolumeCc(int referenceIndex, int compareIndex);
+  /// Get volume of the reference segment outside the compare segment (cc) computed in the last update
+  double GetFalseNegativeVolumeCc(int referenceIndex, int compareIndex);
+
+  /// Get volume of a reference segment (cc) computed in the last update
+  double GetReferenceVolumeCc(int referenceIndex);
+  /// Get volume of a compare segment (cc) computed in the last update
+  double GetCompareVolumeCc(int compareIndex);
+  /// Get center of mass of a reference segment in world (RAS) coordinates computed in the last update
+  /// \return False if the index is invalid or the segment is empty
+  bool GetReferenceCenter(int referenceIndex, double center[3]);
+  /// Get center of mass of a compare segment in world (RAS) coordinates computed in the last update
+  /// \return False if the index is invalid or the segment is empty
+  bool GetCompareCenter(int compareIndex, double center[3]);
+
+protected:
+  vtkSegmentOverlapFilter();
+  virtual ~vtkSegmentOverlapFilter();
+
+  /// Get number of voxels in the intersection of a pair, -1 if the indices are invalid
+  vtkIdType GetNumberOfIntersectionVoxels(int referenceIndex, int compareIndex);
+
+protected:
+  std::vector< vtkSmartPointer<vtkOrientedImageData> > ReferenceLabelmaps;
+  std::vector<std::string> ReferenceNames;
+  std::vector< vtkSmartPointer<vtkOrientedImageData> > CompareLabelmaps;
+  std::vector<std::string> CompareNames;
+
+  vtkSmartPointer<vtkTable> Output;
+
+  /// Number of threads counting the intersections, see \sa SetNumberOfThreads
+  int NumberOfThreads;
+
+  /// Volume of a voxel (cc) in the last update
+  double VoxelVolumeCc;
+  /// Number of voxels in each reference labelmap, then each compare labelmap, in the last update
+  std::vector<vtkIdType> NumberOfVoxels;
+  /// Center of mass (RAS) of each reference labelmap, then each compare labelmap, in the last update
+  std::vector<double> Centers;
+  /// Number of voxels in the intersection of each pair, in the last update
+  std::vector<vtkIdType> NumberOfIntersectionVoxels;
+
+private:
+  vtkSegmentOverlapFilter(const vtkSegmentOverlapFilter&); // Not implemented
+  void operator=(const vtkSegmentOverlapFilter&);          // Not implemented
+};
+
+#endif
@@ -21,6 +21,7 @@
 // SegmentComparison includes
 #include "vtkSlicerSegmentComparisonModuleLogic.h"
 #include "vtkMRMLSegmentComparisonNode.h"
+#include "vtkSegmentOverlapFilter.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -29,6 +30,8 @@
 // SegmentationCore includes
 #include "vtkOrientedImageData.h"
 #include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentation.h"
+#include "vtkSegment.h"
 
 // SlicerRT includes
 #include "PlmCommon.h"
@@ -48,6 +51,9 @@
 // VTK includes
 #include <vtkNew.h>
 #include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkTable.h>
 #include <vtkTimerLog.h>
 #include <vtkObjectFactory.h>
 #include <vtkStringArray.h>
@@ -146,11 +152,11 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
     return errorMessage;
   }
 
-  // Convert inputs to ITK images
+  // Convert inputs to ITK images. The labelmaps are copies of the segment representations, so they can be shared
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   checkpointItkConvertStart = timer->GetUniversalTime();
 
-  plmRefSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(referenceSegmentLabelmap);
+  plmRefSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(referenceSegmentLabelmap, true);
   if (!plmRefSegmentLabelmap)
   {
     std::string errorMessage("Failed to convert reference segment labelmap into Plm_image");
@@ -158,7 +164,7 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
     return errorMessage;
   }
 
-  plmCmpSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(compareSegmentLabelmap);
+  plmCmpSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(compareSegmentLabelmap, true);
   if (!plmCmpSegmentLabelmap)
   {
     std::string errorMessage("Failed to convert compare segment labelmap into Plm_image");
@@ -526,3 +532,165 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtk
 
   return "";
 }
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogic::ComputeOverlapMatrix(vtkMRMLSegmentComparisonNode* parameterNode)
+{
+  if (!parameterNode || !this->GetMRMLScene())
+  {
+    std::string errorMessage("Invalid MRML scene or parameter set node");
+    vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLSegmentationNode* referenceSegmentationNode = parameterNode->GetReferenceSegmentationNode();
+  vtkMRMLSegmentationNode* compareSegmentationNode = parameterNode->GetCompareSegmentationNode();
+  if (!referenceSegmentationNode || !compareSegmentationNode)
+  {
+    std::string errorMessage("Invalid input segmentation selection");
+    vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLTableNode* tableNode = parameterNode->GetOverlapTableNode();
+  if (!tableNode)
+  {
+    std::string errorMessage("Invalid overlap table node");
+    vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
+
+  // Get the binary labelmaps of all reference segments, then all compare segments
+  std::vector<std::string> referenceSegmentIDs;
+  referenceSegmentationNode->GetSegmentation()->GetSegmentIDs(referenceSegmentIDs);
+  std::vector<std::string> compareSegmentIDs;
+  compareSegmentationNode->GetSegmentation()->GetSegmentIDs(compareSegmentIDs);
+  if (referenceSegmentIDs.empty() || compareSegmentIDs.empty())
+  {
+    std::string errorMessage("Reference and compare segmentations must contain segments");
+    vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+    return errorMessage;
+  }
+  std::vector< vtkSmartPointer<vtkOrientedImageData> > inputImages;
+  std::vector<std::string> inputNames;
+  for (int inputSegmentationIndex=0; inputSegmentationIndex<2; ++inputSegmentationIndex)
+  {
+    vtkMRMLSegmentationNode* segmentationNode = (inputSegmentationIndex == 0 ? referenceSegmentationNode : compareSegmentationNode);
+    std::vector<std::string>& segmentIDs = (inputSegmentationIndex == 0 ? referenceSegmentIDs : compareSegmentIDs);
+    for (std::vector<std::string>::iterator segmentIt=segmentIDs.begin(); segmentIt!=segmentIDs.end(); ++segmentIt)
+    {
+      vtkSmartPointer<vtkOrientedImageData> image = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(segmentationNode, *segmentIt, image))
+      {
+        std::string errorMessage("Failed to get binary labelmap from segment: " + *segmentIt);
+        vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+        return errorMessage;
+      }
+      inputImages.push_back(image);
+      vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIt);
+      inputNames.push_back(segment && segment->GetName() ? segment->GetName() : *segmentIt);
+    }
+  }
+
+  // All labelmaps are compared on one shared geometry: the geometry of the first reference segment.
+  // Labelmaps with a different geometry are resampled to an extent containing all segments.
+  double checkpointResampleStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointResampleStart); // Although it is used later, a warning is logged so needs to be suppressed
+  vtkOrientedImageData* referenceImage = inputImages[0];
+  vtkSmartPointer<vtkMatrix4x4> referenceImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceImage->GetImageToWorldMatrix(referenceImageToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> worldToReferenceImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(referenceImageToWorldMatrix, worldToReferenceImageMatrix);
+
+  int sharedExtent[6] = {VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN};
+  std::vector<bool> resampleImage(inputImages.size(), false);
+  for (size_t inputIndex=0; inputIndex<inputImages.size(); ++inputIndex)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    inputImages[inputIndex]->GetExtent(extent);
+    if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+    {
+      // Empty segment, only its geometry needs to match
+      inputImages[inputIndex]->SetGeometryFromImageToWorldMatrix(referenceImageToWorldMatrix);
+      continue;
+    }
+    resampleImage[inputIndex] = !vtkOrientedImageDataResample::DoGeometriesMatch(referenceImage, inputImages[inputIndex]);
+
+    // Extent of the image in the IJK frame of the reference
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    inputImages[inputIndex]->GetImageToWorldMatrix(imageToWorldMatrix);
+    vtkSmartPointer<vtkMatrix4x4> imageToReferenceImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Multiply4x4(worldToReferenceImageMatrix, imageToWorldMatrix, imageToReferenceImageMatrix);
+    for (int corner=0; corner<8; ++corner)
+    {
+      double imagePoint[4] = { (double)extent[corner&1], (double)extent[2+((corner>>1)&1)], (double)extent[4+((corner>>2)&1)], 1.0 };
+      double referencePoint[4] = {0.0, 0.0, 0.0, 1.0};
+      imageToReferenceImageMatrix->MultiplyPoint(imagePoint, referencePoint);
+      for (int axis=0; axis<3; ++axis)
+      {
+        sharedExtent[2*axis] = std::min(sharedExtent[2*axis], vtkMath::Floor(referencePoint[axis] + 1.0e-6));
+        sharedExtent[2*axis+1] = std::max(sharedExtent[2*axis+1], vtkMath::Ceil(referencePoint[axis] - 1.0e-6));
+      }
+    }
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> sharedGeometryImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (sharedExtent[0] <= sharedExtent[1])
+  {
+    sharedGeometryImage->SetExtent(sharedExtent);
+  }
+  sharedGeometryImage->SetGeometryFromImageToWorldMatrix(referenceImageToWorldMatrix);
+  for (size_t inputIndex=0; inputIndex<inputImages.size(); ++inputIndex)
+  {
+    if ( resampleImage[inputIndex] && !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      inputImages[inputIndex], sharedGeometryImage, inputImages[inputIndex]) )
+    {
+      std::string errorMessage("Failed to resample segment " + inputNames[inputIndex]);
+      vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+      return errorMessage;
+    }
+  }
+
+  // Compute overlap metrics of all pairs
+  double checkpointOverlapStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointOverlapStart); // Although it is used later, a warning is logged so needs to be suppressed
+  vtkSmartPointer<vtkSegmentOverlapFilter> overlapFilter = vtkSmartPointer<vtkSegmentOverlapFilter>::New();
+  for (size_t inputIndex=0; inputIndex<inputImages.size(); ++inputIndex)
+  {
+    if (inputIndex < referenceSegmentIDs.size())
+    {
+      overlapFilter->AddReferenceLabelmap(inputImages[inputIndex], inputNames[inputIndex].c_str());
+    }
+    else
+    {
+      overlapFilter->AddCompareLabelmap(inputImages[inputIndex], inputNames[inputIndex].c_str());
+    }
+  }
+  if (!overlapFilter->Update())
+  {
+    std::string errorMessage("Failed to compute overlap metrics");
+    vtkErrorMacro("ComputeOverlapMatrix: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Set results to table node
+  tableNode->SetUseColumnNameAsColumnHeader(true);
+  tableNode->GetTable()->DeepCopy(overlapFilter->GetOutput());
+  // Trigger UI update
+  tableNode->Modified();
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+    vtkDebugMacro("ComputeOverlapMatrix: Total overlap computation time: " << checkpointEnd-checkpointStart << " s\n"
+      << "\tGetting segment labelmaps: " << checkpointResampleStart-checkpointStart << " s\n"
+      << "\tResampling to shared geometry: " << checkpointOverlapStart-checkpointResampleStart << " s\n"
+      << "\tOverlap computation (" << referenceSegmentIDs.size() << "x" << compareSegmentIDs.size() << " pairs): "
+      << checkpointEnd-checkpointOverlapStart << " s");
+  }
+
+  return "";
+}
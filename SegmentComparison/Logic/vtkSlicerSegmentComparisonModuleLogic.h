@@ -53,6 +53,12 @@ public:
   /// \return Error message, empty string if no error
   std::string ComputeHausdorffDistances(vtkMRMLSegmentComparisonNode* parameterNode);
 
+  /// Compute overlap metrics (Dice, Jaccard, volume similarity, false positive and negative volumes, centers of mass)
+  /// for every pair of a segment of the reference segmentation and a segment of the compare segmentation.
+  /// The labelmaps are compared directly, without conversion to ITK images. Results are written to the overlap table node.
+  /// \return Error message, empty string if no error
+  std::string ComputeOverlapMatrix(vtkMRMLSegmentComparisonNode* parameterNode);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
@@ -11,10 +11,20 @@
 // VTK includes
 #include <vtkDelimitedTextWriter.h>
 #include <vtkDoubleArray.h>
+#include <vtkImplicitPolyDataDistance.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataPointSampler.h>
 #include <vtkSphereSource.h>
 #include <vtkTable.h>
 #include <vtkVariantArray.h>
 
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 //-----------------------------------------------------------------------------
 int vtkPolyDataDistanceHistogramFilterTest( int argc, char* argv[] )
 {
@@ -117,5 +127,116 @@ int vtkPolyDataDistanceHistogramFilterTest( int argc, char* argv[] )
   histogramWriter->SetFileName( histogramFilename );
   histogramWriter->Write();
 
+  // Distances must be the same as the ones computed by vtkImplicitPolyDataDistance, which was used to generate
+  // the ground truth. The sample points are generated the same way as in the filter.
+  vtkSmartPointer< vtkPolyDataPointSampler > pointSampler = vtkSmartPointer< vtkPolyDataPointSampler >::New();
+  pointSampler->SetGenerateVertexPoints( 1 );
+  pointSampler->SetGenerateEdgePoints( 1 );
+  pointSampler->SetGenerateInteriorPoints( 1 );
+  pointSampler->SetDistance( 0.025 );
+  pointSampler->SetInputData( sphereSource2->GetOutput() );
+  pointSampler->Update();
+  vtkPoints* samplingPoints = pointSampler->GetOutput()->GetPoints();
+  vtkSmartPointer< vtkImplicitPolyDataDistance > distanceField = vtkSmartPointer< vtkImplicitPolyDataDistance >::New();
+  distanceField->SetInput( sphereSource1->GetOutput() );
+  if ( samplingPoints->GetNumberOfPoints() != rawDistancesDoubleArray->GetNumberOfValues() )
+  {
+    errorStream << "Number of distances (" << rawDistancesDoubleArray->GetNumberOfValues() << ") differs from the number of sample points ("
+      << samplingPoints->GetNumberOfPoints() << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for ( vtkIdType pointIndex = 0; pointIndex < samplingPoints->GetNumberOfPoints(); ++pointIndex )
+  {
+    double samplePoint[3] = { 0.0, 0.0, 0.0 };
+    samplingPoints->GetPoint( pointIndex, samplePoint );
+    double expectedDistance = distanceField->EvaluateFunction( samplePoint );
+    if ( fabs( rawDistancesDoubleArray->GetValue( pointIndex ) - expectedDistance ) > 1e-12 )
+    {
+      errorStream << "Distance of sample point " << pointIndex << " is " << rawDistancesDoubleArray->GetValue( pointIndex )
+        << " instead of " << expectedDistance << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Distances must not depend on the number of threads
+  vtkSmartPointer< vtkDoubleArray > defaultThreadsDistances = vtkSmartPointer< vtkDoubleArray >::New();
+  defaultThreadsDistances->DeepCopy( rawDistancesDoubleArray );
+  const int numberOfThreadsToTest[2] = { 1, 4 };
+  for ( int threadIndex = 0; threadIndex < 2; ++threadIndex )
+  {
+    polyDataDistanceHistogramFilter->SetNumberOfThreads( numberOfThreadsToTest[threadIndex] );
+    polyDataDistanceHistogramFilter->Update();
+    vtkDoubleArray* distances = polyDataDistanceHistogramFilter->GetOutputDistances();
+    bool identical = ( distances->GetNumberOfValues() == defaultThreadsDistances->GetNumberOfValues() );
+    for ( vtkIdType i = 0; identical && i < distances->GetNumberOfValues(); ++i )
+    {
+      identical = ( distances->GetValue( i ) == defaultThreadsDistances->GetValue( i ) );
+    }
+    if ( !identical )
+    {
+      errorStream << "Distances computed with " << numberOfThreadsToTest[threadIndex] << " thread(s) differ from the ones computed with the default number of threads" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Check percentiles against fully sorted distances
+  std::vector<double> sortedDistances;
+  for ( vtkIdType i = 0; i < defaultThreadsDistances->GetNumberOfValues(); ++i )
+  {
+    sortedDistances.push_back( defaultThreadsDistances->GetValue( i ) );
+  }
+  std::sort( sortedDistances.begin(), sortedDistances.end() );
+  std::vector<double> percentiles;
+  percentiles.push_back(95.0);
+  percentiles.push_back(50.0);
+  percentiles.push_back(100.0);
+  percentiles.push_back(0.0);
+  std::vector<double> percentileDistances;
+  polyDataDistanceHistogramFilter->GetNthPercentileHausdorffDistances(percentiles, percentileDistances);
+  if ( percentileDistances.size() != percentiles.size() )
+  {
+    errorStream << "Number of percentile Hausdorff distances is invalid: " << percentileDistances.size() << std::endl;
+    return EXIT_FAILURE;
+  }
+  for ( size_t percentileIndex = 0; percentileIndex < percentiles.size(); ++percentileIndex )
+  {
+    size_t sortedIndex = (size_t)vtkMath::Round( (percentiles[percentileIndex] / 100) * (sortedDistances.size() - 1) );
+    if ( percentileDistances[percentileIndex] != sortedDistances[sortedIndex]
+      || polyDataDistanceHistogramFilter->GetNthPercentileHausdorffDistance(percentiles[percentileIndex]) != sortedDistances[sortedIndex] )
+    {
+      errorStream << percentiles[percentileIndex] << "th percentile Hausdorff distance is " << percentileDistances[percentileIndex]
+        << " instead of " << sortedDistances[sortedIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Check surface metrics
+  double maximumHausdorffDistance = polyDataDistanceHistogramFilter->GetMaximumHausdorffDistance();
+  if ( maximumHausdorffDistance != std::max( fabs(sortedDistances.front()), fabs(sortedDistances.back()) ) )
+  {
+    errorStream << "Invalid maximum Hausdorff distance: " << maximumHausdorffDistance << std::endl;
+    return EXIT_FAILURE;
+  }
+  double meanSurfaceDistance = polyDataDistanceHistogramFilter->GetMeanSurfaceDistance();
+  if ( meanSurfaceDistance <= 0.0 || meanSurfaceDistance > maximumHausdorffDistance )
+  {
+    errorStream << "Invalid mean surface distance: " << meanSurfaceDistance << std::endl;
+    return EXIT_FAILURE;
+  }
+  outputStream << "Mean surface distance: " << meanSurfaceDistance << ", surface Dice: " << polyDataDistanceHistogramFilter->GetSurfaceDice()
+    << ", added path length: " << polyDataDistanceHistogramFilter->GetAddedPathLength() << std::endl;
+
+  // Identical surfaces must match perfectly
+  polyDataDistanceHistogramFilter->SetInputComparePolyData( sphereSource1->GetOutput() );
+  polyDataDistanceHistogramFilter->SetSurfaceDistanceTolerance( 0.01 );
+  polyDataDistanceHistogramFilter->SetAddedPathLengthSliceSpacing( 0.1 );
+  polyDataDistanceHistogramFilter->Update();
+  if ( polyDataDistanceHistogramFilter->GetSurfaceDice() != 1.0 || polyDataDistanceHistogramFilter->GetAddedPathLength() != 0.0 )
+  {
+    errorStream << "Surface Dice (" << polyDataDistanceHistogramFilter->GetSurfaceDice() << ") or added path length ("
+      << polyDataDistanceHistogramFilter->GetAddedPathLength() << ") is invalid for identical surfaces" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
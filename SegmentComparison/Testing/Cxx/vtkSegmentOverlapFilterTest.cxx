@@ -0,0 +1,153 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Module includes
+#include "vtkSegmentOverlapFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  //-----------------------------------------------------------------------------
+  /// Create labelmap with the given extent, with ones in the box extent
+  vtkSmartPointer<vtkOrientedImageData> CreateBoxLabelmap(const int extent[6], const int boxExtent[6], int scalarType)
+  {
+    vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    labelmap->SetOrigin(10.0, 20.0, 30.0);
+    labelmap->SetSpacing(1.0, 2.0, 3.0);
+    labelmap->SetExtent(const_cast<int*>(extent));
+    if (extent[0] > extent[1])
+    {
+      return labelmap;
+    }
+    labelmap->AllocateScalars(scalarType, 1);
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          bool inside = ( i >= boxExtent[0] && i <= boxExtent[1] && j >= boxExtent[2] && j <= boxExtent[3]
+            && k >= boxExtent[4] && k <= boxExtent[5] );
+          labelmap->SetScalarComponentFromDouble(i, j, k, 0, (inside ? 1.0 : 0.0));
+        }
+      }
+    }
+    return labelmap;
+  }
+
+  //-----------------------------------------------------------------------------
+  bool CheckValue(const char* name, double result, double baseline)
+  {
+    if (fabs(result - baseline) > 1.0e-9)
+    {
+      std::cerr << name << " mismatch: " << result << " instead of " << baseline << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSegmentOverlapFilterTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Reference: a 10x10x10 box and an empty segment
+  int boxExtent[6] = {0, 9, 0, 9, 0, 9};
+  int emptyExtent[6] = {0, -1, 0, -1, 0, -1};
+  vtkSmartPointer<vtkOrientedImageData> referenceBox = CreateBoxLabelmap(boxExtent, boxExtent, VTK_UNSIGNED_CHAR);
+  vtkSmartPointer<vtkOrientedImageData> referenceEmpty = CreateBoxLabelmap(emptyExtent, emptyExtent, VTK_UNSIGNED_CHAR);
+
+  // Compare: the box shifted by half of its size, and the same box in a larger short image
+  int shiftedBoxExtent[6] = {5, 14, 0, 9, 0, 9};
+  vtkSmartPointer<vtkOrientedImageData> compareShiftedBox = CreateBoxLabelmap(shiftedBoxExtent, shiftedBoxExtent, VTK_UNSIGNED_CHAR);
+  int largeExtent[6] = {-2, 12, -3, 11, -1, 10};
+  vtkSmartPointer<vtkOrientedImageData> compareSameBox = CreateBoxLabelmap(largeExtent, boxExtent, VTK_SHORT);
+
+  vtkSmartPointer<vtkSegmentOverlapFilter> overlapFilter = vtkSmartPointer<vtkSegmentOverlapFilter>::New();
+  overlapFilter->AddReferenceLabelmap(referenceBox, "Box");
+  overlapFilter->AddReferenceLabelmap(referenceEmpty, "Empty");
+  overlapFilter->AddCompareLabelmap(compareShiftedBox, "ShiftedBox");
+  overlapFilter->AddCompareLabelmap(compareSameBox, "SameBox");
+  overlapFilter->SetNumberOfThreads(2);
+  if (!overlapFilter->Update())
+  {
+    std::cerr << "Failed to compute overlap metrics!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Voxel volume is 6 mm3, half box is 500 voxels
+  bool valid = true;
+  valid &= CheckValue("Dice coefficient (shifted)", overlapFilter->GetDiceCoefficient(0, 0), 0.5);
+  valid &= CheckValue("Jaccard index (shifted)", overlapFilter->GetJaccardIndex(0, 0), 1.0/3.0);
+  valid &= CheckValue("Volume similarity (shifted)", overlapFilter->GetVolumeSimilarity(0, 0), 1.0);
+  valid &= CheckValue("False positive volume (shifted)", overlapFilter->GetFalsePositiveVolumeCc(0, 0), 3.0);
+  valid &= CheckValue("False negative volume (shifted)", overlapFilter->GetFalseNegativeVolumeCc(0, 0), 3.0);
+  valid &= CheckValue("Dice coefficient (same)", overlapFilter->GetDiceCoefficient(0, 1), 1.0);
+  valid &= CheckValue("Jaccard index (same)", overlapFilter->GetJaccardIndex(0, 1), 1.0);
+  valid &= CheckValue("False positive volume (same)", overlapFilter->GetFalsePositiveVolumeCc(0, 1), 0.0);
+  valid &= CheckValue("Dice coefficient (empty)", overlapFilter->GetDiceCoefficient(1, 0), 0.0);
+  valid &= CheckValue("Volume similarity (empty)", overlapFilter->GetVolumeSimilarity(1, 1), 0.0);
+  valid &= CheckValue("False positive volume (empty)", overlapFilter->GetFalsePositiveVolumeCc(1, 1), 6.0);
+  valid &= CheckValue("Reference volume", overlapFilter->GetReferenceVolumeCc(0), 6.0);
+
+  double center[3] = {0.0, 0.0, 0.0};
+  if (!overlapFilter->GetReferenceCenter(0, center))
+  {
+    std::cerr << "Missing reference center!" << std::endl;
+    valid = false;
+  }
+  valid &= CheckValue("Reference center R", center[0], 14.5);
+  valid &= CheckValue("Reference center A", center[1], 29.0);
+  valid &= CheckValue("Reference center S", center[2], 43.5);
+  if (!overlapFilter->GetCompareCenter(0, center))
+  {
+    std::cerr << "Missing compare center!" << std::endl;
+    valid = false;
+  }
+  valid &= CheckValue("Compare center R", center[0], 19.5);
+  if (overlapFilter->GetReferenceCenter(1, center))
+  {
+    std::cerr << "Empty segment must not have a center!" << std::endl;
+    valid = false;
+  }
+
+  vtkTable* table = overlapFilter->GetOutput();
+  if (table->GetNumberOfRows() != 4)
+  {
+    std::cerr << "Invalid number of table rows: " << table->GetNumberOfRows() << " instead of 4" << std::endl;
+    return EXIT_FAILURE;
+  }
+  valid &= CheckValue("Dice coefficient in table", table->GetValueByName(1, "Dice coefficient").ToDouble(), 1.0);
+  if (table->GetValueByName(2, "Reference segment").ToString() != "Empty")
+  {
+    std::cerr << "Invalid segment name in table: " << table->GetValueByName(2, "Reference segment").ToString() << std::endl;
+    valid = false;
+  }
+
+  return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -37,10 +37,12 @@
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
 #include <vtkImageData.h>
+#include <vtkTable.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -388,6 +390,17 @@ int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
   std::string errorMessageDice = segmentComparisonLogic->ComputeDiceStatistics(paramNode);
   std::string errorMessageHausdorff = segmentComparisonLogic->ComputeHausdorffDistances(paramNode);
 
+  // Compute overlap matrix without plastimatch (contains only one pair)
+  vtkSmartPointer<vtkMRMLTableNode> overlapTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(overlapTableNode);
+  paramNode->SetAndObserveOverlapTableNode(overlapTableNode);
+  std::string errorMessageOverlap = segmentComparisonLogic->ComputeOverlapMatrix(paramNode);
+  if (!errorMessageOverlap.empty() || overlapTableNode->GetTable()->GetNumberOfRows() != 1)
+  {
+    std::cerr << "Failed to compute overlap matrix!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   if (!paramNode->GetHausdorffResultsValid() || !paramNode->GetDiceResultsValid())
   {
     mrmlScene->Commit();
@@ -424,6 +437,13 @@ int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
     std::cerr << "Dice coefficient mismatch: " << resultDiceCoefficient << " instead of " << diceCoefficient << std::endl;
     result = EXIT_FAILURE;
   }
+  // Labelmaps may be resampled differently than in plastimatch, so allow 1% difference
+  double overlapDiceCoefficient = overlapTableNode->GetTable()->GetValueByName(0, "Dice coefficient").ToDouble();
+  if (fabs(overlapDiceCoefficient - resultDiceCoefficient) > 0.01 * resultDiceCoefficient)
+  {
+    std::cerr << "Dice coefficient of overlap matrix mismatch: " << overlapDiceCoefficient << " instead of " << resultDiceCoefficient << std::endl;
+    result = EXIT_FAILURE;
+  }
   double resultTruePositivesPercent = paramNode->GetTruePositivesPercent();
   if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultTruePositivesPercent, truePositivesPercent))
   {
@@ -25,6 +25,8 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtTaskPool.h"
+#include "vtkLabelmapMarginFilter.h"
 
 // Segmentation includes
 #include "vtkMRMLSegmentationNode.h"
@@ -34,23 +36,500 @@
 
 // MRML includes
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
 #include <vtkGeneralTransform.h>
 #include <vtkImageAccumulate.h>
-#include <vtkImageContinuousDilate3D.h>
-#include <vtkImageContinuousErode3D.h>
 #include <vtkImageLogic.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageConstantPad.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMutexLock.h>
+#include <vtkPointData.h>
+#include <vtkStringArray.h>
+
+// STD includes
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <vector>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerSegmentMorphologyModuleLogic);
 
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Node of a parsed morphology expression. Leaves (operation None) reference a segment or an earlier result,
+  /// the other nodes apply a vtkMRMLSegmentMorphologyNode operation on their operands.
+  struct MorphologyExpressionNode
+  {
+    MorphologyExpressionNode() : Operation(vtkMRMLSegmentMorphologyNode::None), InputIndex(-1), ResultIndex(-1)
+    {
+      this->Operands[0] = this->Operands[1] = -1;
+      this->Margin[0] = this->Margin[1] = this->Margin[2] = 0.0;
+    }
+    int Operation;
+    /// Referenced segment or result name (for leaves)
+    std::string Name;
+    /// Index of the referenced input segment or earlier result (for leaves, -1 if not that kind)
+    int InputIndex;
+    int ResultIndex;
+    /// Indices of the operand nodes (the second one is only used by binary operations)
+    int Operands[2];
+    /// Margin in mm (for Expand and Shrink)
+    double Margin[3];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Parsed "Result = expression". The nodes of the expression tree are stored in a list, root is the last one.
+  struct MorphologyExpression
+  {
+    std::string ResultName;
+    std::vector<MorphologyExpressionNode> Nodes;
+    /// Indices of the earlier expressions that need to be evaluated before this one
+    std::vector<int> Dependencies;
+    /// Largest distance the result can extend beyond the input segments (in mm)
+    double Padding[3];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Recursive descent parser of morphology expressions.
+  /// Grammar:
+  ///   expression = name "=" sum
+  ///   sum        = product { ("+" | "-") product }    (union, subtract)
+  ///   product    = primary { "*" primary }             (intersect)
+  ///   primary    = "(" sum ")" | ("Expand" | "Shrink") "(" sum "," margin [ "," margin "," margin ] ")" | name
+  ///   name       = identifier of letters, digits, "_" and "." | quoted string
+  class MorphologyExpressionParser
+  {
+  public:
+    MorphologyExpressionParser(const std::string& text, MorphologyExpression& expression)
+      : Text(text), Position(0), Expression(expression) { }
+
+    /// \return Error message, empty string if no error
+    std::string Parse()
+    {
+      this->Expression.Nodes.clear();
+      if (!this->ParseName(this->Expression.ResultName) || !this->Accept('='))
+      {
+        return this->Fail("expected result name and '='");
+      }
+      if (this->ParseSum() < 0)
+      {
+        return this->Error;
+      }
+      this->SkipWhitespace();
+      if (this->Position < this->Text.size())
+      {
+        return this->Fail("unexpected character");
+      }
+      return "";
+    }
+
+  protected:
+    int ParseSum()
+    {
+      int left = this->ParseProduct();
+      while (left >= 0)
+      {
+        int operation = vtkMRMLSegmentMorphologyNode::None;
+        if (this->Accept('+'))
+        {
+          operation = vtkMRMLSegmentMorphologyNode::Union;
+        }
+        else if (this->Accept('-'))
+        {
+          operation = vtkMRMLSegmentMorphologyNode::Subtract;
+        }
+        else
+        {
+          break;
+        }
+        int right = this->ParseProduct();
+        left = (right < 0 ? -1 : this->AddNode(operation, left, right));
+      }
+      return left;
+    }
+
+    int ParseProduct()
+    {
+      int left = this->ParsePrimary();
+      while (left >= 0 && this->Accept('*'))
+      {
+        int right = this->ParsePrimary();
+        left = (right < 0 ? -1 : this->AddNode(vtkMRMLSegmentMorphologyNode::Intersect, left, right));
+      }
+      return left;
+    }
+
+    int ParsePrimary()
+    {
+      if (this->Accept('('))
+      {
+        int node = this->ParseSum();
+        if (node >= 0 && !this->Accept(')'))
+        {
+          this->Fail("expected ')'");
+          return -1;
+        }
+        return node;
+      }
+
+      std::string name;
+      bool quoted = this->IsNext('"') || this->IsNext('\'');
+      if (!this->ParseName(name))
+      {
+        this->Fail("expected segment name");
+        return -1;
+      }
+
+      // Margin operations
+      bool expand = (STRCASECMP(name.c_str(), "Expand") == 0);
+      bool shrink = (STRCASECMP(name.c_str(), "Shrink") == 0);
+      if (!quoted && (expand || shrink) && this->Accept('('))
+      {
+        int operand = this->ParseSum();
+        if (operand < 0)
+        {
+          return -1;
+        }
+        double margin[3] = {0.0, 0.0, 0.0};
+        if (!this->Accept(',') || !this->ParseMargin(margin[0]))
+        {
+          this->Fail("expected margin");
+          return -1;
+        }
+        margin[1] = margin[2] = margin[0];
+        if (this->Accept(',') && (!this->ParseMargin(margin[1]) || !this->Accept(',') || !this->ParseMargin(margin[2])))
+        {
+          this->Fail("expected one or three margins");
+          return -1;
+        }
+        if (!this->Accept(')'))
+        {
+          this->Fail("expected ')'");
+          return -1;
+        }
+        int node = this->AddNode(expand ? vtkMRMLSegmentMorphologyNode::Expand : vtkMRMLSegmentMorphologyNode::Shrink, operand, -1);
+        for (int axis=0; axis<3; ++axis)
+        {
+          this->Expression.Nodes[node].Margin[axis] = margin[axis];
+        }
+        return node;
+      }
+
+      int node = this->AddNode(vtkMRMLSegmentMorphologyNode::None, -1, -1);
+      this->Expression.Nodes[node].Name = name;
+      return node;
+    }
+
+    bool ParseName(std::string& name)
+    {
+      this->SkipWhitespace();
+      name.clear();
+      if (this->IsNext('"') || this->IsNext('\''))
+      {
+        char quote = this->Text[this->Position];
+        size_t end = this->Text.find(quote, this->Position + 1);
+        if (end == std::string::npos)
+        {
+          return false;
+        }
+        name = this->Text.substr(this->Position + 1, end - this->Position - 1);
+        this->Position = end + 1;
+        return !name.empty();
+      }
+      while ( this->Position < this->Text.size()
+        && (isalnum((unsigned char)this->Text[this->Position]) || this->Text[this->Position] == '_' || this->Text[this->Position] == '.') )
+      {
+        name += this->Text[this->Position++];
+      }
+      return !name.empty();
+    }
+
+    bool ParseMargin(double& margin)
+    {
+      this->SkipWhitespace();
+      const char* start = this->Text.c_str() + this->Position;
+      char* end = NULL;
+      margin = strtod(start, &end);
+      if (end == start || margin < 0.0)
+      {
+        return false;
+      }
+      this->Position += (end - start);
+      return true;
+    }
+
+    bool Accept(char c)
+    {
+      if (this->IsNext(c))
+      {
+        ++this->Position;
+        return true;
+      }
+      return false;
+    }
+
+    bool IsNext(char c)
+    {
+      this->SkipWhitespace();
+      return (this->Position < this->Text.size() && this->Text[this->Position] == c);
+    }
+
+    void SkipWhitespace()
+    {
+      while (this->Position < this->Text.size() && isspace((unsigned char)this->Text[this->Position]))
+      {
+        ++this->Position;
+      }
+    }
+
+    int AddNode(int operation, int firstOperand, int secondOperand)
+    {
+      MorphologyExpressionNode node;
+      node.Operation = operation;
+      node.Operands[0] = firstOperand;
+      node.Operands[1] = secondOperand;
+      this->Expression.Nodes.push_back(node);
+      return (int)this->Expression.Nodes.size() - 1;
+    }
+
+    std::string Fail(const std::string& message)
+    {
+      if (this->Error.empty())
+      {
+        std::stringstream ss;
+        ss << "Invalid expression '" << this->Text << "': " << message << " at position " << this->Position;
+        this->Error = ss.str();
+      }
+      return this->Error;
+    }
+
+  protected:
+    std::string Text;
+    size_t Position;
+    MorphologyExpression& Expression;
+    std::string Error;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Binary mask on the shared geometry of a batch, packed to one bit per voxel
+  struct PackedMask
+  {
+    void Allocate(vtkIdType numberOfVoxels)
+    {
+      this->Words.assign((numberOfVoxels + 63) / 64, 0);
+    }
+    bool Get(vtkIdType index) const
+    {
+      return ((this->Words[index >> 6] >> (index & 63)) & 1) != 0;
+    }
+    void Set(vtkIdType index)
+    {
+      this->Words[index >> 6] |= (vtkTypeUInt64(1) << (index & 63));
+    }
+    std::vector<vtkTypeUInt64> Words;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Set the voxels of a mask that are inside a binary labelmap. The labelmap extent must be within the shared extent.
+  template<class T>
+  void PackLabelmap(T* inPtr, int inputExtent[6], int sharedExtent[6], PackedMask& mask)
+  {
+    vtkIdType nx = sharedExtent[1] - sharedExtent[0] + 1;
+    vtkIdType ny = sharedExtent[3] - sharedExtent[2] + 1;
+    for (int z=inputExtent[4]; z<=inputExtent[5]; ++z)
+    {
+      for (int y=inputExtent[2]; y<=inputExtent[3]; ++y)
+      {
+        vtkIdType rowStart = ((vtkIdType)(z - sharedExtent[4]) * ny + (y - sharedExtent[2])) * nx - sharedExtent[0];
+        for (int x=inputExtent[0]; x<=inputExtent[1]; ++x)
+        {
+          if (*(inPtr++) > 0)
+          {
+            mask.Set(rowStart + x);
+          }
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Expressions of a batch and the state shared by the tasks
+  struct MorphologyBatch
+  {
+    std::vector<MorphologyExpression> Expressions;
+    /// Masks of the referenced input segments
+    std::vector<PackedMask> InputMasks;
+    /// Masks of the expression results
+    std::vector<PackedMask> Results;
+
+    int Dimensions[3];
+    double Spacing[3];
+    vtkIdType NumberOfVoxels;
+
+    /// Expressions to evaluate in parallel (all their dependencies have been evaluated)
+    std::vector<int> TaskExpressionIndices;
+    /// Number of threads used by the margin filters of each task
+    int NumberOfMarginThreads;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Scratch objects reused by all the margin operations of the tasks evaluated by one thread, in all waves
+  struct MorphologyScratch
+  {
+    vtkSmartPointer<vtkLabelmapMarginFilter> MarginFilter;
+    vtkSmartPointer<vtkImageData> Labelmap;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Expressions of one wave of a batch. Each task evaluates one expression.
+  struct MorphologyTaskList
+  {
+    MorphologyBatch* Batch;
+    /// Scratch objects not used by any task. There are as many as threads, so a task always finds one
+    std::vector<MorphologyScratch*> FreeScratches;
+    vtkSimpleMutexLock Lock;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Evaluate a node of an expression tree. Leaves are not copied: the mask of the referenced segment or
+  /// result is returned. The masks are only read while the expressions of a wave are evaluated.
+  /// \param storage Mask the result of an operation is written to
+  /// \return Mask of the node, storage unless the node is a leaf
+  const PackedMask* EvaluateMorphologyNode(MorphologyBatch* batch, const MorphologyExpression& expression, int nodeIndex,
+    MorphologyScratch& scratch, PackedMask& storage)
+  {
+    const MorphologyExpressionNode& node = expression.Nodes[nodeIndex];
+    switch (node.Operation)
+    {
+    case vtkMRMLSegmentMorphologyNode::None:
+      return (node.ResultIndex >= 0 ? &batch->Results[node.ResultIndex] : &batch->InputMasks[node.InputIndex]);
+
+    case vtkMRMLSegmentMorphologyNode::Union:
+    case vtkMRMLSegmentMorphologyNode::Intersect:
+    case vtkMRMLSegmentMorphologyNode::Subtract:
+      {
+      // The first operand is evaluated to the storage, so the operation is done in place unless it is a leaf
+      const PackedMask* firstOperand = EvaluateMorphologyNode(batch, expression, node.Operands[0], scratch, storage);
+      PackedMask secondOperandStorage;
+      const PackedMask* secondOperand = EvaluateMorphologyNode(batch, expression, node.Operands[1], scratch, secondOperandStorage);
+      if (firstOperand != &storage)
+      {
+        storage.Words.resize(firstOperand->Words.size());
+      }
+      const vtkTypeUInt64* firstWords = &firstOperand->Words[0];
+      const vtkTypeUInt64* secondWords = &secondOperand->Words[0];
+      vtkTypeUInt64* resultWords = &storage.Words[0];
+      size_t numberOfWords = storage.Words.size();
+      if (node.Operation == vtkMRMLSegmentMorphologyNode::Union)
+      {
+        for (size_t i=0; i<numberOfWords; ++i)
+        {
+          resultWords[i] = firstWords[i] | secondWords[i];
+        }
+      }
+      else if (node.Operation == vtkMRMLSegmentMorphologyNode::Intersect)
+      {
+        for (size_t i=0; i<numberOfWords; ++i)
+        {
+          resultWords[i] = firstWords[i] & secondWords[i];
+        }
+      }
+      else
+      {
+        for (size_t i=0; i<numberOfWords; ++i)
+        {
+          resultWords[i] = firstWords[i] & ~secondWords[i];
+        }
+      }
+      return &storage;
+      }
+
+    case vtkMRMLSegmentMorphologyNode::Expand:
+    case vtkMRMLSegmentMorphologyNode::Shrink:
+      {
+      const PackedMask* operand = EvaluateMorphologyNode(batch, expression, node.Operands[0], scratch, storage);
+
+      // Unpack to the scratch labelmap, apply margin on the shared extent (it already contains the padding), and pack the output
+      unsigned char* labelmapPtr = static_cast<unsigned char*>(scratch.Labelmap->GetScalarPointer());
+      for (vtkIdType i=0; i<batch->NumberOfVoxels; ++i)
+      {
+        labelmapPtr[i] = (operand->Get(i) ? 1 : 0);
+      }
+      scratch.Labelmap->Modified();
+      scratch.MarginFilter->SetNumberOfThreads(batch->NumberOfMarginThreads);
+      scratch.MarginFilter->SetMargin(node.Margin[0], node.Margin[1], node.Margin[2]);
+      scratch.MarginFilter->SetOperation(node.Operation == vtkMRMLSegmentMorphologyNode::Expand
+        ? vtkLabelmapMarginFilter::Expand : vtkLabelmapMarginFilter::Shrink);
+      scratch.MarginFilter->Update();
+      const unsigned char* outputPtr = static_cast<unsigned char*>(scratch.MarginFilter->GetOutput()->GetScalarPointer());
+      storage.Allocate(batch->NumberOfVoxels);
+      for (vtkIdType i=0; i<batch->NumberOfVoxels; ++i)
+      {
+        if (outputPtr[i])
+        {
+          storage.Set(i);
+        }
+      }
+      return &storage;
+      }
+
+    default:
+      return &storage;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void InitializeMorphologyScratch(MorphologyBatch* batch, MorphologyScratch& scratch)
+  {
+    scratch.Labelmap = vtkSmartPointer<vtkImageData>::New();
+    scratch.Labelmap->SetDimensions(batch->Dimensions);
+    scratch.Labelmap->SetSpacing(batch->Spacing);
+    scratch.Labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    scratch.MarginFilter = vtkSmartPointer<vtkLabelmapMarginFilter>::New();
+    scratch.MarginFilter->SetInputData(scratch.Labelmap);
+    scratch.MarginFilter->PadOutputExtentOff();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Evaluate one expression of the wave with a scratch object borrowed from the free list
+  void EvaluateMorphologyExpressionTaskFunction(void* userData, int taskIndex)
+  {
+    MorphologyTaskList* taskList = static_cast<MorphologyTaskList*>(userData);
+    MorphologyBatch* batch = taskList->Batch;
+
+    taskList->Lock.Lock();
+    MorphologyScratch* scratch = taskList->FreeScratches.back();
+    taskList->FreeScratches.pop_back();
+    taskList->Lock.Unlock();
+
+    int expressionIndex = batch->TaskExpressionIndices[taskIndex];
+    const MorphologyExpression& expression = batch->Expressions[expressionIndex];
+    PackedMask& result = batch->Results[expressionIndex];
+    const PackedMask* mask = EvaluateMorphologyNode(batch, expression, (int)expression.Nodes.size() - 1, *scratch, result);
+    if (mask != &result)
+    {
+      // Expression is a single reference
+      result = *mask;
+    }
+
+    taskList->Lock.Lock();
+    taskList->FreeScratches.push_back(scratch);
+    taskList->Lock.Unlock();
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkSlicerSegmentMorphologyModuleLogic::vtkSlicerSegmentMorphologyModuleLogic()
+  : NumberOfThreads(0)
 {
 }
 
@@ -248,19 +727,11 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
     imageB->vtkImageData::DeepCopy(padder->GetOutput());
   }
 
-  // Get kernel size
-  double spacingA[3] = {0.0,0.0,0.0};
-  imageA->GetSpacing(spacingA);
-
+  // Get margin sizes
   double xSize = parameterNode->GetXSize();
   double ySize = parameterNode->GetYSize();
   double zSize = parameterNode->GetZSize();
 
-  int kernelSize[3] = {1,1,1};
-  kernelSize[0] = (int)( 2.0*(xSize/spacingA[0] + 0.5) );
-  kernelSize[1] = (int)( 2.0*(ySize/spacingA[1] + 0.5) );
-  kernelSize[2] = (int)( 2.0*(zSize/spacingA[2] + 0.5) );
-
   // Apply operation on image data
   vtkSmartPointer<vtkImageAccumulate> histogram = vtkSmartPointer<vtkImageAccumulate>::New();
   histogram->SetInputData(imageA);
@@ -270,36 +741,31 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
   vtkSmartPointer<vtkImageData> tempOutputImageData = NULL;
   switch (operation) 
   {
-  // Expand
+  // Expand and shrink
+  // (distance transform based, so the computation time does not depend on the margin size.
+  // The expanded image is padded by the margin, as the extents are fitted to the structure)
   case vtkMRMLSegmentMorphologyNode::Expand:
+  case vtkMRMLSegmentMorphologyNode::Shrink:
     {
-    // Pad image by expansion extent (extents are fitted to the structure, dilate will reach the edge of the image)
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(imageA);
-    int extent[6] = {0,-1,0,-1,0,-1};
-    imageA->GetExtent(extent);
-
-    // Now set the output extent to the new size
-    int expansionExtent[3] = { int(xSize/spacingA[0] + 1.0), int(ySize/spacingA[1] + 1.0), int(zSize/spacingA[2] + 1.0) }; // Rounding up
-    padder->SetOutputWholeExtent(extent[0]-expansionExtent[0], extent[1]+expansionExtent[0], extent[2]-expansionExtent[1], extent[3]+expansionExtent[1], extent[4]-expansionExtent[2], extent[5]+expansionExtent[2]);
-    padder->Update();
-
-    vtkSmartPointer<vtkImageContinuousDilate3D> dilateFilter = vtkSmartPointer<vtkImageContinuousDilate3D>::New();
-    dilateFilter->SetInputConnection(padder->GetOutputPort());
-    dilateFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
-    dilateFilter->Update();
-    tempOutputImageData = dilateFilter->GetOutput();
-    break;
+    vtkSmartPointer<vtkLabelmapMarginFilter> marginFilter = vtkSmartPointer<vtkLabelmapMarginFilter>::New();
+    marginFilter->SetInputData(imageA);
+    marginFilter->SetMargin(xSize, ySize, zSize);
+    if (operation == vtkMRMLSegmentMorphologyNode::Expand)
+    {
+      marginFilter->SetOperationToExpand();
     }
-
-  // Shrink
-  case vtkMRMLSegmentMorphologyNode::Shrink:
+    else
     {
-    vtkSmartPointer<vtkImageContinuousErode3D> erodeFilter = vtkSmartPointer<vtkImageContinuousErode3D>::New();
-    erodeFilter->SetInputData(imageA);
-    erodeFilter->SetKernelSize(kernelSize[0], kernelSize[1], kernelSize[2]);
-    erodeFilter->Update();
-    tempOutputImageData = erodeFilter->GetOutput();
+      marginFilter->SetOperationToShrink();
+    }
+    marginFilter->SetLabelValue(valueMax);
+    if (!marginFilter->Update())
+    {
+      std::string errorMessage("Failed to apply margin to segment A");
+      vtkErrorMacro("ApplyMorphologyOperation: " << errorMessage);
+      return errorMessage;
+    }
+    tempOutputImageData = marginFilter->GetOutput();
     break;
     }
 
@@ -386,6 +852,377 @@ std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyOperation(vtkM
   return "";
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentMorphologyModuleLogic::ApplyMorphologyExpressions(
+  vtkMRMLSegmentationNode* inputSegmentationNode, vtkStringArray* expressions, vtkMRMLSegmentationNode* outputSegmentationNode)
+{
+  if (!inputSegmentationNode || !inputSegmentationNode->GetSegmentation())
+  {
+    std::string errorMessage("Input segmentation is not selected");
+    vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+    return errorMessage;
+  }
+  if (!outputSegmentationNode || !outputSegmentationNode->GetSegmentation())
+  {
+    std::string errorMessage("Output segmentation is not selected");
+    vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+    return errorMessage;
+  }
+  if (!expressions || expressions->GetNumberOfValues() == 0)
+  {
+    return "";
+  }
+  vtkSegmentation* inputSegmentation = inputSegmentationNode->GetSegmentation();
+  std::vector<std::string> inputSegmentIDs;
+  inputSegmentation->GetSegmentIDs(inputSegmentIDs);
+
+  // Parse expressions and resolve the referenced names. Names of earlier results take precedence over segment names,
+  // segments can be referenced by name or by ID.
+  MorphologyBatch batch;
+  std::map<std::string, int> resultIndices;
+  std::map<std::string, int> inputIndices;
+  std::vector<std::string> inputNames;
+  std::vector<std::string> referencedSegmentIDs;
+  for (vtkIdType expressionIndex=0; expressionIndex<expressions->GetNumberOfValues(); ++expressionIndex)
+  {
+    MorphologyExpression expression;
+    MorphologyExpressionParser parser(expressions->GetValue(expressionIndex), expression);
+    std::string errorMessage = parser.Parse();
+    if (!errorMessage.empty())
+    {
+      vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+      return errorMessage;
+    }
+    if (resultIndices.find(expression.ResultName) != resultIndices.end())
+    {
+      errorMessage = "Result defined more than once: " + expression.ResultName;
+      vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+      return errorMessage;
+    }
+
+    for (std::vector<MorphologyExpressionNode>::iterator nodeIt=expression.Nodes.begin(); nodeIt!=expression.Nodes.end(); ++nodeIt)
+    {
+      if (nodeIt->Operation != vtkMRMLSegmentMorphologyNode::None)
+      {
+        continue;
+      }
+      std::map<std::string, int>::iterator resultIt = resultIndices.find(nodeIt->Name);
+      if (resultIt != resultIndices.end())
+      {
+        nodeIt->ResultIndex = resultIt->second;
+        if (std::find(expression.Dependencies.begin(), expression.Dependencies.end(), resultIt->second) == expression.Dependencies.end())
+        {
+          expression.Dependencies.push_back(resultIt->second);
+        }
+        continue;
+      }
+      std::map<std::string, int>::iterator inputIt = inputIndices.find(nodeIt->Name);
+      if (inputIt == inputIndices.end())
+      {
+        std::string segmentID("");
+        for (std::vector<std::string>::iterator segmentIt=inputSegmentIDs.begin(); segmentIt!=inputSegmentIDs.end(); ++segmentIt)
+        {
+          if (nodeIt->Name == inputSegmentation->GetSegment(*segmentIt)->GetName())
+          {
+            segmentID = *segmentIt;
+            break;
+          }
+        }
+        if (segmentID.empty() && inputSegmentation->GetSegment(nodeIt->Name))
+        {
+          segmentID = nodeIt->Name;
+        }
+        if (segmentID.empty())
+        {
+          errorMessage = "Segment not found: " + nodeIt->Name;
+          vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+          return errorMessage;
+        }
+        inputIt = inputIndices.insert(std::make_pair(nodeIt->Name, (int)inputNames.size())).first;
+        inputNames.push_back(nodeIt->Name);
+        referencedSegmentIDs.push_back(segmentID);
+      }
+      nodeIt->InputIndex = inputIt->second;
+    }
+
+    resultIndices[expression.ResultName] = (int)batch.Expressions.size();
+    batch.Expressions.push_back(expression);
+  }
+
+  // The results are binary labelmaps, so they can only be added to a segmentation with binary labelmap master.
+  // Segments with the same names as the results are replaced, so they do not count.
+  vtkSegmentation* outputSegmentation = outputSegmentationNode->GetSegmentation();
+  std::vector<std::string> outputSegmentIDs;
+  outputSegmentation->GetSegmentIDs(outputSegmentIDs);
+  std::vector<std::string> replacedSegmentIDs;
+  for (std::vector<std::string>::iterator segmentIt=outputSegmentIDs.begin(); segmentIt!=outputSegmentIDs.end(); ++segmentIt)
+  {
+    if (resultIndices.find(outputSegmentation->GetSegment(*segmentIt)->GetName()) != resultIndices.end())
+    {
+      replacedSegmentIDs.push_back(*segmentIt);
+    }
+  }
+  std::string binaryLabelmapRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+  if ( outputSegmentIDs.size() > replacedSegmentIDs.size()
+    && outputSegmentation->GetMasterRepresentationName() != binaryLabelmapRepresentationName )
+  {
+    std::string errorMessage("Master representation of output segmentation is not binary labelmap");
+    vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Get the binary labelmaps of the referenced segments
+  std::vector< vtkSmartPointer<vtkOrientedImageData> > inputImages;
+  for (std::vector<std::string>::iterator segmentIt=referencedSegmentIDs.begin(); segmentIt!=referencedSegmentIDs.end(); ++segmentIt)
+  {
+    vtkSmartPointer<vtkOrientedImageData> image = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(inputSegmentationNode, *segmentIt, image))
+    {
+      std::string errorMessage("Failed to get binary labelmap from segment: " + *segmentIt);
+      vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+      return errorMessage;
+    }
+    inputImages.push_back(image);
+  }
+
+  // All expressions are evaluated on one shared geometry: the geometry of the first referenced segment,
+  // with an extent containing all referenced segments, padded by the largest expansion
+  vtkOrientedImageData* referenceImage = inputImages[0];
+  vtkSmartPointer<vtkMatrix4x4> referenceImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceImage->GetImageToWorldMatrix(referenceImageToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> worldToReferenceImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(referenceImageToWorldMatrix, worldToReferenceImageMatrix);
+
+  int sharedExtent[6] = {VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN};
+  std::vector<bool> resampleImage(inputImages.size(), false);
+  for (size_t inputIndex=0; inputIndex<inputImages.size(); ++inputIndex)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    inputImages[inputIndex]->GetExtent(extent);
+    if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+    {
+      continue;
+    }
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    inputImages[inputIndex]->GetImageToWorldMatrix(imageToWorldMatrix);
+    for (int row=0; row<3; ++row)
+    {
+      for (int column=0; column<4; ++column)
+      {
+        if (fabs(imageToWorldMatrix->GetElement(row, column) - referenceImageToWorldMatrix->GetElement(row, column)) > 1.0e-6)
+        {
+          resampleImage[inputIndex] = true;
+        }
+      }
+    }
+
+    // Extent of the image in the IJK frame of the reference
+    vtkSmartPointer<vtkMatrix4x4> imageToReferenceImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Multiply4x4(worldToReferenceImageMatrix, imageToWorldMatrix, imageToReferenceImageMatrix);
+    for (int corner=0; corner<8; ++corner)
+    {
+      double imagePoint[4] = { (double)extent[corner&1], (double)extent[2+((corner>>1)&1)], (double)extent[4+((corner>>2)&1)], 1.0 };
+      double referencePoint[4] = {0.0, 0.0, 0.0, 1.0};
+      imageToReferenceImageMatrix->MultiplyPoint(imagePoint, referencePoint);
+      for (int axis=0; axis<3; ++axis)
+      {
+        sharedExtent[2*axis] = std::min(sharedExtent[2*axis], vtkMath::Floor(referencePoint[axis] + 1.0e-6));
+        sharedExtent[2*axis+1] = std::max(sharedExtent[2*axis+1], vtkMath::Ceil(referencePoint[axis] - 1.0e-6));
+      }
+    }
+  }
+  if (sharedExtent[0] > sharedExtent[1])
+  {
+    // All referenced segments are empty
+    for (int i=0; i<6; ++i)
+    {
+      sharedExtent[i] = 0;
+    }
+  }
+
+  // Resample the segments that do not have the reference geometry. The resampled labelmaps are temporary,
+  // the labelmaps of the segments are not modified.
+  vtkSmartPointer<vtkOrientedImageData> sharedGeometryImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  sharedGeometryImage->SetExtent(sharedExtent);
+  sharedGeometryImage->SetGeometryFromImageToWorldMatrix(referenceImageToWorldMatrix);
+  for (size_t inputIndex=0; inputIndex<inputImages.size(); ++inputIndex)
+  {
+    if (!resampleImage[inputIndex])
+    {
+      continue;
+    }
+    vtkSmartPointer<vtkOrientedImageData> resampledImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      inputImages[inputIndex], sharedGeometryImage, resampledImage) )
+    {
+      std::string errorMessage("Failed to resample segment " + inputNames[inputIndex]);
+      vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+      return errorMessage;
+    }
+    inputImages[inputIndex] = resampledImage;
+  }
+
+  // Pad by the largest distance any result may reach beyond the input segments.
+  // Padding of the expression tree nodes is computed bottom-up (operands always precede the nodes using them).
+  double maximumPadding[3] = {0.0, 0.0, 0.0};
+  for (std::vector<MorphologyExpression>::iterator expressionIt=batch.Expressions.begin(); expressionIt!=batch.Expressions.end(); ++expressionIt)
+  {
+    std::vector<double> nodePadding(3 * expressionIt->Nodes.size(), 0.0);
+    for (size_t nodeIndex=0; nodeIndex<expressionIt->Nodes.size(); ++nodeIndex)
+    {
+      const MorphologyExpressionNode& node = expressionIt->Nodes[nodeIndex];
+      for (int axis=0; axis<3; ++axis)
+      {
+        double padding = 0.0;
+        switch (node.Operation)
+        {
+        case vtkMRMLSegmentMorphologyNode::None:
+          padding = (node.ResultIndex >= 0 ? batch.Expressions[node.ResultIndex].Padding[axis] : 0.0);
+          break;
+        case vtkMRMLSegmentMorphologyNode::Union:
+          padding = std::max(nodePadding[3*node.Operands[0]+axis], nodePadding[3*node.Operands[1]+axis]);
+          break;
+        case vtkMRMLSegmentMorphologyNode::Intersect:
+          padding = std::min(nodePadding[3*node.Operands[0]+axis], nodePadding[3*node.Operands[1]+axis]);
+          break;
+        case vtkMRMLSegmentMorphologyNode::Expand:
+          padding = nodePadding[3*node.Operands[0]+axis] + node.Margin[axis];
+          break;
+        default: // Subtract, Shrink
+          padding = nodePadding[3*node.Operands[0]+axis];
+          break;
+        }
+        nodePadding[3*nodeIndex+axis] = padding;
+      }
+    }
+    for (int axis=0; axis<3; ++axis)
+    {
+      expressionIt->Padding[axis] = nodePadding[3*(expressionIt->Nodes.size()-1)+axis];
+      maximumPadding[axis] = std::max(maximumPadding[axis], expressionIt->Padding[axis]);
+    }
+  }
+  referenceImage->GetSpacing(batch.Spacing);
+  for (int axis=0; axis<3; ++axis)
+  {
+    int paddingVoxels = vtkMath::Floor(maximumPadding[axis] / batch.Spacing[axis] + 1.0e-5);
+    sharedExtent[2*axis] -= paddingVoxels;
+    sharedExtent[2*axis+1] += paddingVoxels;
+    batch.Dimensions[axis] = sharedExtent[2*axis+1] - sharedExtent[2*axis] + 1;
+  }
+  batch.NumberOfVoxels = (vtkIdType)batch.Dimensions[0] * batch.Dimensions[1] * batch.Dimensions[2];
+
+  // Pack the input segments
+  batch.InputMasks.resize(inputImages.size());
+  for (size_t inputIndex=0; inputIndex<inputImages.size(); ++inputIndex)
+  {
+    vtkOrientedImageData* image = inputImages[inputIndex];
+    batch.InputMasks[inputIndex].Allocate(batch.NumberOfVoxels);
+    int extent[6] = {0,-1,0,-1,0,-1};
+    image->GetExtent(extent);
+    if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5] || !image->GetPointData()->GetScalars())
+    {
+      continue;
+    }
+    switch (image->GetScalarType())
+    {
+      vtkTemplateMacro(PackLabelmap(static_cast<VTK_TT*>(image->GetScalarPointer()), extent, sharedExtent, batch.InputMasks[inputIndex]));
+    default:
+      std::string errorMessage("Unknown scalar type of segment " + inputNames[inputIndex]);
+      vtkErrorMacro("ApplyMorphologyExpressions: " << errorMessage);
+      return errorMessage;
+    }
+  }
+
+  // Evaluate the expressions in waves. The expressions of a wave only depend on results of earlier waves, so they run in parallel.
+  int numberOfExpressions = (int)batch.Expressions.size();
+  batch.Results.resize(numberOfExpressions);
+  std::vector<bool> evaluated(numberOfExpressions, false);
+  int numberOfEvaluatedExpressions = 0;
+  // Scratch objects are only added when a wave uses more threads than the earlier ones
+  std::vector<MorphologyScratch> scratches;
+  while (numberOfEvaluatedExpressions < numberOfExpressions)
+  {
+    batch.TaskExpressionIndices.clear();
+    for (int expressionIndex=0; expressionIndex<numberOfExpressions; ++expressionIndex)
+    {
+      bool ready = !evaluated[expressionIndex];
+      const std::vector<int>& dependencies = batch.Expressions[expressionIndex].Dependencies;
+      for (std::vector<int>::const_iterator dependencyIt=dependencies.begin(); dependencyIt!=dependencies.end() && ready; ++dependencyIt)
+      {
+        ready = evaluated[*dependencyIt];
+      }
+      if (ready)
+      {
+        batch.TaskExpressionIndices.push_back(expressionIndex);
+      }
+    }
+
+    int numberOfTasks = (int)batch.TaskExpressionIndices.size();
+    int numberOfThreads = vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(this->NumberOfThreads, numberOfTasks);
+    // If only one expression is ready, then its margin operations use the threads
+    batch.NumberOfMarginThreads = (numberOfThreads > 1 ? 1 : this->NumberOfThreads);
+    MorphologyTaskList taskList;
+    taskList.Batch = &batch;
+    while ((int)scratches.size() < numberOfThreads)
+    {
+      scratches.push_back(MorphologyScratch());
+      InitializeMorphologyScratch(&batch, scratches.back());
+    }
+    for (int threadIndex=0; threadIndex<numberOfThreads; ++threadIndex)
+    {
+      taskList.FreeScratches.push_back(&scratches[threadIndex]);
+    }
+    vtkSlicerRtTaskPool::ExecuteTasks(numberOfTasks, EvaluateMorphologyExpressionTaskFunction, &taskList, numberOfThreads);
+
+    for (std::vector<int>::iterator taskIt=batch.TaskExpressionIndices.begin(); taskIt!=batch.TaskExpressionIndices.end(); ++taskIt)
+    {
+      evaluated[*taskIt] = true;
+      ++numberOfEvaluatedExpressions;
+    }
+  }
+
+  // Replace output segments with the same names as the results
+  for (std::vector<std::string>::iterator segmentIt=replacedSegmentIDs.begin(); segmentIt!=replacedSegmentIDs.end(); ++segmentIt)
+  {
+    outputSegmentation->RemoveSegment(*segmentIt);
+  }
+  outputSegmentation->SetMasterRepresentationName(binaryLabelmapRepresentationName.c_str());
+
+  // The labelmaps of the input segments are in world coordinates, so the results are mapped to the coordinate frame
+  // of the output segmentation. Its parent transform is kept, so that its other segments do not move.
+  vtkSmartPointer<vtkGeneralTransform> worldToOutputSegmentationTransform;
+  if (outputSegmentationNode->GetParentTransformNode())
+  {
+    worldToOutputSegmentationTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+    outputSegmentationNode->GetParentTransformNode()->GetTransformFromWorld(worldToOutputSegmentationTransform);
+  }
+
+  for (int expressionIndex=0; expressionIndex<numberOfExpressions; ++expressionIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> outputImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    outputImage->SetExtent(sharedExtent);
+    outputImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    outputImage->SetGeometryFromImageToWorldMatrix(referenceImageToWorldMatrix);
+    unsigned char* outputPtr = static_cast<unsigned char*>(outputImage->GetScalarPointer());
+    const PackedMask& result = batch.Results[expressionIndex];
+    for (vtkIdType i=0; i<batch.NumberOfVoxels; ++i)
+    {
+      outputPtr[i] = (result.Get(i) ? 1 : 0);
+    }
+    if (worldToOutputSegmentationTransform.GetPointer())
+    {
+      vtkOrientedImageDataResample::TransformOrientedImage(outputImage, worldToOutputSegmentationTransform);
+    }
+
+    vtkSmartPointer<vtkSegment> newSegment = vtkSmartPointer<vtkSegment>::New();
+    newSegment->SetName(batch.Expressions[expressionIndex].ResultName.c_str());
+    newSegment->AddRepresentation(binaryLabelmapRepresentationName, outputImage);
+    outputSegmentation->AddSegment(newSegment);
+  }
+
+  return "";
+}
+
 //---------------------------------------------------------------------------
 std::string vtkSlicerSegmentMorphologyModuleLogic::GenerateOutputSegmentName(vtkMRMLSegmentMorphologyNode* parameterNode)
 {
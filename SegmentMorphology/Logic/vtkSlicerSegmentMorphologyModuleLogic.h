@@ -34,6 +34,8 @@
 #include "vtkSlicerSegmentMorphologyModuleLogicExport.h"
 
 class vtkMRMLSegmentMorphologyNode;
+class vtkMRMLSegmentationNode;
+class vtkStringArray;
 
 /// \ingroup SlicerRt_QtModules_SegmentMorphology
 class VTK_SLICER_SEGMENTMORPHOLOGY_MODULE_LOGIC_EXPORT vtkSlicerSegmentMorphologyModuleLogic :
@@ -48,6 +50,24 @@ public:
   /// \return Error message, empty string if no error
   std::string ApplyMorphologyOperation(vtkMRMLSegmentMorphologyNode* parameterNode);
 
+  /// Evaluate a list of morphology expressions on the segments of a segmentation in one batch.
+  /// Each expression has the form "Result = expression", where the expression combines segments with
+  /// + (union), - (subtract), * (intersect), parentheses, and Expand(expression, margin) / Shrink(expression, margin)
+  /// with one margin or three margins along the I, J and K axes (in mm). Segments are referenced by name (in quotes
+  /// if the name contains other characters than letters, digits, '_' and '.') or by ID, and the results of earlier
+  /// expressions can be referenced by their names. For example:
+  ///   "Ring = Expand(PTV, 10) - Expand(PTV, 3)", "'Bladder wall' = Bladder - Shrink(Bladder, 5, 5, 3)", "Rectum_PRV = Expand(Rectum, 5) - PTV"
+  /// All expressions are evaluated on one geometry (the union of the referenced segments padded by the largest expansion),
+  /// the intermediate masks are bit-packed, and the expressions that do not depend on each other are evaluated in parallel.
+  /// \param outputSegmentationNode Segmentation to add the results to (segments with the same names are replaced).
+  ///   May be the input segmentation.
+  /// \return Error message, empty string if no error
+  std::string ApplyMorphologyExpressions(vtkMRMLSegmentationNode* inputSegmentationNode, vtkStringArray* expressions,
+    vtkMRMLSegmentationNode* outputSegmentationNode);
+
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
 protected:
   /// Generate output segment name from input segment names
   std::string GenerateOutputSegmentName(vtkMRMLSegmentMorphologyNode* parameterNode);
@@ -66,6 +86,12 @@ protected:
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) VTK_OVERRIDE;
   virtual void OnMRMLSceneEndClose() VTK_OVERRIDE;
 
+protected:
+  /// Number of expressions evaluated at the same time. If only one expression can be evaluated (because the
+  /// others depend on it), then its margin operations use the threads instead.
+  /// 0 (default) uses all processor cores, 1 evaluates everything on the calling thread \sa vtkSlicerRtTaskPool
+  int NumberOfThreads;
+
 private:
   vtkSlicerSegmentMorphologyModuleLogic(const vtkSlicerSegmentMorphologyModuleLogic&); // Not implemented
   void operator=(const vtkSlicerSegmentMorphologyModuleLogic&);               // Not implemented
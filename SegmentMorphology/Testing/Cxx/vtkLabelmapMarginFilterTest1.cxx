@@ -0,0 +1,269 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkLabelmapMarginFilter.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+  /// Extent, spacing and origin of the synthetic labelmap. The spacing is different along each axis.
+  const int INPUT_EXTENT[6] = { 2, 14, -1, 9, 0, 7 };
+  const double SPACING[3] = { 1.0, 1.5, 2.5 };
+  const double ORIGIN[3] = { -20.0, 7.5, 3.0 };
+  const unsigned char LABEL_VALUE = 3;
+
+  /// Same tolerance as used by the filter for the unit sphere
+  const double MARGIN_TOLERANCE = 1.0e-5;
+
+  //-----------------------------------------------------------------------------
+  /// Labelmap with an ellipsoid, a thin line and a single voxel
+  vtkSmartPointer<vtkImageData> CreateLabelmap()
+  {
+    vtkSmartPointer<vtkImageData> labelmap = vtkSmartPointer<vtkImageData>::New();
+    labelmap->SetExtent(const_cast<int*>(INPUT_EXTENT));
+    labelmap->SetSpacing(const_cast<double*>(SPACING));
+    labelmap->SetOrigin(const_cast<double*>(ORIGIN));
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    for (int k = INPUT_EXTENT[4]; k <= INPUT_EXTENT[5]; ++k)
+    {
+      for (int j = INPUT_EXTENT[2]; j <= INPUT_EXTENT[3]; ++j)
+      {
+        for (int i = INPUT_EXTENT[0]; i <= INPUT_EXTENT[1]; ++i)
+        {
+          bool inside = ( (i-6)*(i-6) + (j-4)*(j-4) + 2*(k-3)*(k-3) <= 9 )
+            || ( i == 12 && j >= 0 && j <= 7 && k == 5 )
+            || ( i == 13 && j == -1 && k == 1 );
+          *static_cast<unsigned char*>(labelmap->GetScalarPointer(i, j, k)) = (inside ? 1 : 0);
+        }
+      }
+    }
+    return labelmap;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Whether voxel offset is within the ellipsoid with the margins as semi-axes. Along axes with zero
+  /// margin only zero offset is within the ellipsoid.
+  bool IsWithinMargin(int offsetI, int offsetJ, int offsetK, const double margin[3])
+  {
+    int offset[3] = { offsetI, offsetJ, offsetK };
+    double scaledSquaredDistance = 0.0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (margin[axis] <= 0.0)
+      {
+        if (offset[axis] != 0)
+        {
+          return false;
+        }
+        continue;
+      }
+      double scaledOffset = offset[axis] * SPACING[axis] / margin[axis];
+      scaledSquaredDistance += scaledOffset * scaledOffset;
+    }
+    return scaledSquaredDistance <= 1.0 + MARGIN_TOLERANCE;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Whether the voxel is inside in the input. Outside the extent everything is outside.
+  bool IsInsideInput(vtkImageData* labelmap, int i, int j, int k)
+  {
+    if ( i < INPUT_EXTENT[0] || i > INPUT_EXTENT[1] || j < INPUT_EXTENT[2] || j > INPUT_EXTENT[3]
+      || k < INPUT_EXTENT[4] || k > INPUT_EXTENT[5] )
+    {
+      return false;
+    }
+    return *static_cast<unsigned char*>(labelmap->GetScalarPointer(i, j, k)) > 0;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Dilate (positive margin) or erode (negative margin) a voxel of the labelmap by checking every voxel of the
+  /// ellipsoid around it. When eroding, voxels outside the input extent are outside the structure.
+  bool IsInsideBruteForce(vtkImageData* labelmap, int i, int j, int k, const double margin[3], bool expand)
+  {
+    int radius[3] = { 0, 0, 0 };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      radius[axis] = vtkMath::Floor(margin[axis] / SPACING[axis] + MARGIN_TOLERANCE);
+    }
+    if (!expand && !IsInsideInput(labelmap, i, j, k))
+    {
+      return false;
+    }
+    for (int offsetK = -radius[2]; offsetK <= radius[2]; ++offsetK)
+    {
+      for (int offsetJ = -radius[1]; offsetJ <= radius[1]; ++offsetJ)
+      {
+        for (int offsetI = -radius[0]; offsetI <= radius[0]; ++offsetI)
+        {
+          if (!IsWithinMargin(offsetI, offsetJ, offsetK, margin))
+          {
+            continue;
+          }
+          bool inside = IsInsideInput(labelmap, i + offsetI, j + offsetJ, k + offsetK);
+          if (expand && inside)
+          {
+            return true;
+          }
+          if (!expand && !inside)
+          {
+            return false;
+          }
+        }
+      }
+    }
+    return !expand;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Apply the margin with the filter and compare the result to the brute-force dilation or erosion.
+  /// A negative margin shrinks the structure, the same way as the margin operations of the Segment Morphology module.
+  /// \return Number of inside voxels in the output, -1 if the output is invalid
+  int ApplyAndCompareMargin(vtkImageData* labelmap, double marginI, double marginJ, double marginK, int numberOfThreads)
+  {
+    bool expand = (marginI >= 0.0 && marginJ >= 0.0 && marginK >= 0.0);
+    double margin[3] = { fabs(marginI), fabs(marginJ), fabs(marginK) };
+
+    vtkNew<vtkLabelmapMarginFilter> marginFilter;
+    marginFilter->SetInputData(labelmap);
+    marginFilter->SetMargin(margin);
+    if (expand)
+    {
+      marginFilter->SetOperationToExpand();
+    }
+    else
+    {
+      marginFilter->SetOperationToShrink();
+    }
+    marginFilter->SetLabelValue(LABEL_VALUE);
+    marginFilter->SetNumberOfThreads(numberOfThreads);
+    if (!marginFilter->Update())
+    {
+      std::cerr << "Failed to apply margin (" << marginI << ", " << marginJ << ", " << marginK << ")" << std::endl;
+      return -1;
+    }
+
+    // Expanded output is padded by the margin, shrunk output has the input extent
+    vtkImageData* output = marginFilter->GetOutput();
+    int outputExtent[6] = { 0, -1, 0, -1, 0, -1 };
+    output->GetExtent(outputExtent);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      int padding = (expand ? vtkMath::Floor(margin[axis] / SPACING[axis] + MARGIN_TOLERANCE) : 0);
+      if ( outputExtent[2*axis] != INPUT_EXTENT[2*axis] - padding || outputExtent[2*axis+1] != INPUT_EXTENT[2*axis+1] + padding
+        || output->GetSpacing()[axis] != SPACING[axis] || output->GetOrigin()[axis] != ORIGIN[axis] )
+      {
+        std::cerr << "Invalid output geometry along axis " << axis << " for margin (" << marginI << ", " << marginJ << ", " << marginK << ")" << std::endl;
+        return -1;
+      }
+    }
+
+    int numberOfInsideVoxels = 0;
+    int numberOfDifferentVoxels = 0;
+    for (int k = outputExtent[4]; k <= outputExtent[5]; ++k)
+    {
+      for (int j = outputExtent[2]; j <= outputExtent[3]; ++j)
+      {
+        for (int i = outputExtent[0]; i <= outputExtent[1]; ++i)
+        {
+          unsigned char value = *static_cast<unsigned char*>(output->GetScalarPointer(i, j, k));
+          unsigned char expectedValue = (IsInsideBruteForce(labelmap, i, j, k, margin, expand) ? LABEL_VALUE : 0);
+          if (value != expectedValue)
+          {
+            if (numberOfDifferentVoxels == 0)
+            {
+              std::cerr << "Margin (" << marginI << ", " << marginJ << ", " << marginK << ") with " << numberOfThreads
+                << " thread(s) differs from brute force at voxel (" << i << ", " << j << ", " << k << "): "
+                << (int)value << " instead of " << (int)expectedValue << std::endl;
+            }
+            ++numberOfDifferentVoxels;
+          }
+          if (value != 0)
+          {
+            ++numberOfInsideVoxels;
+          }
+        }
+      }
+    }
+    if (numberOfDifferentVoxels > 0)
+    {
+      std::cerr << "  Number of different voxels: " << numberOfDifferentVoxels << std::endl;
+      return -1;
+    }
+    return numberOfInsideVoxels;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkLabelmapMarginFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkImageData> labelmap = CreateLabelmap();
+  int numberOfInputInsideVoxels = 0;
+  for (vtkIdType voxelIndex = 0; voxelIndex < labelmap->GetNumberOfPoints(); ++voxelIndex)
+  {
+    if (static_cast<unsigned char*>(labelmap->GetScalarPointer())[voxelIndex] > 0)
+    {
+      ++numberOfInputInsideVoxels;
+    }
+  }
+
+  // Margins that are not multiples of the spacing, and a zero margin along one axis
+  const int numberOfMargins = 4;
+  const double margins[numberOfMargins][3] = {
+    { 3.0, 2.0, 5.0 },
+    { 2.3, 4.0, 0.0 },
+    { -2.0, -3.0, -2.5 },
+    { -3.5, -1.6, 0.0 } };
+  const int numberOfThreadsToTest[2] = { 1, 4 };
+  for (int marginIndex = 0; marginIndex < numberOfMargins; ++marginIndex)
+  {
+    const double* margin = margins[marginIndex];
+    bool expand = (margin[0] >= 0.0);
+    for (int threadIndex = 0; threadIndex < 2; ++threadIndex)
+    {
+      int numberOfInsideVoxels = ApplyAndCompareMargin(labelmap, margin[0], margin[1], margin[2], numberOfThreadsToTest[threadIndex]);
+      if (numberOfInsideVoxels < 0)
+      {
+        return EXIT_FAILURE;
+      }
+      // Make sure the structure did change, so that the comparison is meaningful
+      if ( numberOfInsideVoxels == 0
+        || (expand && numberOfInsideVoxels <= numberOfInputInsideVoxels)
+        || (!expand && numberOfInsideVoxels >= numberOfInputInsideVoxels) )
+      {
+        std::cerr << "Margin (" << margin[0] << ", " << margin[1] << ", " << margin[2] << ") resulted in " << numberOfInsideVoxels
+          << " inside voxels from " << numberOfInputInsideVoxels << std::endl;
+        return EXIT_FAILURE;
+      }
+      std::cout << "Margin (" << margin[0] << ", " << margin[1] << ", " << margin[2] << ") with " << numberOfThreadsToTest[threadIndex]
+        << " thread(s): " << numberOfInsideVoxels << " inside voxels (input: " << numberOfInputInsideVoxels << ")" << std::endl;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,327 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SegmentMorphology includes
+#include "vtkSlicerSegmentMorphologyModuleLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkStringArray.h>
+
+// STD includes
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace
+{
+  //-----------------------------------------------------------------------------
+  /// Add a segment containing a box of voxels to the segmentation. The labelmap has unit spacing, the box fills its extent.
+  void AddBoxSegment(vtkSegmentation* segmentation, const char* name, const int extent[6], const double origin[3])
+  {
+    vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    labelmap->SetExtent(const_cast<int*>(extent));
+    labelmap->SetOrigin(const_cast<double*>(origin));
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    unsigned char* labelmapPtr = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+    for (vtkIdType i = 0; i < labelmap->GetNumberOfPoints(); ++i)
+    {
+      labelmapPtr[i] = 1;
+    }
+
+    vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+    segment->SetName(name);
+    segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), labelmap);
+    segmentation->AddSegment(segment);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get the binary labelmap of the segment with the given name
+  vtkOrientedImageData* GetSegmentLabelmap(vtkSegmentation* segmentation, const std::string& name)
+  {
+    std::vector<std::string> segmentIDs;
+    segmentation->GetSegmentIDs(segmentIDs);
+    for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+    {
+      vtkSegment* segment = segmentation->GetSegment(*segmentIt);
+      if (name == segment->GetName())
+      {
+        return vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
+          vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+      }
+    }
+    return NULL;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// \return Number of voxels inside the segment with the given name, -1 if there is no such segment
+  int GetNumberOfSegmentVoxels(vtkSegmentation* segmentation, const std::string& name)
+  {
+    vtkOrientedImageData* labelmap = GetSegmentLabelmap(segmentation, name);
+    if (!labelmap)
+    {
+      return -1;
+    }
+    int extent[6] = { 0, -1, 0, -1, 0, -1 };
+    labelmap->GetExtent(extent);
+    if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+    {
+      return 0;
+    }
+    int numberOfVoxels = 0;
+    unsigned char* labelmapPtr = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+    for (vtkIdType i = 0; i < labelmap->GetNumberOfPoints(); ++i)
+    {
+      if (labelmapPtr[i] > 0)
+      {
+        ++numberOfVoxels;
+      }
+    }
+    return numberOfVoxels;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check that the segment with the given name has the expected labelmap origin, in the coordinate frame of the segmentation
+  bool CheckSegmentOrigin(vtkSegmentation* segmentation, const std::string& name, const double expectedOrigin[3], const char* description)
+  {
+    vtkOrientedImageData* labelmap = GetSegmentLabelmap(segmentation, name);
+    if (!labelmap)
+    {
+      std::cerr << "Result " << name << " not found " << description << std::endl;
+      return false;
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (fabs(labelmap->GetOrigin()[axis] - expectedOrigin[axis]) > 1.0e-6)
+      {
+        std::cerr << "Result " << name << " " << description << " has origin (" << labelmap->GetOrigin()[0] << ", "
+          << labelmap->GetOrigin()[1] << ", " << labelmap->GetOrigin()[2] << ") instead of (" << expectedOrigin[0] << ", "
+          << expectedOrigin[1] << ", " << expectedOrigin[2] << ")" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Evaluate morphology expressions on boxes and a single voxel, and compare the voxel counts of the results
+// to the analytically computed ones. Check that the results are placed correctly in transformed segmentations.
+int vtkSlicerSegmentMorphologyExpressionTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkMRMLScene> mrmlScene;
+
+  // Box B has a different origin than box A (the geometry of the first referenced segment), so it is resampled.
+  // In world coordinates A is [0,9]^3, B is [5,14]x[0,9]x[0,9], and the dot is at (20,20,20).
+  vtkNew<vtkMRMLSegmentationNode> inputSegmentationNode;
+  mrmlScene->AddNode(inputSegmentationNode.GetPointer());
+  vtkSegmentation* inputSegmentation = inputSegmentationNode->GetSegmentation();
+  inputSegmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+  const int boxExtent[6] = { 0, 9, 0, 9, 0, 9 };
+  const double boxAOrigin[3] = { 0.0, 0.0, 0.0 };
+  const double boxBOrigin[3] = { 5.0, 0.0, 0.0 };
+  const int dotExtent[6] = { 20, 20, 20, 20, 20, 20 };
+  AddBoxSegment(inputSegmentation, "A", boxExtent, boxAOrigin);
+  AddBoxSegment(inputSegmentation, "B", boxExtent, boxBOrigin);
+  AddBoxSegment(inputSegmentation, "Dot", dotExtent, boxAOrigin);
+
+  vtkNew<vtkStringArray> expressions;
+  std::vector<int> expectedNumberOfVoxels;
+  expressions->InsertNextValue("Union = A + B");
+  expectedNumberOfVoxels.push_back(1500);
+  expressions->InsertNextValue("Intersection = A * B");
+  expectedNumberOfVoxels.push_back(500);
+  expressions->InsertNextValue("Difference = A - B");
+  expectedNumberOfVoxels.push_back(500);
+  // Single voxel expanded by twice the spacing: voxel offsets with squared length at most 4 (1 + 6 + 12 + 8 + 6)
+  expressions->InsertNextValue("Ball = Expand(Dot, 2)");
+  expectedNumberOfVoxels.push_back(33);
+  // Box expanded by one voxel gains one layer on each face
+  expressions->InsertNextValue("'Expanded A' = Expand(A, 1)");
+  expectedNumberOfVoxels.push_back(1600);
+  // Result that is only a reference, and results referencing earlier results
+  expressions->InsertNextValue("Copy = A");
+  expectedNumberOfVoxels.push_back(1000);
+  expressions->InsertNextValue("All = Union + Ball");
+  expectedNumberOfVoxels.push_back(1533);
+  expressions->InsertNextValue("Shell = 'Expanded A' - (Copy * A)");
+  expectedNumberOfVoxels.push_back(600);
+
+  const int numberOfThreadsToTest[2] = { 1, 4 };
+  for (int threadIndex = 0; threadIndex < 2; ++threadIndex)
+  {
+    vtkNew<vtkSlicerSegmentMorphologyModuleLogic> segmentMorphologyLogic;
+    segmentMorphologyLogic->SetMRMLScene(mrmlScene.GetPointer());
+    segmentMorphologyLogic->SetNumberOfThreads(numberOfThreadsToTest[threadIndex]);
+
+    vtkNew<vtkMRMLSegmentationNode> outputSegmentationNode;
+    mrmlScene->AddNode(outputSegmentationNode.GetPointer());
+    vtkSegmentation* outputSegmentation = outputSegmentationNode->GetSegmentation();
+
+    // Apply twice: the second evaluation replaces the results of the first one
+    for (int repetition = 0; repetition < 2; ++repetition)
+    {
+      std::string errorMessage = segmentMorphologyLogic->ApplyMorphologyExpressions(
+        inputSegmentationNode.GetPointer(), expressions.GetPointer(), outputSegmentationNode.GetPointer() );
+      if (!errorMessage.empty())
+      {
+        std::cerr << "Failed to apply morphology expressions: " << errorMessage << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    if (outputSegmentation->GetNumberOfSegments() != expressions->GetNumberOfValues())
+    {
+      std::cerr << "Output segmentation contains " << outputSegmentation->GetNumberOfSegments() << " segments instead of "
+        << expressions->GetNumberOfValues() << std::endl;
+      return EXIT_FAILURE;
+    }
+    if ( outputSegmentation->GetMasterRepresentationName()
+      != std::string(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) )
+    {
+      std::cerr << "Master representation of the output segmentation is not binary labelmap" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    for (vtkIdType expressionIndex = 0; expressionIndex < expressions->GetNumberOfValues(); ++expressionIndex)
+    {
+      std::string expression = expressions->GetValue(expressionIndex);
+      std::string resultName = expression.substr(0, expression.find(" = "));
+      if (resultName[0] == '\'')
+      {
+        resultName = resultName.substr(1, resultName.size() - 2);
+      }
+      int numberOfVoxels = GetNumberOfSegmentVoxels(outputSegmentation, resultName);
+      if (numberOfVoxels != expectedNumberOfVoxels[expressionIndex])
+      {
+        std::cerr << "Result of '" << expression << "' with " << numberOfThreadsToTest[threadIndex] << " thread(s) contains "
+          << numberOfVoxels << " voxels instead of " << expectedNumberOfVoxels[expressionIndex] << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // The input segments must not be changed by the resampling
+  vtkOrientedImageData* boxBLabelmap = GetSegmentLabelmap(inputSegmentation, "B");
+  int boxBExtent[6] = { 0, -1, 0, -1, 0, -1 };
+  boxBLabelmap->GetExtent(boxBExtent);
+  for (int i = 0; i < 6; ++i)
+  {
+    if (boxBExtent[i] != boxExtent[i])
+    {
+      std::cerr << "Labelmap of input segment B was modified" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (boxBLabelmap->GetOrigin()[axis] != boxBOrigin[axis])
+    {
+      std::cerr << "Geometry of input segment B was modified" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (GetNumberOfSegmentVoxels(inputSegmentation, "B") != 1000)
+  {
+    std::cerr << "Labelmap of input segment B was modified" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Results added to the transformed input segmentation stay where the input segments are,
+  // and the parent transform is kept so that the other segments do not move
+  vtkNew<vtkMatrix4x4> inputTranslation;
+  inputTranslation->SetElement(0, 3, 100.0);
+  vtkNew<vtkMRMLLinearTransformNode> inputTransformNode;
+  mrmlScene->AddNode(inputTransformNode.GetPointer());
+  inputTransformNode->SetMatrixTransformToParent(inputTranslation.GetPointer());
+  inputSegmentationNode->SetAndObserveTransformNodeID(inputTransformNode->GetID());
+
+  vtkNew<vtkSlicerSegmentMorphologyModuleLogic> transformedSegmentMorphologyLogic;
+  transformedSegmentMorphologyLogic->SetMRMLScene(mrmlScene.GetPointer());
+  vtkNew<vtkStringArray> copyExpressions;
+  copyExpressions->InsertNextValue("'Transformed copy' = A");
+  std::string errorMessage = transformedSegmentMorphologyLogic->ApplyMorphologyExpressions(
+    inputSegmentationNode.GetPointer(), copyExpressions.GetPointer(), inputSegmentationNode.GetPointer() );
+  if (!errorMessage.empty())
+  {
+    std::cerr << "Failed to apply morphology expressions in transformed segmentation: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !inputSegmentationNode->GetTransformNodeID()
+    || std::string(inputSegmentationNode->GetTransformNodeID()) != inputTransformNode->GetID() )
+  {
+    std::cerr << "Parent transform of the input segmentation was changed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !CheckSegmentOrigin(inputSegmentation, "Transformed copy", boxAOrigin, "added to the input segmentation")
+    || !CheckSegmentOrigin(inputSegmentation, "B", boxBOrigin, "in the input segmentation") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Results added to an output segmentation with a different transform are mapped to its coordinate frame,
+  // and its parent transform is kept so that its existing segments do not move
+  vtkNew<vtkMatrix4x4> outputTranslation;
+  outputTranslation->SetElement(1, 3, 50.0);
+  vtkNew<vtkMRMLLinearTransformNode> outputTransformNode;
+  mrmlScene->AddNode(outputTransformNode.GetPointer());
+  outputTransformNode->SetMatrixTransformToParent(outputTranslation.GetPointer());
+  vtkNew<vtkMRMLSegmentationNode> transformedOutputSegmentationNode;
+  mrmlScene->AddNode(transformedOutputSegmentationNode.GetPointer());
+  transformedOutputSegmentationNode->SetAndObserveTransformNodeID(outputTransformNode->GetID());
+  vtkSegmentation* transformedOutputSegmentation = transformedOutputSegmentationNode->GetSegmentation();
+  transformedOutputSegmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName());
+  AddBoxSegment(transformedOutputSegmentation, "Existing", boxExtent, boxAOrigin);
+  errorMessage = transformedSegmentMorphologyLogic->ApplyMorphologyExpressions(
+    inputSegmentationNode.GetPointer(), copyExpressions.GetPointer(), transformedOutputSegmentationNode.GetPointer() );
+  if (!errorMessage.empty())
+  {
+    std::cerr << "Failed to apply morphology expressions to transformed output segmentation: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !transformedOutputSegmentationNode->GetTransformNodeID()
+    || std::string(transformedOutputSegmentationNode->GetTransformNodeID()) != outputTransformNode->GetID() )
+  {
+    std::cerr << "Parent transform of the output segmentation was changed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double expectedCopyOrigin[3] = { 100.0, -50.0, 0.0 };
+  if ( !CheckSegmentOrigin(transformedOutputSegmentation, "Transformed copy", expectedCopyOrigin, "added to the output segmentation")
+    || !CheckSegmentOrigin(transformedOutputSegmentation, "Existing", boxAOrigin, "in the output segmentation") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -45,6 +45,22 @@
 
 vtkStandardNewMacro(vtkCollisionDetectionFilter);
 
+// Description:
+// OBB tree that gives access to its root node, for traversals other than IntersectWithOBBTree
+class vtkCollisionOBBTree : public vtkOBBTree
+{
+public:
+  static vtkCollisionOBBTree *New();
+  vtkTypeMacro(vtkCollisionOBBTree, vtkOBBTree);
+  vtkOBBNode *GetRoot() { return this->Tree; }
+
+protected:
+  vtkCollisionOBBTree() {}
+  ~vtkCollisionOBBTree() {}
+};
+
+vtkStandardNewMacro(vtkCollisionOBBTree);
+
 // Constructs with initial 0 values.
 vtkCollisionDetectionFilter::vtkCollisionDetectionFilter()
 {
@@ -63,11 +79,15 @@ vtkCollisionDetectionFilter::vtkCollisionDetectionFilter()
   this->BoxTolerance = 0.0;
   this->CellTolerance = 0.0;
   this->NumberOfCellsPerNode = 2;
-  this->tree0 = vtkOBBTree::New();
-  this->tree1 = vtkOBBTree::New();
+  this->tree0 = vtkCollisionOBBTree::New();
+  this->tree1 = vtkCollisionOBBTree::New();
+  this->Tree0NumberOfCellsPerNode = 0;
+  this->Tree1NumberOfCellsPerNode = 0;
+  this->NumberOfTreeBuilds = 0;
   this->GenerateScalars = 0;
   this->CollisionMode = VTK_ALL_CONTACTS;
   this->Opacity = 1.0;
+  this->CountContactsOnly = 0;
 }
 
 // Destroy any allocated memory.
@@ -247,11 +267,13 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
 {
   // This is hard-coded for triangles but could be easily changed to allow for allow n-sided polygons
   int numIdsA, numIdsB;
-  vtkIdList *IdsA, *IdsB, *pointIdsA, *pointIdsB;
+  vtkIdList *IdsA, *IdsB;
   vtkCellArray *cells;
   vtkIdType cellPtIds[2];
   vtkIdTypeArray *contactcells1, *contactcells2;
   vtkPoints *contactpoints;
+  vtkIdType npts;
+  vtkIdType *ptIdsA, *ptIdsB;
   IdsA  = nodeA->Cells;
   IdsB = nodeB->Cells;
   numIdsA = IdsA->GetNumberOfIds();
@@ -263,6 +285,7 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
   // Turn off debugging here if its on... otherwise there's squawks every update/box test
   int DebugWasOn = 0;
   int FirstContact = 0;
+  int CountOnly = self->GetCountContactsOnly();
   if (self->GetDebug())
     {
     self->DebugOff();
@@ -302,7 +325,8 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
   for (i = 0; i < numIdsA; i++) 
    {
     cellIdA = IdsA->GetId(i);
-    pointIdsA = inputA->GetCell(cellIdA)->GetPointIds();
+    // GetCellPoints does not instantiate a cell object like GetCell
+    inputA->GetCellPoints(cellIdA, npts, ptIdsA);
     inputA->GetCellBounds(cellIdA, boundsA);
 
     // Initialize ptsA
@@ -312,7 +336,7 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
       {
       for (k=0; k<3; k++)
         {
-        ptsA[j*3+k] = inputA->GetPoints()->GetPoint(pointIdsA->GetId(j))[k];
+        ptsA[j*3+k] = inputA->GetPoints()->GetPoint(ptIdsA[j])[k];
         }
       }
 
@@ -320,13 +344,12 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
     for (m = 0; m < numIdsB; m++)
       {
       cellIdB = IdsB->GetId(m);
-      pointIdsB = inputB->GetCell(cellIdB)->GetPointIds();
-      inputB->GetCellBounds(cellIdB, boundsB);
+      inputB->GetCellPoints(cellIdB, npts, ptIdsB);
       
       // Initialize ptsB
       for (n=0; n<3; n++)
         {
-        point = inputB->GetPoints()->GetPoint(pointIdsB->GetId(n));
+        point = inputB->GetPoints()->GetPoint(ptIdsB[n]);
         // transform the vertex
         in[0] = point[0]; in[1] = point[1]; in[2] = point[2]; in[3] = 1.0;
         Xform->MultiplyPoint( in, out );
@@ -358,6 +381,15 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
         {
         contactcells1->InsertNextValue(cellIdA);
         contactcells2->InsertNextValue(cellIdB);
+        if (CountOnly)
+          {
+          if (FirstContact)
+            {
+            if (DebugWasOn) self->DebugOn();
+            return (-1 - self->GetNumberOfBoxTests());
+            }
+          continue;
+          }
         //transform x back to "world space"
         // could speed this up by testing for identity matrix
         // and skipping the next transform.
@@ -399,6 +431,82 @@ static int ComputeCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4
   return 1;
 }
 
+// Description:
+// Collision counting state for ComputeNumberOfContacts. It is local to each call,
+// so the filter itself is only read during the search.
+struct vtkCollisionCountData
+{
+  vtkCollisionDetectionFilter *Self;
+  vtkPolyData *InputA;
+  vtkPolyData *InputB;
+  int CollisionMode;
+  int FirstContactOnly;
+  float Tolerance;
+  int NumberOfContacts;
+};
+
+static int CountCollisions(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkMatrix4x4 *Xform, void *clientdata)
+{
+  vtkCollisionCountData *data = reinterpret_cast<vtkCollisionCountData *>( clientdata );
+  vtkIdList *IdsA = nodeA->Cells;
+  vtkIdList *IdsB = nodeB->Cells;
+  vtkIdType numIdsA = IdsA->GetNumberOfIds();
+  vtkIdType numIdsB = IdsB->GetNumberOfIds();
+  vtkPoints *pointsA = data->InputA->GetPoints();
+  vtkPoints *pointsB = data->InputB->GetPoints();
+
+  vtkIdType npts;
+  vtkIdType *ptIdsA, *ptIdsB;
+  double x1[4], x2[4];
+  double ptsA[9], ptsB[9];
+  double boundsA[6], boundsB[6];
+  double in[4], out[4];
+
+  for (vtkIdType i = 0; i < numIdsA; i++)
+    {
+    vtkIdType cellIdA = IdsA->GetId(i);
+    data->InputA->GetCellPoints(cellIdA, npts, ptIdsA);
+    data->InputA->GetCellBounds(cellIdA, boundsA);
+    // the variant of GetPoint that copies into a caller buffer is thread-safe
+    for (int j=0; j<3; j++)
+      {
+      pointsA->GetPoint(ptIdsA[j], ptsA+3*j);
+      }
+
+    for (vtkIdType m = 0; m < numIdsB; m++)
+      {
+      vtkIdType cellIdB = IdsB->GetId(m);
+      data->InputB->GetCellPoints(cellIdB, npts, ptIdsB);
+      boundsB[0] = boundsB[2] = boundsB[4] = VTK_DOUBLE_MAX;
+      boundsB[1] = boundsB[3] = boundsB[5] = VTK_DOUBLE_MIN;
+      for (int n=0; n<3; n++)
+        {
+        pointsB->GetPoint(ptIdsB[n], in);
+        in[3] = 1.0;
+        Xform->MultiplyPoint( in, out );
+        for (int p=0; p<3; p++)
+          {
+          ptsB[n*3+p] = out[p]/out[3];
+          if (ptsB[n*3+p] < boundsB[2*p]) boundsB[2*p] = ptsB[n*3+p];
+          if (ptsB[n*3+p] > boundsB[2*p+1]) boundsB[2*p+1] = ptsB[n*3+p];
+          }
+        }
+
+      if (data->Self->IntersectPolygonWithPolygon(3, ptsA, boundsA, 3, ptsB, boundsB,
+        data->Tolerance, x1, x2, data->CollisionMode))
+        {
+        data->NumberOfContacts++;
+        if (data->FirstContactOnly)
+          {
+          // a negative return value stops the tree intersection
+          return -1;
+          }
+        }
+      }
+    }
+  return 1;
+}
+
 // Description:
 // Perform a collision detection
 int vtkCollisionDetectionFilter::RequestData(
@@ -425,10 +533,18 @@ int vtkCollisionDetectionFilter::RequestData(
     output[i] = vtkPolyData::SafeDownCast(
       outInfo->Get(vtkDataObject::DATA_OBJECT()));
 
-    output[i]->CopyStructure(input[i]);
-    output[i]->GetPointData()->PassData(input[i]->GetPointData());
-    output[i]->GetCellData()->PassData(input[i]->GetCellData());
-    output[i]->GetFieldData()->PassData(input[i]->GetFieldData());
+    if (this->CountContactsOnly || !input[i])
+      {
+      // only the contact cells array is needed
+      output[i]->Initialize();
+      }
+    else
+      {
+      output[i]->CopyStructure(input[i]);
+      output[i]->GetPointData()->PassData(input[i]->GetPointData());
+      output[i]->GetCellData()->PassData(input[i]->GetCellData());
+      output[i]->GetFieldData()->PassData(input[i]->GetFieldData());
+      }
     }
   
   // set up the contacts polydata output on port index 2
@@ -496,23 +612,9 @@ int vtkCollisionDetectionFilter::RequestData(
   this->InvokeEvent(vtkCommand::StartEvent, NULL);
   
 
-  // rebuild the obb trees... they do their own mtime checking with input data
-  tree0->SetDataSet(input[0]);
-  tree0->AutomaticOn();
-  tree0->SetNumberOfCellsPerNode(this->NumberOfCellsPerNode);
-  tree0->BuildLocator();
-
-  tree1->SetDataSet(input[1]);
-  tree1->AutomaticOn();
-  tree1->SetNumberOfCellsPerNode(this->NumberOfCellsPerNode);
-  tree1->BuildLocator();
-    
-  // Set the Box Tolerance
-  tree0->SetTolerance(this->BoxTolerance);
-  tree1->SetTolerance(this->BoxTolerance);
-
-
-
+  // rebuild the obb trees only if the input meshes have changed
+  this->UpdateTree(tree0, input[0], this->Tree0NumberOfCellsPerNode);
+  this->UpdateTree(tree1, input[1], this->Tree1NumberOfCellsPerNode);
 
   // Do the collision detection...
   int boxTests = 
@@ -525,7 +627,7 @@ int vtkCollisionDetectionFilter::RequestData(
   this->NumberOfBoxTests = std::abs(boxTests);
   
   // Generate the scalars if needed
-  if (GenerateScalars)
+  if (GenerateScalars && !this->CountContactsOnly)
     {
 
     for (int idx =0; idx < 2; idx++)
@@ -600,6 +702,315 @@ int vtkCollisionDetectionFilter::RequestData(
 
 }
 
+// Description:
+// Build the OBB trees of both inputs if needed
+void vtkCollisionDetectionFilter::UpdateTrees()
+{
+  vtkPolyData *input0 = this->GetInput(0);
+  vtkPolyData *input1 = this->GetInput(1);
+  if (!input0 || !input1)
+    {
+    vtkWarningMacro(<< "Set both inputs before updating the OBB trees");
+    return;
+    }
+  this->UpdateTree(tree0, input0, this->Tree0NumberOfCellsPerNode);
+  this->UpdateTree(tree1, input1, this->Tree1NumberOfCellsPerNode);
+}
+
+// Description:
+// Count contacts with the given matrices, using the prebuilt OBB trees
+int vtkCollisionDetectionFilter::ComputeNumberOfContacts(vtkMatrix4x4 *matrix0, vtkMatrix4x4 *matrix1, int firstContactOnly)
+{
+  vtkPolyData *input0 = vtkPolyData::SafeDownCast(this->tree0->GetDataSet());
+  vtkPolyData *input1 = vtkPolyData::SafeDownCast(this->tree1->GetDataSet());
+  if (!input0 || !input1 || !matrix0 || !matrix1)
+    {
+    return -1;
+    }
+
+  // transform from the frame of input 1 to the frame of input 0
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> invertedMatrix0 = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(matrix0, invertedMatrix0);
+  vtkMatrix4x4::Multiply4x4(invertedMatrix0, matrix1, matrix);
+
+  vtkCollisionCountData data;
+  data.Self = this;
+  data.InputA = input0;
+  data.InputB = input1;
+  data.CollisionMode = (firstContactOnly ? VTK_FIRST_CONTACT : this->CollisionMode);
+  data.FirstContactOnly = firstContactOnly;
+  data.Tolerance = this->CellTolerance;
+  data.NumberOfContacts = 0;
+  this->tree0->IntersectWithOBBTree(this->tree1, matrix, CountCollisions, &data);
+
+  return data.NumberOfContacts;
+}
+
+// Description:
+// Proximity search state for IsWithinDistance, local to each call like vtkCollisionCountData
+struct vtkCollisionProximityData
+{
+  vtkPolyData *InputA;
+  vtkPolyData *InputB;
+  vtkMatrix4x4 *Xform;
+  double Distance;
+};
+
+// Description:
+// Check a separating axis candidate. Returns 1 if the projections of the two sets to the
+// axis are farther apart than the distance, which proves the sets are at least that far.
+static int IsSeparatingAxis(const double rangeA[2], const double rangeB[2], double distance)
+{
+  return (rangeA[0] - rangeB[1] > distance || rangeB[0] - rangeA[1] > distance);
+}
+
+static void ProjectBox(const double corner[3], const double axes[3][3], const double axis[3], double range[2])
+{
+  range[0] = range[1] = vtkMath::Dot(corner, axis);
+  for (int i=0; i<3; i++)
+    {
+    double d = vtkMath::Dot(axes[i], axis);
+    if (d < 0.0)
+      {
+      range[0] += d;
+      }
+    else
+      {
+      range[1] += d;
+      }
+    }
+}
+
+static void ProjectTriangle(const double *pts, const double axis[3], double range[2])
+{
+  range[0] = range[1] = vtkMath::Dot(pts, axis);
+  for (int i=1; i<3; i++)
+    {
+    double d = vtkMath::Dot(pts+3*i, axis);
+    if (d < range[0]) range[0] = d;
+    if (d > range[1]) range[1] = d;
+    }
+}
+
+// Description:
+// Separating axis test with a margin for two oriented boxes given in the same frame.
+// The candidate axes are the 3+3 box axes and their 9 cross products.
+static int BoxesWithinDistance(const double cornerA[3], const double axesA[3][3],
+  const double cornerB[3], const double axesB[3][3], double distance)
+{
+  double axis[3], rangeA[2], rangeB[2];
+  for (int i=0; i<15; i++)
+    {
+    if (i < 3)
+      {
+      axis[0] = axesA[i][0]; axis[1] = axesA[i][1]; axis[2] = axesA[i][2];
+      }
+    else if (i < 6)
+      {
+      axis[0] = axesB[i-3][0]; axis[1] = axesB[i-3][1]; axis[2] = axesB[i-3][2];
+      }
+    else
+      {
+      vtkMath::Cross(axesA[(i-6)/3], axesB[(i-6)%3], axis);
+      }
+    if (vtkMath::Normalize(axis) == 0.0)
+      {
+      continue;
+      }
+    ProjectBox(cornerA, axesA, axis, rangeA);
+    ProjectBox(cornerB, axesB, axis, rangeB);
+    if (IsSeparatingAxis(rangeA, rangeB, distance))
+      {
+      return 0;
+      }
+    }
+  return 1;
+}
+
+// Description:
+// Separating axis test with a margin for two triangles given in the same frame.
+// The candidate axes are the two normals, the 9 cross products of the edges, and the in-plane
+// edge normals of both triangles (these separate coplanar triangles).
+static int TrianglesWithinDistance(const double ptsA[9], const double ptsB[9], double distance)
+{
+  double edgesA[3][3], edgesB[3][3], normalA[3], normalB[3];
+  for (int i=0; i<3; i++)
+    {
+    for (int j=0; j<3; j++)
+      {
+      edgesA[i][j] = ptsA[3*((i+1)%3)+j] - ptsA[3*i+j];
+      edgesB[i][j] = ptsB[3*((i+1)%3)+j] - ptsB[3*i+j];
+      }
+    }
+  vtkMath::Cross(edgesA[0], edgesA[1], normalA);
+  vtkMath::Cross(edgesB[0], edgesB[1], normalB);
+
+  double axis[3], rangeA[2], rangeB[2];
+  for (int i=0; i<17; i++)
+    {
+    if (i == 0)
+      {
+      axis[0] = normalA[0]; axis[1] = normalA[1]; axis[2] = normalA[2];
+      }
+    else if (i == 1)
+      {
+      axis[0] = normalB[0]; axis[1] = normalB[1]; axis[2] = normalB[2];
+      }
+    else if (i < 11)
+      {
+      vtkMath::Cross(edgesA[(i-2)/3], edgesB[(i-2)%3], axis);
+      }
+    else if (i < 14)
+      {
+      vtkMath::Cross(normalA, edgesA[i-11], axis);
+      }
+    else
+      {
+      vtkMath::Cross(normalB, edgesB[i-14], axis);
+      }
+    if (vtkMath::Normalize(axis) == 0.0)
+      {
+      continue;
+      }
+    ProjectTriangle(ptsA, axis, rangeA);
+    ProjectTriangle(ptsB, axis, rangeB);
+    if (IsSeparatingAxis(rangeA, rangeB, distance))
+      {
+      return 0;
+      }
+    }
+  return 1;
+}
+
+// Description:
+// Recursive proximity test of two OBB subtrees. The box of node B is transformed to the frame of A.
+static int NodesWithinDistance(vtkOBBNode *nodeA, vtkOBBNode *nodeB, vtkCollisionProximityData *data)
+{
+  double cornerB[3], axesB[3][3], in[4], out[4];
+  in[0] = nodeB->Corner[0]; in[1] = nodeB->Corner[1]; in[2] = nodeB->Corner[2]; in[3] = 1.0;
+  data->Xform->MultiplyPoint(in, out);
+  cornerB[0] = out[0]/out[3]; cornerB[1] = out[1]/out[3]; cornerB[2] = out[2]/out[3];
+  for (int i=0; i<3; i++)
+    {
+    in[0] = nodeB->Axes[i][0]; in[1] = nodeB->Axes[i][1]; in[2] = nodeB->Axes[i][2]; in[3] = 0.0;
+    data->Xform->MultiplyPoint(in, out);
+    axesB[i][0] = out[0]; axesB[i][1] = out[1]; axesB[i][2] = out[2];
+    }
+  if (!BoxesWithinDistance(nodeA->Corner, nodeA->Axes, cornerB, axesB, data->Distance))
+    {
+    return 0;
+    }
+
+  if (nodeA->Kids || nodeB->Kids)
+    {
+    // descend into the larger box first, to tighten the bounds as fast as possible
+    double sizeA = vtkMath::Dot(nodeA->Axes[0], nodeA->Axes[0]) + vtkMath::Dot(nodeA->Axes[1], nodeA->Axes[1])
+      + vtkMath::Dot(nodeA->Axes[2], nodeA->Axes[2]);
+    double sizeB = vtkMath::Dot(nodeB->Axes[0], nodeB->Axes[0]) + vtkMath::Dot(nodeB->Axes[1], nodeB->Axes[1])
+      + vtkMath::Dot(nodeB->Axes[2], nodeB->Axes[2]);
+    if (nodeA->Kids && (!nodeB->Kids || sizeA >= sizeB))
+      {
+      return NodesWithinDistance(nodeA->Kids[0], nodeB, data)
+        || NodesWithinDistance(nodeA->Kids[1], nodeB, data);
+      }
+    return NodesWithinDistance(nodeA, nodeB->Kids[0], data)
+      || NodesWithinDistance(nodeA, nodeB->Kids[1], data);
+    }
+
+  // leaves: test the triangles
+  vtkPoints *pointsA = data->InputA->GetPoints();
+  vtkPoints *pointsB = data->InputB->GetPoints();
+  vtkIdType npts;
+  vtkIdType *ptIdsA, *ptIdsB;
+  double ptsA[9], ptsB[9];
+  for (vtkIdType i = 0; i < nodeA->Cells->GetNumberOfIds(); i++)
+    {
+    data->InputA->GetCellPoints(nodeA->Cells->GetId(i), npts, ptIdsA);
+    if (npts != 3)
+      {
+      continue;
+      }
+    for (int j=0; j<3; j++)
+      {
+      pointsA->GetPoint(ptIdsA[j], ptsA+3*j);
+      }
+    for (vtkIdType m = 0; m < nodeB->Cells->GetNumberOfIds(); m++)
+      {
+      data->InputB->GetCellPoints(nodeB->Cells->GetId(m), npts, ptIdsB);
+      if (npts != 3)
+        {
+        continue;
+        }
+      for (int n=0; n<3; n++)
+        {
+        pointsB->GetPoint(ptIdsB[n], in);
+        in[3] = 1.0;
+        data->Xform->MultiplyPoint(in, out);
+        ptsB[3*n] = out[0]/out[3]; ptsB[3*n+1] = out[1]/out[3]; ptsB[3*n+2] = out[2]/out[3];
+        }
+      if (TrianglesWithinDistance(ptsA, ptsB, data->Distance))
+        {
+        return 1;
+        }
+      }
+    }
+  return 0;
+}
+
+// Description:
+// Conservative proximity test with the given matrices, using the prebuilt OBB trees
+int vtkCollisionDetectionFilter::IsWithinDistance(vtkMatrix4x4 *matrix0, vtkMatrix4x4 *matrix1, double distance)
+{
+  vtkPolyData *input0 = vtkPolyData::SafeDownCast(this->tree0->GetDataSet());
+  vtkPolyData *input1 = vtkPolyData::SafeDownCast(this->tree1->GetDataSet());
+  vtkOBBNode *root0 = static_cast<vtkCollisionOBBTree *>(this->tree0)->GetRoot();
+  vtkOBBNode *root1 = static_cast<vtkCollisionOBBTree *>(this->tree1)->GetRoot();
+  if (!input0 || !input1 || !root0 || !root1 || !matrix0 || !matrix1)
+    {
+    return -1;
+    }
+
+  // transform from the frame of input 1 to the frame of input 0
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> invertedMatrix0 = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(matrix0, invertedMatrix0);
+  vtkMatrix4x4::Multiply4x4(invertedMatrix0, matrix1, matrix);
+
+  vtkCollisionProximityData data;
+  data.InputA = input0;
+  data.InputB = input1;
+  data.Xform = matrix;
+  data.Distance = distance;
+  return NodesWithinDistance(root0, root1, &data);
+}
+
+// Description:
+// Build the OBB tree of an input. The tree is kept as long as the input mesh is the same object
+// and has not been modified, so transform-only updates do not need to process the mesh.
+void vtkCollisionDetectionFilter::UpdateTree(vtkOBBTree *tree, vtkPolyData *input, int &treeNumberOfCellsPerNode)
+{
+  // The box tolerance is only used when intersecting the trees, it does not
+  // invalidate the tree structure
+  tree->SetTolerance(this->BoxTolerance);
+
+  if (tree->GetDataSet() == input
+    && tree->GetBuildTime() > input->GetMTime()
+    && treeNumberOfCellsPerNode == this->NumberOfCellsPerNode)
+    {
+    return;
+    }
+
+  vtkDebugMacro(<< "Building OBB tree for input " << input);
+  tree->FreeSearchStructure();
+  tree->SetDataSet(input);
+  tree->AutomaticOn();
+  tree->SetNumberOfCellsPerNode(this->NumberOfCellsPerNode);
+  tree->BuildLocator();
+  treeNumberOfCellsPerNode = this->NumberOfCellsPerNode;
+  this->NumberOfTreeBuilds++;
+}
+
 // Method intersects two polygons. You must supply the number of points and
 // point coordinates (npts, *pts) and the bounding box (bounds) of the two
 // polygons. Also supply a tolerance squared for controlling
@@ -784,5 +1195,7 @@ void vtkCollisionDetectionFilter::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "Box Tolerance: " << this->BoxTolerance << "\n";
   os << indent << "Cell Tolerance: " << this->CellTolerance << "\n";
   os << indent << "Number of cells per Node: " << this->NumberOfCellsPerNode << "\n";
+  os << indent << "Count contacts only: " << this->CountContactsOnly << "\n";
+  os << indent << "Number of tree builds: " << this->NumberOfTreeBuilds << "\n";
 
 }
@@ -21,6 +21,10 @@
 //
 // This class can be used to clip one polydata surface with another, using the Contacts output as a loop
 // set in vtkSelectPolyData
+//
+// The OBB trees are only rebuilt when an input mesh is replaced or modified, so updates where only
+// the transforms or matrices have changed are proportional to the number of overlapping boxes.
+// If only the number of contacts is needed, set CountContactsOnly to skip generating the outputs.
 
 // .SECTION Caveats
 // Currently only triangles are processed. Use vtkTriangleFilter to
@@ -145,10 +149,45 @@ public:
   vtkGetMacro(GenerateScalars, int);
   vtkBooleanMacro(GenerateScalars,int);
   
+  //Description:
+  // Set and Get the flag to only determine the contacting cells. If set, the input meshes are not
+  // copied to outputs 0 and 1 (they only contain the "ContactCells" field array), the Contacts
+  // output is left empty, and no scalars are generated. Default is 0
+  vtkSetMacro(CountContactsOnly, int);
+  vtkGetMacro(CountContactsOnly, int);
+  vtkBooleanMacro(CountContactsOnly, int);
+
   //Description:
   // Get the number of contacting cell pairs
   int GetNumberOfContacts() 
     { return this->GetOutput(0)->GetFieldData()->GetArray("ContactCells")->GetNumberOfTuples(); }
+
+  //Description:
+  // Build the OBB trees of the inputs unless they are up to date. This is done automatically
+  // when the filter is updated, it only needs to be called before ComputeNumberOfContacts.
+  void UpdateTrees();
+
+  //Description:
+  // Count the contacting cell pairs for the given model to world matrices of the two inputs,
+  // without executing the filter or touching its outputs. If firstContactOnly is set then the
+  // search stops at the first contact, so the result is 0 or 1. The OBB trees must be up to
+  // date (see UpdateTrees). As the filter is not modified, this method can be called from
+  // multiple threads at the same time. Returns -1 if the trees have not been built.
+  int ComputeNumberOfContacts(vtkMatrix4x4 *matrix0, vtkMatrix4x4 *matrix1, int firstContactOnly);
+
+  //Description:
+  // Conservative proximity test for the given model to world matrices of the two inputs. Returns 0
+  // if the surfaces are certainly farther apart than distance, and 1 if they may be closer (always
+  // 1 if they intersect). Boxes and triangles are compared with separating axis tests, where a gap
+  // along any axis is a lower bound of the distance, so the test never misses a pair that is close
+  // enough, and becomes exact as the distance goes to zero. The OBB trees must be up to date (see
+  // UpdateTrees). Thread-safe like ComputeNumberOfContacts. Returns -1 if the trees have not been built.
+  int IsWithinDistance(vtkMatrix4x4 *matrix0, vtkMatrix4x4 *matrix1, double distance);
+
+  //Description:
+  // Get the number of times the OBB trees have been built since the filter was created.
+  // The trees are only rebuilt when an input mesh or the number of cells per node changes.
+  vtkGetMacro(NumberOfTreeBuilds, int);
   
   //Description:
   // Get the number of box tests
@@ -175,10 +214,18 @@ protected:
 
   // Usual data generation method
   virtual int RequestData(vtkInformation *, vtkInformationVector **, vtkInformationVector *);
+
+  // Build the OBB tree of an input unless it has been built for the same mesh already
+  void UpdateTree(vtkOBBTree *tree, vtkPolyData *input, int &treeNumberOfCellsPerNode);
   
   vtkOBBTree *tree0;
   vtkOBBTree *tree1;
 
+  // Number of cells per node the trees have been built with
+  int Tree0NumberOfCellsPerNode;
+  int Tree1NumberOfCellsPerNode;
+  int NumberOfTreeBuilds;
+
   vtkLinearTransform *Transform[2];
   vtkMatrix4x4 *Matrix[2];
   
@@ -194,6 +241,8 @@ protected:
   
   int CollisionMode;
 
+  int CountContactsOnly;
+
 private:  
 
   vtkCollisionDetectionFilter(const vtkCollisionDetectionFilter&);  // Not implemented.
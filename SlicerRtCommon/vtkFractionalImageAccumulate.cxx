@@ -21,6 +21,7 @@
 ==============================================================================*/
 
 #include "vtkFractionalImageAccumulate.h"
+#include "vtkFractionalImageAccumulateKernels.h"
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -31,6 +32,15 @@
 #include <vtkFieldData.h>
 #include <vtkMath.h>
 
+// STD includes
+#include <algorithm>
+#include <cstring>
+
+// CPU detection includes
+#if defined(SLICERRT_USE_SIMD_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 vtkStandardNewMacro(vtkFractionalImageAccumulate);
 
 //----------------------------------------------------------------------------
@@ -38,6 +48,7 @@ vtkFractionalImageAccumulate::vtkFractionalImageAccumulate()
 {
   this->MinimumFractionalValue = 0;
   this->MaximumFractionalValue = 1.0;
+  this->UseVectorizedKernels = true;
 }
 
 //----------------------------------------------------------------------------
@@ -96,8 +107,104 @@ int vtkFractionalImageAccumulateExecute(vtkFractionalImageAccumulate *self,
     return 1;
 }
 
+//----------------------------------------------------------------------------
+// Most advanced instruction set of the vectorized span kernels that the processor (and for AVX2 the
+// operating system) supports. Scalar if the kernels are not built.
+static int vtkFractionalImageAccumulateDetectInstructionSet()
+{
+#if defined(SLICERRT_USE_SIMD_KERNELS)
+#if defined(_MSC_VER)
+  int cpuInfo[4] = {0, 0, 0, 0};
+  __cpuid(cpuInfo, 0);
+  int maximumFunctionId = cpuInfo[0];
+  if (maximumFunctionId < 1)
+  {
+    return vtkFractionalImageAccumulateScalar;
+  }
+  __cpuid(cpuInfo, 1);
+  bool sse41 = ((cpuInfo[2] & (1 << 19)) != 0);
+  bool osxsave = ((cpuInfo[2] & (1 << 27)) != 0);
+  bool avx = ((cpuInfo[2] & (1 << 28)) != 0);
+  bool avx2 = false;
+  // AVX registers must be saved by the operating system (XMM and YMM state enabled in XCR0)
+  if (osxsave && avx && maximumFunctionId >= 7 && (_xgetbv(0) & 0x6) == 0x6)
+  {
+    __cpuidex(cpuInfo, 7, 0);
+    avx2 = ((cpuInfo[1] & (1 << 5)) != 0);
+  }
+#else
+  __builtin_cpu_init();
+  bool sse41 = (__builtin_cpu_supports("sse4.1") != 0);
+  bool avx2 = (__builtin_cpu_supports("avx2") != 0);
+#endif
+  if (avx2)
+  {
+    return vtkFractionalImageAccumulateAVX2;
+  }
+  if (sse41)
+  {
+    return vtkFractionalImageAccumulateSSE4;
+  }
+#endif
+  return vtkFractionalImageAccumulateScalar;
+}
+
+//----------------------------------------------------------------------------
+static int vtkFractionalImageAccumulateGetInstructionSet()
+{
+  static int instructionSet = vtkFractionalImageAccumulateDetectInstructionSet();
+  return instructionSet;
+}
+
+//----------------------------------------------------------------------------
+// Accumulate one span of a single-component image
+template <class BaseImageScalarType, class FractionalImageScalarType>
+void vtkFractionalImageAccumulateSpan(const BaseImageScalarType* inPtr, const FractionalImageScalarType* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanScalar(inPtr, fractionalPtr, spanLength, params, acc);
+}
+
+#if defined(SLICERRT_USE_SIMD_KERNELS)
+//----------------------------------------------------------------------------
+// Overloads dispatching to the vectorized kernels for float dose with char/unsigned char fractional labelmap
+template <class FractionalImageScalarType>
+void vtkFractionalImageAccumulateSpanDispatch(const float* inPtr, const FractionalImageScalarType* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  switch (params.InstructionSet)
+  {
+  case vtkFractionalImageAccumulateAVX2:
+    vtkFractionalImageAccumulateSpanAVX2(inPtr, fractionalPtr, spanLength, params, acc);
+    break;
+  case vtkFractionalImageAccumulateSSE4:
+    vtkFractionalImageAccumulateSpanSSE4(inPtr, fractionalPtr, spanLength, params, acc);
+    break;
+  default:
+    vtkFractionalImageAccumulateSpanScalar(inPtr, fractionalPtr, spanLength, params, acc);
+    break;
+  }
+}
+inline void vtkFractionalImageAccumulateSpan(const float* inPtr, const unsigned char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanDispatch(inPtr, fractionalPtr, spanLength, params, acc);
+}
+inline void vtkFractionalImageAccumulateSpan(const float* inPtr, const char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanDispatch(inPtr, fractionalPtr, spanLength, params, acc);
+}
+#endif
+
 //----------------------------------------------------------------------------
 // This templated function executes the filter for any type of data.
+// Single-component images (the dose volume in case of DVH) are processed span by span using the
+// span kernels. Precomputed reciprocals are used for normalizing the fractional values and
+// finding the bins, so compared to dividing per voxel:
+// - the fractional values and the statistics have a relative difference in the order of 1e-15
+//   (vectorized kernels add the sums in a different order, this keeps the difference below 1e-12 for any image size)
+// - a voxel with a value closer than about 1e-15 relative to a bin boundary may be counted in the neighboring bin
 template <class BaseImageScalarType, class FractionalImageScalarType>
 int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
                               BaseImageScalarType* vtkNotUsed(baseTypePtr),
@@ -143,6 +250,11 @@ int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
   outData->GetOrigin(origin);
   double spacing[3];
   outData->GetSpacing(spacing);
+  double inverseSpacing[3];
+  for (int idxC = 0; idxC < 3; ++idxC)
+    {
+    inverseSpacing[idxC] = 1.0 / spacing[idxC];
+    }
 
   // zero count in every bin
   vtkIdType size = 1;
@@ -158,80 +270,124 @@ int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
   bool reverseStencil = (self->GetReverseStencil() != 0);
   bool ignoreZero = (self->GetIgnoreZero() != 0);
 
+  // Constants of the fractional normalization, so that they are not queried and computed for every voxel
+  bool useFractionalLabelmap = self->GetUseFractionalLabelmap();
+  double minimumFractionalValue = self->GetMinimumFractionalValue();
+  double fractionalScale = 1.0 / (self->GetMaximumFractionalValue() - self->GetMinimumFractionalValue());
+
   vtkImageStencilIterator<BaseImageScalarType> inIter(inData, stencil, updateExtent, self);
 
   vtkImageData* fractionalLabelmap = self->GetFractionalLabelmap();
   vtkImageStencilIterator<FractionalImageScalarType> fractionalIter(fractionalLabelmap, stencil, updateExtent, self);
 
-  while (!inIter.IsAtEnd())
+  // Single component: process whole spans with the span kernel
+  if (numC == 1)
     {
-    if (inIter.IsInStencil() ^ reverseStencil)
+    vtkFractionalImageAccumulateSpanParameters params;
+    params.UseFractionalLabelmap = useFractionalLabelmap;
+    params.IgnoreZero = ignoreZero;
+    params.MinimumFractionalValue = minimumFractionalValue;
+    params.FractionalScale = fractionalScale;
+    params.BinOrigin = origin[0];
+    params.InverseBinSpacing = inverseSpacing[0];
+    params.BinExtentMin = outExtent[0];
+    params.BinExtentMax = outExtent[1];
+    params.Histogram = outPtr;
+    params.InstructionSet = (self->GetUseVectorizedKernels() ? vtkFractionalImageAccumulateGetInstructionSet() : (int)vtkFractionalImageAccumulateScalar);
+
+    vtkFractionalImageAccumulateSpanAccumulator acc;
+    while (!inIter.IsAtEnd())
       {
-      BaseImageScalarType *inPtr = inIter.BeginSpan();
-      BaseImageScalarType *spanEndPtr = inIter.EndSpan();
-
-      FractionalImageScalarType* fractionalPtr = (FractionalImageScalarType*)fractionalIter.BeginSpan();
+      if (inIter.IsInStencil() ^ reverseStencil)
+        {
+        BaseImageScalarType *inPtr = inIter.BeginSpan();
+        BaseImageScalarType *spanEndPtr = inIter.EndSpan();
+        FractionalImageScalarType* fractionalPtr = (FractionalImageScalarType*)fractionalIter.BeginSpan();
+        vtkFractionalImageAccumulateSpan(inPtr, fractionalPtr, static_cast<int>(spanEndPtr - inPtr), params, acc);
+        }
+      fractionalIter.NextSpan();
+      inIter.NextSpan();
+      }
 
-      while (inPtr != spanEndPtr)
+    sum[0] = acc.Sum;
+    sumSqr[0] = acc.SumSqr;
+    min[0] = acc.Min;
+    max[0] = acc.Max;
+    *voxelCount = acc.VoxelCount;
+    *fractionalVoxelCount = acc.FractionalVoxelCount;
+    }
+  else
+    {
+    while (!inIter.IsAtEnd())
+      {
+      if (inIter.IsInStencil() ^ reverseStencil)
         {
-        // find the bin for this pixel.
-        bool outOfBounds = false;
-        double *outPtrC = outPtr;
-        double total  = 0.0;
+        BaseImageScalarType *inPtr = inIter.BeginSpan();
+        BaseImageScalarType *spanEndPtr = inIter.EndSpan();
+
+        FractionalImageScalarType* fractionalPtr = (FractionalImageScalarType*)fractionalIter.BeginSpan();
 
-        for (int idxC = 0; idxC < numC; ++idxC)
+        while (inPtr != spanEndPtr)
           {
+          // find the bin for this pixel.
+          bool outOfBounds = false;
+          double *outPtrC = outPtr;
+          double total  = 0.0;
 
-          double v = static_cast<double>(*inPtr++);
-          double f = 1.0;
+          for (int idxC = 0; idxC < numC; ++idxC)
+            {
 
-          if (self->GetUseFractionalLabelmap())
-          {
-            f = ( (*fractionalPtr++) - self->GetMinimumFractionalValue() ) / (self->GetMaximumFractionalValue() - self->GetMinimumFractionalValue());
-          }
+            double v = static_cast<double>(*inPtr++);
+            double f = 1.0;
 
-          if (!ignoreZero || v != 0)
+            if (useFractionalLabelmap)
             {
-            // gather statistics
-            sum[idxC] += v*f;
-            sumSqr[idxC] += v*v*f*f;
-            if (v > max[idxC])
+              f = ( (*fractionalPtr++) - minimumFractionalValue ) * fractionalScale;
+            }
+
+            if (!ignoreZero || v != 0)
               {
-              max[idxC] = v;
+              // gather statistics
+              sum[idxC] += v*f;
+              sumSqr[idxC] += v*v*f*f;
+              if (v > max[idxC])
+                {
+                max[idxC] = v;
+                }
+              if (v < min[idxC])
+                {
+                min[idxC] = v;
+                }
+              (*voxelCount)++;
+              (*fractionalVoxelCount)+=f;
+              total+=f;
               }
-            if (v < min[idxC])
+
+            // compute the index
+            int outIdx = vtkMath::Floor((v - origin[idxC]) * inverseSpacing[idxC]);
+
+            // verify that it is in range
+            if (outIdx >= outExtent[idxC*2] && outIdx <= outExtent[idxC*2+1])
               {
-              min[idxC] = v;
+              outPtrC += (outIdx - outExtent[idxC*2]) * outIncs[idxC];
+              }
+            else
+              {
+                outOfBounds = true;
               }
-            (*voxelCount)++;
-            (*fractionalVoxelCount)+=f;
-            total+=f;
-            }
-
-          // compute the index
-          int outIdx = vtkMath::Floor((v - origin[idxC]) / spacing[idxC]);
 
-          // verify that it is in range
-          if (outIdx >= outExtent[idxC*2] && outIdx <= outExtent[idxC*2+1])
-            {
-            outPtrC += (outIdx - outExtent[idxC*2]) * outIncs[idxC];
             }
-          else
+
+          // increment the bin
+          if (!outOfBounds)
             {
-              outOfBounds = true;
+              (*outPtrC) += total;
             }
-
-          }
-
-        // increment the bin
-        if (!outOfBounds)
-          {
-            (*outPtrC) += total;
           }
         }
+      fractionalIter.NextSpan();
+      inIter.NextSpan();
       }
-    fractionalIter.NextSpan();
-    inIter.NextSpan();
     }
 
   // initialize the statistics
@@ -325,8 +481,23 @@ int vtkFractionalImageAccumulate::RequestData(
   return 1;
 }
 
+//----------------------------------------------------------------------------
+const char* vtkFractionalImageAccumulate::GetVectorizedKernelInstructionSet()
+{
+  switch (vtkFractionalImageAccumulateGetInstructionSet())
+  {
+  case vtkFractionalImageAccumulateAVX2:
+    return "AVX2";
+  case vtkFractionalImageAccumulateSSE4:
+    return "SSE4";
+  default:
+    return "None";
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkFractionalImageAccumulate::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
+  os << indent << "UseVectorizedKernels: " << (this->UseVectorizedKernels ? "true" : "false") << "\n";
 }
\ No newline at end of file
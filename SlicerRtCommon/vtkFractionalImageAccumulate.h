@@ -45,6 +45,16 @@ public:
   vtkSetMacro(UseFractionalLabelmap, bool);
   vtkGetMacro(UseFractionalLabelmap, bool);
   vtkBooleanMacro(UseFractionalLabelmap, bool);
+
+  /// Set flag determining whether the vectorized (SSE4.1 or AVX2) kernels are used for float images with
+  /// char or unsigned char fractional labelmap, if the processor supports them. On by default.
+  /// The statistics differ from those of the scalar kernel only in the order of additions.
+  vtkSetMacro(UseVectorizedKernels, bool);
+  vtkGetMacro(UseVectorizedKernels, bool);
+  vtkBooleanMacro(UseVectorizedKernels, bool);
+
+  /// Get instruction set of the vectorized kernels selected for this processor ("AVX2", "SSE4" or "None")
+  static const char* GetVectorizedKernelInstructionSet();
     
 protected:
   vtkFractionalImageAccumulate();
@@ -64,6 +74,7 @@ protected:
   vtkImageData* FractionalLabelmap;
   double FractionalVoxelCount;
   bool UseFractionalLabelmap;
+  bool UseVectorizedKernels;
 
 private:
   vtkFractionalImageAccumulate(const vtkFractionalImageAccumulate&);  // Not implemented.
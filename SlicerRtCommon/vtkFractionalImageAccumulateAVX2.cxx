@@ -0,0 +1,137 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// AVX2 span kernels of vtkFractionalImageAccumulate. Compiled with AVX2 enabled, only called
+// if the processor and the operating system support it.
+
+#include "vtkFractionalImageAccumulateKernels.h"
+
+// STD includes
+#include <cstring>
+
+// SIMD includes
+#include <immintrin.h>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  inline __m128i vtkFractionalImageAccumulateLoadFractions(const unsigned char* p)
+  {
+    int packed = 0;
+    memcpy(&packed, p, 4);
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+  }
+  inline __m128i vtkFractionalImageAccumulateLoadFractions(const char* p)
+  {
+    int packed = 0;
+    memcpy(&packed, p, 4);
+    return _mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed));
+  }
+
+  //----------------------------------------------------------------------------
+  // AVX2 kernel: 4 voxels per iteration
+  template <class FractionalImageScalarType>
+  void vtkFractionalImageAccumulateSpanAVX2Impl(const float* inPtr, const FractionalImageScalarType* fractionalPtr, int spanLength,
+    const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+  {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d allLanes = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+    const __m256d minimumFractionalValue = _mm256_set1_pd(params.MinimumFractionalValue);
+    const __m256d fractionalScale = _mm256_set1_pd(params.FractionalScale);
+    const __m256d binOrigin = _mm256_set1_pd(params.BinOrigin);
+    const __m256d inverseBinSpacing = _mm256_set1_pd(params.InverseBinSpacing);
+    const __m256d minSentinel = _mm256_set1_pd(VTK_DOUBLE_MAX);
+    const __m256d maxSentinel = _mm256_set1_pd(VTK_DOUBLE_MIN);
+
+    __m256d sum = zero;
+    __m256d sumSqr = zero;
+    __m256d fractionSum = zero;
+    __m256d minimum = minSentinel;
+    __m256d maximum = maxSentinel;
+    vtkIdType voxelCount = 0;
+
+    double fractions[4];
+    int bins[4];
+    int i = 0;
+    for (; i+4 <= spanLength; i += 4)
+    {
+      __m256d v = _mm256_cvtps_pd(_mm_loadu_ps(inPtr + i));
+      __m256d f = one;
+      if (params.UseFractionalLabelmap)
+      {
+        f = _mm256_mul_pd(_mm256_sub_pd(_mm256_cvtepi32_pd(vtkFractionalImageAccumulateLoadFractions(fractionalPtr + i)), minimumFractionalValue), fractionalScale);
+      }
+      __m256d mask = (params.IgnoreZero ? _mm256_cmp_pd(v, zero, _CMP_NEQ_UQ) : allLanes);
+      f = _mm256_and_pd(f, mask);
+
+      __m256d vf = _mm256_mul_pd(v, f);
+      sum = _mm256_add_pd(sum, vf);
+      sumSqr = _mm256_add_pd(sumSqr, _mm256_mul_pd(vf, vf));
+      fractionSum = _mm256_add_pd(fractionSum, f);
+      // Operand order makes NaN values ignored, same as in the scalar comparisons
+      minimum = _mm256_min_pd(_mm256_blendv_pd(minSentinel, v, mask), minimum);
+      maximum = _mm256_max_pd(_mm256_blendv_pd(maxSentinel, v, mask), maximum);
+      voxelCount += vtkFractionalImageAccumulateCountBits(_mm256_movemask_pd(mask));
+
+      // Out of range values (including NaN) are converted to INT_MIN, which is outside the bin extent
+      __m256d binIndex = _mm256_floor_pd(_mm256_mul_pd(_mm256_sub_pd(v, binOrigin), inverseBinSpacing));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bins), _mm256_cvtpd_epi32(binIndex));
+      _mm256_storeu_pd(fractions, f);
+      vtkFractionalImageAccumulateScatter(bins, fractions, 4, params);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    acc.Sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, sumSqr);
+    acc.SumSqr += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, fractionSum);
+    acc.FractionalVoxelCount += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, minimum);
+    for (int k=0; k<4; ++k)
+    {
+      acc.Min = (lanes[k] < acc.Min ? lanes[k] : acc.Min);
+    }
+    _mm256_storeu_pd(lanes, maximum);
+    for (int k=0; k<4; ++k)
+    {
+      acc.Max = (lanes[k] > acc.Max ? lanes[k] : acc.Max);
+    }
+    acc.VoxelCount += voxelCount;
+
+    // Remaining voxels
+    vtkFractionalImageAccumulateSpanScalar<float, FractionalImageScalarType>(inPtr + i, fractionalPtr + i, spanLength - i, params, acc);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkFractionalImageAccumulateSpanAVX2(const float* inPtr, const unsigned char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanAVX2Impl(inPtr, fractionalPtr, spanLength, params, acc);
+}
+
+//----------------------------------------------------------------------------
+void vtkFractionalImageAccumulateSpanAVX2(const float* inPtr, const char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanAVX2Impl(inPtr, fractionalPtr, spanLength, params, acc);
+}
@@ -0,0 +1,171 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Span kernels of vtkFractionalImageAccumulate. Internal header, only included by the
+// vtkFractionalImageAccumulate implementation files.
+//
+// The vectorized kernels are compiled in separate files with instruction set specific flags, and selected
+// at runtime according to the processor. All the functions shared by these files are in an anonymous
+// namespace, so that the linker cannot replace the code compiled for the generic processor by the copy
+// compiled with SSE4.1 or AVX2 instructions (or the other way around).
+
+#ifndef __vtkFractionalImageAccumulateKernels_h
+#define __vtkFractionalImageAccumulateKernels_h
+
+// VTK includes
+#include <vtkType.h>
+
+/// Instruction sets of the span kernels
+enum vtkFractionalImageAccumulateInstructionSet
+{
+  vtkFractionalImageAccumulateScalar = 0,
+  vtkFractionalImageAccumulateSSE4,
+  vtkFractionalImageAccumulateAVX2
+};
+
+//----------------------------------------------------------------------------
+// Constants used by the span kernels, computed once per execution instead of per voxel
+struct vtkFractionalImageAccumulateSpanParameters
+{
+  bool UseFractionalLabelmap;
+  bool IgnoreZero;
+  double MinimumFractionalValue;
+  /// Reciprocal of the fractional value range (1/(max-min))
+  double FractionalScale;
+  double BinOrigin;
+  /// Reciprocal of the bin width
+  double InverseBinSpacing;
+  int BinExtentMin;
+  int BinExtentMax;
+  /// Histogram pointer at bin BinExtentMin
+  double* Histogram;
+  /// Instruction set of the kernel used for float dose with char/unsigned char fractional labelmap
+  int InstructionSet;
+};
+
+//----------------------------------------------------------------------------
+// Statistics accumulated by the span kernels (single component)
+struct vtkFractionalImageAccumulateSpanAccumulator
+{
+  vtkFractionalImageAccumulateSpanAccumulator()
+    : Sum(0.0), SumSqr(0.0), Min(VTK_DOUBLE_MAX), Max(VTK_DOUBLE_MIN), VoxelCount(0), FractionalVoxelCount(0.0)
+  {
+  }
+  double Sum;
+  double SumSqr;
+  double Min;
+  double Max;
+  vtkIdType VoxelCount;
+  double FractionalVoxelCount;
+};
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Same as vtkMath::Floor (which cannot be used here, see the note at the top of the file)
+  inline int vtkFractionalImageAccumulateFloor(double x)
+  {
+    int i = static_cast<int>(x);
+    return i - (i > x);
+  }
+
+  //----------------------------------------------------------------------------
+  // Accumulate one span of a single-component image (scalar implementation for any type)
+  template <class BaseImageScalarType, class FractionalImageScalarType>
+  void vtkFractionalImageAccumulateSpanScalar(const BaseImageScalarType* inPtr, const FractionalImageScalarType* fractionalPtr, int spanLength,
+    const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+  {
+    for (int i=0; i<spanLength; ++i)
+    {
+      double v = static_cast<double>(inPtr[i]);
+      if (params.IgnoreZero && v == 0)
+      {
+        continue;
+      }
+      double f = 1.0;
+      if (params.UseFractionalLabelmap)
+      {
+        f = (static_cast<double>(fractionalPtr[i]) - params.MinimumFractionalValue) * params.FractionalScale;
+      }
+
+      // gather statistics
+      acc.Sum += v*f;
+      acc.SumSqr += v*v*f*f;
+      if (v > acc.Max)
+      {
+        acc.Max = v;
+      }
+      if (v < acc.Min)
+      {
+        acc.Min = v;
+      }
+      ++acc.VoxelCount;
+      acc.FractionalVoxelCount += f;
+
+      // increment the bin
+      int outIdx = vtkFractionalImageAccumulateFloor((v - params.BinOrigin) * params.InverseBinSpacing);
+      if (outIdx >= params.BinExtentMin && outIdx <= params.BinExtentMax)
+      {
+        params.Histogram[outIdx - params.BinExtentMin] += f;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  inline int vtkFractionalImageAccumulateCountBits(int mask)
+  {
+    int count = 0;
+    for (; mask; mask >>= 1)
+    {
+      count += (mask & 1);
+    }
+    return count;
+  }
+
+  //----------------------------------------------------------------------------
+  // Add the fractions of vectorized voxels to their bins, in voxel order (same as the scalar kernel)
+  inline void vtkFractionalImageAccumulateScatter(const int* bins, const double* fractions, int count,
+    const vtkFractionalImageAccumulateSpanParameters& params)
+  {
+    for (int k=0; k<count; ++k)
+    {
+      if (bins[k] >= params.BinExtentMin && bins[k] <= params.BinExtentMax)
+      {
+        params.Histogram[bins[k] - params.BinExtentMin] += fractions[k];
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Vectorized span kernels for float dose and char/unsigned char fractional labelmap (defined in
+// vtkFractionalImageAccumulateSSE4.cxx and vtkFractionalImageAccumulateAVX2.cxx).
+// Lanes accumulate partial sums in double precision that are added up at the end of the span, so the
+// sums differ from the scalar kernel only in the order of additions.
+void vtkFractionalImageAccumulateSpanSSE4(const float* inPtr, const unsigned char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc);
+void vtkFractionalImageAccumulateSpanSSE4(const float* inPtr, const char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc);
+void vtkFractionalImageAccumulateSpanAVX2(const float* inPtr, const unsigned char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc);
+void vtkFractionalImageAccumulateSpanAVX2(const float* inPtr, const char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc);
+
+#endif
@@ -0,0 +1,121 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SSE4.1 span kernels of vtkFractionalImageAccumulate. Compiled with SSE4.1 enabled, only called
+// if the processor supports it.
+
+#include "vtkFractionalImageAccumulateKernels.h"
+
+// SIMD includes
+#include <smmintrin.h>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // SSE4.1 kernel: 2 voxels per iteration
+  template <class FractionalImageScalarType>
+  void vtkFractionalImageAccumulateSpanSSE4Impl(const float* inPtr, const FractionalImageScalarType* fractionalPtr, int spanLength,
+    const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+  {
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d allLanes = _mm_cmpeq_pd(zero, zero);
+    const __m128d minimumFractionalValue = _mm_set1_pd(params.MinimumFractionalValue);
+    const __m128d fractionalScale = _mm_set1_pd(params.FractionalScale);
+    const __m128d binOrigin = _mm_set1_pd(params.BinOrigin);
+    const __m128d inverseBinSpacing = _mm_set1_pd(params.InverseBinSpacing);
+    const __m128d minSentinel = _mm_set1_pd(VTK_DOUBLE_MAX);
+    const __m128d maxSentinel = _mm_set1_pd(VTK_DOUBLE_MIN);
+
+    __m128d sum = zero;
+    __m128d sumSqr = zero;
+    __m128d fractionSum = zero;
+    __m128d minimum = minSentinel;
+    __m128d maximum = maxSentinel;
+    vtkIdType voxelCount = 0;
+
+    double fractions[2];
+    int bins[4];
+    int i = 0;
+    for (; i+2 <= spanLength; i += 2)
+    {
+      __m128d v = _mm_set_pd(static_cast<double>(inPtr[i+1]), static_cast<double>(inPtr[i]));
+      __m128d f = one;
+      if (params.UseFractionalLabelmap)
+      {
+        __m128d fractionalValue = _mm_set_pd(static_cast<double>(fractionalPtr[i+1]), static_cast<double>(fractionalPtr[i]));
+        f = _mm_mul_pd(_mm_sub_pd(fractionalValue, minimumFractionalValue), fractionalScale);
+      }
+      __m128d mask = (params.IgnoreZero ? _mm_cmpneq_pd(v, zero) : allLanes);
+      f = _mm_and_pd(f, mask);
+
+      __m128d vf = _mm_mul_pd(v, f);
+      sum = _mm_add_pd(sum, vf);
+      sumSqr = _mm_add_pd(sumSqr, _mm_mul_pd(vf, vf));
+      fractionSum = _mm_add_pd(fractionSum, f);
+      // Operand order makes NaN values ignored, same as in the scalar comparisons
+      minimum = _mm_min_pd(_mm_blendv_pd(minSentinel, v, mask), minimum);
+      maximum = _mm_max_pd(_mm_blendv_pd(maxSentinel, v, mask), maximum);
+      voxelCount += vtkFractionalImageAccumulateCountBits(_mm_movemask_pd(mask));
+
+      // Out of range values (including NaN) are converted to INT_MIN, which is outside the bin extent
+      __m128d binIndex = _mm_floor_pd(_mm_mul_pd(_mm_sub_pd(v, binOrigin), inverseBinSpacing));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bins), _mm_cvtpd_epi32(binIndex));
+      _mm_storeu_pd(fractions, f);
+      vtkFractionalImageAccumulateScatter(bins, fractions, 2, params);
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum);
+    acc.Sum += lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sumSqr);
+    acc.SumSqr += lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, fractionSum);
+    acc.FractionalVoxelCount += lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, minimum);
+    for (int k=0; k<2; ++k)
+    {
+      acc.Min = (lanes[k] < acc.Min ? lanes[k] : acc.Min);
+    }
+    _mm_storeu_pd(lanes, maximum);
+    for (int k=0; k<2; ++k)
+    {
+      acc.Max = (lanes[k] > acc.Max ? lanes[k] : acc.Max);
+    }
+    acc.VoxelCount += voxelCount;
+
+    // Remaining voxel
+    vtkFractionalImageAccumulateSpanScalar<float, FractionalImageScalarType>(inPtr + i, fractionalPtr + i, spanLength - i, params, acc);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkFractionalImageAccumulateSpanSSE4(const float* inPtr, const unsigned char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanSSE4Impl(inPtr, fractionalPtr, spanLength, params, acc);
+}
+
+//----------------------------------------------------------------------------
+void vtkFractionalImageAccumulateSpanSSE4(const float* inPtr, const char* fractionalPtr, int spanLength,
+  const vtkFractionalImageAccumulateSpanParameters& params, vtkFractionalImageAccumulateSpanAccumulator& acc)
+{
+  vtkFractionalImageAccumulateSpanSSE4Impl(inPtr, fractionalPtr, spanLength, params, acc);
+}
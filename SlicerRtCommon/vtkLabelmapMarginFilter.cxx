@@ -0,0 +1,401 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkLabelmapMarginFilter.h"
+#include "vtkSlicerRtTaskPool.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapMarginFilter);
+
+namespace
+{
+  /// Squared distance of voxels that have no feature voxel found yet
+  const float FAR_DISTANCE = VTK_FLOAT_MAX;
+
+  /// Tolerance of the comparison of the squared scaled distance with the unit sphere
+  const double MARGIN_TOLERANCE = 1.0e-5;
+
+  //----------------------------------------------------------------------------
+  /// Lower envelope of the parabolas of one line (reused between the lines processed by a thread)
+  struct LineEnvelope
+  {
+    void Allocate(int maximumLineLength)
+    {
+      this->Values.resize(maximumLineLength + 2);
+      this->Positions.resize(maximumLineLength + 2);
+      this->Boundaries.resize(maximumLineLength + 3);
+    }
+    /// Squared distance at the apex of each parabola
+    std::vector<double> Values;
+    /// Scaled position of the apex of each parabola
+    std::vector<double> Positions;
+    /// Scaled position where each parabola becomes the lowest
+    std::vector<double> Boundaries;
+  };
+
+  //----------------------------------------------------------------------------
+  /// One dimensional squared distance transform of a line in place (Felzenszwalb and Huttenlocher, 2012).
+  /// Sample k is at scaled position k*weight. If boundaryFeatures is set, then the samples just outside
+  /// the line (at -1 and n) are considered feature voxels (zero distance).
+  void DistanceTransformLine(float* line, vtkIdType stride, int n, double weight, bool boundaryFeatures, LineEnvelope& envelope)
+  {
+    double* values = &envelope.Values[0];
+    double* positions = &envelope.Positions[0];
+    double* boundaries = &envelope.Boundaries[0];
+
+    // Compute lower envelope of the parabolas rooted at the voxels with known distance
+    int k = -1;
+    int first = (boundaryFeatures ? -1 : 0);
+    int last = (boundaryFeatures ? n : n-1);
+    for (int q=first; q<=last; ++q)
+    {
+      double value = ( (q < 0 || q >= n) ? 0.0 : line[q*stride] );
+      if (value >= FAR_DISTANCE)
+      {
+        continue;
+      }
+      double position = weight * q;
+      double intersection = -VTK_DOUBLE_MAX;
+      while (k >= 0)
+      {
+        intersection = ( (value + position*position) - (values[k] + positions[k]*positions[k]) ) / (2.0 * (position - positions[k]));
+        if (intersection > boundaries[k])
+        {
+          break;
+        }
+        --k;
+      }
+      if (k < 0)
+      {
+        intersection = -VTK_DOUBLE_MAX;
+      }
+      ++k;
+      values[k] = value;
+      positions[k] = position;
+      boundaries[k] = intersection;
+    }
+    if (k < 0)
+    {
+      // No feature voxel is reachable along this line yet
+      return;
+    }
+    boundaries[k+1] = VTK_DOUBLE_MAX;
+
+    // Sample the lower envelope
+    int j = 0;
+    for (int p=0; p<n; ++p)
+    {
+      double position = weight * p;
+      while (boundaries[j+1] < position)
+      {
+        ++j;
+      }
+      double offset = position - positions[j];
+      line[p*stride] = static_cast<float>(offset*offset + values[j]);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Lines of one distance transform pass, shared between the worker threads.
+  /// One task is one slice (passes along I and J) or one row of slices (pass along K).
+  /// Each running task borrows a line envelope from the free ones.
+  struct DistanceTransformPassTaskList
+  {
+    float* Distances;
+    int Dimensions[3];
+    int Axis;
+    double Weight;
+    bool BoundaryFeatures;
+    int NumberOfTasks;
+    std::vector<LineEnvelope*> FreeEnvelopes;
+    vtkSimpleMutexLock Lock;
+  };
+
+  //----------------------------------------------------------------------------
+  void DistanceTransformPassTask(DistanceTransformPassTaskList* taskList, int taskIndex, LineEnvelope& envelope)
+  {
+    vtkIdType nx = taskList->Dimensions[0];
+    vtkIdType ny = taskList->Dimensions[1];
+    vtkIdType nz = taskList->Dimensions[2];
+    switch (taskList->Axis)
+    {
+    case 0:
+      for (vtkIdType y=0; y<ny; ++y)
+      {
+        DistanceTransformLine(taskList->Distances + (taskIndex*ny + y)*nx, 1, (int)nx,
+          taskList->Weight, taskList->BoundaryFeatures, envelope);
+      }
+      break;
+    case 1:
+      for (vtkIdType x=0; x<nx; ++x)
+      {
+        DistanceTransformLine(taskList->Distances + taskIndex*nx*ny + x, nx, (int)ny,
+          taskList->Weight, taskList->BoundaryFeatures, envelope);
+      }
+      break;
+    default:
+      for (vtkIdType x=0; x<nx; ++x)
+      {
+        DistanceTransformLine(taskList->Distances + taskIndex*nx + x, nx*ny, (int)nz,
+          taskList->Weight, taskList->BoundaryFeatures, envelope);
+      }
+      break;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Task function for vtkSlicerRtTaskPool
+  void DistanceTransformPassTaskFunction(void* userData, int taskIndex)
+  {
+    DistanceTransformPassTaskList* taskList = static_cast<DistanceTransformPassTaskList*>(userData);
+
+    taskList->Lock.Lock();
+    LineEnvelope* envelope = taskList->FreeEnvelopes.back();
+    taskList->FreeEnvelopes.pop_back();
+    taskList->Lock.Unlock();
+
+    DistanceTransformPassTask(taskList, taskIndex, *envelope);
+
+    taskList->Lock.Lock();
+    taskList->FreeEnvelopes.push_back(envelope);
+    taskList->Lock.Unlock();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Initialize squared distances from the input labelmap. Feature voxels (zero distance) are the
+  /// inside voxels when expanding and the outside voxels when shrinking.
+  template<class T>
+  void vtkLabelmapMarginFilterInitializeDistances(T* inPtr, int inputDimensions[3], int padding[3], int outputDimensions[3],
+    bool expand, float* distances)
+  {
+    float insideDistance = (expand ? 0.0f : FAR_DISTANCE);
+    float outsideDistance = (expand ? FAR_DISTANCE : 0.0f);
+    for (int z=0; z<inputDimensions[2]; ++z)
+    {
+      for (int y=0; y<inputDimensions[1]; ++y)
+      {
+        float* outPtr = distances + ( ((vtkIdType)(z + padding[2]) * outputDimensions[1] + (y + padding[1])) * outputDimensions[0] + padding[0] );
+        for (int x=0; x<inputDimensions[0]; ++x)
+        {
+          outPtr[x] = (inPtr[x] > 0 ? insideDistance : outsideDistance);
+        }
+        inPtr += inputDimensions[0];
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Threshold the squared scaled distances with the unit sphere
+  template<class T>
+  void vtkLabelmapMarginFilterWriteOutput(const float* distances, vtkIdType numberOfVoxels, bool expand, double labelValue, T* outPtr)
+  {
+    T insideValue = static_cast<T>(labelValue);
+    for (vtkIdType i=0; i<numberOfVoxels; ++i)
+    {
+      bool withinMargin = (distances[i] <= 1.0 + MARGIN_TOLERANCE);
+      outPtr[i] = ( (expand ? withinMargin : !withinMargin) ? insideValue : static_cast<T>(0) );
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapMarginFilter::vtkLabelmapMarginFilter()
+  : Operation(Expand)
+  , PadOutputExtent(true)
+  , LabelValue(1.0)
+  , NumberOfThreads(0)
+{
+  this->Margin[0] = this->Margin[1] = this->Margin[2] = 0.0;
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapMarginFilter::~vtkLabelmapMarginFilter()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapMarginFilter::SetInputData(vtkImageData* inputLabelmap)
+{
+  this->InputLabelmap = inputLabelmap;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLabelmapMarginFilter::GetInputData()
+{
+  return this->InputLabelmap;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLabelmapMarginFilter::GetOutput()
+{
+  return this->OutputLabelmap;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapMarginFilter::Update()
+{
+  vtkSmartPointer<vtkImageData> previousOutputLabelmap = this->OutputLabelmap;
+  this->OutputLabelmap = NULL;
+
+  vtkImageData* inputLabelmap = this->InputLabelmap;
+  if (!inputLabelmap || !inputLabelmap->GetPointData() || !inputLabelmap->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Invalid input labelmap");
+    return false;
+  }
+  if (inputLabelmap->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("Update: Input labelmap must have one scalar component");
+    return false;
+  }
+  double spacing[3] = {1.0,1.0,1.0};
+  inputLabelmap->GetSpacing(spacing);
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (this->Margin[axis] < 0.0 || spacing[axis] <= 0.0)
+    {
+      vtkErrorMacro("Update: Margins must not be negative and spacing must be positive");
+      return false;
+    }
+  }
+  bool expand = (this->Operation == Expand);
+
+  // Expanded structure may reach the margin beyond the input extent
+  int inputExtent[6] = {0,-1,0,-1,0,-1};
+  inputLabelmap->GetExtent(inputExtent);
+  int outputExtent[6] = {0,-1,0,-1,0,-1};
+  int inputDimensions[3] = {0,0,0};
+  int outputDimensions[3] = {0,0,0};
+  int padding[3] = {0,0,0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (expand && this->PadOutputExtent)
+    {
+      padding[axis] = vtkMath::Floor(this->Margin[axis] / spacing[axis] + MARGIN_TOLERANCE);
+    }
+    outputExtent[2*axis] = inputExtent[2*axis] - padding[axis];
+    outputExtent[2*axis+1] = inputExtent[2*axis+1] + padding[axis];
+    inputDimensions[axis] = inputExtent[2*axis+1] - inputExtent[2*axis] + 1;
+    outputDimensions[axis] = outputExtent[2*axis+1] - outputExtent[2*axis] + 1;
+  }
+
+  // Reuse the previous output if it has the same extent and type
+  vtkSmartPointer<vtkImageData> outputLabelmap = previousOutputLabelmap;
+  bool reuseOutput = ( outputLabelmap.GetPointer() && outputLabelmap->GetPointData()->GetScalars()
+    && outputLabelmap->GetScalarType() == inputLabelmap->GetScalarType() );
+  if (reuseOutput)
+  {
+    int previousOutputExtent[6] = {0,-1,0,-1,0,-1};
+    outputLabelmap->GetExtent(previousOutputExtent);
+    for (int i=0; i<6; ++i)
+    {
+      reuseOutput = reuseOutput && (previousOutputExtent[i] == outputExtent[i]);
+    }
+  }
+  if (!reuseOutput)
+  {
+    outputLabelmap = vtkSmartPointer<vtkImageData>::New();
+    outputLabelmap->SetExtent(outputExtent);
+    outputLabelmap->AllocateScalars(inputLabelmap->GetScalarType(), 1);
+  }
+  outputLabelmap->SetSpacing(spacing);
+  outputLabelmap->SetOrigin(inputLabelmap->GetOrigin());
+  if (inputDimensions[0] <= 0 || inputDimensions[1] <= 0 || inputDimensions[2] <= 0)
+  {
+    this->OutputLabelmap = outputLabelmap;
+    return true;
+  }
+
+  // Squared distances to the nearest feature voxel, in a space scaled so that the margin ellipsoid is the unit sphere
+  vtkIdType numberOfOutputVoxels = (vtkIdType)outputDimensions[0] * outputDimensions[1] * outputDimensions[2];
+  std::vector<float>& distances = this->Distances;
+  distances.assign(numberOfOutputVoxels, FAR_DISTANCE);
+  switch (inputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(vtkLabelmapMarginFilterInitializeDistances(static_cast<VTK_TT*>(inputLabelmap->GetScalarPointer()),
+      inputDimensions, padding, outputDimensions, expand, &distances[0]));
+  default:
+    vtkErrorMacro("Update: Unknown input labelmap scalar type");
+    return false;
+  }
+
+  // One separable pass along each axis. Axes with zero margin are skipped, as the scaled distance along them is infinite.
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (this->Margin[axis] <= 0.0)
+    {
+      continue;
+    }
+    DistanceTransformPassTaskList taskList;
+    taskList.Distances = &distances[0];
+    taskList.Dimensions[0] = outputDimensions[0];
+    taskList.Dimensions[1] = outputDimensions[1];
+    taskList.Dimensions[2] = outputDimensions[2];
+    taskList.Axis = axis;
+    taskList.Weight = spacing[axis] / this->Margin[axis];
+    // Outside of the input extent is outside the structure, which are features when shrinking
+    taskList.BoundaryFeatures = !expand;
+    taskList.NumberOfTasks = (axis == 2 ? outputDimensions[1] : outputDimensions[2]);
+
+    // One line envelope per thread, so that the lines are processed without allocation
+    int numberOfThreads = vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(this->NumberOfThreads, taskList.NumberOfTasks);
+    std::vector<LineEnvelope> envelopes(numberOfThreads);
+    for (std::vector<LineEnvelope>::iterator envelopeIt = envelopes.begin(); envelopeIt != envelopes.end(); ++envelopeIt)
+    {
+      envelopeIt->Allocate(outputDimensions[axis]);
+      taskList.FreeEnvelopes.push_back(&(*envelopeIt));
+    }
+    vtkSlicerRtTaskPool::ExecuteTasks(taskList.NumberOfTasks, DistanceTransformPassTaskFunction, &taskList, numberOfThreads);
+  }
+
+  switch (outputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(vtkLabelmapMarginFilterWriteOutput(&distances[0], numberOfOutputVoxels, expand, this->LabelValue,
+      static_cast<VTK_TT*>(outputLabelmap->GetScalarPointer())));
+  default:
+    vtkErrorMacro("Update: Unknown output labelmap scalar type");
+    return false;
+  }
+
+  this->OutputLabelmap = outputLabelmap;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapMarginFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Margin: (" << this->Margin[0] << ", " << this->Margin[1] << ", " << this->Margin[2] << ")\n";
+  os << indent << "Operation: " << (this->Operation == Expand ? "Expand" : "Shrink") << "\n";
+  os << indent << "PadOutputExtent: " << (this->PadOutputExtent ? "true" : "false") << "\n";
+  os << indent << "LabelValue: " << this->LabelValue << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+}
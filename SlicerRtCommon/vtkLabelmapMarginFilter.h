@@ -0,0 +1,149 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkLabelmapMarginFilter_h
+#define __vtkLabelmapMarginFilter_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkImageData;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Expand or shrink a binary labelmap by a margin using an exact Euclidean distance transform
+///
+/// The result is the same as dilating or eroding the labelmap with an ellipsoid with the margins as
+/// semi-axes, but the computation time is linear in the number of voxels regardless of the margin size.
+/// The squared distances are computed with separable one-dimensional lower envelope passes (Felzenszwalb
+/// and Huttenlocher), one along each image axis. Anisotropic margins are handled by scaling each axis with
+/// spacing/margin, so that the ellipsoid becomes the unit sphere. The lines of each pass are processed
+/// in parallel.
+///
+/// Voxels with positive value in the input are inside the structure. When expanding, the output extent is
+/// the input extent padded by the margin, so that the expanded structure is not clipped (unless
+/// PadOutputExtent is turned off). When shrinking, the region outside the input extent is considered
+/// outside the structure.
+///
+/// Margins are applied along the image axes; the spacing of the input is used, directions are ignored.
+///
+/// The output image and the distance buffer are reused by subsequent updates with the same output extent, so
+/// one instance can process many labelmaps of the same geometry without reallocation.
+///
+/// This is not a VTK pipeline filter, because the next update overwrites the output image in place.
+/// Deep copy the output if it is needed after processing another labelmap.
+class VTK_SLICERRTCOMMON_EXPORT vtkLabelmapMarginFilter : public vtkObject
+{
+public:
+  enum MarginOperation
+  {
+    Expand = 0,
+    Shrink
+  };
+
+public:
+  static vtkLabelmapMarginFilter* New();
+  vtkTypeMacro(vtkLabelmapMarginFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set input binary labelmap. Must have one scalar component
+  void SetInputData(vtkImageData* inputLabelmap);
+  /// Get input binary labelmap
+  vtkImageData* GetInputData();
+
+  /// Get output labelmap. It has the scalar type, spacing and origin of the input.
+  /// The image is overwritten by the next update if the output extent does not change
+  vtkImageData* GetOutput();
+
+  /// Set margin along the I, J and K axes in physical units (mm). Zero means no change along the axis
+  vtkSetVector3Macro(Margin, double);
+  /// Get margin along the I, J and K axes in physical units (mm)
+  vtkGetVector3Macro(Margin, double);
+
+  /// Set operation (expand or shrink)
+  vtkSetMacro(Operation, int);
+  /// Get operation
+  vtkGetMacro(Operation, int);
+  void SetOperationToExpand() { this->SetOperation(Expand); };
+  void SetOperationToShrink() { this->SetOperation(Shrink); };
+
+  /// Set flag determining whether the output extent is padded by the margin when expanding.
+  /// If off, then the output has the extent of the input, and the expanded structure is clipped at its boundary
+  vtkSetMacro(PadOutputExtent, bool);
+  /// Get flag determining whether the output extent is padded by the margin when expanding
+  vtkGetMacro(PadOutputExtent, bool);
+  vtkBooleanMacro(PadOutputExtent, bool);
+
+  /// Set value of the voxels inside the structure in the output
+  vtkSetMacro(LabelValue, double);
+  /// Get value of the voxels inside the structure in the output
+  vtkGetMacro(LabelValue, double);
+
+  /// Set number of threads sharing the lines of each distance transform pass.
+  /// 0 (default) means one thread per processor core, 1 means the lines are processed on the calling thread
+  /// \sa vtkSlicerRtTaskPool
+  vtkSetMacro(NumberOfThreads, int);
+  /// Get number of threads
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Compute output labelmap
+  /// \return Success flag
+  bool Update();
+
+protected:
+  vtkLabelmapMarginFilter();
+  virtual ~vtkLabelmapMarginFilter();
+
+protected:
+  /// Input labelmap
+  vtkSmartPointer<vtkImageData> InputLabelmap;
+
+  /// Output labelmap
+  vtkSmartPointer<vtkImageData> OutputLabelmap;
+
+  /// Margin along the I, J and K axes in mm. Default is 0
+  double Margin[3];
+
+  /// Expand or shrink. Default is expand
+  int Operation;
+
+  /// Flag determining whether the output extent is padded by the margin when expanding. Default is on
+  bool PadOutputExtent;
+
+  /// Value of the inside voxels in the output. Default is 1
+  double LabelValue;
+
+  /// Number of threads used for the distance transform passes. Default is 0 (all processor cores)
+  int NumberOfThreads;
+
+  /// Squared distances of the output voxels, kept between updates to avoid reallocation
+  std::vector<float> Distances;
+
+private:
+  vtkLabelmapMarginFilter(const vtkLabelmapMarginFilter&); // Not implemented
+  void operator=(const vtkLabelmapMarginFilter&);          // Not implemented
+};
+
+#endif
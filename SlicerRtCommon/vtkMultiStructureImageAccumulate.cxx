@@ -0,0 +1,456 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkMultiStructureImageAccumulate.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkMultiStructureImageAccumulate);
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Convert one row of the input image to double
+  template<class T>
+  void vtkMultiStructureImageAccumulateCopyRow(T* inPtr, int rowLength, double* outPtr)
+  {
+    for (int i=0; i<rowLength; ++i)
+    {
+      outPtr[i] = static_cast<double>(inPtr[i]);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Convert one row of a binary labelmap to inside (1) / outside (0) flags
+  template<class T>
+  void vtkMultiStructureImageAccumulateMaskRow(T* inPtr, int rowLength, unsigned char* outPtr)
+  {
+    for (int i=0; i<rowLength; ++i)
+    {
+      outPtr[i] = (inPtr[i] > 0 ? 1 : 0);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Convert one row of a multi-label labelmap to structure indices (-1 if background or invalid label)
+  template<class T>
+  void vtkMultiStructureImageAccumulateLabelRow(T* inPtr, int rowLength, int numberOfStructures, int* outPtr)
+  {
+    for (int i=0; i<rowLength; ++i)
+    {
+      double label = static_cast<double>(inPtr[i]);
+      outPtr[i] = ( (label >= 1.0 && label <= numberOfStructures) ? static_cast<int>(label) - 1 : -1 );
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkMultiStructureImageAccumulate::StructureStatistics::StructureStatistics()
+  : VoxelCount(0)
+  , Sum(0.0)
+  , Min(VTK_DOUBLE_MAX)
+  , Max(VTK_DOUBLE_MIN)
+  , UnderflowCount(0.0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkMultiStructureImageAccumulate::vtkMultiStructureImageAccumulate()
+  : NumberOfMultiLabelStructures(0)
+  , HistogramOrigin(0.0)
+  , HistogramSpacing(1.0)
+  , NumberOfHistogramBins(100)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkMultiStructureImageAccumulate::~vtkMultiStructureImageAccumulate()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::SetInputData(vtkImageData* inputImage)
+{
+  this->InputImage = inputImage;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkMultiStructureImageAccumulate::GetInputData()
+{
+  return this->InputImage;
+}
+
+//----------------------------------------------------------------------------
+int vtkMultiStructureImageAccumulate::AddStructureLabelmap(vtkImageData* structureLabelmap)
+{
+  this->StructureLabelmaps.push_back(structureLabelmap);
+  this->Modified();
+  return (int)this->StructureLabelmaps.size() - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::RemoveAllStructureLabelmaps()
+{
+  this->StructureLabelmaps.clear();
+  this->Statistics.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::SetMultiLabelLabelmap(vtkImageData* multiLabelLabelmap, int numberOfStructures)
+{
+  this->MultiLabelLabelmap = multiLabelLabelmap;
+  this->NumberOfMultiLabelStructures = (multiLabelLabelmap ? numberOfStructures : 0);
+  this->Statistics.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMultiStructureImageAccumulate::GetNumberOfStructures()
+{
+  if (this->MultiLabelLabelmap.GetPointer())
+  {
+    return this->NumberOfMultiLabelStructures;
+  }
+  return (int)this->StructureLabelmaps.size();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMultiStructureImageAccumulate::Update()
+{
+  this->Statistics.clear();
+
+  vtkImageData* inputImage = this->InputImage;
+  if (!inputImage || !inputImage->GetPointData() || !inputImage->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Invalid input image");
+    return false;
+  }
+  if (inputImage->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("Update: Input image must have one scalar component");
+    return false;
+  }
+  if (this->NumberOfHistogramBins < 1 || this->HistogramSpacing <= 0.0)
+  {
+    vtkErrorMacro("Update: Invalid histogram bins");
+    return false;
+  }
+  bool useMultiLabelLabelmap = (this->MultiLabelLabelmap.GetPointer() != NULL);
+  int numberOfStructures = this->GetNumberOfStructures();
+
+  // Check that all labelmaps have the geometry of the input image
+  int extent[6] = {0,-1,0,-1,0,-1};
+  inputImage->GetExtent(extent);
+  std::vector<vtkImageData*> labelmaps;
+  if (useMultiLabelLabelmap)
+  {
+    labelmaps.push_back(this->MultiLabelLabelmap);
+  }
+  else
+  {
+    for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+    {
+      labelmaps.push_back(this->StructureLabelmaps[structureIndex]);
+    }
+  }
+  for (std::vector<vtkImageData*>::iterator labelmapIt=labelmaps.begin(); labelmapIt!=labelmaps.end(); ++labelmapIt)
+  {
+    int labelmapExtent[6] = {0,-1,0,-1,0,-1};
+    if (!(*labelmapIt) || !(*labelmapIt)->GetPointData()->GetScalars())
+    {
+      vtkErrorMacro("Update: Invalid structure labelmap");
+      return false;
+    }
+    (*labelmapIt)->GetExtent(labelmapExtent);
+    for (int i=0; i<6; ++i)
+    {
+      if (labelmapExtent[i] != extent[i])
+      {
+        vtkErrorMacro("Update: Structure labelmap extent does not match input image extent");
+        return false;
+      }
+    }
+  }
+
+  // Initialize results
+  this->Statistics.resize(numberOfStructures);
+  for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    vtkSmartPointer<vtkDoubleArray> histogram = vtkSmartPointer<vtkDoubleArray>::New();
+    histogram->SetNumberOfTuples(this->NumberOfHistogramBins);
+    histogram->FillComponent(0, 0.0);
+    this->Statistics[structureIndex].Histogram = histogram;
+  }
+  if (extent[1] < extent[0] || extent[3] < extent[2] || extent[5] < extent[4] || numberOfStructures == 0)
+  {
+    return true;
+  }
+
+  // Row buffers (input value, histogram bin index, and structure membership for one image row)
+  int rowLength = extent[1] - extent[0] + 1;
+  std::vector<double> valueRow(rowLength);
+  std::vector<int> binRow(rowLength);
+  std::vector<unsigned char> maskRow(rowLength);
+  std::vector<int> labelRow(rowLength);
+
+  double origin = this->HistogramOrigin;
+  double spacing = this->HistogramSpacing;
+  int numberOfBins = this->NumberOfHistogramBins;
+
+  std::vector<double*> histogramPointers(numberOfStructures);
+  for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    histogramPointers[structureIndex] = this->Statistics[structureIndex].Histogram->GetPointer(0);
+  }
+
+  for (int z=extent[4]; z<=extent[5]; ++z)
+  {
+    for (int y=extent[2]; y<=extent[3]; ++y)
+    {
+      // Convert and bin the input image row once for all structures.
+      // Bin index is -1 for underflow and numberOfBins for overflow.
+      void* inputRowPtr = inputImage->GetScalarPointer(extent[0], y, z);
+      switch (inputImage->GetScalarType())
+      {
+        vtkTemplateMacro(vtkMultiStructureImageAccumulateCopyRow(static_cast<VTK_TT*>(inputRowPtr), rowLength, &valueRow[0]));
+      default:
+        vtkErrorMacro("Update: Unknown input image scalar type");
+        this->Statistics.clear();
+        return false;
+      }
+      for (int x=0; x<rowLength; ++x)
+      {
+        double v = valueRow[x];
+        if (v < origin)
+        {
+          binRow[x] = -1;
+          continue;
+        }
+        int bin = vtkMath::Floor((v - origin) / spacing);
+        binRow[x] = (bin < numberOfBins ? bin : numberOfBins);
+      }
+
+      if (useMultiLabelLabelmap)
+      {
+        void* labelRowPtr = this->MultiLabelLabelmap->GetScalarPointer(extent[0], y, z);
+        switch (this->MultiLabelLabelmap->GetScalarType())
+        {
+          vtkTemplateMacro(vtkMultiStructureImageAccumulateLabelRow(static_cast<VTK_TT*>(labelRowPtr), rowLength, numberOfStructures, &labelRow[0]));
+        default:
+          vtkErrorMacro("Update: Unknown labelmap scalar type");
+          this->Statistics.clear();
+          return false;
+        }
+        for (int x=0; x<rowLength; ++x)
+        {
+          int structureIndex = labelRow[x];
+          if (structureIndex < 0)
+          {
+            continue;
+          }
+          StructureStatistics& statistics = this->Statistics[structureIndex];
+          double v = valueRow[x];
+          statistics.Sum += v;
+          if (v > statistics.Max)
+          {
+            statistics.Max = v;
+          }
+          if (v < statistics.Min)
+          {
+            statistics.Min = v;
+          }
+          ++statistics.VoxelCount;
+          int bin = binRow[x];
+          if (bin < 0)
+          {
+            statistics.UnderflowCount += 1.0;
+          }
+          else if (bin < numberOfBins)
+          {
+            histogramPointers[structureIndex][bin] += 1.0;
+          }
+        }
+      }
+      else
+      {
+        for (int structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+        {
+          vtkImageData* labelmap = this->StructureLabelmaps[structureIndex];
+          void* labelRowPtr = labelmap->GetScalarPointer(extent[0], y, z);
+          switch (labelmap->GetScalarType())
+          {
+            vtkTemplateMacro(vtkMultiStructureImageAccumulateMaskRow(static_cast<VTK_TT*>(labelRowPtr), rowLength, &maskRow[0]));
+          default:
+            vtkErrorMacro("Update: Unknown labelmap scalar type");
+            this->Statistics.clear();
+            return false;
+          }
+
+          StructureStatistics& statistics = this->Statistics[structureIndex];
+          double* histogram = histogramPointers[structureIndex];
+          for (int x=0; x<rowLength; ++x)
+          {
+            if (!maskRow[x])
+            {
+              continue;
+            }
+            double v = valueRow[x];
+            statistics.Sum += v;
+            if (v > statistics.Max)
+            {
+              statistics.Max = v;
+            }
+            if (v < statistics.Min)
+            {
+              statistics.Min = v;
+            }
+            ++statistics.VoxelCount;
+            int bin = binRow[x];
+            if (bin < 0)
+            {
+              statistics.UnderflowCount += 1.0;
+            }
+            else if (bin < numberOfBins)
+            {
+              histogram[bin] += 1.0;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMultiStructureImageAccumulate::IsValidStructureIndex(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= (int)this->Statistics.size())
+  {
+    vtkErrorMacro("Invalid structure index " << structureIndex << " (number of computed structures: " << this->Statistics.size() << ")");
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkMultiStructureImageAccumulate::GetVoxelCount(int structureIndex)
+{
+  if (!this->IsValidStructureIndex(structureIndex))
+  {
+    return 0;
+  }
+  return this->Statistics[structureIndex].VoxelCount;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetMin(int structureIndex)
+{
+  if (!this->IsValidStructureIndex(structureIndex))
+  {
+    return 0.0;
+  }
+  return this->Statistics[structureIndex].Min;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetMax(int structureIndex)
+{
+  if (!this->IsValidStructureIndex(structureIndex))
+  {
+    return 0.0;
+  }
+  return this->Statistics[structureIndex].Max;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetMean(int structureIndex)
+{
+  if (!this->IsValidStructureIndex(structureIndex) || this->Statistics[structureIndex].VoxelCount == 0)
+  {
+    return 0.0;
+  }
+  return this->Statistics[structureIndex].Sum / static_cast<double>(this->Statistics[structureIndex].VoxelCount);
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetUnderflowCount(int structureIndex)
+{
+  if (!this->IsValidStructureIndex(structureIndex))
+  {
+    return 0.0;
+  }
+  return this->Statistics[structureIndex].UnderflowCount;
+}
+
+//----------------------------------------------------------------------------
+vtkDoubleArray* vtkMultiStructureImageAccumulate::GetHistogram(int structureIndex)
+{
+  if (!this->IsValidStructureIndex(structureIndex))
+  {
+    return NULL;
+  }
+  return this->Statistics[structureIndex].Histogram;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::GetCumulativeHistogram(int structureIndex, vtkDoubleArray* cumulativeHistogram)
+{
+  if (!cumulativeHistogram)
+  {
+    vtkErrorMacro("GetCumulativeHistogram: Invalid output array");
+    return;
+  }
+  if (!this->IsValidStructureIndex(structureIndex))
+  {
+    return;
+  }
+
+  StructureStatistics& statistics = this->Statistics[structureIndex];
+  int numberOfBins = statistics.Histogram->GetNumberOfTuples();
+  cumulativeHistogram->SetNumberOfComponents(1);
+  cumulativeHistogram->SetNumberOfTuples(numberOfBins);
+  double totalVoxels = static_cast<double>(statistics.VoxelCount);
+  double voxelsBelowBin = statistics.UnderflowCount;
+  for (int bin=0; bin<numberOfBins; ++bin)
+  {
+    cumulativeHistogram->SetValue(bin, totalVoxels > 0 ? (1.0 - voxelsBelowBin/totalVoxels)*100.0 : 0.0);
+    voxelsBelowBin += statistics.Histogram->GetValue(bin);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfStructures: " << this->GetNumberOfStructures() << "\n";
+  os << indent << "HistogramOrigin: " << this->HistogramOrigin << "\n";
+  os << indent << "HistogramSpacing: " << this->HistogramSpacing << "\n";
+  os << indent << "NumberOfHistogramBins: " << this->NumberOfHistogramBins << "\n";
+}
@@ -0,0 +1,165 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkMultiStructureImageAccumulate_h
+#define __vtkMultiStructureImageAccumulate_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkDoubleArray;
+class vtkImageData;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Compute histogram and statistics of an image for multiple structures in one pass
+///
+/// Equivalent to running one stenciled vtkImageAccumulate for each structure, but the input
+/// image (typically a dose volume) is traversed only once. The image is processed row by row,
+/// so that each image row is converted and binned once, then accumulated into the structures
+/// containing the voxels while it is still in the cache.
+///
+/// The structures are given either as binary labelmaps (one per structure, voxels with positive value
+/// belong to the structure), or as one multi-label labelmap in which voxels with label k belong to the
+/// k-th structure (label 0 is background). The labelmaps must have the same extent as the input image.
+/// Structures may overlap when binary labelmaps are used.
+///
+/// Statistics are accumulated in image order, so they are identical to those of vtkImageAccumulate.
+///
+/// This is not a VTK pipeline filter: the number of structures varies, and the results are
+/// per-structure statistics that are queried after \sa Update instead of an output data object.
+class VTK_SLICERRTCOMMON_EXPORT vtkMultiStructureImageAccumulate : public vtkObject
+{
+public:
+  static vtkMultiStructureImageAccumulate* New();
+  vtkTypeMacro(vtkMultiStructureImageAccumulate, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set input image the histograms are computed from (e.g. dose volume). Must have one scalar component
+  void SetInputData(vtkImageData* inputImage);
+  /// Get input image
+  vtkImageData* GetInputData();
+
+  /// Add binary labelmap of a structure. The structure index is the order of addition
+  /// \return Index of the added structure
+  int AddStructureLabelmap(vtkImageData* structureLabelmap);
+  /// Remove all binary structure labelmaps
+  void RemoveAllStructureLabelmaps();
+
+  /// Set multi-label labelmap defining the structures. If set, then the binary labelmaps are ignored.
+  /// \param numberOfStructures Number of structures. Voxels with label 1..numberOfStructures are accumulated into the structure at index label-1
+  void SetMultiLabelLabelmap(vtkImageData* multiLabelLabelmap, int numberOfStructures);
+
+  /// Get number of structures
+  int GetNumberOfStructures();
+
+  /// Set start value of the first histogram bin
+  vtkSetMacro(HistogramOrigin, double);
+  /// Get start value of the first histogram bin
+  vtkGetMacro(HistogramOrigin, double);
+
+  /// Set width of the histogram bins
+  vtkSetMacro(HistogramSpacing, double);
+  /// Get width of the histogram bins
+  vtkGetMacro(HistogramSpacing, double);
+
+  /// Set number of histogram bins
+  vtkSetMacro(NumberOfHistogramBins, int);
+  /// Get number of histogram bins
+  vtkGetMacro(NumberOfHistogramBins, int);
+
+  /// Compute histograms and statistics for all structures
+  /// \return Success flag
+  bool Update();
+
+  /// Get number of voxels in a structure
+  vtkIdType GetVoxelCount(int structureIndex);
+  /// Get minimum value in a structure
+  double GetMin(int structureIndex);
+  /// Get maximum value in a structure
+  double GetMax(int structureIndex);
+  /// Get mean value in a structure
+  double GetMean(int structureIndex);
+
+  /// Get number of voxels in a structure with value smaller than the histogram origin
+  double GetUnderflowCount(int structureIndex);
+  /// Get voxel counts of the histogram bins for a structure.
+  /// Values outside [HistogramOrigin, HistogramOrigin+NumberOfHistogramBins*HistogramSpacing) are not counted in any of the bins.
+  vtkDoubleArray* GetHistogram(int structureIndex);
+
+  /// Get cumulative histogram for a structure: percentage of the structure voxels that have a value
+  /// greater or equal to the start value of each bin (e.g. volume receiving at least a certain dose in case of DVH)
+  /// \param cumulativeHistogram Output array containing one value per bin
+  void GetCumulativeHistogram(int structureIndex, vtkDoubleArray* cumulativeHistogram);
+
+protected:
+  /// Accumulated statistics and histogram of one structure
+  struct StructureStatistics
+  {
+    StructureStatistics();
+    vtkIdType VoxelCount;
+    double Sum;
+    double Min;
+    double Max;
+    double UnderflowCount;
+    vtkSmartPointer<vtkDoubleArray> Histogram;
+  };
+
+  /// Check if structure index is valid and statistics have been computed
+  bool IsValidStructureIndex(int structureIndex);
+
+protected:
+  vtkMultiStructureImageAccumulate();
+  virtual ~vtkMultiStructureImageAccumulate();
+
+protected:
+  /// Input image
+  vtkSmartPointer<vtkImageData> InputImage;
+
+  /// Binary labelmaps of the structures
+  std::vector< vtkSmartPointer<vtkImageData> > StructureLabelmaps;
+
+  /// Multi-label labelmap of the structures. Binary labelmaps are ignored if set
+  vtkSmartPointer<vtkImageData> MultiLabelLabelmap;
+
+  /// Number of structures in the multi-label labelmap
+  int NumberOfMultiLabelStructures;
+
+  /// Start value of the first histogram bin. Default is 0
+  double HistogramOrigin;
+  /// Width of the histogram bins. Default is 1
+  double HistogramSpacing;
+  /// Number of histogram bins. Default is 100
+  int NumberOfHistogramBins;
+
+  /// Results for each structure
+  std::vector<StructureStatistics> Statistics;
+
+private:
+  vtkMultiStructureImageAccumulate(const vtkMultiStructureImageAccumulate&); // Not implemented
+  void operator=(const vtkMultiStructureImageAccumulate&);                   // Not implemented
+};
+
+#endif
@@ -30,11 +30,15 @@
 #include <vtkMRMLVolumeArchetypeStorageNode.h>
 
 // VTK includes
+#include <vtkDataArray.h>
 #include <vtkDiscretizableColorTransferFunction.h>
 #include <vtkLookupTable.h>
 #include <vtkGeneralTransform.h>
 #include <vtkImageData.h>
+#include <vtkInformation.h>
+#include <vtkInformationObjectBaseKey.h>
 #include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
 #include <vtkSmartPointer.h>
 
 // SegmentationCore includes
@@ -44,6 +48,27 @@
 // VTK sys tools
 #include <vtksys/SystemTools.hxx>
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Holds a reference to an ITK pixel container in the information of a VTK data array
+  class vtkItkPixelContainerReference : public vtkObject
+  {
+  public:
+    static vtkItkPixelContainerReference* New();
+    vtkTypeMacro(vtkItkPixelContainerReference, vtkObject);
+
+    itk::LightObject::Pointer PixelContainer;
+
+  protected:
+    vtkItkPixelContainerReference() { }
+    ~vtkItkPixelContainerReference() { }
+  };
+  vtkStandardNewMacro(vtkItkPixelContainerReference);
+}
+
+vtkInformationKeyMacro(vtkSlicerRtCommon, ITK_PIXEL_CONTAINER, ObjectBase);
+
 //----------------------------------------------------------------------------
 // Constant strings
 //----------------------------------------------------------------------------
@@ -396,3 +421,17 @@ bool vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(vtkMRMLScalarVol
 
   return true;
 }
+
+//---------------------------------------------------------------------------
+void vtkSlicerRtCommon::AttachItkPixelContainer(vtkDataArray* dataArray, itk::LightObject* pixelContainer)
+{
+  if (!dataArray)
+  {
+    vtkGenericWarningMacro("vtkSlicerRtCommon::AttachItkPixelContainer: Invalid data array!");
+    return;
+  }
+
+  vtkSmartPointer<vtkItkPixelContainerReference> reference = vtkSmartPointer<vtkItkPixelContainerReference>::New();
+  reference->PixelContainer = pixelContainer;
+  dataArray->GetInformation()->Set(vtkSlicerRtCommon::ITK_PIXEL_CONTAINER(), reference);
+}
@@ -37,7 +37,9 @@ class vtkMRMLScalarVolumeNode;
 class vtkMRMLScene;
 class vtkMRMLTransformableNode;
 
+class vtkDataArray;
 class vtkImageData;
+class vtkInformationObjectBaseKey;
 class vtkOrientedImageData;
 class vtkGeneralTransform;
 class vtkMatrix4x4;
@@ -183,18 +185,22 @@ public:
     \param inImageData Input oriented image data
     \param outItkVolume Output ITK image
     \param applyRasToLpsConversion Apply RAS (Slicer) to LPS (ITK, DICOM) coordinate frame conversion. True by default
+    \param shareBuffer If true, then the ITK image uses the scalar buffer of the input image instead of a copy,
+      and keeps a reference to the scalar array. Changing voxel values in one image changes them in the other. False by default
     \return Success
   */
-  template<typename T> static bool ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion=true);
+  template<typename T> static bool ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion=true, bool shareBuffer=false);
 
   /*!
     Convert ITK image to VTK image data. The image geometry is not considered!
     \param inItkImage Input ITK image
     \param outVtkImageData Output VTK image data
-    \param vtkType Data scalar type (i.e VTK_FLOAT)
+    \param vtkType Data scalar type (i.e VTK_FLOAT). Must have the same size as the ITK pixel type
+    \param shareBuffer If true, then the VTK image uses the pixel buffer of the ITK image instead of a copy,
+      and keeps a reference to the ITK pixel container. Changing voxel values in one image changes them in the other. False by default
     \return Success
   */
-  template<typename T> static bool ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType);
+  template<typename T> static bool ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType, bool shareBuffer=false);
 
   /*!
     Convert ITK image to MRML volume node. Image geometry is transferred.
@@ -202,9 +208,21 @@ public:
     \param outVolumeNode Output MRML scalar volume node
     \param vtkType Data scalar type (i.e VTK_FLOAT)
     \param applyLpsToRasConversion Apply LPS (ITK, DICOM) to RAS (Slicer) coordinate frame conversion. True by default
+    \param shareBuffer If true, then the volume uses the pixel buffer of the ITK image instead of a copy. False by default
     \return Success
   */
-  template<typename T> static bool ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion=true);
+  template<typename T> static bool ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion=true, bool shareBuffer=false);
+
+  /*!
+    Make a VTK data array that wraps an ITK pixel buffer and keeps the ITK pixel container alive
+    until the array is deleted. Used by \sa ConvertItkImageToVtkImageData
+    \param dataArray Data array using the buffer of the pixel container
+    \param pixelContainer ITK pixel container owning the buffer
+  */
+  static void AttachItkPixelContainer(vtkDataArray* dataArray, itk::LightObject* pixelContainer);
+
+  /// Information key of data arrays that stores the ITK pixel container whose buffer the array uses
+  static vtkInformationObjectBaseKey* ITK_PIXEL_CONTAINER();
 //ETX
 };
 
@@ -26,13 +26,17 @@
 
 // VTK includes
 #include <vtkSmartPointer.h>
+#include <vtkDataArray.h>
 #include <vtkImageData.h>
-#include <vtkImageExport.h>
 #include <vtkImageThreshold.h>
+#include <vtkPointData.h>
 #include <vtkTransform.h>
 
 // ITK includes
-#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImportImageContainer.h>
+
+// STD includes
+#include <cstring>
 
 // Segmentations includes
 #include "vtkOrientedImageData.h"
@@ -49,6 +53,39 @@ namespace
     }
     return val < EPSILON;
   }
+
+  //---------------------------------------------------------------------------
+  /// ITK pixel container that uses the scalar buffer of a VTK data array without copying it.
+  /// The container keeps a reference to the data array, so the buffer remains valid for the
+  /// lifetime of the ITK image even if the VTK image is modified or deleted in the meantime
+  /// (vtkImageData::AllocateScalars does not reuse arrays that are referenced elsewhere).
+  template<typename TElement> class VtkDataArrayImportImageContainer
+    : public itk::ImportImageContainer<itk::SizeValueType, TElement>
+  {
+  public:
+    typedef VtkDataArrayImportImageContainer Self;
+    typedef itk::ImportImageContainer<itk::SizeValueType, TElement> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(VtkDataArrayImportImageContainer, ImportImageContainer);
+
+    /// Import the buffer of the given array. The array is referenced until the container is deleted.
+    void SetDataArray(vtkDataArray* dataArray)
+    {
+      this->DataArray = dataArray;
+      this->SetImportPointer( static_cast<TElement*>(dataArray->GetVoidPointer(0)),
+        static_cast<itk::SizeValueType>(dataArray->GetNumberOfTuples() * dataArray->GetNumberOfComponents()), false );
+    }
+
+  protected:
+    VtkDataArrayImportImageContainer() { }
+    ~VtkDataArrayImportImageContainer() { }
+
+  private:
+    vtkSmartPointer<vtkDataArray> DataArray;
+  };
 }
 
 //----------------------------------------------------------------------------
@@ -84,12 +121,13 @@ template<typename T> bool vtkSlicerRtCommon::ConvertVolumeNodeToItkImage(vtkMRML
     return false; 
   }
   
-  // Convert vtkOrientedImageData to itkImage
-  return vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(orientedImageData, outItkImage, applyRasToLpsConversion);
+  // Convert vtkOrientedImageData to itkImage. The oriented image data is a deep copy of the volume
+  // that is not used anywhere else, so the ITK image can use its buffer directly
+  return vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage<T>(orientedImageData, outItkImage, applyRasToLpsConversion, true);
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion/*=true*/)
+template<typename T> bool vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkImage(vtkOrientedImageData* inImageData, typename itk::Image<T, 3>::Pointer outItkImage, bool applyRasToLpsConversion/*=true*/, bool shareBuffer/*=false*/)
 {
   if (inImageData == NULL)
   {
@@ -106,11 +144,13 @@ template<typename T> bool vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkIma
     vtkErrorWithObjectMacro(inImageData, "ConvertVtkOrientedImageDataToItkImage: Requested type has a different scalar size than input type - output image is NULL!");
     return false; 
   }
-
-  // Convert vtkOrientedImageData to itkImage 
-  vtkSmartPointer<vtkImageExport> imageExport = vtkSmartPointer<vtkImageExport>::New(); 
-  imageExport->SetInputData(inImageData);
-  imageExport->Update(); 
+  vtkDataArray* inScalars = inImageData->GetPointData()->GetScalars();
+  vtkIdType numberOfVoxels = inImageData->GetNumberOfPoints();
+  if (inScalars == NULL || inScalars->GetNumberOfTuples() * inScalars->GetNumberOfComponents() != numberOfVoxels)
+  {
+    vtkErrorWithObjectMacro(inImageData, "ConvertVtkOrientedImageDataToItkImage: Input image data must have single-component scalars for each voxel!");
+    return false; 
+  }
 
   // Determine input image to world transform
   vtkSmartPointer<vtkMatrix4x4> inImageToWorldRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
@@ -194,7 +234,16 @@ template<typename T> bool vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkIma
   region.SetIndex(start);
   outItkImage->SetRegions(region);
 
-  // Create and export ITK image
+  // Let the ITK image use the VTK scalar buffer if requested
+  if (shareBuffer && numberOfVoxels > 0)
+  {
+    typename VtkDataArrayImportImageContainer<T>::Pointer pixelContainer = VtkDataArrayImportImageContainer<T>::New();
+    pixelContainer->SetDataArray(inScalars);
+    outItkImage->SetPixelContainer(pixelContainer);
+    return true;
+  }
+
+  // Allocate ITK image and copy the voxels. Both images store the voxels contiguously in x-y-z order
   try
   {
     outItkImage->Allocate();
@@ -204,14 +253,16 @@ template<typename T> bool vtkSlicerRtCommon::ConvertVtkOrientedImageDataToItkIma
     vtkErrorWithObjectMacro(inImageData, "ConvertVtkOrientedImageDataToItkImage: Failed to allocate memory for the image conversion: " << err.GetDescription())
     return false;
   }
-
-  imageExport->Export( outItkImage->GetBufferPointer() );
+  if (numberOfVoxels > 0)
+  {
+    memcpy(outItkImage->GetBufferPointer(), inScalars->GetVoidPointer(0), numberOfVoxels * sizeof(T));
+  }
 
   return true;
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType)
+template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVtkImageData(typename itk::Image<T, 3>::Pointer inItkImage, vtkImageData* outVtkImageData, int vtkType, bool shareBuffer/*=false*/)
 {
   if ( outVtkImageData == NULL )
   {
@@ -225,27 +276,43 @@ template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVtkImageData(typen
     return false; 
   }
 
+  if ( vtkDataArray::GetDataTypeSize(vtkType) != static_cast<int>(sizeof(T)) )
+  {
+    vtkErrorWithObjectMacro(outVtkImageData, "ConvertItkImageToVtkImageData: Requested VTK type has a different scalar size than input type!");
+    return false; 
+  }
+
   typename itk::Image<T, 3>::RegionType region = inItkImage->GetBufferedRegion();
   typename itk::Image<T, 3>::SizeType imageSize = region.GetSize();
   int extent[6]={0, (int) imageSize[0]-1, 0, (int) imageSize[1]-1, 0, (int) imageSize[2]-1};
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(region.GetNumberOfPixels());
+
+  // Let the VTK image use the ITK pixel buffer if requested. The data array keeps a reference to
+  // the ITK pixel container, so the buffer is released when both images are done with it
+  if (shareBuffer && numberOfVoxels > 0 && inItkImage->GetPixelContainer())
+  {
+    vtkSmartPointer<vtkDataArray> outScalars = vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(vtkType));
+    outScalars->SetNumberOfComponents(1);
+    outScalars->SetVoidArray(inItkImage->GetBufferPointer(), numberOfVoxels, 1);
+    vtkSlicerRtCommon::AttachItkPixelContainer(outScalars, inItkImage->GetPixelContainer());
+    outVtkImageData->SetExtent(extent);
+    outVtkImageData->GetPointData()->SetScalars(outScalars);
+    return true;
+  }
+
+  // Copy the voxels. Both images store the voxels contiguously in x-y-z order
   outVtkImageData->SetExtent(extent);
   outVtkImageData->AllocateScalars(vtkType, 1);
-
-  T* outVtkImageDataPtr = (T*)outVtkImageData->GetScalarPointer();
-  typename itk::ImageRegionIteratorWithIndex< itk::Image<T, 3> > itInItkImage(
-    inItkImage, inItkImage->GetLargestPossibleRegion() );
-  for ( itInItkImage.GoToBegin(); !itInItkImage.IsAtEnd(); ++itInItkImage )
+  if (numberOfVoxels > 0)
   {
-    typename itk::Image<T, 3>::IndexType i = itInItkImage.GetIndex();
-    (*outVtkImageDataPtr) = inItkImage->GetPixel(i);
-    outVtkImageDataPtr++;
+    memcpy(outVtkImageData->GetScalarPointer(), inItkImage->GetBufferPointer(), numberOfVoxels * sizeof(T));
   }
 
   return true;
 }
 
 //----------------------------------------------------------------------------
-template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion/*=true*/)
+template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion/*=true*/, bool shareBuffer/*=false*/)
 {
   if (outVolumeNode == NULL)
   {
@@ -285,7 +352,7 @@ template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVolumeNode(typenam
   }
   
   // Convert ITK image to the VTK image data member of the output volume node
-  if (!vtkSlicerRtCommon::ConvertItkImageToVtkImageData<T>(inItkImage, outImageData, vtkType))
+  if (!vtkSlicerRtCommon::ConvertItkImageToVtkImageData<T>(inItkImage, outImageData, vtkType, shareBuffer))
   {
     vtkErrorWithObjectMacro(outVolumeNode, "ConvertItkImageToVolumeNode: Failed to convert ITK image to VTK image data");
     return false; 
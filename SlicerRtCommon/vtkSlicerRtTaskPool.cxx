@@ -0,0 +1,265 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSlicerRtTaskPool.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerRtTaskPool);
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTaskPool::vtkSlicerRtTaskPool()
+{
+  this->TaskFunction = NULL;
+  this->TaskUserData = NULL;
+  this->ProgressFunction = NULL;
+  this->ProgressUserData = NULL;
+  this->NumberOfThreads = 0;
+  this->ProgressInterval = 50;
+
+  this->NumberOfTasks = 0;
+  this->NextTaskIndex = 0;
+  this->NumberOfCompletedTasks = 0;
+  this->NumberOfRunningThreads = 0;
+  this->CancelRequested = false;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtTaskPool::~vtkSlicerRtTaskPool()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTaskPool::SetTaskFunction(TaskFunctionType taskFunction, void* userData)
+{
+  this->TaskFunction = taskFunction;
+  this->TaskUserData = userData;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTaskPool::SetProgressFunction(ProgressFunctionType progressFunction, void* userData)
+{
+  this->ProgressFunction = progressFunction;
+  this->ProgressUserData = userData;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(int numberOfThreads, int numberOfTasks)
+{
+  if (numberOfThreads <= 0)
+  {
+    numberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  }
+  numberOfThreads = std::min(numberOfThreads, vtkMultiThreader::GetGlobalMaximumNumberOfThreads());
+  return std::max(1, std::min(numberOfThreads, numberOfTasks));
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTaskPool::ExecuteTasks(int numberOfTasks, TaskFunctionType taskFunction, void* userData, int numberOfThreads)
+{
+  vtkSmartPointer<vtkSlicerRtTaskPool> taskPool = vtkSmartPointer<vtkSlicerRtTaskPool>::New();
+  taskPool->SetTaskFunction(taskFunction, userData);
+  taskPool->SetNumberOfThreads(numberOfThreads);
+  taskPool->Execute(numberOfTasks);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerRtTaskPool::Execute(int numberOfTasks)
+{
+  if (!this->TaskFunction)
+  {
+    vtkErrorMacro("Execute: No task function is set");
+    return false;
+  }
+
+  this->Lock.Lock();
+  this->NumberOfTasks = std::max(numberOfTasks, 0);
+  this->NextTaskIndex = 0;
+  this->NumberOfCompletedTasks = 0;
+  this->CancelRequested = false;
+  this->Lock.Unlock();
+
+  int numberOfThreads = vtkSlicerRtTaskPool::GetNumberOfThreadsToUse(this->NumberOfThreads, this->NumberOfTasks);
+  if (numberOfThreads == 1)
+  {
+    // Serial processing on the calling thread
+    this->NumberOfRunningThreads = 1;
+    for (int taskIndex=0; taskIndex<this->NumberOfTasks; ++taskIndex)
+    {
+      this->Lock.Lock();
+      bool cancelRequested = this->CancelRequested;
+      this->Lock.Unlock();
+      if (cancelRequested)
+      {
+        break;
+      }
+
+      this->TaskFunction(this->TaskUserData, taskIndex);
+
+      this->Lock.Lock();
+      int numberOfCompletedTasks = ++this->NumberOfCompletedTasks;
+      this->Lock.Unlock();
+      if (this->ProgressFunction)
+      {
+        this->ProgressFunction(this->ProgressUserData, numberOfCompletedTasks, this->NumberOfTasks);
+      }
+    }
+    this->NumberOfRunningThreads = 0;
+  }
+  else if (!this->ProgressFunction)
+  {
+    // The calling thread is one of the workers
+    this->NumberOfRunningThreads = numberOfThreads;
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(vtkSlicerRtTaskPool::ThreadFunction, this);
+    threader->SingleMethodExecute();
+  }
+  else
+  {
+    // The calling thread reports progress (and may process events) while the workers run
+    vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+    std::vector<int> threadIds;
+    this->Lock.Lock();
+    this->NumberOfRunningThreads = numberOfThreads;
+    this->Lock.Unlock();
+    for (int thread=0; thread<numberOfThreads; ++thread)
+    {
+      int threadId = threader->SpawnThread(vtkSlicerRtTaskPool::ThreadFunction, this);
+      if (threadId < 0)
+      {
+        vtkWarningMacro("Execute: Failed to start worker thread, using " << threadIds.size() << " threads");
+        this->Lock.Lock();
+        --this->NumberOfRunningThreads;
+        this->Lock.Unlock();
+        continue;
+      }
+      threadIds.push_back(threadId);
+    }
+    if (threadIds.empty())
+    {
+      // Process the tasks on the calling thread if no worker could be started
+      this->Lock.Lock();
+      this->NumberOfRunningThreads = 1;
+      this->Lock.Unlock();
+      this->ProcessTasks();
+    }
+
+    while (true)
+    {
+      this->Lock.Lock();
+      int numberOfRunningThreads = this->NumberOfRunningThreads;
+      int numberOfCompletedTasks = this->NumberOfCompletedTasks;
+      this->Lock.Unlock();
+
+      this->ProgressFunction(this->ProgressUserData, numberOfCompletedTasks, this->NumberOfTasks);
+      if (numberOfRunningThreads == 0)
+      {
+        break;
+      }
+      vtksys::SystemTools::Delay(this->ProgressInterval);
+    }
+
+    // Join the workers (they have all returned from the thread function by now)
+    for (std::vector<int>::iterator threadIt = threadIds.begin(); threadIt != threadIds.end(); ++threadIt)
+    {
+      threader->TerminateThread(*threadIt);
+    }
+  }
+
+  this->Lock.Lock();
+  bool allTasksCompleted = (this->NumberOfCompletedTasks == this->NumberOfTasks);
+  this->Lock.Unlock();
+  return allTasksCompleted;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerRtTaskPool::ThreadFunction(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkSlicerRtTaskPool* self = static_cast<vtkSlicerRtTaskPool*>(threadInfo->UserData);
+  self->ProcessTasks();
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTaskPool::ProcessTasks()
+{
+  while (true)
+  {
+    // Take the next unprocessed task (tasks may take very different time, so they are not split up in advance)
+    this->Lock.Lock();
+    int taskIndex = -1;
+    if (!this->CancelRequested && this->NextTaskIndex < this->NumberOfTasks)
+    {
+      taskIndex = this->NextTaskIndex++;
+    }
+    this->Lock.Unlock();
+    if (taskIndex < 0)
+    {
+      break;
+    }
+
+    this->TaskFunction(this->TaskUserData, taskIndex);
+
+    this->Lock.Lock();
+    ++this->NumberOfCompletedTasks;
+    this->Lock.Unlock();
+  }
+
+  this->Lock.Lock();
+  --this->NumberOfRunningThreads;
+  this->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTaskPool::Cancel()
+{
+  this->Lock.Lock();
+  this->CancelRequested = true;
+  this->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtTaskPool::GetNumberOfCompletedTasks()
+{
+  this->Lock.Lock();
+  int numberOfCompletedTasks = this->NumberOfCompletedTasks;
+  this->Lock.Unlock();
+  return numberOfCompletedTasks;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtTaskPool::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "ProgressInterval: " << this->ProgressInterval << "\n";
+}
@@ -0,0 +1,135 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSlicerRtTaskPool_h
+#define __vtkSlicerRtTaskPool_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkObject.h>
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Process a list of independent tasks on a pool of threads
+///
+/// The tasks are identified by their index. The threads take the next unprocessed task from the list
+/// until there are no more, so tasks that take very different time are distributed evenly.
+/// The task function must only access data that belongs to the task (or is read-only while the tasks
+/// are processed); writing the results to the task and merging them afterwards keeps the result
+/// independent of the number of threads.
+///
+/// Number of threads: 1 means serial processing on the calling thread, 0 or negative means using as many
+/// threads as there are processor cores. The number of threads never exceeds the number of tasks.
+///
+/// If a progress function is set, then the tasks are processed by worker threads, and the calling thread
+/// calls the progress function periodically until all the workers finish. The progress function may call
+/// \sa Cancel, after which no new task is started. All tasks are finished and all workers are joined
+/// when \sa Execute returns.
+///
+/// This class CANNOT be a part of the VTK pipeline (as a filter).
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtTaskPool : public vtkObject
+{
+public:
+  /// Function processing the task with the given index
+  typedef void (*TaskFunctionType)(void* userData, int taskIndex);
+  /// Function called on the calling thread while the tasks are processed
+  typedef void (*ProgressFunctionType)(void* userData, int numberOfCompletedTasks, int numberOfTasks);
+
+public:
+  static vtkSlicerRtTaskPool* New();
+  vtkTypeMacro(vtkSlicerRtTaskPool, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set function processing the tasks and the data passed to it
+  void SetTaskFunction(TaskFunctionType taskFunction, void* userData);
+
+  /// Set function reporting progress on the calling thread and the data passed to it. NULL (default) means no progress reporting
+  void SetProgressFunction(ProgressFunctionType progressFunction, void* userData);
+
+  /// Set number of threads. 0 (default) means as many threads as processor cores, 1 means serial processing
+  vtkSetMacro(NumberOfThreads, int);
+  /// Get number of threads
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Set time between the calls of the progress function in milliseconds
+  vtkSetMacro(ProgressInterval, unsigned int);
+  /// Get time between the calls of the progress function in milliseconds
+  vtkGetMacro(ProgressInterval, unsigned int);
+
+  /// Process tasks with index 0 to numberOfTasks-1. Returns when all started tasks are finished
+  /// \return True if all tasks were processed, false if the processing was cancelled
+  bool Execute(int numberOfTasks);
+
+  /// Stop starting new tasks. Tasks in progress are finished. Can be called from any thread
+  void Cancel();
+
+  /// Get number of tasks finished by the last (or current) execution. Can be called from any thread
+  int GetNumberOfCompletedTasks();
+
+  /// Get number of threads actually used for the given number of tasks
+  /// \param numberOfThreads Requested number of threads (0 or negative means as many as processor cores)
+  /// \param numberOfTasks Number of tasks to process
+  static int GetNumberOfThreadsToUse(int numberOfThreads, int numberOfTasks);
+
+  /// Convenience function for processing tasks without progress reporting
+  static void ExecuteTasks(int numberOfTasks, TaskFunctionType taskFunction, void* userData, int numberOfThreads);
+
+protected:
+  /// Process tasks until there is none left or the processing is cancelled
+  void ProcessTasks();
+
+  /// Thread function of the workers
+  static VTK_THREAD_RETURN_TYPE ThreadFunction(void* arg);
+
+protected:
+  vtkSlicerRtTaskPool();
+  virtual ~vtkSlicerRtTaskPool();
+
+protected:
+  /// Task function and its data
+  TaskFunctionType TaskFunction;
+  void* TaskUserData;
+
+  /// Progress function and its data
+  ProgressFunctionType ProgressFunction;
+  void* ProgressUserData;
+
+  /// Requested number of threads
+  int NumberOfThreads;
+
+  /// Time between the calls of the progress function in milliseconds. Default is 50
+  unsigned int ProgressInterval;
+
+  /// State of the current execution, guarded by the lock
+  int NumberOfTasks;
+  int NextTaskIndex;
+  int NumberOfCompletedTasks;
+  int NumberOfRunningThreads;
+  bool CancelRequested;
+  vtkSimpleMutexLock Lock;
+
+private:
+  vtkSlicerRtTaskPool(const vtkSlicerRtTaskPool&); // Not implemented
+  void operator=(const vtkSlicerRtTaskPool&);      // Not implemented
+};
+
+#endif
@@ -27,6 +27,7 @@
 #include <vtkMatrix4x4.h>
 #include <vtkImageShiftScale.h>
 #include <vtkObjectFactory.h>
+#include <vtkCommand.h>
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -44,6 +45,11 @@
 #include <algorithm>
 #include <cctype>
 #include <functional>
+#include <cstring>
+
+//----------------------------------------------------------------------------
+// Maximum number of bytes read from the file at once. Image data is read in slabs of whole slices of this size
+static const vtkIdType VFF_READ_CHUNK_SIZE_BYTES = 64 * 1024 * 1024;
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerVffFileReaderLogic);
@@ -499,15 +505,28 @@ void vtkSlicerVffFileReaderLogic::LoadVffFile(char *filename, bool useImageInten
     if (parameterMissing == false && parameterInvalidValue == false)
     {
       // Calculates the number of bytes to read based on some of the specified parameters
-      long bytesToRead = 1;
-      bytesToRead = bands*bits/8;
-      int sizeOfImageData = (int)size[0]*size[1]*size[2]*(bits/8);
+      int bytesPerVoxel = bands*bits/8;
+      vtkIdType sizeOfImageData = (vtkIdType)size[0]*size[1]*size[2]*bytesPerVoxel;
 
       if (rawsize != sizeOfImageData)
       {
         vtkWarningMacro("LoadVffFile: The specified size from the parameters does not match the specified raw size.");
       }
 
+      // Scalar type of the image data is determined by the number of bits per voxel
+      int scalarType = VTK_VOID;
+      switch (bits)
+      {
+        case 8: scalarType = VTK_UNSIGNED_CHAR; break;
+        case 16: scalarType = VTK_SHORT; break;
+        case 32: scalarType = VTK_FLOAT; break;
+        case 64: scalarType = VTK_DOUBLE; break;
+        default:
+          vtkErrorMacro("LoadVffFile: Unsupported number of bits: " << bits << ". Supported values are 8, 16, 32, and 64.");
+          readFileStream.close();
+          return;
+      }
+
       vtkSmartPointer<vtkMRMLScalarVolumeNode> vffVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
       vffVolumeNode->SetScene(this->GetMRMLScene());
       vffVolumeNode->SetName(name.c_str());
@@ -530,75 +549,37 @@ void vtkSlicerVffFileReaderLogic::LoadVffFile(char *filename, bool useImageInten
         vffVolumeNode->SetAttribute("Date", date.c_str());
       }
 
-      vtkSmartPointer<vtkImageData> floatVffVolumeData = vtkSmartPointer<vtkImageData>::New();
-      floatVffVolumeData->SetExtent(0, size[0]-1, 0, size[1]-1, 0, size[2]-1);
-      floatVffVolumeData->SetSpacing(1, 1, 1);
-      floatVffVolumeData->SetOrigin(0, 0, 0);
-      floatVffVolumeData->AllocateScalars(VTK_FLOAT, bands);
+      vtkSmartPointer<vtkImageData> vffVolumeData = vtkSmartPointer<vtkImageData>::New();
+      vffVolumeData->SetExtent(0, size[0]-1, 0, size[1]-1, 0, size[2]-1);
+      vffVolumeData->SetSpacing(1, 1, 1);
+      vffVolumeData->SetOrigin(0, 0, 0);
+      vffVolumeData->AllocateScalars(scalarType, bands);
 
       // Reads the line feed that comes directly before the image data from the file
       readFileStream.get();
 
-      float* floatPtr = (float*)floatVffVolumeData->GetScalarPointer();
-      std::stringstream ss;
-
-      // The size of the image data read is specified in the header by the parameter size
-      for (long x = 0; x < size[0]; x++)
+      // Reads the image data directly into the scalar buffer of the image
+      if (!this->ReadVffImageData(readFileStream, vffVolumeData))
       {
-        for (long y = 0; y < size[1]; y++)
-        {
-          for (long z = 0; z < size[2]; z++)
-          {
-            if (!readFileStream.eof())
-            {
-              // Reads in the specified number of bytes at a time from the file
-              char *buffer = new char[bytesToRead];
-              char *newBuffer = new char[bytesToRead];
-              readFileStream.read(buffer, bytesToRead);
-
-              // Checks that the correct number of bytes were read from the file
-              if (readFileStream.gcount() == bytesToRead) 
-              { 
-                float *valueFromFile = (float *) newBuffer;
-
-                // Reverses the byte order
-                for (int byte=0; byte<bytesToRead; ++byte)
-                {
-                  newBuffer[byte] = buffer[bytesToRead-byte-1];
-                }
-                (*floatPtr) = (*valueFromFile);
-                ++floatPtr;
-              }
-              else
-              {
-                vtkErrorMacro("LoadVffFile: The end of the file was reached earlier than specified.");
-              }
-            }
-            else
-            {
-              vtkErrorMacro("LoadVffFile: The end of the file was reached earlier than specified.");
-            }
-          }
-        }
+        vtkErrorMacro("LoadVffFile: The end of the file was reached earlier than specified.");
       }
-      
-      if (readFileStream.get() && !readFileStream.eof())
+      else if (readFileStream.get() && !readFileStream.eof())
       {
         vtkWarningMacro("LoadVffFile: The end of the file was not reached.");
       }
-      
-      
+
       if (useImageIntensityScaleAndOffsetFromFile == true)
       {
         vtkSmartPointer<vtkImageShiftScale> imageIntensityShiftScale = vtkSmartPointer<vtkImageShiftScale>::New();
         imageIntensityShiftScale->SetScale(data_scale);
         imageIntensityShiftScale->SetShift(data_offset);
-        imageIntensityShiftScale->SetInputData(floatVffVolumeData);
+        imageIntensityShiftScale->SetOutputScalarTypeToFloat();
+        imageIntensityShiftScale->SetInputData(vffVolumeData);
         imageIntensityShiftScale->Update();
-        floatVffVolumeData = imageIntensityShiftScale->GetOutput();
+        vffVolumeData = imageIntensityShiftScale->GetOutput();
       }
 
-      vffVolumeNode->SetAndObserveImageData(floatVffVolumeData);
+      vffVolumeNode->SetAndObserveImageData(vffVolumeData);
 
       vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> vffVolumeDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
       this->GetMRMLScene()->AddNode(vffVolumeDisplayNode);
@@ -632,3 +613,96 @@ void vtkSlicerVffFileReaderLogic::LoadVffFile(char *filename, bool useImageInten
     
   readFileStream.close();
 }
+
+//----------------------------------------------------------------------------
+bool vtkSlicerVffFileReaderLogic::ReadVffImageData(ifstream &readFileStream, vtkImageData* imageData)
+{
+  int* dimensions = imageData->GetDimensions();
+  int bytesPerValue = imageData->GetScalarSize();
+  vtkIdType bytesPerSlice = (vtkIdType)dimensions[0] * dimensions[1] * imageData->GetNumberOfScalarComponents() * bytesPerValue;
+  if (bytesPerSlice <= 0 || dimensions[2] <= 0)
+  {
+    return true;
+  }
+
+  // Read in slabs of whole slices that fit in the chunk size (at least one slice)
+  int slicesPerSlab = (int)std::max((vtkIdType)1, VFF_READ_CHUNK_SIZE_BYTES / bytesPerSlice);
+  char* scalarPointer = static_cast<char*>(imageData->GetScalarPointer());
+
+  for (int slabStartSlice = 0; slabStartSlice < dimensions[2]; slabStartSlice += slicesPerSlab)
+  {
+    int numberOfSlicesInSlab = std::min(slicesPerSlab, dimensions[2] - slabStartSlice);
+    char* slabPointer = scalarPointer + slabStartSlice * bytesPerSlice;
+    vtkIdType bytesInSlab = numberOfSlicesInSlab * bytesPerSlice;
+
+    readFileStream.read(slabPointer, bytesInSlab);
+    vtkIdType bytesRead = (vtkIdType)readFileStream.gcount();
+    if (bytesRead < bytesInSlab)
+    {
+      // Set voxels missing from the file to zero
+      vtkIdType bytesInImage = dimensions[2] * bytesPerSlice;
+      memset(slabPointer + bytesRead, 0, bytesInImage - slabStartSlice * bytesPerSlice - bytesRead);
+      SwapBigEndianValues(slabPointer, bytesRead / bytesPerValue, bytesPerValue);
+      return false;
+    }
+
+    // Swap while the slab is still in the cache
+    SwapBigEndianValues(slabPointer, bytesInSlab / bytesPerValue, bytesPerValue);
+
+    double progress = (double)(slabStartSlice + numberOfSlicesInSlab) / dimensions[2];
+    this->InvokeEvent(vtkCommand::ProgressEvent, (void*)&progress);
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerVffFileReaderLogic::SwapBigEndianValues(void* data, vtkIdType numberOfValues, int bytesPerValue)
+{
+#ifndef VTK_WORDS_BIGENDIAN
+  // Loops of shifts on unsigned integers are vectorized by the compilers (byte shuffle instructions)
+  switch (bytesPerValue)
+  {
+    case 2:
+    {
+      vtkTypeUInt16* values = static_cast<vtkTypeUInt16*>(data);
+      for (vtkIdType i = 0; i < numberOfValues; ++i)
+      {
+        vtkTypeUInt16 value = values[i];
+        values[i] = (vtkTypeUInt16)((value >> 8) | (value << 8));
+      }
+      break;
+    }
+    case 4:
+    {
+      vtkTypeUInt32* values = static_cast<vtkTypeUInt32*>(data);
+      for (vtkIdType i = 0; i < numberOfValues; ++i)
+      {
+        vtkTypeUInt32 value = values[i];
+        values[i] = (value >> 24) | ((value >> 8) & 0x0000FF00u) | ((value << 8) & 0x00FF0000u) | (value << 24);
+      }
+      break;
+    }
+    case 8:
+    {
+      vtkTypeUInt32* values = static_cast<vtkTypeUInt32*>(data);
+      for (vtkIdType i = 0; i < numberOfValues; ++i)
+      {
+        // Swap the bytes of the two halves and exchange the halves
+        vtkTypeUInt32 low = values[2*i];
+        vtkTypeUInt32 high = values[2*i+1];
+        values[2*i] = (high >> 24) | ((high >> 8) & 0x0000FF00u) | ((high << 8) & 0x00FF0000u) | (high << 24);
+        values[2*i+1] = (low >> 24) | ((low >> 8) & 0x0000FF00u) | ((low << 8) & 0x00FF0000u) | (low << 24);
+      }
+      break;
+    }
+    default:
+      // Single byte values do not need swapping
+      break;
+  }
+#else
+  (void)data;
+  (void)numberOfValues;
+  (void)bytesPerValue;
+#endif
+}
@@ -31,6 +31,7 @@
 // VffFileReader includes
 #include "vtkSlicerVffFileReaderLogicExport.h"
 
+class vtkImageData;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLScalarVolumeDisplayNode;
 class vtkMRMLVolumeHeaderlessStorageNode;
@@ -64,6 +65,20 @@ protected:
 
   bool ReadVffFileHeader(ifstream &readFileStream, std::map<std::string, std::string> &parameterList);
 
+  /// Read image data from the current position of the file stream directly into the scalar buffer of an allocated image.
+  /// Data is read in slabs of whole slices, byte-swapped from big endian in place, and progress is reported per slab
+  /// using vtkCommand::ProgressEvent.
+  /// \param readFileStream File stream positioned at the first byte of the image data
+  /// \param imageData Image with allocated scalars defining the size and type of the data to read
+  /// \return False if the file ended before the image was filled (missing voxels are set to zero)
+  bool ReadVffImageData(ifstream &readFileStream, vtkImageData* imageData);
+
+  /// Convert big endian values to the byte order of the machine in place
+  /// \param data Pointer to the first value
+  /// \param numberOfValues Number of values to convert
+  /// \param bytesPerValue Size of a value in bytes (1, 2, 4, or 8)
+  static void SwapBigEndianValues(void* data, vtkIdType numberOfValues, int bytesPerValue);
+
 protected:
   vtkSlicerVffFileReaderLogic();
   virtual ~vtkSlicerVffFileReaderLogic();